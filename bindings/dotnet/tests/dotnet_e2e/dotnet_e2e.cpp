@@ -275,6 +275,8 @@ TEST_FUNCTION(GW_dotnet_binding_e2e_Managed2Managed)
     GATEWAY_PROPERTIES properties;
     properties.gateway_modules = VECTOR_create(sizeof(GATEWAY_MODULES_ENTRY));
     properties.gateway_links = VECTOR_create(sizeof(GATEWAY_LINK_ENTRY));
+    properties.broker_config = NULL;
+    properties.message_pool_config = NULL;
     ASSERT_IS_NOT_NULL(properties.gateway_modules);
     ASSERT_IS_NOT_NULL(properties.gateway_links);
     VECTOR_push_back(properties.gateway_modules, modulesEntryArray, 3);
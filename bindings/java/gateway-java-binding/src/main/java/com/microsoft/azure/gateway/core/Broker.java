@@ -29,6 +29,19 @@ public class Broker {
      */
     private native int publishMessage(long brokerAddr, long moduleAddr, byte[] message);
 
+    /**
+     * Native Broker_PublishBatch function. Publishes all the provided serialized {@link Message}s with a single call
+     * into the native Broker.
+     *
+     * @see <a href="https://github.com/Azure/azure-iot-gateway-sdk/blob/master/core/devdoc/message_broker_requirements.md" target="_top">Message broker documentation</a>
+     *
+     * @param brokerAddr The address of the pointer to the native Broker.
+     * @param moduleAddr The address of the pointer to the native module.
+     * @param messages The serialized {@link Message}s to be published, in order.
+     * @return 0 on success, non-zero otherwise.
+     */
+    private native int publishMessages(long brokerAddr, long moduleAddr, byte[][] messages);
+
     private long _brokerAddr;
 
     public Broker(long addr){
@@ -49,6 +62,24 @@ public class Broker {
         return this.publishMessage(this._brokerAddr, moduleAddr, message.toByteArray());
     }
 
+    /**
+     * Publishes the {@link Message}s to the {@link Broker} in order, crossing into native code only once.
+     *
+     * @see <a href="https://github.com/Azure/azure-iot-gateway-sdk/blob/master/core/devdoc/message_broker_requirements.md" target="_top">Message broker documentation</a>
+     *
+     * @param moduleAddr The address of the pointer to the native module.
+     * @param messages The {@link Message}s to be published.
+     * @return 0 on success, non-zero otherwise.
+     * @throws IOException If any {@link Message} cannot be serialized.
+     */
+    public int publishMessages(Message[] messages, long moduleAddr) throws IOException {
+        byte[][] serializedMessages = new byte[messages.length][];
+        for (int i = 0; i < messages.length; i++) {
+            serializedMessages[i] = messages[i].toByteArray();
+        }
+        return this.publishMessages(this._brokerAddr, moduleAddr, serializedMessages);
+    }
+
     public long getAddress(){
         return this._brokerAddr;
     }
@@ -68,6 +68,17 @@ public abstract class GatewayModule implements IGatewayModule{
         return this.broker.publishMessage(message, this._addr);
     }
 
+    /**
+     * Publishes the {@link Message}s to the {@link Broker} in order, with a single call into native code.
+     *
+     * @param messages The {@link Message}s to be published
+     * @return 0 on success, non-zero otherwise. See <a href="https://github.com/Azure/azure-iot-gateway-sdk/blob/master/core/devdoc/message_broker_requirements.md" target="_top">Message broker documentation</a>.
+     * @throws IOException If any {@link Message} cannot be serialized.
+     */
+    public int publish(Message[] messages) throws IOException {
+        return this.broker.publishMessages(messages, this._addr);
+    }
+
     //Public getter methods
 
     final public Broker getBroker(){
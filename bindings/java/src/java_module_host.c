@@ -548,6 +548,106 @@ JNIEXPORT jint JNICALL Java_com_microsoft_azure_gateway_core_Broker_publishMessa
     return result;
 }
 
+/*creates a message from one serialized message of a jobjectArray; returns NULL on failure*/
+static MESSAGE_HANDLE create_message_from_array_element(JNIEnv* env, jobjectArray serialized_messages, jsize index)
+{
+    MESSAGE_HANDLE result = NULL;
+    jbyteArray serialized_message = (jbyteArray)JNIFunc(env, GetObjectArrayElement, serialized_messages, index);
+    if (serialized_message == NULL)
+    {
+        LogError("Serialized message %d is NULL.", (int)index);
+    }
+    else
+    {
+        size_t length = JNIFunc(env, GetArrayLength, serialized_message);
+        if (length == 0)
+        {
+            LogError("Serialized message %d length is 0.", (int)index);
+        }
+        else
+        {
+            unsigned char* arr = (unsigned char*)malloc(length);
+            if (arr == NULL)
+            {
+                LogError("Malloc failure.");
+            }
+            else
+            {
+                JNIFunc(env, GetByteArrayRegion, serialized_message, 0, length, arr);
+                jthrowable exception = JNIFunc(env, ExceptionOccurred);
+                if (exception)
+                {
+                    LogError("Exception occured in GetByteArrayRegion.");
+                    JNIFunc(env, ExceptionDescribe);
+                    JNIFunc(env, ExceptionClear);
+                }
+                else
+                {
+                    result = Message_CreateFromByteArray(arr, length);
+                    if (result == NULL)
+                    {
+                        LogError("Message %d could not be created from byte array.", (int)index);
+                    }
+                }
+                free(arr);
+            }
+        }
+        JNIFunc(env, DeleteLocalRef, serialized_message);
+    }
+    return result;
+}
+
+JNIEXPORT jint JNICALL Java_com_microsoft_azure_gateway_core_Broker_publishMessages(JNIEnv* env, jobject jBroker, jlong broker_address, jlong module_address, jobjectArray serialized_messages)
+{
+    /*Codes_SRS_JAVA_MODULE_HOST_30_001: [ This function shall return a non-zero value if the array is empty or any underlying function call fails. ]*/
+    BROKER_RESULT result = BROKER_ERROR;
+
+    BROKER_HANDLE broker = (BROKER_HANDLE)broker_address;
+    MODULE_HANDLE module = (MODULE_HANDLE)module_address;
+
+    jsize count = JNIFunc(env, GetArrayLength, serialized_messages);
+    if (count <= 0)
+    {
+        LogError("Serialized message array is empty.");
+    }
+    else
+    {
+        MESSAGE_HANDLE* messages = (MESSAGE_HANDLE*)malloc(count * sizeof(MESSAGE_HANDLE));
+        if (messages == NULL)
+        {
+            LogError("Malloc failure.");
+        }
+        else
+        {
+            /*Codes_SRS_JAVA_MODULE_HOST_30_002: [ This function shall create a message from every jbyteArray of the array, as `publishMessage` does. ]*/
+            jsize created;
+            for (created = 0; created < count; created++)
+            {
+                messages[created] = create_message_from_array_element(env, serialized_messages, created);
+                if (messages[created] == NULL)
+                {
+                    break;
+                }
+            }
+
+            if (created == count)
+            {
+                /*Codes_SRS_JAVA_MODULE_HOST_30_003: [ This function shall publish all the messages with a single call to `Broker_PublishBatch` and return its result. ]*/
+                result = Broker_PublishBatch(broker, module, messages, (size_t)count);
+            }
+
+            /*Codes_SRS_JAVA_MODULE_HOST_30_004: [ This function shall destroy the messages it created. ]*/
+            for (jsize i = 0; i < created; i++)
+            {
+                Message_Destroy(messages[i]);
+            }
+            free(messages);
+        }
+    }
+
+    return result;
+}
+
 //Internal functions
 static jmethodID get_module_method(JAVA_MODULE_HANDLE_DATA* module, const char* method_name, const char* method_descriptor)
 {
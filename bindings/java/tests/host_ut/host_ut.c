@@ -122,6 +122,7 @@ void my_Message_Destroy(MESSAGE_HANDLE message)
 
 //Broker mocks
 MOCKABLE_FUNCTION(, BROKER_RESULT, Broker_Publish, BROKER_HANDLE, broker, MODULE_HANDLE, source, MESSAGE_HANDLE, message);
+MOCKABLE_FUNCTION(, BROKER_RESULT, Broker_PublishBatch, BROKER_HANDLE, broker, MODULE_HANDLE, source, MESSAGE_HANDLE*, messages, size_t, message_count);
 
 //JEnv function mocks
 MOCKABLE_FUNCTION(JNICALL, jclass, FindClass, JNIEnv*, env, const char*, name);
@@ -168,6 +169,12 @@ jsize my_GetArrayLength(JNIEnv* env, jarray arr)
     return sizeof(arr);
 }
 
+MOCKABLE_FUNCTION(JNICALL, jobject, GetObjectArrayElement, JNIEnv*, env, jobjectArray, array, jsize, index);
+jobject my_GetObjectArrayElement(JNIEnv* env, jobjectArray array, jsize index)
+{
+    return (jobject)malloc(1);
+}
+
 MOCKABLE_FUNCTION(JNICALL, void, GetByteArrayRegion, JNIEnv*, env, jbyteArray, arr, jsize, start, jsize, len, jbyte*, buf);
 
 MOCKABLE_FUNCTION(JNICALL, void, DeleteLocalRef, JNIEnv*, env, jobject, obj);
@@ -260,7 +267,7 @@ jint mock_JNI_CreateJavaVM(JavaVM** pvm, void** penv, void* args)
             NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
             NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
             NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-            NULL, NULL, NULL, NewStringUTF, NULL, NULL, NULL, GetArrayLength, NULL, NULL,
+            NULL, NULL, NULL, NewStringUTF, NULL, NULL, NULL, GetArrayLength, NULL, GetObjectArrayElement,
             NULL, NULL, NewByteArray, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
             NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
             NULL, NULL, NULL, NULL, NULL, NULL, GetByteArrayRegion, NULL, NULL, NULL,
@@ -592,6 +599,7 @@ TEST_SUITE_INITIALIZE(TestClassInitialize)
     REGISTER_GLOBAL_MOCK_HOOK(NewByteArray, my_NewByteArray);
     REGISTER_GLOBAL_MOCK_HOOK(GetArrayLength, my_GetArrayLength);
     REGISTER_GLOBAL_MOCK_HOOK(DeleteLocalRef, my_DeleteLocalRef);
+    REGISTER_GLOBAL_MOCK_HOOK(GetObjectArrayElement, my_GetObjectArrayElement);
     REGISTER_GLOBAL_MOCK_HOOK(NewGlobalRef, my_NewGlobalRef);
     REGISTER_GLOBAL_MOCK_HOOK(DeleteGlobalRef, my_DeleteGlobalRef);
     REGISTER_GLOBAL_MOCK_HOOK(ExceptionOccurred, my_ExceptionOccurred);
@@ -641,6 +649,7 @@ TEST_SUITE_INITIALIZE(TestClassInitialize)
     REGISTER_UMOCK_ALIAS_TYPE(MODULE_HANDLE, void*);
 
     REGISTER_UMOCK_ALIAS_TYPE(MESSAGE_HANDLE, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(MESSAGE_HANDLE*, void*);
 
     REGISTER_UMOCK_ALIAS_TYPE(STRING_HANDLE, void*);
 
@@ -660,6 +669,7 @@ TEST_SUITE_INITIALIZE(TestClassInitialize)
     REGISTER_UMOCK_ALIAS_TYPE(jsize, int);
     REGISTER_UMOCK_ALIAS_TYPE(jthrowable, int);
     REGISTER_UMOCK_ALIAS_TYPE(jbyteArray, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(jobjectArray, void*);
     REGISTER_UMOCK_ALIAS_TYPE(jsize, int);
     REGISTER_UMOCK_ALIAS_TYPE(const jbyte*, void*);
     REGISTER_UMOCK_ALIAS_TYPE(jarray, void*);
@@ -2850,6 +2860,153 @@ TEST_FUNCTION(Java_com_microsoft_azure_gateway_core_Broker_publishMessage_failur
     JavaModuleHost_Destroy(module);
 }
 
+//=============================================================================
+//Java_com_microsoft_azure_gateway_core_Broker_publishMessages tests
+//=============================================================================
+
+/*Tests_SRS_JAVA_MODULE_HOST_30_002: [ This function shall create a message from every jbyteArray of the array, as `publishMessage` does. ]*/
+/*Tests_SRS_JAVA_MODULE_HOST_30_003: [ This function shall publish all the messages with a single call to `Broker_PublishBatch` and return its result. ]*/
+/*Tests_SRS_JAVA_MODULE_HOST_30_004: [ This function shall destroy the messages it created. ]*/
+TEST_FUNCTION(Java_com_microsoft_azure_gateway_core_Broker_publishMessages_success)
+{
+    //Arrange
+    MODULE_HANDLE module = JavaModuleHost_Create((BROKER_HANDLE)0x42, &config);
+    umock_c_reset_all_calls();
+
+    jobjectArray serialized_messages = (jobjectArray)0x42;
+    jobject jBroker = (jobject)0x42;
+    jlong broker_address = (jlong)0x42;
+    BROKER_HANDLE broker = (BROKER_HANDLE)broker_address;
+    /*my_GetArrayLength returns sizeof(jarray) for every array*/
+    jsize message_count = (jsize)sizeof(jarray);
+
+    STRICT_EXPECTED_CALL(GetArrayLength(global_env, serialized_messages));
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
+        .IgnoreArgument(1);
+    for (jsize i = 0; i < message_count; i++)
+    {
+        STRICT_EXPECTED_CALL(GetObjectArrayElement(global_env, serialized_messages, i));
+        STRICT_EXPECTED_CALL(GetArrayLength(global_env, IGNORED_PTR_ARG))
+            .IgnoreArgument(2);
+        STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(GetByteArrayRegion(global_env, IGNORED_PTR_ARG, 0, IGNORED_NUM_ARG, IGNORED_PTR_ARG))
+            .IgnoreArgument(2)
+            .IgnoreArgument(4)
+            .IgnoreArgument(5);
+        STRICT_EXPECTED_CALL(ExceptionOccurred(global_env));
+        STRICT_EXPECTED_CALL(Message_CreateFromByteArray(IGNORED_PTR_ARG, IGNORED_NUM_ARG))
+            .IgnoreAllArguments();
+        STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(DeleteLocalRef(global_env, IGNORED_PTR_ARG))
+            .IgnoreArgument(2);
+    }
+    STRICT_EXPECTED_CALL(Broker_PublishBatch(broker, module, IGNORED_PTR_ARG, (size_t)message_count))
+        .IgnoreArgument(3);
+    for (jsize i = 0; i < message_count; i++)
+    {
+        STRICT_EXPECTED_CALL(Message_Destroy(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+    }
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+
+    //Act
+    jint result = Java_com_microsoft_azure_gateway_core_Broker_publishMessages(global_env, jBroker, broker_address, (jlong)module, serialized_messages);
+
+    //Assert
+    ASSERT_ARE_EQUAL(int32_t, JNI_OK, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //Cleanup
+    JavaModuleHost_Destroy(module);
+}
+
+/*Tests_SRS_JAVA_MODULE_HOST_30_001: [ This function shall return a non-zero value if the array is empty or any underlying function call fails. ]*/
+TEST_FUNCTION(Java_com_microsoft_azure_gateway_core_Broker_publishMessages_fails_for_empty_array)
+{
+    //Arrange
+    MODULE_HANDLE module = JavaModuleHost_Create((BROKER_HANDLE)0x42, &config);
+    umock_c_reset_all_calls();
+
+    jobjectArray serialized_messages = (jobjectArray)0x42;
+    jobject jBroker = (jobject)0x42;
+    jlong broker_address = (jlong)0x42;
+
+    STRICT_EXPECTED_CALL(GetArrayLength(global_env, serialized_messages))
+        .SetReturn(0);
+
+    //Act
+    jint result = Java_com_microsoft_azure_gateway_core_Broker_publishMessages(global_env, jBroker, broker_address, (jlong)module, serialized_messages);
+
+    //Assert
+    ASSERT_ARE_NOT_EQUAL(int32_t, JNI_OK, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //Cleanup
+    JavaModuleHost_Destroy(module);
+}
+
+/*Tests_SRS_JAVA_MODULE_HOST_30_001: [ This function shall return a non-zero value if the array is empty or any underlying function call fails. ]*/
+/*Tests_SRS_JAVA_MODULE_HOST_30_004: [ This function shall destroy the messages it created. ]*/
+TEST_FUNCTION(Java_com_microsoft_azure_gateway_core_Broker_publishMessages_publishes_nothing_when_a_message_cannot_be_created)
+{
+    //Arrange
+    MODULE_HANDLE module = JavaModuleHost_Create((BROKER_HANDLE)0x42, &config);
+    umock_c_reset_all_calls();
+
+    jobjectArray serialized_messages = (jobjectArray)0x42;
+    jobject jBroker = (jobject)0x42;
+    jlong broker_address = (jlong)0x42;
+
+    STRICT_EXPECTED_CALL(GetArrayLength(global_env, serialized_messages));
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
+        .IgnoreArgument(1);
+    for (jsize i = 0; i < 2; i++)
+    {
+        STRICT_EXPECTED_CALL(GetObjectArrayElement(global_env, serialized_messages, i));
+        STRICT_EXPECTED_CALL(GetArrayLength(global_env, IGNORED_PTR_ARG))
+            .IgnoreArgument(2);
+        STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(GetByteArrayRegion(global_env, IGNORED_PTR_ARG, 0, IGNORED_NUM_ARG, IGNORED_PTR_ARG))
+            .IgnoreArgument(2)
+            .IgnoreArgument(4)
+            .IgnoreArgument(5);
+        STRICT_EXPECTED_CALL(ExceptionOccurred(global_env));
+        if (i == 0)
+        {
+            STRICT_EXPECTED_CALL(Message_CreateFromByteArray(IGNORED_PTR_ARG, IGNORED_NUM_ARG))
+                .IgnoreAllArguments();
+        }
+        else
+        {
+            STRICT_EXPECTED_CALL(Message_CreateFromByteArray(IGNORED_PTR_ARG, IGNORED_NUM_ARG))
+                .IgnoreAllArguments()
+                .SetReturn(NULL);
+        }
+        STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(DeleteLocalRef(global_env, IGNORED_PTR_ARG))
+            .IgnoreArgument(2);
+    }
+    STRICT_EXPECTED_CALL(Message_Destroy(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+
+    //Act
+    jint result = Java_com_microsoft_azure_gateway_core_Broker_publishMessages(global_env, jBroker, broker_address, (jlong)module, serialized_messages);
+
+    //Assert
+    ASSERT_ARE_NOT_EQUAL(int32_t, JNI_OK, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //Cleanup
+    JavaModuleHost_Destroy(module);
+}
+
 /*Tests_SRS_JAVA_MODULE_HOST_26_001: [ `Module_GetApi` shall fill out the provided `MODULES_API` structure with required module's APIs functions. ] */
 TEST_FUNCTION(Module_GetApi_returns_non_NULL)
 {
@@ -476,6 +476,61 @@ static unsigned char* copy_contents(
     return result;
 }
 
+static MESSAGE_HANDLE create_message_from_object(
+    v8::Isolate* isolate,
+    v8::Local<v8::Context> context,
+    v8::Local<v8::Object> message_obj
+)
+{
+    MESSAGE_HANDLE result;
+
+    // create and copy the message properties
+    MAP_HANDLE message_properties = Map_Create(NULL);
+    if (message_properties == NULL)
+    {
+        LogError("Map_Create() failed");
+        result = NULL;
+    }
+    else
+    {
+        if (copy_properties_from_message(isolate, context, message_obj, message_properties) == false)
+        {
+            LogError("An error occurred when copying properties to the message handle");
+            result = NULL;
+        }
+        else
+        {
+            // copy the message contents if we have any
+            MESSAGE_CONFIG message_config;
+            message_config.sourceProperties = message_properties;
+
+            if (validate_object_prop(isolate, context, message_obj, "content") == true)
+            {
+                message_config.source = copy_contents(
+                    isolate, context, message_obj, &(message_config.size)
+                );
+            }
+            else
+            {
+                message_config.source = nullptr;
+            }
+
+            /*Codes_SRS_NODEJS_13_030: [ broker_publish shall construct and initialize a MESSAGE_HANDLE from the first argument. ]*/
+            result = Message_Create(&message_config);
+            if (result == NULL)
+            {
+                LogError("Message_Create() failed");
+            }
+
+            free((void*)message_config.source);
+        }
+
+        Map_Destroy(message_properties);
+    }
+
+    return result;
+}
+
 static void broker_publish(const v8::FunctionCallbackInfo<v8::Value>& info)
 {
     // this MUST NOT be NULL
@@ -530,71 +585,134 @@ static void broker_publish(const v8::FunctionCallbackInfo<v8::Value>& info)
             {
                 auto& handle_data = modules_manager->GetModuleFromId(module_id);
 
-                // create and copy the message properties
-                MAP_HANDLE message_properties = Map_Create(NULL);
-                if (message_properties == NULL)
+                MESSAGE_HANDLE message = create_message_from_object(isolate, context, info[0]->ToObject());
+                if (message == NULL)
                 {
                     /*Codes_SRS_NODEJS_13_031: [ broker_publish shall set the return value to false if any underlying platform call fails. ]*/
-                    LogError("Map_Create() failed");
+                    LogError("Could not create a message from the object passed to broker_publish()");
                     info.GetReturnValue().Set(false);
                 }
                 else
                 {
-                    auto message_obj = info[0]->ToObject();
-                    if (copy_properties_from_message(isolate, context, message_obj, message_properties) == false)
+                    /*Codes_SRS_NODEJS_13_032: [ broker_publish shall call Broker_Publish passing the newly constructed MESSAGE_HANDLE. ]*/
+                    if (Broker_Publish(handle_data.broker, reinterpret_cast<MODULE_HANDLE>(&handle_data), message) != BROKER_OK)
                     {
                         /*Codes_SRS_NODEJS_13_031: [ broker_publish shall set the return value to false if any underlying platform call fails. ]*/
-                        LogError("An error occurred when copying properties to the message handle");
+                        LogError("Broker_Publish() failed");
                         info.GetReturnValue().Set(false);
                     }
                     else
                     {
-                        // copy the message contents if we have any
-                        MESSAGE_CONFIG message_config;
-                        message_config.sourceProperties = message_properties;
+                        /*Codes_SRS_NODEJS_13_033: [ broker_publish shall set the return value to true or false depending on the status of the Broker_Publish call. ]*/
+                        info.GetReturnValue().Set(true);
+                    }
 
-                        if (validate_object_prop(isolate, context, message_obj, "content") == true)
-                        {
-                            message_config.source = copy_contents(
-                                isolate, context, message_obj, &(message_config.size)
-                            );
-                        }
-                        else
-                        {
-                            message_config.source = nullptr;
-                        }
+                    /*Codes_SRS_NODEJS_13_034: [ broker_publish shall destroy the MESSAGE_HANDLE. ]*/
+                    Message_Destroy(message);
+                }
+            }
+        }
+    }
+}
+
+static void broker_publish_batch(const v8::FunctionCallbackInfo<v8::Value>& info)
+{
+    // this MUST NOT be NULL
+    auto isolate = info.GetIsolate();
+    auto context = isolate->GetCurrentContext();
+    auto this_object = info.This();
+
+    // there must be one parameter and it must be a non-empty array
+    if (
+            info.Length() < 1
+            ||
+            info[0]->IsArray() == false
+            ||
+            this_object.IsEmpty() == true
+            ||
+            info[0].As<v8::Array>()->Length() == 0
+       )
+    {
+        LogError("broker_publish_batch was called with invalid parameters");
+
+        /*Codes_SRS_NODEJS_30_001: [ broker_publish_batch shall set the return value to false if the first argument is not a non-empty JS array. ]*/
+        info.GetReturnValue().Set(false);
+    }
+    else
+    {
+        // get a reference to NODEJS_MODULE_HANDLE_DATA; this MUST NOT be NULL
+        auto module_id_value = this_object->GetInternalField(0);
+        if (module_id_value.IsEmpty() == true)
+        {
+            LogError("broker_publish_batch() was called with an unexpected object as the 'this' variable");
+            info.GetReturnValue().Set(false);
+        }
+        else
+        {
+            auto module_id = module_id_value->Uint32Value();
+            auto modules_manager = nodejs_module::ModulesManager::Get();
+
+            // The module might not exist if there's a race condition between messages being
+            // published and the module being removed from modules manager.
+            if (modules_manager->HasModule(module_id) == true)
+            {
+                auto& handle_data = modules_manager->GetModuleFromId(module_id);
+                auto messages_array = info[0].As<v8::Array>();
+                uint32_t count = messages_array->Length();
 
-                        /*Codes_SRS_NODEJS_13_030: [ broker_publish shall construct and initialize a MESSAGE_HANDLE from the first argument. ]*/
-                        MESSAGE_HANDLE message = Message_Create(&message_config);
-                        if (message == NULL)
+                MESSAGE_HANDLE* messages = (MESSAGE_HANDLE*)malloc(count * sizeof(MESSAGE_HANDLE));
+                if (messages == NULL)
+                {
+                    /*Codes_SRS_NODEJS_30_003: [ broker_publish_batch shall set the return value to false if any underlying platform call fails. ]*/
+                    LogError("malloc failed");
+                    info.GetReturnValue().Set(false);
+                }
+                else
+                {
+                    uint32_t created;
+                    for (created = 0; created < count; created++)
+                    {
+                        auto element = messages_array->Get(created);
+
+                        /*Codes_SRS_NODEJS_30_002: [ broker_publish_batch shall set the return value to false if any element of the array is not an object that conforms to the Message interface accepted by broker_publish. ]*/
+                        if (element->IsObject() == false || validate_message(isolate, context, element) == false)
                         {
-                            /*Codes_SRS_NODEJS_13_031: [ broker_publish shall set the return value to false if any underlying platform call fails. ]*/
-                            LogError("Message_Create() failed");
-                            info.GetReturnValue().Set(false);
+                            LogError("element %u passed to broker_publish_batch() is not a message", created);
+                            break;
                         }
-                        else
-                        {
-                            /*Codes_SRS_NODEJS_13_032: [ broker_publish shall call Broker_Publish passing the newly constructed MESSAGE_HANDLE. ]*/
-                            if (Broker_Publish(handle_data.broker, reinterpret_cast<MODULE_HANDLE>(&handle_data), message) != BROKER_OK)
-                            {
-                                /*Codes_SRS_NODEJS_13_031: [ broker_publish shall set the return value to false if any underlying platform call fails. ]*/
-                                LogError("Broker_Publish() failed");
-                                info.GetReturnValue().Set(false);
-                            }
-                            else
-                            {
-                                /*Codes_SRS_NODEJS_13_033: [ broker_publish shall set the return value to true or false depending on the status of the Broker_Publish call. ]*/
-                                info.GetReturnValue().Set(true);
-                            }
 
-                            /*Codes_SRS_NODEJS_13_034: [ broker_publish shall destroy the MESSAGE_HANDLE. ]*/
-                            Message_Destroy(message);
+                        /*Codes_SRS_NODEJS_30_004: [ broker_publish_batch shall construct a MESSAGE_HANDLE from every element of the array as broker_publish does. ]*/
+                        messages[created] = create_message_from_object(isolate, context, element->ToObject());
+                        if (messages[created] == NULL)
+                        {
+                            /*Codes_SRS_NODEJS_30_003: [ broker_publish_batch shall set the return value to false if any underlying platform call fails. ]*/
+                            LogError("Could not create a message from element %u passed to broker_publish_batch()", created);
+                            break;
                         }
+                    }
 
-                        free((void*)message_config.source);
+                    if (created < count)
+                    {
+                        info.GetReturnValue().Set(false);
+                    }
+                    /*Codes_SRS_NODEJS_30_005: [ broker_publish_batch shall call Broker_PublishBatch once, passing all the MESSAGE_HANDLEs in the order of the array. ]*/
+                    else if (Broker_PublishBatch(handle_data.broker, reinterpret_cast<MODULE_HANDLE>(&handle_data), messages, count) != BROKER_OK)
+                    {
+                        LogError("Broker_PublishBatch() failed");
+                        info.GetReturnValue().Set(false);
+                    }
+                    else
+                    {
+                        /*Codes_SRS_NODEJS_30_006: [ broker_publish_batch shall set the return value to true or false depending on the status of the Broker_PublishBatch call. ]*/
+                        info.GetReturnValue().Set(true);
                     }
 
-                    Map_Destroy(message_properties);
+                    /*Codes_SRS_NODEJS_30_007: [ broker_publish_batch shall destroy the MESSAGE_HANDLEs it created. ]*/
+                    for (uint32_t i = 0; i < created; i++)
+                    {
+                        Message_Destroy(messages[i]);
+                    }
+                    free(messages);
                 }
             }
         }
@@ -615,6 +733,12 @@ static v8::Local<v8::Object> create_message_broker(v8::Isolate* isolate, v8::Loc
     {
         auto mbt = broker_template.Get(isolate);
 
+        // add 'publishBatch' next to 'publish' so arrays of messages cross into native code once
+        mbt->Set(
+            v8::String::NewFromUtf8(isolate, "publishBatch"),
+            v8::FunctionTemplate::New(isolate, broker_publish_batch)
+        );
+
         // add a placeholder for an internal field where we will store the module identifier
         mbt->SetInternalFieldCount(1);
 
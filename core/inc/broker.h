@@ -28,8 +28,51 @@ extern "C"
 {
 #else
 #include <stddef.h>
+#include <stdbool.h>
 #endif
 
+#define BROKER_FILTER_MATCH_VALUES \
+    BROKER_FILTER_EQUALS, \
+    BROKER_FILTER_PREFIX
+
+/** @brief    Enumeration describing how a #BROKER_FILTER_CONDITION compares a
+*             property of the message with its values.
+*
+*   @details  #BROKER_FILTER_EQUALS matches a property equal to one of the
+*             values: one value tests for equality, several for membership in
+*             a set. #BROKER_FILTER_PREFIX matches a property that starts with
+*             one of the values.
+*/
+DEFINE_ENUM(BROKER_FILTER_MATCH, BROKER_FILTER_MATCH_VALUES);
+
+/** @brief    One test a message has to pass to go through a filtered link. */
+typedef struct BROKER_FILTER_CONDITION_TAG
+{
+    /** @brief    Name of the property tested. Messages without that property
+    *             fail the test.
+    */
+    const char* key;
+    /** @brief    How the property is compared with @c values. */
+    BROKER_FILTER_MATCH match;
+    /** @brief    Values the property is compared with. */
+    const char* const* values;
+    /** @brief    Number of @c values, at least 1. */
+    size_t value_count;
+} BROKER_FILTER_CONDITION;
+
+/** @brief    Filter of a link: only the messages passing all of its
+*             conditions are delivered to the sink.
+*/
+typedef struct BROKER_LINK_FILTER_TAG
+{
+    /** @brief    The tests a message has to pass. */
+    const BROKER_FILTER_CONDITION* conditions;
+    /** @brief    Number of @c conditions, a filter without any lets every
+    *             message through.
+    */
+    size_t condition_count;
+} BROKER_LINK_FILTER;
+
 /** @brief    Link Data with #MODULE_HANDLE for source and sink. 
 */
 typedef struct BROKER_LINK_DATA_TAG {
@@ -39,6 +82,15 @@ typedef struct BROKER_LINK_DATA_TAG {
     /** @brief    #MODULE_HANDLE representing the module receiving messages. 
     */
     MODULE_HANDLE module_sink_handle;
+    /** @brief    Messages the link delivers, @c NULL for all of them. Only
+    *             read by ::Broker_AddLink.
+    */
+    const BROKER_LINK_FILTER* filter;
+    /** @brief    Queue the messages of this link on the sink's priority lane,
+    *             which the sink drains before its queue. Only brokers using
+    *             #BROKER_DELIVERY_ZERO_COPY have priority lanes.
+    */
+    bool high_priority;
 } BROKER_LINK_DATA;
 
 #define BROKER_RESULT_VALUES \
@@ -53,12 +105,192 @@ typedef struct BROKER_LINK_DATA_TAG {
 */
 DEFINE_ENUM(BROKER_RESULT, BROKER_RESULT_VALUES);
 
+#define BROKER_DELIVERY_MODE_VALUES \
+    BROKER_DELIVERY_SERIALIZED, \
+    BROKER_DELIVERY_ZERO_COPY
+
+/** @brief    Enumeration describing how the broker hands messages to modules.
+*
+*   @details  #BROKER_DELIVERY_SERIALIZED serializes every published message
+*             and routes it through nanomsg; each sink deserializes its own
+*             copy. #BROKER_DELIVERY_ZERO_COPY routes messages in-process and
+*             hands every sink a #Message_Clone of the published message, so
+*             no serialization takes place in the broker. Each module gets a
+*             bounded lock-free queue and only linked sinks are woken.
+*/
+DEFINE_ENUM(BROKER_DELIVERY_MODE, BROKER_DELIVERY_MODE_VALUES);
+
+/** @brief    Number of messages a module can have waiting for delivery when
+*             #BROKER_CONFIG::queue_capacity is 0.
+*/
+#define BROKER_DEFAULT_QUEUE_CAPACITY 1024
+
+/** @brief    Largest number of messages handed to a module's
+*             #pfModule_ReceiveBatch at once when #BROKER_CONFIG::batch_size
+*             is 0.
+*/
+#define BROKER_DEFAULT_BATCH_SIZE 64
+
+/** @brief    Largest number of messages a module takes in a row off its
+*             priority lane while messages wait in its queue, see
+*             #BROKER_LINK_DATA::high_priority.
+*/
+#define BROKER_PRIORITY_BURST 16
+
+#define BROKER_SCHEDULER_VALUES \
+    BROKER_SCHEDULER_DEDICATED_THREADS, \
+    BROKER_SCHEDULER_THREAD_POOL
+
+/** @brief    Enumeration describing which threads deliver messages to modules.
+*
+*   @details  #BROKER_SCHEDULER_DEDICATED_THREADS gives every module a thread
+*             of its own. #BROKER_SCHEDULER_THREAD_POOL shares a fixed number
+*             of worker threads between the modules of a zero-copy broker: a
+*             module with messages waiting is queued on a worker, which
+*             delivers a bounded number of them and moves on. Idle workers
+*             steal modules queued on busy ones. A module is never run by two
+*             workers at once, so it still receives its messages one at a time
+*             and in order. Modules that block in their receive callback, or
+*             that publish to modules using #BROKER_OVERFLOW_BLOCK, should ask
+*             for a thread of their own with #BROKER_MODULE_CONFIG: when every
+*             worker is blocked no pooled module makes progress.
+*/
+DEFINE_ENUM(BROKER_SCHEDULER, BROKER_SCHEDULER_VALUES);
+
+/** @brief    Largest number of worker threads a broker using
+*             #BROKER_SCHEDULER_THREAD_POOL can be given.
+*/
+#define BROKER_MAX_WORKER_COUNT 256
+
+/** @brief    Configuration used when creating a message broker with
+*             ::Broker_CreateWithConfig.
+*/
+typedef struct BROKER_CONFIG_TAG
+{
+    /** @brief    How messages are delivered to modules. */
+    BROKER_DELIVERY_MODE delivery_mode;
+    /** @brief    With #BROKER_DELIVERY_ZERO_COPY, the number of messages each
+    *             module can have waiting for delivery. Rounded up to a power of
+    *             two, 0 selects #BROKER_DEFAULT_QUEUE_CAPACITY. Publishing to
+    *             a module whose queue is full fails. Ignored with
+    *             #BROKER_DELIVERY_SERIALIZED.
+    */
+    size_t queue_capacity;
+    /** @brief    Largest number of messages handed to a module implementing
+    *             #pfModule_ReceiveBatch at once, 0 selects
+    *             #BROKER_DEFAULT_BATCH_SIZE.
+    */
+    size_t batch_size;
+    /** @brief    With #BROKER_DELIVERY_ZERO_COPY, how long the broker waits
+    *             for more messages before handing a module implementing
+    *             #pfModule_ReceiveBatch a batch that is not full, in
+    *             milliseconds. 0 hands over whatever is waiting right away.
+    *             Serialized delivery never waits.
+    */
+    unsigned int batch_window_ms;
+    /** @brief    With #BROKER_DELIVERY_ZERO_COPY, which threads deliver
+    *             messages to modules. Ignored with
+    *             #BROKER_DELIVERY_SERIALIZED, where every module has a thread
+    *             of its own. Pooled workers never wait for a batch to fill up,
+    *             #batch_window_ms only applies to modules with a thread of
+    *             their own.
+    */
+    BROKER_SCHEDULER scheduler;
+    /** @brief    With #BROKER_SCHEDULER_THREAD_POOL, the number of worker
+    *             threads, 0 selects the number of processors.
+    */
+    size_t worker_count;
+} BROKER_CONFIG;
+
+/** @brief    Per module options given to ::Broker_AddModuleWithConfig.
+*/
+typedef struct BROKER_MODULE_CONFIG_TAG
+{
+    /** @brief    When the broker uses #BROKER_SCHEDULER_THREAD_POOL, deliver
+    *             the module's messages on a thread of its own instead of on
+    *             the pool. Has no effect otherwise.
+    */
+    bool dedicated_thread;
+} BROKER_MODULE_CONFIG;
+
+#define BROKER_OVERFLOW_POLICY_VALUES \
+    BROKER_OVERFLOW_DROP_NEWEST, \
+    BROKER_OVERFLOW_DROP_OLDEST, \
+    BROKER_OVERFLOW_BLOCK, \
+    BROKER_OVERFLOW_SAMPLE
+
+/** @brief    Enumeration describing what happens when a message is published
+*             to a module whose queue is full.
+*
+*   @details  #BROKER_OVERFLOW_DROP_NEWEST drops the message being published
+*             and ::Broker_Publish reports #BROKER_ERROR, this is what a
+*             queue does unless configured otherwise.
+*             #BROKER_OVERFLOW_DROP_OLDEST drops the oldest waiting message to
+*             make room. #BROKER_OVERFLOW_BLOCK makes the publisher wait until
+*             the module has taken a message off its queue; a cycle of
+*             blocking links whose queues are all full never makes progress.
+*             #BROKER_OVERFLOW_SAMPLE starts shedding load when the queue is
+*             half full: only one message in #BROKER_QUEUE_CONFIG::sample_interval
+*             is queued, the others are dropped. Once the queue is full it
+*             behaves like #BROKER_OVERFLOW_DROP_NEWEST.
+*/
+DEFINE_ENUM(BROKER_OVERFLOW_POLICY, BROKER_OVERFLOW_POLICY_VALUES);
+
+/** @brief    Configuration of the queue of messages waiting for one module,
+*             see ::Broker_SetSinkQueue.
+*/
+typedef struct BROKER_QUEUE_CONFIG_TAG
+{
+    /** @brief    Number of messages that can wait for the module. Rounded up
+    *             to a power of two, 0 selects the broker's
+    *             #BROKER_CONFIG::queue_capacity.
+    */
+    size_t capacity;
+    /** @brief    What to do with a message published while the queue is full. */
+    BROKER_OVERFLOW_POLICY overflow;
+    /** @brief    With #BROKER_OVERFLOW_SAMPLE, one message in this many is
+    *             queued once the queue is half full. 0 selects 2.
+    */
+    size_t sample_interval;
+} BROKER_QUEUE_CONFIG;
+
+/** @brief    Counters describing the queue of one module, see
+*             ::Broker_GetSinkQueueStats.
+*/
+typedef struct BROKER_QUEUE_STATS_TAG
+{
+    /** @brief    Number of messages that can wait for the module. */
+    size_t capacity;
+    /** @brief    Number of messages waiting for the module right now. */
+    size_t queued;
+    /** @brief    Number of messages waiting on the module's priority lane
+    *             right now, not counted in @c queued.
+    */
+    size_t priority_queued;
+    /** @brief    Number of messages dropped since the module was added. */
+    size_t dropped;
+    /** @brief    Number of times a publisher had to wait for room in the
+    *             queue since the module was added.
+    */
+    size_t blocked;
+} BROKER_QUEUE_STATS;
+
 /** @brief        Creates a new message broker.
 *   
 *    @return        A valid #BROKER_HANDLE upon success, or @c NULL upon failure.
 */
 GATEWAY_EXPORT BROKER_HANDLE Broker_Create(void);
 
+/** @brief        Creates a new message broker using the given configuration.
+*
+*    @param        config  The #BROKER_CONFIG describing the broker. When
+*                        @c NULL the broker behaves exactly like one created
+*                        by ::Broker_Create.
+*
+*    @return        A valid #BROKER_HANDLE upon success, or @c NULL upon failure.
+*/
+GATEWAY_EXPORT BROKER_HANDLE Broker_CreateWithConfig(const BROKER_CONFIG* config);
+
 /** @brief        Increments the reference count of a message broker.
 *
 *    @details    This function will simply increment the internal reference
@@ -96,6 +328,29 @@ GATEWAY_EXPORT void Broker_DecRef(BROKER_HANDLE broker);
 */
 GATEWAY_EXPORT BROKER_RESULT Broker_Publish(BROKER_HANDLE broker, MODULE_HANDLE source, MESSAGE_HANDLE message);
 
+/** @brief        Publishes an array of messages to the message broker.
+*
+*    @details    Equivalent to calling ::Broker_Publish for every message in
+*                order, but with #BROKER_DELIVERY_ZERO_COPY the sinks of
+*                @c source are looked up once for the whole batch. Every sink
+*                receives the messages in the order they appear in
+*                @c messages. Publishing keeps going when a message cannot be
+*                delivered to a sink.
+*
+*    @param        broker           The #BROKER_HANDLE onto which the messages
+*                                   will be published.
+*    @param        source           The #MODULE_HANDLE from which the messages
+*                                   will be published.
+*    @param        messages         The messages to publish. The caller keeps
+*                                   ownership of them.
+*    @param        message_count    The number of messages, must not be 0.
+*
+*    @return        #BROKER_INVALIDARG if an argument or any of the messages is
+*                   @c NULL, #BROKER_ERROR if any message could not be
+*                   published, #BROKER_OK otherwise.
+*/
+GATEWAY_EXPORT BROKER_RESULT Broker_PublishBatch(BROKER_HANDLE broker, MODULE_HANDLE source, MESSAGE_HANDLE* messages, size_t message_count);
+
 /** @brief        Adds a module to the message broker.
 *
 *    @details    For details about threading with regard to the message broker
@@ -111,6 +366,20 @@ GATEWAY_EXPORT BROKER_RESULT Broker_Publish(BROKER_HANDLE broker, MODULE_HANDLE
 */
 GATEWAY_EXPORT BROKER_RESULT Broker_AddModule(BROKER_HANDLE broker, const MODULE* module);
 
+/** @brief        Adds a module to the message broker with per module options.
+*
+*    @param        broker          The #BROKER_HANDLE onto which the module will be
+*                                added.
+*    @param        module            The #MODULE for the module that will be added
+*                                to this message broker.
+*    @param        config          The #BROKER_MODULE_CONFIG of the module. When
+*                                NULL the module is added as ::Broker_AddModule
+*                                does.
+*
+*    @return        A #BROKER_RESULT describing the result of the function.
+*/
+GATEWAY_EXPORT BROKER_RESULT Broker_AddModuleWithConfig(BROKER_HANDLE broker, const MODULE* module, const BROKER_MODULE_CONFIG* config);
+
 /** @brief        Removes a module from the message broker.
 *   
 *    @param        broker    The #BROKER_HANDLE from which the module will be removed.
@@ -126,6 +395,23 @@ GATEWAY_EXPORT BROKER_RESULT Broker_RemoveModule(BROKER_HANDLE broker, const MOD
 *                and modules connected to it, see
 *                <a href="https://github.com/Azure/azure-iot-gateway-sdk/blob/master/core/devdoc/broker_hld.md">Broker High Level Design Documentation</a>.
 *
+*                A link with a #BROKER_LINK_DATA::filter only delivers the
+*                messages passing it. The broker keeps a compiled copy of the
+*                filter, evaluated by ::Broker_Publish before the message is
+*                cloned or queued for the sink. Only brokers using
+*                #BROKER_DELIVERY_ZERO_COPY filter links. Adding a link that
+*                already exists keeps its filter and its priority.
+*
+*                The messages of a #BROKER_LINK_DATA::high_priority link are
+*                queued on a second queue of the sink, its priority lane,
+*                created by the first such link. It holds as many messages as
+*                the queues of the broker and drops the newest message when
+*                it is full. The sink drains its priority lane first; once it
+*                took #BROKER_PRIORITY_BURST messages in a row off the lane, a
+*                message waiting in its queue gets its turn, so a steady stream of high priority
+*                messages does not starve the other links. Commands can then
+*                overtake a backlog of telemetry.
+*
 *    @param        broker          The #BROKER_HANDLE onto which the module will be
 *                                added.
 *    @param        link            The #BROKER_LINK_DATA for the link that will be added
@@ -144,6 +430,64 @@ GATEWAY_EXPORT BROKER_RESULT Broker_AddLink(BROKER_HANDLE broker, const BROKER_L
 */
 GATEWAY_EXPORT BROKER_RESULT Broker_RemoveLink(BROKER_HANDLE broker, const BROKER_LINK_DATA* link);
 
+/** @brief        Configures the queue of messages waiting for a module.
+*
+*    @details    Only brokers using #BROKER_DELIVERY_ZERO_COPY have module
+*                queues. Messages already waiting for the module are delivered
+*                before the ones published after the change; until they are,
+*                configuring a different queue for the module fails. Setting
+*                the configuration the queue already has does nothing.
+*
+*    @param        broker    The #BROKER_HANDLE the module is attached to.
+*    @param        sink      The #MODULE_HANDLE of the module receiving the
+*                        messages.
+*    @param        config    The #BROKER_QUEUE_CONFIG for the module's queue.
+*
+*    @return        A #BROKER_RESULT describing the result of the function.
+*/
+GATEWAY_EXPORT BROKER_RESULT Broker_SetSinkQueue(BROKER_HANDLE broker, MODULE_HANDLE sink, const BROKER_QUEUE_CONFIG* config);
+
+/** @brief        Makes publishers call a module themselves instead of
+*                queuing messages for it.
+*
+*    @details    Only brokers using #BROKER_DELIVERY_ZERO_COPY can deliver
+*                inline. An inline module's @c Module_Receive (or
+*                @c Module_ReceiveBatch) runs on the thread of whichever module
+*                publishes to it, once the message has been queued for the
+*                other sinks, and is handed the published message itself
+*                rather than a clone. This saves a thread hand-off per hop and
+*                suits cheap modules that never block, but the module must
+*                cope with being called by several publishers at once and
+*                must not add or remove modules or links, nor call this
+*                function, from @c Module_Receive. A cycle of links between
+*                inline modules recurses without end. The setting can only
+*                change while no module links to @p sink: making it inline
+*                stops its worker and delivers the messages still queued for
+*                it on the calling thread, so the worker and the publishers
+*                never call the module at the same time.
+*
+*    @param        broker            The #BROKER_HANDLE the module is attached to.
+*    @param        sink              The #MODULE_HANDLE of the module receiving
+*                                the messages.
+*    @param        deliver_inline    @c true to deliver inline, @c false to
+*                                queue messages again.
+*
+*    @return        A #BROKER_RESULT describing the result of the function.
+*/
+GATEWAY_EXPORT BROKER_RESULT Broker_SetSinkInline(BROKER_HANDLE broker, MODULE_HANDLE sink, bool deliver_inline);
+
+/** @brief        Reads the counters of the queue of messages waiting for a
+*                module.
+*
+*    @param        broker    The #BROKER_HANDLE the module is attached to.
+*    @param        sink      The #MODULE_HANDLE of the module receiving the
+*                        messages.
+*    @param        stats     Receives the #BROKER_QUEUE_STATS of the queue.
+*
+*    @return        A #BROKER_RESULT describing the result of the function.
+*/
+GATEWAY_EXPORT BROKER_RESULT Broker_GetSinkQueueStats(BROKER_HANDLE broker, MODULE_HANDLE sink, BROKER_QUEUE_STATS* stats);
+
 /** @brief      Disposes of resources allocated by a message broker.
 *
 *    @param      broker  The #BROKER_HANDLE to be destroyed.
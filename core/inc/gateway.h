@@ -15,6 +15,7 @@
 #include "azure_c_shared_utility/vector.h"
 #include "module.h"
 #include "module_loader.h"
+#include "message_pool.h"
 #include "gateway_export.h"
 
 #ifdef __cplusplus
@@ -47,6 +48,26 @@ typedef struct GATEWAY_LINK_ENTRY_TAG
 
     /** @brief  The name of the module which is going to receive messages. */
     const char* module_sink;
+
+    /** @brief  Queue the sink gets when the broker uses
+     *          #BROKER_DELIVERY_ZERO_COPY, see ::Broker_SetSinkQueue. When
+     *          @c NULL the sink keeps the queue it has.
+     */
+    const BROKER_QUEUE_CONFIG* sink_queue;
+
+    /** @brief  Properties the messages must have to be delivered over this
+     *          link when the broker uses #BROKER_DELIVERY_ZERO_COPY, see
+     *          ::Broker_AddLink. When @c NULL every message is delivered.
+     *          Links whose source is "*" cannot have a filter.
+     */
+    const BROKER_LINK_FILTER* filter;
+
+    /** @brief  When @c true and the broker uses #BROKER_DELIVERY_ZERO_COPY,
+     *          the messages of this link wait on the sink's priority lane and
+     *          are delivered ahead of its other messages, see
+     *          ::Broker_AddLink.
+     */
+    bool high_priority;
 } GATEWAY_LINK_ENTRY;
 
 /** @brief      Struct representing a particular gateway. */
@@ -79,6 +100,20 @@ typedef struct GATEWAY_MODULES_ENTRY_TAG
 
     /** @brief  The user-defined configuration object for the module */
     const void* module_configuration;
+
+    /** @brief  When the broker delivers messages on a pool of worker
+     *          threads, give this module a thread of its own instead (see
+     *          #BROKER_MODULE_CONFIG).
+     */
+    bool dedicated_thread;
+
+    /** @brief  When @c true and the broker uses #BROKER_DELIVERY_ZERO_COPY,
+     *          the modules linked to this one call it on their own thread
+     *          instead of queuing messages for it, see
+     *          ::Broker_SetSinkInline. Only meant for cheap modules that
+     *          never block.
+     */
+    bool deliver_inline;
 } GATEWAY_MODULES_ENTRY;
 
 /** @brief      Struct representing the properties that should be used when
@@ -92,6 +127,18 @@ typedef struct GATEWAY_PROPERTIES_DATA_TAG
 
     /** @brief  Vector of #GATEWAY_LINK_ENTRY objects. */
     VECTOR_HANDLE gateway_links;
+
+    /** @brief  The (possibly @c NULL) configuration of the gateway's
+     *          message broker. When @c NULL the broker is created with
+     *          ::Broker_Create.
+     */
+    const BROKER_CONFIG* broker_config;
+
+    /** @brief  The (possibly @c NULL) configuration of the message pool. When
+     *          not @c NULL the gateway enables the process-wide message pool
+     *          (see message_pool.h) for as long as it lives.
+     */
+    const MESSAGE_POOL_CONFIG* message_pool_config;
 } GATEWAY_PROPERTIES;
 
 /** @brief      Creates a gateway using a JSON configuration file as input
@@ -136,11 +183,25 @@ typedef struct GATEWAY_PROPERTIES_DATA_TAG
  *                  [
  *                      {
  *                          "source": "sensor",
- *                          "sink": "logger"
+ *                          "sink": "logger",
+ *                          "queue-capacity": 256,
+ *                          "overflow": "drop-oldest"
  *                      }
- *                  ]
+ *                  ],
+ *                  "broker":
+ *                  {
+ *                      "delivery": "zero-copy"
+ *                  }
  *              }
  *
+ *              The "broker" object is optional. "delivery" may be
+ *              "serialized" (the default) or "zero-copy".
+ *
+ *              With zero-copy delivery a link may configure the queue of
+ *              its sink: "queue-capacity", "overflow" ("drop-newest",
+ *              "drop-oldest", "block" or "sample") and "sample-interval".
+ *              They map to the fields of #BROKER_QUEUE_CONFIG.
+ *
  * @return      A non-NULL #GATEWAY_HANDLE that can be used to manage the
  *              gateway or @c NULL on failure.
  */
@@ -210,6 +271,17 @@ GATEWAY_EXPORT void Gateway_RemoveModule(GATEWAY_HANDLE gw, MODULE_HANDLE module
  */
 GATEWAY_EXPORT int Gateway_RemoveModuleByName(GATEWAY_HANDLE gw, const char *module_name);
 
+/** @brief      Reads the counters of the queue of messages waiting for a
+ *              module, see ::Broker_GetSinkQueueStats.
+ *
+ *  @param      gw              Pointer to a #GATEWAY_HANDLE.
+ *  @param      module_name     The name of the module receiving the messages.
+ *  @param      stats           Receives the #BROKER_QUEUE_STATS of the queue.
+ *
+ *  @return     Non-zero if an error occurred, otherwise 0.
+ */
+GATEWAY_EXPORT int Gateway_GetSinkQueueStats(GATEWAY_HANDLE gw, const char* module_name, BROKER_QUEUE_STATS* stats);
+
 /** @brief      Adds a link to a gateway message broker.
  *
  *  @param      gw          Pointer to a #GATEWAY_HANDLE from which link is
@@ -31,6 +31,7 @@
 #include "azure_c_shared_utility/constmap.h"
 #include "azure_c_shared_utility/constbuffer.h"
 #include "gateway_export.h"
+#include "property_key.h"
 
 #ifdef __cplusplus
 #include <cstdint>
@@ -115,11 +116,42 @@ GATEWAY_EXPORT MESSAGE_HANDLE Message_Create(const MESSAGE_CONFIG* cfg);
  */
 GATEWAY_EXPORT MESSAGE_HANDLE Message_CreateFromByteArray(const unsigned char* source, int32_t size);
 
+/** @brief      Function called to release the byte array wrapped by a message
+ *              created with #Message_CreateFromByteArrayNoCopy.
+ */
+typedef void(*MESSAGE_BUFFER_FREE)(void* context);
+
+/** @brief      Creates a new reference counted message that wraps a byte array
+ *              containing the serialized form of a message, without copying
+ *              it.
+ *
+ *  @details    The byte array is validated but neither the properties nor the
+ *              content are copied: #Message_GetContent returns a view into
+ *              @p source and the properties are only materialized the first
+ *              time #Message_GetProperties is called. The byte array must stay
+ *              unchanged for as long as the message lives. When the last
+ *              reference to the message is destroyed, @p free_buffer (if not
+ *              NULL) is called with @p free_context. If this function fails,
+ *              @p free_buffer is not called and the caller still owns the
+ *              byte array.
+ *
+ *  @param      source          Pointer to a byte array.
+ *  @param      size            size in bytes of the array
+ *  @param      free_buffer     Function releasing the byte array, or NULL.
+ *  @param      free_context    Argument passed to @p free_buffer.
+ *
+ *  @return     A non-NULL #MESSAGE_HANDLE for the newly created message, or
+ *              NULL upon failure.
+ */
+GATEWAY_EXPORT MESSAGE_HANDLE Message_CreateFromByteArrayNoCopy(const unsigned char* source, int32_t size, MESSAGE_BUFFER_FREE free_buffer, void* free_context);
+
 /** @brief      Creates a byte array representation of a MESSAGE_HANDLE. 
  *
  *  @details    The byte array created can be used with function
  *              #Message_CreateFromByteArray to reproduce the message. If buffer
  *              is not set, this function will return the serialization size.
+ *              The serialization size is computed once and remembered by the
+ *              message, so asking for it before serializing costs nothing.
  *
  *  @param      messageHandle   A #MESSAGE_HANDLE. Must not be NULL.
  *  @param      buf             A pointer to a byte array in memory, or NULL.
@@ -175,6 +207,23 @@ GATEWAY_EXPORT MESSAGE_HANDLE Message_Clone(MESSAGE_HANDLE message);
  */
 GATEWAY_EXPORT CONSTMAP_HANDLE Message_GetProperties(MESSAGE_HANDLE message);
 
+/** @brief      Gets the value of one property of a message.
+ *
+ *  @details    The properties of a message are kept sorted by key, so this is
+ *              a binary search that does not copy anything. When @p key is
+ *              the pointer returned by ::PropertyKey_Intern for that key the
+ *              search compares pointers instead of strings. Receivers that
+ *              only look at a few properties should prefer this function to
+ *              #Message_GetProperties.
+ *
+ *  @param      message     The #MESSAGE_HANDLE whose property is wanted.
+ *  @param      key         The name of the property.
+ *
+ *  @return     The value of the property, valid as long as @p message is, or
+ *              @c NULL if the message has no such property or upon failure.
+ */
+GATEWAY_EXPORT const char* Message_GetProperty(MESSAGE_HANDLE message, const char* key);
+
 /** @brief      Gets the content of a message.
  *
  *  @details    The returned @c CONSTBUFFER need not be freed by the caller.
@@ -0,0 +1,136 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+/** @file       message_pool.h
+ *
+ *  @brief      Optional pooled allocation for messages.
+ *
+ *  @details    When the pool is enabled, messages are built in blocks taken
+ *              from size classes (64 bytes to 64 KB) instead of being
+ *              assembled from separate allocations for the message, its
+ *              properties and its content. Released blocks go to a small
+ *              per-thread cache first and to a shared depot when that cache
+ *              is full, so in steady state creating and destroying a message
+ *              does not call malloc or free at all.
+ *
+ *              The pool is process-wide. It is normally enabled by
+ *              ::Gateway_Create when #GATEWAY_PROPERTIES::message_pool_config
+ *              is set and disabled by the matching ::Gateway_Destroy.
+ *              ::MessagePool_Enable and ::MessagePool_Disable are not thread
+ *              safe with respect to each other and the pool must not be
+ *              disabled for good while other threads still create messages.
+ */
+
+#ifndef MESSAGE_POOL_H
+#define MESSAGE_POOL_H
+
+#include "azure_c_shared_utility/macro_utils.h"
+#include "azure_c_shared_utility/umock_c_prod.h"
+#include "gateway_export.h"
+
+#ifdef __cplusplus
+#include <cstddef>
+extern "C"
+{
+#else
+#include <stddef.h>
+#endif
+
+/** @brief  Number of blocks of each size class a thread keeps for itself
+ *          when #MESSAGE_POOL_CONFIG::thread_cache_size is 0.
+ */
+#define MESSAGE_POOL_DEFAULT_THREAD_CACHE_SIZE 64
+
+/** @brief  Number of blocks of each size class the shared depot keeps when
+ *          #MESSAGE_POOL_CONFIG::depot_size is 0.
+ */
+#define MESSAGE_POOL_DEFAULT_DEPOT_SIZE 1024
+
+/** @brief  Largest block handed out by the pool, bigger requests fall back
+ *          to malloc.
+ */
+#define MESSAGE_POOL_MAX_BLOCK_SIZE (64 * 1024)
+
+/** @brief  Struct describing how the message pool is sized. */
+typedef struct MESSAGE_POOL_CONFIG_TAG
+{
+    /** @brief  Number of free blocks of each size class a thread keeps in its
+     *          own cache, #MESSAGE_POOL_DEFAULT_THREAD_CACHE_SIZE when 0.
+     */
+    size_t thread_cache_size;
+
+    /** @brief  Number of free blocks of each size class kept in the depot
+     *          shared by all threads, #MESSAGE_POOL_DEFAULT_DEPOT_SIZE when 0.
+     *          Blocks released beyond that are freed.
+     */
+    size_t depot_size;
+} MESSAGE_POOL_CONFIG;
+
+/** @brief  Struct reporting how well the message pool does. */
+typedef struct MESSAGE_POOL_STATISTICS_TAG
+{
+    /** @brief  Number of blocks handed out since the pool was enabled. */
+    size_t allocations;
+
+    /** @brief  Allocations served from a thread cache or from the depot. The
+     *          hit rate is @c hits / @c allocations.
+     */
+    size_t hits;
+
+    /** @brief  Allocations that had to call malloc, including the oversized
+     *          ones.
+     */
+    size_t misses;
+
+    /** @brief  Allocations bigger than #MESSAGE_POOL_MAX_BLOCK_SIZE. */
+    size_t oversized;
+} MESSAGE_POOL_STATISTICS;
+
+/** @brief      Enables the message pool.
+ *
+ *  @details    Calls are counted: the pool stays enabled until
+ *              ::MessagePool_Disable has been called as many times. Only the
+ *              configuration passed by the first call is used.
+ *
+ *  @param      config  Pointer to a #MESSAGE_POOL_CONFIG. Must not be NULL.
+ *
+ *  @return     0 on success, a non-zero value otherwise.
+ */
+MOCKABLE_FUNCTION(, GATEWAY_EXPORT int, MessagePool_Enable, const MESSAGE_POOL_CONFIG*, config);
+
+/** @brief      Undoes one call to ::MessagePool_Enable. The last one frees
+ *              every cached block and resets the statistics.
+ */
+MOCKABLE_FUNCTION(, GATEWAY_EXPORT void, MessagePool_Disable);
+
+/** @brief      Returns non-zero when the message pool is enabled. */
+MOCKABLE_FUNCTION(, GATEWAY_EXPORT int, MessagePool_IsEnabled);
+
+/** @brief      Reads the statistics of the message pool.
+ *
+ *  @param      statistics  Receives the statistics. Must not be NULL.
+ *
+ *  @return     0 on success, a non-zero value otherwise.
+ */
+MOCKABLE_FUNCTION(, GATEWAY_EXPORT int, MessagePool_GetStatistics, MESSAGE_POOL_STATISTICS*, statistics);
+
+/** @brief      Allocates a block of at least @p size bytes.
+ *
+ *  @details    When the pool is disabled or @p size is bigger than
+ *              #MESSAGE_POOL_MAX_BLOCK_SIZE the block comes from malloc. In
+ *              every case it must be released with ::MessagePool_Free.
+ *
+ *  @return     A pointer to the block, or NULL upon failure.
+ */
+MOCKABLE_FUNCTION(, GATEWAY_EXPORT void*, MessagePool_Allocate, size_t, size);
+
+/** @brief      Gives back a block obtained from ::MessagePool_Allocate. Does
+ *              nothing if @p block is NULL.
+ */
+MOCKABLE_FUNCTION(, GATEWAY_EXPORT void, MessagePool_Free, void*, block);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*MESSAGE_POOL_H*/
@@ -36,6 +36,9 @@ extern "C"
 /** @brief  Macro to get the Module_Receive from a MODULES_API pointer */
 #define MODULE_RECEIVE(module_api_ptr) (((const MODULE_API_1*)(module_api_ptr))->Module_Receive)
 
+/** @brief  Macro to get the Module_ReceiveBatch from a MODULES_API pointer, NULL for modules older than MODULE_API_VERSION_2 */
+#define MODULE_RECEIVE_BATCH(module_api_ptr) (((module_api_ptr)->version >= MODULE_API_VERSION_2) ? ((const MODULE_API_2*)(module_api_ptr))->Module_ReceiveBatch : NULL)
+
 #ifdef __cplusplus
 }
 #endif
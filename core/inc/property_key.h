@@ -0,0 +1,68 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+/** @file       property_key.h
+ *
+ *  @brief      Gateway-wide table of interned message property keys.
+ *
+ *  @details    Most messages flowing through a gateway carry the same few
+ *              property keys (@c source, @c macAddress, @c deviceName,
+ *              @c deviceKey, @c timestamp...). Interning a key gives back a
+ *              canonical pointer that is the same for every caller, so
+ *              messages can refer to the key instead of keeping their own
+ *              copy of it and lookups can compare pointers before comparing
+ *              strings.
+ *
+ *              The keys used by the modules shipped with the gateway are
+ *              interned from the start. Other keys can be added at run time
+ *              with ::PropertyKey_Intern; they stay interned for the lifetime
+ *              of the process. Both functions are lock free and can be called
+ *              from any thread.
+ */
+
+#ifndef PROPERTY_KEY_H
+#define PROPERTY_KEY_H
+
+#include "gateway_export.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/** @brief  Maximum number of keys that can be interned at run time, on top
+ *          of the well-known ones.
+ */
+#define PROPERTY_KEY_MAX_INTERNED 256
+
+/** @brief  Maximum length of a key interned at run time, not counting the
+ *          terminating '\0'.
+ */
+#define PROPERTY_KEY_MAX_LENGTH 63
+
+/** @brief      Returns the canonical pointer of @p key, interning it if it is
+ *              not interned yet.
+ *
+ *  @details    The key is copied, @p key does not need to outlive the call.
+ *
+ *  @param      key     The property key. Must not be NULL.
+ *
+ *  @return     The canonical pointer for @p key, or @c NULL if @p key is NULL,
+ *              longer than #PROPERTY_KEY_MAX_LENGTH or if the table is full.
+ */
+GATEWAY_EXPORT const char* PropertyKey_Intern(const char* key);
+
+/** @brief      Returns the canonical pointer of @p key without interning it.
+ *
+ *  @param      key     The property key. Must not be NULL.
+ *
+ *  @return     The canonical pointer for @p key, or @c NULL if @p key is not
+ *              interned.
+ */
+GATEWAY_EXPORT const char* PropertyKey_Find(const char* key);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*PROPERTY_KEY_H*/
@@ -0,0 +1,950 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+/*
+* Throughput and latency benchmark for the message broker.
+*
+* The broker is built directly with Broker_CreateWithConfig, Broker_AddModule
+* and Broker_AddLink out of three synthetic modules: sources publish messages
+* from their own thread, relays publish again every message they receive and
+* sinks count what they receive. Every message carries the time it was
+* published in its first 8 bytes, so sinks measure the end-to-end latency.
+*
+* For both delivery modes, every topology and every payload size the
+* benchmark reports the delivery rate, the p50/p99/p999 latency, the number of
+* heap allocations per published message (glibc only) and how many of the
+* expected deliveries took place. The topologies are, for a given width W:
+* - 1->1: one source linked to one sink;
+* - pairs: W sources, each linked to a sink of its own;
+* - fan-out: one source linked to W sinks;
+* - fan-in: W sources linked to the same sink;
+* - chain: one source, W relays one after the other, then one sink;
+* - inline-chain: the chain with inline relays (see Broker_SetSinkInline),
+*   zero-copy delivery only.
+* Every topology but 1->1 is run for W = 1, 2, 4... up to max_width, so pairs
+* and fan-in show how the broker scales with the number of producers.
+*
+* A last, zero-copy only, scenario measures a broker the size of a large
+* gateway: SCALE_MODULES modules each linked to the SCALE_LINKS_PER_MODULE
+* modules that follow it. It reports how long adding the modules, adding the
+* links and removing the modules takes, and the rate at which messages
+* published round-robin by every module are delivered.
+*
+* With zero-copy delivery the queues of relays and sinks block publishers
+* instead of dropping messages, so every message gets delivered. Serialized
+* delivery goes through nanomsg, which drops messages when a subscriber falls
+* behind; the benchmark stops waiting for them after DRAIN_IDLE_MS without
+* progress. A publish that fails is counted as lost.
+*
+* usage: broker_perf [messages_per_source] [max_width] [queue_capacity] [rate] [message_pool]
+*   rate            messages per second published by each source, 0 for as
+*                   fast as possible. Latency under a given load is best
+*                   measured with a rate the broker can sustain.
+*   message_pool    1 to enable the message pool.
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "azure_c_shared_utility/threadapi.h"
+#include "azure_c_shared_utility/map.h"
+
+#include "broker.h"
+#include "message.h"
+#include "message_pool.h"
+#include "module.h"
+#include "monotonic_clock.h"
+#include "../../src/internal/atomics.h"
+
+#define DEFAULT_MESSAGES_PER_SOURCE 20000
+#define DEFAULT_MAX_WIDTH 8
+#define DRAIN_IDLE_MS 1000
+
+static const size_t payload_sizes[] = { 64, 1024, 16 * 1024 };
+
+#define SCALE_MODULES 1000
+#define SCALE_LINKS_PER_MODULE 5
+
+/*latencies are kept in nanoseconds in log-linear buckets: 32 buckets per power of two, about 3% apart*/
+#define HISTOGRAM_SUB_BUCKET_BITS 5
+#define HISTOGRAM_SUB_BUCKETS (1 << HISTOGRAM_SUB_BUCKET_BITS)
+#define HISTOGRAM_MAX_BITS 40
+#define HISTOGRAM_BUCKETS ((HISTOGRAM_MAX_BITS - HISTOGRAM_SUB_BUCKET_BITS + 1) * HISTOGRAM_SUB_BUCKETS)
+
+typedef struct PERF_HISTOGRAM_TAG
+{
+    uint64_t counts[HISTOGRAM_BUCKETS];
+} PERF_HISTOGRAM;
+
+typedef enum PERF_TOPOLOGY_TAG
+{
+    PERF_ONE_TO_ONE,
+    PERF_PAIRS,
+    PERF_FAN_OUT,
+    PERF_FAN_IN,
+    PERF_CHAIN,
+    PERF_INLINE_CHAIN
+} PERF_TOPOLOGY;
+
+static const char* const topology_names[] = { "1->1", "pairs", "fan-out", "fan-in", "chain", "inline-chain" };
+
+typedef struct PERF_OPTIONS_TAG
+{
+    size_t message_count;
+    size_t max_width;
+    size_t queue_capacity;
+    size_t rate;
+} PERF_OPTIONS;
+
+typedef struct PERF_SOURCE_TAG
+{
+    MODULE module;
+    BROKER_HANDLE broker;
+    MAP_HANDLE properties;
+    unsigned char* payload;
+    size_t payload_size;
+    size_t message_count;
+    size_t rate;
+    volatile long* start;
+    long failures;
+} PERF_SOURCE;
+
+typedef struct PERF_RELAY_TAG
+{
+    MODULE module;
+    BROKER_HANDLE broker;
+    volatile long failures;
+} PERF_RELAY;
+
+typedef struct PERF_SINK_TAG
+{
+    MODULE module;
+    /*only written by the thread delivering to the sink, read once the scenario is drained*/
+    PERF_HISTOGRAM* latencies;
+    volatile long received;
+} PERF_SINK;
+
+#if defined(__GLIBC__)
+/*
+* Every heap allocation of the process, nanomsg's included, goes through these.
+* Threads count in stripes of their own so counting does not make them share a
+* cache line.
+*/
+#define ALLOCATION_STRIPES 64
+
+typedef struct ALLOCATION_STRIPE_TAG
+{
+    volatile long count;
+    char padding[64 - sizeof(long)];
+} ALLOCATION_STRIPE;
+
+extern void* __libc_malloc(size_t size);
+extern void* __libc_calloc(size_t count, size_t size);
+extern void* __libc_realloc(void* ptr, size_t size);
+extern void __libc_free(void* ptr);
+
+static ALLOCATION_STRIPE allocation_stripes[ALLOCATION_STRIPES];
+static volatile long next_allocation_stripe = 0;
+static __thread long allocation_stripe = -1;
+
+static void count_allocation(void)
+{
+    if (allocation_stripe < 0)
+    {
+        allocation_stripe = ATOMIC_INC(&next_allocation_stripe) % ALLOCATION_STRIPES;
+    }
+    (void)ATOMIC_INC(&allocation_stripes[allocation_stripe].count);
+}
+
+void* malloc(size_t size)
+{
+    count_allocation();
+    return __libc_malloc(size);
+}
+
+void* calloc(size_t count, size_t size)
+{
+    count_allocation();
+    return __libc_calloc(count, size);
+}
+
+void* realloc(void* ptr, size_t size)
+{
+    count_allocation();
+    return __libc_realloc(ptr, size);
+}
+
+void free(void* ptr)
+{
+    __libc_free(ptr);
+}
+
+/*returns the number of allocations so far, or -1 if they are not counted*/
+static double allocation_count(void)
+{
+    long result = 0;
+    for (size_t i = 0; i < ALLOCATION_STRIPES; i++)
+    {
+        result += ATOMIC_LOAD(&allocation_stripes[i].count);
+    }
+    return (double)result;
+}
+#else
+static double allocation_count(void)
+{
+    return -1.0;
+}
+#endif
+
+static size_t histogram_bucket(uint64_t value)
+{
+    size_t result;
+    if (value < HISTOGRAM_SUB_BUCKETS)
+    {
+        result = (size_t)value;
+    }
+    else
+    {
+        size_t bits = 0;
+        while ((value >> bits) >= 2 * HISTOGRAM_SUB_BUCKETS)
+        {
+            bits++;
+        }
+        result = (bits + 1) * HISTOGRAM_SUB_BUCKETS + (size_t)(value >> bits) - HISTOGRAM_SUB_BUCKETS;
+        if (result >= HISTOGRAM_BUCKETS)
+        {
+            result = HISTOGRAM_BUCKETS - 1;
+        }
+    }
+    return result;
+}
+
+/*returns the middle of the range of values counted by bucket*/
+static uint64_t histogram_value(size_t bucket)
+{
+    uint64_t result;
+    if (bucket < HISTOGRAM_SUB_BUCKETS)
+    {
+        result = bucket;
+    }
+    else
+    {
+        size_t bits = bucket / HISTOGRAM_SUB_BUCKETS - 1;
+        uint64_t low = (uint64_t)(bucket % HISTOGRAM_SUB_BUCKETS + HISTOGRAM_SUB_BUCKETS) << bits;
+        result = low + (((uint64_t)1 << bits) >> 1);
+    }
+    return result;
+}
+
+/*returns the latency in microseconds below which a fraction quantile of the messages arrived*/
+static double histogram_percentile(const PERF_HISTOGRAM* histogram, uint64_t total, double quantile)
+{
+    double result = 0.0;
+    uint64_t rank = (uint64_t)(quantile * (double)total + 0.5);
+    uint64_t seen = 0;
+    if (rank == 0)
+    {
+        rank = 1;
+    }
+    for (size_t i = 0; i < HISTOGRAM_BUCKETS; i++)
+    {
+        seen += histogram->counts[i];
+        if (seen >= rank)
+        {
+            result = (double)histogram_value(i) / 1000.0;
+            break;
+        }
+    }
+    return result;
+}
+
+static void PerfSink_Receive(MODULE_HANDLE moduleHandle, MESSAGE_HANDLE messageHandle)
+{
+    PERF_SINK* sink = (PERF_SINK*)moduleHandle;
+    const CONSTBUFFER* content = Message_GetContent(messageHandle);
+    if (content != NULL && content->size >= sizeof(uint64_t))
+    {
+        uint64_t published;
+        uint64_t now = MonotonicClock_GetNs();
+        (void)memcpy(&published, content->buffer, sizeof(published));
+        sink->latencies->counts[histogram_bucket(now > published ? now - published : 0)]++;
+    }
+    (void)ATOMIC_INC(&sink->received);
+}
+
+static const MODULE_API_1 PerfSink_API =
+{
+    { MODULE_API_VERSION_1 },
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    PerfSink_Receive,
+    NULL
+};
+
+static void PerfRelay_Receive(MODULE_HANDLE moduleHandle, MESSAGE_HANDLE messageHandle)
+{
+    PERF_RELAY* relay = (PERF_RELAY*)moduleHandle;
+    if (Broker_Publish(relay->broker, moduleHandle, messageHandle) != BROKER_OK)
+    {
+        (void)ATOMIC_INC(&relay->failures);
+    }
+}
+
+static const MODULE_API_1 PerfRelay_API =
+{
+    { MODULE_API_VERSION_1 },
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    PerfRelay_Receive,
+    NULL
+};
+
+static void PerfSource_Receive(MODULE_HANDLE moduleHandle, MESSAGE_HANDLE messageHandle)
+{
+    (void)moduleHandle;
+    (void)messageHandle;
+}
+
+static const MODULE_API_1 PerfSource_API =
+{
+    { MODULE_API_VERSION_1 },
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    PerfSource_Receive,
+    NULL
+};
+
+static int source_worker(void* user_data)
+{
+    PERF_SOURCE* source = (PERF_SOURCE*)user_data;
+    uint64_t begin;
+    MESSAGE_CONFIG config;
+    config.size = source->payload_size;
+    config.source = source->payload;
+    config.sourceProperties = source->properties;
+
+    while (ATOMIC_LOAD(source->start) == 0)
+    {
+        ThreadAPI_Sleep(0);
+    }
+
+    begin = MonotonicClock_GetNs();
+    for (size_t i = 0; i < source->message_count; i++)
+    {
+        MESSAGE_HANDLE message;
+        uint64_t published;
+
+        if (source->rate != 0)
+        {
+            uint64_t due = begin + (uint64_t)((double)i * 1000000000.0 / (double)source->rate);
+            while (MonotonicClock_GetNs() < due)
+            {
+                ThreadAPI_Sleep(0);
+            }
+        }
+
+        /*like any module would, every message is created right before being published*/
+        published = MonotonicClock_GetNs();
+        (void)memcpy(source->payload, &published, sizeof(published));
+        message = Message_Create(&config);
+        if (message == NULL)
+        {
+            source->failures++;
+        }
+        else
+        {
+            if (Broker_Publish(source->broker, source->module.module_handle, message) != BROKER_OK)
+            {
+                source->failures++;
+            }
+            Message_Destroy(message);
+        }
+    }
+
+    return 0;
+}
+
+static void topology_shape(PERF_TOPOLOGY topology, size_t width, size_t* source_count, size_t* relay_count, size_t* sink_count)
+{
+    *source_count = (topology == PERF_PAIRS || topology == PERF_FAN_IN) ? width : 1;
+    *relay_count = (topology == PERF_CHAIN || topology == PERF_INLINE_CHAIN) ? width : 0;
+    *sink_count = (topology == PERF_PAIRS || topology == PERF_FAN_OUT) ? width : 1;
+}
+
+/*returns 0 if success, otherwise __LINE__*/
+static int add_link(BROKER_HANDLE broker, const MODULE* source, const MODULE* sink)
+{
+    int result;
+    BROKER_LINK_DATA link;
+    link.module_source_handle = source->module_handle;
+    link.module_sink_handle = sink->module_handle;
+    link.filter = NULL;
+    link.high_priority = false;
+    if (Broker_AddLink(broker, &link) != BROKER_OK)
+    {
+        (void)printf("unable to link modules\n");
+        result = __LINE__;
+    }
+    else
+    {
+        result = 0;
+    }
+    return result;
+}
+
+/*returns 0 if success, otherwise __LINE__*/
+static int add_links(BROKER_HANDLE broker, PERF_TOPOLOGY topology, PERF_SOURCE* sources, size_t source_count, PERF_RELAY* relays, size_t relay_count, PERF_SINK* sinks, size_t sink_count)
+{
+    int result = 0;
+    if (topology == PERF_CHAIN || topology == PERF_INLINE_CHAIN)
+    {
+        const MODULE* previous = &sources[0].module;
+        for (size_t i = 0; i < relay_count && result == 0; i++)
+        {
+            result = add_link(broker, previous, &relays[i].module);
+            previous = &relays[i].module;
+        }
+        if (result == 0)
+        {
+            result = add_link(broker, previous, &sinks[0].module);
+        }
+    }
+    else
+    {
+        size_t link_count = (source_count > sink_count) ? source_count : sink_count;
+        for (size_t i = 0; i < link_count && result == 0; i++)
+        {
+            result = add_link(broker, &sources[i % source_count].module, &sinks[i % sink_count].module);
+        }
+    }
+    return result;
+}
+
+/*returns 0 if success, otherwise __LINE__*/
+static int add_module(BROKER_HANDLE broker, BROKER_DELIVERY_MODE mode, const MODULE* module, int blocking)
+{
+    int result;
+    if (Broker_AddModule(broker, module) != BROKER_OK)
+    {
+        (void)printf("unable to add a module to the broker\n");
+        result = __LINE__;
+    }
+    else
+    {
+        result = 0;
+        if (blocking && mode == BROKER_DELIVERY_ZERO_COPY)
+        {
+            BROKER_QUEUE_CONFIG queue;
+            queue.capacity = 0;
+            queue.overflow = BROKER_OVERFLOW_BLOCK;
+            queue.sample_interval = 0;
+            if (Broker_SetSinkQueue(broker, module->module_handle, &queue) != BROKER_OK)
+            {
+                (void)printf("unable to configure the queue of a module\n");
+                (void)Broker_RemoveModule(broker, module);
+                result = __LINE__;
+            }
+        }
+    }
+    return result;
+}
+
+static uint64_t total_received(PERF_SINK* sinks, size_t sink_count)
+{
+    uint64_t result = 0;
+    for (size_t i = 0; i < sink_count; i++)
+    {
+        result += (uint64_t)ATOMIC_LOAD(&sinks[i].received);
+    }
+    return result;
+}
+
+/*starts the sources, waits for the deliveries and prints the results. Returns 0 if success, otherwise __LINE__*/
+static int measure(const char* name, size_t payload_size, PERF_SOURCE* sources, size_t source_count, PERF_SINK* sinks, size_t sink_count, uint64_t expected)
+{
+    int result = 0;
+    THREAD_HANDLE* threads = (THREAD_HANDLE*)calloc(source_count, sizeof(THREAD_HANDLE));
+    PERF_HISTOGRAM* latencies = (PERF_HISTOGRAM*)calloc(1, sizeof(PERF_HISTOGRAM));
+    volatile long start = 0;
+    size_t started = 0;
+
+    if (threads == NULL || latencies == NULL)
+    {
+        (void)printf("unable to allocate the scenario\n");
+        result = __LINE__;
+    }
+    else
+    {
+        for (; started < source_count; started++)
+        {
+            sources[started].start = &start;
+            if (ThreadAPI_Create(&threads[started], source_worker, &sources[started]) != THREADAPI_OK)
+            {
+                (void)printf("unable to start %lu sources\n", (unsigned long)source_count);
+                result = __LINE__;
+                break;
+            }
+        }
+    }
+
+    /*sources that did start are waiting for this, they must be released even if the others failed*/
+    if (threads != NULL)
+    {
+        double allocations_before = allocation_count();
+        double allocations_after;
+        uint64_t begin = MonotonicClock_GetNs();
+        uint64_t last_progress;
+        uint64_t received = 0;
+        long failures = 0;
+        int thread_result;
+
+        (void)ATOMIC_INC(&start);
+        for (size_t i = 0; i < started; i++)
+        {
+            (void)ThreadAPI_Join(threads[i], &thread_result);
+            failures += sources[i].failures;
+        }
+
+        /*with serialized delivery messages can be lost without anybody knowing, so stop waiting once nothing moves*/
+        last_progress = MonotonicClock_GetNs();
+        while (1)
+        {
+            uint64_t now = total_received(sinks, sink_count);
+            if (now != received)
+            {
+                received = now;
+                last_progress = MonotonicClock_GetNs();
+            }
+            if (received >= expected || MonotonicClock_GetNs() - last_progress > (uint64_t)DRAIN_IDLE_MS * 1000000)
+            {
+                break;
+            }
+            ThreadAPI_Sleep(1);
+        }
+        allocations_after = allocation_count();
+
+        if (result == 0)
+        {
+            double seconds = (last_progress > begin) ? (double)(last_progress - begin) / 1000000000.0 : 0.000000001;
+            double published = (double)(started * sources[0].message_count);
+
+            for (size_t i = 0; i < sink_count; i++)
+            {
+                for (size_t j = 0; j < HISTOGRAM_BUCKETS; j++)
+                {
+                    latencies->counts[j] += sinks[i].latencies->counts[j];
+                }
+            }
+
+            (void)printf("%-10s %-12s %9lu %12.0f %10.1f %10.1f %10.1f ",
+                "", name,
+                (unsigned long)payload_size,
+                (double)received / seconds,
+                histogram_percentile(latencies, received, 0.50),
+                histogram_percentile(latencies, received, 0.99),
+                histogram_percentile(latencies, received, 0.999));
+            if (allocations_before < 0.0)
+            {
+                (void)printf("%12s", "n/a");
+            }
+            else
+            {
+                (void)printf("%12.2f", (allocations_after - allocations_before) / published);
+            }
+            (void)printf(" %12lu/%lu (%ld failed)\n", (unsigned long)received, (unsigned long)expected, failures);
+        }
+    }
+
+    free(latencies);
+    free(threads);
+    return result;
+}
+
+/*returns 0 if success, otherwise __LINE__*/
+static int run_scenario(const PERF_OPTIONS* options, BROKER_DELIVERY_MODE mode, PERF_TOPOLOGY topology, size_t width, size_t payload_size)
+{
+    int result;
+    BROKER_CONFIG config;
+    BROKER_HANDLE broker;
+    (void)memset(&config, 0, sizeof(config));
+    config.delivery_mode = mode;
+    config.queue_capacity = options->queue_capacity;
+
+    broker = Broker_CreateWithConfig(&config);
+    if (broker == NULL)
+    {
+        (void)printf("unable to create broker\n");
+        result = __LINE__;
+    }
+    else
+    {
+        size_t source_count, relay_count, sink_count;
+        PERF_SOURCE* sources;
+        PERF_RELAY* relays;
+        PERF_SINK* sinks;
+        size_t added_sources = 0, added_relays = 0, added_sinks = 0;
+
+        topology_shape(topology, width, &source_count, &relay_count, &sink_count);
+        sources = (PERF_SOURCE*)calloc(source_count, sizeof(PERF_SOURCE));
+        relays = (PERF_RELAY*)calloc(relay_count + 1, sizeof(PERF_RELAY));
+        sinks = (PERF_SINK*)calloc(sink_count, sizeof(PERF_SINK));
+
+        if (sources == NULL || relays == NULL || sinks == NULL)
+        {
+            (void)printf("unable to allocate the scenario\n");
+            result = __LINE__;
+        }
+        else
+        {
+            result = 0;
+            for (size_t i = 0; i < source_count && result == 0; i++)
+            {
+                PERF_SOURCE* source = &sources[i];
+                source->module.module_apis = (const MODULE_API*)&PerfSource_API;
+                source->module.module_handle = source;
+                source->broker = broker;
+                source->payload_size = payload_size;
+                source->message_count = options->message_count;
+                source->rate = options->rate;
+                source->payload = (unsigned char*)calloc(1, payload_size);
+                source->properties = Map_Create(NULL);
+                if (source->payload == NULL ||
+                    source->properties == NULL ||
+                    Map_AddOrUpdate(source->properties, "source", "broker_perf") != MAP_OK ||
+                    Map_AddOrUpdate(source->properties, "deviceName", "perf-device-0001") != MAP_OK)
+                {
+                    (void)printf("unable to create the messages of a source\n");
+                    result = __LINE__;
+                }
+            }
+
+            for (size_t i = 0; i < sink_count && result == 0; i++)
+            {
+                sinks[i].module.module_apis = (const MODULE_API*)&PerfSink_API;
+                sinks[i].module.module_handle = &sinks[i];
+                sinks[i].latencies = (PERF_HISTOGRAM*)calloc(1, sizeof(PERF_HISTOGRAM));
+                if (sinks[i].latencies == NULL)
+                {
+                    (void)printf("unable to allocate the latencies of a sink\n");
+                    result = __LINE__;
+                }
+            }
+
+            for (size_t i = 0; i < relay_count; i++)
+            {
+                relays[i].module.module_apis = (const MODULE_API*)&PerfRelay_API;
+                relays[i].module.module_handle = &relays[i];
+                relays[i].broker = broker;
+            }
+
+            for (; added_sinks < sink_count && result == 0; added_sinks++)
+            {
+                result = add_module(broker, mode, &sinks[added_sinks].module, 1);
+            }
+            for (; added_relays < relay_count && result == 0; added_relays++)
+            {
+                result = add_module(broker, mode, &relays[added_relays].module, topology != PERF_INLINE_CHAIN);
+                if (result == 0 &&
+                    topology == PERF_INLINE_CHAIN &&
+                    Broker_SetSinkInline(broker, relays[added_relays].module.module_handle, true) != BROKER_OK)
+                {
+                    (void)printf("unable to make a relay inline\n");
+                    result = __LINE__;
+                }
+            }
+            for (; added_sources < source_count && result == 0; added_sources++)
+            {
+                result = add_module(broker, mode, &sources[added_sources].module, 0);
+            }
+
+            if (result == 0)
+            {
+                result = add_links(broker, topology, sources, source_count, relays, relay_count, sinks, sink_count);
+            }
+
+            if (result == 0)
+            {
+                char name[32];
+                uint64_t expected = (uint64_t)options->message_count * source_count * ((topology == PERF_FAN_OUT) ? sink_count : 1);
+                (void)sprintf(name, (topology == PERF_ONE_TO_ONE) ? "%s" : "%s x%lu", topology_names[topology], (unsigned long)width);
+                result = measure(name, payload_size, sources, source_count, sinks, sink_count, expected);
+            }
+
+            /*a module that failed to be added is counted as added, removing it again is harmless*/
+            for (size_t i = 0; i < added_sources; i++)
+            {
+                (void)Broker_RemoveModule(broker, &sources[i].module);
+            }
+            for (size_t i = 0; i < added_relays; i++)
+            {
+                (void)Broker_RemoveModule(broker, &relays[i].module);
+            }
+            for (size_t i = 0; i < added_sinks; i++)
+            {
+                (void)Broker_RemoveModule(broker, &sinks[i].module);
+            }
+        }
+
+        if (sources != NULL)
+        {
+            for (size_t i = 0; i < source_count; i++)
+            {
+                if (sources[i].properties != NULL)
+                {
+                    Map_Destroy(sources[i].properties);
+                }
+                free(sources[i].payload);
+            }
+        }
+        if (sinks != NULL)
+        {
+            for (size_t i = 0; i < sink_count; i++)
+            {
+                free(sinks[i].latencies);
+            }
+        }
+        free(sinks);
+        free(relays);
+        free(sources);
+        Broker_Destroy(broker);
+    }
+
+    return result;
+}
+
+/*returns 0 if success, otherwise __LINE__*/
+static int run_scale(const PERF_OPTIONS* options)
+{
+    int result;
+    BROKER_CONFIG config;
+    BROKER_HANDLE broker;
+    (void)memset(&config, 0, sizeof(config));
+    config.delivery_mode = BROKER_DELIVERY_ZERO_COPY;
+    config.queue_capacity = options->queue_capacity;
+
+    broker = Broker_CreateWithConfig(&config);
+    if (broker == NULL)
+    {
+        (void)printf("unable to create broker\n");
+        result = __LINE__;
+    }
+    else
+    {
+        PERF_SINK* modules = (PERF_SINK*)calloc(SCALE_MODULES, sizeof(PERF_SINK));
+        unsigned char payload[64] = { 0 };
+        MAP_HANDLE properties = Map_Create(NULL);
+        MESSAGE_HANDLE message = NULL;
+        size_t added = 0;
+
+        if (modules == NULL || properties == NULL)
+        {
+            (void)printf("unable to allocate the scenario\n");
+            result = __LINE__;
+        }
+        else
+        {
+            MESSAGE_CONFIG message_config;
+            message_config.size = sizeof(payload);
+            message_config.source = payload;
+            message_config.sourceProperties = properties;
+            message = Message_Create(&message_config);
+            result = (message == NULL) ? __LINE__ : 0;
+
+            for (size_t i = 0; i < SCALE_MODULES && result == 0; i++)
+            {
+                modules[i].module.module_apis = (const MODULE_API*)&PerfSink_API;
+                modules[i].module.module_handle = &modules[i];
+                modules[i].latencies = (PERF_HISTOGRAM*)calloc(1, sizeof(PERF_HISTOGRAM));
+                if (modules[i].latencies == NULL)
+                {
+                    (void)printf("unable to allocate the latencies of a module\n");
+                    result = __LINE__;
+                }
+            }
+
+            if (result == 0)
+            {
+                uint64_t modules_begin = MonotonicClock_GetNs();
+                uint64_t links_begin;
+                uint64_t publish_begin;
+                uint64_t last_progress;
+                uint64_t received = 0;
+                uint64_t expected = (uint64_t)options->message_count * SCALE_LINKS_PER_MODULE;
+                long failures = 0;
+
+                for (; added < SCALE_MODULES && result == 0; added++)
+                {
+                    result = add_module(broker, BROKER_DELIVERY_ZERO_COPY, &modules[added].module, 1);
+                }
+
+                links_begin = MonotonicClock_GetNs();
+                for (size_t i = 0; i < SCALE_MODULES && result == 0; i++)
+                {
+                    for (size_t j = 1; j <= SCALE_LINKS_PER_MODULE && result == 0; j++)
+                    {
+                        result = add_link(broker, &modules[i].module, &modules[(i + j) % SCALE_MODULES].module);
+                    }
+                }
+
+                if (result == 0)
+                {
+                    publish_begin = MonotonicClock_GetNs();
+                    for (size_t i = 0; i < options->message_count; i++)
+                    {
+                        /*messages are immutable, every module publishes the same one and no latency is measured*/
+                        if (Broker_Publish(broker, modules[i % SCALE_MODULES].module.module_handle, message) != BROKER_OK)
+                        {
+                            failures++;
+                        }
+                    }
+
+                    last_progress = MonotonicClock_GetNs();
+                    while (1)
+                    {
+                        uint64_t now = total_received(modules, SCALE_MODULES);
+                        if (now != received)
+                        {
+                            received = now;
+                            last_progress = MonotonicClock_GetNs();
+                        }
+                        if (received >= expected || MonotonicClock_GetNs() - last_progress > (uint64_t)DRAIN_IDLE_MS * 1000000)
+                        {
+                            break;
+                        }
+                        ThreadAPI_Sleep(1);
+                    }
+
+                    (void)printf("%lu modules, %lu links: add modules %.1f us/module, add links %.1f us/link, %.0f messages/s, %lu/%lu delivered (%ld failed)",
+                        (unsigned long)SCALE_MODULES,
+                        (unsigned long)(SCALE_MODULES * SCALE_LINKS_PER_MODULE),
+                        (double)(links_begin - modules_begin) / 1000.0 / SCALE_MODULES,
+                        (double)(publish_begin - links_begin) / 1000.0 / (SCALE_MODULES * SCALE_LINKS_PER_MODULE),
+                        (double)received / ((last_progress > publish_begin) ? (double)(last_progress - publish_begin) / 1000000000.0 : 0.000000001),
+                        (unsigned long)received, (unsigned long)expected, failures);
+                }
+            }
+
+            if (added != 0)
+            {
+                uint64_t remove_begin = MonotonicClock_GetNs();
+                /*a module that failed to be added is counted as added, removing it again is harmless*/
+                for (size_t i = 0; i < added; i++)
+                {
+                    (void)Broker_RemoveModule(broker, &modules[i].module);
+                }
+                if (result == 0)
+                {
+                    (void)printf(", remove modules %.1f us/module\n", (double)(MonotonicClock_GetNs() - remove_begin) / 1000.0 / added);
+                }
+            }
+        }
+
+        if (message != NULL)
+        {
+            Message_Destroy(message);
+        }
+        if (properties != NULL)
+        {
+            Map_Destroy(properties);
+        }
+        if (modules != NULL)
+        {
+            for (size_t i = 0; i < SCALE_MODULES; i++)
+            {
+                free(modules[i].latencies);
+            }
+        }
+        free(modules);
+        Broker_Destroy(broker);
+    }
+
+    return result;
+}
+
+static const char* mode_name(BROKER_DELIVERY_MODE mode)
+{
+    return (mode == BROKER_DELIVERY_ZERO_COPY) ? "zero-copy" : "serialized";
+}
+
+int main(int argc, char** argv)
+{
+    int result = 0;
+    PERF_OPTIONS options;
+    int use_message_pool = (argc > 5) ? atoi(argv[5]) : 0;
+    options.message_count = (argc > 1) ? (size_t)strtoul(argv[1], NULL, 10) : DEFAULT_MESSAGES_PER_SOURCE;
+    options.max_width = (argc > 2) ? (size_t)strtoul(argv[2], NULL, 10) : DEFAULT_MAX_WIDTH;
+    options.queue_capacity = (argc > 3) ? (size_t)strtoul(argv[3], NULL, 10) : 0;
+    options.rate = (argc > 4) ? (size_t)strtoul(argv[4], NULL, 10) : 0;
+
+    if (options.message_count == 0 || options.max_width == 0)
+    {
+        (void)printf("usage: %s [messages_per_source] [max_width] [queue_capacity] [rate] [message_pool]\n", argv[0]);
+        result = 1;
+    }
+    else
+    {
+        MESSAGE_POOL_CONFIG pool_config = { 0, 0 };
+
+        if (use_message_pool && MessagePool_Enable(&pool_config) != 0)
+        {
+            (void)printf("unable to enable the message pool\n");
+            result = 1;
+        }
+        else
+        {
+            static const BROKER_DELIVERY_MODE modes[] = { BROKER_DELIVERY_SERIALIZED, BROKER_DELIVERY_ZERO_COPY };
+            static const PERF_TOPOLOGY topologies[] = { PERF_ONE_TO_ONE, PERF_PAIRS, PERF_FAN_OUT, PERF_FAN_IN, PERF_CHAIN, PERF_INLINE_CHAIN };
+
+            (void)printf("%lu messages per source, %s, message pool %s\n",
+                (unsigned long)options.message_count,
+                (options.rate == 0) ? "as fast as possible" : "paced",
+                use_message_pool ? "enabled" : "disabled");
+            (void)printf("%-10s %-12s %9s %12s %10s %10s %10s %12s %12s\n", "mode", "topology", "payload", "messages/s", "p50 (us)", "p99 (us)", "p999 (us)", "allocs/msg", "delivered");
+            for (size_t m = 0; m < sizeof(modes) / sizeof(modes[0]) && result == 0; m++)
+            {
+                (void)printf("%s\n", mode_name(modes[m]));
+                for (size_t t = 0; t < sizeof(topologies) / sizeof(topologies[0]) && result == 0; t++)
+                {
+                    /*only zero-copy brokers call sinks inline*/
+                    int skipped = (topologies[t] == PERF_INLINE_CHAIN && modes[m] != BROKER_DELIVERY_ZERO_COPY);
+                    /*1->1 does not depend on the width*/
+                    size_t max_width = (topologies[t] == PERF_ONE_TO_ONE) ? 1 : options.max_width;
+                    for (size_t width = 1; width <= max_width && result == 0 && !skipped; width *= 2)
+                    {
+                        for (size_t s = 0; s < sizeof(payload_sizes) / sizeof(payload_sizes[0]) && result == 0; s++)
+                        {
+                            if (run_scenario(&options, modes[m], topologies[t], width, payload_sizes[s]) != 0)
+                            {
+                                result = 1;
+                            }
+                        }
+                    }
+                }
+            }
+
+            if (result == 0)
+            {
+                (void)printf("scale (zero-copy)\n");
+                if (run_scale(&options) != 0)
+                {
+                    result = 1;
+                }
+            }
+
+            if (use_message_pool)
+            {
+                MessagePool_Disable();
+            }
+        }
+    }
+
+    return result;
+}
@@ -0,0 +1,258 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+/*
+* Serialization benchmark for messages.
+*
+* For messages with 0, 8 and 32 properties and contents from 64 bytes to
+* 64 KB it reports the average cost of:
+* - Message_ToByteArray, asking for the size first and then serializing, the
+*   way the broker does it;
+* - Message_CreateFromByteArray followed by Message_Destroy;
+* - Message_CreateFromByteArrayNoCopy followed by Message_Destroy;
+* - Message_CreateFromByteArrayNoCopy, Message_GetProperties and
+*   Message_Destroy, for receivers that look at the properties.
+*
+* The table is printed twice, the second time with the message pool enabled,
+* followed by the hit rate of the pool.
+*
+* usage: message_perf [iterations]
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "azure_c_shared_utility/tickcounter.h"
+#include "azure_c_shared_utility/map.h"
+#include "azure_c_shared_utility/constmap.h"
+
+#include "message.h"
+#include "message_pool.h"
+
+#define DEFAULT_ITERATIONS 50000
+
+static const size_t property_counts[] = { 0, 8, 32 };
+static const size_t payload_sizes[] = { 64, 1024, 16 * 1024, 64 * 1024 };
+
+static MESSAGE_HANDLE create_message(size_t property_count, size_t payload_size)
+{
+    MESSAGE_HANDLE result;
+    MAP_HANDLE properties = Map_Create(NULL);
+    unsigned char* payload = (unsigned char*)malloc(payload_size);
+    if (properties == NULL || payload == NULL)
+    {
+        result = NULL;
+    }
+    else
+    {
+        MESSAGE_CONFIG config;
+        char key[32];
+        char value[32];
+        for (size_t i = 0; i < property_count; i++)
+        {
+            (void)sprintf(key, "property%lu", (unsigned long)i);
+            (void)sprintf(value, "value-of-property-%lu", (unsigned long)i);
+            (void)Map_AddOrUpdate(properties, key, value);
+        }
+        for (size_t i = 0; i < payload_size; i++)
+        {
+            payload[i] = (unsigned char)i;
+        }
+        config.size = payload_size;
+        config.source = payload;
+        config.sourceProperties = properties;
+        result = Message_Create(&config);
+    }
+
+    if (properties != NULL)
+    {
+        Map_Destroy(properties);
+    }
+    free(payload);
+    return result;
+}
+
+/*returns the average time of one operation in nanoseconds*/
+static double per_operation_ns(tickcounter_ms_t begin, tickcounter_ms_t end, size_t iterations)
+{
+    return (double)(end - begin) * 1000000.0 / (double)iterations;
+}
+
+/*returns 0 if success, otherwise __LINE__*/
+static int run_scenario(size_t property_count, size_t payload_size, size_t iterations, TICK_COUNTER_HANDLE ticks)
+{
+    int result;
+    MESSAGE_HANDLE message = create_message(property_count, payload_size);
+    int32_t size = (message == NULL) ? -1 : Message_ToByteArray(message, NULL, 0);
+    unsigned char* serialized = (size <= 0) ? NULL : (unsigned char*)malloc(size);
+
+    if (serialized == NULL || Message_ToByteArray(message, serialized, size) != size)
+    {
+        (void)printf("unable to create a message with %lu properties and %lu bytes of content\n", (unsigned long)property_count, (unsigned long)payload_size);
+        result = __LINE__;
+    }
+    else
+    {
+        unsigned char* buffer = (unsigned char*)malloc(size);
+        if (buffer == NULL)
+        {
+            (void)printf("unable to allocate the serialization buffer\n");
+            result = __LINE__;
+        }
+        else
+        {
+            tickcounter_ms_t begin = 0, serialize = 0, copy = 0, wrap = 0, wrap_properties = 0;
+            size_t failures = 0;
+
+            (void)tickcounter_get_current_ms(ticks, &begin);
+            for (size_t i = 0; i < iterations; i++)
+            {
+                int32_t needed = Message_ToByteArray(message, NULL, 0);
+                if (Message_ToByteArray(message, buffer, needed) != needed)
+                {
+                    failures++;
+                }
+            }
+            (void)tickcounter_get_current_ms(ticks, &serialize);
+
+            for (size_t i = 0; i < iterations; i++)
+            {
+                MESSAGE_HANDLE copied = Message_CreateFromByteArray(serialized, size);
+                if (copied == NULL)
+                {
+                    failures++;
+                }
+                else
+                {
+                    Message_Destroy(copied);
+                }
+            }
+            (void)tickcounter_get_current_ms(ticks, &copy);
+
+            for (size_t i = 0; i < iterations; i++)
+            {
+                MESSAGE_HANDLE wrapped = Message_CreateFromByteArrayNoCopy(serialized, size, NULL, NULL);
+                if (wrapped == NULL)
+                {
+                    failures++;
+                }
+                else
+                {
+                    Message_Destroy(wrapped);
+                }
+            }
+            (void)tickcounter_get_current_ms(ticks, &wrap);
+
+            for (size_t i = 0; i < iterations; i++)
+            {
+                MESSAGE_HANDLE wrapped = Message_CreateFromByteArrayNoCopy(serialized, size, NULL, NULL);
+                if (wrapped == NULL)
+                {
+                    failures++;
+                }
+                else
+                {
+                    CONSTMAP_HANDLE properties = Message_GetProperties(wrapped);
+                    if (properties == NULL)
+                    {
+                        failures++;
+                    }
+                    else
+                    {
+                        ConstMap_Destroy(properties);
+                    }
+                    Message_Destroy(wrapped);
+                }
+            }
+            (void)tickcounter_get_current_ms(ticks, &wrap_properties);
+
+            (void)printf("%10lu %9lu %14.0f %14.0f %14.0f %19.0f %9lu\n",
+                (unsigned long)property_count,
+                (unsigned long)payload_size,
+                per_operation_ns(begin, serialize, iterations),
+                per_operation_ns(serialize, copy, iterations),
+                per_operation_ns(copy, wrap, iterations),
+                per_operation_ns(wrap, wrap_properties, iterations),
+                (unsigned long)failures);
+
+            result = (failures == 0) ? 0 : __LINE__;
+            free(buffer);
+        }
+    }
+
+    free(serialized);
+    if (message != NULL)
+    {
+        Message_Destroy(message);
+    }
+    return result;
+}
+
+/*returns 0 if success, otherwise __LINE__*/
+static int run_all_scenarios(size_t iterations, TICK_COUNTER_HANDLE ticks)
+{
+    int result = 0;
+    (void)printf("%10s %9s %14s %14s %14s %19s %9s\n", "properties", "content", "to byte array", "from (copy)", "from (wrap)", "wrap + properties", "failures");
+    for (size_t p = 0; p < sizeof(property_counts) / sizeof(property_counts[0]) && result == 0; p++)
+    {
+        for (size_t s = 0; s < sizeof(payload_sizes) / sizeof(payload_sizes[0]) && result == 0; s++)
+        {
+            result = run_scenario(property_counts[p], payload_sizes[s], iterations, ticks);
+        }
+    }
+    return result;
+}
+
+int main(int argc, char** argv)
+{
+    int result = 0;
+    size_t iterations = (argc > 1) ? (size_t)strtoul(argv[1], NULL, 10) : DEFAULT_ITERATIONS;
+    TICK_COUNTER_HANDLE ticks = tickcounter_create();
+
+    if (ticks == NULL || iterations == 0)
+    {
+        (void)printf("usage: %s [iterations]\n", argv[0]);
+        result = 1;
+    }
+    else
+    {
+        MESSAGE_POOL_CONFIG pool_config = { 0, 0 };
+
+        (void)printf("%lu iterations, average ns per operation\n", (unsigned long)iterations);
+        if (run_all_scenarios(iterations, ticks) != 0)
+        {
+            result = 1;
+        }
+        else if (MessagePool_Enable(&pool_config) != 0)
+        {
+            (void)printf("unable to enable the message pool\n");
+            result = 1;
+        }
+        else
+        {
+            MESSAGE_POOL_STATISTICS statistics;
+
+            (void)printf("\nwith the message pool\n");
+            if (run_all_scenarios(iterations, ticks) != 0)
+            {
+                result = 1;
+            }
+
+            if (MessagePool_GetStatistics(&statistics) == 0 && statistics.allocations > 0)
+            {
+                (void)printf("pool: %lu allocations, %.2f%% hits, %lu misses, %lu oversized\n",
+                    (unsigned long)statistics.allocations,
+                    (double)statistics.hits * 100.0 / (double)statistics.allocations,
+                    (unsigned long)statistics.misses,
+                    (unsigned long)statistics.oversized);
+            }
+            MessagePool_Disable();
+        }
+    }
+
+    if (ticks != NULL)
+    {
+        tickcounter_destroy(ticks);
+    }
+    return result;
+}
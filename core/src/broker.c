@@ -3,11 +3,18 @@
 
 #include <stdlib.h>
 #include <stdbool.h>
+#include <string.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
 
 #include "azure_c_shared_utility/gballoc.h"
 #include "azure_c_shared_utility/vector.h"
 #include "azure_c_shared_utility/strings.h"
 #include "azure_c_shared_utility/lock.h"
+#include "azure_c_shared_utility/condition.h"
 #include "azure_c_shared_utility/threadapi.h"
 #include "azure_c_shared_utility/xlogging.h"
 #include "azure_c_shared_utility/refcount.h"
@@ -21,6 +28,8 @@
 #include "module.h"
 #include "module_access.h"
 #include "broker.h"
+#include "property_key.h"
+#include "internal/atomics.h"
 
 /* minimum size for a guid string, 36 characters + null terminator */
 #define BROKER_GUID_SIZE 37
@@ -28,13 +37,175 @@
 #define INPROC_URL_HEAD_SIZE 9
 #define URL_SIZE (INPROC_URL_HEAD_SIZE + BROKER_GUID_SIZE +1)
 
+/*largest queue a zero-copy module can be given, keeps ring positions well
+  inside the range of a long*/
+#define BROKER_MAX_QUEUE_CAPACITY ((size_t)1 << 24)
+
+/*largest number of messages a pooled worker delivers to a module before
+  giving the other modules queued on it their turn*/
+#define BROKER_WORKER_QUANTUM 64
+
+/*number of slots of the smallest module index or routing table index*/
+#define BROKER_INDEX_MIN_SIZE 16
+
+struct BROKER_MODULEINFO_TAG;
+struct BROKER_POOL_TAG;
+
+/*One slot of a message ring. sequence tells producers and the consumer whose
+  turn it is: twice the enqueue position when the slot is free, one more once a
+  message has been stored. Doubling keeps a full slot of a one slot ring from
+  reading as free for the next position.*/
+typedef struct MESSAGE_RING_CELL_TAG
+{
+    volatile long   sequence;
+    MESSAGE_HANDLE  message;
+}MESSAGE_RING_CELL;
+
+/*Bounded queue of messages. Publishers claim slots with a compare-and-swap
+  on enqueue_position, the module worker (and publishers making room with
+  BROKER_OVERFLOW_DROP_OLDEST) with a compare-and-swap on dequeue_position.
+  The overflow policy travels with the ring so publishers never see a policy
+  that does not match the ring they push to.*/
+typedef struct MESSAGE_RING_TAG
+{
+    size_t                  mask;
+    MESSAGE_RING_CELL*      cells;
+    BROKER_OVERFLOW_POLICY  overflow;
+    long                    sample_interval;
+    volatile long           sample_counter;
+    volatile long           enqueue_position;
+    /*keeps publishers and the worker off each other's cache line*/
+    char                    padding[64];
+    volatile long           dequeue_position;
+}MESSAGE_RING;
+
+/*One condition of a compiled link filter*/
+typedef struct BROKER_FILTER_TEST_TAG
+{
+    /*interned when possible, so Message_GetProperty compares pointers*/
+    const char*         key;
+    BROKER_FILTER_MATCH match;
+    size_t              value_count;
+    const char**        values;
+    size_t*             value_lengths;
+}BROKER_FILTER_TEST;
+
+/*A BROKER_LINK_FILTER compiled by Broker_AddLink. One block holds the tests
+  and copies of every string. The link and every route holding the link own a
+  reference, the last one to let go frees the block.*/
+typedef struct BROKER_FILTER_TAG
+{
+    volatile long       refs;
+    size_t              test_count;
+    BROKER_FILTER_TEST* tests;
+}BROKER_FILTER;
+
+/*A link from a source to one of its sinks (zero-copy delivery only)*/
+typedef struct BROKER_LINK_TAG
+{
+    struct BROKER_MODULEINFO_TAG*   sink;
+    /*NULL when the link delivers every message*/
+    BROKER_FILTER*                  filter;
+    /*messages go to the sink's priority lane*/
+    bool                            high_priority;
+}BROKER_LINK;
+
+/*The sinks of one source, as seen by Broker_Publish. A route never changes:
+  a link change builds a new route for its source only and swaps it in. The
+  index owns a reference to the route, and so does every publisher delivering
+  along it, the last one to let go frees it.*/
+typedef struct BROKER_ROUTE_TAG
+{
+    volatile long                   refs;
+    struct BROKER_MODULEINFO_TAG*   source_info;
+    size_t                          sink_count;
+    BROKER_LINK*                    sinks;
+    /*chains the routes a link change retires, or has yet to swap in*/
+    struct BROKER_ROUTE_TAG*        next;
+}BROKER_ROUTE;
+
+/*A source and its current route, NULL while the source has no sinks*/
+typedef struct BROKER_ROUTE_SLOT_TAG
+{
+    MODULE_HANDLE volatile          source;
+    BROKER_ROUTE* volatile          route;
+}BROKER_ROUTE_SLOT;
+
+/*Open addressing index of the routes by source, index_mask + 1 slots. A
+  source keeps its slot, and its route is swapped in place, until the index
+  runs out of room and is replaced by a bigger one that leaves out the sources
+  without a route.*/
+typedef struct BROKER_ROUTING_TAG
+{
+    size_t              index_mask;
+    /*slots given to a source, with or without a route*/
+    size_t              used_slots;
+    BROKER_ROUTE_SLOT*  slots;
+}BROKER_ROUTING;
+
+/*One thread of the pool (BROKER_SCHEDULER_THREAD_POOL only). Modules with
+  messages waiting are queued on it, first in first out; other workers steal
+  from the head when they run out of modules of their own.*/
+typedef struct BROKER_WORKER_TAG
+{
+    struct BROKER_POOL_TAG*                 pool;
+    THREAD_HANDLE                           thread;
+    LOCK_HANDLE                             lock;
+    struct BROKER_MODULEINFO_TAG* volatile  head;
+    struct BROKER_MODULEINFO_TAG*           tail;
+}BROKER_WORKER;
+
+/*The threads shared by the modules of a pooled broker*/
+typedef struct BROKER_POOL_TAG
+{
+    size_t          worker_count;
+    BROKER_WORKER*  workers;
+    /*idle workers sleep on idle_condition under idle_lock*/
+    LOCK_HANDLE     idle_lock;
+    COND_HANDLE     idle_condition;
+    volatile long   idle_workers;
+    /*number of modules queued on the workers*/
+    volatile long   pending;
+    /*spreads modules scheduled from outside the pool over the workers*/
+    volatile long   next_worker;
+    /*cleared under idle_lock to ask the workers to exit*/
+    volatile bool   is_running;
+}BROKER_POOL;
+
 /*The structure backing the message broker handle*/
 typedef struct BROKER_HANDLE_DATA_TAG
 {
     SINGLYLINKEDLIST_HANDLE modules;
+    /*open addressing table finding a module from its handle, module_index_size
+      slots (a power of two, at least twice module_count), NULL until the first
+      module is added*/
+    struct BROKER_MODULEINFO_TAG** module_index;
+    size_t                  module_index_size;
+    size_t                  module_count;
     LOCK_HANDLE             modules_lock;
     int                     publish_socket;
     STRING_HANDLE           url;
+    BROKER_DELIVERY_MODE    delivery_mode;
+    /*number of messages each module can have waiting (zero-copy delivery only)*/
+    size_t                  queue_capacity;
+    /*largest number of messages handed to Module_ReceiveBatch at once*/
+    size_t                  batch_size;
+    /*how long zero-copy workers wait for a batch to fill up, in milliseconds*/
+    unsigned int            batch_window_ms;
+    /*worker threads shared by the modules, NULL when every module has its own*/
+    BROKER_POOL*            pool;
+    /*index of the routes by source read by Broker_Publish (zero-copy delivery only)*/
+    BROKER_ROUTING* volatile routing;
+    /*keeps the epoch, which publishers only read, off the line of the fields
+      above and of the reader counters every publisher writes*/
+    char                    epoch_padding[64];
+    /*advanced by writers to retire routes, its parity selects the
+      reader counter new publishers register with*/
+    volatile long           routing_epoch;
+    char                    readers_padding[64];
+    /*number of publishers reading routes, per epoch parity*/
+    volatile long           routing_readers[2];
+    char                    tail_padding[64];
 }BROKER_HANDLE_DATA;
 
 DEFINE_REFCOUNT_TYPE(BROKER_HANDLE_DATA);
@@ -49,13 +220,196 @@ typedef struct BROKER_MODULEINFO_TAG
     THREAD_HANDLE   thread;
     /** Socket this module will receive messages on */
     int             receive_socket;
-    /** Lock to prevent nanomsg race condition */
+    /** Lock to prevent nanomsg race condition, or to put the zero-copy worker
+     *  to sleep without missing a wake up
+     */
     LOCK_HANDLE     socket_lock;
     /** Guid sent to module worker thread to close task */
     STRING_HANDLE   quit_message_guid;
+    /** BROKER_LINKs to the modules linked to this one as sinks (zero-copy delivery only) */
+    VECTOR_HANDLE   sinks;
+    /** Messages waiting to be delivered to this module (zero-copy delivery only) */
+    MESSAGE_RING* volatile message_queue;
+    /** Queue the worker takes messages from. Differs from message_queue after
+     *  Broker_SetSinkQueue until the worker has drained the previous queue.
+     */
+    MESSAGE_RING*   consumer_queue;
+    /** Set to consumer_queue once no publisher can push to it anymore, the
+     *  worker frees it when it is empty and clears this
+     */
+    MESSAGE_RING* volatile retired_queue;
+    /** Signalled when a message is queued for a sleeping worker or the worker has to stop */
+    COND_HANDLE     queue_condition;
+    /** Signalled when the worker took a message off a queue blocked publishers wait on */
+    COND_HANDLE     space_condition;
+    /** Non-zero while the worker is about to sleep on queue_condition */
+    volatile long   is_waiting;
+    /** Number of publishers waiting on space_condition */
+    volatile long   blocked_publishers;
+    /** Messages dropped because the queue was full or being sampled */
+    volatile long   dropped_count;
+    /** Times a publisher had to wait for room in the queue */
+    volatile long   blocked_count;
+    /** Cleared to ask the queue worker to exit */
+    volatile bool   is_running;
+    /** The module's Module_ReceiveBatch, NULL if it receives one message at a time */
+    pfModule_ReceiveBatch receive_batch;
+    /** Messages being handed to receive_batch, room for batch_size of them */
+    MESSAGE_HANDLE* batch;
+    /** Largest number of messages handed to receive_batch at once */
+    size_t          batch_size;
+    /** How long the zero-copy worker waits for a batch to fill up */
+    unsigned int    batch_window_ms;
+    /** Pool delivering the module's messages, NULL if the module has a thread of its own */
+    BROKER_POOL*    pool;
+    /** Non-zero while the module is queued on a pooled worker or being run by one */
+    volatile long   scheduled;
+    /** The pooled worker running the module, NULL when it is not running */
+    BROKER_WORKER* volatile worker;
+    /** Next module queued on the same pooled worker */
+    struct BROKER_MODULEINFO_TAG* next_scheduled;
+    /** Set when publishers call the module themselves instead of queuing messages for it */
+    volatile bool   deliver_inline;
+    /** Number of routes, swapped in or still held by a publisher, that
+     *  deliver to this module (zero-copy delivery only)
+     */
+    volatile long   sink_routes;
+    /** Messages of high priority links, drained before message_queue. NULL
+     *  until the first such link to the module is added, then kept until the
+     *  module is removed.
+     */
+    MESSAGE_RING* volatile priority_queue;
+    /** Messages the worker delivered off priority_queue since it last took
+     *  one off its other queue
+     */
+    size_t          priority_streak;
+    /** The item of BROKER_HANDLE_DATA::modules holding this module */
+    LIST_ITEM_HANDLE list_item;
 
 }BROKER_MODULEINFO;
 
+/*first slot of a power of two sized table where handle is looked up*/
+static size_t handle_slot(const void* handle, size_t mask)
+{
+    /*handles are heap addresses, mix the high bits into the low ones*/
+    size_t hash = (size_t)(uintptr_t)handle;
+    hash ^= hash >> 16;
+    hash *= 0x45d9f3b;
+    hash ^= hash >> 16;
+    return hash & mask;
+}
+
+static void module_index_insert(BROKER_MODULEINFO** index, size_t size, BROKER_MODULEINFO* module_info)
+{
+    size_t mask = size - 1;
+    size_t slot = handle_slot(module_info->module->module_handle, mask);
+    while (index[slot] != NULL)
+    {
+        slot = (slot + 1) & mask;
+    }
+    index[slot] = module_info;
+}
+
+/*adds module_info to the module index, doubling the index when it would be
+  more than half full. Must be called with modules_lock held. Returns 0 if
+  success, otherwise __LINE__*/
+static int module_index_add(BROKER_HANDLE_DATA* broker_data, BROKER_MODULEINFO* module_info)
+{
+    int result;
+    if ((broker_data->module_count + 1) * 2 <= broker_data->module_index_size)
+    {
+        module_index_insert(broker_data->module_index, broker_data->module_index_size, module_info);
+        broker_data->module_count++;
+        result = 0;
+    }
+    else
+    {
+        size_t size = (broker_data->module_index_size == 0) ? BROKER_INDEX_MIN_SIZE : broker_data->module_index_size * 2;
+        BROKER_MODULEINFO** index = (BROKER_MODULEINFO**)malloc(size * sizeof(BROKER_MODULEINFO*));
+        if (index == NULL)
+        {
+            LogError("unable to allocate a module index of %zu slots", size);
+            result = __LINE__;
+        }
+        else
+        {
+            for (size_t i = 0; i < size; i++)
+            {
+                index[i] = NULL;
+            }
+            for (size_t i = 0; i < broker_data->module_index_size; i++)
+            {
+                if (broker_data->module_index[i] != NULL)
+                {
+                    module_index_insert(index, size, broker_data->module_index[i]);
+                }
+            }
+            module_index_insert(index, size, module_info);
+            if (broker_data->module_index != NULL)
+            {
+                free(broker_data->module_index);
+            }
+            broker_data->module_index = index;
+            broker_data->module_index_size = size;
+            broker_data->module_count++;
+            result = 0;
+        }
+    }
+    return result;
+}
+
+/*takes module_info, which has to be in the module index, out of it. Must be
+  called with modules_lock held.*/
+static void module_index_remove(BROKER_HANDLE_DATA* broker_data, const BROKER_MODULEINFO* module_info)
+{
+    BROKER_MODULEINFO** index = broker_data->module_index;
+    size_t mask = broker_data->module_index_size - 1;
+    size_t slot = handle_slot(module_info->module->module_handle, mask);
+    size_t next;
+    while (index[slot] != module_info)
+    {
+        slot = (slot + 1) & mask;
+    }
+
+    /*moves back the modules probed past the freed slot so that they are still
+      found from their first slot*/
+    next = (slot + 1) & mask;
+    while (index[next] != NULL)
+    {
+        size_t first = handle_slot(index[next]->module->module_handle, mask);
+        if (((next - first) & mask) >= ((next - slot) & mask))
+        {
+            index[slot] = index[next];
+            slot = next;
+        }
+        next = (next + 1) & mask;
+    }
+    index[slot] = NULL;
+    broker_data->module_count--;
+}
+
+/*returns the module attached with module_handle, NULL if there is none. Must
+  be called with modules_lock held.*/
+static BROKER_MODULEINFO* module_index_find(const BROKER_HANDLE_DATA* broker_data, MODULE_HANDLE module_handle)
+{
+    BROKER_MODULEINFO* result = NULL;
+    if (broker_data->module_index != NULL)
+    {
+        size_t mask = broker_data->module_index_size - 1;
+        size_t slot = handle_slot(module_handle, mask);
+        while (broker_data->module_index[slot] != NULL)
+        {
+            if (broker_data->module_index[slot]->module->module_handle == module_handle)
+            {
+                result = broker_data->module_index[slot];
+                break;
+            }
+            slot = (slot + 1) & mask;
+        }
+    }
+    return result;
+}
+
 static STRING_HANDLE construct_url()
 {
     STRING_HANDLE result;
@@ -90,7 +444,70 @@ static STRING_HANDLE construct_url()
     return result;
 }
 
-BROKER_HANDLE Broker_Create(void)
+/*returns 0 if success, otherwise __LINE__*/
+static int init_publish_socket(BROKER_HANDLE_DATA* broker_data)
+{
+    int result;
+
+    /*Codes_SRS_BROKER_17_001: [ Broker_Create shall initialize a socket for publishing messages. ]*/
+    broker_data->publish_socket = nn_socket(AF_SP, NN_PUB);
+    if (broker_data->publish_socket < 0)
+    {
+        /*Codes_SRS_BROKER_13_003: [ This function shall return NULL if an underlying API call to the platform causes an error. ]*/
+        LogError("nanomsg puclish socket create failedL %d", broker_data->publish_socket);
+        result = __LINE__;
+    }
+    else
+    {
+        broker_data->url = construct_url();
+        if (broker_data->url == NULL)
+        {
+            /*Codes_SRS_BROKER_13_003: [ This function shall return NULL if an underlying API call to the platform causes an error. ]*/
+            nn_close(broker_data->publish_socket);
+            LogError("Unable to generate unique url.");
+            result = __LINE__;
+        }
+        else
+        {
+            /*Codes_SRS_BROKER_17_004: [ Broker_Create shall bind the socket to the BROKER_HANDLE_DATA::url. ]*/
+            if (nn_bind(broker_data->publish_socket, STRING_c_str(broker_data->url)) < 0)
+            {
+                /*Codes_SRS_BROKER_13_003: [ This function shall return NULL if an underlying API call to the platform causes an error. ]*/
+                LogError("nanomsg bind failed");
+                nn_close(broker_data->publish_socket);
+                STRING_delete(broker_data->url);
+                result = __LINE__;
+            }
+            else
+            {
+                result = 0;
+            }
+        }
+    }
+
+    return result;
+}
+
+static BROKER_POOL* pool_create(size_t worker_count);
+
+/*number of processors a pool of workers is sized after by default*/
+static size_t processor_count(void)
+{
+    size_t result;
+#ifdef _WIN32
+    SYSTEM_INFO system_info;
+    GetSystemInfo(&system_info);
+    result = (size_t)system_info.dwNumberOfProcessors;
+#else
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    result = (count > 0) ? (size_t)count : 1;
+#endif
+    return (result > BROKER_MAX_WORKER_COUNT) ? BROKER_MAX_WORKER_COUNT : result;
+}
+
+/*worker_count is the size of the pool of workers, 0 when every module has a
+  thread of its own*/
+static BROKER_HANDLE_DATA* broker_create_internal(BROKER_DELIVERY_MODE delivery_mode, size_t queue_capacity, size_t batch_size, unsigned int batch_window_ms, size_t worker_count)
 {
     BROKER_HANDLE_DATA* result;
 
@@ -126,51 +543,122 @@ BROKER_HANDLE Broker_Create(void)
             }
             else
             {
-                /*Codes_SRS_BROKER_17_001: [ Broker_Create shall initialize a socket for publishing messages. ]*/
-                result->publish_socket = nn_socket(AF_SP, NN_PUB);
-                if (result->publish_socket < 0)
-                {
-                    /*Codes_SRS_BROKER_13_003: [ This function shall return NULL if an underlying API call to the platform causes an error. ]*/
-                    LogError("nanomsg puclish socket create failedL %d", result->publish_socket);
-                    singlylinkedlist_destroy(result->modules);
-                    Lock_Deinit(result->modules_lock);
-                    free(result);
-                    result = NULL;
-                }
-                else
+                result->module_index = NULL;
+                result->module_index_size = 0;
+                result->module_count = 0;
+                result->delivery_mode = delivery_mode;
+                result->queue_capacity = queue_capacity;
+                result->batch_size = batch_size;
+                result->batch_window_ms = batch_window_ms;
+                result->pool = NULL;
+                result->routing = NULL;
+                result->routing_epoch = 0;
+                result->routing_readers[0] = 0;
+                result->routing_readers[1] = 0;
+                if (delivery_mode == BROKER_DELIVERY_ZERO_COPY)
                 {
-                    result->url = construct_url();
-                    if (result->url == NULL)
+                    /*Codes_SRS_BROKER_30_003: [ If `config->delivery_mode` is `BROKER_DELIVERY_ZERO_COPY`, `Broker_CreateWithConfig` shall not create the nanomsg publish socket nor the url. ]*/
+                    result->publish_socket = -1;
+                    result->url = NULL;
+                    if (worker_count > 0 &&
+                        (result->pool = pool_create(worker_count)) == NULL)
                     {
                         /*Codes_SRS_BROKER_13_003: [ This function shall return NULL if an underlying API call to the platform causes an error. ]*/
+                        LogError("unable to create the pool of workers");
                         singlylinkedlist_destroy(result->modules);
                         Lock_Deinit(result->modules_lock);
-                        nn_close(result->publish_socket);
                         free(result);
-                        LogError("Unable to generate unique url.");
                         result = NULL;
                     }
-                    else
-                    {
-                        /*Codes_SRS_BROKER_17_004: [ Broker_Create shall bind the socket to the BROKER_HANDLE_DATA::url. ]*/
-                        if (nn_bind(result->publish_socket, STRING_c_str(result->url)) < 0)
-                        {
-                            /*Codes_SRS_BROKER_13_003: [ This function shall return NULL if an underlying API call to the platform causes an error. ]*/
-                            LogError("nanomsg bind failed");
-                            singlylinkedlist_destroy(result->modules);
-                            Lock_Deinit(result->modules_lock);
-                            nn_close(result->publish_socket);
-                            STRING_delete(result->url);                
-                            free(result);
-                            result = NULL;
-                        }
-                    }
+                }
+                else if (init_publish_socket(result) != 0)
+                {
+                    /*Codes_SRS_BROKER_13_003: [ This function shall return NULL if an underlying API call to the platform causes an error. ]*/
+                    singlylinkedlist_destroy(result->modules);
+                    Lock_Deinit(result->modules_lock);
+                    free(result);
+                    result = NULL;
                 }
             }
         }
     }
 
+    return result;
+}
+
+BROKER_HANDLE Broker_Create(void)
+{
     /*Codes_SRS_BROKER_13_001: [This API shall yield a BROKER_HANDLE representing the newly created message broker. This handle value shall not be equal to NULL when the API call is successful.]*/
+    return broker_create_internal(BROKER_DELIVERY_SERIALIZED, BROKER_DEFAULT_QUEUE_CAPACITY, BROKER_DEFAULT_BATCH_SIZE, 0, 0);
+}
+
+BROKER_HANDLE Broker_CreateWithConfig(const BROKER_CONFIG* config)
+{
+    BROKER_HANDLE result;
+
+    if (config == NULL)
+    {
+        /*Codes_SRS_BROKER_30_001: [ If `config` is `NULL`, `Broker_CreateWithConfig` shall create the broker exactly as `Broker_Create` does. ]*/
+        result = broker_create_internal(BROKER_DELIVERY_SERIALIZED, BROKER_DEFAULT_QUEUE_CAPACITY, BROKER_DEFAULT_BATCH_SIZE, 0, 0);
+    }
+    else if (config->delivery_mode != BROKER_DELIVERY_SERIALIZED &&
+        config->delivery_mode != BROKER_DELIVERY_ZERO_COPY)
+    {
+        /*Codes_SRS_BROKER_30_002: [ If `config->delivery_mode` is not a valid `BROKER_DELIVERY_MODE`, `Broker_CreateWithConfig` shall fail and return `NULL`. ]*/
+        LogError("invalid delivery mode %d", (int)config->delivery_mode);
+        result = NULL;
+    }
+    else if (config->queue_capacity > BROKER_MAX_QUEUE_CAPACITY)
+    {
+        /*Codes_SRS_BROKER_30_005: [ If `config->queue_capacity` is greater than 2^24, `Broker_CreateWithConfig` shall fail and return `NULL`. ]*/
+        LogError("queue capacity %zu is too large", config->queue_capacity);
+        result = NULL;
+    }
+    else if (config->batch_size > BROKER_MAX_QUEUE_CAPACITY)
+    {
+        /*Codes_SRS_BROKER_30_070: [ If `config->batch_size` is greater than 2^24, `Broker_CreateWithConfig` shall fail and return `NULL`. ]*/
+        LogError("batch size %zu is too large", config->batch_size);
+        result = NULL;
+    }
+    else if (config->scheduler != BROKER_SCHEDULER_DEDICATED_THREADS &&
+        config->scheduler != BROKER_SCHEDULER_THREAD_POOL)
+    {
+        /*Codes_SRS_BROKER_30_100: [ If `config->scheduler` is not a valid `BROKER_SCHEDULER`, `Broker_CreateWithConfig` shall fail and return `NULL`. ]*/
+        LogError("invalid scheduler %d", (int)config->scheduler);
+        result = NULL;
+    }
+    else if (config->worker_count > BROKER_MAX_WORKER_COUNT)
+    {
+        /*Codes_SRS_BROKER_30_101: [ If `config->worker_count` is greater than `BROKER_MAX_WORKER_COUNT`, `Broker_CreateWithConfig` shall fail and return `NULL`. ]*/
+        LogError("worker count %zu is too large", config->worker_count);
+        result = NULL;
+    }
+    else
+    {
+        /*Codes_SRS_BROKER_30_006: [ A `config->queue_capacity` of 0 shall select `BROKER_DEFAULT_QUEUE_CAPACITY`, any other value shall be rounded up to the next power of two. ]*/
+        size_t queue_capacity = 1;
+        while (queue_capacity < config->queue_capacity)
+        {
+            queue_capacity <<= 1;
+        }
+        if (config->queue_capacity == 0)
+        {
+            queue_capacity = BROKER_DEFAULT_QUEUE_CAPACITY;
+        }
+        /*Codes_SRS_BROKER_30_071: [ A `config->batch_size` of 0 shall select `BROKER_DEFAULT_BATCH_SIZE`. ]*/
+        size_t batch_size = (config->batch_size == 0) ? BROKER_DEFAULT_BATCH_SIZE : config->batch_size;
+        size_t worker_count = 0;
+        if (config->delivery_mode == BROKER_DELIVERY_ZERO_COPY &&
+            config->scheduler == BROKER_SCHEDULER_THREAD_POOL)
+        {
+            /*Codes_SRS_BROKER_30_102: [ If `config->delivery_mode` is `BROKER_DELIVERY_ZERO_COPY` and `config->scheduler` is `BROKER_SCHEDULER_THREAD_POOL`, `Broker_CreateWithConfig` shall start a pool of `config->worker_count` workers, the number of processors if it is 0, each with a lock and a thread, and fail and return `NULL` if that fails. ]*/
+            worker_count = (config->worker_count == 0) ? processor_count() : config->worker_count;
+        }
+        /*Codes_SRS_BROKER_30_103: [ With `BROKER_DELIVERY_SERIALIZED`, `config->scheduler` and `config->worker_count` shall be ignored. ]*/
+        /*Codes_SRS_BROKER_30_004: [ Otherwise `Broker_CreateWithConfig` shall create the broker as `Broker_Create` does, using `config->delivery_mode` to deliver messages. ]*/
+        result = broker_create_internal(config->delivery_mode, queue_capacity, batch_size, config->batch_window_ms, worker_count);
+    }
+
     return result;
 }
 
@@ -188,599 +676,2912 @@ void Broker_IncRef(BROKER_HANDLE broker)
     }
 }
 
-/**
-* This function runs for each module. It receives a pointer to a MODULE_INFO
-* object that describes the module. Its job is to call the Receive function on
-* the associated module whenever it receives a message.
-*/
-static int module_worker(void * user_data)
+/*allocates a ring of capacity slots, capacity must be a power of two*/
+static MESSAGE_RING* message_ring_create(size_t capacity, BROKER_OVERFLOW_POLICY overflow, size_t sample_interval)
 {
-    /*Codes_SRS_BROKER_13_026: [This function shall assign `user_data` to a local variable called `module_info` of type `BROKER_MODULEINFO*`.]*/
-    BROKER_MODULEINFO* module_info = (BROKER_MODULEINFO*)user_data;
-
-    int should_continue = 1;
-    while (should_continue)
+    MESSAGE_RING* result = (MESSAGE_RING*)malloc(sizeof(MESSAGE_RING) + (capacity * sizeof(MESSAGE_RING_CELL)));
+    if (result == NULL)
     {
-        /*Codes_SRS_BROKER_13_089: [ This function shall acquire the lock on module_info->socket_lock. ]*/
-        if (Lock(module_info->socket_lock))
+        LogError("unable to allocate a message queue of %zu messages", capacity);
+    }
+    else
+    {
+        result->mask = capacity - 1;
+        result->cells = (MESSAGE_RING_CELL*)(result + 1);
+        for (size_t i = 0; i < capacity; i++)
         {
-            /*Codes_SRS_BROKER_02_004: [ If acquiring the lock fails, then module_worker shall return. ]*/
-            LogError("unable to Lock");
-            should_continue = 0;
-            break;
+            result->cells[i].sequence = (long)(2 * i);
+            result->cells[i].message = NULL;
         }
-        int nn_fd = module_info->receive_socket;
-        int nbytes;
-        unsigned char *buf = NULL;
+        result->overflow = overflow;
+        result->sample_interval = (long)sample_interval;
+        result->sample_counter = 0;
+        result->enqueue_position = 0;
+        result->dequeue_position = 0;
+    }
+    return result;
+}
 
-        /*Codes_SRS_BROKER_17_005: [ For every iteration of the loop, the function shall wait on the receive_socket for messages. ]*/
-        nbytes = nn_recv(nn_fd, (void *)&buf, NN_MSG, 0);
-        /*Codes_SRS_BROKER_13_091: [ The function shall unlock module_info->socket_lock. ]*/
-        if (Unlock(module_info->socket_lock) != LOCK_OK)
+/*returns 0 if message was queued, otherwise __LINE__ (the ring is full). Safe
+  to call from any number of threads at once.*/
+static int message_ring_push(MESSAGE_RING* ring, MESSAGE_HANDLE message)
+{
+    int result;
+    long position = ATOMIC_LOAD(&ring->enqueue_position);
+    for (;;)
+    {
+        MESSAGE_RING_CELL* cell = &(ring->cells[(size_t)position & ring->mask]);
+        long difference = (long)((unsigned long)ATOMIC_LOAD(&cell->sequence) - (2 * (unsigned long)position));
+        if (difference == 0)
         {
-            /*Codes_SRS_BROKER_17_016: [ If releasing the lock fails, then module_worker shall return. ]*/
-            should_continue = 0;
-            if (nbytes > 0)
+            long observed = ATOMIC_COMPARE_EXCHANGE(&ring->enqueue_position, (long)((unsigned long)position + 1), position);
+            if (observed == position)
             {
-                /*Codes_SRS_BROKER_17_019: [ The function shall free the buffer received on the receive_socket. ]*/
-                nn_freemsg(buf);
+                cell->message = message;
+                /*hands the slot to the consumer, sequence becomes 2 * position + 1*/
+                (void)ATOMIC_INC(&cell->sequence);
+                result = 0;
+                break;
             }
-            break;
+            position = observed;
         }
-
-        if (nbytes < 0)
+        else if (difference < 0)
         {
-            /*Codes_SRS_BROKER_17_006: [ An error on receiving a message shall terminate the loop. ]*/
-            should_continue = 0;
+            /*the consumer has not freed this slot yet*/
+            result = __LINE__;
+            break;
         }
         else
         {
-            if (nbytes == BROKER_GUID_SIZE &&
-                (strncmp(STRING_c_str(module_info->quit_message_guid), (const char *)buf, BROKER_GUID_SIZE-1)==0))
-            {
-                /*Codes_SRS_BROKER_13_068: [ This function shall run a loop that keeps running until module_info->quit_message_guid is sent to the thread. ]*/
-                /* received special quit message for this module */
-                should_continue = 0;
-            }
-            else
-            {
-                /*Codes_SRS_BROKER_17_024: [ The function shall strip off the topic from the message. ]*/
-                const unsigned char*buf_bytes = (const unsigned char*)buf;
-                buf_bytes += sizeof(MODULE_HANDLE);
-                /*Codes_SRS_BROKER_17_017: [ The function shall deserialize the message received. ]*/
-                MESSAGE_HANDLE msg = Message_CreateFromByteArray(buf_bytes, nbytes - sizeof(MODULE_HANDLE));
-                /*Codes_SRS_BROKER_17_018: [ If the deserialization is not successful, the message loop shall continue. ]*/
-                if (msg != NULL)
-                {
-                    /*Codes_SRS_BROKER_13_092: [The function shall deliver the message to the module's callback function via module_info->module_apis. ]*/
-                    MODULE_RECEIVE(module_info->module->module_apis)(module_info->module->module_handle, msg);
-                    /*Codes_SRS_BROKER_13_093: [ The function shall destroy the message that was dequeued by calling Message_Destroy. ]*/
-                    Message_Destroy(msg);
-                }
-            }
-            /*Codes_SRS_BROKER_17_019: [ The function shall free the buffer received on the receive_socket. ]*/
-            nn_freemsg(buf);
-        }    
+            /*another publisher claimed the slot first*/
+            position = ATOMIC_LOAD(&ring->enqueue_position);
+        }
     }
-
-    return 0;
+    return result;
 }
 
-static BROKER_RESULT init_module(BROKER_MODULEINFO* module_info, const MODULE* module)
+/*returns the oldest message or NULL when the ring is empty. Safe to call from
+  any number of threads at once.*/
+static MESSAGE_HANDLE message_ring_pop(MESSAGE_RING* ring)
 {
-    BROKER_RESULT result;
-
-    /*Codes_SRS_BROKER_13_107: The function shall assign the `module` handle to `BROKER_MODULEINFO::module`.*/
-    module_info->module = (MODULE*)malloc(sizeof(MODULE));
-    if (module_info->module == NULL)
-    {
-        LogError("Allocate module failed");
-        result = BROKER_ERROR;
-    }
-    else
+    MESSAGE_HANDLE result;
+    long position = ATOMIC_LOAD(&ring->dequeue_position);
+    for (;;)
     {
-        module_info->module->module_apis = module->module_apis;
-        module_info->module->module_handle = module->module_handle;
-
-        /*Codes_SRS_BROKER_13_099: [The function shall initialize BROKER_MODULEINFO::socket_lock with a valid lock handle.]*/
-        module_info->socket_lock = Lock_Init();
-        if (module_info->socket_lock == NULL)
+        MESSAGE_RING_CELL* cell = &(ring->cells[(size_t)position & ring->mask]);
+        long difference = (long)((unsigned long)ATOMIC_LOAD(&cell->sequence) - (2 * (unsigned long)position + 1));
+        if (difference == 0)
         {
-            /*Codes_SRS_BROKER_13_047: [ This function shall return BROKER_ERROR if an underlying API call to the platform causes an error or BROKER_OK otherwise. ]*/
-            LogError("Lock_Init for socket lock failed");
-            result = BROKER_ERROR;
+            long observed = ATOMIC_COMPARE_EXCHANGE(&ring->dequeue_position, (long)((unsigned long)position + 1), position);
+            if (observed == position)
+            {
+                result = cell->message;
+                cell->message = NULL;
+                /*frees the slot for the publisher one lap ahead, sequence becomes 2 * (position + capacity)*/
+                (void)ATOMIC_ADD(&cell->sequence, (long)(2 * ring->mask + 1));
+                break;
+            }
+            position = observed;
         }
-        else
+        else if (difference < 0)
         {
-            char uuid[BROKER_GUID_SIZE];
-            memset(uuid, 0, BROKER_GUID_SIZE);
+            /*no publisher has filled this slot yet*/
+            result = NULL;
+            break;
+        }
+        else
+        {
+            /*another consumer took the message first*/
+            position = ATOMIC_LOAD(&ring->dequeue_position);
+        }
+    }
+    return result;
+}
+
+/*number of messages in the ring, only a snapshot while publishers are active*/
+static size_t message_ring_count(MESSAGE_RING* ring)
+{
+    long dequeue_position = ATOMIC_LOAD(&ring->dequeue_position);
+    long difference = (long)((unsigned long)ATOMIC_LOAD(&ring->enqueue_position) - (unsigned long)dequeue_position);
+    return (difference < 0) ? 0 : (size_t)difference;
+}
+
+static bool message_ring_is_empty(MESSAGE_RING* ring)
+{
+    return message_ring_count(ring) == 0;
+}
+
+/*releases a buffer received from nanomsg once the message wrapping it is destroyed*/
+static void free_received_buffer(void* buf)
+{
+    (void)nn_freemsg(buf);
+}
+
+static bool is_quit_message(BROKER_MODULEINFO* module_info, const unsigned char* buf, int nbytes)
+{
+    return nbytes == BROKER_GUID_SIZE &&
+        (strncmp(STRING_c_str(module_info->quit_message_guid), (const char *)buf, BROKER_GUID_SIZE-1)==0);
+}
+
+/*hands module_info->batch to the module and destroys the messages in it*/
+static void deliver_batch(BROKER_MODULEINFO* module_info, size_t count)
+{
+    /*Codes_SRS_BROKER_30_074: [ The worker shall hand the messages to `Module_ReceiveBatch` in the order they were published and destroy each of them by calling `Message_Destroy` once it returns. ]*/
+    module_info->receive_batch(module_info->module->module_handle, module_info->batch, count);
+    for (size_t index = 0; index < count; index++)
+    {
+        Message_Destroy(module_info->batch[index]);
+    }
+}
+
+/**
+* Called by module_worker once it received msg for a module that implements
+* Module_ReceiveBatch: takes the messages already waiting on the socket,
+* without waiting for more, and delivers them together with msg. Returns 0 if
+* the worker has to stop.
+*/
+static int receive_socket_batch(BROKER_MODULEINFO* module_info, MESSAGE_HANDLE msg)
+{
+    int should_continue = 1;
+    bool is_draining = true;
+    size_t count = 1;
+
+    module_info->batch[0] = msg;
+    /*Codes_SRS_BROKER_30_073: [ Once it received a message for a module with a `Module_ReceiveBatch`, the worker shall receive every message already waiting on the receive_socket, without waiting, until it holds `batch_size` messages. ]*/
+    while (is_draining && count < module_info->batch_size)
+    {
+        unsigned char *buf = NULL;
+        int nbytes = -1;
+
+        if (Lock(module_info->socket_lock) != LOCK_OK)
+        {
+            LogError("unable to Lock");
+            should_continue = 0;
+            is_draining = false;
+        }
+        else
+        {
+            nbytes = nn_recv(module_info->receive_socket, (void *)&buf, NN_MSG, NN_DONTWAIT);
+            if (Unlock(module_info->socket_lock) != LOCK_OK)
+            {
+                should_continue = 0;
+                is_draining = false;
+            }
+            else if (nbytes < 0)
+            {
+                /*nothing else is waiting, an actual error shows up on the next blocking receive*/
+                is_draining = false;
+            }
+            else if (is_quit_message(module_info, buf, nbytes))
+            {
+                /*Codes_SRS_BROKER_30_075: [ If the quit message is among them, the worker shall deliver the messages received before it and return. ]*/
+                should_continue = 0;
+                is_draining = false;
+            }
+            else
+            {
+                MESSAGE_HANDLE next = Message_CreateFromByteArrayNoCopy(buf + sizeof(MODULE_HANDLE), nbytes - sizeof(MODULE_HANDLE), free_received_buffer, buf);
+                if (next != NULL)
+                {
+                    /*the message owns buf now*/
+                    module_info->batch[count++] = next;
+                    buf = NULL;
+                }
+            }
+
+            if (buf != NULL)
+            {
+                nn_freemsg(buf);
+            }
+        }
+    }
+
+    deliver_batch(module_info, count);
+    return should_continue;
+}
+
+/**
+* This function runs for each module. It receives a pointer to a MODULE_INFO
+* object that describes the module. Its job is to call the Receive function on
+* the associated module whenever it receives a message.
+*/
+static int module_worker(void * user_data)
+{
+    /*Codes_SRS_BROKER_13_026: [This function shall assign `user_data` to a local variable called `module_info` of type `BROKER_MODULEINFO*`.]*/
+    BROKER_MODULEINFO* module_info = (BROKER_MODULEINFO*)user_data;
+
+    int should_continue = 1;
+    while (should_continue)
+    {
+        /*Codes_SRS_BROKER_13_089: [ This function shall acquire the lock on module_info->socket_lock. ]*/
+        if (Lock(module_info->socket_lock))
+        {
+            /*Codes_SRS_BROKER_02_004: [ If acquiring the lock fails, then module_worker shall return. ]*/
+            LogError("unable to Lock");
+            should_continue = 0;
+            break;
+        }
+        int nn_fd = module_info->receive_socket;
+        int nbytes;
+        unsigned char *buf = NULL;
+
+        /*Codes_SRS_BROKER_17_005: [ For every iteration of the loop, the function shall wait on the receive_socket for messages. ]*/
+        nbytes = nn_recv(nn_fd, (void *)&buf, NN_MSG, 0);
+        /*Codes_SRS_BROKER_13_091: [ The function shall unlock module_info->socket_lock. ]*/
+        if (Unlock(module_info->socket_lock) != LOCK_OK)
+        {
+            /*Codes_SRS_BROKER_17_016: [ If releasing the lock fails, then module_worker shall return. ]*/
+            should_continue = 0;
+            if (nbytes > 0)
+            {
+                /*Codes_SRS_BROKER_17_019: [ The function shall free the buffer received on the receive_socket. ]*/
+                nn_freemsg(buf);
+            }
+            break;
+        }
+
+        if (nbytes < 0)
+        {
+            /*Codes_SRS_BROKER_17_006: [ An error on receiving a message shall terminate the loop. ]*/
+            should_continue = 0;
+        }
+        else
+        {
+            if (is_quit_message(module_info, buf, nbytes))
+            {
+                /*Codes_SRS_BROKER_13_068: [ This function shall run a loop that keeps running until module_info->quit_message_guid is sent to the thread. ]*/
+                /* received special quit message for this module */
+                should_continue = 0;
+            }
+            else
+            {
+                /*Codes_SRS_BROKER_17_024: [ The function shall strip off the topic from the message. ]*/
+                const unsigned char*buf_bytes = (const unsigned char*)buf;
+                buf_bytes += sizeof(MODULE_HANDLE);
+                /*Codes_SRS_BROKER_17_017: [ The function shall deserialize the message received. ]*/
+                /*Codes_SRS_BROKER_30_090: [ The function shall deserialize the message with Message_CreateFromByteArrayNoCopy, handing the ownership of the received buffer to the message. ]*/
+                MESSAGE_HANDLE msg = Message_CreateFromByteArrayNoCopy(buf_bytes, nbytes - sizeof(MODULE_HANDLE), free_received_buffer, buf);
+                /*Codes_SRS_BROKER_17_018: [ If the deserialization is not successful, the message loop shall continue. ]*/
+                if (msg != NULL)
+                {
+                    /*Codes_SRS_BROKER_17_019: [ The function shall free the buffer received on the receive_socket. ]*/
+                    /*buf is released with the last reference to msg*/
+                    buf = NULL;
+                    if (module_info->receive_batch != NULL)
+                    {
+                        should_continue = receive_socket_batch(module_info, msg);
+                    }
+                    else
+                    {
+                        /*Codes_SRS_BROKER_13_092: [The function shall deliver the message to the module's callback function via module_info->module_apis. ]*/
+                        MODULE_RECEIVE(module_info->module->module_apis)(module_info->module->module_handle, msg);
+                        /*Codes_SRS_BROKER_13_093: [ The function shall destroy the message that was dequeued by calling Message_Destroy. ]*/
+                        Message_Destroy(msg);
+                    }
+                }
+            }
+            if (buf != NULL)
+            {
+                /*Codes_SRS_BROKER_17_019: [ The function shall free the buffer received on the receive_socket. ]*/
+                nn_freemsg(buf);
+            }
+        }    
+    }
+
+    return 0;
+}
+
+/*wakes the publishers blocked on a full queue of module_info, if any*/
+static void wake_blocked_publishers(BROKER_MODULEINFO* module_info)
+{
+    if (ATOMIC_LOAD(&module_info->blocked_publishers) != 0)
+    {
+        if (Lock(module_info->socket_lock) != LOCK_OK)
+        {
+            LogError("unable to Lock");
+            (void)Condition_Post(module_info->space_condition);
+        }
+        else
+        {
+            (void)Condition_Post(module_info->space_condition);
+            (void)Unlock(module_info->socket_lock);
+        }
+    }
+}
+
+/*moves messages from queue to module_info->batch until it holds batch_size of
+  them or queue is empty, returns the number of messages in the batch*/
+static size_t fill_batch(BROKER_MODULEINFO* module_info, MESSAGE_RING* queue, size_t count)
+{
+    MESSAGE_HANDLE msg;
+    while (count < module_info->batch_size && (msg = message_ring_pop(queue)) != NULL)
+    {
+        module_info->batch[count++] = msg;
+        wake_blocked_publishers(module_info);
+    }
+    return count;
+}
+
+/*zero-copy counterpart of receive_socket_batch, returns the number of
+  messages delivered*/
+static size_t receive_queue_batch(BROKER_MODULEINFO* module_info, MESSAGE_RING* queue, MESSAGE_HANDLE msg)
+{
+    module_info->batch[0] = msg;
+    /*Codes_SRS_BROKER_30_076: [ Once it dequeued a message for a module with a `Module_ReceiveBatch`, the zero-copy worker shall dequeue more until it holds `batch_size` messages or the queue is empty. ]*/
+    size_t count = fill_batch(module_info, queue, 1);
+    /*Codes_SRS_BROKER_30_110: [ A pooled worker shall deliver a batch that is not full right away, whatever `batch_window_ms` is. ]*/
+    if (count < module_info->batch_size && module_info->batch_window_ms > 0 && module_info->pool == NULL)
+    {
+        /*Codes_SRS_BROKER_30_077: [ If the batch is not full and `batch_window_ms` is not 0, the zero-copy worker shall wait on `queue_condition` for `batch_window_ms` milliseconds, without flagging itself as waiting, and dequeue more messages before delivering the batch. ]*/
+        if (Lock(module_info->socket_lock) != LOCK_OK)
+        {
+            LogError("unable to Lock, delivering the batch right away");
+        }
+        else
+        {
+            if (module_info->is_running)
+            {
+                (void)Condition_Wait(module_info->queue_condition, module_info->socket_lock, (int)module_info->batch_window_ms);
+            }
+            (void)Unlock(module_info->socket_lock);
+            count = fill_batch(module_info, queue, count);
+        }
+    }
+    deliver_batch(module_info, count);
+    return count;
+}
+
+/*frees queue, a queue replaced by Broker_SetSinkQueue the worker has drained,
+  and moves the worker on to the current one*/
+static void switch_consumer_queue(BROKER_MODULEINFO* module_info, MESSAGE_RING* queue)
+{
+    /*Codes_SRS_BROKER_30_028: [ Once a queue replaced by `Broker_SetSinkQueue` is empty, the zero-copy worker shall free it and continue with the new queue. ]*/
+    module_info->consumer_queue = (MESSAGE_RING*)ATOMIC_LOAD_PTR(&module_info->message_queue);
+    (void)ATOMIC_EXCHANGE_PTR(&module_info->retired_queue, NULL);
+    free(queue);
+}
+
+/*hands msg, just taken off queue, to the module and returns the number of
+  messages delivered. When queue is NULL msg is delivered on its own.*/
+static size_t deliver_queued_message(BROKER_MODULEINFO* module_info, MESSAGE_RING* queue, MESSAGE_HANDLE msg)
+{
+    size_t result;
+    /*Codes_SRS_BROKER_30_027: [ After dequeuing a message the zero-copy worker shall signal `module_info->space_condition` if publishers are blocked on the queue. ]*/
+    wake_blocked_publishers(module_info);
+    if (module_info->receive_batch != NULL && queue != NULL)
+    {
+        result = receive_queue_batch(module_info, queue, msg);
+    }
+    else if (module_info->receive_batch != NULL)
+    {
+        module_info->batch[0] = msg;
+        deliver_batch(module_info, 1);
+        result = 1;
+    }
+    else
+    {
+        /*Codes_SRS_BROKER_30_025: [ The zero-copy worker shall deliver the message to the module's callback function without deserializing it. ]*/
+        MODULE_RECEIVE(module_info->module->module_apis)(module_info->module->module_handle, msg);
+        /*Codes_SRS_BROKER_30_026: [ The zero-copy worker shall destroy the dequeued message by calling `Message_Destroy`. ]*/
+        Message_Destroy(msg);
+        result = 1;
+    }
+    return result;
+}
+
+/*true if module_info has no priority lane or nothing waits on it*/
+static bool priority_queue_is_empty(BROKER_MODULEINFO* module_info)
+{
+    MESSAGE_RING* priority_queue = (MESSAGE_RING*)ATOMIC_LOAD_PTR(&module_info->priority_queue);
+    return priority_queue == NULL || message_ring_is_empty(priority_queue);
+}
+
+/*takes the next message off the priority lane of module_info or off queue
+  and delivers it, returns the number of messages delivered (0 when both are
+  empty)*/
+static size_t deliver_next_message(BROKER_MODULEINFO* module_info, MESSAGE_RING* queue)
+{
+    size_t result;
+    MESSAGE_RING* priority_queue = (MESSAGE_RING*)ATOMIC_LOAD_PTR(&module_info->priority_queue);
+    MESSAGE_HANDLE msg = NULL;
+
+    /*Codes_SRS_BROKER_30_153: [ The zero-copy worker shall take messages off the module's priority lane before its queue, except that after delivering `BROKER_PRIORITY_BURST` messages off the priority lane in a row it shall deliver a message waiting in the queue first. ]*/
+    /*Codes_SRS_BROKER_30_154: [ The messages of a batch shall all come from the lane its first message was taken from. ]*/
+    if (priority_queue != NULL && module_info->priority_streak < BROKER_PRIORITY_BURST)
+    {
+        msg = message_ring_pop(priority_queue);
+    }
+
+    if (msg != NULL)
+    {
+        result = deliver_queued_message(module_info, priority_queue, msg);
+        module_info->priority_streak += result;
+    }
+    else if ((msg = message_ring_pop(queue)) != NULL)
+    {
+        result = deliver_queued_message(module_info, queue, msg);
+        module_info->priority_streak = 0;
+    }
+    else if (priority_queue != NULL && (msg = message_ring_pop(priority_queue)) != NULL)
+    {
+        /* nothing else is waiting, the streak goes on */
+        result = deliver_queued_message(module_info, priority_queue, msg);
+    }
+    else
+    {
+        result = 0;
+    }
+    return result;
+}
+
+/*Broker_SetSinkQueue only hands the queue it replaced to the worker once no
+  publisher can be using it, and a publisher blocked on the full new queue
+  would hold it back forever. Until then the worker takes the messages of the
+  new queue one at a time, each after whatever was left on queue, so messages
+  from one source stay in order. Returns the number of messages delivered.*/
+static size_t deliver_from_next_queue(BROKER_MODULEINFO* module_info, MESSAGE_RING* queue)
+{
+    size_t result = 0;
+    MESSAGE_RING* next = (MESSAGE_RING*)ATOMIC_LOAD_PTR(&module_info->message_queue);
+    if (next != queue)
+    {
+        /*Codes_SRS_BROKER_30_029: [ Until `Broker_SetSinkQueue` hands it the queue it replaced, the zero-copy worker shall take one message at a time off the new queue and deliver it after the messages still left on the replaced queue. ]*/
+        MESSAGE_HANDLE msg = message_ring_pop(next);
+        if (msg != NULL)
+        {
+            MESSAGE_HANDLE older;
+            while ((older = message_ring_pop(queue)) != NULL)
+            {
+                result += deliver_queued_message(module_info, queue, older);
+            }
+            result += deliver_queued_message(module_info, NULL, msg);
+        }
+    }
+    return result;
+}
+
+/**
+* Zero-copy counterpart of module_worker. Messages are not received from a
+* socket but taken from BROKER_MODULEINFO::consumer_queue, where
+* Broker_Publish has placed a clone of the published message. The worker only
+* takes socket_lock when it runs out of messages and has to go to sleep.
+*/
+static int module_queue_worker(void * user_data)
+{
+    BROKER_MODULEINFO* module_info = (BROKER_MODULEINFO*)user_data;
+
+    /*Codes_SRS_BROKER_30_022: [ The zero-copy worker shall run a loop that keeps running until `module_info->is_running` is cleared. ]*/
+    while (module_info->is_running)
+    {
+        MESSAGE_RING* queue = module_info->consumer_queue;
+        /*Codes_SRS_BROKER_30_024: [ The zero-copy worker shall dequeue the oldest message without taking any lock. ]*/
+        if (deliver_next_message(module_info, queue) != 0)
+        {
+            /* keep going until both lanes are empty */
+        }
+        else if (ATOMIC_LOAD_PTR(&module_info->retired_queue) == queue)
+        {
+            switch_consumer_queue(module_info, queue);
+        }
+        else if (deliver_from_next_queue(module_info, queue) != 0)
+        {
+            /* Broker_SetSinkQueue is still waiting for publishers of the replaced queue */
+        }
+        /*Codes_SRS_BROKER_30_020: [ When the queue is empty the zero-copy worker shall acquire the lock on `module_info->socket_lock`. ]*/
+        else if (Lock(module_info->socket_lock) != LOCK_OK)
+        {
+            /*Codes_SRS_BROKER_30_021: [ If acquiring the lock fails, then the zero-copy worker shall return. ]*/
+            LogError("unable to Lock");
+            break;
+        }
+        else
+        {
+            /*Codes_SRS_BROKER_30_023: [ The zero-copy worker shall flag itself as waiting and, unless a message was queued, its queue was retired or the worker was stopped in the meantime, wait on `module_info->queue_condition`. ]*/
+            (void)ATOMIC_INC(&module_info->is_waiting);
+            if (module_info->is_running &&
+                message_ring_is_empty(queue) &&
+                message_ring_is_empty((MESSAGE_RING*)ATOMIC_LOAD_PTR(&module_info->message_queue)) &&
+                priority_queue_is_empty(module_info) &&
+                ATOMIC_LOAD_PTR(&module_info->retired_queue) != queue)
+            {
+                (void)Condition_Wait(module_info->queue_condition, module_info->socket_lock, 0);
+            }
+            (void)ATOMIC_DEC(&module_info->is_waiting);
+            (void)Unlock(module_info->socket_lock);
+        }
+    }
+
+    return 0;
+}
+
+/*true if the worker of module_info has messages to deliver or a drained queue
+  to free*/
+static bool module_has_work(BROKER_MODULEINFO* module_info)
+{
+    MESSAGE_RING* queue = module_info->consumer_queue;
+    return !message_ring_is_empty(queue) ||
+        !message_ring_is_empty((MESSAGE_RING*)ATOMIC_LOAD_PTR(&module_info->message_queue)) ||
+        !priority_queue_is_empty(module_info) ||
+        ATOMIC_LOAD_PTR(&module_info->retired_queue) == queue;
+}
+
+/*queues module_info on worker, or on the next worker in turn when worker is
+  NULL, and wakes an idle worker. module_info must be flagged as scheduled.
+  Returns 0 if success, otherwise __LINE__*/
+static int pool_push(BROKER_POOL* pool, BROKER_MODULEINFO* module_info, BROKER_WORKER* worker)
+{
+    int result;
+
+    if (worker == NULL)
+    {
+        worker = &(pool->workers[(unsigned long)ATOMIC_INC(&pool->next_worker) % pool->worker_count]);
+    }
+
+    if (Lock(worker->lock) != LOCK_OK)
+    {
+        LogError("unable to lock worker [%p]", worker);
+        result = __LINE__;
+    }
+    else
+    {
+        module_info->next_scheduled = NULL;
+        if (worker->head == NULL)
+        {
+            worker->head = module_info;
+        }
+        else
+        {
+            worker->tail->next_scheduled = module_info;
+        }
+        worker->tail = module_info;
+        (void)Unlock(worker->lock);
+
+        /* a worker going idle counts itself before it looks at pending, so
+           one of the two sees the other */
+        (void)ATOMIC_INC(&pool->pending);
+        if (ATOMIC_LOAD(&pool->idle_workers) != 0)
+        {
+            if (Lock(pool->idle_lock) != LOCK_OK)
+            {
+                LogError("unable to lock the idle workers");
+                (void)Condition_Post(pool->idle_condition);
+            }
+            else
+            {
+                (void)Condition_Post(pool->idle_condition);
+                (void)Unlock(pool->idle_lock);
+            }
+        }
+        result = 0;
+    }
+
+    return result;
+}
+
+/*takes the module queued first on worker, NULL if there is none*/
+static BROKER_MODULEINFO* worker_pop(BROKER_WORKER* worker)
+{
+    BROKER_MODULEINFO* result = NULL;
+    if (ATOMIC_LOAD_PTR(&worker->head) != NULL)
+    {
+        if (Lock(worker->lock) != LOCK_OK)
+        {
+            LogError("unable to lock worker [%p]", worker);
+        }
+        else
+        {
+            result = worker->head;
+            if (result != NULL)
+            {
+                worker->head = result->next_scheduled;
+            }
+            (void)Unlock(worker->lock);
+        }
+    }
+    return result;
+}
+
+/*takes the next module worker shall run, stealing it from the other workers
+  when worker has none queued*/
+static BROKER_MODULEINFO* pool_take(BROKER_POOL* pool, BROKER_WORKER* worker)
+{
+    size_t index = (size_t)(worker - pool->workers);
+    /*Codes_SRS_BROKER_30_108: [ A pooled worker shall run the module queued first on it or, if there is none, steal the module queued first on another worker. ]*/
+    BROKER_MODULEINFO* result = worker_pop(worker);
+    for (size_t i = 1; result == NULL && i < pool->worker_count; i++)
+    {
+        result = worker_pop(&(pool->workers[(index + i) % pool->worker_count]));
+    }
+    if (result != NULL)
+    {
+        (void)ATOMIC_DEC(&pool->pending);
+    }
+    return result;
+}
+
+/*makes sure a pooled worker runs module_info. It is queued on worker when
+  that is not NULL.*/
+static void schedule_module(BROKER_MODULEINFO* module_info, BROKER_WORKER* worker)
+{
+    if (ATOMIC_COMPARE_EXCHANGE(&module_info->scheduled, 1, 0) == 0 &&
+        pool_push(module_info->pool, module_info, worker) != 0)
+    {
+        /* the messages stay queued, the next one published tries again */
+        (void)ATOMIC_COMPARE_EXCHANGE(&module_info->scheduled, 0, 1);
+    }
+}
+
+/*called by the pooled worker that ran out of messages for module_info. Once
+  the module is no longer flagged as scheduled Broker_RemoveModule may free it,
+  so the flag is cleared under socket_lock and module_info is not touched
+  after it is released.*/
+static void unschedule_module(BROKER_MODULEINFO* module_info, BROKER_WORKER* worker)
+{
+    BROKER_POOL* pool = module_info->pool;
+    bool requeue = false;
+
+    if (Lock(module_info->socket_lock) != LOCK_OK)
+    {
+        /* the messages stay queued, the next one published schedules the module again */
+        LogError("unable to lock the queue of module [%p]", module_info);
+        (void)ATOMIC_COMPARE_EXCHANGE(&module_info->scheduled, 0, 1);
+    }
+    else
+    {
+        /*Codes_SRS_BROKER_30_111: [ When a pooled module has no message left, its worker shall clear the module's scheduled flag under `socket_lock` and queue the module again if a message was queued for it in the meantime. ]*/
+        (void)ATOMIC_COMPARE_EXCHANGE(&module_info->scheduled, 0, 1);
+        if (!module_info->is_running)
+        {
+            (void)Condition_Post(module_info->queue_condition);
+        }
+        else if (module_has_work(module_info) &&
+            ATOMIC_COMPARE_EXCHANGE(&module_info->scheduled, 1, 0) == 0)
+        {
+            requeue = true;
+        }
+        (void)Unlock(module_info->socket_lock);
+    }
+
+    if (requeue && pool_push(pool, module_info, worker) != 0)
+    {
+        (void)ATOMIC_COMPARE_EXCHANGE(&module_info->scheduled, 0, 1);
+    }
+}
+
+/*delivers the messages waiting for module_info on a pooled worker*/
+static void run_module(BROKER_MODULEINFO* module_info, BROKER_WORKER* worker)
+{
+    size_t delivered = 0;
+    bool requeue = false;
+
+    /* publishers running on this worker queue their sinks on it */
+    module_info->worker = worker;
+    while (module_info->is_running)
+    {
+        MESSAGE_RING* queue = module_info->consumer_queue;
+        size_t next_delivered;
+        if (delivered >= BROKER_WORKER_QUANTUM)
+        {
+            /*Codes_SRS_BROKER_30_109: [ A pooled worker shall deliver at most `BROKER_WORKER_QUANTUM` messages to a module before queuing it again behind the other modules queued on the worker. ]*/
+            requeue = true;
+            break;
+        }
+        else if ((next_delivered = deliver_next_message(module_info, queue)) != 0)
+        {
+            delivered += next_delivered;
+        }
+        else if (ATOMIC_LOAD_PTR(&module_info->retired_queue) == queue)
+        {
+            switch_consumer_queue(module_info, queue);
+        }
+        else
+        {
+            next_delivered = deliver_from_next_queue(module_info, queue);
+            if (next_delivered == 0)
+            {
+                break;
+            }
+            delivered += next_delivered;
+        }
+    }
+    module_info->worker = NULL;
+
+    if (!requeue || pool_push(module_info->pool, module_info, worker) != 0)
+    {
+        unschedule_module(module_info, worker);
+    }
+}
+
+/**
+* Thread of the pool shared by the modules of a broker using
+* BROKER_SCHEDULER_THREAD_POOL. Runs the modules queued on it, steals from
+* the other workers when it has none and sleeps when no module is queued
+* anywhere.
+*/
+static int pool_worker(void * user_data)
+{
+    BROKER_WORKER* worker = (BROKER_WORKER*)user_data;
+    BROKER_POOL* pool = worker->pool;
+
+    while (pool->is_running)
+    {
+        BROKER_MODULEINFO* module_info = pool_take(pool, worker);
+        if (module_info != NULL)
+        {
+            run_module(module_info, worker);
+        }
+        else if (Lock(pool->idle_lock) != LOCK_OK)
+        {
+            LogError("unable to lock the idle workers");
+            break;
+        }
+        else
+        {
+            /*Codes_SRS_BROKER_30_112: [ A pooled worker with no module to run shall wait on the pool's `idle_condition` unless a module was queued or the pool was stopped in the meantime. ]*/
+            (void)ATOMIC_INC(&pool->idle_workers);
+            if (pool->is_running && ATOMIC_LOAD(&pool->pending) <= 0)
+            {
+                (void)Condition_Wait(pool->idle_condition, pool->idle_lock, 0);
+            }
+            (void)ATOMIC_DEC(&pool->idle_workers);
+            (void)Unlock(pool->idle_lock);
+        }
+    }
+
+    return 0;
+}
+
+/*asks the first started workers of pool to exit and joins them*/
+static void pool_stop(BROKER_POOL* pool, size_t started)
+{
+    size_t i;
+
+    if (Lock(pool->idle_lock) != LOCK_OK)
+    {
+        LogError("unable to lock the idle workers, stopping them anyway");
+        pool->is_running = false;
+        for (i = 0; i < started; i++)
+        {
+            (void)Condition_Post(pool->idle_condition);
+        }
+    }
+    else
+    {
+        pool->is_running = false;
+        for (i = 0; i < started; i++)
+        {
+            (void)Condition_Post(pool->idle_condition);
+        }
+        (void)Unlock(pool->idle_lock);
+    }
+
+    for (i = 0; i < started; i++)
+    {
+        int thread_result;
+        if (ThreadAPI_Join(pool->workers[i].thread, &thread_result) != THREADAPI_OK)
+        {
+            LogError("ThreadAPI_Join() returned an error.");
+        }
+    }
+}
+
+/*frees pool and the locks of its first lock_count workers*/
+static void pool_free(BROKER_POOL* pool, size_t lock_count)
+{
+    for (size_t i = 0; i < lock_count; i++)
+    {
+        Lock_Deinit(pool->workers[i].lock);
+    }
+    Condition_Deinit(pool->idle_condition);
+    Lock_Deinit(pool->idle_lock);
+    free(pool);
+}
+
+static BROKER_POOL* pool_create(size_t worker_count)
+{
+    /*one block: the pool, then its workers*/
+    BROKER_POOL* result = (BROKER_POOL*)malloc(sizeof(BROKER_POOL) + (worker_count * sizeof(BROKER_WORKER)));
+    if (result == NULL)
+    {
+        LogError("unable to allocate a pool of %zu workers", worker_count);
+    }
+    else
+    {
+        result->worker_count = worker_count;
+        result->workers = (BROKER_WORKER*)(result + 1);
+        result->idle_workers = 0;
+        result->pending = 0;
+        result->next_worker = 0;
+        result->is_running = true;
+        result->idle_lock = Lock_Init();
+        if (result->idle_lock == NULL)
+        {
+            LogError("Lock_Init failed");
+            free(result);
+            result = NULL;
+        }
+        else if ((result->idle_condition = Condition_Init()) == NULL)
+        {
+            LogError("Condition_Init failed");
+            Lock_Deinit(result->idle_lock);
+            free(result);
+            result = NULL;
+        }
+        else
+        {
+            size_t locks, threads;
+            /* every lock exists before the first worker can steal */
+            for (locks = 0; locks < worker_count; locks++)
+            {
+                BROKER_WORKER* worker = &(result->workers[locks]);
+                worker->pool = result;
+                worker->head = NULL;
+                worker->tail = NULL;
+                worker->lock = Lock_Init();
+                if (worker->lock == NULL)
+                {
+                    LogError("Lock_Init failed");
+                    break;
+                }
+            }
+
+            threads = 0;
+            if (locks == worker_count)
+            {
+                for (; threads < worker_count; threads++)
+                {
+                    if (ThreadAPI_Create(&(result->workers[threads].thread), pool_worker, &(result->workers[threads])) != THREADAPI_OK)
+                    {
+                        LogError("ThreadAPI_Create failed");
+                        break;
+                    }
+                }
+            }
+
+            if (threads < worker_count)
+            {
+                pool_stop(result, threads);
+                pool_free(result, locks);
+                result = NULL;
+            }
+        }
+    }
+
+    return result;
+}
+
+static void pool_destroy(BROKER_POOL* pool)
+{
+    pool_stop(pool, pool->worker_count);
+    pool_free(pool, pool->worker_count);
+}
+
+static BROKER_RESULT init_module(BROKER_MODULEINFO* module_info, const MODULE* module, size_t batch_size, unsigned int batch_window_ms)
+{
+    BROKER_RESULT result;
+
+    /*Codes_SRS_BROKER_13_107: The function shall assign the `module` handle to `BROKER_MODULEINFO::module`.*/
+    module_info->module = (MODULE*)malloc(sizeof(MODULE));
+    if (module_info->module == NULL)
+    {
+        LogError("Allocate module failed");
+        result = BROKER_ERROR;
+    }
+    else
+    {
+        module_info->module->module_apis = module->module_apis;
+        module_info->module->module_handle = module->module_handle;
+
+        /*Codes_SRS_BROKER_13_099: [The function shall initialize BROKER_MODULEINFO::socket_lock with a valid lock handle.]*/
+        module_info->socket_lock = Lock_Init();
+        if (module_info->socket_lock == NULL)
+        {
+            /*Codes_SRS_BROKER_13_047: [ This function shall return BROKER_ERROR if an underlying API call to the platform causes an error or BROKER_OK otherwise. ]*/
+            LogError("Lock_Init for socket lock failed");
+            result = BROKER_ERROR;
+        }
+        else
+        {
+            char uuid[BROKER_GUID_SIZE];
+            memset(uuid, 0, BROKER_GUID_SIZE);
             /*Codes_SRS_BROKER_17_020: [ The function shall create a unique ID used as a quit signal. ]*/
             if (UniqueId_Generate(uuid, BROKER_GUID_SIZE) != UNIQUEID_OK)
             {
-                /*Codes_SRS_BROKER_13_047: [ This function shall return BROKER_ERROR if an underlying API call to the platform causes an error or BROKER_OK otherwise. ]*/
-                LogError("Lock_Init for socket lock failed");
-                Lock_Deinit(module_info->socket_lock);
+                /*Codes_SRS_BROKER_13_047: [ This function shall return BROKER_ERROR if an underlying API call to the platform causes an error or BROKER_OK otherwise. ]*/
+                LogError("Lock_Init for socket lock failed");
+                Lock_Deinit(module_info->socket_lock);
+                result = BROKER_ERROR;
+            }
+            else
+            {
+                module_info->quit_message_guid = STRING_construct(uuid);
+                if (module_info->quit_message_guid == NULL)
+                {
+                    /*Codes_SRS_BROKER_13_047: [ This function shall return BROKER_ERROR if an underlying API call to the platform causes an error or BROKER_OK otherwise. ]*/
+                    LogError("String construct failed for module guid");
+                    Lock_Deinit(module_info->socket_lock);
+                    result = BROKER_ERROR;
+                }
+                else
+                {
+                    /*Codes_SRS_BROKER_30_072: [ If the module's `MODULE_API` is `MODULE_API_VERSION_2` or later and has a `Module_ReceiveBatch`, the function shall allocate room for `batch_size` messages to hand to it. ]*/
+                    module_info->receive_batch = MODULE_RECEIVE_BATCH(module->module_apis);
+                    module_info->batch_size = batch_size;
+                    module_info->batch_window_ms = batch_window_ms;
+                    if (module_info->receive_batch == NULL)
+                    {
+                        module_info->batch = NULL;
+                        result = BROKER_OK;
+                    }
+                    else if ((module_info->batch = (MESSAGE_HANDLE*)malloc(batch_size * sizeof(MESSAGE_HANDLE))) == NULL)
+                    {
+                        /*Codes_SRS_BROKER_13_047: [ This function shall return BROKER_ERROR if an underlying API call to the platform causes an error or BROKER_OK otherwise. ]*/
+                        LogError("unable to allocate the message batch");
+                        STRING_delete(module_info->quit_message_guid);
+                        Lock_Deinit(module_info->socket_lock);
+                        result = BROKER_ERROR;
+                    }
+                    else
+                    {
+                        result = BROKER_OK;
+                    }
+                }
+            }
+        }
+    }
+    return result;
+}
+
+static void deinit_module(BROKER_MODULEINFO* module_info)
+{
+    /*Codes_SRS_BROKER_13_057: [The function shall free all members of the MODULE_INFO object.]*/
+    Lock_Deinit(module_info->socket_lock);
+    STRING_delete(module_info->quit_message_guid);
+    if (module_info->batch != NULL)
+    {
+        free(module_info->batch);
+    }
+    free(module_info->module);
+}
+
+/*destroys every message left in ring and frees it*/
+static void message_ring_destroy(MESSAGE_RING* ring)
+{
+    MESSAGE_HANDLE msg;
+    while ((msg = message_ring_pop(ring)) != NULL)
+    {
+        Message_Destroy(msg);
+    }
+    free(ring);
+}
+
+static BROKER_RESULT init_module_queue(BROKER_MODULEINFO* module_info, size_t queue_capacity, BROKER_POOL* pool)
+{
+    BROKER_RESULT result;
+
+    /*Codes_SRS_BROKER_30_010: [ In zero-copy mode `Broker_AddModule` shall create a vector of sinks, a message queue holding `BROKER_HANDLE_DATA::queue_capacity` messages with the `BROKER_OVERFLOW_DROP_NEWEST` policy and two conditions for the module. ]*/
+    module_info->sinks = VECTOR_create(sizeof(BROKER_LINK));
+    if (module_info->sinks == NULL)
+    {
+        LogError("VECTOR_create for sinks failed");
+        result = BROKER_ERROR;
+    }
+    else
+    {
+        module_info->message_queue = message_ring_create(queue_capacity, BROKER_OVERFLOW_DROP_NEWEST, 2);
+        if (module_info->message_queue == NULL)
+        {
+            LogError("unable to create the message queue");
+            VECTOR_destroy(module_info->sinks);
+            result = BROKER_ERROR;
+        }
+        else
+        {
+            module_info->queue_condition = Condition_Init();
+            if (module_info->queue_condition == NULL)
+            {
+                LogError("Condition_Init failed");
+                free(module_info->message_queue);
+                VECTOR_destroy(module_info->sinks);
+                result = BROKER_ERROR;
+            }
+            else
+            {
+                module_info->space_condition = Condition_Init();
+                if (module_info->space_condition == NULL)
+                {
+                    LogError("Condition_Init failed");
+                    Condition_Deinit(module_info->queue_condition);
+                    free(module_info->message_queue);
+                    VECTOR_destroy(module_info->sinks);
+                    result = BROKER_ERROR;
+                }
+                else
+                {
+                    module_info->consumer_queue = module_info->message_queue;
+                    module_info->retired_queue = NULL;
+                    module_info->is_waiting = 0;
+                    module_info->blocked_publishers = 0;
+                    module_info->dropped_count = 0;
+                    module_info->blocked_count = 0;
+                    module_info->is_running = false;
+                    module_info->pool = pool;
+                    module_info->scheduled = 0;
+                    module_info->worker = NULL;
+                    module_info->next_scheduled = NULL;
+                    module_info->deliver_inline = false;
+                    module_info->sink_routes = 0;
+                    module_info->priority_queue = NULL;
+                    module_info->priority_streak = 0;
+                    result = BROKER_OK;
+                }
+            }
+        }
+    }
+
+    return result;
+}
+
+/*drops a reference to filter and frees it with the last one. filter may be NULL*/
+static void filter_release(BROKER_FILTER* filter)
+{
+    if (filter != NULL && ATOMIC_DEC(&filter->refs) == 0)
+    {
+        free(filter);
+    }
+}
+
+static void deinit_module_queue(BROKER_MODULEINFO* module_info)
+{
+    /*Codes_SRS_BROKER_30_016: [ In zero-copy mode the function shall destroy every message still queued for the module. ]*/
+    if (module_info->consumer_queue != module_info->message_queue)
+    {
+        /*a queue replaced by Broker_SetSinkQueue the worker never got to drain*/
+        message_ring_destroy(module_info->consumer_queue);
+    }
+    message_ring_destroy(module_info->message_queue);
+    /*Codes_SRS_BROKER_30_155: [ In zero-copy mode the function shall destroy every message waiting on the module's priority lane and free the lane. ]*/
+    if (module_info->priority_queue != NULL)
+    {
+        message_ring_destroy(module_info->priority_queue);
+    }
+    Condition_Deinit(module_info->space_condition);
+    Condition_Deinit(module_info->queue_condition);
+    /*Codes_SRS_BROKER_30_135: [ In zero-copy mode the function shall free the filters of the links from the module. ]*/
+    for (size_t i = 0; i < VECTOR_size(module_info->sinks); i++)
+    {
+        filter_release(((BROKER_LINK*)VECTOR_element(module_info->sinks, i))->filter);
+    }
+    VECTOR_destroy(module_info->sinks);
+}
+
+static BROKER_RESULT start_module(BROKER_MODULEINFO* module_info, STRING_HANDLE url)
+{
+    BROKER_RESULT result;
+
+    /* Connect to pub/sub */
+    /*Codes_SRS_BROKER_17_013: [ The function shall create a nanomsg socket for reception. ]*/
+    module_info->receive_socket = nn_socket(AF_SP, NN_SUB);
+    if (module_info->receive_socket < 0)
+    {
+        /*Codes_SRS_BROKER_13_047: [ This function shall return BROKER_ERROR if an underlying API call to the platform causes an error or BROKER_OK otherwise. ]*/
+        LogError("module receive socket create failed");
+        result = BROKER_ERROR;
+    }
+    else
+    {
+        /*Codes_SRS_BROKER_17_014: [ The function shall bind the socket to the the BROKER_HANDLE_DATA::url. ]*/
+        int connect_result = nn_connect(module_info->receive_socket, STRING_c_str(url));
+        if (connect_result < 0)
+        {
+            /*Codes_SRS_BROKER_13_047: [ This function shall return BROKER_ERROR if an underlying API call to the platform causes an error or BROKER_OK otherwise. ]*/
+            LogError("nn_connect failed");
+            nn_close(module_info->receive_socket);
+            module_info->receive_socket = -1;
+            result = BROKER_ERROR;
+        }
+        else
+        {
+            /* Codes_SRS_BROKER_17_028: [ The function shall subscribe BROKER_MODULEINFO::receive_socket to the quit signal GUID. ]*/
+            if (nn_setsockopt(
+                module_info->receive_socket, NN_SUB, NN_SUB_SUBSCRIBE, STRING_c_str(module_info->quit_message_guid), STRING_length(module_info->quit_message_guid)) < 0)
+            {
+                /*Codes_SRS_BROKER_13_047: [ This function shall return BROKER_ERROR if an underlying API call to the platform causes an error or BROKER_OK otherwise. ]*/
+                LogError("nn_setsockopt failed");
+                nn_close(module_info->receive_socket);
+                module_info->receive_socket = -1;
+                result = BROKER_ERROR;
+            }
+            else
+            {
+                /*Codes_SRS_BROKER_13_102: [The function shall create a new thread for the module by calling ThreadAPI_Create using module_worker as the thread callback and using the newly allocated BROKER_MODULEINFO object as the thread context.*/
+                if (ThreadAPI_Create(
+                    &(module_info->thread),
+                    module_worker,
+                    (void*)module_info
+                ) != THREADAPI_OK)
+                {
+                    /*Codes_SRS_BROKER_13_047: [ This function shall return BROKER_ERROR if an underlying API call to the platform causes an error or BROKER_OK otherwise. ]*/
+                    LogError("ThreadAPI_Create failed");
+                    nn_close(module_info->receive_socket);
+                    result = BROKER_ERROR;
+                }
+                else
+                {
+                    result = BROKER_OK;
+                }
+            }
+        }
+    }
+
+    return result;
+}
+
+/*stop module means: stop the thread that feeds messages to Module_Receive function + deletion of all queued messages */
+/*returns 0 if success, otherwise __LINE__*/
+static int stop_module(int publish_socket, BROKER_MODULEINFO* module_info)
+{
+    int  quit_result, close_result, thread_result, result;
+
+    /*Codes_SRS_BROKER_17_021: [ This function shall send a quit signal to the worker thread by sending BROKER_MODULEINFO::quit_message_guid to the publish_socket. ]*/
+    /* send the unique quite id for this module */
+    if ((quit_result = nn_send(publish_socket, STRING_c_str(module_info->quit_message_guid), BROKER_GUID_SIZE, 0)) < 0)
+    {
+        /*Codes_SRS_BROKER_17_015: [ This function shall close the BROKER_MODULEINFO::receive_socket. ]*/
+        /* at the cost of a data race, we will close the socket to terminate the thread */
+        nn_close(module_info->receive_socket);
+        LogError("unable to peacefully close thread for module [%p], nn_send error [%d], taking harsher methods", module_info, quit_result);
+    }
+    else
+    {
+        /*Codes_SRS_BROKER_02_001: [ Broker_RemoveModule shall lock BROKER_MODULEINFO::socket_lock. ]*/
+        if (Lock(module_info->socket_lock) != LOCK_OK)
+        {
+            /*Codes_SRS_BROKER_17_015: [ This function shall close the BROKER_MODULEINFO::receive_socket. ]*/
+            /* at the cost of a data race, we will close the socket to terminate the thread */
+            nn_close(module_info->receive_socket);
+            LogError("unable to peacefully close thread for module [%p], Lock error, taking harsher methods", module_info );
+        }
+        else
+        {
+            /*Codes_SRS_BROKER_17_015: [ This function shall close the BROKER_MODULEINFO::receive_socket. ]*/
+            close_result = nn_close(module_info->receive_socket);
+            if (close_result < 0)
+            {
+                LogError("Receive socket close failed for module at  item [%p] failed", module_info);
+            }
+            else
+            {
+                /*all is fine, thread will eventually stop and be joined*/
+            }
+            /*Codes_SRS_BROKER_02_003: [ After closing the socket, Broker_RemoveModule shall unlock BROKER_MODULEINFO::info_lock. ]*/
+            if (Unlock(module_info->socket_lock) != LOCK_OK)
+            {
+                LogError("unable to unlock socket lock");
+            }
+        }
+    }
+    /*Codes_SRS_BROKER_13_104: [The function shall wait for the module's thread to exit by joining BROKER_MODULEINFO::thread via ThreadAPI_Join. ]*/
+    if (ThreadAPI_Join(module_info->thread, &thread_result) != THREADAPI_OK)
+    {
+        result = __LINE__;
+        LogError("ThreadAPI_Join() returned an error.");
+    }
+    else
+    {
+        result = 0;
+    }
+    return result;
+}
+
+static BROKER_RESULT start_module_queue(BROKER_MODULEINFO* module_info)
+{
+    BROKER_RESULT result;
+
+    module_info->is_running = true;
+    if (module_info->pool != NULL)
+    {
+        /*Codes_SRS_BROKER_30_105: [ If the broker uses `BROKER_SCHEDULER_THREAD_POOL` and the module did not ask for a dedicated thread, the function shall not create a thread for the module, its messages shall be delivered by the pool. ]*/
+        result = BROKER_OK;
+    }
+    /*Codes_SRS_BROKER_30_011: [ In zero-copy mode the function shall create the module's thread using the zero-copy worker as the thread callback. ]*/
+    /*Codes_SRS_BROKER_30_106: [ A module that asked for a dedicated thread shall get a thread of its own running the zero-copy worker, as with `BROKER_SCHEDULER_DEDICATED_THREADS`. ]*/
+    else if (ThreadAPI_Create(&(module_info->thread), module_queue_worker, (void*)module_info) != THREADAPI_OK)
+    {
+        LogError("ThreadAPI_Create failed");
+        module_info->is_running = false;
+        result = BROKER_ERROR;
+    }
+    else
+    {
+        result = BROKER_OK;
+    }
+
+    return result;
+}
+
+/*stops the thread of a zero-copy module that has one. Returns 0 if success,
+  otherwise __LINE__*/
+static int stop_module_thread(BROKER_MODULEINFO* module_info)
+{
+    int thread_result, result;
+
+    /*Codes_SRS_BROKER_30_015: [ In zero-copy mode the function shall clear `BROKER_MODULEINFO::is_running` under `socket_lock` and signal `queue_condition`. ]*/
+    if (Lock(module_info->socket_lock) != LOCK_OK)
+    {
+        /* the worker only reads the flag, worst case it notices late */
+        LogError("unable to lock the queue of module [%p], stopping it anyway", module_info);
+        module_info->is_running = false;
+        (void)Condition_Post(module_info->queue_condition);
+    }
+    else
+    {
+        module_info->is_running = false;
+        (void)Condition_Post(module_info->queue_condition);
+        (void)Unlock(module_info->socket_lock);
+    }
+
+    /*Codes_SRS_BROKER_13_104: [The function shall wait for the module's thread to exit by joining BROKER_MODULEINFO::thread via ThreadAPI_Join. ]*/
+    if (ThreadAPI_Join(module_info->thread, &thread_result) != THREADAPI_OK)
+    {
+        result = __LINE__;
+        LogError("ThreadAPI_Join() returned an error.");
+    }
+    else
+    {
+        result = 0;
+    }
+    return result;
+}
+
+/*returns 0 if success, otherwise __LINE__*/
+static int stop_module_queue(BROKER_MODULEINFO* module_info)
+{
+    int result;
+
+    if (module_info->pool != NULL)
+    {
+        /*Codes_SRS_BROKER_30_113: [ For a pooled module the function shall clear `BROKER_MODULEINFO::is_running` under `socket_lock` and wait on `queue_condition` until no worker runs the module nor has it queued. ]*/
+        if (Lock(module_info->socket_lock) != LOCK_OK)
+        {
+            LogError("unable to lock the queue of module [%p], waiting for the pool anyway", module_info);
+            module_info->is_running = false;
+            while (ATOMIC_LOAD(&module_info->scheduled) != 0)
+            {
+                ThreadAPI_Sleep(1);
+            }
+        }
+        else
+        {
+            module_info->is_running = false;
+            while (ATOMIC_LOAD(&module_info->scheduled) != 0)
+            {
+                (void)Condition_Wait(module_info->queue_condition, module_info->socket_lock, 0);
+            }
+            (void)Unlock(module_info->socket_lock);
+        }
+        result = 0;
+    }
+    else
+    {
+        result = stop_module_thread(module_info);
+    }
+    return result;
+}
+
+static bool find_sink_predicate(const void* element, const void* value)
+{
+    return ((const BROKER_LINK*)element)->sink == (const BROKER_MODULEINFO*)value;
+}
+
+/*removes module_info from the sinks of every module attached to the broker.
+  No route may deliver to module_info anymore.*/
+static void unlink_sink(BROKER_HANDLE_DATA* broker_data, BROKER_MODULEINFO* module_info)
+{
+    LIST_ITEM_HANDLE item = singlylinkedlist_get_head_item(broker_data->modules);
+    while (item != NULL)
+    {
+        BROKER_MODULEINFO* source_info = (BROKER_MODULEINFO*)singlylinkedlist_item_get_value(item);
+        BROKER_LINK* link = (BROKER_LINK*)VECTOR_find_if(source_info->sinks, find_sink_predicate, module_info);
+        if (link != NULL)
+        {
+            filter_release(link->filter);
+            VECTOR_erase(source_info->sinks, link, 1);
+        }
+        item = singlylinkedlist_get_next_item(item);
+    }
+}
+
+/*returns false if filter is not a valid link filter*/
+static bool filter_is_valid(const BROKER_LINK_FILTER* filter)
+{
+    bool result = (filter->condition_count == 0 || filter->conditions != NULL);
+    for (size_t i = 0; i < filter->condition_count && result; i++)
+    {
+        const BROKER_FILTER_CONDITION* condition = &(filter->conditions[i]);
+        result =
+            condition->key != NULL &&
+            (condition->match == BROKER_FILTER_EQUALS || condition->match == BROKER_FILTER_PREFIX) &&
+            condition->values != NULL &&
+            condition->value_count > 0;
+        for (size_t j = 0; j < condition->value_count && result; j++)
+        {
+            result = (condition->values[j] != NULL);
+        }
+    }
+    return result;
+}
+
+/*copies filter into one block, NULL if it has no conditions. Returns 0 if success, otherwise __LINE__*/
+static int filter_compile(const BROKER_LINK_FILTER* filter, BROKER_FILTER** compiled)
+{
+    int result;
+    size_t value_count = 0;
+    size_t text_size = 0;
+
+    for (size_t i = 0; i < filter->condition_count; i++)
+    {
+        const BROKER_FILTER_CONDITION* condition = &(filter->conditions[i]);
+        text_size += strlen(condition->key) + 1;
+        value_count += condition->value_count;
+        for (size_t j = 0; j < condition->value_count; j++)
+        {
+            text_size += strlen(condition->values[j]) + 1;
+        }
+    }
+
+    if (filter->condition_count == 0)
+    {
+        *compiled = NULL;
+        result = 0;
+    }
+    else
+    {
+        /*the filter, its tests, every test's values and their lengths, then the strings*/
+        BROKER_FILTER* block = (BROKER_FILTER*)malloc(sizeof(BROKER_FILTER) + (filter->condition_count * sizeof(BROKER_FILTER_TEST)) + (value_count * (sizeof(const char*) + sizeof(size_t))) + text_size);
+        if (block == NULL)
+        {
+            LogError("unable to allocate a filter of %zu conditions", filter->condition_count);
+            result = __LINE__;
+        }
+        else
+        {
+            const char** next_value;
+            size_t* next_length;
+            char* next_text;
+            block->refs = 1;
+            block->test_count = filter->condition_count;
+            block->tests = (BROKER_FILTER_TEST*)(block + 1);
+            next_value = (const char**)(block->tests + filter->condition_count);
+            next_length = (size_t*)(next_value + value_count);
+            next_text = (char*)(next_length + value_count);
+
+            for (size_t i = 0; i < filter->condition_count; i++)
+            {
+                const BROKER_FILTER_CONDITION* condition = &(filter->conditions[i]);
+                BROKER_FILTER_TEST* test = &(block->tests[i]);
+                size_t size = strlen(condition->key) + 1;
+
+                test->key = PropertyKey_Intern(condition->key);
+                if (test->key == NULL)
+                {
+                    /*the key table is full, the lookup compares strings then*/
+                    (void)memcpy(next_text, condition->key, size);
+                    test->key = next_text;
+                }
+                next_text += size;
+
+                test->match = condition->match;
+                test->value_count = condition->value_count;
+                test->values = next_value;
+                test->value_lengths = next_length;
+                for (size_t j = 0; j < condition->value_count; j++)
+                {
+                    test->value_lengths[j] = strlen(condition->values[j]);
+                    (void)memcpy(next_text, condition->values[j], test->value_lengths[j] + 1);
+                    test->values[j] = next_text;
+                    next_text += test->value_lengths[j] + 1;
+                }
+                next_value += condition->value_count;
+                next_length += condition->value_count;
+            }
+            *compiled = block;
+            result = 0;
+        }
+    }
+
+    return result;
+}
+
+/*returns true if message passes every test of filter*/
+static bool filter_matches(const BROKER_FILTER* filter, MESSAGE_HANDLE message)
+{
+    bool result = true;
+    for (size_t i = 0; i < filter->test_count && result; i++)
+    {
+        const BROKER_FILTER_TEST* test = &(filter->tests[i]);
+        const char* value = Message_GetProperty(message, test->key);
+        result = false;
+        if (value != NULL)
+        {
+            for (size_t j = 0; j < test->value_count && !result; j++)
+            {
+                result = (test->match == BROKER_FILTER_EQUALS) ?
+                    (strcmp(value, test->values[j]) == 0) :
+                    (strncmp(value, test->values[j], test->value_lengths[j]) == 0);
+            }
+        }
+    }
+    return result;
+}
+
+static bool link_passes(const BROKER_LINK* link, MESSAGE_HANDLE message)
+{
+    return (link->filter == NULL) || filter_matches(link->filter, message);
+}
+
+/*waits until no publisher can still be reading a table retired before this call*/
+static void routing_synchronize(BROKER_HANDLE_DATA* broker_data)
+{
+    /*a publisher may sample the epoch right before it moves and register with
+      the parity being drained after the first pass, hence two passes*/
+    for (int pass = 0; pass < 2; pass++)
+    {
+        long retired = (ATOMIC_INC(&broker_data->routing_epoch) - 1) & 1;
+        while (ATOMIC_LOAD(&broker_data->routing_readers[retired]) != 0)
+        {
+            ThreadAPI_Sleep(0);
+        }
+    }
+}
+
+/*builds the route of source_info out of its sinks, leaving out the link to
+  excluded_sink if it is not NULL. The route may have no sinks, it holds a
+  reference to the filter of every link it copies and counts in the
+  sink_routes of every sink. Must be called with modules_lock held. Returns 0
+  if success, otherwise __LINE__*/
+static int route_create(BROKER_MODULEINFO* source_info, const BROKER_MODULEINFO* excluded_sink, BROKER_ROUTE** route)
+{
+    int result;
+    size_t count = VECTOR_size(source_info->sinks);
+    /*one block: the route, then its sinks*/
+    BROKER_ROUTE* new_route = (BROKER_ROUTE*)malloc(sizeof(BROKER_ROUTE) + (count * sizeof(BROKER_LINK)));
+    if (new_route == NULL)
+    {
+        LogError("unable to allocate a route of %zu sinks", count);
+        result = __LINE__;
+    }
+    else
+    {
+        new_route->refs = 1;
+        new_route->source_info = source_info;
+        new_route->sink_count = 0;
+        new_route->sinks = (BROKER_LINK*)(new_route + 1);
+        new_route->next = NULL;
+        for (size_t i = 0; i < count; i++)
+        {
+            const BROKER_LINK* link = (const BROKER_LINK*)VECTOR_element(source_info->sinks, i);
+            if (link->sink != excluded_sink)
+            {
+                new_route->sinks[new_route->sink_count++] = *link;
+                (void)ATOMIC_INC(&link->sink->sink_routes);
+                if (link->filter != NULL)
+                {
+                    (void)ATOMIC_INC(&link->filter->refs);
+                }
+            }
+        }
+        *route = new_route;
+        result = 0;
+    }
+    return result;
+}
+
+/*frees route, letting go of what route_create took for it. route may be NULL.
+  Does not touch the source of the route, which may be gone already.*/
+static void route_free(BROKER_ROUTE* route)
+{
+    if (route != NULL)
+    {
+        for (size_t i = 0; i < route->sink_count; i++)
+        {
+            filter_release(route->sinks[i].filter);
+            (void)ATOMIC_DEC(&route->sinks[i].sink->sink_routes);
+        }
+        free(route);
+    }
+}
+
+/*drops a reference to route and frees it with the last one*/
+static void route_release(BROKER_ROUTE* route)
+{
+    if (ATOMIC_DEC(&route->refs) == 0)
+    {
+        route_free(route);
+    }
+}
+
+/*returns the slot of source, or the free slot its probe sequence ends on.
+  The index is never more than half full, so there always is one.*/
+static BROKER_ROUTE_SLOT* routing_slot(const BROKER_ROUTING* routing, MODULE_HANDLE source)
+{
+    size_t slot = handle_slot(source, routing->index_mask);
+    MODULE_HANDLE slot_source;
+    while ((slot_source = (MODULE_HANDLE)ATOMIC_LOAD_PTR(&(routing->slots[slot].source))) != NULL &&
+        slot_source != source)
+    {
+        slot = (slot + 1) & routing->index_mask;
+    }
+    return &(routing->slots[slot]);
+}
+
+/*replaces the routing index with one that has room for another source,
+  carrying over the sources that have a route. Must be called with
+  modules_lock held. Returns 0 if success, otherwise __LINE__*/
+static int routing_grow(BROKER_HANDLE_DATA* broker_data)
+{
+    int result;
+    BROKER_ROUTING* previous = broker_data->routing;
+    size_t route_count = 0;
+    size_t index_size = BROKER_INDEX_MIN_SIZE;
+    BROKER_ROUTING* routing;
+
+    if (previous != NULL)
+    {
+        for (size_t i = 0; i <= previous->index_mask; i++)
+        {
+            if (previous->slots[i].route != NULL)
+            {
+                route_count++;
+            }
+        }
+    }
+    /*at most a quarter full, so that sources can come and go a while before
+      the index has to be replaced again*/
+    while (index_size < (route_count + 1) * 4)
+    {
+        index_size *= 2;
+    }
+
+    routing = (BROKER_ROUTING*)malloc(sizeof(BROKER_ROUTING) + (index_size * sizeof(BROKER_ROUTE_SLOT)));
+    if (routing == NULL)
+    {
+        LogError("unable to allocate a routing index of %zu slots", index_size);
+        result = __LINE__;
+    }
+    else
+    {
+        routing->index_mask = index_size - 1;
+        routing->used_slots = route_count;
+        routing->slots = (BROKER_ROUTE_SLOT*)(routing + 1);
+        for (size_t i = 0; i < index_size; i++)
+        {
+            routing->slots[i].source = NULL;
+            routing->slots[i].route = NULL;
+        }
+        if (previous != NULL)
+        {
+            for (size_t i = 0; i <= previous->index_mask; i++)
+            {
+                if (previous->slots[i].route != NULL)
+                {
+                    BROKER_ROUTE_SLOT* slot = routing_slot(routing, previous->slots[i].source);
+                    slot->source = previous->slots[i].source;
+                    slot->route = previous->slots[i].route;
+                }
+            }
+        }
+
+        /*the routes move to the new index, only the previous index is freed*/
+        (void)ATOMIC_EXCHANGE_PTR(&broker_data->routing, routing);
+        if (previous != NULL)
+        {
+            routing_synchronize(broker_data);
+            free(previous);
+        }
+        result = 0;
+    }
+    return result;
+}
+
+/*swaps route in as the route of its source, a route without sinks as no
+  route at all, and chains the routes this retires on *retired. Must be
+  called with modules_lock held. Returns 0 if success, otherwise __LINE__ and
+  nothing changed*/
+static int routing_set(BROKER_HANDLE_DATA* broker_data, BROKER_ROUTE* route, BROKER_ROUTE** retired)
+{
+    int result;
+    MODULE_HANDLE source = route->source_info->module->module_handle;
+    BROKER_ROUTE* published = (route->sink_count > 0) ? route : NULL;
+    BROKER_ROUTE_SLOT* slot = (broker_data->routing == NULL) ? NULL : routing_slot(broker_data->routing, source);
+
+    if (published == NULL)
+    {
+        route->next = *retired;
+        *retired = route;
+    }
+
+    if (slot != NULL && slot->source == source)
+    {
+        BROKER_ROUTE* previous = (BROKER_ROUTE*)ATOMIC_EXCHANGE_PTR(&(slot->route), published);
+        if (previous != NULL)
+        {
+            previous->next = *retired;
+            *retired = previous;
+        }
+        result = 0;
+    }
+    else if (published == NULL)
+    {
+        /*the source had no route and still has none*/
+        result = 0;
+    }
+    else if ((broker_data->routing == NULL || (broker_data->routing->used_slots + 1) * 2 > broker_data->routing->index_mask + 1) &&
+        routing_grow(broker_data) != 0)
+    {
+        result = __LINE__;
+    }
+    else
+    {
+        slot = routing_slot(broker_data->routing, source);
+        /*publishers that find the source in the slot have to find its route too*/
+        (void)ATOMIC_EXCHANGE_PTR(&(slot->route), published);
+        (void)ATOMIC_EXCHANGE_PTR(&(slot->source), source);
+        broker_data->routing->used_slots++;
+        result = 0;
+    }
+    return result;
+}
+
+/*drops the index's reference to the routes a link change retired once no
+  publisher can be looking them up anymore. A publisher still delivering
+  along one of them frees it when done. Must be called with modules_lock held.*/
+static void routing_release(BROKER_HANDLE_DATA* broker_data, BROKER_ROUTE* retired)
+{
+    if (retired != NULL)
+    {
+        routing_synchronize(broker_data);
+        while (retired != NULL)
+        {
+            BROKER_ROUTE* next = retired->next;
+            route_release(retired);
+            retired = next;
+        }
+    }
+}
+
+/*registers the calling publisher as a reader and returns the current table*/
+static const BROKER_ROUTING* routing_enter(BROKER_HANDLE_DATA* broker_data, long* reader_slot)
+{
+    *reader_slot = ATOMIC_LOAD(&broker_data->routing_epoch) & 1;
+    (void)ATOMIC_INC(&broker_data->routing_readers[*reader_slot]);
+    return (const BROKER_ROUTING*)ATOMIC_LOAD_PTR(&broker_data->routing);
+}
+
+static void routing_exit(BROKER_HANDLE_DATA* broker_data, long reader_slot)
+{
+    (void)ATOMIC_DEC(&broker_data->routing_readers[reader_slot]);
+}
+
+static BROKER_ROUTE* routing_find(const BROKER_ROUTING* routing, MODULE_HANDLE source)
+{
+    BROKER_ROUTE* result = NULL;
+    if (routing != NULL)
+    {
+        const BROKER_ROUTE_SLOT* slot = routing_slot(routing, source);
+        if (slot->source == source)
+        {
+            result = (BROKER_ROUTE*)ATOMIC_LOAD_PTR(&(slot->route));
+        }
+    }
+    return result;
+}
+/*builds, for every module linking to module_info, a route without it, and
+  chains them on *routes. Must be called with modules_lock held. Returns 0 if
+  success, otherwise __LINE__*/
+static int unlink_routes_create(BROKER_HANDLE_DATA* broker_data, const BROKER_MODULEINFO* module_info, BROKER_ROUTE** routes)
+{
+    int result = 0;
+    LIST_ITEM_HANDLE item = singlylinkedlist_get_head_item(broker_data->modules);
+    while (item != NULL && result == 0)
+    {
+        BROKER_MODULEINFO* source_info = (BROKER_MODULEINFO*)singlylinkedlist_item_get_value(item);
+        BROKER_ROUTE* route;
+        if (source_info != module_info &&
+            VECTOR_find_if(source_info->sinks, find_sink_predicate, module_info) != NULL)
+        {
+            if (route_create(source_info, module_info, &route) != 0)
+            {
+                result = __LINE__;
+            }
+            else
+            {
+                route->next = *routes;
+                *routes = route;
+            }
+        }
+        item = singlylinkedlist_get_next_item(item);
+    }
+
+    if (result != 0)
+    {
+        while (*routes != NULL)
+        {
+            BROKER_ROUTE* next = (*routes)->next;
+            route_free(*routes);
+            *routes = next;
+        }
+    }
+    return result;
+}
+
+/*swaps in the routes of unlink_routes_create, drops the route of module_info
+  and frees the routes this retires once no publisher can be reading them.
+  Must be called with modules_lock held.*/
+static void unlink_routes_publish(BROKER_HANDLE_DATA* broker_data, BROKER_MODULEINFO* module_info, BROKER_ROUTE* routes)
+{
+    BROKER_ROUTE* retired = NULL;
+    BROKER_ROUTE_SLOT* slot;
+    while (routes != NULL)
+    {
+        BROKER_ROUTE* next = routes->next;
+        /*the modules linking to module_info have a slot already, this cannot fail*/
+        (void)routing_set(broker_data, routes, &retired);
+        routes = next;
+    }
+    if (broker_data->routing != NULL)
+    {
+        slot = routing_slot(broker_data->routing, module_info->module->module_handle);
+        if (slot->source == module_info->module->module_handle && slot->route != NULL)
+        {
+            BROKER_ROUTE* previous = (BROKER_ROUTE*)ATOMIC_EXCHANGE_PTR(&(slot->route), NULL);
+            previous->next = retired;
+            retired = previous;
+        }
+    }
+    routing_release(broker_data, retired);
+}
+
+/*waits until the publishers still delivering to module_info along a route
+  they took before it was unlinked are done with it. No route swapped in may
+  deliver to module_info anymore.*/
+static void wait_for_sink_routes(BROKER_MODULEINFO* module_info)
+{
+    while (ATOMIC_LOAD(&module_info->sink_routes) != 0)
+    {
+        ThreadAPI_Sleep(0);
+    }
+}
+
+static void release_module(BROKER_HANDLE_DATA* broker_data, BROKER_MODULEINFO* module_info)
+{
+    if (broker_data->delivery_mode == BROKER_DELIVERY_ZERO_COPY)
+    {
+        deinit_module_queue(module_info);
+    }
+    deinit_module(module_info);
+}
+
+static BROKER_RESULT add_module(BROKER_HANDLE broker, const MODULE* module, bool dedicated_thread)
+{
+    BROKER_RESULT result;
+
+    /*Codes_SRS_BROKER_99_013: [If `broker` or `module` is NULL the function shall return BROKER_INVALIDARG.]*/
+    if (broker == NULL || module == NULL)
+    {
+        result = BROKER_INVALIDARG;
+        LogError("invalid parameter (NULL).");
+    }
+    /*Codes_SRS_BROKER_99_014: [If `module_handle` or `module_apis` are `NULL` the function shall return `BROKER_INVALIDARG`.]*/
+    else if (module->module_apis == NULL || module->module_handle == NULL)
+    {
+        result = BROKER_INVALIDARG;
+        LogError("invalid parameter (NULL).");
+    }
+    else
+    {
+        BROKER_MODULEINFO* module_info = (BROKER_MODULEINFO*)malloc(sizeof(BROKER_MODULEINFO));
+        if (module_info == NULL)
+        {
+            LogError("Allocate module info failed");
+            result = BROKER_ERROR;
+        }
+        else
+        {
+            BROKER_HANDLE_DATA* broker_data = (BROKER_HANDLE_DATA*)broker;
+            if (init_module(module_info, module, broker_data->batch_size, broker_data->batch_window_ms) != BROKER_OK)
+            {
+                /*Codes_SRS_BROKER_13_047: [This function shall return BROKER_ERROR if an underlying API call to the platform causes an error or BROKER_OK otherwise.]*/
+                LogError("start_module failed");
+                free(module_info->module);
+                free(module_info);
+                result = BROKER_ERROR;
+            }
+            else
+            {
+                if (broker_data->delivery_mode == BROKER_DELIVERY_ZERO_COPY &&
+                    init_module_queue(module_info, broker_data->queue_capacity, dedicated_thread ? NULL : broker_data->pool) != BROKER_OK)
+                {
+                    /*Codes_SRS_BROKER_13_047: [This function shall return BROKER_ERROR if an underlying API call to the platform causes an error or BROKER_OK otherwise.]*/
+                    LogError("init_module_queue failed");
+                    deinit_module(module_info);
+                    free(module_info);
+                    result = BROKER_ERROR;
+                }
+                /*Codes_SRS_BROKER_13_039: [This function shall acquire the lock on BROKER_HANDLE_DATA::modules_lock.]*/
+                else if (Lock(broker_data->modules_lock) != LOCK_OK)
+                {
+                    /*Codes_SRS_BROKER_13_047: [This function shall return BROKER_ERROR if an underlying API call to the platform causes an error or BROKER_OK otherwise.]*/
+                    LogError("Lock on broker_data->modules_lock failed");
+                    release_module(broker_data, module_info);
+                    free(module_info);
+                    result = BROKER_ERROR;
+                }
+                else
+                {
+                    /*Codes_SRS_BROKER_13_045: [Broker_AddModule shall append the new instance of BROKER_MODULEINFO to BROKER_HANDLE_DATA::modules.]*/
+                    LIST_ITEM_HANDLE moduleListItem = singlylinkedlist_add(broker_data->modules, module_info);
+                    if (moduleListItem == NULL)
+                    {
+                        /*Codes_SRS_BROKER_13_047: [This function shall return BROKER_ERROR if an underlying API call to the platform causes an error or BROKER_OK otherwise.]*/
+                        LogError("singlylinkedlist_add failed");
+                        release_module(broker_data, module_info);
+                        free(module_info);
+                        result = BROKER_ERROR;
+                    }
+                    /*Codes_SRS_BROKER_30_140: [ `Broker_AddModule` shall add the new `BROKER_MODULEINFO` to the broker's module index, keyed by `module->module_handle`. ]*/
+                    else if (module_index_add(broker_data, module_info) != 0)
+                    {
+                        /*Codes_SRS_BROKER_13_047: [This function shall return BROKER_ERROR if an underlying API call to the platform causes an error or BROKER_OK otherwise.]*/
+                        LogError("unable to index the module");
+                        release_module(broker_data, module_info);
+                        singlylinkedlist_remove(broker_data->modules, moduleListItem);
+                        free(module_info);
+                        result = BROKER_ERROR;
+                    }
+                    else
+                    {
+                        BROKER_RESULT start_result;
+                        module_info->list_item = moduleListItem;
+                        start_result = (broker_data->delivery_mode == BROKER_DELIVERY_ZERO_COPY) ?
+                            start_module_queue(module_info) :
+                            start_module(module_info, broker_data->url);
+                        if (start_result != BROKER_OK)
+                        {
+                            LogError("start_module failed");
+                            /*the index hashes module_info->module, which release_module frees*/
+                            module_index_remove(broker_data, module_info);
+                            release_module(broker_data, module_info);
+                            singlylinkedlist_remove(broker_data->modules, moduleListItem);
+                            free(module_info);
+                            result = BROKER_ERROR;
+                        }
+                        else
+                        {
+                            /*Codes_SRS_BROKER_13_047: [This function shall return BROKER_ERROR if an underlying API call to the platform causes an error or BROKER_OK otherwise.]*/
+                            result = BROKER_OK;
+                        }
+                    }
+
+                    /*Codes_SRS_BROKER_13_046: [This function shall release the lock on BROKER_HANDLE_DATA::modules_lock.]*/
+                    Unlock(broker_data->modules_lock);
+                }
+            }
+
+        }
+    }
+
+    return result;
+}
+
+BROKER_RESULT Broker_AddModule(BROKER_HANDLE broker, const MODULE* module)
+{
+    return add_module(broker, module, false);
+}
+
+BROKER_RESULT Broker_AddModuleWithConfig(BROKER_HANDLE broker, const MODULE* module, const BROKER_MODULE_CONFIG* config)
+{
+    /*Codes_SRS_BROKER_30_104: [ `Broker_AddModuleWithConfig` shall add `module` as `Broker_AddModule` does, giving it a dedicated thread if `config` is not `NULL` and `config->dedicated_thread` is `true`. ]*/
+    return add_module(broker, module, (config != NULL) && config->dedicated_thread);
+}
+
+BROKER_RESULT Broker_RemoveModule(BROKER_HANDLE broker, const MODULE* module)
+{
+    /*Codes_SRS_BROKER_13_048: [If `broker` or `module` is NULL the function shall return BROKER_INVALIDARG.]*/
+    BROKER_RESULT result;
+    if (broker == NULL || module == NULL)
+    {
+        /*Codes_SRS_BROKER_13_053: [ This function shall return BROKER_ERROR if an underlying API call to the platform causes an error or BROKER_OK otherwise. ]*/
+        result = BROKER_INVALIDARG;
+        LogError("invalid parameter (NULL).");
+    }
+    else
+    {
+        /*Codes_SRS_BROKER_13_088: [This function shall acquire the lock on BROKER_HANDLE_DATA::modules_lock.]*/
+        BROKER_HANDLE_DATA* broker_data = (BROKER_HANDLE_DATA*)broker;
+        if (Lock(broker_data->modules_lock) != LOCK_OK)
+        {
+            /*Codes_SRS_BROKER_13_053: [This function shall return BROKER_ERROR if an underlying API call to the platform causes an error or BROKER_OK otherwise.]*/
+            LogError("Lock on broker_data->modules_lock failed");
+            result = BROKER_ERROR;
+        }
+        else
+        {
+            /*Codes_SRS_BROKER_13_049: [Broker_RemoveModule shall look module up in the broker's module index.]*/
+            BROKER_MODULEINFO* module_info = module_index_find(broker_data, module->module_handle);
+
+            if (module_info == NULL)
+            {
+                /*Codes_SRS_BROKER_13_050: [Broker_RemoveModule shall unlock BROKER_HANDLE_DATA::modules_lock and return BROKER_ERROR if the module is not found in BROKER_HANDLE_DATA::modules.]*/
+                LogError("Supplied module is not attached to the broker");
                 result = BROKER_ERROR;
             }
             else
             {
-                module_info->quit_message_guid = STRING_construct(uuid);
-                if (module_info->quit_message_guid == NULL)
+                BROKER_ROUTE* routes = NULL;
+                if (broker_data->delivery_mode == BROKER_DELIVERY_ZERO_COPY &&
+                    unlink_routes_create(broker_data, module_info, &routes) != 0)
                 {
-                    /*Codes_SRS_BROKER_13_047: [ This function shall return BROKER_ERROR if an underlying API call to the platform causes an error or BROKER_OK otherwise. ]*/
-                    LogError("String construct failed for module guid");
-                    Lock_Deinit(module_info->socket_lock);
+                    /*Codes_SRS_BROKER_13_053: [This function shall return BROKER_ERROR if an underlying API call to the platform causes an error or BROKER_OK otherwise.]*/
+                    LogError("unable to unlink module [%p]", module_info);
                     result = BROKER_ERROR;
                 }
                 else
                 {
+                    int stop_result;
+                    if (broker_data->delivery_mode == BROKER_DELIVERY_ZERO_COPY)
+                    {
+                        /*Codes_SRS_BROKER_30_017: [ In zero-copy mode the function shall swap in new routes for the module and for the modules linking to it, leaving the module out, and wait until no publisher can be reading the routes they replace before stopping the module. ]*/
+                        unlink_routes_publish(broker_data, module_info, routes);
+                        /*Codes_SRS_BROKER_30_158: [ In zero-copy mode the function shall then wait until no publisher is queuing messages for, or calling, the module along a route it took before. ]*/
+                        wait_for_sink_routes(module_info);
+                        /*Codes_SRS_BROKER_30_014: [ In zero-copy mode the function shall remove the module from the sinks of every other module and free the filters of these links. ]*/
+                        unlink_sink(broker_data, module_info);
+                        /*Codes_SRS_BROKER_30_128: [ In zero-copy mode the function shall not stop the worker of an inline module, `Broker_SetSinkInline` stopped it already. ]*/
+                        stop_result = module_info->deliver_inline ? 0 : stop_module_queue(module_info);
+                    }
+                    else
+                    {
+                        stop_result = stop_module(broker_data->publish_socket, module_info);
+                    }
+
+                    /*Codes_SRS_BROKER_13_052: [The function shall remove the module from BROKER_HANDLE_DATA::modules.]*/
+                    /*the index hashes module_info->module, which release_module frees*/
+                    module_index_remove(broker_data, module_info);
+                    if (stop_result == 0)
+                    {
+                        release_module(broker_data, module_info);
+                    }
+                    else
+                    {
+                        LogError("unable to stop module");
+                    }
+
+                    singlylinkedlist_remove(broker_data->modules, module_info->list_item);
+                    free(module_info);
+
+                    /*Codes_SRS_BROKER_13_053: [This function shall return BROKER_ERROR if an underlying API call to the platform causes an error or BROKER_OK otherwise.]*/
                     result = BROKER_OK;
                 }
             }
+
+            /*Codes_SRS_BROKER_13_054: [This function shall release the lock on BROKER_HANDLE_DATA::modules_lock.]*/
+            Unlock(broker_data->modules_lock);
+        }
+    }
+
+    return result;
+}
+
+BROKER_MODULEINFO* broker_locate_handle(BROKER_HANDLE_DATA* broker_data, MODULE_HANDLE handle)
+{
+    return module_index_find(broker_data, handle);
+}
+
+/*gives module_info a priority lane unless it has one already. Returns 0 if
+  success, otherwise __LINE__*/
+static int add_priority_queue(BROKER_HANDLE_DATA* broker_data, BROKER_MODULEINFO* module_info)
+{
+    int result;
+    if (module_info->priority_queue != NULL)
+    {
+        result = 0;
+    }
+    else
+    {
+        MESSAGE_RING* priority_queue = message_ring_create(broker_data->queue_capacity, BROKER_OVERFLOW_DROP_NEWEST, 2);
+        if (priority_queue == NULL)
+        {
+            result = __LINE__;
+        }
+        else
+        {
+            /* kept even if adding the link fails, the module frees it */
+            (void)ATOMIC_EXCHANGE_PTR(&module_info->priority_queue, priority_queue);
+            result = 0;
+        }
+    }
+    return result;
+}
+
+BROKER_RESULT Broker_AddLink(BROKER_HANDLE broker, const BROKER_LINK_DATA* link)
+{
+    BROKER_RESULT result;
+    /*Codes_SRS_BROKER_17_029: [ If broker or link are NULL, Broker_AddLink shall return BROKER_INVALIDARG. ]*/
+    if (broker == NULL || link == NULL || link->module_sink_handle == NULL || link->module_source_handle == NULL)
+    {
+        LogError("Broker_AddLink, input is NULL.");
+        result = BROKER_INVALIDARG;
+    }
+    else if (link->filter != NULL && !filter_is_valid(link->filter))
+    {
+        /*Codes_SRS_BROKER_30_130: [ If `link->filter` has a condition whose `key` or `values` is `NULL`, whose `value_count` is 0, whose `match` is not a valid `BROKER_FILTER_MATCH` or one of whose values is `NULL`, `Broker_AddLink` shall return `BROKER_INVALIDARG`. ]*/
+        LogError("Broker_AddLink, invalid link filter.");
+        result = BROKER_INVALIDARG;
+    }
+    else if (link->filter != NULL && ((BROKER_HANDLE_DATA*)broker)->delivery_mode != BROKER_DELIVERY_ZERO_COPY)
+    {
+        /*Codes_SRS_BROKER_30_131: [ If `link->filter` is not `NULL` and the broker does not use `BROKER_DELIVERY_ZERO_COPY`, `Broker_AddLink` shall return `BROKER_ADD_LINK_ERROR`. ]*/
+        LogError("Broker_AddLink, only zero-copy brokers filter links.");
+        result = BROKER_ADD_LINK_ERROR;
+    }
+    else if (link->high_priority && ((BROKER_HANDLE_DATA*)broker)->delivery_mode != BROKER_DELIVERY_ZERO_COPY)
+    {
+        /*Codes_SRS_BROKER_30_150: [ If `link->high_priority` is `true` and the broker does not use `BROKER_DELIVERY_ZERO_COPY`, `Broker_AddLink` shall return `BROKER_ADD_LINK_ERROR`. ]*/
+        LogError("Broker_AddLink, only zero-copy brokers have priority lanes.");
+        result = BROKER_ADD_LINK_ERROR;
+    }
+    else
+    {
+        BROKER_HANDLE_DATA* broker_data = (BROKER_HANDLE_DATA*)broker;
+        /*Codes_SRS_BROKER_17_030: [ Broker_AddLink shall lock the modules_lock. ]*/
+        if (Lock(broker_data->modules_lock) != LOCK_OK)
+        {
+            /*Codes_SRS_BROKER_17_034: [ Upon an error, Broker_AddLink shall return BROKER_ADD_LINK_ERROR ]*/
+            LogError("Broker_AddLink, Lock on broker_data->modules_lock failed");
+            result = BROKER_ADD_LINK_ERROR;
+        }
+        else
+        {
+            /*Codes_SRS_BROKER_17_031: [ Broker_AddLink shall find the BROKER_HANDLE_DATA::module_info for link->sink. ]*/
+            BROKER_MODULEINFO* module_info = broker_locate_handle(broker_data, link->module_sink_handle);
+
+            if (module_info == NULL)
+            {
+                /*Codes_SRS_BROKER_17_034: [ Upon an error, Broker_AddLink shall return BROKER_ADD_LINK_ERROR ]*/
+                LogError("Link->sink is not attached to the broker");
+                result = BROKER_ADD_LINK_ERROR;
+            }
+            else
+            {
+                /*Codes_SRS_BROKER_17_041: [ Broker_AddLink shall find the BROKER_HANDLE_DATA::module_info for link->module_source_handle. ]*/
+                BROKER_MODULEINFO* source_module = broker_locate_handle(broker_data, link->module_source_handle);
+
+                if (source_module == NULL)
+                {
+                    LogError("Link->source is not attached to the broker");
+                    result = BROKER_ADD_LINK_ERROR;
+                }
+                else if (broker_data->delivery_mode == BROKER_DELIVERY_ZERO_COPY)
+                {
+                    BROKER_LINK new_link;
+                    new_link.sink = module_info;
+                    new_link.filter = NULL;
+                    new_link.high_priority = link->high_priority;
+                    /*Codes_SRS_BROKER_30_040: [ In zero-copy mode, if the sink is already linked to the source, `Broker_AddLink` shall do nothing and return `BROKER_OK`. ]*/
+                    if (VECTOR_find_if(source_module->sinks, find_sink_predicate, module_info) != NULL)
+                    {
+                        result = BROKER_OK;
+                    }
+                    /*Codes_SRS_BROKER_30_151: [ In zero-copy mode, if `link->high_priority` is `true` and the sink has no priority lane yet, `Broker_AddLink` shall create one holding `BROKER_HANDLE_DATA::queue_capacity` messages with the `BROKER_OVERFLOW_DROP_NEWEST` policy, and fail with `BROKER_ADD_LINK_ERROR` if that fails. ]*/
+                    else if (link->high_priority && add_priority_queue(broker_data, module_info) != 0)
+                    {
+                        LogError("Unable to give the sink a priority lane");
+                        result = BROKER_ADD_LINK_ERROR;
+                    }
+                    /*Codes_SRS_BROKER_30_132: [ In zero-copy mode `Broker_AddLink` shall compile `link->filter`, copying its keys and values, and fail with `BROKER_ADD_LINK_ERROR` if that fails. ]*/
+                    else if (link->filter != NULL && filter_compile(link->filter, &new_link.filter) != 0)
+                    {
+                        LogError("Unable to compile the filter of the link");
+                        result = BROKER_ADD_LINK_ERROR;
+                    }
+                    /*Codes_SRS_BROKER_30_041: [ In zero-copy mode `Broker_AddLink` shall append the sink's `module_info` to the source's sinks. ]*/
+                    else if (VECTOR_push_back(source_module->sinks, &new_link, 1) != 0)
+                    {
+                        /*Codes_SRS_BROKER_17_034: [ Upon an error, Broker_AddLink shall return BROKER_ADD_LINK_ERROR ]*/
+                        LogError("Unable to make link in Broker");
+                        free(new_link.filter);
+                        result = BROKER_ADD_LINK_ERROR;
+                    }
+                    else
+                    {
+                        BROKER_ROUTE* route = NULL;
+                        BROKER_ROUTE* retired = NULL;
+                        /*Codes_SRS_BROKER_30_043: [ In zero-copy mode `Broker_AddLink` and `Broker_RemoveLink` shall build a new route for the source only and swap it in for `Broker_Publish`, freeing the route it replaces once no publisher can be reading it. ]*/
+                        if (route_create(source_module, NULL, &route) != 0 ||
+                            routing_set(broker_data, route, &retired) != 0)
+                        {
+                            /*Codes_SRS_BROKER_17_034: [ Upon an error, Broker_AddLink shall return BROKER_ADD_LINK_ERROR ]*/
+                            LogError("Unable to publish the new link");
+                            route_free(route);
+                            VECTOR_erase(source_module->sinks, VECTOR_back(source_module->sinks), 1);
+                            filter_release(new_link.filter);
+                            result = BROKER_ADD_LINK_ERROR;
+                        }
+                        else
+                        {
+                            routing_release(broker_data, retired);
+                            result = BROKER_OK;
+                        }
+                    }
+                }
+                else
+                {
+                    /*Codes_SRS_BROKER_17_032: [ Broker_AddLink shall subscribe module_info->receive_socket to the link->source module handle. ]*/
+                    if (nn_setsockopt(
+                        module_info->receive_socket, NN_SUB, NN_SUB_SUBSCRIBE, &(link->module_source_handle), sizeof(MODULE_HANDLE)) < 0)
+                    {
+                        /*Codes_SRS_BROKER_17_034: [ Upon an error, Broker_AddLink shall return BROKER_ADD_LINK_ERROR ]*/
+                        LogError("Unable to make link in Broker");
+                        result = BROKER_ADD_LINK_ERROR;
+                    }
+                    else
+                    {
+                        result = BROKER_OK;
+                    }
+                }
+            }
+            /*Codes_SRS_BROKER_17_033: [ Broker_AddLink shall unlock the modules_lock. ]*/
+            Unlock(broker_data->modules_lock);
+        }
+    }
+    return result;
+}
+
+BROKER_RESULT Broker_RemoveLink(BROKER_HANDLE broker, const BROKER_LINK_DATA* link)
+{
+    BROKER_RESULT result;
+    /*Codes_SRS_BROKER_17_035: [ If broker, link, link->module_source_handle or link->module_sink_handle are NULL, Broker_RemoveLink shall return BROKER_INVALIDARG. ]*/
+    if (broker == NULL || link == NULL || link->module_sink_handle == NULL || link->module_source_handle == NULL)
+    {
+        LogError("Broker_AddLink, input is NULL.");
+        result = BROKER_INVALIDARG;
+    }
+    else
+    {
+        BROKER_HANDLE_DATA* broker_data = (BROKER_HANDLE_DATA*)broker;
+        /*Codes_SRS_BROKER_17_036: [ Broker_RemoveLink shall lock the modules_lock. ]*/
+        if (Lock(broker_data->modules_lock) != LOCK_OK)
+        {
+            /*Codes_SRS_BROKER_17_040: [ Upon an error, Broker_RemoveLink shall return BROKER_REMOVE_LINK_ERROR. ]*/
+            LogError("Broker_AddLink, Lock on broker_data->modules_lock failed");
+            result = BROKER_REMOVE_LINK_ERROR;
+        }
+        else
+        {
+            /*Codes_SRS_BROKER_17_037: [ Broker_RemoveLink shall find the module_info for link->module_sink_handle. ]*/
+            BROKER_MODULEINFO* module_info = broker_locate_handle(broker_data, link->module_sink_handle);
+
+            if (module_info == NULL)
+            {
+                /*Codes_SRS_BROKER_17_040: [ Upon an error, Broker_RemoveLink shall return BROKER_REMOVE_LINK_ERROR. ]*/
+                LogError("Link->sink is not attached to the broker");
+                result = BROKER_REMOVE_LINK_ERROR;
+            }
+            else
+            {
+                /*Codes_SRS_BROKER_17_042: [ Broker_RemoveLink shall find the module_info for link->module_source_handle. ]*/
+                BROKER_MODULEINFO* source_module_info = broker_locate_handle(broker_data, link->module_source_handle);
+                if (source_module_info == NULL)
+                {
+                    LogError("Link->source is not attached to the broker");
+                    result = BROKER_REMOVE_LINK_ERROR;
+                }
+                else if (broker_data->delivery_mode == BROKER_DELIVERY_ZERO_COPY)
+                {
+                    /*Codes_SRS_BROKER_30_042: [ In zero-copy mode `Broker_RemoveLink` shall remove the sink's `module_info` from the source's sinks and fail if the link does not exist. ]*/
+                    BROKER_LINK* sink = (BROKER_LINK*)VECTOR_find_if(source_module_info->sinks, find_sink_predicate, module_info);
+                    BROKER_ROUTE* route = NULL;
+                    BROKER_ROUTE* retired = NULL;
+                    if (sink == NULL)
+                    {
+                        /*Codes_SRS_BROKER_17_040: [ Upon an error, Broker_RemoveLink shall return BROKER_REMOVE_LINK_ERROR. ]*/
+                        LogError("Link is not present in Broker");
+                        result = BROKER_REMOVE_LINK_ERROR;
+                    }
+                    /*Codes_SRS_BROKER_30_043: [ In zero-copy mode `Broker_AddLink` and `Broker_RemoveLink` shall build a new route for the source only and swap it in for `Broker_Publish`, freeing the route it replaces once no publisher can be reading it. ]*/
+                    else if (route_create(source_module_info, module_info, &route) != 0 ||
+                        routing_set(broker_data, route, &retired) != 0)
+                    {
+                        /*Codes_SRS_BROKER_17_040: [ Upon an error, Broker_RemoveLink shall return BROKER_REMOVE_LINK_ERROR. ]*/
+                        LogError("Unable to publish the removal of the link");
+                        route_free(route);
+                        result = BROKER_REMOVE_LINK_ERROR;
+                    }
+                    else
+                    {
+                        BROKER_FILTER* filter = sink->filter;
+                        VECTOR_erase(source_module_info->sinks, sink, 1);
+                        routing_release(broker_data, retired);
+                        /*Codes_SRS_BROKER_30_134: [ In zero-copy mode `Broker_RemoveLink` shall release the link's reference to its filter once the new route is swapped in, the filter being freed with the last route that still holds it. ]*/
+                        filter_release(filter);
+                        result = BROKER_OK;
+                    }
+                }
+                else
+                {
+                    /*Codes_SRS_BROKER_17_038: [ Broker_RemoveLink shall unsubscribe module_info->receive_socket from the link->module_source_handle module handle. ]*/
+                    if (nn_setsockopt(
+                        module_info->receive_socket, NN_SUB, NN_SUB_UNSUBSCRIBE, &(link->module_source_handle), sizeof(MODULE_HANDLE)) < 0)
+                    {
+                        /*Codes_SRS_BROKER_17_040: [ Upon an error, Broker_RemoveLink shall return BROKER_REMOVE_LINK_ERROR. ]*/
+                        LogError("Unable to make link in Broker");
+                        result = BROKER_REMOVE_LINK_ERROR;
+                    }
+                    else
+                    {
+                        result = BROKER_OK;
+                    }
+                }
+            }
+            /*Codes_SRS_BROKER_17_039: [ Broker_RemoveLink shall unlock the modules_lock. ]*/
+            Unlock(broker_data->modules_lock);
         }
     }
     return result;
 }
 
-static void deinit_module(BROKER_MODULEINFO* module_info)
-{
-    /*Codes_SRS_BROKER_13_057: [The function shall free all members of the MODULE_INFO object.]*/
-    Lock_Deinit(module_info->socket_lock);
-    STRING_delete(module_info->quit_message_guid);
-    free(module_info->module);
-}
-
-static BROKER_RESULT start_module(BROKER_MODULEINFO* module_info, STRING_HANDLE url)
+/*gives module_info a new queue built from config, messages already queued
+  stay in the previous queue until the worker has delivered them. Must be
+  called with modules_lock held.*/
+static BROKER_RESULT replace_module_queue(BROKER_HANDLE_DATA* broker_data, BROKER_MODULEINFO* module_info, size_t capacity, BROKER_OVERFLOW_POLICY overflow, size_t sample_interval)
 {
     BROKER_RESULT result;
+    MESSAGE_RING* current = module_info->message_queue;
 
-    /* Connect to pub/sub */
-    /*Codes_SRS_BROKER_17_013: [ The function shall create a nanomsg socket for reception. ]*/
-    module_info->receive_socket = nn_socket(AF_SP, NN_SUB);
-    if (module_info->receive_socket < 0)
+    if (current->mask + 1 == capacity &&
+        current->overflow == overflow &&
+        (size_t)current->sample_interval == sample_interval)
     {
-        /*Codes_SRS_BROKER_13_047: [ This function shall return BROKER_ERROR if an underlying API call to the platform causes an error or BROKER_OK otherwise. ]*/
-        LogError("module receive socket create failed");
+        /*Codes_SRS_BROKER_30_054: [ If the sink's queue already has the requested capacity and policy, `Broker_SetSinkQueue` shall leave it as it is and return `BROKER_OK`. ]*/
+        result = BROKER_OK;
+    }
+    else if (ATOMIC_LOAD_PTR(&module_info->retired_queue) != NULL)
+    {
+        /*Codes_SRS_BROKER_30_055: [ If the worker has not finished delivering the messages of a queue replaced earlier, `Broker_SetSinkQueue` shall fail and return `BROKER_ERROR`. ]*/
+        LogError("the previous queue of module [%p] is still being drained", module_info);
         result = BROKER_ERROR;
     }
     else
     {
-        /*Codes_SRS_BROKER_17_014: [ The function shall bind the socket to the the BROKER_HANDLE_DATA::url. ]*/
-        int connect_result = nn_connect(module_info->receive_socket, STRING_c_str(url));
-        if (connect_result < 0)
+        /*Codes_SRS_BROKER_30_056: [ `Broker_SetSinkQueue` shall create a new message queue for the sink and fail with `BROKER_ERROR` if that fails. ]*/
+        MESSAGE_RING* queue = message_ring_create(capacity, overflow, sample_interval);
+        if (queue == NULL)
         {
-            /*Codes_SRS_BROKER_13_047: [ This function shall return BROKER_ERROR if an underlying API call to the platform causes an error or BROKER_OK otherwise. ]*/
-            LogError("nn_connect failed");
-            nn_close(module_info->receive_socket);
-            module_info->receive_socket = -1;
+            LogError("unable to create the message queue");
             result = BROKER_ERROR;
         }
         else
         {
-            /* Codes_SRS_BROKER_17_028: [ The function shall subscribe BROKER_MODULEINFO::receive_socket to the quit signal GUID. ]*/
-            if (nn_setsockopt(
-                module_info->receive_socket, NN_SUB, NN_SUB_SUBSCRIBE, STRING_c_str(module_info->quit_message_guid), STRING_length(module_info->quit_message_guid)) < 0)
+            /*Codes_SRS_BROKER_30_057: [ `Broker_SetSinkQueue` shall swap in the new queue for `Broker_Publish`, wait until no publisher can be using the previous one and hand the previous one to the worker to drain and free. ]*/
+            (void)ATOMIC_EXCHANGE_PTR(&module_info->message_queue, queue);
+            routing_synchronize(broker_data);
+            (void)ATOMIC_EXCHANGE_PTR(&module_info->retired_queue, current);
+
+            if (module_info->pool != NULL)
             {
-                /*Codes_SRS_BROKER_13_047: [ This function shall return BROKER_ERROR if an underlying API call to the platform causes an error or BROKER_OK otherwise. ]*/
-                LogError("nn_setsockopt failed");
-                nn_close(module_info->receive_socket);
-                module_info->receive_socket = -1;
-                result = BROKER_ERROR;
+                /*Codes_SRS_BROKER_30_115: [ If the sink is pooled, `Broker_SetSinkQueue` shall schedule it on the pool instead of signalling it. ]*/
+                schedule_module(module_info, NULL);
+            }
+            /*Codes_SRS_BROKER_30_058: [ `Broker_SetSinkQueue` shall signal the sink's `queue_condition` while holding its `socket_lock`. ]*/
+            else if (Lock(module_info->socket_lock) != LOCK_OK)
+            {
+                LogError("unable to lock the queue of module [%p]", module_info);
+                (void)Condition_Post(module_info->queue_condition);
             }
             else
             {
-                /*Codes_SRS_BROKER_13_102: [The function shall create a new thread for the module by calling ThreadAPI_Create using module_worker as the thread callback and using the newly allocated BROKER_MODULEINFO object as the thread context.*/
-                if (ThreadAPI_Create(
-                    &(module_info->thread),
-                    module_worker,
-                    (void*)module_info
-                ) != THREADAPI_OK)
-                {
-                    /*Codes_SRS_BROKER_13_047: [ This function shall return BROKER_ERROR if an underlying API call to the platform causes an error or BROKER_OK otherwise. ]*/
-                    LogError("ThreadAPI_Create failed");
-                    nn_close(module_info->receive_socket);
-                    result = BROKER_ERROR;
-                }
-                else
-                {
-                    result = BROKER_OK;
-                }
+                (void)Condition_Post(module_info->queue_condition);
+                (void)Unlock(module_info->socket_lock);
             }
+            result = BROKER_OK;
         }
     }
 
     return result;
 }
 
-/*stop module means: stop the thread that feeds messages to Module_Receive function + deletion of all queued messages */
-/*returns 0 if success, otherwise __LINE__*/
-static int stop_module(int publish_socket, BROKER_MODULEINFO* module_info)
+BROKER_RESULT Broker_SetSinkQueue(BROKER_HANDLE broker, MODULE_HANDLE sink, const BROKER_QUEUE_CONFIG* config)
 {
-    int  quit_result, close_result, thread_result, result;
-
-    /*Codes_SRS_BROKER_17_021: [ This function shall send a quit signal to the worker thread by sending BROKER_MODULEINFO::quit_message_guid to the publish_socket. ]*/
-    /* send the unique quite id for this module */
-    if ((quit_result = nn_send(publish_socket, STRING_c_str(module_info->quit_message_guid), BROKER_GUID_SIZE, 0)) < 0)
+    BROKER_RESULT result;
+    /*Codes_SRS_BROKER_30_050: [ If `broker`, `sink` or `config` is `NULL`, `Broker_SetSinkQueue` shall return `BROKER_INVALIDARG`. ]*/
+    if (broker == NULL || sink == NULL || config == NULL)
     {
-        /*Codes_SRS_BROKER_17_015: [ This function shall close the BROKER_MODULEINFO::receive_socket. ]*/
-        /* at the cost of a data race, we will close the socket to terminate the thread */
-        nn_close(module_info->receive_socket);
-        LogError("unable to peacefully close thread for module [%p], nn_send error [%d], taking harsher methods", module_info, quit_result);
+        LogError("invalid parameter (NULL).");
+        result = BROKER_INVALIDARG;
+    }
+    /*Codes_SRS_BROKER_30_051: [ If `config->capacity` is greater than 2^24 or `config->overflow` is not a valid `BROKER_OVERFLOW_POLICY`, `Broker_SetSinkQueue` shall return `BROKER_INVALIDARG`. ]*/
+    else if (config->capacity > BROKER_MAX_QUEUE_CAPACITY)
+    {
+        LogError("queue capacity %zu is too large", config->capacity);
+        result = BROKER_INVALIDARG;
+    }
+    else if (config->overflow != BROKER_OVERFLOW_DROP_NEWEST &&
+        config->overflow != BROKER_OVERFLOW_DROP_OLDEST &&
+        config->overflow != BROKER_OVERFLOW_BLOCK &&
+        config->overflow != BROKER_OVERFLOW_SAMPLE)
+    {
+        LogError("invalid overflow policy %d", (int)config->overflow);
+        result = BROKER_INVALIDARG;
     }
     else
     {
-        /*Codes_SRS_BROKER_02_001: [ Broker_RemoveModule shall lock BROKER_MODULEINFO::socket_lock. ]*/
-        if (Lock(module_info->socket_lock) != LOCK_OK)
+        BROKER_HANDLE_DATA* broker_data = (BROKER_HANDLE_DATA*)broker;
+        if (broker_data->delivery_mode != BROKER_DELIVERY_ZERO_COPY)
         {
-            /*Codes_SRS_BROKER_17_015: [ This function shall close the BROKER_MODULEINFO::receive_socket. ]*/
-            /* at the cost of a data race, we will close the socket to terminate the thread */
-            nn_close(module_info->receive_socket);
-            LogError("unable to peacefully close thread for module [%p], Lock error, taking harsher methods", module_info );
+            /*Codes_SRS_BROKER_30_052: [ If the broker does not use `BROKER_DELIVERY_ZERO_COPY`, `Broker_SetSinkQueue` shall return `BROKER_ERROR`. ]*/
+            LogError("only zero-copy brokers have module queues");
+            result = BROKER_ERROR;
+        }
+        else if (Lock(broker_data->modules_lock) != LOCK_OK)
+        {
+            LogError("Lock on broker_data->modules_lock failed");
+            result = BROKER_ERROR;
         }
         else
         {
-            /*Codes_SRS_BROKER_17_015: [ This function shall close the BROKER_MODULEINFO::receive_socket. ]*/
-            close_result = nn_close(module_info->receive_socket);
-            if (close_result < 0)
+            BROKER_MODULEINFO* module_info = broker_locate_handle(broker_data, sink);
+            if (module_info == NULL)
             {
-                LogError("Receive socket close failed for module at  item [%p] failed", module_info);
+                /*Codes_SRS_BROKER_30_053: [ If `sink` is not attached to the broker, `Broker_SetSinkQueue` shall return `BROKER_ERROR`. ]*/
+                LogError("sink is not attached to the broker");
+                result = BROKER_ERROR;
             }
             else
             {
-                /*all is fine, thread will eventually stop and be joined*/
-            }
-            /*Codes_SRS_BROKER_02_003: [ After closing the socket, Broker_RemoveModule shall unlock BROKER_MODULEINFO::info_lock. ]*/
-            if (Unlock(module_info->socket_lock) != LOCK_OK)
-            {
-                LogError("unable to unlock socket lock");
+                /*Codes_SRS_BROKER_30_059: [ A `config->capacity` of 0 shall select `BROKER_HANDLE_DATA::queue_capacity`, any other value shall be rounded up to the next power of two; a `config->sample_interval` of 0 shall select 2. ]*/
+                size_t capacity = 1;
+                while (capacity < config->capacity)
+                {
+                    capacity <<= 1;
+                }
+                if (config->capacity == 0)
+                {
+                    capacity = broker_data->queue_capacity;
+                }
+                result = replace_module_queue(broker_data, module_info, capacity, config->overflow,
+                    (config->sample_interval == 0) ? 2 : config->sample_interval);
             }
+            Unlock(broker_data->modules_lock);
         }
     }
-    /*Codes_SRS_BROKER_13_104: [The function shall wait for the module's thread to exit by joining BROKER_MODULEINFO::thread via ThreadAPI_Join. ]*/
-    if (ThreadAPI_Join(module_info->thread, &thread_result) != THREADAPI_OK)
+    return result;
+}
+
+/*true if a module attached to the broker links to module_info. Must be
+  called with modules_lock held.*/
+static bool module_is_linked(BROKER_HANDLE_DATA* broker_data, const BROKER_MODULEINFO* module_info)
+{
+    bool result = false;
+    LIST_ITEM_HANDLE item = singlylinkedlist_get_head_item(broker_data->modules);
+    while (item != NULL && !result)
     {
-        result = __LINE__;
-        LogError("ThreadAPI_Join() returned an error.");
+        BROKER_MODULEINFO* source_info = (BROKER_MODULEINFO*)singlylinkedlist_item_get_value(item);
+        result = (VECTOR_find_if(source_info->sinks, find_sink_predicate, module_info) != NULL);
+        item = singlylinkedlist_get_next_item(item);
     }
-    else
+    return result;
+}
+
+/*delivers on the calling thread the messages left for module_info once its
+  worker is stopped and nothing can queue messages for it anymore*/
+static void drain_module_queue(BROKER_MODULEINFO* module_info)
+{
+    bool drained = false;
+    while (!drained)
     {
-        result = 0;
+        MESSAGE_RING* queue = module_info->consumer_queue;
+        if (deliver_next_message(module_info, queue) != 0)
+        {
+            /* keep going until both lanes are empty */
+        }
+        else if (queue != module_info->message_queue)
+        {
+            /* a queue replaced by Broker_SetSinkQueue, the new one may hold messages too */
+            switch_consumer_queue(module_info, queue);
+        }
+        else
+        {
+            drained = true;
+        }
     }
-    return result;
 }
 
-BROKER_RESULT Broker_AddModule(BROKER_HANDLE broker, const MODULE* module)
+BROKER_RESULT Broker_SetSinkInline(BROKER_HANDLE broker, MODULE_HANDLE sink, bool deliver_inline)
 {
     BROKER_RESULT result;
-
-    /*Codes_SRS_BROKER_99_013: [If `broker` or `module` is NULL the function shall return BROKER_INVALIDARG.]*/
-    if (broker == NULL || module == NULL)
+    /*Codes_SRS_BROKER_30_121: [ If `broker` or `sink` is `NULL`, `Broker_SetSinkInline` shall return `BROKER_INVALIDARG`. ]*/
+    if (broker == NULL || sink == NULL)
     {
-        result = BROKER_INVALIDARG;
         LogError("invalid parameter (NULL).");
-    }
-    /*Codes_SRS_BROKER_99_014: [If `module_handle` or `module_apis` are `NULL` the function shall return `BROKER_INVALIDARG`.]*/
-    else if (module->module_apis == NULL || module->module_handle == NULL)
-    {
         result = BROKER_INVALIDARG;
-        LogError("invalid parameter (NULL).");
     }
     else
     {
-        BROKER_MODULEINFO* module_info = (BROKER_MODULEINFO*)malloc(sizeof(BROKER_MODULEINFO));
-        if (module_info == NULL)
+        BROKER_HANDLE_DATA* broker_data = (BROKER_HANDLE_DATA*)broker;
+        if (broker_data->delivery_mode != BROKER_DELIVERY_ZERO_COPY)
         {
-            LogError("Allocate module info failed");
+            /*Codes_SRS_BROKER_30_122: [ If the broker does not use `BROKER_DELIVERY_ZERO_COPY`, `Broker_SetSinkInline` shall return `BROKER_ERROR`. ]*/
+            LogError("only zero-copy brokers can deliver inline");
+            result = BROKER_ERROR;
+        }
+        else if (Lock(broker_data->modules_lock) != LOCK_OK)
+        {
+            LogError("Lock on broker_data->modules_lock failed");
             result = BROKER_ERROR;
         }
         else
         {
-            if (init_module(module_info, module) != BROKER_OK)
+            BROKER_MODULEINFO* module_info = broker_locate_handle(broker_data, sink);
+            if (module_info == NULL)
             {
-                /*Codes_SRS_BROKER_13_047: [This function shall return BROKER_ERROR if an underlying API call to the platform causes an error or BROKER_OK otherwise.]*/
-                LogError("start_module failed");
-                free(module_info->module);
-                free(module_info);
+                /*Codes_SRS_BROKER_30_123: [ If `sink` is not attached to the broker, `Broker_SetSinkInline` shall return `BROKER_ERROR`. ]*/
+                LogError("sink is not attached to the broker");
+                result = BROKER_ERROR;
+            }
+            else if (module_info->deliver_inline == deliver_inline)
+            {
+                /*Codes_SRS_BROKER_30_124: [ If `deliver_inline` is the sink's setting already, `Broker_SetSinkInline` shall return `BROKER_OK`. ]*/
+                result = BROKER_OK;
+            }
+            else if (module_is_linked(broker_data, module_info))
+            {
+                /*Codes_SRS_BROKER_30_125: [ If a module links to `sink`, `Broker_SetSinkInline` shall fail and return `BROKER_ERROR`. ]*/
+                LogError("modules link to module [%p], it cannot change how it is delivered to", module_info);
                 result = BROKER_ERROR;
             }
             else
             {
-                /*Codes_SRS_BROKER_13_039: [This function shall acquire the lock on BROKER_HANDLE_DATA::modules_lock.]*/
-                BROKER_HANDLE_DATA* broker_data = (BROKER_HANDLE_DATA*)broker;
-                if (Lock(broker_data->modules_lock) != LOCK_OK)
-                {
-                    /*Codes_SRS_BROKER_13_047: [This function shall return BROKER_ERROR if an underlying API call to the platform causes an error or BROKER_OK otherwise.]*/
-                    LogError("Lock on broker_data->modules_lock failed");
-                    deinit_module(module_info);
-                    free(module_info);
-                    result = BROKER_ERROR;
-                }
-                else
+                /*Codes_SRS_BROKER_30_159: [ Before changing the setting, `Broker_SetSinkInline` shall wait until no publisher is queuing messages for, or calling, the sink along a route it took before the sink was unlinked. ]*/
+                wait_for_sink_routes(module_info);
+                if (deliver_inline)
                 {
-                    /*Codes_SRS_BROKER_13_045: [Broker_AddModule shall append the new instance of BROKER_MODULEINFO to BROKER_HANDLE_DATA::modules.]*/
-                    LIST_ITEM_HANDLE moduleListItem = singlylinkedlist_add(broker_data->modules, module_info);
-                    if (moduleListItem == NULL)
+                    /*Codes_SRS_BROKER_30_126: [ To make the sink inline, `Broker_SetSinkInline` shall stop its worker, deliver the messages still queued for it on the calling thread and then flag it inline. ]*/
+                    if (stop_module_queue(module_info) != 0)
                     {
-                        /*Codes_SRS_BROKER_13_047: [This function shall return BROKER_ERROR if an underlying API call to the platform causes an error or BROKER_OK otherwise.]*/
-                        LogError("singlylinkedlist_add failed");
-                        deinit_module(module_info);
-                        free(module_info);
+                        LogError("unable to stop the worker of module [%p]", module_info);
                         result = BROKER_ERROR;
                     }
                     else
                     {
-                        if (start_module(module_info, broker_data->url) != BROKER_OK)
-                        {
-                            LogError("start_module failed");
-                            deinit_module(module_info);
-                            singlylinkedlist_remove(broker_data->modules, moduleListItem);
-                            free(module_info);
-                            result = BROKER_ERROR;
-                        }
-                        else
-                        {
-                            /*Codes_SRS_BROKER_13_047: [This function shall return BROKER_ERROR if an underlying API call to the platform causes an error or BROKER_OK otherwise.]*/
-                            result = BROKER_OK;
-                        }
+                        drain_module_queue(module_info);
+                        module_info->deliver_inline = true;
+                        result = BROKER_OK;
+                    }
+                }
+                /*Codes_SRS_BROKER_30_127: [ To queue messages for the sink again, `Broker_SetSinkInline` shall restart its worker, and fail with `BROKER_ERROR` and leave the sink inline if that fails. ]*/
+                else if (start_module_queue(module_info) != BROKER_OK)
+                {
+                    LogError("unable to restart the worker of module [%p]", module_info);
+                    result = BROKER_ERROR;
+                }
+                else
+                {
+                    module_info->deliver_inline = false;
+                    result = BROKER_OK;
+                }
+            }
+            Unlock(broker_data->modules_lock);
+        }
+    }
+    return result;
+}
+
+BROKER_RESULT Broker_GetSinkQueueStats(BROKER_HANDLE broker, MODULE_HANDLE sink, BROKER_QUEUE_STATS* stats)
+{
+    BROKER_RESULT result;
+    /*Codes_SRS_BROKER_30_060: [ If `broker`, `sink` or `stats` is `NULL`, `Broker_GetSinkQueueStats` shall return `BROKER_INVALIDARG`. ]*/
+    if (broker == NULL || sink == NULL || stats == NULL)
+    {
+        LogError("invalid parameter (NULL).");
+        result = BROKER_INVALIDARG;
+    }
+    else
+    {
+        BROKER_HANDLE_DATA* broker_data = (BROKER_HANDLE_DATA*)broker;
+        if (broker_data->delivery_mode != BROKER_DELIVERY_ZERO_COPY)
+        {
+            /*Codes_SRS_BROKER_30_061: [ If the broker does not use `BROKER_DELIVERY_ZERO_COPY`, `Broker_GetSinkQueueStats` shall return `BROKER_ERROR`. ]*/
+            LogError("only zero-copy brokers have module queues");
+            result = BROKER_ERROR;
+        }
+        else if (Lock(broker_data->modules_lock) != LOCK_OK)
+        {
+            LogError("Lock on broker_data->modules_lock failed");
+            result = BROKER_ERROR;
+        }
+        else
+        {
+            BROKER_MODULEINFO* module_info = broker_locate_handle(broker_data, sink);
+            if (module_info == NULL)
+            {
+                /*Codes_SRS_BROKER_30_062: [ If `sink` is not attached to the broker, `Broker_GetSinkQueueStats` shall return `BROKER_ERROR`. ]*/
+                LogError("sink is not attached to the broker");
+                result = BROKER_ERROR;
+            }
+            else
+            {
+                /*Codes_SRS_BROKER_30_063: [ `Broker_GetSinkQueueStats` shall fill `stats` with the capacity of the sink's queue, the number of messages waiting in it and the sink's drop and wait counters, then return `BROKER_OK`. ]*/
+                /* a queue being drained may be freed by the worker at any time, it is not counted */
+                stats->capacity = module_info->message_queue->mask + 1;
+                stats->queued = message_ring_count(module_info->message_queue);
+                /*Codes_SRS_BROKER_30_156: [ `Broker_GetSinkQueueStats` shall set `stats->priority_queued` to the number of messages waiting on the sink's priority lane, 0 if it has none. ]*/
+                stats->priority_queued = (module_info->priority_queue == NULL) ? 0 : message_ring_count(module_info->priority_queue);
+                stats->dropped = (size_t)ATOMIC_LOAD(&module_info->dropped_count);
+                stats->blocked = (size_t)ATOMIC_LOAD(&module_info->blocked_count);
+                result = BROKER_OK;
+            }
+            Unlock(broker_data->modules_lock);
+        }
+    }
+    return result;
+}
+
+static void broker_decrement_ref(BROKER_HANDLE broker)
+{
+    /*Codes_SRS_BROKER_13_058: [If `broker` is NULL the function shall do nothing.]*/
+    if (broker != NULL)
+    {
+        /*Codes_SRS_BROKER_13_111: [Otherwise, Broker_Destroy shall decrement the internal ref count of the message.]*/
+        /*Codes_SRS_BROKER_13_112: [If the ref count is zero then the allocated resources are freed.]*/
+        if (DEC_REF(BROKER_HANDLE_DATA, broker) == DEC_RETURN_ZERO)
+        {
+            BROKER_HANDLE_DATA* broker_data = (BROKER_HANDLE_DATA*)broker; 
+            if (singlylinkedlist_get_head_item(broker_data->modules) != NULL)
+            {
+                LogError("WARNING: There are still active modules attached to the broker and the broker is being destroyed.");
+            }
+            if (broker_data->delivery_mode != BROKER_DELIVERY_ZERO_COPY)
+            {
+                /* May want to do nn_shutdown first for cleanliness. */
+                nn_close(broker_data->publish_socket);
+                STRING_delete(broker_data->url);
+            }
+            if (broker_data->pool != NULL)
+            {
+                /*Codes_SRS_BROKER_30_114: [ If the broker has a pool of workers, the function shall clear the pool's `is_running` under `idle_lock`, signal `idle_condition` once per worker, join every worker and free the pool. ]*/
+                pool_destroy(broker_data->pool);
+            }
+            if (broker_data->routing != NULL)
+            {
+                for (size_t i = 0; i <= broker_data->routing->index_mask; i++)
+                {
+                    if (broker_data->routing->slots[i].route != NULL)
+                    {
+                        free(broker_data->routing->slots[i].route);
                     }
-
-                    /*Codes_SRS_BROKER_13_046: [This function shall release the lock on BROKER_HANDLE_DATA::modules_lock.]*/
-                    Unlock(broker_data->modules_lock);
                 }
+                free(broker_data->routing);
             }
-
+            if (broker_data->module_index != NULL)
+            {
+                free(broker_data->module_index);
+            }
+            singlylinkedlist_destroy(broker_data->modules);
+            Lock_Deinit(broker_data->modules_lock);
+            free(broker_data);
         }
     }
+    else
+    {
+        LogError("broker handle is NULL");
+    }
+}
 
-    return result;
+extern void Broker_Destroy(BROKER_HANDLE broker)
+{
+    broker_decrement_ref(broker);
 }
 
-static bool find_module_predicate(LIST_ITEM_HANDLE list_item, const void* value)
+extern void Broker_DecRef(BROKER_HANDLE broker)
 {
-    BROKER_MODULEINFO* element = (BROKER_MODULEINFO*)singlylinkedlist_item_get_value(list_item);
-    return element->module->module_handle == ((MODULE*)value)->module_handle;
+    /*Codes_SRS_BROKER_13_113: [This function shall implement all the requirements of the Broker_Destroy API.]*/
+    broker_decrement_ref(broker);
 }
 
-BROKER_RESULT Broker_RemoveModule(BROKER_HANDLE broker, const MODULE* module)
+static BROKER_RESULT publish_serialized(BROKER_HANDLE_DATA* broker_data, MODULE_HANDLE source, MESSAGE_HANDLE message)
 {
-    /*Codes_SRS_BROKER_13_048: [If `broker` or `module` is NULL the function shall return BROKER_INVALIDARG.]*/
     BROKER_RESULT result;
-    if (broker == NULL || module == NULL)
+    int32_t msg_size;
+    int32_t buf_size;
+    /*Codes_SRS_BROKER_17_007: [ Broker_Publish shall clone the message. ]*/
+    MESSAGE_HANDLE msg = Message_Clone(message);
+    /*Codes_SRS_BROKER_17_008: [ Broker_Publish shall serialize the message. ]*/
+    msg_size = Message_ToByteArray(message, NULL, 0);
+    if (msg_size < 0)
     {
-        /*Codes_SRS_BROKER_13_053: [ This function shall return BROKER_ERROR if an underlying API call to the platform causes an error or BROKER_OK otherwise. ]*/
-        result = BROKER_INVALIDARG;
-        LogError("invalid parameter (NULL).");
+        /*Codes_SRS_BROKER_13_053: [This function shall return BROKER_ERROR if an underlying API call to the platform causes an error or BROKER_OK otherwise.]*/
+        LogError("unable to serialize a message [%p]", msg);
+        Message_Destroy(msg);
+        result = BROKER_ERROR;
     }
     else
     {
-        /*Codes_SRS_BROKER_13_088: [This function shall acquire the lock on BROKER_HANDLE_DATA::modules_lock.]*/
-        BROKER_HANDLE_DATA* broker_data = (BROKER_HANDLE_DATA*)broker;
-        if (Lock(broker_data->modules_lock) != LOCK_OK)
+        /*Codes_SRS_BROKER_17_025: [ Broker_Publish shall allocate a nanomsg buffer the size of the serialized message + sizeof(MODULE_HANDLE). ]*/
+        buf_size = msg_size + sizeof(MODULE_HANDLE);
+        void* nn_msg = nn_allocmsg(buf_size, 0);
+        if (nn_msg == NULL)
         {
             /*Codes_SRS_BROKER_13_053: [This function shall return BROKER_ERROR if an underlying API call to the platform causes an error or BROKER_OK otherwise.]*/
-            LogError("Lock on broker_data->modules_lock failed");
+            LogError("unable to serialize a message [%p]", msg);
             result = BROKER_ERROR;
         }
         else
         {
-            /*Codes_SRS_BROKER_13_049: [Broker_RemoveModule shall perform a linear search for module in BROKER_HANDLE_DATA::modules.]*/
-            LIST_ITEM_HANDLE module_info_item = singlylinkedlist_find(broker_data->modules, find_module_predicate, module);
+            /*Codes_SRS_BROKER_17_026: [ Broker_Publish shall copy source into the beginning of the nanomsg buffer. ]*/
+            unsigned char *nn_msg_bytes = (unsigned char *)nn_msg;
+            memcpy(nn_msg_bytes, &source, sizeof(MODULE_HANDLE));
+            /*Codes_SRS_BROKER_17_027: [ Broker_Publish shall serialize the message into the remainder of the nanomsg buffer. ]*/
+            nn_msg_bytes += sizeof(MODULE_HANDLE);
+            Message_ToByteArray(message, nn_msg_bytes, msg_size);
 
-            if (module_info_item == NULL)
+            /*Codes_SRS_BROKER_17_010: [ Broker_Publish shall send a message on the publish_socket. ]*/
+            int nbytes = nn_send(broker_data->publish_socket, &nn_msg, NN_MSG, 0);
+            if (nbytes != buf_size)
             {
-                /*Codes_SRS_BROKER_13_050: [Broker_RemoveModule shall unlock BROKER_HANDLE_DATA::modules_lock and return BROKER_ERROR if the module is not found in BROKER_HANDLE_DATA::modules.]*/
-                LogError("Supplied module is not attached to the broker");
+                /*Codes_SRS_BROKER_13_053: [This function shall return BROKER_ERROR if an underlying API call to the platform causes an error or BROKER_OK otherwise.]*/
+                LogError("unable to send a message [%p]", msg);
+                /*Codes_SRS_BROKER_17_012: [ Broker_Publish shall free the message. ]*/
+                nn_freemsg(nn_msg);
                 result = BROKER_ERROR;
             }
             else
             {
-                BROKER_MODULEINFO* module_info = (BROKER_MODULEINFO*)singlylinkedlist_item_get_value(module_info_item);
-                if (stop_module(broker_data->publish_socket, module_info) == 0)
-                {
-                    deinit_module(module_info);
-                }
-                else
-                {
-                    LogError("unable to stop module");
-                }
-
-                /*Codes_SRS_BROKER_13_052: [The function shall remove the module from BROKER_HANDLE_DATA::modules.]*/
-                singlylinkedlist_remove(broker_data->modules, module_info_item);
-                free(module_info);
-
-                /*Codes_SRS_BROKER_13_053: [This function shall return BROKER_ERROR if an underlying API call to the platform causes an error or BROKER_OK otherwise.]*/
                 result = BROKER_OK;
             }
+        }
+        /*Codes_SRS_BROKER_17_012: [ Broker_Publish shall free the message. ]*/
+        Message_Destroy(msg);
+        /*Codes_SRS_BROKER_17_011: [ Broker_Publish shall free the serialized message data. ]*/
+    }
 
-            /*Codes_SRS_BROKER_13_054: [This function shall release the lock on BROKER_HANDLE_DATA::modules_lock.]*/
-            Unlock(broker_data->modules_lock);
+    return result;
+}
+
+/*waits until the worker of module_info makes room in queue and queues msg
+  there. The publisher leaves the routing table while it waits, so that it
+  does not hold up changes of links and queues, and reads the sink's queue
+  again once back since Broker_SetSinkQueue may have replaced it. Returns 0 if
+  success, otherwise __LINE__*/
+static int wait_for_space(BROKER_HANDLE_DATA* broker_data, long* reader_slot, BROKER_MODULEINFO* module_info, MESSAGE_RING* queue, bool high_priority, MESSAGE_HANDLE msg)
+{
+    int result;
+
+    (void)ATOMIC_INC(&module_info->blocked_publishers);
+    (void)ATOMIC_INC(&module_info->blocked_count);
+    if (Lock(module_info->socket_lock) != LOCK_OK)
+    {
+        LogError("unable to lock the queue of module [%p]", module_info);
+        result = __LINE__;
+    }
+    else
+    {
+        /* the worker takes socket_lock before signalling space_condition, so
+           room made after the failed push cannot go unnoticed */
+        while (message_ring_push(queue, msg) != 0)
+        {
+            routing_exit(broker_data, *reader_slot);
+            (void)Condition_Wait(module_info->space_condition, module_info->socket_lock, 0);
+            (void)routing_enter(broker_data, reader_slot);
+            queue = (MESSAGE_RING*)(high_priority ?
+                ATOMIC_LOAD_PTR(&module_info->priority_queue) :
+                ATOMIC_LOAD_PTR(&module_info->message_queue));
         }
+        (void)Unlock(module_info->socket_lock);
+        result = 0;
     }
+    (void)ATOMIC_DEC(&module_info->blocked_publishers);
 
     return result;
 }
 
-BROKER_MODULEINFO* broker_locate_handle(BROKER_HANDLE_DATA* broker_data, MODULE_HANDLE handle)
+/*queues msg applying the overflow policy of queue. Returns 0 if success,
+  otherwise __LINE__*/
+static int queue_message(BROKER_HANDLE_DATA* broker_data, long* reader_slot, BROKER_MODULEINFO* module_info, MESSAGE_RING* queue, bool high_priority, MESSAGE_HANDLE msg)
 {
-    BROKER_MODULEINFO* result;
-    MODULE module;
-    module.module_apis = NULL;
-    module.module_handle = handle;
+    int result;
 
-    LIST_ITEM_HANDLE module_info_item = singlylinkedlist_find(broker_data->modules, find_module_predicate, &module);
-    if (module_info_item == NULL)
+    /*Codes_SRS_BROKER_30_031: [ In zero-copy mode `Broker_Publish` shall append the clone to the sink's message queue without taking any lock. ]*/
+    if (message_ring_push(queue, msg) == 0)
     {
-        result = NULL;
+        result = 0;
+    }
+    else if (queue->overflow == BROKER_OVERFLOW_DROP_OLDEST)
+    {
+        /*Codes_SRS_BROKER_30_038: [ If the sink's message queue is full and its policy is `BROKER_OVERFLOW_DROP_OLDEST`, `Broker_Publish` shall destroy the oldest queued message, count it as dropped and queue the clone. ]*/
+        do
+        {
+            MESSAGE_HANDLE oldest = message_ring_pop(queue);
+            if (oldest != NULL)
+            {
+                Message_Destroy(oldest);
+                (void)ATOMIC_INC(&module_info->dropped_count);
+            }
+        } while (message_ring_push(queue, msg) != 0);
+        result = 0;
+    }
+    else if (queue->overflow == BROKER_OVERFLOW_BLOCK)
+    {
+        /*Codes_SRS_BROKER_30_039: [ If the sink's message queue is full and its policy is `BROKER_OVERFLOW_BLOCK`, `Broker_Publish` shall count the wait and wait on the sink's `space_condition` until the clone can be queued. ]*/
+        result = wait_for_space(broker_data, reader_slot, module_info, queue, high_priority, msg);
     }
     else
     {
-        result = (BROKER_MODULEINFO*)singlylinkedlist_item_get_value(module_info_item);
+        LogError("message queue of module [%p] is full", module_info);
+        result = __LINE__;
     }
+
     return result;
 }
 
-BROKER_RESULT Broker_AddLink(BROKER_HANDLE broker, const BROKER_LINK_DATA* link)
+/*hands a clone of message to the module's queue, or to its priority lane,
+  and wakes its worker if it sleeps. worker is the pooled worker running the
+  publisher, NULL if there is none. Must be called between routing_enter and
+  routing_exit, reader_slot being the one routing_enter returned*/
+static BROKER_RESULT enqueue_message(BROKER_HANDLE_DATA* broker_data, long* reader_slot, BROKER_MODULEINFO* module_info, MESSAGE_HANDLE message, bool high_priority, BROKER_WORKER* worker)
 {
     BROKER_RESULT result;
-    /*Codes_SRS_BROKER_17_029: [ If broker or link are NULL, Broker_AddLink shall return BROKER_INVALIDARG. ]*/
-    if (broker == NULL || link == NULL || link->module_sink_handle == NULL || link->module_source_handle == NULL)
+    /*Codes_SRS_BROKER_30_152: [ If the link to a sink is a high priority link, `Broker_Publish` and `Broker_PublishBatch` shall queue the clones for the sink on its priority lane. ]*/
+    MESSAGE_RING* queue = (MESSAGE_RING*)(high_priority ?
+        ATOMIC_LOAD_PTR(&module_info->priority_queue) :
+        ATOMIC_LOAD_PTR(&module_info->message_queue));
+
+    if (queue->overflow == BROKER_OVERFLOW_SAMPLE &&
+        message_ring_count(queue) > queue->mask / 2 &&
+        (ATOMIC_INC(&queue->sample_counter) % queue->sample_interval) != 0)
     {
-        LogError("Broker_AddLink, input is NULL.");
-        result = BROKER_INVALIDARG;
+        /*Codes_SRS_BROKER_30_037: [ If the sink's policy is `BROKER_OVERFLOW_SAMPLE` and its message queue is at least half full, `Broker_Publish` shall only queue one message in `sample_interval` for the sink and count the others as dropped without failing. ]*/
+        (void)ATOMIC_INC(&module_info->dropped_count);
+        result = BROKER_OK;
     }
     else
     {
-        BROKER_HANDLE_DATA* broker_data = (BROKER_HANDLE_DATA*)broker;
-        /*Codes_SRS_BROKER_17_030: [ Broker_AddLink shall lock the modules_lock. ]*/
-        if (Lock(broker_data->modules_lock) != LOCK_OK)
+        /*Codes_SRS_BROKER_30_030: [ In zero-copy mode `Broker_Publish` shall clone the `message` once for every sink linked to `source`. ]*/
+        MESSAGE_HANDLE msg = Message_Clone(message);
+        if (msg == NULL)
         {
-            /*Codes_SRS_BROKER_17_034: [ Upon an error, Broker_AddLink shall return BROKER_ADD_LINK_ERROR ]*/
-            LogError("Broker_AddLink, Lock on broker_data->modules_lock failed");
-            result = BROKER_ADD_LINK_ERROR;
+            LogError("unable to clone message [%p]", message);
+            result = BROKER_ERROR;
+        }
+        else if (queue_message(broker_data, reader_slot, module_info, queue, high_priority, msg) != 0)
+        {
+            /*Codes_SRS_BROKER_30_035: [ If the clone cannot be queued, `Broker_Publish` shall destroy it, count it as dropped and treat the sink as failed. ]*/
+            Message_Destroy(msg);
+            (void)ATOMIC_INC(&module_info->dropped_count);
+            result = BROKER_ERROR;
         }
         else
         {
-            /*Codes_SRS_BROKER_17_031: [ Broker_AddLink shall find the BROKER_HANDLE_DATA::module_info for link->sink. ]*/
-            BROKER_MODULEINFO* module_info = broker_locate_handle(broker_data, link->module_sink_handle);
-
-            if (module_info == NULL)
+            if (module_info->pool != NULL)
             {
-                /*Codes_SRS_BROKER_17_034: [ Upon an error, Broker_AddLink shall return BROKER_ADD_LINK_ERROR ]*/
-                LogError("Link->sink is not attached to the broker");
-                result = BROKER_ADD_LINK_ERROR;
+                /*Codes_SRS_BROKER_30_107: [ If the sink is pooled and not scheduled yet, `Broker_Publish` shall flag it as scheduled and queue it on the worker running `source`, or on the next worker in turn if no worker runs `source`, then signal the pool's `idle_condition` while holding `idle_lock` if a worker is idle. ]*/
+                schedule_module(module_info, worker);
             }
-            else
+            /*Codes_SRS_BROKER_30_036: [ If the sink's worker is waiting, `Broker_Publish` shall signal its `queue_condition` while holding its `socket_lock`. ]*/
+            else if (ATOMIC_LOAD(&module_info->is_waiting) != 0)
             {
-                /*Codes_SRS_BROKER_17_041: [ Broker_AddLink shall find the BROKER_HANDLE_DATA::module_info for link->module_source_handle. ]*/
-                BROKER_MODULEINFO* source_module = broker_locate_handle(broker_data, link->module_source_handle);
-
-                if (source_module == NULL)
+                if (Lock(module_info->socket_lock) != LOCK_OK)
                 {
-                    LogError("Link->source is not attached to the broker");
-                    result = BROKER_ADD_LINK_ERROR;
+                    /* the message is queued already, wake the worker regardless */
+                    LogError("unable to lock the queue of module [%p]", module_info);
+                    (void)Condition_Post(module_info->queue_condition);
                 }
                 else
                 {
-                    /*Codes_SRS_BROKER_17_032: [ Broker_AddLink shall subscribe module_info->receive_socket to the link->source module handle. ]*/
-                    if (nn_setsockopt(
-                        module_info->receive_socket, NN_SUB, NN_SUB_SUBSCRIBE, &(link->module_source_handle), sizeof(MODULE_HANDLE)) < 0)
-                    {
-                        /*Codes_SRS_BROKER_17_034: [ Upon an error, Broker_AddLink shall return BROKER_ADD_LINK_ERROR ]*/
-                        LogError("Unable to make link in Broker");
-                        result = BROKER_ADD_LINK_ERROR;
-                    }
-                    else
-                    {
-                        result = BROKER_OK;
-                    }
+                    (void)Condition_Post(module_info->queue_condition);
+                    (void)Unlock(module_info->socket_lock);
                 }
             }
-            /*Codes_SRS_BROKER_17_033: [ Broker_AddLink shall unlock the modules_lock. ]*/
-            Unlock(broker_data->modules_lock);
+            result = BROKER_OK;
         }
     }
+
     return result;
 }
 
-BROKER_RESULT Broker_RemoveLink(BROKER_HANDLE broker, const BROKER_LINK_DATA* link)
+/*hands messages to an inline sink on the publisher's thread. The publisher
+  owns the messages for as long as it is publishing them, so they are neither
+  cloned nor queued.*/
+static void deliver_inline(const BROKER_LINK* link, MESSAGE_HANDLE* messages, size_t message_count)
 {
-    BROKER_RESULT result;
-    /*Codes_SRS_BROKER_17_035: [ If broker, link, link->module_source_handle or link->module_sink_handle are NULL, Broker_RemoveLink shall return BROKER_INVALIDARG. ]*/
-    if (broker == NULL || link == NULL || link->module_sink_handle == NULL || link->module_source_handle == NULL)
+    BROKER_MODULEINFO* module_info = link->sink;
+    size_t limit = (module_info->receive_batch != NULL) ? module_info->batch_size : 1;
+    size_t i = 0;
+    while (i < message_count)
     {
-        LogError("Broker_AddLink, input is NULL.");
-        result = BROKER_INVALIDARG;
-    }
-    else
-    {
-        BROKER_HANDLE_DATA* broker_data = (BROKER_HANDLE_DATA*)broker;
-        /*Codes_SRS_BROKER_17_036: [ Broker_RemoveLink shall lock the modules_lock. ]*/
-        if (Lock(broker_data->modules_lock) != LOCK_OK)
+        /* hand over the longest run of messages the link lets through */
+        bool rejected = false;
+        size_t count = 0;
+        while (count < limit && i + count < message_count)
         {
-            /*Codes_SRS_BROKER_17_040: [ Upon an error, Broker_RemoveLink shall return BROKER_REMOVE_LINK_ERROR. ]*/
-            LogError("Broker_AddLink, Lock on broker_data->modules_lock failed");
-            result = BROKER_REMOVE_LINK_ERROR;
+            if (!link_passes(link, messages[i + count]))
+            {
+                rejected = true;
+                break;
+            }
+            count++;
         }
-        else
-        {
-            /*Codes_SRS_BROKER_17_037: [ Broker_RemoveLink shall find the module_info for link->module_sink_handle. ]*/
-            BROKER_MODULEINFO* module_info = broker_locate_handle(broker_data, link->module_sink_handle);
 
-            if (module_info == NULL)
+        if (count > 0)
+        {
+            if (module_info->receive_batch != NULL)
             {
-                /*Codes_SRS_BROKER_17_040: [ Upon an error, Broker_RemoveLink shall return BROKER_REMOVE_LINK_ERROR. ]*/
-                LogError("Link->sink is not attached to the broker");
-                result = BROKER_REMOVE_LINK_ERROR;
+                module_info->receive_batch(module_info->module->module_handle, messages + i, count);
             }
             else
             {
-                /*Codes_SRS_BROKER_17_042: [ Broker_RemoveLink shall find the module_info for link->module_source_handle. ]*/
-                BROKER_MODULEINFO* source_module_info = broker_locate_handle(broker_data, link->module_source_handle);
-                if (source_module_info == NULL)
-                {
-                    LogError("Link->source is not attached to the broker");
-                    result = BROKER_REMOVE_LINK_ERROR;
-                }
-                else
-                {
-                    /*Codes_SRS_BROKER_17_038: [ Broker_RemoveLink shall unsubscribe module_info->receive_socket from the link->module_source_handle module handle. ]*/
-                    if (nn_setsockopt(
-                        module_info->receive_socket, NN_SUB, NN_SUB_UNSUBSCRIBE, &(link->module_source_handle), sizeof(MODULE_HANDLE)) < 0)
-                    {
-                        /*Codes_SRS_BROKER_17_040: [ Upon an error, Broker_RemoveLink shall return BROKER_REMOVE_LINK_ERROR. ]*/
-                        LogError("Unable to make link in Broker");
-                        result = BROKER_REMOVE_LINK_ERROR;
-                    }
-                    else
-                    {
-                        result = BROKER_OK;
-                    }
-                }
+                MODULE_RECEIVE(module_info->module->module_apis)(module_info->module->module_handle, messages[i]);
             }
-            /*Codes_SRS_BROKER_17_039: [ Broker_RemoveLink shall unlock the modules_lock. ]*/
-            Unlock(broker_data->modules_lock);
         }
+        i += count + (rejected ? 1 : 0);
     }
-    return result;
 }
 
-static void broker_decrement_ref(BROKER_HANDLE broker)
+static BROKER_RESULT publish_zero_copy(BROKER_HANDLE_DATA* broker_data, MODULE_HANDLE source, MESSAGE_HANDLE* messages, size_t message_count)
 {
-    /*Codes_SRS_BROKER_13_058: [If `broker` is NULL the function shall do nothing.]*/
-    if (broker != NULL)
+    BROKER_RESULT result = BROKER_OK;
+    long reader_slot;
+    /*Codes_SRS_BROKER_30_034: [ In zero-copy mode `Broker_Publish` shall look up the sinks of `source` in the current routing table without taking any lock. ]*/
+    /*Codes_SRS_BROKER_30_082: [ In zero-copy mode `Broker_PublishBatch` shall look up the sinks of `source` once for the whole batch. ]*/
+    const BROKER_ROUTING* routing = routing_enter(broker_data, &reader_slot);
+    BROKER_ROUTE* route = routing_find(routing, source);
+    /* sinks of a module running on the pool are queued on the same worker */
+    BROKER_WORKER* worker = NULL;
+
+    /*Codes_SRS_BROKER_30_032: [ In zero-copy mode, if `source` is not attached to the broker or has no sinks, `Broker_Publish` shall return `BROKER_OK` without delivering the message. ]*/
+    if (route != NULL)
     {
-        /*Codes_SRS_BROKER_13_111: [Otherwise, Broker_Destroy shall decrement the internal ref count of the message.]*/
-        /*Codes_SRS_BROKER_13_112: [If the ref count is zero then the allocated resources are freed.]*/
-        if (DEC_REF(BROKER_HANDLE_DATA, broker) == DEC_RETURN_ZERO)
+        /*Codes_SRS_BROKER_30_157: [ In zero-copy mode `Broker_Publish` and `Broker_PublishBatch` shall hold a reference to the route of `source` while delivering along it, and leave the routing table while waiting for room in a sink's queue and before calling inline sinks, so that neither holds up changes of links. ]*/
+        (void)ATOMIC_INC(&route->refs);
+        worker = route->source_info->worker;
+        for (size_t i = 0; i < route->sink_count; i++)
         {
-            BROKER_HANDLE_DATA* broker_data = (BROKER_HANDLE_DATA*)broker; 
-            if (singlylinkedlist_get_head_item(broker_data->modules) != NULL)
+            if (!route->sinks[i].sink->deliver_inline)
             {
-                LogError("WARNING: There are still active modules attached to the broker and the broker is being destroyed.");
+                /*Codes_SRS_BROKER_30_083: [ `Broker_PublishBatch` shall queue the messages for each sink in the order they appear in `messages`, applying the sink's overflow policy to every message as `Broker_Publish` does. ]*/
+                for (size_t j = 0; j < message_count; j++)
+                {
+                    /*Codes_SRS_BROKER_30_133: [ If the link to a sink has a filter, `Broker_Publish` and `Broker_PublishBatch` shall only clone, queue or deliver to the sink the messages whose properties pass all of its conditions. ]*/
+                    /*Codes_SRS_BROKER_30_033: [ In zero-copy mode, if queuing the message for a sink fails, `Broker_Publish` shall still queue it for the remaining sinks and return `BROKER_ERROR`. ]*/
+                    if (link_passes(&(route->sinks[i]), messages[j]) &&
+                        enqueue_message(broker_data, &reader_slot, route->sinks[i].sink, messages[j], route->sinks[i].high_priority, worker) != BROKER_OK)
+                    {
+                        result = BROKER_ERROR;
+                    }
+                }
+            }
+        }
+        routing_exit(broker_data, reader_slot);
+
+        /* the queued sinks get going while the inline ones run here */
+        for (size_t i = 0; i < route->sink_count; i++)
+        {
+            if (route->sinks[i].sink->deliver_inline)
+            {
+                /*Codes_SRS_BROKER_30_120: [ If the sink is inline, `Broker_Publish` and `Broker_PublishBatch` shall hand the messages to the sink's `Module_ReceiveBatch`, in batches of up to `batch_size` messages, or else to its `Module_Receive`, on the calling thread and without cloning them, once the messages are queued for the other sinks. ]*/
+                /*Codes_SRS_BROKER_30_133: [ If the link to a sink has a filter, `Broker_Publish` and `Broker_PublishBatch` shall only clone, queue or deliver to the sink the messages whose properties pass all of its conditions. ]*/
+                deliver_inline(&(route->sinks[i]), messages, message_count);
             }
-            /* May want to do nn_shutdown first for cleanliness. */
-            nn_close(broker_data->publish_socket);
-            STRING_delete(broker_data->url);
-            singlylinkedlist_destroy(broker_data->modules);
-            Lock_Deinit(broker_data->modules_lock);
-            free(broker_data);
         }
+
+        route_release(route);
     }
     else
     {
-        LogError("broker handle is NULL");
+        routing_exit(broker_data, reader_slot);
     }
-}
-
-extern void Broker_Destroy(BROKER_HANDLE broker)
-{
-    broker_decrement_ref(broker);
-}
 
-extern void Broker_DecRef(BROKER_HANDLE broker)
-{
-    /*Codes_SRS_BROKER_13_113: [This function shall implement all the requirements of the Broker_Destroy API.]*/
-    broker_decrement_ref(broker);
+    return result;
 }
 
 BROKER_RESULT Broker_Publish(BROKER_HANDLE broker, MODULE_HANDLE source, MESSAGE_HANDLE message)
@@ -795,72 +3596,69 @@ BROKER_RESULT Broker_Publish(BROKER_HANDLE broker, MODULE_HANDLE source, MESSAGE
     else
     {
         BROKER_HANDLE_DATA* broker_data = (BROKER_HANDLE_DATA*)broker;
-        /*Codes_SRS_BROKER_17_022: [ Broker_Publish shall Lock the modules lock. ]*/
-        if (Lock(broker_data->modules_lock) != LOCK_OK)
+        /*Codes_SRS_BROKER_17_022: [ Broker_Publish shall not acquire the modules lock, so that any number of threads can publish concurrently. ]*/
+        if (broker_data->delivery_mode == BROKER_DELIVERY_ZERO_COPY)
         {
-            /*Codes_SRS_BROKER_13_053: [This function shall return BROKER_ERROR if an underlying API call to the platform causes an error or BROKER_OK otherwise.]*/
-            LogError("Lock on broker_data->modules_lock failed");
-            result = BROKER_ERROR;
+            result = publish_zero_copy(broker_data, source, &message, 1);
+        }
+        else
+        {
+            /* nanomsg sockets are thread safe and publish_socket lives as long as the broker */
+            result = publish_serialized(broker_data, source, message);
+        }
+    }
+    /*Codes_SRS_BROKER_13_037: [ This function shall return BROKER_ERROR if an underlying API call to the platform causes an error or BROKER_OK otherwise. ]*/
+    return result;
+}
+
+BROKER_RESULT Broker_PublishBatch(BROKER_HANDLE broker, MODULE_HANDLE source, MESSAGE_HANDLE* messages, size_t message_count)
+{
+    BROKER_RESULT result;
+    /*Codes_SRS_BROKER_30_080: [ If `broker`, `source` or `messages` is `NULL`, or `message_count` is 0, `Broker_PublishBatch` shall return `BROKER_INVALIDARG`. ]*/
+    if (broker == NULL || source == NULL || messages == NULL || message_count == 0)
+    {
+        result = BROKER_INVALIDARG;
+        LogError("Broker handle, source, and/or messages are NULL or empty");
+    }
+    else
+    {
+        size_t i;
+        for (i = 0; i < message_count; i++)
+        {
+            if (messages[i] == NULL)
+            {
+                break;
+            }
+        }
+
+        if (i < message_count)
+        {
+            /*Codes_SRS_BROKER_30_081: [ If any of the `messages` is `NULL`, `Broker_PublishBatch` shall return `BROKER_INVALIDARG` without publishing any of them. ]*/
+            result = BROKER_INVALIDARG;
+            LogError("message %zu of the batch is NULL", i);
         }
         else
         {
-            int32_t msg_size;
-            int32_t buf_size;
-            /*Codes_SRS_BROKER_17_007: [ Broker_Publish shall clone the message. ]*/
-            MESSAGE_HANDLE msg = Message_Clone(message);
-            /*Codes_SRS_BROKER_17_008: [ Broker_Publish shall serialize the message. ]*/
-            msg_size = Message_ToByteArray(message, NULL, 0);
-            if (msg_size < 0)
+            BROKER_HANDLE_DATA* broker_data = (BROKER_HANDLE_DATA*)broker;
+            /*Codes_SRS_BROKER_30_085: [ `Broker_PublishBatch` shall not acquire the modules lock. ]*/
+            if (broker_data->delivery_mode == BROKER_DELIVERY_ZERO_COPY)
             {
-                /*Codes_SRS_BROKER_13_053: [This function shall return BROKER_ERROR if an underlying API call to the platform causes an error or BROKER_OK otherwise.]*/
-                LogError("unable to serialize a message [%p]", msg);
-                Message_Destroy(msg);
-                result = BROKER_ERROR;
+                result = publish_zero_copy(broker_data, source, messages, message_count);
             }
             else
             {
-                /*Codes_SRS_BROKER_17_025: [ Broker_Publish shall allocate a nanomsg buffer the size of the serialized message + sizeof(MODULE_HANDLE). ]*/
-                buf_size = msg_size + sizeof(MODULE_HANDLE);
-                void* nn_msg = nn_allocmsg(buf_size, 0);
-                if (nn_msg == NULL)
-                {
-                    /*Codes_SRS_BROKER_13_053: [This function shall return BROKER_ERROR if an underlying API call to the platform causes an error or BROKER_OK otherwise.]*/
-                    LogError("unable to serialize a message [%p]", msg);
-                    result = BROKER_ERROR;
-                }
-                else
+                /*Codes_SRS_BROKER_30_084: [ In serialized mode `Broker_PublishBatch` shall publish every message as `Broker_Publish` does, in order, and keep going when one of them fails. ]*/
+                result = BROKER_OK;
+                for (i = 0; i < message_count; i++)
                 {
-                    /*Codes_SRS_BROKER_17_026: [ Broker_Publish shall copy source into the beginning of the nanomsg buffer. ]*/
-                    unsigned char *nn_msg_bytes = (unsigned char *)nn_msg;
-                    memcpy(nn_msg_bytes, &source, sizeof(MODULE_HANDLE));
-                    /*Codes_SRS_BROKER_17_027: [ Broker_Publish shall serialize the message into the remainder of the nanomsg buffer. ]*/
-                    nn_msg_bytes += sizeof(MODULE_HANDLE);
-                    Message_ToByteArray(message, nn_msg_bytes, msg_size);
-
-                    /*Codes_SRS_BROKER_17_010: [ Broker_Publish shall send a message on the publish_socket. ]*/
-                    int nbytes = nn_send(broker_data->publish_socket, &nn_msg, NN_MSG, 0);
-                    if (nbytes != buf_size)
+                    if (publish_serialized(broker_data, source, messages[i]) != BROKER_OK)
                     {
-                        /*Codes_SRS_BROKER_13_053: [This function shall return BROKER_ERROR if an underlying API call to the platform causes an error or BROKER_OK otherwise.]*/
-                        LogError("unable to send a message [%p]", msg);
-                        /*Codes_SRS_BROKER_17_012: [ Broker_Publish shall free the message. ]*/
-                        nn_freemsg(nn_msg);
                         result = BROKER_ERROR;
                     }
-                    else
-                    {
-                        result = BROKER_OK;
-                    }
                 }
-                /*Codes_SRS_BROKER_17_012: [ Broker_Publish shall free the message. ]*/
-                Message_Destroy(msg);
-                /*Codes_SRS_BROKER_17_011: [ Broker_Publish shall free the serialized message data. ]*/
             }
-            /*Codes_SRS_BROKER_17_023: [ Broker_Publish shall Unlock the modules lock. ]*/
-            Unlock(broker_data->modules_lock);
         }
-
     }
-    /*Codes_SRS_BROKER_13_037: [ This function shall return BROKER_ERROR if an underlying API call to the platform causes an error or BROKER_OK otherwise. ]*/
+    /*Codes_SRS_BROKER_30_086: [ `Broker_PublishBatch` shall return `BROKER_ERROR` if publishing any of the messages failed or `BROKER_OK` otherwise. ]*/
     return result;
-}
\ No newline at end of file
+}
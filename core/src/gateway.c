@@ -321,6 +321,38 @@ int Gateway_RemoveModuleByName(GATEWAY_HANDLE gw, const char *module_name)
     return result;
 }
 
+int Gateway_GetSinkQueueStats(GATEWAY_HANDLE gw, const char* module_name, BROKER_QUEUE_STATS* stats)
+{
+    int result;
+    if (gw == NULL || module_name == NULL || stats == NULL)
+    {
+        /*Codes_SRS_GATEWAY_30_020: [ If `gw`, `module_name` or `stats` is `NULL` the function shall return a non-zero value. ]*/
+        LogError("NULL argument given to Gateway_GetSinkQueueStats(). gw = %p, module_name = %p, stats = %p", gw, module_name, stats);
+        result = __LINE__;
+    }
+    else
+    {
+        MODULE_DATA **module_data = (MODULE_DATA**)VECTOR_find_if(gw->modules, module_name_find, module_name);
+        if (module_data == NULL)
+        {
+            /*Codes_SRS_GATEWAY_30_021: [ If no module is named `module_name` the function shall return a non-zero value. ]*/
+            LogError("Couldn't find module with the specified name");
+            result = __LINE__;
+        }
+        /*Codes_SRS_GATEWAY_30_022: [ The function shall read the counters by calling `Broker_GetSinkQueueStats` with the module's handle and return a non-zero value if that fails, 0 otherwise. ]*/
+        else if (Broker_GetSinkQueueStats(gw->broker, (*module_data)->module, stats) != BROKER_OK)
+        {
+            LogError("Unable to read the queue counters of module %s", module_name);
+            result = __LINE__;
+        }
+        else
+        {
+            result = 0;
+        }
+    }
+    return result;
+}
+
 GATEWAY_ADD_LINK_RESULT Gateway_AddLink(GATEWAY_HANDLE gw, const GATEWAY_LINK_ENTRY* entryLink)
 {
     GATEWAY_ADD_LINK_RESULT result;
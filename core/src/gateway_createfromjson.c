@@ -1,6 +1,7 @@
 // Copyright (c) Microsoft. All rights reserved.
 // Licensed under the MIT license. See LICENSE file in the project root for full license information.
 
+#include <string.h>
 #include "azure_c_shared_utility/gballoc.h"
 #include "azure_c_shared_utility/xlogging.h"
 #include "azure_c_shared_utility/macro_utils.h"
@@ -17,10 +18,37 @@
 #define LOADER_ENTRYPOINT_KEY "entrypoint"
 #define MODULE_PATH_KEY "module.path"
 #define ARG_KEY "args"
+#define MODULE_DEDICATED_THREAD_KEY "dedicated-thread"
+#define MODULE_INLINE_KEY "inline"
 
 #define LINKS_KEY "links"
 #define SOURCE_KEY "source"
 #define SINK_KEY "sink"
+#define LINK_QUEUE_CAPACITY_KEY "queue-capacity"
+#define LINK_OVERFLOW_KEY "overflow"
+#define LINK_SAMPLE_INTERVAL_KEY "sample-interval"
+#define LINK_OVERFLOW_DROP_NEWEST_VALUE "drop-newest"
+#define LINK_OVERFLOW_DROP_OLDEST_VALUE "drop-oldest"
+#define LINK_OVERFLOW_BLOCK_VALUE "block"
+#define LINK_OVERFLOW_SAMPLE_VALUE "sample"
+#define LINK_FILTER_KEY "filter"
+#define LINK_HIGH_PRIORITY_KEY "high-priority"
+#define LINK_FILTER_PREFIX_KEY "prefix"
+
+#define BROKER_KEY "broker"
+#define BROKER_DELIVERY_KEY "delivery"
+#define BROKER_DELIVERY_SERIALIZED_VALUE "serialized"
+#define BROKER_DELIVERY_ZERO_COPY_VALUE "zero-copy"
+#define BROKER_QUEUE_CAPACITY_KEY "queue-capacity"
+#define BROKER_BATCH_SIZE_KEY "batch-size"
+#define BROKER_BATCH_WINDOW_KEY "batch-window-ms"
+#define BROKER_SCHEDULER_KEY "scheduler"
+#define BROKER_SCHEDULER_DEDICATED_THREADS_VALUE "dedicated-threads"
+#define BROKER_SCHEDULER_THREAD_POOL_VALUE "thread-pool"
+#define BROKER_WORKER_THREADS_KEY "worker-threads"
+#define BROKER_MESSAGE_POOL_KEY "message-pool"
+#define MESSAGE_POOL_THREAD_CACHE_SIZE_KEY "thread-cache-size"
+#define MESSAGE_POOL_DEPOT_SIZE_KEY "depot-size"
 
 #define PARSE_JSON_RESULT_VALUES \
     PARSE_JSON_SUCCESS, \
@@ -32,7 +60,7 @@
 DEFINE_ENUM(PARSE_JSON_RESULT, PARSE_JSON_RESULT_VALUES);
 
 GATEWAY_HANDLE gateway_create_internal(const GATEWAY_PROPERTIES* properties, bool use_json);
-static PARSE_JSON_RESULT parse_json_internal(GATEWAY_PROPERTIES* out_properties, JSON_Value *root);
+static PARSE_JSON_RESULT parse_json_internal(GATEWAY_PROPERTIES* out_properties, BROKER_CONFIG* broker_config, MESSAGE_POOL_CONFIG* message_pool_config, JSON_Value *root);
 static void destroy_properties_internal(GATEWAY_PROPERTIES* properties);
 void gateway_destroy_internal(GATEWAY_HANDLE gw);
 
@@ -62,9 +90,13 @@ GATEWAY_HANDLE Gateway_CreateFromJson(const char* file_path)
 
                 if (properties != NULL)
                 {
+                    BROKER_CONFIG broker_config;
+                    MESSAGE_POOL_CONFIG message_pool_config;
                     properties->gateway_modules = NULL;
                     properties->gateway_links = NULL;
-                    if (parse_json_internal(properties, root_value) == PARSE_JSON_SUCCESS)
+                    properties->broker_config = NULL;
+                    properties->message_pool_config = NULL;
+                    if (parse_json_internal(properties, &broker_config, &message_pool_config, root_value) == PARSE_JSON_SUCCESS)
                     {
                         /*Codes_SRS_GATEWAY_JSON_14_007: [The function shall use the GATEWAY_PROPERTIES instance to create and return a GATEWAY_HANDLE using the lower level API.]*/
                         /*Codes_SRS_GATEWAY_JSON_17_004: [ The function shall set the module loader to the default dynamically linked library module loader. ]*/
@@ -146,6 +178,20 @@ static void destroy_properties_internal(GATEWAY_PROPERTIES* properties)
 
     if (properties->gateway_links != NULL)
     {
+        size_t vector_size = VECTOR_size(properties->gateway_links);
+        for (size_t element_index = 0; element_index < vector_size; ++element_index)
+        {
+            GATEWAY_LINK_ENTRY* element = (GATEWAY_LINK_ENTRY*)VECTOR_element(properties->gateway_links, element_index);
+            if (element->sink_queue != NULL)
+            {
+                free((void*)(element->sink_queue));
+            }
+            if (element->filter != NULL)
+            {
+                free((void*)(element->filter));
+            }
+        }
+
         VECTOR_destroy(properties->gateway_links);
         properties->gateway_links = NULL;
     }
@@ -197,7 +243,288 @@ static PARSE_JSON_RESULT parse_loader(JSON_Object* loader_json, GATEWAY_MODULE_L
     return result;
 }
 
-static PARSE_JSON_RESULT parse_json_internal(GATEWAY_PROPERTIES* out_properties, JSON_Value *root)
+static PARSE_JSON_RESULT parse_broker(JSON_Object* broker_json, BROKER_CONFIG* broker_config, MESSAGE_POOL_CONFIG* message_pool_config, const MESSAGE_POOL_CONFIG** out_message_pool_config)
+{
+    PARSE_JSON_RESULT result;
+    double thread_cache_size = 0;
+    double depot_size = 0;
+
+    /*Codes_SRS_GATEWAY_JSON_30_002: [ The function shall parse the "broker" object for "delivery", which may be "serialized" or "zero-copy". ]*/
+    const char* delivery = json_object_get_string(broker_json, BROKER_DELIVERY_KEY);
+    /*Codes_SRS_GATEWAY_JSON_30_005: [ The function shall parse the "broker" object for "queue-capacity" and use it as `BROKER_CONFIG::queue_capacity`, 0 when it is missing. ]*/
+    double queue_capacity = json_object_get_number(broker_json, BROKER_QUEUE_CAPACITY_KEY);
+    broker_config->queue_capacity = (queue_capacity > 0) ? (size_t)queue_capacity : 0;
+    /*Codes_SRS_GATEWAY_JSON_30_015: [ The function shall parse the "broker" object for "batch-size" and "batch-window-ms" and use them as `BROKER_CONFIG::batch_size` and `BROKER_CONFIG::batch_window_ms`, 0 when they are missing. ]*/
+    double batch_size = json_object_get_number(broker_json, BROKER_BATCH_SIZE_KEY);
+    double batch_window_ms = json_object_get_number(broker_json, BROKER_BATCH_WINDOW_KEY);
+    broker_config->batch_size = (batch_size > 0) ? (size_t)batch_size : 0;
+    broker_config->batch_window_ms = (batch_window_ms > 0) ? (unsigned int)batch_window_ms : 0;
+    /*Codes_SRS_GATEWAY_JSON_30_019: [ The function shall parse the "broker" object for "scheduler", which may be "dedicated-threads" or "thread-pool", and "worker-threads", used as `BROKER_CONFIG::worker_count`, 0 when it is missing. ]*/
+    const char* scheduler = json_object_get_string(broker_json, BROKER_SCHEDULER_KEY);
+    double worker_threads = json_object_get_number(broker_json, BROKER_WORKER_THREADS_KEY);
+    broker_config->worker_count = (worker_threads > 0) ? (size_t)worker_threads : 0;
+    /*Codes_SRS_GATEWAY_JSON_30_020: [ If "scheduler" is missing the broker shall give every module a thread of its own. ]*/
+    broker_config->scheduler = (scheduler != NULL && strcmp(scheduler, BROKER_SCHEDULER_THREAD_POOL_VALUE) == 0) ? BROKER_SCHEDULER_THREAD_POOL : BROKER_SCHEDULER_DEDICATED_THREADS;
+    /*Codes_SRS_GATEWAY_JSON_30_017: [ The function shall parse the optional "message-pool" object of "broker" for "thread-cache-size" and "depot-size" and set `GATEWAY_PROPERTIES::message_pool_config` when it is present, 0 being used for missing sizes. ]*/
+    JSON_Object* message_pool_json = json_object_get_object(broker_json, BROKER_MESSAGE_POOL_KEY);
+    if (message_pool_json != NULL)
+    {
+        thread_cache_size = json_object_get_number(message_pool_json, MESSAGE_POOL_THREAD_CACHE_SIZE_KEY);
+        depot_size = json_object_get_number(message_pool_json, MESSAGE_POOL_DEPOT_SIZE_KEY);
+        message_pool_config->thread_cache_size = (thread_cache_size > 0) ? (size_t)thread_cache_size : 0;
+        message_pool_config->depot_size = (depot_size > 0) ? (size_t)depot_size : 0;
+        *out_message_pool_config = message_pool_config;
+    }
+
+    if (queue_capacity < 0)
+    {
+        /*Codes_SRS_GATEWAY_JSON_30_006: [ If "queue-capacity" is negative the function shall fail and return NULL. ]*/
+        LogError("Invalid broker queue capacity - %f.", queue_capacity);
+        result = PARSE_JSON_MISSING_OR_MISCONFIGURED_CONFIG;
+    }
+    else if (batch_size < 0 || batch_window_ms < 0)
+    {
+        /*Codes_SRS_GATEWAY_JSON_30_016: [ If "batch-size" or "batch-window-ms" is negative the function shall fail and return NULL. ]*/
+        LogError("Invalid broker batch size - %f or batch window - %f.", batch_size, batch_window_ms);
+        result = PARSE_JSON_MISSING_OR_MISCONFIGURED_CONFIG;
+    }
+    else if (thread_cache_size < 0 || depot_size < 0)
+    {
+        /*Codes_SRS_GATEWAY_JSON_30_018: [ If "thread-cache-size" or "depot-size" is negative the function shall fail and return NULL. ]*/
+        LogError("Invalid message pool thread cache size - %f or depot size - %f.", thread_cache_size, depot_size);
+        result = PARSE_JSON_MISSING_OR_MISCONFIGURED_CONFIG;
+    }
+    else if (worker_threads < 0)
+    {
+        /*Codes_SRS_GATEWAY_JSON_30_021: [ If "worker-threads" is negative or "scheduler" has any other value the function shall fail and return NULL. ]*/
+        LogError("Invalid broker worker thread count - %f.", worker_threads);
+        result = PARSE_JSON_MISSING_OR_MISCONFIGURED_CONFIG;
+    }
+    else if (scheduler != NULL &&
+        strcmp(scheduler, BROKER_SCHEDULER_DEDICATED_THREADS_VALUE) != 0 &&
+        strcmp(scheduler, BROKER_SCHEDULER_THREAD_POOL_VALUE) != 0)
+    {
+        /*Codes_SRS_GATEWAY_JSON_30_021: [ If "worker-threads" is negative or "scheduler" has any other value the function shall fail and return NULL. ]*/
+        LogError("Unknown broker scheduler - %s.", scheduler);
+        result = PARSE_JSON_MISSING_OR_MISCONFIGURED_CONFIG;
+    }
+    else if (delivery == NULL || strcmp(delivery, BROKER_DELIVERY_SERIALIZED_VALUE) == 0)
+    {
+        /*Codes_SRS_GATEWAY_JSON_30_003: [ If "delivery" is missing the broker shall use serialized delivery. ]*/
+        broker_config->delivery_mode = BROKER_DELIVERY_SERIALIZED;
+        result = PARSE_JSON_SUCCESS;
+    }
+    else if (strcmp(delivery, BROKER_DELIVERY_ZERO_COPY_VALUE) == 0)
+    {
+        broker_config->delivery_mode = BROKER_DELIVERY_ZERO_COPY;
+        result = PARSE_JSON_SUCCESS;
+    }
+    else
+    {
+        /*Codes_SRS_GATEWAY_JSON_30_004: [ If "delivery" has any other value the function shall fail and return NULL. ]*/
+        LogError("Unknown broker delivery mode - %s.", delivery);
+        result = PARSE_JSON_MISSING_OR_MISCONFIGURED_CONFIG;
+    }
+
+    return result;
+}
+
+/*returns 0 if overflow_name names a policy, otherwise __LINE__*/
+static int parse_overflow(const char* overflow_name, BROKER_OVERFLOW_POLICY* overflow)
+{
+    int result = 0;
+
+    if (overflow_name == NULL || strcmp(overflow_name, LINK_OVERFLOW_DROP_NEWEST_VALUE) == 0)
+    {
+        *overflow = BROKER_OVERFLOW_DROP_NEWEST;
+    }
+    else if (strcmp(overflow_name, LINK_OVERFLOW_DROP_OLDEST_VALUE) == 0)
+    {
+        *overflow = BROKER_OVERFLOW_DROP_OLDEST;
+    }
+    else if (strcmp(overflow_name, LINK_OVERFLOW_BLOCK_VALUE) == 0)
+    {
+        *overflow = BROKER_OVERFLOW_BLOCK;
+    }
+    else if (strcmp(overflow_name, LINK_OVERFLOW_SAMPLE_VALUE) == 0)
+    {
+        *overflow = BROKER_OVERFLOW_SAMPLE;
+    }
+    else
+    {
+        result = __LINE__;
+    }
+
+    return result;
+}
+
+static PARSE_JSON_RESULT parse_link_queue(JSON_Object* route, BROKER_QUEUE_CONFIG** sink_queue)
+{
+    PARSE_JSON_RESULT result;
+    BROKER_OVERFLOW_POLICY overflow;
+
+    /*Codes_SRS_GATEWAY_JSON_30_010: [ The function shall parse each link for "queue-capacity", "overflow" and "sample-interval". ]*/
+    double capacity = json_object_get_number(route, LINK_QUEUE_CAPACITY_KEY);
+    const char* overflow_name = json_object_get_string(route, LINK_OVERFLOW_KEY);
+    double sample_interval = json_object_get_number(route, LINK_SAMPLE_INTERVAL_KEY);
+
+    *sink_queue = NULL;
+    if (capacity < 0 || sample_interval < 0)
+    {
+        /*Codes_SRS_GATEWAY_JSON_30_011: [ If "queue-capacity" or "sample-interval" is negative the function shall fail and return NULL. ]*/
+        LogError("Invalid link queue capacity - %f or sample interval - %f.", capacity, sample_interval);
+        result = PARSE_JSON_MISSING_OR_MISCONFIGURED_CONFIG;
+    }
+    /*Codes_SRS_GATEWAY_JSON_30_012: [ "overflow" may be "drop-newest", "drop-oldest", "block" or "sample", any other value shall make the function fail and return NULL. ]*/
+    else if (parse_overflow(overflow_name, &overflow) != 0)
+    {
+        LogError("Unknown link overflow policy - %s.", overflow_name);
+        result = PARSE_JSON_MISSING_OR_MISCONFIGURED_CONFIG;
+    }
+    else if (capacity == 0 && overflow_name == NULL && sample_interval == 0)
+    {
+        /*Codes_SRS_GATEWAY_JSON_30_013: [ If a link has none of these keys its `GATEWAY_LINK_ENTRY::sink_queue` shall be `NULL`. ]*/
+        result = PARSE_JSON_SUCCESS;
+    }
+    else
+    {
+        /*Codes_SRS_GATEWAY_JSON_30_014: [ Otherwise the function shall allocate a `BROKER_QUEUE_CONFIG` for the link's `GATEWAY_LINK_ENTRY::sink_queue`, using 0 for missing numbers and "drop-newest" for a missing "overflow". ]*/
+        *sink_queue = (BROKER_QUEUE_CONFIG*)malloc(sizeof(BROKER_QUEUE_CONFIG));
+        if (*sink_queue == NULL)
+        {
+            LogError("Failed to allocate the queue configuration of a link.");
+            result = PARSE_JSON_FAILURE;
+        }
+        else
+        {
+            (*sink_queue)->capacity = (size_t)capacity;
+            (*sink_queue)->overflow = overflow;
+            (*sink_queue)->sample_interval = (size_t)sample_interval;
+            result = PARSE_JSON_SUCCESS;
+        }
+    }
+
+    return result;
+}
+
+/*returns how many values the condition of a link filter has, 0 if it is not a
+  string, an array of strings or an object whose only member is "prefix" with
+  either of these; values receives them unless it is NULL*/
+static size_t parse_filter_values(const JSON_Value* condition, BROKER_FILTER_MATCH* match, const char** values)
+{
+    size_t result = 0;
+    const JSON_Value* operand = NULL;
+
+    if (json_value_get_type(condition) == JSONObject)
+    {
+        JSON_Object* condition_object = json_value_get_object(condition);
+        if (json_object_get_count(condition_object) == 1)
+        {
+            operand = json_object_get_value(condition_object, LINK_FILTER_PREFIX_KEY);
+        }
+        *match = BROKER_FILTER_PREFIX;
+    }
+    else
+    {
+        operand = condition;
+        *match = BROKER_FILTER_EQUALS;
+    }
+
+    if (operand == NULL)
+    {
+        /*not a valid condition*/
+    }
+    else if (json_value_get_type(operand) == JSONString)
+    {
+        if (values != NULL)
+        {
+            values[0] = json_value_get_string(operand);
+        }
+        result = 1;
+    }
+    else if (json_value_get_type(operand) == JSONArray)
+    {
+        JSON_Array* array = json_value_get_array(operand);
+        size_t value_count = json_array_get_count(array);
+        bool valid = true;
+        for (size_t i = 0; i < value_count && valid; i++)
+        {
+            const char* value = json_array_get_string(array, i);
+            valid = (value != NULL);
+            if (valid && values != NULL)
+            {
+                values[i] = value;
+            }
+        }
+        result = valid ? value_count : 0;
+    }
+
+    return result;
+}
+
+static PARSE_JSON_RESULT parse_link_filter(JSON_Object* route, BROKER_LINK_FILTER** filter)
+{
+    PARSE_JSON_RESULT result;
+    BROKER_FILTER_MATCH match;
+
+    /*Codes_SRS_GATEWAY_JSON_30_024: [ The function shall parse the optional "filter" object of each link, whose members name message properties. ]*/
+    JSON_Object* filter_json = json_object_get_object(route, LINK_FILTER_KEY);
+    size_t condition_count = (filter_json == NULL) ? 0 : json_object_get_count(filter_json);
+    size_t value_count = 0;
+    bool valid = true;
+
+    *filter = NULL;
+    for (size_t i = 0; i < condition_count && valid; i++)
+    {
+        size_t condition_values = parse_filter_values(json_object_get_value(filter_json, json_object_get_name(filter_json, i)), &match, NULL);
+        valid = (condition_values != 0);
+        value_count += condition_values;
+    }
+
+    if (filter_json == NULL)
+    {
+        /*Codes_SRS_GATEWAY_JSON_30_027: [ If a link has no "filter" its `GATEWAY_LINK_ENTRY::filter` shall be `NULL`. ]*/
+        result = PARSE_JSON_SUCCESS;
+    }
+    else if (condition_count == 0 || !valid)
+    {
+        /*Codes_SRS_GATEWAY_JSON_30_026: [ If "filter" is empty or one of its members has any other value the function shall fail and return NULL. ]*/
+        LogError("Invalid link filter.");
+        result = PARSE_JSON_MISSING_OR_MISCONFIGURED_CONFIG;
+    }
+    else
+    {
+        /*Codes_SRS_GATEWAY_JSON_30_025: [ A member whose value is a string or an array of strings shall make the link only deliver messages whose property equals one of them, a member whose value is an object with a "prefix" string or array of strings shall make it only deliver messages whose property starts with one of them. ]*/
+        /*Codes_SRS_GATEWAY_JSON_30_028: [ Otherwise the function shall allocate a `BROKER_LINK_FILTER` for the link's `GATEWAY_LINK_ENTRY::filter`. ]*/
+        BROKER_LINK_FILTER* new_filter = (BROKER_LINK_FILTER*)malloc(sizeof(BROKER_LINK_FILTER) + (condition_count * sizeof(BROKER_FILTER_CONDITION)) + (value_count * sizeof(const char*)));
+        if (new_filter == NULL)
+        {
+            LogError("Failed to allocate the filter of a link.");
+            result = PARSE_JSON_FAILURE;
+        }
+        else
+        {
+            /*the conditions follow the filter, their values follow the conditions*/
+            BROKER_FILTER_CONDITION* conditions = (BROKER_FILTER_CONDITION*)(new_filter + 1);
+            const char** values = (const char**)(conditions + condition_count);
+            for (size_t i = 0; i < condition_count; i++)
+            {
+                conditions[i].key = json_object_get_name(filter_json, i);
+                conditions[i].values = values;
+                conditions[i].value_count = parse_filter_values(json_object_get_value(filter_json, conditions[i].key), &conditions[i].match, values);
+                values += conditions[i].value_count;
+            }
+            new_filter->conditions = conditions;
+            new_filter->condition_count = condition_count;
+            *filter = new_filter;
+            result = PARSE_JSON_SUCCESS;
+        }
+    }
+
+    return result;
+}
+
+static PARSE_JSON_RESULT parse_json_internal(GATEWAY_PROPERTIES* out_properties, BROKER_CONFIG* broker_config, MESSAGE_POOL_CONFIG* message_pool_config, JSON_Value *root)
 {
     PARSE_JSON_RESULT result;
 
@@ -244,11 +571,17 @@ static PARSE_JSON_RESULT parse_json_internal(GATEWAY_PROPERTIES* out_properties,
                                 /*Codes_SRS_GATEWAY_JSON_14_005: [The function shall set the value of const void* module_properties in the GATEWAY_PROPERTIES instance to a char* representing the serialized args value for the particular module.]*/
                                 JSON_Value *args = json_object_get_value(module, ARG_KEY);
                                 char* args_str = json_serialize_to_string(args);
+                                /*Codes_SRS_GATEWAY_JSON_30_022: [ The function shall set `GATEWAY_MODULES_ENTRY::dedicated_thread` when the module's "dedicated-thread" is true. ]*/
+                                int dedicated_thread = json_object_get_boolean(module, MODULE_DEDICATED_THREAD_KEY);
+                                /*Codes_SRS_GATEWAY_JSON_30_023: [ The function shall set `GATEWAY_MODULES_ENTRY::deliver_inline` when the module's "inline" is true. ]*/
+                                int deliver_inline = json_object_get_boolean(module, MODULE_INLINE_KEY);
 
                                 GATEWAY_MODULES_ENTRY entry = {
                                     module_name,
                                     loader_info,
-                                    args_str
+                                    args_str,
+                                    dedicated_thread == 1,
+                                    deliver_inline == 1
                                 };
 
                                 /*Codes_SRS_GATEWAY_JSON_14_006: [The function shall return NULL if the JSON_Value contains incomplete information.]*/
@@ -292,21 +625,52 @@ static PARSE_JSON_RESULT parse_json_internal(GATEWAY_PROPERTIES* out_properties,
 
                                 if (module_source != NULL && module_sink != NULL)
                                 {
-                                    GATEWAY_LINK_ENTRY entry = {
-                                        module_source,
-                                        module_sink
-                                    };
+                                    BROKER_QUEUE_CONFIG* sink_queue;
+                                    BROKER_LINK_FILTER* filter = NULL;
+                                    result = parse_link_queue(route, &sink_queue);
+                                    if (result == PARSE_JSON_SUCCESS)
+                                    {
+                                        result = parse_link_filter(route, &filter);
+                                        if (result != PARSE_JSON_SUCCESS && sink_queue != NULL)
+                                        {
+                                            free(sink_queue);
+                                        }
+                                    }
 
-                                    /* Codes_SRS_GATEWAY_JSON_04_002: [ The function shall add all modules source and sink to GATEWAY_PROPERTIES inside gateway_links. ] */
-                                    if (VECTOR_push_back(out_properties->gateway_links, &entry, 1) == 0)
+                                    if (result != PARSE_JSON_SUCCESS)
                                     {
-                                        result = PARSE_JSON_SUCCESS;
+                                        break;
                                     }
                                     else
                                     {
-                                        result = PARSE_JSON_VECTOR_FAILURE;
-                                        LogError("Failed to push data into links vector.");
-                                        break;
+                                        GATEWAY_LINK_ENTRY entry = {
+                                            module_source,
+                                            module_sink,
+                                            sink_queue,
+                                            filter,
+                                            /*Codes_SRS_GATEWAY_JSON_30_029: [ The function shall set `GATEWAY_LINK_ENTRY::high_priority` when the link's "high-priority" is true. ]*/
+                                            json_object_get_boolean(route, LINK_HIGH_PRIORITY_KEY) == 1
+                                        };
+
+                                        /* Codes_SRS_GATEWAY_JSON_04_002: [ The function shall add all modules source and sink to GATEWAY_PROPERTIES inside gateway_links. ] */
+                                        if (VECTOR_push_back(out_properties->gateway_links, &entry, 1) == 0)
+                                        {
+                                            result = PARSE_JSON_SUCCESS;
+                                        }
+                                        else
+                                        {
+                                            if (sink_queue != NULL)
+                                            {
+                                                free(sink_queue);
+                                            }
+                                            if (filter != NULL)
+                                            {
+                                                free(filter);
+                                            }
+                                            result = PARSE_JSON_VECTOR_FAILURE;
+                                            LogError("Failed to push data into links vector.");
+                                            break;
+                                        }
                                     }
                                 }
                                 /*Codes_SRS_GATEWAY_JSON_14_006: [The function shall return NULL if the JSON_Value contains incomplete information.]*/
@@ -325,6 +689,20 @@ static PARSE_JSON_RESULT parse_json_internal(GATEWAY_PROPERTIES* out_properties,
                             LogError("Failed to create links vector. ");
                         }
                     }
+
+                    if (result == PARSE_JSON_SUCCESS)
+                    {
+                        /*Codes_SRS_GATEWAY_JSON_30_001: [ The function shall parse the optional "broker" JSON object and set `GATEWAY_PROPERTIES::broker_config` when it is present. ]*/
+                        JSON_Object* broker_json = json_object_get_object(json_document, BROKER_KEY);
+                        if (broker_json != NULL)
+                        {
+                            result = parse_broker(broker_json, broker_config, message_pool_config, &out_properties->message_pool_config);
+                            if (result == PARSE_JSON_SUCCESS)
+                            {
+                                out_properties->broker_config = broker_config;
+                            }
+                        }
+                    }
                 }
                 /* Codes_SRS_GATEWAY_JSON_14_008: [ This function shall return NULL upon any memory allocation failure. ] */
                 else
@@ -11,6 +11,7 @@
 
 #include "experimental/event_system.h"
 #include "broker.h"
+#include "message_pool.h"
 #include "module_access.h"
 
 #include "gateway_internal.h"
@@ -43,13 +44,15 @@ static bool check_if_link_exists(GATEWAY_HANDLE_DATA* gateway_handle, const GATE
     return link_data == NULL ? false : true;
 }
 
-static int add_one_link_to_broker(GATEWAY_HANDLE_DATA* gateway_handle, MODULE_HANDLE source, MODULE_HANDLE sink)
+static int add_one_link_to_broker(GATEWAY_HANDLE_DATA* gateway_handle, MODULE_HANDLE source, MODULE_HANDLE sink, const BROKER_LINK_FILTER* filter, bool high_priority)
 {
     int result;
     BROKER_LINK_DATA broker_link_entry =
     {
         source,
-        sink
+        sink,
+        filter,
+        high_priority
     };
     if (Broker_AddLink(gateway_handle->broker, &broker_link_entry) != BROKER_OK)
     {
@@ -106,7 +109,9 @@ static int add_regular_link(GATEWAY_HANDLE_DATA* gateway_handle, const GATEWAY_L
         }
         else
         {
-            if (add_one_link_to_broker(gateway_handle, (*module_source_handle)->module, (*module_sink_handle)->module) != 0)
+            /*Codes_SRS_GATEWAY_30_013: [ The function shall pass `entryLink->filter` to `Broker_AddLink` for a link whose source is a module. ]*/
+            /*Codes_SRS_GATEWAY_30_015: [ The function shall pass `entryLink->high_priority` to `Broker_AddLink` for every broker link it makes, including the links of a "*" source to modules added later. ]*/
+            if (add_one_link_to_broker(gateway_handle, (*module_source_handle)->module, (*module_sink_handle)->module, link_entry->filter, link_entry->high_priority) != 0)
             {
                 LogError("Unable to add link to Broker.");
                 result = __LINE__;
@@ -117,7 +122,8 @@ static int add_regular_link(GATEWAY_HANDLE_DATA* gateway_handle, const GATEWAY_L
                 {
                     false,
                     *module_source_handle,
-                    *module_sink_handle
+                    *module_sink_handle,
+                    link_entry->high_priority
                 };
 
                 /*Codes_SRS_GATEWAY_04_012: [ This function shall add the entryLink to the gw->links ] */
@@ -148,9 +154,36 @@ GATEWAY_HANDLE gateway_create_internal(const GATEWAY_PROPERTIES* properties, boo
         /* For freeing up NULL ptrs in case of create failure */
         memset(gateway, 0, sizeof(GATEWAY_HANDLE_DATA));
 
-        /*Codes_SRS_GATEWAY_14_003: [This function shall create a new BROKER_HANDLE for the gateway representing this gateway's message broker. ]*/
-        gateway->broker = Broker_Create();
-        if (gateway->broker == NULL)
+        /*Codes_SRS_GATEWAY_30_002: [ If `properties->message_pool_config` is not `NULL`, this function shall enable the message pool with `MessagePool_Enable` before creating the broker. ]*/
+        if (properties != NULL && properties->message_pool_config != NULL &&
+            MessagePool_Enable(properties->message_pool_config) != 0)
+        {
+            /*Codes_SRS_GATEWAY_30_003: [ If `MessagePool_Enable` fails, this function shall free the gateway and return NULL. ]*/
+            LogError("Gateway_Create(): MessagePool_Enable() failed.");
+            free(gateway);
+            gateway = NULL;
+        }
+        else
+        {
+            gateway->message_pool_enabled = (properties != NULL && properties->message_pool_config != NULL);
+
+            /*Codes_SRS_GATEWAY_14_003: [This function shall create a new BROKER_HANDLE for the gateway representing this gateway's message broker. ]*/
+            if (properties != NULL && properties->broker_config != NULL)
+            {
+                /*Codes_SRS_GATEWAY_30_001: [ If `properties->broker_config` is not `NULL`, this function shall create the broker with `Broker_CreateWithConfig`. ]*/
+                gateway->broker = Broker_CreateWithConfig(properties->broker_config);
+            }
+            else
+            {
+                gateway->broker = Broker_Create();
+            }
+        }
+
+        if (gateway == NULL)
+        {
+            /*already logged*/
+        }
+        else if (gateway->broker == NULL)
         {
             /*Codes_SRS_GATEWAY_14_004: [This function shall return NULL if a BROKER_HANDLE cannot be created.]*/
             gateway_destroy_internal(gateway);
@@ -320,6 +353,12 @@ void gateway_destroy_internal(GATEWAY_HANDLE gw)
             Broker_Destroy(gateway_handle->broker);
         }
 
+        if (gateway_handle->message_pool_enabled)
+        {
+            /*Codes_SRS_GATEWAY_30_004: [ If the gateway enabled the message pool, the function shall disable it with `MessagePool_Disable` after destroying the broker. ]*/
+            MessagePool_Disable();
+        }
+
         free(gateway_handle);
     }
     else
@@ -449,14 +488,38 @@ MODULE_HANDLE gateway_addmodule_internal(GATEWAY_HANDLE_DATA* gateway_handle, co
                         module.module_apis = module_apis;
                         module.module_handle = module_handle;
 
-                        /*Codes_SRS_GATEWAY_14_017: [The function shall attach the module to the GATEWAY_HANDLE_DATA's broker using a call to Broker_AddModule. ]*/
+                        BROKER_RESULT add_result;
+                        if (module_entry->dedicated_thread)
+                        {
+                            /*Codes_SRS_GATEWAY_30_030: [ If `module_entry->dedicated_thread` is true, the function shall attach the module using `Broker_AddModuleWithConfig` with `BROKER_MODULE_CONFIG::dedicated_thread` set instead. ]*/
+                            BROKER_MODULE_CONFIG module_config = { true };
+                            add_result = Broker_AddModuleWithConfig(gateway_handle->broker, &module, &module_config);
+                        }
+                        else
+                        {
+                            /*Codes_SRS_GATEWAY_14_017: [The function shall attach the module to the GATEWAY_HANDLE_DATA's broker using a call to Broker_AddModule. ]*/
+                            add_result = Broker_AddModule(gateway_handle->broker, &module);
+                        }
+
                         /*Codes_SRS_GATEWAY_14_018: [If the function cannot attach the module to the message broker, the function shall return NULL.]*/
-                        if (Broker_AddModule(gateway_handle->broker, &module) != BROKER_OK)
+                        if (add_result != BROKER_OK)
                         {
                             free(new_module_data);
                             module_result = NULL;
                             LogError("Failed to add module to the gateway's broker.");
                         }
+                        /*Codes_SRS_GATEWAY_30_031: [ If `module_entry->deliver_inline` is true, the function shall make the module inline by calling `Broker_SetSinkInline` before linking it to anything, and fail if that fails. ]*/
+                        else if (module_entry->deliver_inline &&
+                            Broker_SetSinkInline(gateway_handle->broker, module_handle, true) != BROKER_OK)
+                        {
+                            free(new_module_data);
+                            module_result = NULL;
+                            if (Broker_RemoveModule(gateway_handle->broker, &module) != BROKER_OK)
+                            {
+                                LogError("Failed to remove module [%p] from the gateway message broker. This module will remain attached.", &module);
+                            }
+                            LogError("Unable to deliver inline to module %s.", module_entry->module_name);
+                        }
                         else
                         {
                             char* name_copied = NULL;
@@ -580,6 +643,37 @@ void gateway_removemodule_internal(GATEWAY_HANDLE_DATA* gateway_handle, MODULE_D
     free(module_data_ptr);
 }
 
+/*returns 0 if success, otherwise __LINE__*/
+static int configure_sink_queue(GATEWAY_HANDLE_DATA* gateway_handle, const GATEWAY_LINK_ENTRY* link_entry)
+{
+    int result;
+
+    if (link_entry->sink_queue == NULL)
+    {
+        result = 0;
+    }
+    else
+    {
+        MODULE_DATA** module_sink_data = (MODULE_DATA**)VECTOR_find_if(gateway_handle->modules, module_name_find, link_entry->module_sink);
+        if (module_sink_data == NULL)
+        {
+            LogError("Failed to configure the queue. Sink module doesn't exists on this gateway. Module Name: %s.", link_entry->module_sink);
+            result = __LINE__;
+        }
+        else if (Broker_SetSinkQueue(gateway_handle->broker, (*module_sink_data)->module, link_entry->sink_queue) != BROKER_OK)
+        {
+            LogError("Unable to configure the queue of module %s.", link_entry->module_sink);
+            result = __LINE__;
+        }
+        else
+        {
+            result = 0;
+        }
+    }
+
+    return result;
+}
+
 bool gateway_addlink_internal(GATEWAY_HANDLE_DATA* gateway_handle, const GATEWAY_LINK_ENTRY* link_entry)
 {
     bool result;
@@ -590,7 +684,19 @@ bool gateway_addlink_internal(GATEWAY_HANDLE_DATA* gateway_handle, const GATEWAY
 
     if (!linkExist)
     {
-        if (strcmp(GATEWAY_ALL, link_entry->module_source) == 0)
+        /*Codes_SRS_GATEWAY_30_012: [ If `entryLink->filter` is not `NULL` and `entryLink->module_source` is "*", the function shall return `GATEWAY_ADD_LINK_ERROR`. ]*/
+        if (link_entry->filter != NULL && strcmp(GATEWAY_ALL, link_entry->module_source) == 0)
+        {
+            LogError("Links from any source cannot be filtered, sink = %s", link_entry->module_sink);
+            result = false;
+        }
+        /*Codes_SRS_GATEWAY_30_010: [ If `entryLink->sink_queue` is not `NULL`, the function shall configure the queue of the sink by calling `Broker_SetSinkQueue` before adding the link, and fail if that fails. ]*/
+        else if (configure_sink_queue(gateway_handle, link_entry) != 0)
+        {
+            LogError("Failed to configure the queue of sink = %s", link_entry->module_sink);
+            result = false;
+        }
+        else if (strcmp(GATEWAY_ALL, link_entry->module_source) == 0)
         {
             /*Codes_SRS_GATEWAY_17_002: [ The gateway shall accept a link with a source of "*" and a sink of a valid module. ]*/
             if (add_any_source_link(gateway_handle, link_entry) != 0)
@@ -632,6 +738,8 @@ void gateway_removelink_internal(GATEWAY_HANDLE_DATA* gateway_handle, LINK_DATA*
     if (link_data->from_any_source)
     {
         remove_any_source_link(gateway_handle, link_data);
+        /* erasing keeps the order of the links behind, so the "*" links stay in front */
+        gateway_handle->any_source_links--;
     }
     else
     {
@@ -652,27 +760,17 @@ int add_module_to_any_source(GATEWAY_HANDLE_DATA* gateway_handle, MODULE_DATA* m
 {
     int result = 0;
     size_t link;
-    size_t num_links = VECTOR_size(gateway_handle->links);
+    /*Codes_SRS_GATEWAY_30_016: [ The gateway shall keep the "*" links ahead of the other links, so that adding or removing a module visits only the "*" links. ]*/
+    size_t num_links = gateway_handle->any_source_links;
     for (link = 0; link < num_links; link++)
     {
         LINK_DATA * link_data = VECTOR_element(gateway_handle->links, link);
-        if (link_data->from_any_source)
+        /*Codes_SRS_GATEWAY_30_014: [ The gateway shall link a "*" source to its sink through the sink's module data kept by the link, without looking the sink up by name. ]*/
+        if (add_one_link_to_broker(gateway_handle, module->module, link_data->module_sink->module, NULL, link_data->high_priority) != 0)
         {
-            MODULE_DATA** module_sink = (MODULE_DATA**)VECTOR_find_if(gateway_handle->modules, module_name_find, link_data->module_sink->module_name);
-            if (module_sink == NULL)
-            {
-                LogError("Link failure between [%s] and [%s]", link_data->module_sink->module_name, module->module_name);
-                result = __LINE__;
-                break;
-            }
-            else
-            {
-                if (add_one_link_to_broker(gateway_handle, module->module, (*module_sink)->module) != 0)
-                {
-                    result = __LINE__;
-                    break;
-                }
-            }
+            LogError("Link failure between [%s] and [%s]", link_data->module_sink->module_name, module->module_name);
+            result = __LINE__;
+            break;
         }
     }
     if (result != 0)
@@ -686,24 +784,15 @@ int add_module_to_any_source(GATEWAY_HANDLE_DATA* gateway_handle, MODULE_DATA* m
 void remove_module_from_any_source(GATEWAY_HANDLE_DATA* gateway_handle, MODULE_DATA* module)
 {
     size_t link;
-    size_t num_links = VECTOR_size(gateway_handle->links);
+    /*Codes_SRS_GATEWAY_30_016: [ The gateway shall keep the "*" links ahead of the other links, so that adding or removing a module visits only the "*" links. ]*/
+    size_t num_links = gateway_handle->any_source_links;
     for (link = 0; link < num_links; link++)
     {
         LINK_DATA * link_data = VECTOR_element(gateway_handle->links, link);
-        if (link_data->from_any_source)
+        /*Codes_SRS_GATEWAY_30_014: [ The gateway shall link a "*" source to its sink through the sink's module data kept by the link, without looking the sink up by name. ]*/
+        if (remove_one_link_from_broker(gateway_handle, module->module, link_data->module_sink->module) != 0)
         {
-            MODULE_DATA** module_sink = (MODULE_DATA**)VECTOR_find_if(gateway_handle->modules, module_name_find, link_data->module_sink->module_name);
-            if (module_sink == NULL)
-            {
-                LogError("Could not find sink for link [%s]", link_data->module_sink);
-            }
-            else
-            {
-                if (remove_one_link_from_broker(gateway_handle, module->module, (*module_sink)->module) != 0)
-                {
-                    LogError("Unable to remove link to Broker.");
-                }
-            }
+            LogError("Unable to remove link to Broker.");
         }
     }
 }
@@ -726,7 +815,8 @@ int add_any_source_link(GATEWAY_HANDLE_DATA* gateway_handle, const GATEWAY_LINK_
         {
             true,
             no_module,
-            *module_sink_data
+            *module_sink_data,
+            link_entry->high_priority
         };
 
         /*Codes_SRS_GATEWAY_04_012: [ This function shall add the entryLink to the gw->links ] */
@@ -737,6 +827,15 @@ int add_any_source_link(GATEWAY_HANDLE_DATA* gateway_handle, const GATEWAY_LINK_
         }
         else
         {
+            /*Codes_SRS_GATEWAY_30_016: [ The gateway shall keep the "*" links ahead of the other links, so that adding or removing a module visits only the "*" links. ]*/
+            LINK_DATA* any_source_end = (LINK_DATA*)VECTOR_element(gateway_handle->links, gateway_handle->any_source_links);
+            LINK_DATA* added = (LINK_DATA*)VECTOR_back(gateway_handle->links);
+            if (added != any_source_end)
+            {
+                *added = *any_source_end;
+                *any_source_end = link_data;
+            }
+
             /*Codes_SRS_GATEWAY_17_003: [ The gateway shall treat a source of "*" as link to the sink module from every other module in gateway. ]*/
             size_t m;
             size_t num_modules = VECTOR_size(gateway_handle->modules);
@@ -746,7 +845,7 @@ int add_any_source_link(GATEWAY_HANDLE_DATA* gateway_handle, const GATEWAY_LINK_
                 MODULE_DATA **source_module_data = (MODULE_DATA **)VECTOR_element(gateway_handle->modules, m);
                 /*Codes_SRS_GATEWAY_17_005: [ For this link, the sink shall receive all messages publish by other modules. ]*/
                 if ((*source_module_data)->module != (*module_sink_data)->module &&
-                    add_one_link_to_broker(gateway_handle, (*source_module_data)->module, (*module_sink_data)->module) != 0)
+                    add_one_link_to_broker(gateway_handle, (*source_module_data)->module, (*module_sink_data)->module, NULL, link_entry->high_priority) != 0)
                 {
                     result = __LINE__;
                     break;
@@ -755,7 +854,11 @@ int add_any_source_link(GATEWAY_HANDLE_DATA* gateway_handle, const GATEWAY_LINK_
             if (result != 0)
             {
                 remove_any_source_link(gateway_handle, &link_data);
-                VECTOR_erase(gateway_handle->links, VECTOR_back(gateway_handle->links), 1);
+                VECTOR_erase(gateway_handle->links, any_source_end, 1);
+            }
+            else
+            {
+                gateway_handle->any_source_links++;
             }
         }
     }
@@ -764,28 +867,19 @@ int add_any_source_link(GATEWAY_HANDLE_DATA* gateway_handle, const GATEWAY_LINK_
 
 void remove_any_source_link(GATEWAY_HANDLE_DATA* gateway_handle, LINK_DATA* link_entry)
 {
-    MODULE_DATA** module_sink_data = (MODULE_DATA**)VECTOR_find_if(gateway_handle->modules, module_name_find, link_entry->module_sink->module_name);
-
-    /*Codes_SRS_GATEWAY_04_011: [If the module referenced by the entryLink->module_source or entryLink->module_sink doesn't exists this function shall return GATEWAY_ADD_LINK_ERROR ] */
-    if (module_sink_data != NULL)
+    /*Codes_SRS_GATEWAY_30_014: [ The gateway shall link a "*" source to its sink through the sink's module data kept by the link, without looking the sink up by name. ]*/
+    MODULE_DATA* module_sink_data = link_entry->module_sink;
+    size_t m;
+    size_t num_modules = VECTOR_size(gateway_handle->modules);
+    for (m = 0; m < num_modules; m++)
     {
-        size_t m;
-        size_t num_modules = VECTOR_size(gateway_handle->modules);
-        for (m = 0; m < num_modules; m++)
+        MODULE_DATA **source_module_data = (MODULE_DATA **)VECTOR_element(gateway_handle->modules, m);
+        if ((*source_module_data)->module != module_sink_data->module &&
+            remove_one_link_from_broker(gateway_handle, (*source_module_data)->module, module_sink_data->module) != 0)
         {
-            MODULE_DATA **source_module_data = (MODULE_DATA **)VECTOR_element(gateway_handle->modules, m);
-            if ((*source_module_data)->module != (*module_sink_data)->module &&
-                remove_one_link_from_broker(gateway_handle, (*source_module_data)->module, (*module_sink_data)->module) != 0)
-            {
-                LogError("Unable to remove link to Broker.");
-            }
+            LogError("Unable to remove link to Broker.");
         }
     }
-    else
-    {
-        LogError("Sink module doesn't exists on this gateway. Module Name: %s.", link_entry->module_sink);
-    }
-
 }
 
 /* Searches both sources and sinks. */
@@ -41,12 +41,21 @@ typedef struct GATEWAY_HANDLE_DATA_TAG {
 
     /** @brief  Vector of LINK_DATA links that the Gateway must track */
     VECTOR_HANDLE links;
+
+    /** @brief  Number of "*" links, kept at the front of links */
+    size_t any_source_links;
+
+    /** @brief  true when this Gateway enabled the message pool and has to
+     *          disable it when destroyed
+     */
+    bool message_pool_enabled;
 } GATEWAY_HANDLE_DATA;
 
 typedef struct LINK_DATA_TAG {
     bool from_any_source;
     MODULE_DATA *module_source;
     MODULE_DATA *module_sink;
+    bool high_priority;
 } LINK_DATA;
 
 GATEWAY_HANDLE gateway_create_internal(const GATEWAY_PROPERTIES* properties, bool use_json);
@@ -0,0 +1,47 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifndef ATOMICS_H
+#define ATOMICS_H
+
+/*
+* Minimal set of atomic operations used by the gateway core. The operations
+* that modify memory are full memory barriers; ATOMIC_LOAD and ATOMIC_LOAD_PTR
+* are sequentially consistent loads that do not write, so threads polling a
+* counter keep its cache line shared. Counters are plain `volatile long`s so
+* the Interlocked family can be used as-is on Windows, where the loads stay
+* compare-exchanges. ATOMIC_COMPARE_EXCHANGE stores `value`
+* only if the counter equals `expected` and always returns the previous value;
+* ATOMIC_COMPARE_EXCHANGE_PTR does the same for pointers.
+*/
+
+#if defined(_MSC_VER)
+
+#include <windows.h>
+
+#define ATOMIC_INC(counter)                 InterlockedIncrement(counter)
+#define ATOMIC_DEC(counter)                 InterlockedDecrement(counter)
+#define ATOMIC_ADD(counter, value)          (InterlockedExchangeAdd((counter), (value)) + (value))
+#define ATOMIC_LOAD(counter)                InterlockedCompareExchange((counter), 0, 0)
+#define ATOMIC_COMPARE_EXCHANGE(counter, value, expected) InterlockedCompareExchange((counter), (value), (expected))
+#define ATOMIC_LOAD_PTR(pointer)            InterlockedCompareExchangePointer((PVOID volatile*)(pointer), NULL, NULL)
+#define ATOMIC_EXCHANGE_PTR(pointer, value) InterlockedExchangePointer((PVOID volatile*)(pointer), (value))
+#define ATOMIC_COMPARE_EXCHANGE_PTR(pointer, value, expected) InterlockedCompareExchangePointer((PVOID volatile*)(pointer), (value), (expected))
+
+#elif defined(__GNUC__)
+
+#define ATOMIC_INC(counter)                 __sync_add_and_fetch((counter), 1)
+#define ATOMIC_DEC(counter)                 __sync_sub_and_fetch((counter), 1)
+#define ATOMIC_ADD(counter, value)          __sync_add_and_fetch((counter), (value))
+#define ATOMIC_LOAD(counter)                __atomic_load_n((counter), __ATOMIC_SEQ_CST)
+#define ATOMIC_COMPARE_EXCHANGE(counter, value, expected) __sync_val_compare_and_swap((counter), (expected), (value))
+#define ATOMIC_LOAD_PTR(pointer)            __atomic_load_n((void* volatile*)(pointer), __ATOMIC_SEQ_CST)
+#define ATOMIC_COMPARE_EXCHANGE_PTR(pointer, value, expected) __sync_val_compare_and_swap((void* volatile*)(pointer), (void*)(expected), (void*)(value))
+
+#define ATOMIC_EXCHANGE_PTR(pointer, value) __atomic_exchange_n((void* volatile*)(pointer), (void*)(value), __ATOMIC_SEQ_CST)
+
+#else
+#error "atomics.h: no atomic operations available for this compiler"
+#endif
+
+#endif /*ATOMICS_H*/
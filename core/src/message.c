@@ -3,6 +3,7 @@
 
 #include <stdlib.h>
 #include <stddef.h>
+#include <stdbool.h>
 #include <inttypes.h>
 #include "azure_c_shared_utility/gballoc.h"
 
@@ -12,26 +13,313 @@
 #include "azure_c_shared_utility/constmap.h"
 #include "azure_c_shared_utility/xlogging.h"
 
-#include "azure_c_shared_utility/refcount.h"
+#include "message_pool.h"
+#include "property_key.h"
+#include "internal/atomics.h"
 
 #define FIRST_MESSAGE_BYTE 0xA1  /*0xA1 comes from (A)zure (I)oT*/
 #define SECOND_MESSAGE_BYTE 0x60 /*0x60 comes from (G)ateway*/
 
 #define MIN_MESSAGE_BUFFER_LENGTH 14 /*14 is the minimum message length that is still valid*/
 
+typedef enum MESSAGE_STORAGE_TAG
+{
+    /*properties and content are a CONSTMAP and a CONSTBUFFER made when the message is created*/
+    MESSAGE_STORAGE_HANDLES,
+    /*the message wraps a serialized byte array (Message_CreateFromByteArrayNoCopy, or a pooled copy)*/
+    MESSAGE_STORAGE_BYTE_ARRAY,
+    /*properties and content are kept right behind the message, properties as a sorted index*/
+    MESSAGE_STORAGE_COMPACT
+}MESSAGE_STORAGE;
+
+/*properties sorted by key, the values are in the same order. Interned keys point to the gateway-wide copy (see property_key.h)*/
+typedef struct PROPERTY_INDEX_TAG
+{
+    size_t count;
+    const char** keys;
+    const char** values;
+}PROPERTY_INDEX;
+
 typedef struct MESSAGE_HANDLE_DATA_TAG
 {
+    volatile long ref_count;
+    /*true when the message lives in a block of the message pool*/
+    bool pooled;
+    MESSAGE_STORAGE storage;
+    /*NULL until somebody looks up a property, except for compact messages which always have one*/
+    PROPERTY_INDEX* property_index;
+    /*for wrapped and compact messages properties and content are NULL until somebody asks for them*/
     CONSTMAP_HANDLE properties;
     CONSTBUFFER_HANDLE content;
+    /*size of the serialized form of the message, 0 until it is known*/
+    volatile long serialized_size;
+    /*the fields below are only used by messages wrapping a byte array*/
+    const unsigned char* serialized;
+    int32_t properties_position;
+    int32_t properties_count;
+    /*content of wrapped and compact messages*/
+    CONSTBUFFER content_view;
+    MESSAGE_BUFFER_FREE free_buffer;
+    void* free_context;
 }MESSAGE_HANDLE_DATA;
 
-DEFINE_REFCOUNT_TYPE(MESSAGE_HANDLE_DATA);
+/*allocates a message with a ref count of 1 followed by extraSize bytes*/
+static MESSAGE_HANDLE_DATA* allocate_message_data(size_t extraSize)
+{
+    MESSAGE_HANDLE_DATA* result;
+    /*MessagePool_Allocate falls back to malloc by itself, so trailing bytes always come from it*/
+    bool pooled = (extraSize > 0) || (MessagePool_IsEnabled() != 0);
+    if (pooled)
+    {
+        result = (MESSAGE_HANDLE_DATA*)MessagePool_Allocate(sizeof(MESSAGE_HANDLE_DATA) + extraSize);
+    }
+    else
+    {
+        result = (MESSAGE_HANDLE_DATA*)malloc(sizeof(MESSAGE_HANDLE_DATA));
+    }
+
+    if (result != NULL)
+    {
+        result->ref_count = 1;
+        result->pooled = pooled;
+        result->storage = MESSAGE_STORAGE_HANDLES;
+        result->property_index = NULL;
+        result->properties = NULL;
+        result->content = NULL;
+    }
+    return result;
+}
+
+static void release_message_data(MESSAGE_HANDLE_DATA* messageData)
+{
+    if (messageData->pooled)
+    {
+        MessagePool_Free(messageData);
+    }
+    else
+    {
+        free(messageData);
+    }
+}
+
+static void init_message_data(MESSAGE_HANDLE_DATA* messageData)
+{
+    messageData->serialized_size = 0;
+    messageData->serialized = NULL;
+    messageData->properties_position = 0;
+    messageData->properties_count = 0;
+    messageData->content_view.buffer = NULL;
+    messageData->content_view.size = 0;
+    messageData->free_buffer = NULL;
+    messageData->free_context = NULL;
+}
+
+static CONSTMAP_HANDLE get_lazy_properties(MESSAGE_HANDLE_DATA* messageData);
+static CONSTBUFFER_HANDLE get_lazy_content_handle(MESSAGE_HANDLE_DATA* messageData);
+static int parse_byte_array_layout(const unsigned char* source, int32_t size, int32_t* propertiesPosition, int32_t* propertiesCount, int32_t* contentPosition, int32_t* contentSize);
+
+/*makes messageData a message wrapping the serialization in source, which has already been validated*/
+static void wrap_byte_array(MESSAGE_HANDLE_DATA* messageData, const unsigned char* source, int32_t size, int32_t propertiesPosition, int32_t propertiesCount, int32_t contentPosition, int32_t contentSize, MESSAGE_BUFFER_FREE free_buffer, void* free_context)
+{
+    messageData->storage = MESSAGE_STORAGE_BYTE_ARRAY;
+    messageData->properties = NULL;
+    messageData->content = NULL;
+    messageData->serialized = source;
+    /*the size of the serialization is the one of the byte array*/
+    messageData->serialized_size = size;
+    messageData->properties_position = propertiesPosition;
+    messageData->properties_count = propertiesCount;
+    messageData->content_view.buffer = (contentSize == 0) ? NULL : source + contentPosition;
+    messageData->content_view.size = (size_t)contentSize;
+    messageData->free_buffer = free_buffer;
+    messageData->free_context = free_context;
+}
+
+static size_t get_byte_array_size(const char* const* keys, const char* const* values, size_t nProperties, size_t contentSize)
+{
+    size_t i;
+    size_t result =
+        + 2 /*header*/
+        + 4 /*total size of byte array*/
+        + 4 /*total number of properties*/
+        + 4 /*number of bytes in messageContent*/
+        + contentSize;
+
+    for (i = 0; i < nProperties; i++)
+    {
+        /*add to the needed size the name and value of property i*/
+        result += (strlen(keys[i]) + 1) + (strlen(values[i]) + 1);
+    }
+    return result;
+}
+
+/*buf is expected to be byteArraySize bytes, as computed by get_byte_array_size*/
+static void write_byte_array(unsigned char* buf, size_t byteArraySize, const char* const* keys, const char* const* values, size_t nProperties, const unsigned char* content, size_t contentSize)
+{
+    size_t i;
+    size_t currentPosition; /*always points to the byte we are about to write*/
+    /*a header formed of the following hex characters in this order: 0xA1 0x60*/
+    buf[0] = FIRST_MESSAGE_BYTE;
+    buf[1] = SECOND_MESSAGE_BYTE;
+    /*4 bytes in MSB order representing the total size of the byte array. */
+    buf[2] = byteArraySize >> 24;
+    buf[3] = (byteArraySize >> 16) & 0xFF;
+    buf[4] = (byteArraySize >> 8) & 0xFF;
+    buf[5] = (byteArraySize) & 0xFF;
+    /*4 bytes in MSB order representing the number of properties*/
+    buf[6] = nProperties >> 24;
+    buf[7] = (nProperties >> 16) & 0xFF;
+    buf[8] = (nProperties >> 8) & 0xFF;
+    buf[9] = nProperties & 0xFF;
+    /*for every property, 2 arrays of null terminated characters representing the name of the property and the value.*/
+    currentPosition = 10;
+    for (i = 0;i < nProperties;i++)
+    {
+        size_t nameLength = strlen(keys[i]) + 1;/*the +1 will take care of copying '\0' too*/
+        size_t valueLength = strlen(values[i]) + 1;/*the +1 will take care of copying '\0' too*/
+
+        /*copy name*/
+        memcpy(buf + currentPosition, keys[i], nameLength);
+        currentPosition += nameLength;
+
+        /*copy value*/
+        memcpy(buf + currentPosition, values[i], valueLength);
+        currentPosition += valueLength;
+    }
+
+    /*4 bytes in MSB order representing the number of bytes in the message content array*/
+    buf[currentPosition++] = (contentSize) >> 24;
+    buf[currentPosition++] = ((contentSize) >> 16) & 0xFF;
+    buf[currentPosition++] = ((contentSize) >> 8) & 0xFF;
+    buf[currentPosition++] = (contentSize) & 0xFF;
+
+    /*n bytes of message content follows.*/
+    if (contentSize > 0)
+    {
+        memcpy(buf + currentPosition, content, contentSize);
+    }
+}
+
+#define PROPERTY_INDEX_SIZE(count) (sizeof(PROPERTY_INDEX) + 2 * (count) * sizeof(const char*))
+
+/*lays out the keys and values arrays of an index for count properties right behind it, returns where the memory after them starts*/
+static unsigned char* init_property_index(PROPERTY_INDEX* index, size_t count)
+{
+    index->count = count;
+    index->keys = (const char**)(index + 1);
+    index->values = index->keys + count;
+    return (unsigned char*)(index->values + count);
+}
+
+/*messages have a handful of properties, insertion sort does*/
+static void sort_property_index(PROPERTY_INDEX* index)
+{
+    size_t i;
+    for (i = 1; i < index->count; i++)
+    {
+        const char* key = index->keys[i];
+        const char* value = index->values[i];
+        size_t j = i;
+        while ((j > 0) && (strcmp(index->keys[j - 1], key) > 0))
+        {
+            index->keys[j] = index->keys[j - 1];
+            index->values[j] = index->values[j - 1];
+            j--;
+        }
+        index->keys[j] = key;
+        index->values[j] = value;
+    }
+}
+
+/*with the pool enabled the message keeps its properties and content right behind its own structure, in a single block*/
+/*the properties are a sorted index, interned keys are not copied*/
+static MESSAGE_HANDLE_DATA* create_compact_message(const MESSAGE_CONFIG * cfg)
+{
+    MESSAGE_HANDLE_DATA* result;
+    const char* const* keys;
+    const char* const* values;
+    size_t nProperties;
+
+    if (Map_GetInternals(cfg->sourceProperties, &keys, &values, &nProperties) != MAP_OK)
+    {
+        /*Codes_SRS_MESSAGE_30_016: [ If any step fails, Message_Create shall fail and return NULL. ]*/
+        LogError("failed to get the keys and values of the properties");
+        result = NULL;
+    }
+    else
+    {
+        size_t i;
+        size_t byteArraySize = get_byte_array_size(NULL, NULL, 0, cfg->size);
+        size_t blockSize = PROPERTY_INDEX_SIZE(nProperties) + cfg->size;
+        for (i = 0; i < nProperties; i++)
+        {
+            size_t keyLength = strlen(keys[i]) + 1;
+            size_t valueLength = strlen(values[i]) + 1;
+            byteArraySize += keyLength + valueLength;
+            blockSize += valueLength + ((PropertyKey_Find(keys[i]) == NULL) ? keyLength : 0);
+        }
+
+        if (byteArraySize > INT32_MAX)
+        {
+            LogError("message is too big to be serialized");
+            result = NULL;
+        }
+        else
+        {
+            /*Codes_SRS_MESSAGE_30_015: [ If the message pool is enabled, Message_Create shall allocate the message, its properties and its content in a single block from the pool. ]*/
+            result = allocate_message_data(blockSize);
+            if (result == NULL)
+            {
+                LogError("unable to allocate a pooled message");
+            }
+            else
+            {
+                PROPERTY_INDEX* index = (PROPERTY_INDEX*)(result + 1);
+                unsigned char* content = init_property_index(index, nProperties);
+                char* strings = (char*)(content + cfg->size);
+
+                if (cfg->size > 0)
+                {
+                    memcpy(content, cfg->source, cfg->size);
+                }
+
+                for (i = 0; i < nProperties; i++)
+                {
+                    /*Codes_SRS_MESSAGE_30_018: [ Message_Create shall not copy the keys that are interned, the properties shall refer to the interned keys instead. ]*/
+                    const char* key = PropertyKey_Find(keys[i]);
+                    size_t valueLength = strlen(values[i]) + 1;
+                    if (key == NULL)
+                    {
+                        size_t keyLength = strlen(keys[i]) + 1;
+                        memcpy(strings, keys[i], keyLength);
+                        key = strings;
+                        strings += keyLength;
+                    }
+                    memcpy(strings, values[i], valueLength);
+                    index->keys[i] = key;
+                    index->values[i] = strings;
+                    strings += valueLength;
+                }
+                /*Codes_SRS_MESSAGE_30_019: [ Message_Create shall keep the properties sorted by key. ]*/
+                sort_property_index(index);
+
+                init_message_data(result);
+                result->storage = MESSAGE_STORAGE_COMPACT;
+                result->property_index = index;
+                result->serialized_size = (long)byteArraySize;
+                result->content_view.buffer = (cfg->size == 0) ? NULL : content;
+                result->content_view.size = cfg->size;
+            }
+        }
+    }
+    return result;
+}
 
 static MESSAGE_HANDLE_DATA* Message_CreateImpl(const MESSAGE_CONFIG * cfg)
 {
     MESSAGE_HANDLE_DATA* result;
     /*Codes_SRS_MESSAGE_02_006: [Otherwise, Message_Create shall return a non-NULL handle and shall set the internal ref count to "1".]*/
-    result = REFCOUNT_TYPE_CREATE(MESSAGE_HANDLE_DATA);
+    result = allocate_message_data(0);
     if (result == NULL)
     {
         LogError("malloc returned NULL");
@@ -39,6 +327,7 @@ static MESSAGE_HANDLE_DATA* Message_CreateImpl(const MESSAGE_CONFIG * cfg)
     }
     else
     {
+        init_message_data(result);
         /*Codes_SRS_MESSAGE_02_004: [Mesages shall be allowed to be created from zero-size content.]*/
         /*Codes_SRS_MESSAGE_02_015: [The MESSAGE_CONTENT's field size shall have the same value as the cfg's field size.]*/
         /*Codes_SRS_MESSAGE_17_003: [Message_Create shall copy the source to a readonly CONSTBUFFER.]*/
@@ -46,7 +335,7 @@ static MESSAGE_HANDLE_DATA* Message_CreateImpl(const MESSAGE_CONFIG * cfg)
         if (result->content == NULL)
         {
             LogError("CONSBUFFER_Create failed");
-            free(result);
+            release_message_data(result);
             result = NULL;
         }
         else
@@ -58,7 +347,7 @@ static MESSAGE_HANDLE_DATA* Message_CreateImpl(const MESSAGE_CONFIG * cfg)
                 /*Codes_SRS_MESSAGE_02_005: [If Message_Create encounters an error while building the internal structures of the message, then it shall return NULL.] */
                 LogError("ConstMap_Create failed");
                 CONSTBUFFER_Destroy(result->content);
-                free(result);
+                release_message_data(result);
                 result = NULL;
             }
             else
@@ -87,8 +376,15 @@ MESSAGE_HANDLE Message_Create(const MESSAGE_CONFIG * cfg)
     }
     else
     {
-        /*delegate to internal function that does not do validation*/
-        result = Message_CreateImpl(cfg);
+        if (MessagePool_IsEnabled())
+        {
+            result = create_compact_message(cfg);
+        }
+        else
+        {
+            /*delegate to internal function that does not do validation*/
+            result = Message_CreateImpl(cfg);
+        }
     }
     return (MESSAGE_HANDLE)result;
 }
@@ -118,7 +414,7 @@ MESSAGE_HANDLE Message_CreateFromBuffer(const MESSAGE_BUFFER_CONFIG* cfg)
     {
         /*Codes_SRS_MESSAGE_17_011: [If Message_CreateFromBuffer encounters an error while building the internal structures of the message, then it shall return NULL.]*/
         /*Codes_SRS_MESSAGE_17_014: [On success, Message_CreateFromBuffer shall return a non-NULL handle and set the internal ref count to "1".]*/
-        result = REFCOUNT_TYPE_CREATE(MESSAGE_HANDLE_DATA);
+        result = allocate_message_data(0);
         if (result == NULL)
         {
             LogError("malloc returned NULL");
@@ -126,12 +422,13 @@ MESSAGE_HANDLE Message_CreateFromBuffer(const MESSAGE_BUFFER_CONFIG* cfg)
         }
         else
         {
+            init_message_data(result);
             /*Codes_SRS_MESSAGE_17_013: [Message_CreateFromBuffer shall clone the CONSTBUFFER sourceBuffer.]*/
             result->content = CONSTBUFFER_Clone(cfg->sourceContent);
             if (result->content == NULL)
             {
                 LogError("CONSBUFFER Clone failed");
-                free(result);
+                release_message_data(result);
                 result = NULL;
             }
             else
@@ -142,7 +439,7 @@ MESSAGE_HANDLE Message_CreateFromBuffer(const MESSAGE_BUFFER_CONFIG* cfg)
                 {
                     LogError("ConstMap_Create failed");
                     CONSTBUFFER_Destroy(result->content);
-                    free(result);
+                    release_message_data(result);
                     result = NULL;
                 }
                 else
@@ -165,12 +462,20 @@ MESSAGE_HANDLE Message_Clone(MESSAGE_HANDLE message)
     else
     {
         /*Codes_SRS_MESSAGE_02_008: [Otherwise, Message_Clone shall increment the internal ref count.] */
-        INC_REF(MESSAGE_HANDLE_DATA, message);
         MESSAGE_HANDLE_DATA* messageData = (MESSAGE_HANDLE_DATA*)message;
-        /*Codes_SRS_MESSAGE_17_001: [Message_Clone shall clone the CONSTMAP handle.]*/
-        (void)ConstMap_Clone(messageData->properties);
-        /*Codes_SRS_MESSAGE_17_004: [Message_Clone shall clone the CONSTBUFFER handle]*/
-        (void)CONSTBUFFER_Clone(messageData->content);
+        (void)ATOMIC_INC(&messageData->ref_count);
+        if (messageData->storage == MESSAGE_STORAGE_HANDLES)
+        {
+            /*Codes_SRS_MESSAGE_17_001: [Message_Clone shall clone the CONSTMAP handle.]*/
+            (void)ConstMap_Clone(messageData->properties);
+            /*Codes_SRS_MESSAGE_17_004: [Message_Clone shall clone the CONSTBUFFER handle]*/
+            (void)CONSTBUFFER_Clone(messageData->content);
+        }
+        else
+        {
+            /*Codes_SRS_MESSAGE_30_008: [ If message wraps a byte array, Message_Clone shall only increment the internal ref count. ]*/
+            /*Codes_SRS_MESSAGE_30_020: [ If message is compact, Message_Clone shall only increment the internal ref count. ]*/
+        }
     }
     /*Codes_SRS_MESSAGE_02_010: [Message_Clone shall return messageHandle.]*/
     return message;
@@ -189,7 +494,14 @@ CONSTMAP_HANDLE Message_GetProperties(MESSAGE_HANDLE message)
     {
         /*Codes_SRS_MESSAGE_02_012: [Otherwise, Message_GetProperties shall shall clone and return the CONSTMAP handle representing the properties of the message.]*/
         MESSAGE_HANDLE_DATA* messageData = (MESSAGE_HANDLE_DATA*)message;
-        result = ConstMap_Clone(messageData->properties);
+        if (messageData->storage == MESSAGE_STORAGE_HANDLES)
+        {
+            result = ConstMap_Clone(messageData->properties);
+        }
+        else
+        {
+            result = get_lazy_properties(messageData);
+        }
     }
     return result;
 }
@@ -207,7 +519,17 @@ const CONSTBUFFER * Message_GetContent(MESSAGE_HANDLE message)
     {
         /*Codes_SRS_MESSAGE_02_014: [Otherwise, Message_GetContent shall return a non-NULL const pointer to a structure of type MESSAGE_CONTENT.]*/
         /*Codes_SRS_MESSAGE_02_016: [The CONSTBUFFER's field buffer shall compare equal byte-by-byte to the cfg's field source.]*/
-        result = CONSTBUFFER_GetContent(((MESSAGE_HANDLE_DATA*)message)->content);
+        MESSAGE_HANDLE_DATA* messageData = (MESSAGE_HANDLE_DATA*)message;
+        if (messageData->storage == MESSAGE_STORAGE_HANDLES)
+        {
+            result = CONSTBUFFER_GetContent(messageData->content);
+        }
+        else
+        {
+            /*Codes_SRS_MESSAGE_30_010: [ If message wraps a byte array, Message_GetContent shall return a CONSTBUFFER pointing into the byte array. ]*/
+            /*Codes_SRS_MESSAGE_30_021: [ If message is compact, Message_GetContent shall return a CONSTBUFFER pointing to the content kept with the message. ]*/
+            result = &messageData->content_view;
+        }
     }
     return result;
 }
@@ -224,7 +546,15 @@ CONSTBUFFER_HANDLE Message_GetContentHandle(MESSAGE_HANDLE message)
     else
     {
         /*Codes_SRS_MESSAGE_17_007: [Otherwise, Message_GetContentHandle shall shall clone and return the CONSTBUFFER_HANDLE representing the message content.]*/
-        result = CONSTBUFFER_Clone(((MESSAGE_HANDLE_DATA*)message)->content);
+        MESSAGE_HANDLE_DATA* messageData = (MESSAGE_HANDLE_DATA*)message;
+        if (messageData->storage == MESSAGE_STORAGE_HANDLES)
+        {
+            result = CONSTBUFFER_Clone(messageData->content);
+        }
+        else
+        {
+            result = get_lazy_content_handle(messageData);
+        }
     }
     return result;
 }
@@ -239,15 +569,48 @@ void Message_Destroy(MESSAGE_HANDLE message)
     else
     {
         MESSAGE_HANDLE_DATA* messageData = (MESSAGE_HANDLE_DATA*)message;
-        /*Codes_SRS_MESSAGE_17_002: [Message_Destroy shall destroy the CONSTMAP properties.]*/
-        ConstMap_Destroy(messageData->properties);
-        /*Codes_SRS_MESSAGE_17_005: [Message_Destroy shall destroy the CONSTBUFFER.]*/
-        CONSTBUFFER_Destroy(messageData->content);
+        if (messageData->storage == MESSAGE_STORAGE_HANDLES)
+        {
+            /*Codes_SRS_MESSAGE_17_002: [Message_Destroy shall destroy the CONSTMAP properties.]*/
+            ConstMap_Destroy(messageData->properties);
+            /*Codes_SRS_MESSAGE_17_005: [Message_Destroy shall destroy the CONSTBUFFER.]*/
+            CONSTBUFFER_Destroy(messageData->content);
+        }
         /*Codes_SRS_MESSAGE_02_020: [Otherwise, Message_Destroy shall decrement the internal ref count of the message.]*/
-        if (DEC_REF(MESSAGE_HANDLE_DATA, message) == DEC_RETURN_ZERO)
+        if (ATOMIC_DEC(&messageData->ref_count) == 0)
         {
+            if (messageData->storage == MESSAGE_STORAGE_HANDLES)
+            {
+                if (messageData->property_index != NULL)
+                {
+                    /*Codes_SRS_MESSAGE_30_026: [ Message_Destroy shall free the property index built for the message, if any. ]*/
+                    MessagePool_Free(messageData->property_index);
+                }
+            }
+            else
+            {
+                /*Codes_SRS_MESSAGE_30_013: [ If message wraps a byte array, Message_Destroy shall destroy the properties and content handles created for it, if any, and shall call free_buffer with free_context. ]*/
+                /*Codes_SRS_MESSAGE_30_022: [ If message is compact, Message_Destroy shall destroy the properties and content handles created for it, if any. ]*/
+                /*Codes_SRS_MESSAGE_30_026: [ Message_Destroy shall free the property index built for the message, if any. ]*/
+                if ((messageData->storage == MESSAGE_STORAGE_BYTE_ARRAY) && (messageData->property_index != NULL))
+                {
+                    MessagePool_Free(messageData->property_index);
+                }
+                if (messageData->properties != NULL)
+                {
+                    ConstMap_Destroy(messageData->properties);
+                }
+                if (messageData->content != NULL)
+                {
+                    CONSTBUFFER_Destroy(messageData->content);
+                }
+                if (messageData->free_buffer != NULL)
+                {
+                    messageData->free_buffer(messageData->free_context);
+                }
+            }
             /*Codes_SRS_MESSAGE_02_021: [If the ref count is zero then the allocated resources are freed.]*/
-            free(message);
+            release_message_data(messageData);
         }
     }
 }
@@ -312,6 +675,35 @@ MESSAGE_HANDLE Message_CreateFromByteArray(const unsigned char* source, int32_t
         LogError("invalid parameter source=[%p] size=%" PRId32, source, size);
         result = NULL;
     }
+    else if (MessagePool_IsEnabled())
+    {
+        int32_t propertiesPosition;
+        int32_t propertiesCount;
+        int32_t contentPosition;
+        int32_t contentSize;
+
+        if (parse_byte_array_layout(source, size, &propertiesPosition, &propertiesCount, &contentPosition, &contentSize) != 0)
+        {
+            LogError("byte array is not a valid gateway message serialization");
+            result = NULL;
+        }
+        else
+        {
+            /*Codes_SRS_MESSAGE_30_017: [ If the message pool is enabled, Message_CreateFromByteArray shall copy source as is in a single block from the pool, right behind the message, and the message shall wrap that copy. ]*/
+            result = allocate_message_data((size_t)size);
+            if (result == NULL)
+            {
+                LogError("unable to allocate a pooled message");
+            }
+            else
+            {
+                unsigned char* serialized = (unsigned char*)(result + 1);
+                init_message_data(result);
+                memcpy(serialized, source, size);
+                wrap_byte_array(result, serialized, size, propertiesPosition, propertiesCount, contentPosition, contentSize, NULL, NULL);
+            }
+        }
+    }
     else
     {
         /*Codes_SRS_MESSAGE_02_024: [ If the first two bytes of source are not 0xA1 0x60 then Message_CreateFromByteArray shall fail and return NULL. ]*/
@@ -461,6 +853,437 @@ MESSAGE_HANDLE Message_CreateFromByteArray(const unsigned char* source, int32_t
 
 }
 
+/*walks a serialized message without copying anything. On success it returns 0 and fills in where the properties and the content are*/
+static int parse_byte_array_layout(const unsigned char* source, int32_t size, int32_t* propertiesPosition, int32_t* propertiesCount, int32_t* contentPosition, int32_t* contentSize)
+{
+    int result;
+    int32_t currentPosition = 2;
+    int32_t parsed;
+    int32_t messageSize;
+
+    if (
+        (source[0] != FIRST_MESSAGE_BYTE) ||
+        (source[1] != SECOND_MESSAGE_BYTE)
+        )
+    {
+        LogError("byte array is not a gateway message serialization");
+        result = __LINE__;
+    }
+    else if (parse_int32_t(source, size, currentPosition, &parsed, &messageSize) != 0)
+    {
+        LogError("unable to parse an int32_t");
+        result = __LINE__;
+    }
+    else if (messageSize != size)
+    {
+        LogError("message size is inconsistent");
+        result = __LINE__;
+    }
+    else if (parse_int32_t(source, size, currentPosition + parsed, &parsed, propertiesCount) != 0)
+    {
+        LogError("unable to parse an int32_t");
+        result = __LINE__;
+    }
+    else if (
+        (*propertiesCount < 0) ||
+        (*propertiesCount == INT32_MAX)
+        )
+    {
+        LogError("invalid message detected with wrong number of properties =%" PRId32, *propertiesCount);
+        result = __LINE__;
+    }
+    else
+    {
+        int32_t i;
+        currentPosition += 8;
+        *propertiesPosition = currentPosition;
+
+        for (i = 0; i < *propertiesCount; i++)
+        {
+            const char* keyName;
+            const char* keyValue;
+            if (parse_null_terminated_const_char(source, size, currentPosition, &parsed, &keyName) != 0)
+            {
+                LogError("unable to parse the name string of the property");
+                break;
+            }
+            else
+            {
+                currentPosition += parsed;
+                if (parse_null_terminated_const_char(source, size, currentPosition, &parsed, &keyValue) != 0)
+                {
+                    LogError("unable to parse the value string of the property");
+                    break;
+                }
+                else
+                {
+                    currentPosition += parsed;
+                }
+            }
+        }
+
+        if (i != *propertiesCount)
+        {
+            result = __LINE__;
+        }
+        else if (parse_int32_t(source, size, currentPosition, &parsed, contentSize) != 0)
+        {
+            LogError("no space to read the number of bytes making the message");
+            result = __LINE__;
+        }
+        else
+        {
+            currentPosition += parsed;
+            if (currentPosition + *contentSize != messageSize)
+            {
+                LogError("the message content doesn't up to the message size %" PRId32 " %" PRId32, (int32_t)(currentPosition + *contentSize), messageSize);
+                result = __LINE__;
+            }
+            else
+            {
+                *contentPosition = currentPosition;
+                result = 0;
+            }
+        }
+    }
+    return result;
+}
+
+MESSAGE_HANDLE Message_CreateFromByteArrayNoCopy(const unsigned char* source, int32_t size, MESSAGE_BUFFER_FREE free_buffer, void* free_context)
+{
+    MESSAGE_HANDLE_DATA* result;
+    int32_t propertiesPosition;
+    int32_t propertiesCount;
+    int32_t contentPosition;
+    int32_t contentSize;
+
+    /*Codes_SRS_MESSAGE_30_001: [ If source is NULL or size is smaller than 14 then Message_CreateFromByteArrayNoCopy shall fail and return NULL. ]*/
+    if (
+        (source == NULL) ||
+        (size < MIN_MESSAGE_BUFFER_LENGTH)
+        )
+    {
+        LogError("invalid parameter source=[%p] size=%" PRId32, source, size);
+        result = NULL;
+    }
+    /*Codes_SRS_MESSAGE_30_002: [ Message_CreateFromByteArrayNoCopy shall validate source the same way Message_CreateFromByteArray does, without allocating memory, and shall fail and return NULL if it is not a valid serialization. ]*/
+    else if (parse_byte_array_layout(source, size, &propertiesPosition, &propertiesCount, &contentPosition, &contentSize) != 0)
+    {
+        LogError("byte array is not a valid gateway message serialization");
+        result = NULL;
+    }
+    else
+    {
+        /*Codes_SRS_MESSAGE_30_003: [ Message_CreateFromByteArrayNoCopy shall allocate the message and set its internal ref count to "1", it shall not copy the properties nor the content. ]*/
+        result = allocate_message_data(0);
+        if (result == NULL)
+        {
+            /*Codes_SRS_MESSAGE_30_004: [ If Message_CreateFromByteArrayNoCopy fails, it shall not call free_buffer. ]*/
+            LogError("malloc returned NULL");
+        }
+        else
+        {
+            init_message_data(result);
+            wrap_byte_array(result, source, size, propertiesPosition, propertiesCount, contentPosition, contentSize, free_buffer, free_context);
+        }
+    }
+    return (MESSAGE_HANDLE)result;
+}
+
+/*builds a CONSTMAP out of the properties of a wrapped byte array, the byte array has already been validated*/
+static CONSTMAP_HANDLE create_properties_from_byte_array(const MESSAGE_HANDLE_DATA* messageData)
+{
+    CONSTMAP_HANDLE result;
+    MAP_HANDLE map = Map_Create(NULL);
+    if (map == NULL)
+    {
+        LogError("failed to create a MAP_HANDLE");
+        result = NULL;
+    }
+    else
+    {
+        int32_t size = (int32_t)messageData->serialized_size;
+        int32_t currentPosition = messageData->properties_position;
+        int32_t parsed;
+        int32_t i;
+
+        for (i = 0; i < messageData->properties_count; i++)
+        {
+            const char* keyName;
+            const char* keyValue;
+            (void)parse_null_terminated_const_char(messageData->serialized, size, currentPosition, &parsed, &keyName);
+            currentPosition += parsed;
+            (void)parse_null_terminated_const_char(messageData->serialized, size, currentPosition, &parsed, &keyValue);
+            currentPosition += parsed;
+            if (Map_Add(map, keyName, keyValue) != MAP_OK)
+            {
+                LogError("Map_Add failed");
+                break;
+            }
+        }
+
+        if (i != messageData->properties_count)
+        {
+            result = NULL;
+        }
+        else
+        {
+            result = ConstMap_Create(map);
+            if (result == NULL)
+            {
+                LogError("ConstMap_Create failed");
+            }
+        }
+        Map_Destroy(map);
+    }
+    return result;
+}
+
+/*builds a CONSTMAP out of the properties of a compact message*/
+static CONSTMAP_HANDLE create_properties_from_index(const PROPERTY_INDEX* index)
+{
+    CONSTMAP_HANDLE result;
+    MAP_HANDLE map = Map_Create(NULL);
+    if (map == NULL)
+    {
+        LogError("failed to create a MAP_HANDLE");
+        result = NULL;
+    }
+    else
+    {
+        size_t i;
+        for (i = 0; i < index->count; i++)
+        {
+            if (Map_Add(map, index->keys[i], index->values[i]) != MAP_OK)
+            {
+                LogError("Map_Add failed");
+                break;
+            }
+        }
+
+        if (i != index->count)
+        {
+            result = NULL;
+        }
+        else
+        {
+            result = ConstMap_Create(map);
+            if (result == NULL)
+            {
+                LogError("ConstMap_Create failed");
+            }
+        }
+        Map_Destroy(map);
+    }
+    return result;
+}
+
+static CONSTMAP_HANDLE get_lazy_properties(MESSAGE_HANDLE_DATA* messageData)
+{
+    CONSTMAP_HANDLE result;
+    CONSTMAP_HANDLE properties = (CONSTMAP_HANDLE)ATOMIC_LOAD_PTR(&messageData->properties);
+    if (properties == NULL)
+    {
+        /*Codes_SRS_MESSAGE_30_009: [ If message wraps a byte array, the first call to Message_GetProperties shall build a CONSTMAP out of the properties in the byte array and keep it for the lifetime of the message. ]*/
+        /*Codes_SRS_MESSAGE_30_023: [ If message is compact, the first call to Message_GetProperties shall build a CONSTMAP out of its properties and keep it for the lifetime of the message. ]*/
+        properties = (messageData->storage == MESSAGE_STORAGE_BYTE_ARRAY) ?
+            create_properties_from_byte_array(messageData) :
+            create_properties_from_index(messageData->property_index);
+        if (properties != NULL)
+        {
+            CONSTMAP_HANDLE previous = (CONSTMAP_HANDLE)ATOMIC_COMPARE_EXCHANGE_PTR(&messageData->properties, properties, NULL);
+            if (previous != NULL)
+            {
+                /*another thread got there first, use its map*/
+                ConstMap_Destroy(properties);
+                properties = previous;
+            }
+        }
+    }
+
+    if (properties == NULL)
+    {
+        /*Codes_SRS_MESSAGE_30_007: [ If building the properties fails, Message_GetProperties shall return NULL. ]*/
+        LogError("unable to build the properties of the message");
+        result = NULL;
+    }
+    else
+    {
+        result = ConstMap_Clone(properties);
+    }
+    return result;
+}
+
+static CONSTBUFFER_HANDLE get_lazy_content_handle(MESSAGE_HANDLE_DATA* messageData)
+{
+    CONSTBUFFER_HANDLE result;
+    CONSTBUFFER_HANDLE content = (CONSTBUFFER_HANDLE)ATOMIC_LOAD_PTR(&messageData->content);
+    if (content == NULL)
+    {
+        /*Codes_SRS_MESSAGE_30_011: [ If message wraps a byte array, the first call to Message_GetContentHandle shall create a CONSTBUFFER from the content in the byte array and keep it for the lifetime of the message. ]*/
+        content = CONSTBUFFER_Create(messageData->content_view.buffer, messageData->content_view.size);
+        if (content != NULL)
+        {
+            CONSTBUFFER_HANDLE previous = (CONSTBUFFER_HANDLE)ATOMIC_COMPARE_EXCHANGE_PTR(&messageData->content, content, NULL);
+            if (previous != NULL)
+            {
+                CONSTBUFFER_Destroy(content);
+                content = previous;
+            }
+        }
+    }
+
+    if (content == NULL)
+    {
+        LogError("unable to create the content handle of the message");
+        result = NULL;
+    }
+    else
+    {
+        result = CONSTBUFFER_Clone(content);
+    }
+    return result;
+}
+
+/*builds the sorted index of the properties of a message made of handles or wrapping a byte array*/
+/*the index only points to the keys and values the message already has, or to the interned keys*/
+static PROPERTY_INDEX* create_property_index(const MESSAGE_HANDLE_DATA* messageData)
+{
+    PROPERTY_INDEX* result;
+    const char* const* keys = NULL;
+    const char* const* values = NULL;
+    size_t count;
+
+    if (messageData->storage == MESSAGE_STORAGE_BYTE_ARRAY)
+    {
+        count = (size_t)messageData->properties_count;
+    }
+    else if (ConstMap_GetInternals(messageData->properties, &keys, &values, &count) != CONSTMAP_OK)
+    {
+        LogError("failed to get the keys and values from the message properties");
+        count = SIZE_MAX;
+    }
+
+    if (count == SIZE_MAX)
+    {
+        result = NULL;
+    }
+    else
+    {
+        result = (PROPERTY_INDEX*)MessagePool_Allocate(PROPERTY_INDEX_SIZE(count));
+        if (result == NULL)
+        {
+            LogError("unable to allocate the property index");
+        }
+        else
+        {
+            size_t i;
+            int32_t size = (int32_t)messageData->serialized_size;
+            int32_t currentPosition = messageData->properties_position;
+            int32_t parsed;
+
+            (void)init_property_index(result, count);
+            for (i = 0; i < count; i++)
+            {
+                const char* key;
+                if (keys != NULL)
+                {
+                    key = keys[i];
+                    result->values[i] = values[i];
+                }
+                else
+                {
+                    /*the byte array has already been validated*/
+                    (void)parse_null_terminated_const_char(messageData->serialized, size, currentPosition, &parsed, &key);
+                    currentPosition += parsed;
+                    (void)parse_null_terminated_const_char(messageData->serialized, size, currentPosition, &parsed, &result->values[i]);
+                    currentPosition += parsed;
+                }
+                /*Codes_SRS_MESSAGE_30_028: [ The keys of the index shall be the interned keys whenever the key is interned. ]*/
+                result->keys[i] = PropertyKey_Find(key);
+                if (result->keys[i] == NULL)
+                {
+                    result->keys[i] = key;
+                }
+            }
+            sort_property_index(result);
+        }
+    }
+    return result;
+}
+
+static const PROPERTY_INDEX* get_property_index(MESSAGE_HANDLE_DATA* messageData)
+{
+    PROPERTY_INDEX* result = (PROPERTY_INDEX*)ATOMIC_LOAD_PTR(&messageData->property_index);
+    if (result == NULL)
+    {
+        /*Codes_SRS_MESSAGE_30_027: [ Unless message is compact, the first call to Message_GetProperty shall build a sorted index of the properties of the message and keep it for the lifetime of the message. ]*/
+        result = create_property_index(messageData);
+        if (result != NULL)
+        {
+            PROPERTY_INDEX* previous = (PROPERTY_INDEX*)ATOMIC_COMPARE_EXCHANGE_PTR(&messageData->property_index, result, NULL);
+            if (previous != NULL)
+            {
+                /*another thread got there first, use its index*/
+                MessagePool_Free(result);
+                result = previous;
+            }
+        }
+    }
+    return result;
+}
+
+const char* Message_GetProperty(MESSAGE_HANDLE message, const char* key)
+{
+    const char* result;
+    if (
+        (message == NULL) ||
+        (key == NULL)
+        )
+    {
+        /*Codes_SRS_MESSAGE_30_024: [ If message or key is NULL, Message_GetProperty shall return NULL. ]*/
+        LogError("invalid arg message=%p, key=%p", message, key);
+        result = NULL;
+    }
+    else
+    {
+        const PROPERTY_INDEX* index = get_property_index((MESSAGE_HANDLE_DATA*)message);
+        if (index == NULL)
+        {
+            /*Codes_SRS_MESSAGE_30_029: [ If building the index fails, Message_GetProperty shall return NULL. ]*/
+            LogError("unable to index the properties of the message");
+            result = NULL;
+        }
+        else
+        {
+            /*Codes_SRS_MESSAGE_30_025: [ Message_GetProperty shall return the value of the property called key, or NULL if the message has no such property. ]*/
+            /*Codes_SRS_MESSAGE_30_030: [ Message_GetProperty shall binary search the index, comparing key to the keys of the index by pointer before comparing the strings. ]*/
+            size_t low = 0;
+            size_t high = index->count;
+            result = NULL;
+            while (low < high)
+            {
+                size_t middle = low + (high - low) / 2;
+                int compare = (key == index->keys[middle]) ? 0 : strcmp(key, index->keys[middle]);
+                if (compare == 0)
+                {
+                    result = index->values[middle];
+                    break;
+                }
+                else if (compare < 0)
+                {
+                    high = middle;
+                }
+                else
+                {
+                    low = middle + 1;
+                }
+            }
+        }
+    }
+    return result;
+}
+
 extern int32_t Message_ToByteArray(MESSAGE_HANDLE messageHandle, unsigned char* buf, int32_t size)
 {
     int32_t result;
@@ -482,95 +1305,111 @@ extern int32_t Message_ToByteArray(MESSAGE_HANDLE messageHandle, unsigned char*
     else
     {
         MESSAGE_HANDLE_DATA* messageHandleData = (MESSAGE_HANDLE_DATA*)messageHandle;
+        int32_t knownSize = (int32_t)ATOMIC_LOAD(&messageHandleData->serialized_size);
 
-        /*Codes_SRS_MESSAGE_02_033: [Message_ToByteArray shall precompute the needed memory size.]*/
-        size_t byteArraySize =
-            + 2 /*header*/
-            + 4 /*total size of byte array*/
-            + 4 /*total number of properties*/
-            + 0 /*an unknown at this moment number of bytes for properties*/
-            + 4 /*number of bytes in messageContent*/
-            + 0 /*an unknown at this moment number of bytes for message content*/
-            ;
-        
-        const char* const * keys;
-        const char* const * values;
-        size_t nProperties;
-
-        /*Codes_SRS_MESSAGE_02_035: [ If any of the above steps fails then Message_ToByteArray shall fail and return -1. ]*/
-        if (ConstMap_GetInternals(messageHandleData->properties, &keys, &values, &nProperties) != CONSTMAP_OK)
-        {
-            LogError("failed to get the keys and values from the message properties");
-            result = -1;
-        }
-        else
+        if (messageHandleData->storage == MESSAGE_STORAGE_BYTE_ARRAY)
         {
-            size_t i;
-            for (i = 0;i < nProperties;i++)
+            if (size == 0)
             {
-                /*add to the needed size the name and value of property i*/
-                byteArraySize += (strlen(keys[i]) + 1) + (strlen(values[i]) + 1);
+                result = knownSize;
             }
-
-            const CONSTBUFFER* messageContent = CONSTBUFFER_GetContent(messageHandleData->content);
-            byteArraySize += messageContent->size;
-            
+            else if (knownSize > size)
+            {
+                LogError("message is %" PRId32 " bytes, won't fit in buffer of %" PRId32 " bytes", knownSize, size);
+                result = -1;
+            }
+            else
+            {
+                /*Codes_SRS_MESSAGE_30_012: [ If messageHandle wraps a byte array, Message_ToByteArray shall copy the byte array as is. ]*/
+                memcpy(buf, messageHandleData->serialized, knownSize);
+                result = knownSize;
+            }
+        }
+        else if (messageHandleData->storage == MESSAGE_STORAGE_COMPACT)
+        {
+            /*the size of a compact message is known from the start*/
             if (size == 0)
             {
-                /*Codes_SRS_MESSAGE_17_016: [ If buf is NULL and size is equal to zero, Message_ToByteArray shall return the needed memory size. ]*/
-                result = byteArraySize;
+                result = knownSize;
             }
-            else if (byteArraySize > (size_t)size)
+            else if (knownSize > size)
             {
-                /*Codes_SRS_MESSAGE_17_017: [ If buf is not NULL and size is less than the needed memory size, Message_ToByteArray shall return -1; ]*/
-                LogError("message is %u bytes, won't fit in buffer of %u bytes", byteArraySize, size);
+                LogError("message is %" PRId32 " bytes, won't fit in buffer of %" PRId32 " bytes", knownSize, size);
                 result = -1;
             }
             else
             {
-                /*Codes_SRS_MESSAGE_02_034: [ Message_ToByteArray shall populate the memory with values as indicated in the implementation details. ]*/
-
-                size_t currentPosition; /*always points to the byte we are about to write*/
-                /*a header formed of the following hex characters in this order: 0xA1 0x60*/
-                buf[0] = FIRST_MESSAGE_BYTE;
-                buf[1] = SECOND_MESSAGE_BYTE;
-                /*4 bytes in MSB order representing the total size of the byte array. */
-                buf[2] = byteArraySize >> 24;
-                buf[3] = (byteArraySize >> 16) & 0xFF;
-                buf[4] = (byteArraySize >> 8) & 0xFF;
-                buf[5] = (byteArraySize) & 0xFF;
-                /*4 bytes in MSB order representing the number of properties*/
-                buf[6] = nProperties >> 24;
-                buf[7] = (nProperties >> 16) & 0xFF;
-                buf[8] = (nProperties >> 8) & 0xFF;
-                buf[9] = nProperties & 0xFF;
-                /*for every property, 2 arrays of null terminated characters representing the name of the property and the value.*/
-                currentPosition = 10;
-                for (i = 0;i < nProperties;i++)
+                /*Codes_SRS_MESSAGE_30_031: [ If messageHandle is compact, Message_ToByteArray shall serialize its properties in key order, followed by its content. ]*/
+                const PROPERTY_INDEX* index = messageHandleData->property_index;
+                write_byte_array(buf, (size_t)knownSize, index->keys, index->values, index->count, messageHandleData->content_view.buffer, messageHandleData->content_view.size);
+                result = knownSize;
+            }
+        }
+        else if (
+            (knownSize != 0) &&
+            (size == 0)
+            )
+        {
+            /*Codes_SRS_MESSAGE_30_006: [ Once the needed memory size is known, Message_ToByteArray shall return it without looking at the properties and content again. ]*/
+            result = knownSize;
+        }
+        else if (
+            (knownSize != 0) &&
+            (knownSize > size)
+            )
+        {
+            /*Codes_SRS_MESSAGE_17_017: [ If buf is not NULL and size is less than the needed memory size, Message_ToByteArray shall return -1; ]*/
+            LogError("message is %" PRId32 " bytes, won't fit in buffer of %" PRId32 " bytes", knownSize, size);
+            result = -1;
+        }
+        else
+        {
+            /*Codes_SRS_MESSAGE_02_033: [Message_ToByteArray shall precompute the needed memory size.]*/
+            size_t byteArraySize;
+            const char* const * keys;
+            const char* const * values;
+            size_t nProperties;
+
+            /*Codes_SRS_MESSAGE_02_035: [ If any of the above steps fails then Message_ToByteArray shall fail and return -1. ]*/
+            if (ConstMap_GetInternals(messageHandleData->properties, &keys, &values, &nProperties) != CONSTMAP_OK)
+            {
+                LogError("failed to get the keys and values from the message properties");
+                result = -1;
+            }
+            else
+            {
+                const CONSTBUFFER* messageContent = CONSTBUFFER_GetContent(messageHandleData->content);
+                if (knownSize != 0)
                 {
-                    size_t nameLength = strlen(keys[i]) + 1;/*the +1 will take care of copying '\0' too*/
-                    size_t valueLength = strlen(values[i]) + 1;/*the +1 will take care of copying '\0' too*/
-
-                    /*copy name*/
-                    memcpy(buf + currentPosition, keys[i], nameLength);
-                    currentPosition += nameLength;
-                    
-                    /*copy value*/
-                    memcpy(buf + currentPosition, values[i], valueLength);
-                    currentPosition += valueLength;
+                    byteArraySize = (size_t)knownSize;
                 }
+                else
+                {
+                    byteArraySize = get_byte_array_size(keys, values, nProperties, messageContent->size);
 
-                /*4 bytes in MSB order representing the number of bytes in the message content array*/
-                buf[currentPosition++] = (messageContent->size) >> 24;
-                buf[currentPosition++] = ((messageContent->size) >> 16) & 0xFF;
-                buf[currentPosition++] = ((messageContent->size) >> 8) & 0xFF;
-                buf[currentPosition++] = (messageContent->size) & 0xFF;
+                    /*Codes_SRS_MESSAGE_30_005: [ Message_ToByteArray shall compute the needed memory size only once per message and remember it. ]*/
+                    (void)ATOMIC_COMPARE_EXCHANGE(&messageHandleData->serialized_size, (long)byteArraySize, 0);
+                }
 
-                /*n bytes of message content follows.*/
-                memcpy(buf + currentPosition, messageContent->buffer, messageContent->size);
+                if (size == 0)
+                {
+                    /*Codes_SRS_MESSAGE_17_016: [ If buf is NULL and size is equal to zero, Message_ToByteArray shall return the needed memory size. ]*/
+                    result = byteArraySize;
+                }
+                else if (byteArraySize > (size_t)size)
+                {
+                    /*Codes_SRS_MESSAGE_17_017: [ If buf is not NULL and size is less than the needed memory size, Message_ToByteArray shall return -1; ]*/
+                    LogError("message is %zu bytes, won't fit in buffer of %" PRId32 " bytes", byteArraySize, size);
+                    result = -1;
+                }
+                else
+                {
+                    /*Codes_SRS_MESSAGE_02_034: [ Message_ToByteArray shall populate the memory with values as indicated in the implementation details. ]*/
+                    write_byte_array(buf, byteArraySize, keys, values, nProperties, messageContent->buffer, messageContent->size);
 
-                /*Codes_SRS_MESSAGE_02_036: [ Otherwise Message_ToByteArray shall succeed, and return the byte array size. ]*/
-                result = byteArraySize;
+                    /*Codes_SRS_MESSAGE_02_036: [ Otherwise Message_ToByteArray shall succeed, and return the byte array size. ]*/
+                    result = byteArraySize;
+                }
             }
         }
     }
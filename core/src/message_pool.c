@@ -0,0 +1,533 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include "azure_c_shared_utility/gballoc.h"
+#include "azure_c_shared_utility/lock.h"
+#include "azure_c_shared_utility/xlogging.h"
+
+#include "message_pool.h"
+
+#if defined(_MSC_VER)
+#include <windows.h>
+#define THREAD_LOCAL __declspec(thread)
+#elif defined(__GNUC__)
+#include <pthread.h>
+#define THREAD_LOCAL __thread
+#else
+#error "message_pool.c: no thread local storage available for this compiler"
+#endif
+
+#define SMALLEST_BLOCK_SIZE 64
+#define SIZE_CLASS_COUNT 11 /*64 bytes, 128 bytes ... 64 KB*/
+#define UNPOOLED_CLASS SIZE_CLASS_COUNT /*blocks that go straight back to free*/
+
+/*every block starts with this header, the union keeps the data that follows it aligned*/
+typedef union BLOCK_HEADER_TAG
+{
+    struct
+    {
+        /*next free block, only meaningful while the block sits in a cache or in the depot*/
+        union BLOCK_HEADER_TAG* next;
+        size_t size_class;
+    } info;
+    long double align_long_double;
+    long long align_long_long;
+    void* align_pointer;
+} BLOCK_HEADER;
+
+typedef struct FREE_LIST_TAG
+{
+    BLOCK_HEADER* head;
+    size_t count;
+} FREE_LIST;
+
+/*a cache is only ever touched by the thread owning it, except by MessagePool_GetStatistics which only reads the counters*/
+typedef struct THREAD_CACHE_TAG
+{
+    FREE_LIST free_blocks[SIZE_CLASS_COUNT];
+    volatile long allocations;
+    volatile long hits;
+    volatile long misses;
+    volatile long oversized;
+    /*the caches of the running threads are chained so the last MessagePool_Disable can empty them*/
+    struct THREAD_CACHE_TAG* next;
+} THREAD_CACHE;
+
+static volatile int pool_enabled = 0;
+static size_t enable_count = 0;
+static size_t thread_cache_size;
+static size_t depot_size;
+/*guards depot, caches and exited_statistics*/
+static LOCK_HANDLE pool_lock = NULL;
+static FREE_LIST depot[SIZE_CLASS_COUNT];
+static THREAD_CACHE* caches = NULL;
+/*the counters of the caches of the threads that exited*/
+static MESSAGE_POOL_STATISTICS exited_statistics;
+/*bumped every time the pool is disabled for good, so threads stop using the cache they had*/
+static volatile long pool_generation = 1;
+
+static THREAD_LOCAL THREAD_CACHE* this_thread_cache = NULL;
+static THREAD_LOCAL long this_thread_generation = 0;
+
+static size_t size_class_of(size_t size)
+{
+    size_t result = 0;
+    while ((result < SIZE_CLASS_COUNT) && (((size_t)SMALLEST_BLOCK_SIZE << result) < size))
+    {
+        result++;
+    }
+    return result;
+}
+
+static void push_block(FREE_LIST* list, BLOCK_HEADER* block)
+{
+    block->info.next = list->head;
+    list->head = block;
+    list->count++;
+}
+
+static BLOCK_HEADER* pop_block(FREE_LIST* list)
+{
+    BLOCK_HEADER* result = list->head;
+    if (result != NULL)
+    {
+        list->head = result->info.next;
+        list->count--;
+    }
+    return result;
+}
+
+static void free_blocks(FREE_LIST* list)
+{
+    BLOCK_HEADER* block;
+    while ((block = pop_block(list)) != NULL)
+    {
+        free(block);
+    }
+}
+
+/*runs on the exit of a thread that has a cache: the blocks of the cache go to
+  the depot, those that do not fit in there are freed, and its counters are
+  kept for the statistics*/
+static void release_thread_cache(THREAD_CACHE* cache)
+{
+    if (this_thread_cache == cache)
+    {
+        this_thread_cache = NULL;
+    }
+
+    /*the last MessagePool_Disable empties the caches itself*/
+    if (pool_enabled)
+    {
+        if (Lock(pool_lock) != LOCK_OK)
+        {
+            LogError("unable to Lock");
+        }
+        else
+        {
+            THREAD_CACHE** link = &caches;
+            while ((*link != NULL) && (*link != cache))
+            {
+                link = &((*link)->next);
+            }
+            /*a cache that is not chained belongs to a pool disabled since*/
+            if (*link != NULL)
+            {
+                /*Codes_SRS_MESSAGE_POOL_30_018: [ When a thread that has a cache exits, the pool shall move the blocks of its cache to the depot, free those that do not fit, keep the counters of the cache for the statistics and free the cache. ]*/
+                size_t i;
+                *link = cache->next;
+                for (i = 0; i < SIZE_CLASS_COUNT; i++)
+                {
+                    BLOCK_HEADER* block;
+                    while ((block = pop_block(&cache->free_blocks[i])) != NULL)
+                    {
+                        if (depot[i].count < depot_size)
+                        {
+                            push_block(&depot[i], block);
+                        }
+                        else
+                        {
+                            free(block);
+                        }
+                    }
+                }
+                exited_statistics.allocations += cache->allocations;
+                exited_statistics.hits += cache->hits;
+                exited_statistics.misses += cache->misses;
+                exited_statistics.oversized += cache->oversized;
+                free(cache);
+            }
+            (void)Unlock(pool_lock);
+        }
+    }
+}
+
+/*the thread exit callback calling release_thread_cache, a pthread key
+  destructor or a fiber local storage callback*/
+#if defined(_MSC_VER)
+static DWORD thread_exit_key = FLS_OUT_OF_INDEXES;
+
+static VOID WINAPI on_thread_exit(PVOID value)
+{
+    release_thread_cache((THREAD_CACHE*)value);
+}
+
+static int thread_exit_key_create(void)
+{
+    thread_exit_key = FlsAlloc(on_thread_exit);
+    return (thread_exit_key == FLS_OUT_OF_INDEXES) ? __LINE__ : 0;
+}
+
+static void thread_exit_key_delete(void)
+{
+    (void)FlsFree(thread_exit_key);
+    thread_exit_key = FLS_OUT_OF_INDEXES;
+}
+
+static void thread_exit_key_set(THREAD_CACHE* cache)
+{
+    if (!FlsSetValue(thread_exit_key, cache))
+    {
+        LogError("unable to register the thread cache for the exit of the thread");
+    }
+}
+#else
+static pthread_key_t thread_exit_key;
+
+static void on_thread_exit(void* value)
+{
+    release_thread_cache((THREAD_CACHE*)value);
+}
+
+static int thread_exit_key_create(void)
+{
+    return (pthread_key_create(&thread_exit_key, on_thread_exit) != 0) ? __LINE__ : 0;
+}
+
+static void thread_exit_key_delete(void)
+{
+    (void)pthread_key_delete(thread_exit_key);
+}
+
+static void thread_exit_key_set(THREAD_CACHE* cache)
+{
+    if (pthread_setspecific(thread_exit_key, cache) != 0)
+    {
+        LogError("unable to register the thread cache for the exit of the thread");
+    }
+}
+#endif
+
+static THREAD_CACHE* get_thread_cache(void)
+{
+    THREAD_CACHE* result;
+    if ((this_thread_cache != NULL) && (this_thread_generation == pool_generation))
+    {
+        result = this_thread_cache;
+    }
+    else
+    {
+        result = (THREAD_CACHE*)malloc(sizeof(THREAD_CACHE));
+        if (result == NULL)
+        {
+            LogError("unable to allocate a thread cache");
+        }
+        else
+        {
+            memset(result, 0, sizeof(THREAD_CACHE));
+            if (Lock(pool_lock) != LOCK_OK)
+            {
+                LogError("unable to Lock");
+                free(result);
+                result = NULL;
+            }
+            else
+            {
+                result->next = caches;
+                caches = result;
+                (void)Unlock(pool_lock);
+
+                this_thread_cache = result;
+                this_thread_generation = pool_generation;
+                thread_exit_key_set(result);
+            }
+        }
+    }
+    return result;
+}
+
+/*moves up to half a cache worth of blocks from the depot to the thread cache*/
+static void refill_from_depot(THREAD_CACHE* cache, size_t size_class)
+{
+    if (Lock(pool_lock) != LOCK_OK)
+    {
+        LogError("unable to Lock");
+    }
+    else
+    {
+        size_t wanted = (thread_cache_size + 1) / 2;
+        BLOCK_HEADER* block;
+        while ((wanted > 0) && ((block = pop_block(&depot[size_class])) != NULL))
+        {
+            push_block(&cache->free_blocks[size_class], block);
+            wanted--;
+        }
+        (void)Unlock(pool_lock);
+    }
+}
+
+/*moves half of a full thread cache to the depot, blocks that do not fit in there are freed*/
+static void flush_to_depot(THREAD_CACHE* cache, size_t size_class)
+{
+    size_t count = (thread_cache_size + 1) / 2;
+    if (Lock(pool_lock) != LOCK_OK)
+    {
+        LogError("unable to Lock");
+        while (count-- > 0)
+        {
+            free(pop_block(&cache->free_blocks[size_class]));
+        }
+    }
+    else
+    {
+        while (count-- > 0)
+        {
+            BLOCK_HEADER* block = pop_block(&cache->free_blocks[size_class]);
+            if (depot[size_class].count < depot_size)
+            {
+                push_block(&depot[size_class], block);
+            }
+            else
+            {
+                free(block);
+            }
+        }
+        (void)Unlock(pool_lock);
+    }
+}
+
+int MessagePool_Enable(const MESSAGE_POOL_CONFIG* config)
+{
+    int result;
+    if (config == NULL)
+    {
+        /*Codes_SRS_MESSAGE_POOL_30_001: [ If config is NULL, MessagePool_Enable shall fail and return a non-zero value. ]*/
+        LogError("invalid arg: config is NULL");
+        result = __LINE__;
+    }
+    else if (enable_count > 0)
+    {
+        /*Codes_SRS_MESSAGE_POOL_30_003: [ If the pool is already enabled, MessagePool_Enable shall only count the call and return 0. ]*/
+        enable_count++;
+        result = 0;
+    }
+    else
+    {
+        /*Codes_SRS_MESSAGE_POOL_30_002: [ MessagePool_Enable shall create the lock guarding the shared depot and enable the pool with the sizes in config, using the defaults for the ones that are 0. ]*/
+        pool_lock = Lock_Init();
+        if (pool_lock == NULL)
+        {
+            /*Codes_SRS_MESSAGE_POOL_30_004: [ If creating the lock fails, MessagePool_Enable shall fail and return a non-zero value. ]*/
+            LogError("Lock_Init failed");
+            result = __LINE__;
+        }
+        /*Codes_SRS_MESSAGE_POOL_30_017: [ MessagePool_Enable shall register a callback for the exit of the threads, and fail and return a non-zero value if that fails. ]*/
+        else if (thread_exit_key_create() != 0)
+        {
+            LogError("unable to register a callback for the exit of the threads");
+            Lock_Deinit(pool_lock);
+            pool_lock = NULL;
+            result = __LINE__;
+        }
+        else
+        {
+            thread_cache_size = (config->thread_cache_size == 0) ? MESSAGE_POOL_DEFAULT_THREAD_CACHE_SIZE : config->thread_cache_size;
+            depot_size = (config->depot_size == 0) ? MESSAGE_POOL_DEFAULT_DEPOT_SIZE : config->depot_size;
+            memset(depot, 0, sizeof(depot));
+            memset(&exited_statistics, 0, sizeof(exited_statistics));
+            caches = NULL;
+            enable_count = 1;
+            pool_enabled = 1;
+            result = 0;
+        }
+    }
+    return result;
+}
+
+void MessagePool_Disable(void)
+{
+    if (enable_count == 0)
+    {
+        /*Codes_SRS_MESSAGE_POOL_30_005: [ If the pool is not enabled, MessagePool_Disable shall do nothing. ]*/
+        LogError("the message pool is not enabled");
+    }
+    else if (--enable_count == 0)
+    {
+        MESSAGE_POOL_STATISTICS statistics;
+        size_t i;
+
+        /*Codes_SRS_MESSAGE_POOL_30_006: [ When the last enable is undone, MessagePool_Disable shall log the statistics of the pool, free every block in the depot and in the thread caches, free the caches and destroy the lock. ]*/
+        if ((MessagePool_GetStatistics(&statistics) == 0) && (statistics.allocations > 0))
+        {
+            LogInfo("message pool: %lu allocations, %lu hits (%lu%%), %lu misses, %lu oversized",
+                (unsigned long)statistics.allocations,
+                (unsigned long)statistics.hits,
+                (unsigned long)(statistics.hits * 100 / statistics.allocations),
+                (unsigned long)statistics.misses,
+                (unsigned long)statistics.oversized);
+        }
+
+        pool_enabled = 0;
+        thread_exit_key_delete();
+        for (i = 0; i < SIZE_CLASS_COUNT; i++)
+        {
+            free_blocks(&depot[i]);
+        }
+        while (caches != NULL)
+        {
+            THREAD_CACHE* cache = caches;
+            caches = cache->next;
+            for (i = 0; i < SIZE_CLASS_COUNT; i++)
+            {
+                free_blocks(&cache->free_blocks[i]);
+            }
+            free(cache);
+        }
+        pool_generation++;
+        Lock_Deinit(pool_lock);
+        pool_lock = NULL;
+    }
+}
+
+int MessagePool_IsEnabled(void)
+{
+    return pool_enabled;
+}
+
+int MessagePool_GetStatistics(MESSAGE_POOL_STATISTICS* statistics)
+{
+    int result;
+    if (statistics == NULL)
+    {
+        /*Codes_SRS_MESSAGE_POOL_30_007: [ If statistics is NULL, MessagePool_GetStatistics shall fail and return a non-zero value. ]*/
+        LogError("invalid arg: statistics is NULL");
+        result = __LINE__;
+    }
+    else
+    {
+        memset(statistics, 0, sizeof(MESSAGE_POOL_STATISTICS));
+        if (!pool_enabled)
+        {
+            /*Codes_SRS_MESSAGE_POOL_30_008: [ If the pool is not enabled, MessagePool_GetStatistics shall report zeros and return 0. ]*/
+            result = 0;
+        }
+        else if (Lock(pool_lock) != LOCK_OK)
+        {
+            LogError("unable to Lock");
+            result = __LINE__;
+        }
+        else
+        {
+            /*Codes_SRS_MESSAGE_POOL_30_009: [ MessagePool_GetStatistics shall add up the counters of every thread cache, including the caches of the threads that exited, and return 0. ]*/
+            THREAD_CACHE* cache;
+            *statistics = exited_statistics;
+            for (cache = caches; cache != NULL; cache = cache->next)
+            {
+                statistics->allocations += cache->allocations;
+                statistics->hits += cache->hits;
+                statistics->misses += cache->misses;
+                statistics->oversized += cache->oversized;
+            }
+            (void)Unlock(pool_lock);
+            result = 0;
+        }
+    }
+    return result;
+}
+
+void* MessagePool_Allocate(size_t size)
+{
+    void* result;
+    BLOCK_HEADER* block;
+    size_t size_class = size_class_of(size);
+    THREAD_CACHE* cache = pool_enabled ? get_thread_cache() : NULL;
+
+    if (cache == NULL)
+    {
+        /*Codes_SRS_MESSAGE_POOL_30_010: [ If the pool is not enabled, MessagePool_Allocate shall allocate the block with malloc. ]*/
+        block = (BLOCK_HEADER*)malloc(sizeof(BLOCK_HEADER) + size);
+        size_class = UNPOOLED_CLASS;
+    }
+    else
+    {
+        cache->allocations++;
+        if (size_class == UNPOOLED_CLASS)
+        {
+            /*Codes_SRS_MESSAGE_POOL_30_011: [ If size is bigger than MESSAGE_POOL_MAX_BLOCK_SIZE, MessagePool_Allocate shall allocate the block with malloc and count it as an oversized miss. ]*/
+            cache->misses++;
+            cache->oversized++;
+            block = (BLOCK_HEADER*)malloc(sizeof(BLOCK_HEADER) + size);
+        }
+        else
+        {
+            /*Codes_SRS_MESSAGE_POOL_30_012: [ MessagePool_Allocate shall take a free block of the smallest size class that fits size from the thread cache, refilling the cache from the depot when it is empty, and count it as a hit. ]*/
+            if (cache->free_blocks[size_class].head == NULL)
+            {
+                refill_from_depot(cache, size_class);
+            }
+
+            block = pop_block(&cache->free_blocks[size_class]);
+            if (block != NULL)
+            {
+                cache->hits++;
+            }
+            else
+            {
+                /*Codes_SRS_MESSAGE_POOL_30_013: [ If there is no free block of that size class, MessagePool_Allocate shall allocate one with malloc and count it as a miss. ]*/
+                cache->misses++;
+                block = (BLOCK_HEADER*)malloc(sizeof(BLOCK_HEADER) + ((size_t)SMALLEST_BLOCK_SIZE << size_class));
+            }
+        }
+    }
+
+    if (block == NULL)
+    {
+        /*Codes_SRS_MESSAGE_POOL_30_014: [ If allocating the block fails, MessagePool_Allocate shall return NULL. ]*/
+        LogError("unable to allocate a block of %lu bytes", (unsigned long)size);
+        result = NULL;
+    }
+    else
+    {
+        block->info.size_class = size_class;
+        result = block + 1;
+    }
+    return result;
+}
+
+void MessagePool_Free(void* block)
+{
+    if (block != NULL)
+    {
+        BLOCK_HEADER* header = (BLOCK_HEADER*)block - 1;
+        size_t size_class = header->info.size_class;
+        THREAD_CACHE* cache = ((size_class != UNPOOLED_CLASS) && pool_enabled) ? get_thread_cache() : NULL;
+
+        if (cache == NULL)
+        {
+            /*Codes_SRS_MESSAGE_POOL_30_015: [ If the block was not pooled or the pool is not enabled anymore, MessagePool_Free shall free the block. ]*/
+            free(header);
+        }
+        else
+        {
+            /*Codes_SRS_MESSAGE_POOL_30_016: [ Otherwise MessagePool_Free shall put the block in the thread cache, moving half of the cache to the depot first when it is full. ]*/
+            if (cache->free_blocks[size_class].count >= thread_cache_size)
+            {
+                flush_to_depot(cache, size_class);
+            }
+            push_block(&cache->free_blocks[size_class], header);
+        }
+    }
+}
@@ -0,0 +1,175 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include "azure_c_shared_utility/xlogging.h"
+
+#include "property_key.h"
+#include "internal/atomics.h"
+
+/*keys used by the modules shipped with the gateway, sorted as strcmp does*/
+static const char* const well_known_keys[] =
+{
+    "bleControllerIndex",
+    "characteristicUUID",
+    "deviceId",
+    "deviceKey",
+    "deviceName",
+    "macAddress",
+    "source",
+    "timestamp"
+};
+
+#define WELL_KNOWN_KEY_COUNT (sizeof(well_known_keys) / sizeof(well_known_keys[0]))
+
+/*open addressing table of the keys interned at run time, twice as big as it can ever get so probes stay short*/
+#define INTERNED_SLOT_COUNT (2 * PROPERTY_KEY_MAX_INTERNED)
+#define KEY_STORAGE_SIZE (PROPERTY_KEY_MAX_LENGTH + 1)
+
+/*a slot is written once, from NULL to a key in key_storage, and never changes after that*/
+static const char* volatile interned_slots[INTERNED_SLOT_COUNT];
+static char key_storage[PROPERTY_KEY_MAX_INTERNED][KEY_STORAGE_SIZE];
+static volatile long used_key_storage = 0;
+
+static const char* find_well_known_key(const char* key)
+{
+    const char* result = NULL;
+    size_t low = 0;
+    size_t high = WELL_KNOWN_KEY_COUNT;
+    while (low < high)
+    {
+        size_t middle = low + (high - low) / 2;
+        int compare = strcmp(key, well_known_keys[middle]);
+        if (compare == 0)
+        {
+            result = well_known_keys[middle];
+            break;
+        }
+        else if (compare < 0)
+        {
+            high = middle;
+        }
+        else
+        {
+            low = middle + 1;
+        }
+    }
+    return result;
+}
+
+/*FNV-1a*/
+static size_t hash_key(const char* key)
+{
+    unsigned long hash = 2166136261UL;
+    while (*key != '\0')
+    {
+        hash ^= (unsigned char)*key++;
+        hash = (hash * 16777619UL) & 0xFFFFFFFFUL;
+    }
+    return (size_t)hash;
+}
+
+/*returns the interned copy of key, interning it first if add is true and there is room for it*/
+static const char* find_interned_key(const char* key, int add)
+{
+    const char* result = NULL;
+    char* copy = NULL;
+    size_t slot = hash_key(key) % INTERNED_SLOT_COUNT;
+    size_t probes;
+
+    for (probes = 0; probes < INTERNED_SLOT_COUNT; probes++)
+    {
+        const char* interned = (const char*)ATOMIC_LOAD_PTR(&interned_slots[slot]);
+        if (interned == NULL)
+        {
+            if (!add)
+            {
+                break;
+            }
+
+            if (copy == NULL)
+            {
+                /*the load keeps a full table from counting up forever*/
+                long index = (ATOMIC_LOAD(&used_key_storage) >= PROPERTY_KEY_MAX_INTERNED) ? PROPERTY_KEY_MAX_INTERNED : ATOMIC_INC(&used_key_storage) - 1;
+                if (index >= PROPERTY_KEY_MAX_INTERNED)
+                {
+                    LogError("no room left to intern property key %s", key);
+                    break;
+                }
+                copy = key_storage[index];
+                (void)strcpy(copy, key);
+            }
+
+            interned = (const char*)ATOMIC_COMPARE_EXCHANGE_PTR(&interned_slots[slot], copy, NULL);
+            if (interned == NULL)
+            {
+                result = copy;
+                break;
+            }
+            /*another thread took the slot first, it might have interned the very same key*/
+        }
+
+        if (strcmp(interned, key) == 0)
+        {
+            /*if a copy was made it is wasted, that only happens when two threads intern the same key at the same time*/
+            result = interned;
+            break;
+        }
+        slot = (slot + 1) % INTERNED_SLOT_COUNT;
+    }
+    return result;
+}
+
+const char* PropertyKey_Intern(const char* key)
+{
+    const char* result;
+    if (key == NULL)
+    {
+        /*Codes_SRS_PROPERTY_KEY_30_001: [ If key is NULL, PropertyKey_Intern shall fail and return NULL. ]*/
+        LogError("invalid (NULL) key");
+        result = NULL;
+    }
+    else
+    {
+        /*Codes_SRS_PROPERTY_KEY_30_002: [ If key is one of the well-known keys, PropertyKey_Intern shall return the canonical pointer of that key. ]*/
+        result = find_well_known_key(key);
+        if (result == NULL)
+        {
+            if (strlen(key) > PROPERTY_KEY_MAX_LENGTH)
+            {
+                /*Codes_SRS_PROPERTY_KEY_30_004: [ If key is longer than PROPERTY_KEY_MAX_LENGTH, or if PROPERTY_KEY_MAX_INTERNED keys have already been interned, PropertyKey_Intern shall fail and return NULL. ]*/
+                LogError("property key %s is too long to be interned", key);
+            }
+            else
+            {
+                /*Codes_SRS_PROPERTY_KEY_30_003: [ Otherwise PropertyKey_Intern shall return the pointer to the copy of key made by the first call interning it, making that copy if there is none. ]*/
+                /*Codes_SRS_PROPERTY_KEY_30_004: [ If key is longer than PROPERTY_KEY_MAX_LENGTH, or if PROPERTY_KEY_MAX_INTERNED keys have already been interned, PropertyKey_Intern shall fail and return NULL. ]*/
+                result = find_interned_key(key, 1);
+            }
+        }
+    }
+    return result;
+}
+
+const char* PropertyKey_Find(const char* key)
+{
+    const char* result;
+    if (key == NULL)
+    {
+        /*Codes_SRS_PROPERTY_KEY_30_005: [ If key is NULL, PropertyKey_Find shall return NULL. ]*/
+        LogError("invalid (NULL) key");
+        result = NULL;
+    }
+    else
+    {
+        /*Codes_SRS_PROPERTY_KEY_30_006: [ PropertyKey_Find shall return the canonical pointer of key if key is interned, and NULL otherwise. ]*/
+        result = find_well_known_key(key);
+        if (result == NULL)
+        {
+            result = find_interned_key(key, 0);
+        }
+    }
+    return result;
+}
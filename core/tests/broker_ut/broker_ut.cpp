@@ -3,11 +3,16 @@
 
 #include <cstdlib>
 #include <cstddef>
+#include <cstdint>
 #include <cstdbool>
+#include <atomic>
+#include <functional>
+#include <thread>
 #include "testrunnerswitcher.h"
 #include "micromock.h"
 #include "micromockcharstararenullterminatedstrings.h"
 #include "azure_c_shared_utility/lock.h"
+#include "azure_c_shared_utility/condition.h"
 #include "azure_c_shared_utility/vector.h"
 #include "azure_c_shared_utility/singlylinkedlist.h"
 #include "message.h"
@@ -87,6 +92,14 @@ static size_t whenShallCond_Post_fail;
 
 static size_t currentThreadAPI_Create_call;
 static size_t whenShallThreadAPI_Create_fail;
+static size_t currentThreadAPI_Join_call;
+
+static size_t currentMessage_CreateFromByteArrayNoCopy_call;
+static size_t whenShallMessage_CreateFromByteArrayNoCopy_fail;
+
+/*the only message with a property, Message_GetProperty returns its value for any key*/
+static MESSAGE_HANDLE fake_property_message;
+static const char* fake_property_value;
 
 static size_t nn_current_msg_size;
 
@@ -113,6 +126,14 @@ static void* nn_socket_memory[10];
 static THREAD_START_FUNC thread_func_to_call;
 static void* thread_func_args;
 
+/*once set, every Lock fails, which stops a zero-copy worker the test runs on
+  a thread of its own*/
+static std::atomic<bool> shallLock_fail_always;
+
+/*run by the next Message_Clone only, while the publisher is between looking
+  up its sinks and queuing the clone*/
+static std::function<void()> on_Message_Clone;
+
 struct FakeModule_Receive_Call_Status
 {
     MODULE_HANDLE module;
@@ -121,6 +142,11 @@ struct FakeModule_Receive_Call_Status
 };
 static FakeModule_Receive_Call_Status call_status_for_FakeModule_Receive;
 
+/*messages handed to FakeModule_Receive, in order*/
+#define FAKE_RECEIVED_MAX 32
+static MESSAGE_HANDLE fake_received[FAKE_RECEIVED_MAX];
+static size_t fake_received_count;
+
 static MODULE_HANDLE fake_module_handle = (MODULE_HANDLE)0x42;
 
 static MODULE_HANDLE FakeModule_Create(BROKER_HANDLE broker, const void* configuration)
@@ -136,6 +162,11 @@ static void FakeModule_Receive(MODULE_HANDLE module, MESSAGE_HANDLE messageHandl
 {
     call_status_for_FakeModule_Receive.was_called = true;
     ASSERT_ARE_EQUAL(void_ptr, module, call_status_for_FakeModule_Receive.module);
+    if (fake_received_count < FAKE_RECEIVED_MAX)
+    {
+        fake_received[fake_received_count] = messageHandle;
+    }
+    fake_received_count++;
 }
 
 static MODULE_API_1 fake_module_apis =
@@ -155,6 +186,39 @@ MODULE fake_module =
     fake_module_handle
 };
 
+static size_t fake_batch_call_count;
+static size_t fake_batch_message_count;
+
+static void FakeModule_ReceiveBatch(MODULE_HANDLE module, MESSAGE_HANDLE* messageHandles, size_t messageCount)
+{
+    ASSERT_IS_NOT_NULL(messageHandles);
+    fake_batch_call_count++;
+    fake_batch_message_count += messageCount;
+}
+
+static MODULE_API_2 fake_batch_module_apis =
+{
+    { MODULE_API_VERSION_2 },
+    NULL,
+    NULL,
+    FakeModule_Create,
+    FakeModule_Destroy,
+    FakeModule_Receive,
+    NULL,
+    FakeModule_ReceiveBatch
+};
+
+static MODULE_HANDLE fake_batch_module_handle = (MODULE_HANDLE)0x43;
+
+/*never attached to a broker*/
+static MODULE_HANDLE unknown_module_handle = (MODULE_HANDLE)0x44;
+
+MODULE fake_batch_module =
+{
+    (const MODULE_API *)&fake_batch_module_apis,
+    fake_batch_module_handle
+};
+
 class RefCountObject
 {
 private:
@@ -217,8 +281,9 @@ public:
     MOCK_STATIC_METHOD_1(, LOCK_RESULT, Lock, LOCK_HANDLE, lock)
         LOCK_RESULT result2;
         ++currentLock_call;
-        if ((whenShallLock_fail > 0) &&
-            (currentLock_call == whenShallLock_fail))
+        if (shallLock_fail_always ||
+            ((whenShallLock_fail > 0) &&
+            (currentLock_call == whenShallLock_fail)))
         {
             result2 = LOCK_ERROR;
         }
@@ -239,6 +304,33 @@ public:
         auto result2 = LOCK_OK;
     MOCK_METHOD_END(LOCK_RESULT, result2)
 
+    MOCK_STATIC_METHOD_0(, COND_HANDLE, Condition_Init)
+        COND_HANDLE result2;
+        ++currentCond_Init_call;
+        if ((whenShallCond_Init_fail > 0) &&
+            (currentCond_Init_call == whenShallCond_Init_fail))
+        {
+            result2 = NULL;
+        }
+        else
+        {
+            result2 = (COND_HANDLE)malloc(1);
+        }
+    MOCK_METHOD_END(COND_HANDLE, result2)
+
+    MOCK_STATIC_METHOD_1(, COND_RESULT, Condition_Post, COND_HANDLE, handle)
+        ++currentCond_Post_call;
+        auto result2 = COND_OK;
+    MOCK_METHOD_END(COND_RESULT, result2)
+
+    MOCK_STATIC_METHOD_3(, COND_RESULT, Condition_Wait, COND_HANDLE, handle, LOCK_HANDLE, lock, int, timeout_milliseconds)
+        auto result2 = COND_OK;
+    MOCK_METHOD_END(COND_RESULT, result2)
+
+    MOCK_STATIC_METHOD_1(, void, Condition_Deinit, COND_HANDLE, handle)
+        free(handle);
+    MOCK_VOID_METHOD_END()
+
     MOCK_STATIC_METHOD_1(, VECTOR_HANDLE, VECTOR_create, size_t, elementSize)
         VECTOR_HANDLE result2;
         ++currentVECTOR_create_call;
@@ -324,15 +416,25 @@ public:
     MOCK_METHOD_END(THREADAPI_RESULT, result2)
 
     MOCK_STATIC_METHOD_2(, THREADAPI_RESULT, ThreadAPI_Join, THREAD_HANDLE, threadHandle, int*, res)
+        ++currentThreadAPI_Join_call;
         free(threadHandle);
         auto result2 = THREADAPI_OK;
     MOCK_METHOD_END(THREADAPI_RESULT, result2)
 
+    MOCK_STATIC_METHOD_1(, void, ThreadAPI_Sleep, unsigned int, milliseconds)
+    MOCK_VOID_METHOD_END()
+
     MOCK_STATIC_METHOD_1(, MESSAGE_HANDLE, Message_Create, const MESSAGE_CONFIG*, cfg)
         MESSAGE_HANDLE result2 = (MESSAGE_HANDLE)(new RefCountObject());
     MOCK_METHOD_END(MESSAGE_HANDLE, result2)
 
     MOCK_STATIC_METHOD_1(, MESSAGE_HANDLE, Message_Clone, MESSAGE_HANDLE, message)
+        if (on_Message_Clone)
+        {
+            std::function<void()> hook = on_Message_Clone;
+            on_Message_Clone = nullptr;
+            hook();
+        }
         ((RefCountObject*)message)->inc_ref();
     MOCK_METHOD_END(MESSAGE_HANDLE, message)
 
@@ -343,9 +445,34 @@ public:
     MOCK_STATIC_METHOD_2(, MESSAGE_HANDLE, Message_CreateFromByteArray, const unsigned char*, source, int32_t, size)
     MOCK_METHOD_END(MESSAGE_HANDLE, (MESSAGE_HANDLE)(new RefCountObject()))
 
+    MOCK_STATIC_METHOD_4(, MESSAGE_HANDLE, Message_CreateFromByteArrayNoCopy, const unsigned char*, source, int32_t, size, MESSAGE_BUFFER_FREE, free_buffer, void*, free_context)
+        MESSAGE_HANDLE result2;
+        currentMessage_CreateFromByteArrayNoCopy_call++;
+        if ((whenShallMessage_CreateFromByteArrayNoCopy_fail > 0) &&
+            (currentMessage_CreateFromByteArrayNoCopy_call == whenShallMessage_CreateFromByteArrayNoCopy_fail))
+        {
+            /*on failure the buffer stays with the caller*/
+            result2 = NULL;
+        }
+        else
+        {
+            /*the fake message does not keep the buffer around, release it right away*/
+            free_buffer(free_context);
+            result2 = (MESSAGE_HANDLE)(new RefCountObject());
+        }
+    MOCK_METHOD_END(MESSAGE_HANDLE, result2)
+
     MOCK_STATIC_METHOD_3(, int32_t, Message_ToByteArray, MESSAGE_HANDLE, messageHandle, unsigned char *, buffer, int32_t, size)
     MOCK_METHOD_END(int32_t, (int32_t)1)
 
+    MOCK_STATIC_METHOD_2(, const char*, Message_GetProperty, MESSAGE_HANDLE, message, const char*, key)
+    MOCK_METHOD_END(const char*, (message == fake_property_message) ? fake_property_value : NULL)
+
+    // property_key.h
+
+    MOCK_STATIC_METHOD_1(, const char*, PropertyKey_Intern, const char*, key)
+    MOCK_METHOD_END(const char*, key)
+
     // list.h
 
     MOCK_STATIC_METHOD_0(, SINGLYLINKEDLIST_HANDLE, singlylinkedlist_create)
@@ -579,6 +706,11 @@ DECLARE_GLOBAL_MOCK_METHOD_1(CBrokerMocks, , LOCK_RESULT, Lock, LOCK_HANDLE, loc
 DECLARE_GLOBAL_MOCK_METHOD_1(CBrokerMocks, , LOCK_RESULT, Unlock, LOCK_HANDLE, lock);
 DECLARE_GLOBAL_MOCK_METHOD_1(CBrokerMocks, , LOCK_RESULT, Lock_Deinit, LOCK_HANDLE, lock);
 
+DECLARE_GLOBAL_MOCK_METHOD_0(CBrokerMocks, , COND_HANDLE, Condition_Init);
+DECLARE_GLOBAL_MOCK_METHOD_1(CBrokerMocks, , COND_RESULT, Condition_Post, COND_HANDLE, handle);
+DECLARE_GLOBAL_MOCK_METHOD_3(CBrokerMocks, , COND_RESULT, Condition_Wait, COND_HANDLE, handle, LOCK_HANDLE, lock, int, timeout_milliseconds);
+DECLARE_GLOBAL_MOCK_METHOD_1(CBrokerMocks, , void, Condition_Deinit, COND_HANDLE, handle);
+
 DECLARE_GLOBAL_MOCK_METHOD_1(CBrokerMocks, , VECTOR_HANDLE, VECTOR_create, size_t, elementSize);
 DECLARE_GLOBAL_MOCK_METHOD_1(CBrokerMocks, , void, VECTOR_destroy, VECTOR_HANDLE, vector);
 DECLARE_GLOBAL_MOCK_METHOD_3(CBrokerMocks, , int, VECTOR_push_back, VECTOR_HANDLE, vector, const void*, elements, size_t, numElements);
@@ -591,12 +723,18 @@ DECLARE_GLOBAL_MOCK_METHOD_1(CBrokerMocks, , size_t, VECTOR_size, VECTOR_HANDLE,
 
 DECLARE_GLOBAL_MOCK_METHOD_3(CBrokerMocks, , THREADAPI_RESULT, ThreadAPI_Create, THREAD_HANDLE*, threadHandle, THREAD_START_FUNC, func, void*, arg);
 DECLARE_GLOBAL_MOCK_METHOD_2(CBrokerMocks, , THREADAPI_RESULT, ThreadAPI_Join, THREAD_HANDLE, threadHandle, int*, res);
+DECLARE_GLOBAL_MOCK_METHOD_1(CBrokerMocks, , void, ThreadAPI_Sleep, unsigned int, milliseconds);
 
 DECLARE_GLOBAL_MOCK_METHOD_1(CBrokerMocks, , MESSAGE_HANDLE, Message_Create, const MESSAGE_CONFIG*, cfg);
 DECLARE_GLOBAL_MOCK_METHOD_1(CBrokerMocks, , MESSAGE_HANDLE, Message_Clone, MESSAGE_HANDLE, message);
 DECLARE_GLOBAL_MOCK_METHOD_1(CBrokerMocks, , void, Message_Destroy, MESSAGE_HANDLE, message);
 DECLARE_GLOBAL_MOCK_METHOD_2(CBrokerMocks, , MESSAGE_HANDLE, Message_CreateFromByteArray, const unsigned char*, source, int32_t, size);
+DECLARE_GLOBAL_MOCK_METHOD_4(CBrokerMocks, , MESSAGE_HANDLE, Message_CreateFromByteArrayNoCopy, const unsigned char*, source, int32_t, size, MESSAGE_BUFFER_FREE, free_buffer, void*, free_context);
 DECLARE_GLOBAL_MOCK_METHOD_3(CBrokerMocks, , int32_t, Message_ToByteArray, MESSAGE_HANDLE, messageHandle, unsigned char *, buffer, int32_t, size);
+DECLARE_GLOBAL_MOCK_METHOD_2(CBrokerMocks, , const char*, Message_GetProperty, MESSAGE_HANDLE, message, const char*, key);
+
+// property_key.h
+DECLARE_GLOBAL_MOCK_METHOD_1(CBrokerMocks, , const char*, PropertyKey_Intern, const char*, key);
 
 // singlylinkedlist.h
 DECLARE_GLOBAL_MOCK_METHOD_0(CBrokerMocks, , SINGLYLINKEDLIST_HANDLE, singlylinkedlist_create);
@@ -676,6 +814,7 @@ TEST_FUNCTION_INITIALIZE(TestMethodInitialize)
 
     currentLock_call = 0;
     whenShallLock_fail = 0;
+    shallLock_fail_always = false;
 
     currentUnlock_call = 0;
 
@@ -687,6 +826,13 @@ TEST_FUNCTION_INITIALIZE(TestMethodInitialize)
 
     currentThreadAPI_Create_call = 0;
     whenShallThreadAPI_Create_fail = 0;
+    currentThreadAPI_Join_call = 0;
+
+    currentMessage_CreateFromByteArrayNoCopy_call = 0;
+    whenShallMessage_CreateFromByteArrayNoCopy_fail = 0;
+
+    fake_property_message = NULL;
+    fake_property_value = NULL;
 
     current_nn_socket_index = 0;
     for (int l = 0; l < 10; l++)
@@ -698,11 +844,15 @@ TEST_FUNCTION_INITIALIZE(TestMethodInitialize)
 
     thread_func_to_call = NULL;
     thread_func_args = NULL;
+    on_Message_Clone = nullptr;
 
 
     call_status_for_FakeModule_Receive.messageHandle = NULL;
     call_status_for_FakeModule_Receive.module = NULL;
     call_status_for_FakeModule_Receive.was_called = false;
+    fake_received_count = 0;
+    fake_batch_call_count = 0;
+    fake_batch_message_count = 0;
 }
 
 TEST_FUNCTION_CLEANUP(TestMethodCleanup)
@@ -1363,6 +1513,8 @@ TEST_FUNCTION(Broker_AddModule_fails_when_nn_socket_fails)
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, singlylinkedlist_add(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreAllArguments();
+    STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is for the module index*/
+        .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, singlylinkedlist_remove(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreAllArguments();
     STRICT_EXPECTED_CALL(mocks, nn_socket(AF_SP, NN_SUB))
@@ -1411,6 +1563,8 @@ TEST_FUNCTION(Broker_AddModule_fails_when_nn_connect_fails)
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, singlylinkedlist_add(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreAllArguments();
+    STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is for the module index*/
+        .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, singlylinkedlist_remove(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreAllArguments();
     STRICT_EXPECTED_CALL(mocks, nn_socket(AF_SP, NN_SUB));
@@ -1465,6 +1619,8 @@ TEST_FUNCTION(Broker_AddModule_fails_when_nn_setSocketOpts_fails)
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, singlylinkedlist_add(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreAllArguments();
+    STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is for the module index*/
+        .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, singlylinkedlist_remove(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreAllArguments();
     STRICT_EXPECTED_CALL(mocks, nn_socket(AF_SP, NN_SUB));
@@ -1526,6 +1682,8 @@ TEST_FUNCTION(Broker_AddModule_fails_when_ThreadAPI_Create_fails)
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, singlylinkedlist_add(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreAllArguments();
+    STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is for the module index*/
+        .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, singlylinkedlist_remove(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreAllArguments();
     STRICT_EXPECTED_CALL(mocks, nn_socket(AF_SP, NN_SUB));
@@ -1584,6 +1742,8 @@ TEST_FUNCTION(Broker_AddModule_succeeds)
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, singlylinkedlist_add(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreAllArguments();
+    STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is for the module index*/
+        .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, Lock_Init());
     STRICT_EXPECTED_CALL(mocks, UniqueId_Generate(IGNORED_PTR_ARG, 37))
         .IgnoreArgument(1);
@@ -1630,6 +1790,7 @@ TEST_FUNCTION(Broker_AddModule_succeeds)
 //Tests_SRS_BROKER_13_093: [ The function shall destroy the message that was dequeued by calling Message_Destroy. ]
 //Tests_SRS_BROKER_17_019: [ The function shall free the buffer received on the receive_socket. ]
 //Tests_SRS_BROKER_17_024: [ The function shall strip off the topic from the message. ]
+//Tests_SRS_BROKER_30_090: [ The function shall deserialize the message with Message_CreateFromByteArrayNoCopy, handing the ownership of the received buffer to the message. ]
 TEST_FUNCTION(module_publish_worker_calls_receive_once_then_exits_on_quit_msg)
 {
     CBrokerMocks mocks;
@@ -1656,9 +1817,8 @@ TEST_FUNCTION(module_publish_worker_calls_receive_once_then_exits_on_quit_msg)
         .IgnoreArgument(2);
     STRICT_EXPECTED_CALL(mocks, nn_freemsg(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, Message_CreateFromByteArray(IGNORED_PTR_ARG, IGNORED_NUM_ARG))
-        .IgnoreArgument(1)
-        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, Message_CreateFromByteArrayNoCopy(IGNORED_PTR_ARG, IGNORED_NUM_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
     STRICT_EXPECTED_CALL(mocks, Message_Destroy(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
 
@@ -1838,9 +1998,8 @@ TEST_FUNCTION(module_publish_worker_message_size_matches_but_not_quit_for_me)
     STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
         .IgnoreArgument(1)
         .SetFailReturn("nn_send");
-    STRICT_EXPECTED_CALL(mocks, Message_CreateFromByteArray(IGNORED_PTR_ARG, IGNORED_NUM_ARG))
-        .IgnoreArgument(1)
-        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, Message_CreateFromByteArrayNoCopy(IGNORED_PTR_ARG, IGNORED_NUM_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
     STRICT_EXPECTED_CALL(mocks, Message_Destroy(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
 
@@ -1900,10 +2059,9 @@ TEST_FUNCTION(module_publish_worker_continue_on_CreateFromByteArray_fails)
         .IgnoreArgument(2);
     STRICT_EXPECTED_CALL(mocks, nn_freemsg(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, Message_CreateFromByteArray(IGNORED_PTR_ARG, IGNORED_NUM_ARG))
-        .IgnoreArgument(1)
-        .IgnoreArgument(2)
-        .SetFailReturn((MESSAGE_HANDLE)NULL);
+    STRICT_EXPECTED_CALL(mocks, Message_CreateFromByteArrayNoCopy(IGNORED_PTR_ARG, IGNORED_NUM_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
+    whenShallMessage_CreateFromByteArrayNoCopy_fail = currentMessage_CreateFromByteArrayNoCopy_call + 1;
 
     //loop 2
     STRICT_EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
@@ -1992,13 +2150,6 @@ TEST_FUNCTION(Broker_RemoveModule_succeeds)
     STRICT_EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
 
-    STRICT_EXPECTED_CALL(mocks, singlylinkedlist_find(IGNORED_PTR_ARG, IGNORED_PTR_ARG, &fake_module))
-        .IgnoreArgument(1)
-        .IgnoreArgument(2);
-    STRICT_EXPECTED_CALL(mocks, singlylinkedlist_item_get_value(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, singlylinkedlist_item_get_value(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, nn_send(IGNORED_NUM_ARG, IGNORED_PTR_ARG, 37, 0))
         .IgnoreArgument(1)
         .IgnoreArgument(2);
@@ -2064,13 +2215,19 @@ TEST_FUNCTION(Broker_RemoveModule_fails_when_Lock_fails)
 }
 
 
+//Tests_SRS_BROKER_13_049: [Broker_RemoveModule shall look module up in the broker's module index.]
 //Tests_SRS_BROKER_13_050: [Broker_RemoveModule shall unlock BROKER_HANDLE_DATA::modules_lock and return BROKER_ERROR if the module is not found in BROKER_HANDLE_DATA::modules.]
-TEST_FUNCTION(Broker_RemoveModule_fails_when_singlylinkedlist_find_fails)
+TEST_FUNCTION(Broker_RemoveModule_fails_for_unknown_module)
 {
     ///arrange
     CBrokerMocks mocks;
     auto broker = Broker_Create();
     auto result = Broker_AddModule(broker, &fake_module);
+    MODULE unknown_module =
+    {
+        fake_module.module_apis,
+        unknown_module_handle
+    };
     mocks.ResetAllCalls();
 
     // this is for the Broker_RemoveModule call
@@ -2078,13 +2235,9 @@ TEST_FUNCTION(Broker_RemoveModule_fails_when_singlylinkedlist_find_fails)
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
-    whenShallsinglylinkedlist_find_fail = 1;
-    STRICT_EXPECTED_CALL(mocks, singlylinkedlist_find(IGNORED_PTR_ARG, IGNORED_PTR_ARG, &fake_module))
-        .IgnoreArgument(1)
-        .IgnoreArgument(2);
 
     ///act
-    result = Broker_RemoveModule(broker, &fake_module);
+    result = Broker_RemoveModule(broker, &unknown_module);
 
     ///assert
     ASSERT_ARE_EQUAL(BROKER_RESULT, result, BROKER_ERROR);
@@ -2110,13 +2263,6 @@ TEST_FUNCTION(Broker_RemoveModule_succeeds_when_nn_send_fails)
     STRICT_EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
 
-    STRICT_EXPECTED_CALL(mocks, singlylinkedlist_find(IGNORED_PTR_ARG, IGNORED_PTR_ARG, &fake_module))
-        .IgnoreArgument(1)
-        .IgnoreArgument(2);
-    STRICT_EXPECTED_CALL(mocks, singlylinkedlist_item_get_value(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, singlylinkedlist_item_get_value(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, nn_send(IGNORED_NUM_ARG, IGNORED_PTR_ARG, 37, 0))
         .IgnoreArgument(1)
         .IgnoreArgument(2)
@@ -2166,13 +2312,6 @@ TEST_FUNCTION(Broker_RemoveModule_succeeds_even_when_Lock_fails)
     STRICT_EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
 
-    STRICT_EXPECTED_CALL(mocks, singlylinkedlist_find(IGNORED_PTR_ARG, IGNORED_PTR_ARG, &fake_module))
-        .IgnoreArgument(1)
-        .IgnoreArgument(2);
-    STRICT_EXPECTED_CALL(mocks, singlylinkedlist_item_get_value(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, singlylinkedlist_item_get_value(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, nn_send(IGNORED_NUM_ARG, IGNORED_PTR_ARG, 37, 0))
         .IgnoreArgument(1)
         .IgnoreArgument(2);
@@ -2224,13 +2363,6 @@ TEST_FUNCTION(Broker_RemoveModule_succeeds_even_when_nn_close_fails)
     STRICT_EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
 
-    STRICT_EXPECTED_CALL(mocks, singlylinkedlist_find(IGNORED_PTR_ARG, IGNORED_PTR_ARG, &fake_module))
-        .IgnoreArgument(1)
-        .IgnoreArgument(2);
-    STRICT_EXPECTED_CALL(mocks, singlylinkedlist_item_get_value(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, singlylinkedlist_item_get_value(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, nn_send(IGNORED_NUM_ARG, IGNORED_PTR_ARG, 37, 0))
         .IgnoreArgument(1)
         .IgnoreArgument(2);
@@ -2285,13 +2417,6 @@ TEST_FUNCTION(Broker_RemoveModule_succeeds_even_when_unlock_fails)
         .IgnoreArgument(1)
         .SetFailReturn(LOCK_ERROR);
 
-    STRICT_EXPECTED_CALL(mocks, singlylinkedlist_find(IGNORED_PTR_ARG, IGNORED_PTR_ARG, &fake_module))
-        .IgnoreArgument(1)
-        .IgnoreArgument(2);
-    STRICT_EXPECTED_CALL(mocks, singlylinkedlist_item_get_value(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, singlylinkedlist_item_get_value(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, nn_send(IGNORED_NUM_ARG, IGNORED_PTR_ARG, 37, 0))
         .IgnoreArgument(1)
         .IgnoreArgument(2);
@@ -2438,22 +2563,6 @@ TEST_FUNCTION(Broker_AddLink_succeeds)
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, singlylinkedlist_find(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreArgument(1)
-        .IgnoreArgument(2)
-        .IgnoreArgument(3);
-    STRICT_EXPECTED_CALL(mocks, singlylinkedlist_item_get_value(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, singlylinkedlist_item_get_value(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, singlylinkedlist_find(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreArgument(1)
-        .IgnoreArgument(2)
-        .IgnoreArgument(3);
-    STRICT_EXPECTED_CALL(mocks, singlylinkedlist_item_get_value(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, singlylinkedlist_item_get_value(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, nn_setsockopt(IGNORED_NUM_ARG, NN_SUB, NN_SUB_SUBSCRIBE, IGNORED_PTR_ARG, sizeof(MODULE_HANDLE)))
         .IgnoreArgument(1)
         .IgnoreArgument(4);
@@ -2489,22 +2598,6 @@ TEST_FUNCTION(Broker_AddLink_fails_setsocketoption_fails)
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, singlylinkedlist_find(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreArgument(1)
-        .IgnoreArgument(2)
-        .IgnoreArgument(3);
-    STRICT_EXPECTED_CALL(mocks, singlylinkedlist_item_get_value(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, singlylinkedlist_item_get_value(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, singlylinkedlist_find(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreArgument(1)
-        .IgnoreArgument(2)
-        .IgnoreArgument(3);
-    STRICT_EXPECTED_CALL(mocks, singlylinkedlist_item_get_value(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, singlylinkedlist_item_get_value(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, nn_setsockopt(IGNORED_NUM_ARG, NN_SUB, NN_SUB_SUBSCRIBE, IGNORED_PTR_ARG, sizeof(MODULE_HANDLE)))
         .IgnoreArgument(1)
         .IgnoreArgument(4)
@@ -2529,7 +2622,7 @@ TEST_FUNCTION(Broker_AddLink_fails_setsocketoption_fails)
 }
 
 //Tests_SRS_BROKER_17_034: [ Upon an error, Broker_AddLink shall return BROKER_ADD_LINK_ERROR ]
-TEST_FUNCTION(Broker_AddLink_fails_source_find_fails)
+TEST_FUNCTION(Broker_AddLink_fails_for_unknown_source)
 {
     ///arrange
     CBrokerMocks mocks;
@@ -2541,23 +2634,10 @@ TEST_FUNCTION(Broker_AddLink_fails_source_find_fails)
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, singlylinkedlist_find(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreArgument(1)
-        .IgnoreArgument(2)
-        .IgnoreArgument(3);
-    STRICT_EXPECTED_CALL(mocks, singlylinkedlist_item_get_value(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, singlylinkedlist_item_get_value(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, singlylinkedlist_find(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreArgument(1)
-        .IgnoreArgument(2)
-        .IgnoreArgument(3)
-        .SetFailReturn((LIST_ITEM_HANDLE)NULL);
 
     BROKER_LINK_DATA bld =
     {
-        fake_module_handle,
+        unknown_module_handle,
         fake_module_handle
     };
 
@@ -2574,7 +2654,7 @@ TEST_FUNCTION(Broker_AddLink_fails_source_find_fails)
 }
 
 //Tests_SRS_BROKER_17_034: [ Upon an error, Broker_AddLink shall return BROKER_ADD_LINK_ERROR ]
-TEST_FUNCTION(Broker_AddLink_fails_singlylinkedlist_find_fails)
+TEST_FUNCTION(Broker_AddLink_fails_for_unknown_sink)
 {
     ///arrange
     CBrokerMocks mocks;
@@ -2586,16 +2666,11 @@ TEST_FUNCTION(Broker_AddLink_fails_singlylinkedlist_find_fails)
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, singlylinkedlist_find(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreArgument(1)
-        .IgnoreArgument(2)
-        .IgnoreArgument(3)
-        .SetFailReturn((LIST_ITEM_HANDLE)NULL);
 
     BROKER_LINK_DATA bld =
     {
         fake_module_handle,
-        fake_module_handle
+        unknown_module_handle
     };
 
     ///act
@@ -2757,22 +2832,6 @@ TEST_FUNCTION(Broker_RemoveLink_succeeds)
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, singlylinkedlist_find(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreArgument(1)
-        .IgnoreArgument(2)
-        .IgnoreArgument(3);
-    STRICT_EXPECTED_CALL(mocks, singlylinkedlist_item_get_value(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, singlylinkedlist_item_get_value(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, singlylinkedlist_find(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreArgument(1)
-        .IgnoreArgument(2)
-        .IgnoreArgument(3);
-    STRICT_EXPECTED_CALL(mocks, singlylinkedlist_item_get_value(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, singlylinkedlist_item_get_value(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
 
     STRICT_EXPECTED_CALL(mocks, nn_setsockopt(IGNORED_NUM_ARG, NN_SUB, NN_SUB_UNSUBSCRIBE, IGNORED_PTR_ARG, sizeof(MODULE_HANDLE)))
         .IgnoreArgument(1)
@@ -2810,22 +2869,6 @@ TEST_FUNCTION(Broker_RemoveLink_fails_sockopt_fails)
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, singlylinkedlist_find(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreArgument(1)
-        .IgnoreArgument(2)
-        .IgnoreArgument(3);
-    STRICT_EXPECTED_CALL(mocks, singlylinkedlist_item_get_value(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, singlylinkedlist_item_get_value(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, singlylinkedlist_find(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreArgument(1)
-        .IgnoreArgument(2)
-        .IgnoreArgument(3);
-    STRICT_EXPECTED_CALL(mocks, singlylinkedlist_item_get_value(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, singlylinkedlist_item_get_value(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, nn_setsockopt(IGNORED_NUM_ARG, NN_SUB, NN_SUB_UNSUBSCRIBE, IGNORED_PTR_ARG, sizeof(MODULE_HANDLE)))
         .IgnoreArgument(1)
         .IgnoreArgument(4)
@@ -2843,7 +2886,7 @@ TEST_FUNCTION(Broker_RemoveLink_fails_sockopt_fails)
     Broker_Destroy(broker);
 }
 
-TEST_FUNCTION(Broker_RemoveLink_fails_source_find_fails)
+TEST_FUNCTION(Broker_RemoveLink_fails_for_unknown_source)
 {
     ///arrange
     CBrokerMocks mocks;
@@ -2855,6 +2898,11 @@ TEST_FUNCTION(Broker_RemoveLink_fails_source_find_fails)
         fake_module_handle
     };
     result = Broker_AddLink(broker, &bld);
+    BROKER_LINK_DATA unknown_bld =
+    {
+        unknown_module_handle,
+        fake_module_handle
+    };
 
     mocks.ResetAllCalls();
 
@@ -2862,22 +2910,9 @@ TEST_FUNCTION(Broker_RemoveLink_fails_source_find_fails)
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, singlylinkedlist_find(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreArgument(1)
-        .IgnoreArgument(2)
-        .IgnoreArgument(3);
-    STRICT_EXPECTED_CALL(mocks, singlylinkedlist_item_get_value(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, singlylinkedlist_item_get_value(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, singlylinkedlist_find(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreArgument(1)
-        .IgnoreArgument(2)
-        .IgnoreArgument(3)
-        .SetFailReturn(nullptr);
 
     ///act
-    result = Broker_RemoveLink(broker, &bld);
+    result = Broker_RemoveLink(broker, &unknown_bld);
 
     ///assert
     ASSERT_ARE_EQUAL(BROKER_RESULT, result, BROKER_REMOVE_LINK_ERROR);
@@ -2890,7 +2925,7 @@ TEST_FUNCTION(Broker_RemoveLink_fails_source_find_fails)
 
 
 //Tests_SRS_BROKER_17_040: [ Upon an error, Broker_RemoveLink shall return BROKER_REMOVE_LINK_ERROR. ]
-TEST_FUNCTION(Broker_RemoveLink_fails_singlylinkedlist_find_fails)
+TEST_FUNCTION(Broker_RemoveLink_fails_for_unknown_sink)
 {
     ///arrange
     CBrokerMocks mocks;
@@ -2902,6 +2937,11 @@ TEST_FUNCTION(Broker_RemoveLink_fails_singlylinkedlist_find_fails)
         fake_module_handle
     };
     result = Broker_AddLink(broker, &bld);
+    BROKER_LINK_DATA unknown_bld =
+    {
+        fake_module_handle,
+        unknown_module_handle
+    };
 
     mocks.ResetAllCalls();
 
@@ -2909,14 +2949,9 @@ TEST_FUNCTION(Broker_RemoveLink_fails_singlylinkedlist_find_fails)
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, singlylinkedlist_find(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreArgument(1)
-        .IgnoreArgument(2)
-        .IgnoreArgument(3)
-        .SetFailReturn(nullptr);
 
     ///act
-    result = Broker_RemoveLink(broker, &bld);
+    result = Broker_RemoveLink(broker, &unknown_bld);
 
     ///assert
     ASSERT_ARE_EQUAL(BROKER_RESULT, result, BROKER_REMOVE_LINK_ERROR);
@@ -3152,41 +3187,6 @@ TEST_FUNCTION(Broker_Publish_fails_with_null_source)
 
     ///cleanup
 }
-//Tests_SRS_BROKER_13_037: [This function shall return BROKER_ERROR if an underlying API call to the platform causes an error or BROKER_OK otherwise.]
-TEST_FUNCTION(Broker_Publish_fails_when_Lock_fails)
-{
-    ///arrange
-    CBrokerMocks mocks;
-
-    auto broker = Broker_Create();
-
-    // create a message to send
-    unsigned char fake;
-    MESSAGE_CONFIG c = { 1, &fake, (MAP_HANDLE)&fake };
-    auto message = Message_Create(&c);
-
-    auto result = Broker_AddModule(broker, &fake_module);
-
-    mocks.ResetAllCalls();
-
-    // this is for Broker_Publish
-    STRICT_EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
-        .IgnoreArgument(1)
-        .SetFailReturn(LOCK_ERROR);
-
-    ///act
-    result = Broker_Publish(broker, fake_module_handle, message);
-
-    ///assert
-    ASSERT_ARE_EQUAL(BROKER_RESULT, result, BROKER_ERROR);
-    mocks.AssertActualAndExpectedCalls();
-
-    ///cleanup
-    Message_Destroy(message);
-    Broker_RemoveModule(broker, &fake_module);
-    Broker_Destroy(broker);
-}
-
 //Tests_SRS_BROKER_13_037: [This function shall return BROKER_ERROR if an underlying API call to the platform causes an error or BROKER_OK otherwise.]
 TEST_FUNCTION(Broker_Publish_fails_when_Message_ToByteArray_fails)
 {
@@ -3205,10 +3205,6 @@ TEST_FUNCTION(Broker_Publish_fails_when_Message_ToByteArray_fails)
     mocks.ResetAllCalls();
 
     // this is for Broker_Publish
-    STRICT_EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, Message_Clone(message));
     STRICT_EXPECTED_CALL(mocks, Message_Destroy(message));
     STRICT_EXPECTED_CALL(mocks, Message_ToByteArray(message, NULL, 0))
@@ -3245,10 +3241,6 @@ TEST_FUNCTION(Broker_Publish_fails_when_allocmsg_fails)
     mocks.ResetAllCalls();
 
     // this is for Broker_Publish
-    STRICT_EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, Message_Clone(message));
     STRICT_EXPECTED_CALL(mocks, Message_Destroy(message));
     STRICT_EXPECTED_CALL(mocks, Message_ToByteArray(message, NULL, 0));
@@ -3286,10 +3278,6 @@ TEST_FUNCTION(Broker_Publish_fails_when_send_fails)
     mocks.ResetAllCalls();
 
     // this is for Broker_Publish
-    STRICT_EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, Message_Clone(message));
     STRICT_EXPECTED_CALL(mocks, Message_Destroy(message));
     STRICT_EXPECTED_CALL(mocks, Message_ToByteArray(message, NULL, 0));
@@ -3317,7 +3305,7 @@ TEST_FUNCTION(Broker_Publish_fails_when_send_fails)
     Broker_Destroy(broker);
 }
 
-//Tests_SRS_BROKER_17_022: [ Broker_Publish shall Lock the modules lock. ]
+//Tests_SRS_BROKER_17_022: [ Broker_Publish shall not acquire the modules lock, so that any number of threads can publish concurrently. ]
 //Tests_SRS_BROKER_17_007: [Broker_Publish shall clone the message.]
 //Tests_SRS_BROKER_17_008: [ Broker_Publish shall serialize the message. ]
 //Tests_SRS_BROKER_17_025: [ Broker_Publish shall allocate a nanomsg buffer the size of the serialized message + sizeof(MODULE_HANDLE). ]
@@ -3326,7 +3314,6 @@ TEST_FUNCTION(Broker_Publish_fails_when_send_fails)
 //Tests_SRS_BROKER_17_010: [ Broker_Publish shall send a message on the publish_socket. ]
 //Tests_SRS_BROKER_17_011: [ Broker_Publish shall free the serialized message data. ]
 //Tests_SRS_BROKER_17_012: [ Broker_Publish shall free the message. ]
-//Tests_SRS_BROKER_17_023: [ Broker_Publish shall Unlock the modules lock. ]
 //Tests_SRS_BROKER_13_037 : [This function shall return BROKER_ERROR if an underlying API call to the platform causes an error or BROKER_OK otherwise.]
 TEST_FUNCTION(Broker_Publish_succeeds)
 {
@@ -3345,10 +3332,6 @@ TEST_FUNCTION(Broker_Publish_succeeds)
     mocks.ResetAllCalls();
 
     // this is for Broker_Publish
-    STRICT_EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, Message_Clone(message));
     STRICT_EXPECTED_CALL(mocks, Message_Destroy(message));
     STRICT_EXPECTED_CALL(mocks, Message_ToByteArray(message, NULL, 0));
@@ -3375,4 +3358,3294 @@ TEST_FUNCTION(Broker_Publish_succeeds)
 }
 
 
+/*expectations for building the route of a source that has sink_count sinks,
+  grows_index when the source needs a slot the routing index has no room for*/
+static void expect_route_create(CBrokerMocks& mocks, size_t sink_count, bool grows_index)
+{
+    STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*the route*/
+        .IgnoreArgument(1);
+    for (size_t i = 0; i < sink_count; i++)
+    {
+        STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, i))
+            .IgnoreArgument(1);
+    }
+    if (grows_index)
+    {
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*the routing index*/
+            .IgnoreArgument(1);
+    }
+}
+
+//Tests_SRS_BROKER_30_001: [ If `config` is `NULL`, `Broker_CreateWithConfig` shall create the broker exactly as `Broker_Create` does. ]
+TEST_FUNCTION(Broker_CreateWithConfig_with_NULL_config_succeeds)
+{
+    ///arrange
+    CBrokerMocks mocks;
+
+    STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is for the structure*/
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, singlylinkedlist_create());
+    STRICT_EXPECTED_CALL(mocks, Lock_Init());
+    STRICT_EXPECTED_CALL(mocks, nn_socket(AF_SP, NN_PUB));
+    STRICT_EXPECTED_CALL(mocks, UniqueId_Generate(IGNORED_PTR_ARG, 37))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, STRING_construct("inproc://"));
+    STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, nn_bind(IGNORED_NUM_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+
+    ///act
+    auto r = Broker_CreateWithConfig(NULL);
+
+    ///assert
+    ASSERT_IS_NOT_NULL(r);
+    mocks.AssertActualAndExpectedCalls();
+
+    ///cleanup
+    Broker_Destroy(r);
+}
+
+//Tests_SRS_BROKER_30_002: [ If `config->delivery_mode` is not a valid `BROKER_DELIVERY_MODE`, `Broker_CreateWithConfig` shall fail and return `NULL`. ]
+TEST_FUNCTION(Broker_CreateWithConfig_fails_with_invalid_delivery_mode)
+{
+    ///arrange
+    CBrokerMocks mocks;
+    BROKER_CONFIG config = { (BROKER_DELIVERY_MODE)42 };
+
+    ///act
+    auto r = Broker_CreateWithConfig(&config);
+
+    ///assert
+    ASSERT_IS_NULL(r);
+    mocks.AssertActualAndExpectedCalls();
+
+    ///cleanup
+}
+
+//Tests_SRS_BROKER_30_003: [ If `config->delivery_mode` is `BROKER_DELIVERY_ZERO_COPY`, `Broker_CreateWithConfig` shall not create the nanomsg publish socket nor the url. ]
+//Tests_SRS_BROKER_30_004: [ Otherwise `Broker_CreateWithConfig` shall create the broker as `Broker_Create` does, using `config->delivery_mode` to deliver messages. ]
+TEST_FUNCTION(Broker_CreateWithConfig_zero_copy_succeeds)
+{
+    ///arrange
+    CBrokerMocks mocks;
+    BROKER_CONFIG config = { BROKER_DELIVERY_ZERO_COPY };
+
+    STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is for the structure*/
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, singlylinkedlist_create());
+    STRICT_EXPECTED_CALL(mocks, Lock_Init());
+
+    ///act
+    auto r = Broker_CreateWithConfig(&config);
+
+    ///assert
+    ASSERT_IS_NOT_NULL(r);
+    mocks.AssertActualAndExpectedCalls();
+
+    ///cleanup
+    Broker_Destroy(r);
+}
+
+//Tests_SRS_BROKER_30_010: [ In zero-copy mode `Broker_AddModule` shall create a vector of sinks, a message queue holding `BROKER_HANDLE_DATA::queue_capacity` messages with the `BROKER_OVERFLOW_DROP_NEWEST` policy and two conditions for the module. ]
+//Tests_SRS_BROKER_30_011: [ In zero-copy mode the function shall create the module's thread using the zero-copy worker as the thread callback. ]
+TEST_FUNCTION(Broker_AddModule_zero_copy_succeeds)
+{
+    ///arrange
+    CBrokerMocks mocks;
+    BROKER_CONFIG config = { BROKER_DELIVERY_ZERO_COPY };
+    auto broker = Broker_CreateWithConfig(&config);
+    mocks.ResetAllCalls();
+
+    STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is for the module_info*/
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is for the module struct*/
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, Lock_Init());
+    STRICT_EXPECTED_CALL(mocks, UniqueId_Generate(IGNORED_PTR_ARG, 37))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, STRING_construct(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, VECTOR_create(2 * sizeof(void*))); /*a sink and the filter of its link*/
+    STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is for the message queue*/
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, Condition_Init());
+    STRICT_EXPECTED_CALL(mocks, Condition_Init());
+    STRICT_EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, singlylinkedlist_add(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
+    STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is for the module index*/
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
+    STRICT_EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+
+    ///act
+    auto result = Broker_AddModule(broker, &fake_module);
+
+    ///assert
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result, BROKER_OK);
+    mocks.AssertActualAndExpectedCalls();
+
+    ///cleanup
+    Broker_RemoveModule(broker, &fake_module);
+    Broker_Destroy(broker);
+}
+
+//Tests_SRS_BROKER_13_047: [This function shall return BROKER_ERROR if an underlying API call to the platform causes an error or BROKER_OK otherwise.]
+TEST_FUNCTION(Broker_AddModule_zero_copy_fails_when_Condition_Init_fails)
+{
+    ///arrange
+    CBrokerMocks mocks;
+    BROKER_CONFIG config = { BROKER_DELIVERY_ZERO_COPY };
+    auto broker = Broker_CreateWithConfig(&config);
+    mocks.ResetAllCalls();
+
+    STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is for the module_info*/
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is for the module struct*/
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, Lock_Init());
+    STRICT_EXPECTED_CALL(mocks, Lock_Deinit(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, UniqueId_Generate(IGNORED_PTR_ARG, 37))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, STRING_construct(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, VECTOR_create(2 * sizeof(void*))); /*a sink and the filter of its link*/
+    STRICT_EXPECTED_CALL(mocks, VECTOR_destroy(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is for the message queue*/
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    whenShallCond_Init_fail = currentCond_Init_call + 1;
+    STRICT_EXPECTED_CALL(mocks, Condition_Init());
+
+    ///act
+    auto result = Broker_AddModule(broker, &fake_module);
+
+    ///assert
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result, BROKER_ERROR);
+    mocks.AssertActualAndExpectedCalls();
+
+    ///cleanup
+    Broker_Destroy(broker);
+}
+
+//Tests_SRS_BROKER_30_041: [ In zero-copy mode `Broker_AddLink` shall append the sink's `module_info` to the source's sinks. ]
+//Tests_SRS_BROKER_30_043: [ In zero-copy mode `Broker_AddLink` and `Broker_RemoveLink` shall build a new route for the source only and swap it in for `Broker_Publish`, freeing the route it replaces once no publisher can be reading it. ]
+TEST_FUNCTION(Broker_AddLink_zero_copy_succeeds)
+{
+    ///arrange
+    CBrokerMocks mocks;
+    BROKER_CONFIG config = { BROKER_DELIVERY_ZERO_COPY };
+    auto broker = Broker_CreateWithConfig(&config);
+    auto result = Broker_AddModule(broker, &fake_module);
+    mocks.ResetAllCalls();
+
+    STRICT_EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
+    STRICT_EXPECTED_CALL(mocks, VECTOR_push_back(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
+    expect_route_create(mocks, 1, true);
+
+    BROKER_LINK_DATA bld =
+    {
+        fake_module_handle,
+        fake_module_handle
+    };
+
+    ///act
+    result = Broker_AddLink(broker, &bld);
+
+    ///assert
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result, BROKER_OK);
+    mocks.AssertActualAndExpectedCalls();
+
+    ///cleanup
+    Broker_RemoveModule(broker, &fake_module);
+    Broker_Destroy(broker);
+}
+
+//Tests_SRS_BROKER_30_040: [ In zero-copy mode, if the sink is already linked to the source, `Broker_AddLink` shall do nothing and return `BROKER_OK`. ]
+TEST_FUNCTION(Broker_AddLink_zero_copy_twice_links_once)
+{
+    ///arrange
+    CBrokerMocks mocks;
+    BROKER_CONFIG config = { BROKER_DELIVERY_ZERO_COPY };
+    auto broker = Broker_CreateWithConfig(&config);
+    auto result = Broker_AddModule(broker, &fake_module);
+    BROKER_LINK_DATA bld =
+    {
+        fake_module_handle,
+        fake_module_handle
+    };
+    result = Broker_AddLink(broker, &bld);
+    mocks.ResetAllCalls();
+
+    STRICT_EXPECTED_CALL(mocks, VECTOR_push_back(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2)
+        .NeverInvoked();
+
+    ///act
+    result = Broker_AddLink(broker, &bld);
+    auto remove_result = Broker_RemoveLink(broker, &bld);
+    auto remove_again_result = Broker_RemoveLink(broker, &bld);
+
+    ///assert
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result, BROKER_OK);
+    ASSERT_ARE_EQUAL(BROKER_RESULT, remove_result, BROKER_OK);
+    ASSERT_ARE_EQUAL(BROKER_RESULT, remove_again_result, BROKER_REMOVE_LINK_ERROR);
+
+    ///cleanup
+    Broker_RemoveModule(broker, &fake_module);
+    Broker_Destroy(broker);
+}
+
+//Tests_SRS_BROKER_30_042: [ In zero-copy mode `Broker_RemoveLink` shall remove the sink's `module_info` from the source's sinks and fail if the link does not exist. ]
+//Tests_SRS_BROKER_30_043: [ In zero-copy mode `Broker_AddLink` and `Broker_RemoveLink` shall build a new route for the source only and swap it in for `Broker_Publish`, freeing the route it replaces once no publisher can be reading it. ]
+TEST_FUNCTION(Broker_RemoveLink_zero_copy_succeeds)
+{
+    ///arrange
+    CBrokerMocks mocks;
+    BROKER_CONFIG config = { BROKER_DELIVERY_ZERO_COPY };
+    auto broker = Broker_CreateWithConfig(&config);
+    auto result = Broker_AddModule(broker, &fake_module);
+    BROKER_LINK_DATA bld =
+    {
+        fake_module_handle,
+        fake_module_handle
+    };
+    result = Broker_AddLink(broker, &bld);
+    mocks.ResetAllCalls();
+
+    STRICT_EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
+    expect_route_create(mocks, 1, false);
+    STRICT_EXPECTED_CALL(mocks, VECTOR_erase(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)) /*the previous route*/
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)) /*the new route, it has no sinks*/
+        .IgnoreArgument(1);
+
+    ///act
+    result = Broker_RemoveLink(broker, &bld);
+
+    ///assert
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result, BROKER_OK);
+    mocks.AssertActualAndExpectedCalls();
+
+    ///cleanup
+    Broker_RemoveModule(broker, &fake_module);
+    Broker_Destroy(broker);
+}
+
+//Tests_SRS_BROKER_30_043: [ In zero-copy mode `Broker_AddLink` and `Broker_RemoveLink` shall build a new route for the source only and swap it in for `Broker_Publish`, freeing the route it replaces once no publisher can be reading it. ]
+TEST_FUNCTION(Broker_AddLink_zero_copy_builds_only_the_route_of_its_source)
+{
+    ///arrange
+    CBrokerMocks mocks;
+    BROKER_CONFIG config = { BROKER_DELIVERY_ZERO_COPY };
+    auto broker = Broker_CreateWithConfig(&config);
+    auto result = Broker_AddModule(broker, &fake_module);
+    result = Broker_AddModule(broker, &fake_batch_module);
+    BROKER_LINK_DATA other =
+    {
+        fake_batch_module_handle,
+        fake_batch_module_handle
+    };
+    result = Broker_AddLink(broker, &other);
+    mocks.ResetAllCalls();
+
+    STRICT_EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
+    STRICT_EXPECTED_CALL(mocks, VECTOR_push_back(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
+    /*the route of fake_batch_module is neither copied nor replaced*/
+    expect_route_create(mocks, 1, false);
+
+    BROKER_LINK_DATA bld =
+    {
+        fake_module_handle,
+        fake_module_handle
+    };
+
+    ///act
+    result = Broker_AddLink(broker, &bld);
+
+    ///assert
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result, BROKER_OK);
+    mocks.AssertActualAndExpectedCalls();
+
+    ///cleanup
+    Broker_RemoveModule(broker, &fake_batch_module);
+    Broker_RemoveModule(broker, &fake_module);
+    Broker_Destroy(broker);
+}
+
+//Tests_SRS_BROKER_30_017: [ In zero-copy mode the function shall swap in new routes for the module and for the modules linking to it, leaving the module out, and wait until no publisher can be reading the routes they replace before stopping the module. ]
+TEST_FUNCTION(Broker_RemoveModule_zero_copy_leaves_the_module_out_of_the_routes_linking_to_it)
+{
+    ///arrange
+    CBrokerMocks mocks;
+    BROKER_CONFIG config = { BROKER_DELIVERY_ZERO_COPY };
+    auto broker = Broker_CreateWithConfig(&config);
+
+    unsigned char fake;
+    MESSAGE_CONFIG c = { 1, &fake, (MAP_HANDLE)&fake };
+    auto message = Message_Create(&c);
+
+    auto result = Broker_AddModule(broker, &fake_module);
+    result = Broker_AddModule(broker, &fake_batch_module);
+    BROKER_LINK_DATA to_self =
+    {
+        fake_module_handle,
+        fake_module_handle
+    };
+    BROKER_LINK_DATA to_other =
+    {
+        fake_module_handle,
+        fake_batch_module_handle
+    };
+    BROKER_LINK_DATA from_other =
+    {
+        fake_batch_module_handle,
+        fake_module_handle
+    };
+    result = Broker_AddLink(broker, &to_self);
+    result = Broker_AddLink(broker, &to_other);
+    result = Broker_AddLink(broker, &from_other);
+
+    ///act
+    auto remove_result = Broker_RemoveModule(broker, &fake_batch_module);
+    auto publish_result = Broker_Publish(broker, fake_module_handle, message);
+    auto unknown_result = Broker_Publish(broker, fake_batch_module_handle, message);
+
+    ///assert
+    BROKER_QUEUE_STATS stats;
+    ASSERT_ARE_EQUAL(BROKER_RESULT, remove_result, BROKER_OK);
+    ASSERT_ARE_EQUAL(BROKER_RESULT, publish_result, BROKER_OK);
+    ASSERT_ARE_EQUAL(BROKER_RESULT, unknown_result, BROKER_OK);
+    ASSERT_ARE_EQUAL(BROKER_RESULT, Broker_GetSinkQueueStats(broker, fake_module_handle, &stats), BROKER_OK);
+    ASSERT_ARE_EQUAL(size_t, stats.queued, (size_t)1);
+
+    ///cleanup
+    Message_Destroy(message);
+    Broker_RemoveModule(broker, &fake_module);
+    Broker_Destroy(broker);
+}
+
+//Tests_SRS_BROKER_30_030: [ In zero-copy mode `Broker_Publish` shall clone the `message` once for every sink linked to `source`. ]
+//Tests_SRS_BROKER_30_031: [ In zero-copy mode `Broker_Publish` shall append the clone to the sink's message queue without taking any lock. ]
+//Tests_SRS_BROKER_30_034: [ In zero-copy mode `Broker_Publish` shall look up the sinks of `source` in the current routing table without taking any lock. ]
+TEST_FUNCTION(Broker_Publish_zero_copy_queues_clone_without_serializing)
+{
+    ///arrange
+    CBrokerMocks mocks;
+    BROKER_CONFIG config = { BROKER_DELIVERY_ZERO_COPY };
+    auto broker = Broker_CreateWithConfig(&config);
+
+    unsigned char fake;
+    MESSAGE_CONFIG c = { 1, &fake, (MAP_HANDLE)&fake };
+    auto message = Message_Create(&c);
+
+    auto result = Broker_AddModule(broker, &fake_module);
+    BROKER_LINK_DATA bld =
+    {
+        fake_module_handle,
+        fake_module_handle
+    };
+    result = Broker_AddLink(broker, &bld);
+    mocks.ResetAllCalls();
+
+    STRICT_EXPECTED_CALL(mocks, Message_Clone(message));
+
+    ///act
+    result = Broker_Publish(broker, fake_module_handle, message);
+
+    ///assert
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result, BROKER_OK);
+    mocks.AssertActualAndExpectedCalls();
+
+    ///cleanup
+    Message_Destroy(message);
+    Broker_RemoveModule(broker, &fake_module);
+    Broker_Destroy(broker);
+}
+
+//Tests_SRS_BROKER_30_032: [ In zero-copy mode, if `source` is not attached to the broker or has no sinks, `Broker_Publish` shall return `BROKER_OK` without delivering the message. ]
+TEST_FUNCTION(Broker_Publish_zero_copy_without_links_succeeds)
+{
+    ///arrange
+    CBrokerMocks mocks;
+    BROKER_CONFIG config = { BROKER_DELIVERY_ZERO_COPY };
+    auto broker = Broker_CreateWithConfig(&config);
+
+    unsigned char fake;
+    MESSAGE_CONFIG c = { 1, &fake, (MAP_HANDLE)&fake };
+    auto message = Message_Create(&c);
+
+    auto result = Broker_AddModule(broker, &fake_module);
+    mocks.ResetAllCalls();
+
+    ///act
+    result = Broker_Publish(broker, fake_module_handle, message);
+
+    ///assert
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result, BROKER_OK);
+    mocks.AssertActualAndExpectedCalls();
+
+    ///cleanup
+    Message_Destroy(message);
+    Broker_RemoveModule(broker, &fake_module);
+    Broker_Destroy(broker);
+}
+
+//Tests_SRS_BROKER_30_080: [ If `broker`, `source` or `messages` is `NULL`, or `message_count` is 0, `Broker_PublishBatch` shall return `BROKER_INVALIDARG`. ]
+TEST_FUNCTION(Broker_PublishBatch_fails_with_NULL_arguments)
+{
+    ///arrange
+    CBrokerMocks mocks;
+    MESSAGE_HANDLE messages[1] = { (MESSAGE_HANDLE)0x1 };
+
+    ///act
+    auto r1 = Broker_PublishBatch(NULL, fake_module_handle, messages, 1);
+    auto r2 = Broker_PublishBatch((BROKER_HANDLE)0x1, NULL, messages, 1);
+    auto r3 = Broker_PublishBatch((BROKER_HANDLE)0x1, fake_module_handle, NULL, 1);
+    auto r4 = Broker_PublishBatch((BROKER_HANDLE)0x1, fake_module_handle, messages, 0);
+
+    ///assert
+    ASSERT_ARE_EQUAL(BROKER_RESULT, r1, BROKER_INVALIDARG);
+    ASSERT_ARE_EQUAL(BROKER_RESULT, r2, BROKER_INVALIDARG);
+    ASSERT_ARE_EQUAL(BROKER_RESULT, r3, BROKER_INVALIDARG);
+    ASSERT_ARE_EQUAL(BROKER_RESULT, r4, BROKER_INVALIDARG);
+    mocks.AssertActualAndExpectedCalls();
+
+    ///cleanup
+}
+
+//Tests_SRS_BROKER_30_081: [ If any of the `messages` is `NULL`, `Broker_PublishBatch` shall return `BROKER_INVALIDARG` without publishing any of them. ]
+TEST_FUNCTION(Broker_PublishBatch_fails_with_NULL_message_in_batch)
+{
+    ///arrange
+    CBrokerMocks mocks;
+    BROKER_CONFIG config = { BROKER_DELIVERY_ZERO_COPY };
+    auto broker = Broker_CreateWithConfig(&config);
+
+    unsigned char fake;
+    MESSAGE_CONFIG c = { 1, &fake, (MAP_HANDLE)&fake };
+    auto message = Message_Create(&c);
+
+    auto result = Broker_AddModule(broker, &fake_module);
+    BROKER_LINK_DATA bld =
+    {
+        fake_module_handle,
+        fake_module_handle
+    };
+    result = Broker_AddLink(broker, &bld);
+    MESSAGE_HANDLE messages[2] = { message, NULL };
+    mocks.ResetAllCalls();
+
+    STRICT_EXPECTED_CALL(mocks, Message_Clone(message))
+        .NeverInvoked();
+
+    ///act
+    result = Broker_PublishBatch(broker, fake_module_handle, messages, 2);
+
+    ///assert
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result, BROKER_INVALIDARG);
+    mocks.AssertActualAndExpectedCalls();
+
+    ///cleanup
+    Message_Destroy(message);
+    Broker_RemoveModule(broker, &fake_module);
+    Broker_Destroy(broker);
+}
+
+//Tests_SRS_BROKER_30_084: [ In serialized mode `Broker_PublishBatch` shall publish every message as `Broker_Publish` does, in order, and keep going when one of them fails. ]
+//Tests_SRS_BROKER_30_085: [ `Broker_PublishBatch` shall not acquire the modules lock. ]
+//Tests_SRS_BROKER_30_086: [ `Broker_PublishBatch` shall return `BROKER_ERROR` if publishing any of the messages failed or `BROKER_OK` otherwise. ]
+TEST_FUNCTION(Broker_PublishBatch_serialized_sends_every_message)
+{
+    ///arrange
+    CBrokerMocks mocks;
+
+    auto broker = Broker_Create();
+
+    unsigned char fake;
+    MESSAGE_CONFIG c = { 1, &fake, (MAP_HANDLE)&fake };
+    auto message = Message_Create(&c);
+    MESSAGE_HANDLE messages[2] = { message, message };
+
+    auto result = Broker_AddModule(broker, &fake_module);
+
+    mocks.ResetAllCalls();
+
+    STRICT_EXPECTED_CALL(mocks, Message_Clone(message))
+        .ExpectedTimesExactly(2);
+    STRICT_EXPECTED_CALL(mocks, Message_Destroy(message))
+        .ExpectedTimesExactly(2);
+    STRICT_EXPECTED_CALL(mocks, Message_ToByteArray(message, NULL, 0))
+        .ExpectedTimesExactly(2);
+    STRICT_EXPECTED_CALL(mocks, nn_allocmsg(1 + sizeof(MODULE_HANDLE), 0))
+        .IgnoreArgument(1)
+        .ExpectedTimesExactly(2);
+    STRICT_EXPECTED_CALL(mocks, Message_ToByteArray(message, IGNORED_PTR_ARG, 1))
+        .IgnoreArgument(2)
+        .ExpectedTimesExactly(2);
+    STRICT_EXPECTED_CALL(mocks, nn_send(IGNORED_NUM_ARG, IGNORED_PTR_ARG, NN_MSG, 0))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2)
+        .ExpectedTimesExactly(2);
+
+    ///act
+    result = Broker_PublishBatch(broker, fake_module_handle, messages, 2);
+
+    ///assert
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result, BROKER_OK);
+    mocks.AssertActualAndExpectedCalls();
+
+    ///cleanup
+    Message_Destroy(message);
+    Broker_RemoveModule(broker, &fake_module);
+    Broker_Destroy(broker);
+}
+
+//Tests_SRS_BROKER_30_082: [ In zero-copy mode `Broker_PublishBatch` shall look up the sinks of `source` once for the whole batch. ]
+//Tests_SRS_BROKER_30_083: [ `Broker_PublishBatch` shall queue the messages for each sink in the order they appear in `messages`, applying the sink's overflow policy to every message as `Broker_Publish` does. ]
+TEST_FUNCTION(Broker_PublishBatch_zero_copy_queues_every_message)
+{
+    ///arrange
+    CBrokerMocks mocks;
+    BROKER_CONFIG config = { BROKER_DELIVERY_ZERO_COPY };
+    auto broker = Broker_CreateWithConfig(&config);
+
+    unsigned char fake;
+    MESSAGE_CONFIG c = { 1, &fake, (MAP_HANDLE)&fake };
+    auto message = Message_Create(&c);
+    MESSAGE_HANDLE messages[3] = { message, message, message };
+
+    auto result = Broker_AddModule(broker, &fake_module);
+    BROKER_LINK_DATA bld =
+    {
+        fake_module_handle,
+        fake_module_handle
+    };
+    result = Broker_AddLink(broker, &bld);
+    mocks.ResetAllCalls();
+
+    STRICT_EXPECTED_CALL(mocks, Message_Clone(message))
+        .ExpectedTimesExactly(3);
+
+    ///act
+    result = Broker_PublishBatch(broker, fake_module_handle, messages, 3);
+
+    ///assert
+    BROKER_QUEUE_STATS stats;
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result, BROKER_OK);
+    mocks.AssertActualAndExpectedCalls();
+    ASSERT_ARE_EQUAL(BROKER_RESULT, Broker_GetSinkQueueStats(broker, fake_module_handle, &stats), BROKER_OK);
+    ASSERT_ARE_EQUAL(size_t, stats.queued, 3);
+    ASSERT_ARE_EQUAL(size_t, stats.dropped, 0);
+
+    ///cleanup
+    Message_Destroy(message);
+    Broker_RemoveModule(broker, &fake_module);
+    Broker_Destroy(broker);
+}
+
+//Tests_SRS_BROKER_30_083: [ `Broker_PublishBatch` shall queue the messages for each sink in the order they appear in `messages`, applying the sink's overflow policy to every message as `Broker_Publish` does. ]
+//Tests_SRS_BROKER_30_086: [ `Broker_PublishBatch` shall return `BROKER_ERROR` if publishing any of the messages failed or `BROKER_OK` otherwise. ]
+TEST_FUNCTION(Broker_PublishBatch_zero_copy_fails_when_queue_fills_up)
+{
+    ///arrange
+    CBrokerMocks mocks;
+    BROKER_CONFIG config = { BROKER_DELIVERY_ZERO_COPY, 2 };
+    auto broker = Broker_CreateWithConfig(&config);
+
+    unsigned char fake;
+    MESSAGE_CONFIG c = { 1, &fake, (MAP_HANDLE)&fake };
+    auto message = Message_Create(&c);
+    MESSAGE_HANDLE messages[3] = { message, message, message };
+
+    auto result = Broker_AddModule(broker, &fake_module);
+    BROKER_LINK_DATA bld =
+    {
+        fake_module_handle,
+        fake_module_handle
+    };
+    result = Broker_AddLink(broker, &bld);
+    mocks.ResetAllCalls();
+
+    STRICT_EXPECTED_CALL(mocks, Message_Clone(message))
+        .ExpectedTimesExactly(3);
+    STRICT_EXPECTED_CALL(mocks, Message_Destroy(message));
+
+    ///act
+    result = Broker_PublishBatch(broker, fake_module_handle, messages, 3);
+
+    ///assert
+    BROKER_QUEUE_STATS stats;
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result, BROKER_ERROR);
+    mocks.AssertActualAndExpectedCalls();
+    ASSERT_ARE_EQUAL(BROKER_RESULT, Broker_GetSinkQueueStats(broker, fake_module_handle, &stats), BROKER_OK);
+    ASSERT_ARE_EQUAL(size_t, stats.queued, 2);
+    ASSERT_ARE_EQUAL(size_t, stats.dropped, 1);
+
+    ///cleanup
+    Message_Destroy(message);
+    Broker_RemoveModule(broker, &fake_module);
+    Broker_Destroy(broker);
+}
+
+//Tests_SRS_BROKER_17_034: [ Upon an error, Broker_AddLink shall return BROKER_ADD_LINK_ERROR ]
+TEST_FUNCTION(Broker_AddLink_zero_copy_fails_when_route_cannot_be_allocated)
+{
+    ///arrange
+    CBrokerMocks mocks;
+    BROKER_CONFIG config = { BROKER_DELIVERY_ZERO_COPY };
+    auto broker = Broker_CreateWithConfig(&config);
+
+    unsigned char fake;
+    MESSAGE_CONFIG c = { 1, &fake, (MAP_HANDLE)&fake };
+    auto message = Message_Create(&c);
+
+    auto result = Broker_AddModule(broker, &fake_module);
+    BROKER_LINK_DATA bld =
+    {
+        fake_module_handle,
+        fake_module_handle
+    };
+    whenShallmalloc_fail = currentmalloc_call + 1;
+
+    ///act
+    result = Broker_AddLink(broker, &bld);
+    mocks.ResetAllCalls();
+    STRICT_EXPECTED_CALL(mocks, Message_Clone(message))
+        .NeverInvoked();
+    auto publish_result = Broker_Publish(broker, fake_module_handle, message);
+
+    ///assert
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result, BROKER_ADD_LINK_ERROR);
+    ASSERT_ARE_EQUAL(BROKER_RESULT, publish_result, BROKER_OK);
+    mocks.AssertActualAndExpectedCalls();
+
+    ///cleanup
+    Message_Destroy(message);
+    Broker_RemoveModule(broker, &fake_module);
+    Broker_Destroy(broker);
+}
+
+//Tests_SRS_BROKER_30_034: [ In zero-copy mode `Broker_Publish` shall look up the sinks of `source` in the current routing table without taking any lock. ]
+//Tests_SRS_BROKER_30_043: [ In zero-copy mode `Broker_AddLink` and `Broker_RemoveLink` shall build a new route for the source only and swap it in for `Broker_Publish`, freeing the route it replaces once no publisher can be reading it. ]
+TEST_FUNCTION(Broker_Publish_zero_copy_after_RemoveLink_delivers_nothing)
+{
+    ///arrange
+    CBrokerMocks mocks;
+    BROKER_CONFIG config = { BROKER_DELIVERY_ZERO_COPY };
+    auto broker = Broker_CreateWithConfig(&config);
+
+    unsigned char fake;
+    MESSAGE_CONFIG c = { 1, &fake, (MAP_HANDLE)&fake };
+    auto message = Message_Create(&c);
+
+    auto result = Broker_AddModule(broker, &fake_module);
+    BROKER_LINK_DATA bld =
+    {
+        fake_module_handle,
+        fake_module_handle
+    };
+    result = Broker_AddLink(broker, &bld);
+    result = Broker_RemoveLink(broker, &bld);
+    mocks.ResetAllCalls();
+
+    STRICT_EXPECTED_CALL(mocks, Message_Clone(message))
+        .NeverInvoked();
+
+    ///act
+    result = Broker_Publish(broker, fake_module_handle, message);
+
+    ///assert
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result, BROKER_OK);
+    mocks.AssertActualAndExpectedCalls();
+
+    ///cleanup
+    Message_Destroy(message);
+    Broker_RemoveModule(broker, &fake_module);
+    Broker_Destroy(broker);
+}
+
+//Tests_SRS_BROKER_30_020: [ When the queue is empty the zero-copy worker shall acquire the lock on `module_info->socket_lock`. ]
+//Tests_SRS_BROKER_30_021: [ If acquiring the lock fails, then the zero-copy worker shall return. ]
+//Tests_SRS_BROKER_30_024: [ The zero-copy worker shall dequeue the oldest message without taking any lock. ]
+//Tests_SRS_BROKER_30_025: [ The zero-copy worker shall deliver the message to the module's callback function without deserializing it. ]
+//Tests_SRS_BROKER_30_026: [ The zero-copy worker shall destroy the dequeued message by calling `Message_Destroy`. ]
+TEST_FUNCTION(module_queue_worker_delivers_queued_message_without_deserializing)
+{
+    ///arrange
+    CBrokerMocks mocks;
+    BROKER_CONFIG config = { BROKER_DELIVERY_ZERO_COPY };
+    auto broker = Broker_CreateWithConfig(&config);
+
+    unsigned char fake;
+    MESSAGE_CONFIG c = { 1, &fake, (MAP_HANDLE)&fake };
+    auto message = Message_Create(&c);
+    call_status_for_FakeModule_Receive.module = fake_module.module_handle;
+    call_status_for_FakeModule_Receive.messageHandle = message;
+
+    auto result = Broker_AddModule(broker, &fake_module);
+    BROKER_LINK_DATA bld =
+    {
+        fake_module_handle,
+        fake_module_handle
+    };
+    result = Broker_AddLink(broker, &bld);
+    result = Broker_Publish(broker, fake_module_handle, message);
+    mocks.ResetAllCalls();
+
+    STRICT_EXPECTED_CALL(mocks, Message_Destroy(message));
+    whenShallLock_fail = currentLock_call + 1;
+    STRICT_EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+
+    ///act
+    auto thread_result = thread_func_to_call(thread_func_args);
+
+    ///assert
+    ASSERT_ARE_EQUAL(int, thread_result, 0);
+    ASSERT_IS_TRUE(call_status_for_FakeModule_Receive.was_called);
+    mocks.AssertActualAndExpectedCalls();
+
+    ///cleanup
+    Message_Destroy(message);
+    Broker_RemoveModule(broker, &fake_module);
+    Broker_Destroy(broker);
+}
+
+//Tests_SRS_BROKER_30_023: [ The zero-copy worker shall flag itself as waiting and, unless a message was queued, its queue was retired or the worker was stopped in the meantime, wait on `module_info->queue_condition`. ]
+TEST_FUNCTION(module_queue_worker_waits_when_queue_is_empty)
+{
+    ///arrange
+    CBrokerMocks mocks;
+    BROKER_CONFIG config = { BROKER_DELIVERY_ZERO_COPY };
+    auto broker = Broker_CreateWithConfig(&config);
+    auto result = Broker_AddModule(broker, &fake_module);
+    mocks.ResetAllCalls();
+
+    STRICT_EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, Condition_Wait(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 0))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    whenShallLock_fail = currentLock_call + 2;
+    STRICT_EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+
+    ///act
+    auto thread_result = thread_func_to_call(thread_func_args);
+
+    ///assert
+    ASSERT_ARE_EQUAL(int, thread_result, 0);
+    mocks.AssertActualAndExpectedCalls();
+
+    ///cleanup
+    Broker_RemoveModule(broker, &fake_module);
+    Broker_Destroy(broker);
+}
+
+//Tests_SRS_BROKER_30_005: [ If `config->queue_capacity` is greater than 2^24, `Broker_CreateWithConfig` shall fail and return `NULL`. ]
+TEST_FUNCTION(Broker_CreateWithConfig_fails_with_too_large_queue_capacity)
+{
+    ///arrange
+    CBrokerMocks mocks;
+    BROKER_CONFIG config = { BROKER_DELIVERY_ZERO_COPY, ((size_t)1 << 24) + 1 };
+
+    ///act
+    auto r = Broker_CreateWithConfig(&config);
+
+    ///assert
+    ASSERT_IS_NULL(r);
+    mocks.AssertActualAndExpectedCalls();
+
+    ///cleanup
+}
+
+//Tests_SRS_BROKER_30_006: [ A `config->queue_capacity` of 0 shall select `BROKER_DEFAULT_QUEUE_CAPACITY`, any other value shall be rounded up to the next power of two. ]
+//Tests_SRS_BROKER_30_033: [ In zero-copy mode, if queuing the message for a sink fails, `Broker_Publish` shall still queue it for the remaining sinks and return `BROKER_ERROR`. ]
+//Tests_SRS_BROKER_30_035: [ If the clone cannot be queued, `Broker_Publish` shall destroy it, count it as dropped and treat the sink as failed. ]
+TEST_FUNCTION(Broker_Publish_zero_copy_fails_when_queue_is_full)
+{
+    ///arrange
+    CBrokerMocks mocks;
+    BROKER_CONFIG config = { BROKER_DELIVERY_ZERO_COPY, 3 };
+    auto broker = Broker_CreateWithConfig(&config);
+
+    unsigned char fake;
+    MESSAGE_CONFIG c = { 1, &fake, (MAP_HANDLE)&fake };
+    auto message = Message_Create(&c);
+
+    auto result = Broker_AddModule(broker, &fake_module);
+    BROKER_LINK_DATA bld =
+    {
+        fake_module_handle,
+        fake_module_handle
+    };
+    result = Broker_AddLink(broker, &bld);
+    BROKER_RESULT publish_results[5];
+    for (size_t i = 0; i < 4; i++)
+    {
+        publish_results[i] = Broker_Publish(broker, fake_module_handle, message);
+    }
+    mocks.ResetAllCalls();
+
+    STRICT_EXPECTED_CALL(mocks, Message_Clone(message));
+    STRICT_EXPECTED_CALL(mocks, Message_Destroy(message));
+
+    ///act
+    publish_results[4] = Broker_Publish(broker, fake_module_handle, message);
+
+    ///assert
+    for (size_t i = 0; i < 4; i++)
+    {
+        ASSERT_ARE_EQUAL(BROKER_RESULT, publish_results[i], BROKER_OK);
+    }
+    ASSERT_ARE_EQUAL(BROKER_RESULT, publish_results[4], BROKER_ERROR);
+    mocks.AssertActualAndExpectedCalls();
+
+    ///cleanup
+    Message_Destroy(message);
+    Broker_RemoveModule(broker, &fake_module);
+    Broker_Destroy(broker);
+}
+
+//Tests_SRS_BROKER_30_050: [ If `broker`, `sink` or `config` is `NULL`, `Broker_SetSinkQueue` shall return `BROKER_INVALIDARG`. ]
+TEST_FUNCTION(Broker_SetSinkQueue_fails_with_NULL_arguments)
+{
+    ///arrange
+    CBrokerMocks mocks;
+    BROKER_CONFIG config = { BROKER_DELIVERY_ZERO_COPY };
+    auto broker = Broker_CreateWithConfig(&config);
+    BROKER_QUEUE_CONFIG queue_config = { 8, BROKER_OVERFLOW_DROP_OLDEST, 0 };
+    mocks.ResetAllCalls();
+
+    ///act
+    auto result1 = Broker_SetSinkQueue(NULL, fake_module_handle, &queue_config);
+    auto result2 = Broker_SetSinkQueue(broker, NULL, &queue_config);
+    auto result3 = Broker_SetSinkQueue(broker, fake_module_handle, NULL);
+
+    ///assert
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result1, BROKER_INVALIDARG);
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result2, BROKER_INVALIDARG);
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result3, BROKER_INVALIDARG);
+    mocks.AssertActualAndExpectedCalls();
+
+    ///cleanup
+    Broker_Destroy(broker);
+}
+
+//Tests_SRS_BROKER_30_051: [ If `config->capacity` is greater than 2^24 or `config->overflow` is not a valid `BROKER_OVERFLOW_POLICY`, `Broker_SetSinkQueue` shall return `BROKER_INVALIDARG`. ]
+TEST_FUNCTION(Broker_SetSinkQueue_fails_with_invalid_config)
+{
+    ///arrange
+    CBrokerMocks mocks;
+    BROKER_CONFIG config = { BROKER_DELIVERY_ZERO_COPY };
+    auto broker = Broker_CreateWithConfig(&config);
+    auto result = Broker_AddModule(broker, &fake_module);
+    BROKER_QUEUE_CONFIG too_large = { ((size_t)1 << 24) + 1, BROKER_OVERFLOW_DROP_OLDEST, 0 };
+    BROKER_QUEUE_CONFIG bad_policy = { 8, (BROKER_OVERFLOW_POLICY)42, 0 };
+    mocks.ResetAllCalls();
+
+    ///act
+    auto result1 = Broker_SetSinkQueue(broker, fake_module_handle, &too_large);
+    auto result2 = Broker_SetSinkQueue(broker, fake_module_handle, &bad_policy);
+
+    ///assert
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result1, BROKER_INVALIDARG);
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result2, BROKER_INVALIDARG);
+    mocks.AssertActualAndExpectedCalls();
+
+    ///cleanup
+    Broker_RemoveModule(broker, &fake_module);
+    Broker_Destroy(broker);
+}
+
+//Tests_SRS_BROKER_30_052: [ If the broker does not use `BROKER_DELIVERY_ZERO_COPY`, `Broker_SetSinkQueue` shall return `BROKER_ERROR`. ]
+TEST_FUNCTION(Broker_SetSinkQueue_fails_for_serialized_broker)
+{
+    ///arrange
+    CBrokerMocks mocks;
+    auto broker = Broker_Create();
+    BROKER_QUEUE_CONFIG queue_config = { 8, BROKER_OVERFLOW_DROP_OLDEST, 0 };
+    mocks.ResetAllCalls();
+
+    ///act
+    auto result = Broker_SetSinkQueue(broker, fake_module_handle, &queue_config);
+
+    ///assert
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result, BROKER_ERROR);
+    mocks.AssertActualAndExpectedCalls();
+
+    ///cleanup
+    Broker_Destroy(broker);
+}
+
+//Tests_SRS_BROKER_30_053: [ If `sink` is not attached to the broker, `Broker_SetSinkQueue` shall return `BROKER_ERROR`. ]
+TEST_FUNCTION(Broker_SetSinkQueue_fails_for_unknown_sink)
+{
+    ///arrange
+    CBrokerMocks mocks;
+    BROKER_CONFIG config = { BROKER_DELIVERY_ZERO_COPY };
+    auto broker = Broker_CreateWithConfig(&config);
+    BROKER_QUEUE_CONFIG queue_config = { 8, BROKER_OVERFLOW_DROP_OLDEST, 0 };
+    mocks.ResetAllCalls();
+
+    STRICT_EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+
+    ///act
+    auto result = Broker_SetSinkQueue(broker, fake_module_handle, &queue_config);
+
+    ///assert
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result, BROKER_ERROR);
+    mocks.AssertActualAndExpectedCalls();
+
+    ///cleanup
+    Broker_Destroy(broker);
+}
+
+//Tests_SRS_BROKER_30_056: [ `Broker_SetSinkQueue` shall create a new message queue for the sink and fail with `BROKER_ERROR` if that fails. ]
+//Tests_SRS_BROKER_30_057: [ `Broker_SetSinkQueue` shall swap in the new queue for `Broker_Publish`, wait until no publisher can be using the previous one and hand the previous one to the worker to drain and free. ]
+//Tests_SRS_BROKER_30_058: [ `Broker_SetSinkQueue` shall signal the sink's `queue_condition` while holding its `socket_lock`. ]
+TEST_FUNCTION(Broker_SetSinkQueue_replaces_the_queue)
+{
+    ///arrange
+    CBrokerMocks mocks;
+    BROKER_CONFIG config = { BROKER_DELIVERY_ZERO_COPY };
+    auto broker = Broker_CreateWithConfig(&config);
+    auto result = Broker_AddModule(broker, &fake_module);
+    BROKER_QUEUE_CONFIG queue_config = { 8, BROKER_OVERFLOW_DROP_OLDEST, 0 };
+    mocks.ResetAllCalls();
+
+    STRICT_EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is for the new message queue*/
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, Condition_Post(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+
+    ///act
+    result = Broker_SetSinkQueue(broker, fake_module_handle, &queue_config);
+
+    ///assert
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result, BROKER_OK);
+    mocks.AssertActualAndExpectedCalls();
+
+    ///cleanup
+    Broker_RemoveModule(broker, &fake_module);
+    Broker_Destroy(broker);
+}
+
+//Tests_SRS_BROKER_30_054: [ If the sink's queue already has the requested capacity and policy, `Broker_SetSinkQueue` shall leave it as it is and return `BROKER_OK`. ]
+//Tests_SRS_BROKER_30_059: [ A `config->capacity` of 0 shall select `BROKER_HANDLE_DATA::queue_capacity`, any other value shall be rounded up to the next power of two; a `config->sample_interval` of 0 shall select 2. ]
+TEST_FUNCTION(Broker_SetSinkQueue_with_current_config_does_nothing)
+{
+    ///arrange
+    CBrokerMocks mocks;
+    BROKER_CONFIG config = { BROKER_DELIVERY_ZERO_COPY, 16 };
+    auto broker = Broker_CreateWithConfig(&config);
+    auto result = Broker_AddModule(broker, &fake_module);
+    BROKER_QUEUE_CONFIG default_config = { 0, BROKER_OVERFLOW_DROP_NEWEST, 0 };
+    BROKER_QUEUE_CONFIG rounded_config = { 9, BROKER_OVERFLOW_DROP_NEWEST, 2 };
+    mocks.ResetAllCalls();
+
+    STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
+        .IgnoreArgument(1)
+        .NeverInvoked();
+
+    ///act
+    auto result1 = Broker_SetSinkQueue(broker, fake_module_handle, &default_config);
+    auto result2 = Broker_SetSinkQueue(broker, fake_module_handle, &rounded_config);
+
+    ///assert
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result1, BROKER_OK);
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result2, BROKER_OK);
+
+    ///cleanup
+    Broker_RemoveModule(broker, &fake_module);
+    Broker_Destroy(broker);
+}
+
+//Tests_SRS_BROKER_30_055: [ If the worker has not finished delivering the messages of a queue replaced earlier, `Broker_SetSinkQueue` shall fail and return `BROKER_ERROR`. ]
+TEST_FUNCTION(Broker_SetSinkQueue_fails_while_previous_queue_is_drained)
+{
+    ///arrange
+    CBrokerMocks mocks;
+    BROKER_CONFIG config = { BROKER_DELIVERY_ZERO_COPY };
+    auto broker = Broker_CreateWithConfig(&config);
+    auto result = Broker_AddModule(broker, &fake_module);
+    BROKER_QUEUE_CONFIG first_config = { 8, BROKER_OVERFLOW_DROP_OLDEST, 0 };
+    BROKER_QUEUE_CONFIG second_config = { 8, BROKER_OVERFLOW_BLOCK, 0 };
+    result = Broker_SetSinkQueue(broker, fake_module_handle, &first_config);
+    mocks.ResetAllCalls();
+
+    STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
+        .IgnoreArgument(1)
+        .NeverInvoked();
+
+    ///act
+    result = Broker_SetSinkQueue(broker, fake_module_handle, &second_config);
+
+    ///assert
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result, BROKER_ERROR);
+
+    ///cleanup
+    Broker_RemoveModule(broker, &fake_module);
+    Broker_Destroy(broker);
+}
+
+//Tests_SRS_BROKER_30_028: [ Once a queue replaced by `Broker_SetSinkQueue` is empty, the zero-copy worker shall free it and continue with the new queue. ]
+TEST_FUNCTION(module_queue_worker_frees_replaced_queue)
+{
+    ///arrange
+    CBrokerMocks mocks;
+    BROKER_CONFIG config = { BROKER_DELIVERY_ZERO_COPY };
+    auto broker = Broker_CreateWithConfig(&config);
+    auto result = Broker_AddModule(broker, &fake_module);
+    BROKER_QUEUE_CONFIG first_config = { 8, BROKER_OVERFLOW_DROP_OLDEST, 0 };
+    BROKER_QUEUE_CONFIG second_config = { 8, BROKER_OVERFLOW_BLOCK, 0 };
+    result = Broker_SetSinkQueue(broker, fake_module_handle, &first_config);
+    mocks.ResetAllCalls();
+
+    STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)) /*the replaced message queue*/
+        .IgnoreArgument(1);
+    whenShallLock_fail = currentLock_call + 1;
+    STRICT_EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+
+    ///act
+    auto thread_result = thread_func_to_call(thread_func_args);
+    mocks.AssertActualAndExpectedCalls();
+    result = Broker_SetSinkQueue(broker, fake_module_handle, &second_config);
+
+    ///assert
+    ASSERT_ARE_EQUAL(int, thread_result, 0);
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result, BROKER_OK);
+
+    ///cleanup
+    Broker_RemoveModule(broker, &fake_module);
+    Broker_Destroy(broker);
+}
+
+//Tests_SRS_BROKER_30_029: [ Until `Broker_SetSinkQueue` hands it the queue it replaced, the zero-copy worker shall take one message at a time off the new queue and deliver it after the messages still left on the replaced queue. ]
+//Tests_SRS_BROKER_30_057: [ `Broker_SetSinkQueue` shall swap in the new queue for `Broker_Publish`, wait until no publisher can be using the previous one and hand the previous one to the worker to drain and free. ]
+TEST_FUNCTION(Broker_SetSinkQueue_returns_while_a_publisher_blocks_on_the_new_queue)
+{
+    ///arrange
+    CBrokerMocks mocks;
+    BROKER_CONFIG config = { BROKER_DELIVERY_ZERO_COPY };
+    auto broker = Broker_CreateWithConfig(&config);
+
+    unsigned char fake;
+    MESSAGE_CONFIG c = { 1, &fake, (MAP_HANDLE)&fake };
+    auto message = Message_Create(&c);
+
+    /*the source queues for modules[1] before modules[2], the sink resized;
+      thread_func_to_call is the worker of the sink, added last*/
+    MODULE modules[3];
+    const size_t module_count = sizeof(modules) / sizeof(modules[0]);
+    for (size_t i = 0; i < module_count; i++)
+    {
+        modules[i].module_apis = fake_module.module_apis;
+        modules[i].module_handle = (MODULE_HANDLE)(0x201 + i);
+        (void)Broker_AddModule(broker, &modules[i]);
+    }
+    for (size_t i = 1; i < module_count; i++)
+    {
+        BROKER_LINK_DATA bld =
+        {
+            modules[0].module_handle,
+            modules[i].module_handle
+        };
+        (void)Broker_AddLink(broker, &bld);
+    }
+    MODULE_HANDLE sink = modules[2].module_handle;
+    call_status_for_FakeModule_Receive.module = sink;
+
+    BROKER_QUEUE_CONFIG queue_config = { 1, BROKER_OVERFLOW_BLOCK, 0 };
+    BROKER_RESULT resize_result = BROKER_ERROR;
+    BROKER_RESULT fill_result = BROKER_ERROR;
+    int worker_result = -1;
+    std::thread resizer;
+    std::thread worker;
+
+    /*while the publisher queues for modules[1] it still holds the routing it
+      looked up, so Broker_SetSinkQueue cannot hand the replaced queue to the
+      worker before it returns. Another publish fills the new queue, and once
+      the publisher blocks on it the worker starts.*/
+    on_Message_Clone = [&]()
+    {
+        BROKER_QUEUE_STATS stats;
+        resizer = std::thread([&]()
+        {
+            resize_result = Broker_SetSinkQueue(broker, sink, &queue_config);
+        });
+        do
+        {
+            std::this_thread::yield();
+            (void)Broker_GetSinkQueueStats(broker, sink, &stats);
+        } while (stats.capacity != 1);
+        fill_result = Broker_Publish(broker, modules[0].module_handle, message);
+
+        worker = std::thread([&]()
+        {
+            BROKER_QUEUE_STATS worker_stats;
+            do
+            {
+                std::this_thread::yield();
+                (void)Broker_GetSinkQueueStats(broker, sink, &worker_stats);
+            } while (worker_stats.blocked == 0);
+            worker_result = thread_func_to_call(thread_func_args);
+        });
+    };
+    mocks.ResetAllCalls();
+
+    ///act
+    auto publish_result = Broker_Publish(broker, modules[0].module_handle, message);
+    resizer.join();
+
+    /*the worker delivers the last message, then goes back to Lock to wait*/
+    BROKER_QUEUE_STATS stats;
+    do
+    {
+        std::this_thread::yield();
+        (void)Broker_GetSinkQueueStats(broker, sink, &stats);
+    } while (stats.queued != 0);
+    shallLock_fail_always = true;
+    worker.join();
+    shallLock_fail_always = false;
+
+    ///assert
+    ASSERT_ARE_EQUAL(BROKER_RESULT, publish_result, BROKER_OK);
+    ASSERT_ARE_EQUAL(BROKER_RESULT, fill_result, BROKER_OK);
+    ASSERT_ARE_EQUAL(BROKER_RESULT, resize_result, BROKER_OK);
+    ASSERT_ARE_EQUAL(int, worker_result, 0);
+    ASSERT_ARE_EQUAL(size_t, fake_received_count, 2);
+    ASSERT_ARE_EQUAL(BROKER_RESULT, Broker_GetSinkQueueStats(broker, sink, &stats), BROKER_OK);
+    ASSERT_ARE_EQUAL(size_t, stats.capacity, 1);
+    ASSERT_ARE_EQUAL(size_t, stats.blocked, 1);
+
+    ///cleanup
+    Message_Destroy(message);
+    for (size_t i = 0; i < module_count; i++)
+    {
+        Broker_RemoveModule(broker, &modules[i]);
+    }
+    Broker_Destroy(broker);
+}
+
+//Tests_SRS_BROKER_30_038: [ If the sink's message queue is full and its policy is `BROKER_OVERFLOW_DROP_OLDEST`, `Broker_Publish` shall destroy the oldest queued message, count it as dropped and queue the clone. ]
+TEST_FUNCTION(Broker_Publish_zero_copy_drop_oldest_makes_room)
+{
+    ///arrange
+    CBrokerMocks mocks;
+    BROKER_CONFIG config = { BROKER_DELIVERY_ZERO_COPY };
+    auto broker = Broker_CreateWithConfig(&config);
+
+    unsigned char fake;
+    MESSAGE_CONFIG c = { 1, &fake, (MAP_HANDLE)&fake };
+    auto message = Message_Create(&c);
+
+    auto result = Broker_AddModule(broker, &fake_module);
+    BROKER_LINK_DATA bld =
+    {
+        fake_module_handle,
+        fake_module_handle
+    };
+    result = Broker_AddLink(broker, &bld);
+    BROKER_QUEUE_CONFIG queue_config = { 2, BROKER_OVERFLOW_DROP_OLDEST, 0 };
+    result = Broker_SetSinkQueue(broker, fake_module_handle, &queue_config);
+    (void)Broker_Publish(broker, fake_module_handle, message);
+    (void)Broker_Publish(broker, fake_module_handle, message);
+    mocks.ResetAllCalls();
+
+    STRICT_EXPECTED_CALL(mocks, Message_Clone(message));
+    STRICT_EXPECTED_CALL(mocks, Message_Destroy(message));
+
+    ///act
+    result = Broker_Publish(broker, fake_module_handle, message);
+
+    ///assert
+    BROKER_QUEUE_STATS stats;
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result, BROKER_OK);
+    mocks.AssertActualAndExpectedCalls();
+    ASSERT_ARE_EQUAL(BROKER_RESULT, Broker_GetSinkQueueStats(broker, fake_module_handle, &stats), BROKER_OK);
+    ASSERT_ARE_EQUAL(size_t, stats.capacity, 2);
+    ASSERT_ARE_EQUAL(size_t, stats.queued, 2);
+    ASSERT_ARE_EQUAL(size_t, stats.dropped, 1);
+    ASSERT_ARE_EQUAL(size_t, stats.blocked, 0);
+
+    ///cleanup
+    Message_Destroy(message);
+    Broker_RemoveModule(broker, &fake_module);
+    Broker_Destroy(broker);
+}
+
+//Tests_SRS_BROKER_30_037: [ If the sink's policy is `BROKER_OVERFLOW_SAMPLE` and its message queue is at least half full, `Broker_Publish` shall only queue one message in `sample_interval` for the sink and count the others as dropped without failing. ]
+TEST_FUNCTION(Broker_Publish_zero_copy_sample_sheds_load_once_half_full)
+{
+    ///arrange
+    CBrokerMocks mocks;
+    BROKER_CONFIG config = { BROKER_DELIVERY_ZERO_COPY };
+    auto broker = Broker_CreateWithConfig(&config);
+
+    unsigned char fake;
+    MESSAGE_CONFIG c = { 1, &fake, (MAP_HANDLE)&fake };
+    auto message = Message_Create(&c);
+
+    auto result = Broker_AddModule(broker, &fake_module);
+    BROKER_LINK_DATA bld =
+    {
+        fake_module_handle,
+        fake_module_handle
+    };
+    result = Broker_AddLink(broker, &bld);
+    BROKER_QUEUE_CONFIG queue_config = { 4, BROKER_OVERFLOW_SAMPLE, 2 };
+    result = Broker_SetSinkQueue(broker, fake_module_handle, &queue_config);
+    mocks.ResetAllCalls();
+
+    /*2 messages fill half the queue, then one in two is queued until it is full*/
+    STRICT_EXPECTED_CALL(mocks, Message_Clone(message))
+        .ExpectedTimesExactly(4);
+
+    ///act
+    BROKER_RESULT publish_results[6];
+    for (size_t i = 0; i < 6; i++)
+    {
+        publish_results[i] = Broker_Publish(broker, fake_module_handle, message);
+    }
+
+    ///assert
+    BROKER_QUEUE_STATS stats;
+    for (size_t i = 0; i < 6; i++)
+    {
+        ASSERT_ARE_EQUAL(BROKER_RESULT, publish_results[i], BROKER_OK);
+    }
+    mocks.AssertActualAndExpectedCalls();
+    ASSERT_ARE_EQUAL(BROKER_RESULT, Broker_GetSinkQueueStats(broker, fake_module_handle, &stats), BROKER_OK);
+    ASSERT_ARE_EQUAL(size_t, stats.queued, 4);
+    ASSERT_ARE_EQUAL(size_t, stats.dropped, 2);
+
+    ///cleanup
+    Message_Destroy(message);
+    Broker_RemoveModule(broker, &fake_module);
+    Broker_Destroy(broker);
+}
+
+//Tests_SRS_BROKER_30_039: [ If the sink's message queue is full and its policy is `BROKER_OVERFLOW_BLOCK`, `Broker_Publish` shall count the wait and wait on the sink's `space_condition` until the clone can be queued. ]
+TEST_FUNCTION(Broker_Publish_zero_copy_block_fails_when_Lock_fails)
+{
+    ///arrange
+    CBrokerMocks mocks;
+    BROKER_CONFIG config = { BROKER_DELIVERY_ZERO_COPY };
+    auto broker = Broker_CreateWithConfig(&config);
+
+    unsigned char fake;
+    MESSAGE_CONFIG c = { 1, &fake, (MAP_HANDLE)&fake };
+    auto message = Message_Create(&c);
+
+    auto result = Broker_AddModule(broker, &fake_module);
+    BROKER_LINK_DATA bld =
+    {
+        fake_module_handle,
+        fake_module_handle
+    };
+    result = Broker_AddLink(broker, &bld);
+    BROKER_QUEUE_CONFIG queue_config = { 1, BROKER_OVERFLOW_BLOCK, 0 };
+    result = Broker_SetSinkQueue(broker, fake_module_handle, &queue_config);
+    (void)Broker_Publish(broker, fake_module_handle, message);
+    mocks.ResetAllCalls();
+
+    STRICT_EXPECTED_CALL(mocks, Message_Clone(message));
+    whenShallLock_fail = currentLock_call + 1;
+    STRICT_EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, Message_Destroy(message));
+
+    ///act
+    result = Broker_Publish(broker, fake_module_handle, message);
+
+    ///assert
+    BROKER_QUEUE_STATS stats;
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result, BROKER_ERROR);
+    mocks.AssertActualAndExpectedCalls();
+    ASSERT_ARE_EQUAL(BROKER_RESULT, Broker_GetSinkQueueStats(broker, fake_module_handle, &stats), BROKER_OK);
+    ASSERT_ARE_EQUAL(size_t, stats.queued, 1);
+    ASSERT_ARE_EQUAL(size_t, stats.dropped, 1);
+    ASSERT_ARE_EQUAL(size_t, stats.blocked, 1);
+
+    ///cleanup
+    Message_Destroy(message);
+    Broker_RemoveModule(broker, &fake_module);
+    Broker_Destroy(broker);
+}
+
+//Tests_SRS_BROKER_30_060: [ If `broker`, `sink` or `stats` is `NULL`, `Broker_GetSinkQueueStats` shall return `BROKER_INVALIDARG`. ]
+TEST_FUNCTION(Broker_GetSinkQueueStats_fails_with_NULL_arguments)
+{
+    ///arrange
+    CBrokerMocks mocks;
+    BROKER_CONFIG config = { BROKER_DELIVERY_ZERO_COPY };
+    auto broker = Broker_CreateWithConfig(&config);
+    BROKER_QUEUE_STATS stats;
+    mocks.ResetAllCalls();
+
+    ///act
+    auto result1 = Broker_GetSinkQueueStats(NULL, fake_module_handle, &stats);
+    auto result2 = Broker_GetSinkQueueStats(broker, NULL, &stats);
+    auto result3 = Broker_GetSinkQueueStats(broker, fake_module_handle, NULL);
+
+    ///assert
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result1, BROKER_INVALIDARG);
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result2, BROKER_INVALIDARG);
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result3, BROKER_INVALIDARG);
+    mocks.AssertActualAndExpectedCalls();
+
+    ///cleanup
+    Broker_Destroy(broker);
+}
+
+//Tests_SRS_BROKER_30_061: [ If the broker does not use `BROKER_DELIVERY_ZERO_COPY`, `Broker_GetSinkQueueStats` shall return `BROKER_ERROR`. ]
+TEST_FUNCTION(Broker_GetSinkQueueStats_fails_for_serialized_broker)
+{
+    ///arrange
+    CBrokerMocks mocks;
+    auto broker = Broker_Create();
+    BROKER_QUEUE_STATS stats;
+    mocks.ResetAllCalls();
+
+    ///act
+    auto result = Broker_GetSinkQueueStats(broker, fake_module_handle, &stats);
+
+    ///assert
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result, BROKER_ERROR);
+    mocks.AssertActualAndExpectedCalls();
+
+    ///cleanup
+    Broker_Destroy(broker);
+}
+
+//Tests_SRS_BROKER_30_062: [ If `sink` is not attached to the broker, `Broker_GetSinkQueueStats` shall return `BROKER_ERROR`. ]
+TEST_FUNCTION(Broker_GetSinkQueueStats_fails_for_unknown_sink)
+{
+    ///arrange
+    CBrokerMocks mocks;
+    BROKER_CONFIG config = { BROKER_DELIVERY_ZERO_COPY };
+    auto broker = Broker_CreateWithConfig(&config);
+    BROKER_QUEUE_STATS stats;
+    mocks.ResetAllCalls();
+
+    ///act
+    auto result = Broker_GetSinkQueueStats(broker, fake_module_handle, &stats);
+
+    ///assert
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result, BROKER_ERROR);
+
+    ///cleanup
+    Broker_Destroy(broker);
+}
+
+//Tests_SRS_BROKER_30_035: [ If the clone cannot be queued, `Broker_Publish` shall destroy it, count it as dropped and treat the sink as failed. ]
+//Tests_SRS_BROKER_30_063: [ `Broker_GetSinkQueueStats` shall fill `stats` with the capacity of the sink's queue, the number of messages waiting in it and the sink's drop and wait counters, then return `BROKER_OK`. ]
+TEST_FUNCTION(Broker_GetSinkQueueStats_counts_messages_dropped_by_full_queue)
+{
+    ///arrange
+    CBrokerMocks mocks;
+    BROKER_CONFIG config = { BROKER_DELIVERY_ZERO_COPY, 2 };
+    auto broker = Broker_CreateWithConfig(&config);
+
+    unsigned char fake;
+    MESSAGE_CONFIG c = { 1, &fake, (MAP_HANDLE)&fake };
+    auto message = Message_Create(&c);
+
+    auto result = Broker_AddModule(broker, &fake_module);
+    BROKER_LINK_DATA bld =
+    {
+        fake_module_handle,
+        fake_module_handle
+    };
+    result = Broker_AddLink(broker, &bld);
+    for (size_t i = 0; i < 5; i++)
+    {
+        (void)Broker_Publish(broker, fake_module_handle, message);
+    }
+    BROKER_QUEUE_STATS stats;
+    mocks.ResetAllCalls();
+
+    STRICT_EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+
+    ///act
+    result = Broker_GetSinkQueueStats(broker, fake_module_handle, &stats);
+
+    ///assert
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result, BROKER_OK);
+    mocks.AssertActualAndExpectedCalls();
+    ASSERT_ARE_EQUAL(size_t, stats.capacity, 2);
+    ASSERT_ARE_EQUAL(size_t, stats.queued, 2);
+    ASSERT_ARE_EQUAL(size_t, stats.priority_queued, 0);
+    ASSERT_ARE_EQUAL(size_t, stats.dropped, 3);
+    ASSERT_ARE_EQUAL(size_t, stats.blocked, 0);
+
+    ///cleanup
+    Message_Destroy(message);
+    Broker_RemoveModule(broker, &fake_module);
+    Broker_Destroy(broker);
+}
+
+//Tests_SRS_BROKER_30_070: [ If `config->batch_size` is greater than 2^24, `Broker_CreateWithConfig` shall fail and return `NULL`. ]
+TEST_FUNCTION(Broker_CreateWithConfig_fails_with_too_large_batch_size)
+{
+    ///arrange
+    CBrokerMocks mocks;
+    BROKER_CONFIG config = { BROKER_DELIVERY_ZERO_COPY, 0, ((size_t)1 << 24) + 1 };
+
+    ///act
+    auto r = Broker_CreateWithConfig(&config);
+
+    ///assert
+    ASSERT_IS_NULL(r);
+    mocks.AssertActualAndExpectedCalls();
+
+    ///cleanup
+}
+
+//Tests_SRS_BROKER_30_072: [ If the module's `MODULE_API` is `MODULE_API_VERSION_2` or later and has a `Module_ReceiveBatch`, the function shall allocate room for `batch_size` messages to hand to it. ]
+//Tests_SRS_BROKER_13_047: [This function shall return BROKER_ERROR if an underlying API call to the platform causes an error or BROKER_OK otherwise.]
+TEST_FUNCTION(Broker_AddModule_fails_when_batch_alloc_fails)
+{
+    ///arrange
+    CBrokerMocks mocks;
+    auto broker = Broker_Create();
+    mocks.ResetAllCalls();
+
+    STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is for the module_info*/
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is for the module struct*/
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, Lock_Init());
+    STRICT_EXPECTED_CALL(mocks, Lock_Deinit(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, UniqueId_Generate(IGNORED_PTR_ARG, 37))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, STRING_construct(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, gballoc_malloc(BROKER_DEFAULT_BATCH_SIZE * sizeof(MESSAGE_HANDLE))); /*this is for the batch*/
+    whenShallmalloc_fail = currentmalloc_call + 3;
+
+    ///act
+    auto result = Broker_AddModule(broker, &fake_batch_module);
+
+    ///assert
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result, BROKER_ERROR);
+    mocks.AssertActualAndExpectedCalls();
+
+    ///cleanup
+    Broker_Destroy(broker);
+}
+
+//Tests_SRS_BROKER_30_073: [ Once it received a message for a module with a `Module_ReceiveBatch`, the worker shall receive every message already waiting on the receive_socket, without waiting, until it holds `batch_size` messages. ]
+//Tests_SRS_BROKER_30_074: [ The worker shall hand the messages to `Module_ReceiveBatch` in the order they were published and destroy each of them by calling `Message_Destroy` once it returns. ]
+TEST_FUNCTION(module_publish_worker_hands_waiting_messages_to_ReceiveBatch)
+{
+    CBrokerMocks mocks;
+    auto broker = Broker_Create();
+    auto add_result = Broker_AddModule(broker, &fake_batch_module);
+    mocks.ResetAllCalls();
+
+    //loop 1, the first message
+    STRICT_EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, nn_recv(IGNORED_NUM_ARG, IGNORED_PTR_ARG, NN_MSG, 0))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, Message_CreateFromByteArrayNoCopy(IGNORED_PTR_ARG, IGNORED_NUM_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
+    STRICT_EXPECTED_CALL(mocks, nn_freemsg(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    // a second message is waiting
+    STRICT_EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, nn_recv(IGNORED_NUM_ARG, IGNORED_PTR_ARG, NN_MSG, NN_DONTWAIT))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, Message_CreateFromByteArrayNoCopy(IGNORED_PTR_ARG, IGNORED_NUM_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
+    STRICT_EXPECTED_CALL(mocks, nn_freemsg(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    // then nothing
+    STRICT_EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, nn_recv(IGNORED_NUM_ARG, IGNORED_PTR_ARG, NN_MSG, NN_DONTWAIT))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2)
+        .SetFailReturn(-1);
+    STRICT_EXPECTED_CALL(mocks, Message_Destroy(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, Message_Destroy(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+
+    //loop 2
+    STRICT_EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, nn_recv(IGNORED_NUM_ARG, IGNORED_PTR_ARG, NN_MSG, 0))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2)
+        .SetReturn(37);
+    STRICT_EXPECTED_CALL(mocks, nn_freemsg(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .SetFailReturn("nn_recv");
+
+    ///act
+    auto result = thread_func_to_call(thread_func_args);
+
+    ///assert
+    ASSERT_ARE_EQUAL(int, result, 0);
+    ASSERT_ARE_EQUAL(size_t, 1, fake_batch_call_count);
+    ASSERT_ARE_EQUAL(size_t, 2, fake_batch_message_count);
+    ASSERT_IS_FALSE(call_status_for_FakeModule_Receive.was_called);
+    mocks.AssertActualAndExpectedCalls();
+
+    ///cleanup
+    Broker_RemoveModule(broker, &fake_batch_module);
+    Broker_Destroy(broker);
+}
+
+//Tests_SRS_BROKER_30_075: [ If the quit message is among them, the worker shall deliver the messages received before it and return. ]
+TEST_FUNCTION(module_publish_worker_delivers_batch_before_quitting)
+{
+    CBrokerMocks mocks;
+    auto broker = Broker_Create();
+    auto add_result = Broker_AddModule(broker, &fake_batch_module);
+    mocks.ResetAllCalls();
+
+    STRICT_EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, nn_recv(IGNORED_NUM_ARG, IGNORED_PTR_ARG, NN_MSG, 0))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, Message_CreateFromByteArrayNoCopy(IGNORED_PTR_ARG, IGNORED_NUM_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
+    STRICT_EXPECTED_CALL(mocks, nn_freemsg(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    // the quit message is waiting behind it
+    STRICT_EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, nn_recv(IGNORED_NUM_ARG, IGNORED_PTR_ARG, NN_MSG, NN_DONTWAIT))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2)
+        .SetReturn(37);
+    STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .SetFailReturn("nn_recv");
+    STRICT_EXPECTED_CALL(mocks, nn_freemsg(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, Message_Destroy(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+
+    ///act
+    auto result = thread_func_to_call(thread_func_args);
+
+    ///assert
+    ASSERT_ARE_EQUAL(int, result, 0);
+    ASSERT_ARE_EQUAL(size_t, 1, fake_batch_call_count);
+    ASSERT_ARE_EQUAL(size_t, 1, fake_batch_message_count);
+    mocks.AssertActualAndExpectedCalls();
+
+    ///cleanup
+    Broker_RemoveModule(broker, &fake_batch_module);
+    Broker_Destroy(broker);
+}
+
+//Tests_SRS_BROKER_30_076: [ Once it dequeued a message for a module with a `Module_ReceiveBatch`, the zero-copy worker shall dequeue more until it holds `batch_size` messages or the queue is empty. ]
+//Tests_SRS_BROKER_30_074: [ The worker shall hand the messages to `Module_ReceiveBatch` in the order they were published and destroy each of them by calling `Message_Destroy` once it returns. ]
+TEST_FUNCTION(module_queue_worker_hands_queued_messages_to_ReceiveBatch)
+{
+    ///arrange
+    CBrokerMocks mocks;
+    BROKER_CONFIG config = { BROKER_DELIVERY_ZERO_COPY, 0, 2 };
+    auto broker = Broker_CreateWithConfig(&config);
+
+    unsigned char fake;
+    MESSAGE_CONFIG c = { 1, &fake, (MAP_HANDLE)&fake };
+    auto message = Message_Create(&c);
+
+    auto result = Broker_AddModule(broker, &fake_batch_module);
+    BROKER_LINK_DATA bld =
+    {
+        fake_batch_module_handle,
+        fake_batch_module_handle
+    };
+    result = Broker_AddLink(broker, &bld);
+    result = Broker_Publish(broker, fake_batch_module_handle, message);
+    result = Broker_Publish(broker, fake_batch_module_handle, message);
+    result = Broker_Publish(broker, fake_batch_module_handle, message);
+    mocks.ResetAllCalls();
+
+    STRICT_EXPECTED_CALL(mocks, Message_Destroy(message));
+    STRICT_EXPECTED_CALL(mocks, Message_Destroy(message));
+    STRICT_EXPECTED_CALL(mocks, Message_Destroy(message));
+    whenShallLock_fail = currentLock_call + 1;
+    STRICT_EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+
+    ///act
+    auto thread_result = thread_func_to_call(thread_func_args);
+
+    ///assert
+    ASSERT_ARE_EQUAL(int, thread_result, 0);
+    ASSERT_ARE_EQUAL(size_t, 2, fake_batch_call_count);
+    ASSERT_ARE_EQUAL(size_t, 3, fake_batch_message_count);
+    ASSERT_IS_FALSE(call_status_for_FakeModule_Receive.was_called);
+    mocks.AssertActualAndExpectedCalls();
+
+    ///cleanup
+    Message_Destroy(message);
+    Broker_RemoveModule(broker, &fake_batch_module);
+    Broker_Destroy(broker);
+}
+
+//Tests_SRS_BROKER_30_077: [ If the batch is not full and `batch_window_ms` is not 0, the zero-copy worker shall wait on `queue_condition` for `batch_window_ms` milliseconds, without flagging itself as waiting, and dequeue more messages before delivering the batch. ]
+TEST_FUNCTION(module_queue_worker_waits_batch_window_before_delivering)
+{
+    ///arrange
+    CBrokerMocks mocks;
+    BROKER_CONFIG config = { BROKER_DELIVERY_ZERO_COPY, 0, 0, 5 };
+    auto broker = Broker_CreateWithConfig(&config);
+
+    unsigned char fake;
+    MESSAGE_CONFIG c = { 1, &fake, (MAP_HANDLE)&fake };
+    auto message = Message_Create(&c);
+
+    auto result = Broker_AddModule(broker, &fake_batch_module);
+    BROKER_LINK_DATA bld =
+    {
+        fake_batch_module_handle,
+        fake_batch_module_handle
+    };
+    result = Broker_AddLink(broker, &bld);
+    result = Broker_Publish(broker, fake_batch_module_handle, message);
+    mocks.ResetAllCalls();
+
+    STRICT_EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, Condition_Wait(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 5))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, Message_Destroy(message));
+    whenShallLock_fail = currentLock_call + 2;
+    STRICT_EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+
+    ///act
+    auto thread_result = thread_func_to_call(thread_func_args);
+
+    ///assert
+    ASSERT_ARE_EQUAL(int, thread_result, 0);
+    ASSERT_ARE_EQUAL(size_t, 1, fake_batch_call_count);
+    ASSERT_ARE_EQUAL(size_t, 1, fake_batch_message_count);
+    mocks.AssertActualAndExpectedCalls();
+
+    ///cleanup
+    Message_Destroy(message);
+    Broker_RemoveModule(broker, &fake_batch_module);
+    Broker_Destroy(broker);
+}
+
+//Tests_SRS_BROKER_30_100: [ If `config->scheduler` is not a valid `BROKER_SCHEDULER`, `Broker_CreateWithConfig` shall fail and return `NULL`. ]
+TEST_FUNCTION(Broker_CreateWithConfig_fails_with_invalid_scheduler)
+{
+    ///arrange
+    CBrokerMocks mocks;
+    BROKER_CONFIG config = { BROKER_DELIVERY_ZERO_COPY, 0, 0, 0, (BROKER_SCHEDULER)42 };
+
+    ///act
+    auto r = Broker_CreateWithConfig(&config);
+
+    ///assert
+    ASSERT_IS_NULL(r);
+    mocks.AssertActualAndExpectedCalls();
+
+    ///cleanup
+}
+
+//Tests_SRS_BROKER_30_101: [ If `config->worker_count` is greater than `BROKER_MAX_WORKER_COUNT`, `Broker_CreateWithConfig` shall fail and return `NULL`. ]
+TEST_FUNCTION(Broker_CreateWithConfig_fails_with_too_many_workers)
+{
+    ///arrange
+    CBrokerMocks mocks;
+    BROKER_CONFIG config = { BROKER_DELIVERY_ZERO_COPY, 0, 0, 0, BROKER_SCHEDULER_THREAD_POOL, BROKER_MAX_WORKER_COUNT + 1 };
+
+    ///act
+    auto r = Broker_CreateWithConfig(&config);
+
+    ///assert
+    ASSERT_IS_NULL(r);
+    mocks.AssertActualAndExpectedCalls();
+
+    ///cleanup
+}
+
+//Tests_SRS_BROKER_30_102: [ If `config->delivery_mode` is `BROKER_DELIVERY_ZERO_COPY` and `config->scheduler` is `BROKER_SCHEDULER_THREAD_POOL`, `Broker_CreateWithConfig` shall start a pool of `config->worker_count` workers, the number of processors if it is 0, each with a lock and a thread, and fail and return `NULL` if that fails. ]
+TEST_FUNCTION(Broker_CreateWithConfig_thread_pool_starts_the_workers)
+{
+    ///arrange
+    CBrokerMocks mocks;
+    BROKER_CONFIG config = { BROKER_DELIVERY_ZERO_COPY, 0, 0, 0, BROKER_SCHEDULER_THREAD_POOL, 2 };
+
+    STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is for the structure*/
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, singlylinkedlist_create());
+    STRICT_EXPECTED_CALL(mocks, Lock_Init());
+    STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is for the pool and its workers*/
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, Lock_Init());
+    STRICT_EXPECTED_CALL(mocks, Condition_Init());
+    STRICT_EXPECTED_CALL(mocks, Lock_Init());
+    STRICT_EXPECTED_CALL(mocks, Lock_Init());
+    STRICT_EXPECTED_CALL(mocks, ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
+    STRICT_EXPECTED_CALL(mocks, ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
+
+    ///act
+    auto r = Broker_CreateWithConfig(&config);
+
+    ///assert
+    ASSERT_IS_NOT_NULL(r);
+    mocks.AssertActualAndExpectedCalls();
+
+    ///cleanup
+    Broker_Destroy(r);
+}
+
+//Tests_SRS_BROKER_30_102: [ If `config->delivery_mode` is `BROKER_DELIVERY_ZERO_COPY` and `config->scheduler` is `BROKER_SCHEDULER_THREAD_POOL`, `Broker_CreateWithConfig` shall start a pool of `config->worker_count` workers, the number of processors if it is 0, each with a lock and a thread, and fail and return `NULL` if that fails. ]
+TEST_FUNCTION(Broker_CreateWithConfig_thread_pool_fails_when_a_worker_cannot_start)
+{
+    ///arrange
+    CBrokerMocks mocks;
+    BROKER_CONFIG config = { BROKER_DELIVERY_ZERO_COPY, 0, 0, 0, BROKER_SCHEDULER_THREAD_POOL, 2 };
+
+    STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is for the structure*/
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, singlylinkedlist_create());
+    STRICT_EXPECTED_CALL(mocks, Lock_Init());
+    STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is for the pool and its workers*/
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, Lock_Init());
+    STRICT_EXPECTED_CALL(mocks, Condition_Init());
+    STRICT_EXPECTED_CALL(mocks, Lock_Init());
+    STRICT_EXPECTED_CALL(mocks, Lock_Init());
+    STRICT_EXPECTED_CALL(mocks, ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
+    whenShallThreadAPI_Create_fail = currentThreadAPI_Create_call + 2;
+    STRICT_EXPECTED_CALL(mocks, ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
+    /*the worker that started is stopped*/
+    STRICT_EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, Condition_Post(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, ThreadAPI_Join(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
+    STRICT_EXPECTED_CALL(mocks, Lock_Deinit(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, Lock_Deinit(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, Condition_Deinit(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, Lock_Deinit(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, singlylinkedlist_destroy(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, Lock_Deinit(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+
+    ///act
+    auto r = Broker_CreateWithConfig(&config);
+
+    ///assert
+    ASSERT_IS_NULL(r);
+    mocks.AssertActualAndExpectedCalls();
+
+    ///cleanup
+}
+
+//Tests_SRS_BROKER_30_105: [ If the broker uses `BROKER_SCHEDULER_THREAD_POOL` and the module did not ask for a dedicated thread, the function shall not create a thread for the module, its messages shall be delivered by the pool. ]
+TEST_FUNCTION(Broker_AddModule_thread_pool_creates_no_thread)
+{
+    ///arrange
+    CBrokerMocks mocks;
+    BROKER_CONFIG config = { BROKER_DELIVERY_ZERO_COPY, 0, 0, 0, BROKER_SCHEDULER_THREAD_POOL, 1 };
+    auto broker = Broker_CreateWithConfig(&config);
+    mocks.ResetAllCalls();
+
+    STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is for the module_info*/
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is for the module struct*/
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, Lock_Init());
+    STRICT_EXPECTED_CALL(mocks, UniqueId_Generate(IGNORED_PTR_ARG, 37))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, STRING_construct(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, VECTOR_create(2 * sizeof(void*))); /*a sink and the filter of its link*/
+    STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is for the message queue*/
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, Condition_Init());
+    STRICT_EXPECTED_CALL(mocks, Condition_Init());
+    STRICT_EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, singlylinkedlist_add(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
+    STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is for the module index*/
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+
+    ///act
+    auto result = Broker_AddModule(broker, &fake_module);
+
+    ///assert
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result, BROKER_OK);
+    mocks.AssertActualAndExpectedCalls();
+
+    ///cleanup
+    Broker_RemoveModule(broker, &fake_module);
+    Broker_Destroy(broker);
+}
+
+//Tests_SRS_BROKER_30_104: [ `Broker_AddModuleWithConfig` shall add `module` as `Broker_AddModule` does, giving it a dedicated thread if `config` is not `NULL` and `config->dedicated_thread` is `true`. ]
+//Tests_SRS_BROKER_30_106: [ A module that asked for a dedicated thread shall get a thread of its own running the zero-copy worker, as with `BROKER_SCHEDULER_DEDICATED_THREADS`. ]
+TEST_FUNCTION(Broker_AddModuleWithConfig_gives_a_dedicated_thread)
+{
+    ///arrange
+    CBrokerMocks mocks;
+    BROKER_CONFIG config = { BROKER_DELIVERY_ZERO_COPY, 0, 0, 0, BROKER_SCHEDULER_THREAD_POOL, 1 };
+    BROKER_MODULE_CONFIG module_config = { true };
+    auto broker = Broker_CreateWithConfig(&config);
+    mocks.ResetAllCalls();
+
+    STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is for the module_info*/
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is for the module struct*/
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, Lock_Init());
+    STRICT_EXPECTED_CALL(mocks, UniqueId_Generate(IGNORED_PTR_ARG, 37))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, STRING_construct(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, VECTOR_create(2 * sizeof(void*))); /*a sink and the filter of its link*/
+    STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is for the message queue*/
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, Condition_Init());
+    STRICT_EXPECTED_CALL(mocks, Condition_Init());
+    STRICT_EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, singlylinkedlist_add(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
+    STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is for the module index*/
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
+    STRICT_EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+
+    ///act
+    auto result = Broker_AddModuleWithConfig(broker, &fake_module, &module_config);
+
+    ///assert
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result, BROKER_OK);
+    mocks.AssertActualAndExpectedCalls();
+
+    ///cleanup
+    Broker_RemoveModule(broker, &fake_module);
+    Broker_Destroy(broker);
+}
+
+//Tests_SRS_BROKER_30_107: [ If the sink is pooled and not scheduled yet, `Broker_Publish` shall flag it as scheduled and queue it on the worker running `source`, or on the next worker in turn if no worker runs `source`, then signal the pool's `idle_condition` while holding `idle_lock` if a worker is idle. ]
+//Tests_SRS_BROKER_30_108: [ A pooled worker shall run the module queued first on it or, if there is none, steal the module queued first on another worker. ]
+//Tests_SRS_BROKER_30_111: [ When a pooled module has no message left, its worker shall clear the module's scheduled flag under `socket_lock` and queue the module again if a message was queued for it in the meantime. ]
+TEST_FUNCTION(pool_worker_delivers_message_to_pooled_sink)
+{
+    ///arrange
+    CBrokerMocks mocks;
+    BROKER_CONFIG config = { BROKER_DELIVERY_ZERO_COPY, 0, 0, 0, BROKER_SCHEDULER_THREAD_POOL, 1 };
+    auto broker = Broker_CreateWithConfig(&config);
+    /*the only thread created is the pool's worker*/
+    auto worker_func = thread_func_to_call;
+    auto worker_args = thread_func_args;
+
+    unsigned char fake;
+    MESSAGE_CONFIG c = { 1, &fake, (MAP_HANDLE)&fake };
+    auto message = Message_Create(&c);
+    call_status_for_FakeModule_Receive.module = fake_module.module_handle;
+    call_status_for_FakeModule_Receive.messageHandle = message;
+
+    auto result = Broker_AddModule(broker, &fake_module);
+    BROKER_LINK_DATA bld =
+    {
+        fake_module_handle,
+        fake_module_handle
+    };
+    result = Broker_AddLink(broker, &bld);
+    mocks.ResetAllCalls();
+
+    /*publishing queues the sink on the worker*/
+    STRICT_EXPECTED_CALL(mocks, Message_Clone(message));
+    STRICT_EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    /*the worker takes it, delivers the message and unschedules it*/
+    STRICT_EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, Message_Destroy(message));
+    STRICT_EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    /*then has nothing left to run*/
+    STRICT_EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+
+    ///act
+    result = Broker_Publish(broker, fake_module_handle, message);
+    whenShallLock_fail = currentLock_call + 3;
+    auto thread_result = worker_func(worker_args);
+
+    ///assert
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result, BROKER_OK);
+    ASSERT_ARE_EQUAL(int, thread_result, 0);
+    ASSERT_IS_TRUE(call_status_for_FakeModule_Receive.was_called);
+    mocks.AssertActualAndExpectedCalls();
+
+    ///cleanup
+    Message_Destroy(message);
+    Broker_RemoveModule(broker, &fake_module);
+    Broker_Destroy(broker);
+}
+
+//Tests_SRS_BROKER_30_112: [ A pooled worker with no module to run shall wait on the pool's `idle_condition` unless a module was queued or the pool was stopped in the meantime. ]
+TEST_FUNCTION(pool_worker_waits_when_no_module_is_queued)
+{
+    ///arrange
+    CBrokerMocks mocks;
+    BROKER_CONFIG config = { BROKER_DELIVERY_ZERO_COPY, 0, 0, 0, BROKER_SCHEDULER_THREAD_POOL, 1 };
+    auto broker = Broker_CreateWithConfig(&config);
+    mocks.ResetAllCalls();
+
+    STRICT_EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, Condition_Wait(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 0))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    whenShallLock_fail = currentLock_call + 2;
+    STRICT_EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+
+    ///act
+    auto thread_result = thread_func_to_call(thread_func_args);
+
+    ///assert
+    ASSERT_ARE_EQUAL(int, thread_result, 0);
+    mocks.AssertActualAndExpectedCalls();
+
+    ///cleanup
+    Broker_Destroy(broker);
+}
+
+//Tests_SRS_BROKER_30_121: [ If `broker` or `sink` is `NULL`, `Broker_SetSinkInline` shall return `BROKER_INVALIDARG`. ]
+TEST_FUNCTION(Broker_SetSinkInline_fails_with_NULL_arguments)
+{
+    ///arrange
+    CBrokerMocks mocks;
+    BROKER_CONFIG config = { BROKER_DELIVERY_ZERO_COPY };
+    auto broker = Broker_CreateWithConfig(&config);
+    mocks.ResetAllCalls();
+
+    ///act
+    auto result1 = Broker_SetSinkInline(NULL, fake_module_handle, true);
+    auto result2 = Broker_SetSinkInline(broker, NULL, true);
+
+    ///assert
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result1, BROKER_INVALIDARG);
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result2, BROKER_INVALIDARG);
+    mocks.AssertActualAndExpectedCalls();
+
+    ///cleanup
+    Broker_Destroy(broker);
+}
+
+//Tests_SRS_BROKER_30_122: [ If the broker does not use `BROKER_DELIVERY_ZERO_COPY`, `Broker_SetSinkInline` shall return `BROKER_ERROR`. ]
+TEST_FUNCTION(Broker_SetSinkInline_fails_for_serialized_broker)
+{
+    ///arrange
+    CBrokerMocks mocks;
+    auto broker = Broker_Create();
+    mocks.ResetAllCalls();
+
+    ///act
+    auto result = Broker_SetSinkInline(broker, fake_module_handle, true);
+
+    ///assert
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result, BROKER_ERROR);
+    mocks.AssertActualAndExpectedCalls();
+
+    ///cleanup
+    Broker_Destroy(broker);
+}
+
+//Tests_SRS_BROKER_30_123: [ If `sink` is not attached to the broker, `Broker_SetSinkInline` shall return `BROKER_ERROR`. ]
+TEST_FUNCTION(Broker_SetSinkInline_fails_for_unknown_sink)
+{
+    ///arrange
+    CBrokerMocks mocks;
+    BROKER_CONFIG config = { BROKER_DELIVERY_ZERO_COPY };
+    auto broker = Broker_CreateWithConfig(&config);
+    mocks.ResetAllCalls();
+
+    STRICT_EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+
+    ///act
+    auto result = Broker_SetSinkInline(broker, fake_module_handle, true);
+
+    ///assert
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result, BROKER_ERROR);
+    mocks.AssertActualAndExpectedCalls();
+
+    ///cleanup
+    Broker_Destroy(broker);
+}
+
+//Tests_SRS_BROKER_30_120: [ If the sink is inline, `Broker_Publish` and `Broker_PublishBatch` shall hand the messages to the sink's `Module_ReceiveBatch`, in batches of up to `batch_size` messages, or else to its `Module_Receive`, on the calling thread and without cloning them, once the messages are queued for the other sinks. ]
+//Tests_SRS_BROKER_30_126: [ To make the sink inline, `Broker_SetSinkInline` shall stop its worker, deliver the messages still queued for it on the calling thread and then flag it inline. ]
+TEST_FUNCTION(Broker_Publish_zero_copy_calls_inline_sink)
+{
+    ///arrange
+    CBrokerMocks mocks;
+    BROKER_CONFIG config = { BROKER_DELIVERY_ZERO_COPY };
+    auto broker = Broker_CreateWithConfig(&config);
+
+    unsigned char fake;
+    MESSAGE_CONFIG c = { 1, &fake, (MAP_HANDLE)&fake };
+    auto message = Message_Create(&c);
+
+    auto result = Broker_AddModule(broker, &fake_module);
+    BROKER_LINK_DATA bld =
+    {
+        fake_module_handle,
+        fake_module_handle
+    };
+    auto inline_result = Broker_SetSinkInline(broker, fake_module_handle, true);
+    result = Broker_AddLink(broker, &bld);
+    call_status_for_FakeModule_Receive.module = fake_module.module_handle;
+    call_status_for_FakeModule_Receive.messageHandle = message;
+    mocks.ResetAllCalls();
+
+    STRICT_EXPECTED_CALL(mocks, Message_Clone(message))
+        .NeverInvoked();
+
+    ///act
+    result = Broker_Publish(broker, fake_module_handle, message);
+
+    ///assert
+    BROKER_QUEUE_STATS stats;
+    ASSERT_ARE_EQUAL(BROKER_RESULT, inline_result, BROKER_OK);
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result, BROKER_OK);
+    ASSERT_IS_TRUE(call_status_for_FakeModule_Receive.was_called);
+    mocks.AssertActualAndExpectedCalls();
+    ASSERT_ARE_EQUAL(BROKER_RESULT, Broker_GetSinkQueueStats(broker, fake_module_handle, &stats), BROKER_OK);
+    ASSERT_ARE_EQUAL(size_t, stats.queued, 0);
+
+    ///cleanup
+    Message_Destroy(message);
+    Broker_RemoveModule(broker, &fake_module);
+    Broker_Destroy(broker);
+}
+
+//Tests_SRS_BROKER_30_120: [ If the sink is inline, `Broker_Publish` and `Broker_PublishBatch` shall hand the messages to the sink's `Module_ReceiveBatch`, in batches of up to `batch_size` messages, or else to its `Module_Receive`, on the calling thread and without cloning them, once the messages are queued for the other sinks. ]
+TEST_FUNCTION(Broker_PublishBatch_zero_copy_hands_batches_to_inline_sink)
+{
+    ///arrange
+    CBrokerMocks mocks;
+    BROKER_CONFIG config = { BROKER_DELIVERY_ZERO_COPY, 0, 2 };
+    auto broker = Broker_CreateWithConfig(&config);
+
+    unsigned char fake;
+    MESSAGE_CONFIG c = { 1, &fake, (MAP_HANDLE)&fake };
+    auto message = Message_Create(&c);
+    MESSAGE_HANDLE messages[3] = { message, message, message };
+
+    auto result = Broker_AddModule(broker, &fake_batch_module);
+    BROKER_LINK_DATA bld =
+    {
+        fake_batch_module_handle,
+        fake_batch_module_handle
+    };
+    result = Broker_SetSinkInline(broker, fake_batch_module_handle, true);
+    result = Broker_AddLink(broker, &bld);
+    mocks.ResetAllCalls();
+
+    STRICT_EXPECTED_CALL(mocks, Message_Clone(message))
+        .NeverInvoked();
+
+    ///act
+    result = Broker_PublishBatch(broker, fake_batch_module_handle, messages, 3);
+
+    ///assert
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result, BROKER_OK);
+    ASSERT_ARE_EQUAL(size_t, 2, fake_batch_call_count);
+    ASSERT_ARE_EQUAL(size_t, 3, fake_batch_message_count);
+    ASSERT_IS_FALSE(call_status_for_FakeModule_Receive.was_called);
+    mocks.AssertActualAndExpectedCalls();
+
+    ///cleanup
+    Message_Destroy(message);
+    Broker_RemoveModule(broker, &fake_batch_module);
+    Broker_Destroy(broker);
+}
+
+//Tests_SRS_BROKER_30_127: [ To queue messages for the sink again, `Broker_SetSinkInline` shall restart its worker, and fail with `BROKER_ERROR` and leave the sink inline if that fails. ]
+TEST_FUNCTION(Broker_SetSinkInline_false_queues_again)
+{
+    ///arrange
+    CBrokerMocks mocks;
+    BROKER_CONFIG config = { BROKER_DELIVERY_ZERO_COPY };
+    auto broker = Broker_CreateWithConfig(&config);
+
+    unsigned char fake;
+    MESSAGE_CONFIG c = { 1, &fake, (MAP_HANDLE)&fake };
+    auto message = Message_Create(&c);
+
+    auto result = Broker_AddModule(broker, &fake_module);
+    BROKER_LINK_DATA bld =
+    {
+        fake_module_handle,
+        fake_module_handle
+    };
+    result = Broker_SetSinkInline(broker, fake_module_handle, true);
+    result = Broker_SetSinkInline(broker, fake_module_handle, false);
+    result = Broker_AddLink(broker, &bld);
+    mocks.ResetAllCalls();
+
+    STRICT_EXPECTED_CALL(mocks, Message_Clone(message));
+
+    ///act
+    result = Broker_Publish(broker, fake_module_handle, message);
+
+    ///assert
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result, BROKER_OK);
+    ASSERT_IS_FALSE(call_status_for_FakeModule_Receive.was_called);
+    mocks.AssertActualAndExpectedCalls();
+
+    ///cleanup
+    Message_Destroy(message);
+    Broker_RemoveModule(broker, &fake_module);
+    Broker_Destroy(broker);
+}
+
+//Tests_SRS_BROKER_30_125: [ If a module links to `sink`, `Broker_SetSinkInline` shall fail and return `BROKER_ERROR`. ]
+TEST_FUNCTION(Broker_SetSinkInline_fails_for_a_linked_sink)
+{
+    ///arrange
+    CBrokerMocks mocks;
+    BROKER_CONFIG config = { BROKER_DELIVERY_ZERO_COPY };
+    auto broker = Broker_CreateWithConfig(&config);
+
+    auto result = Broker_AddModule(broker, &fake_module);
+    BROKER_LINK_DATA bld =
+    {
+        fake_module_handle,
+        fake_module_handle
+    };
+    result = Broker_AddLink(broker, &bld);
+    mocks.ResetAllCalls();
+
+    STRICT_EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, singlylinkedlist_get_head_item(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
+    STRICT_EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+
+    ///act
+    result = Broker_SetSinkInline(broker, fake_module_handle, true);
+
+    ///assert
+    ASSERT_ARE_EQUAL(BROKER_RESULT, BROKER_ERROR, result);
+    ASSERT_ARE_EQUAL(size_t, 0, currentThreadAPI_Join_call);
+    mocks.AssertActualAndExpectedCalls();
+
+    ///cleanup
+    Broker_RemoveModule(broker, &fake_module);
+    Broker_Destroy(broker);
+}
+
+//Tests_SRS_BROKER_30_126: [ To make the sink inline, `Broker_SetSinkInline` shall stop its worker, deliver the messages still queued for it on the calling thread and then flag it inline. ]
+TEST_FUNCTION(Broker_SetSinkInline_delivers_the_queued_messages_before_returning)
+{
+    ///arrange
+    CBrokerMocks mocks;
+    BROKER_CONFIG config = { BROKER_DELIVERY_ZERO_COPY };
+    auto broker = Broker_CreateWithConfig(&config);
+
+    unsigned char fake;
+    MESSAGE_CONFIG c = { 1, &fake, (MAP_HANDLE)&fake };
+    auto message = Message_Create(&c);
+
+    auto result = Broker_AddModule(broker, &fake_module);
+    BROKER_LINK_DATA bld =
+    {
+        fake_module_handle,
+        fake_module_handle
+    };
+    result = Broker_AddLink(broker, &bld);
+    /* the worker never runs here, the message stays queued */
+    result = Broker_Publish(broker, fake_module_handle, message);
+    result = Broker_RemoveLink(broker, &bld);
+    call_status_for_FakeModule_Receive.module = fake_module.module_handle;
+    mocks.ResetAllCalls();
+
+    ///act
+    result = Broker_SetSinkInline(broker, fake_module_handle, true);
+
+    ///assert
+    BROKER_QUEUE_STATS stats;
+    ASSERT_ARE_EQUAL(BROKER_RESULT, BROKER_OK, result);
+    ASSERT_ARE_EQUAL(size_t, 1, currentThreadAPI_Join_call);
+    ASSERT_ARE_EQUAL(size_t, 1, fake_received_count);
+    ASSERT_ARE_EQUAL(void_ptr, (void*)message, (void*)fake_received[0]);
+    ASSERT_ARE_EQUAL(BROKER_RESULT, BROKER_OK, Broker_GetSinkQueueStats(broker, fake_module_handle, &stats));
+    ASSERT_ARE_EQUAL(size_t, 0, stats.queued);
+
+    ///cleanup
+    Message_Destroy(message);
+    Broker_RemoveModule(broker, &fake_module);
+    Broker_Destroy(broker);
+}
+
+//Tests_SRS_BROKER_30_127: [ To queue messages for the sink again, `Broker_SetSinkInline` shall restart its worker, and fail with `BROKER_ERROR` and leave the sink inline if that fails. ]
+TEST_FUNCTION(Broker_SetSinkInline_false_fails_when_ThreadAPI_Create_fails)
+{
+    ///arrange
+    CBrokerMocks mocks;
+    BROKER_CONFIG config = { BROKER_DELIVERY_ZERO_COPY };
+    auto broker = Broker_CreateWithConfig(&config);
+
+    unsigned char fake;
+    MESSAGE_CONFIG c = { 1, &fake, (MAP_HANDLE)&fake };
+    auto message = Message_Create(&c);
+
+    auto result = Broker_AddModule(broker, &fake_module);
+    result = Broker_SetSinkInline(broker, fake_module_handle, true);
+    whenShallThreadAPI_Create_fail = currentThreadAPI_Create_call + 1;
+    auto queue_result = Broker_SetSinkInline(broker, fake_module_handle, false);
+    BROKER_LINK_DATA bld =
+    {
+        fake_module_handle,
+        fake_module_handle
+    };
+    result = Broker_AddLink(broker, &bld);
+    call_status_for_FakeModule_Receive.module = fake_module.module_handle;
+    mocks.ResetAllCalls();
+
+    STRICT_EXPECTED_CALL(mocks, Message_Clone(message))
+        .NeverInvoked();
+
+    ///act
+    result = Broker_Publish(broker, fake_module_handle, message);
+
+    ///assert
+    ASSERT_ARE_EQUAL(BROKER_RESULT, BROKER_ERROR, queue_result);
+    ASSERT_ARE_EQUAL(BROKER_RESULT, BROKER_OK, result);
+    ASSERT_IS_TRUE(call_status_for_FakeModule_Receive.was_called);
+    mocks.AssertActualAndExpectedCalls();
+
+    ///cleanup
+    Message_Destroy(message);
+    Broker_RemoveModule(broker, &fake_module);
+    Broker_Destroy(broker);
+}
+
+//Tests_SRS_BROKER_30_128: [ In zero-copy mode the function shall not stop the worker of an inline module, `Broker_SetSinkInline` stopped it already. ]
+TEST_FUNCTION(Broker_RemoveModule_does_not_stop_an_inline_module_again)
+{
+    ///arrange
+    CBrokerMocks mocks;
+    BROKER_CONFIG config = { BROKER_DELIVERY_ZERO_COPY };
+    auto broker = Broker_CreateWithConfig(&config);
+
+    auto result = Broker_AddModule(broker, &fake_module);
+    result = Broker_SetSinkInline(broker, fake_module_handle, true);
+    mocks.ResetAllCalls();
+
+    ///act
+    result = Broker_RemoveModule(broker, &fake_module);
+
+    ///assert
+    ASSERT_ARE_EQUAL(BROKER_RESULT, BROKER_OK, result);
+    ASSERT_ARE_EQUAL(size_t, 1, currentThreadAPI_Join_call);
+
+    ///cleanup
+    Broker_Destroy(broker);
+}
+
+//Tests_SRS_BROKER_30_130: [ If `link->filter` has a condition whose `key` or `values` is `NULL`, whose `value_count` is 0, whose `match` is not a valid `BROKER_FILTER_MATCH` or one of whose values is `NULL`, `Broker_AddLink` shall return `BROKER_INVALIDARG`. ]
+TEST_FUNCTION(Broker_AddLink_fails_with_invalid_filter)
+{
+    ///arrange
+    CBrokerMocks mocks;
+    BROKER_CONFIG config = { BROKER_DELIVERY_ZERO_COPY };
+    auto broker = Broker_CreateWithConfig(&config);
+    const char* values[] = { "bleTelemetry", NULL };
+    BROKER_FILTER_CONDITION no_key = { NULL, BROKER_FILTER_EQUALS, values, 1 };
+    BROKER_FILTER_CONDITION no_value = { "source", BROKER_FILTER_EQUALS, values, 0 };
+    BROKER_FILTER_CONDITION null_value = { "source", BROKER_FILTER_EQUALS, values, 2 };
+    BROKER_FILTER_CONDITION bad_match = { "source", (BROKER_FILTER_MATCH)42, values, 1 };
+    BROKER_LINK_FILTER filters[] = { { &no_key, 1 }, { &no_value, 1 }, { &null_value, 1 }, { &bad_match, 1 }, { NULL, 1 } };
+    mocks.ResetAllCalls();
+
+    for (size_t i = 0; i < sizeof(filters) / sizeof(filters[0]); i++)
+    {
+        BROKER_LINK_DATA bld =
+        {
+            fake_module_handle,
+            fake_module_handle,
+            &filters[i]
+        };
+
+        ///act
+        auto result = Broker_AddLink(broker, &bld);
+
+        ///assert
+        ASSERT_ARE_EQUAL(BROKER_RESULT, result, BROKER_INVALIDARG);
+    }
+    mocks.AssertActualAndExpectedCalls();
+
+    ///cleanup
+    Broker_Destroy(broker);
+}
+
+//Tests_SRS_BROKER_30_131: [ If `link->filter` is not `NULL` and the broker does not use `BROKER_DELIVERY_ZERO_COPY`, `Broker_AddLink` shall return `BROKER_ADD_LINK_ERROR`. ]
+TEST_FUNCTION(Broker_AddLink_with_filter_fails_for_serialized_broker)
+{
+    ///arrange
+    CBrokerMocks mocks;
+    auto broker = Broker_Create();
+    const char* values[] = { "bleTelemetry" };
+    BROKER_FILTER_CONDITION condition = { "source", BROKER_FILTER_EQUALS, values, 1 };
+    BROKER_LINK_FILTER filter = { &condition, 1 };
+    BROKER_LINK_DATA bld =
+    {
+        fake_module_handle,
+        fake_module_handle,
+        &filter
+    };
+    mocks.ResetAllCalls();
+
+    ///act
+    auto result = Broker_AddLink(broker, &bld);
+
+    ///assert
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result, BROKER_ADD_LINK_ERROR);
+    mocks.AssertActualAndExpectedCalls();
+
+    ///cleanup
+    Broker_Destroy(broker);
+}
+
+//Tests_SRS_BROKER_30_132: [ In zero-copy mode `Broker_AddLink` shall compile `link->filter`, copying its keys and values, and fail with `BROKER_ADD_LINK_ERROR` if that fails. ]
+TEST_FUNCTION(Broker_AddLink_zero_copy_fails_when_filter_cannot_be_compiled)
+{
+    ///arrange
+    CBrokerMocks mocks;
+    BROKER_CONFIG config = { BROKER_DELIVERY_ZERO_COPY };
+    auto broker = Broker_CreateWithConfig(&config);
+    auto result = Broker_AddModule(broker, &fake_module);
+    const char* values[] = { "bleTelemetry" };
+    BROKER_FILTER_CONDITION condition = { "source", BROKER_FILTER_EQUALS, values, 1 };
+    BROKER_LINK_FILTER filter = { &condition, 1 };
+    BROKER_LINK_DATA bld =
+    {
+        fake_module_handle,
+        fake_module_handle,
+        &filter
+    };
+    mocks.ResetAllCalls();
+
+    STRICT_EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
+    whenShallmalloc_fail = currentmalloc_call + 1;
+    STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*the compiled filter*/
+        .IgnoreArgument(1);
+
+    ///act
+    result = Broker_AddLink(broker, &bld);
+
+    ///assert
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result, BROKER_ADD_LINK_ERROR);
+    mocks.AssertActualAndExpectedCalls();
+
+    ///cleanup
+    Broker_RemoveModule(broker, &fake_module);
+    Broker_Destroy(broker);
+}
+
+//Tests_SRS_BROKER_30_132: [ In zero-copy mode `Broker_AddLink` shall compile `link->filter`, copying its keys and values, and fail with `BROKER_ADD_LINK_ERROR` if that fails. ]
+//Tests_SRS_BROKER_30_133: [ If the link to a sink has a filter, `Broker_Publish` and `Broker_PublishBatch` shall only clone, queue or deliver to the sink the messages whose properties pass all of its conditions. ]
+TEST_FUNCTION(Broker_Publish_zero_copy_queues_only_messages_passing_the_filter)
+{
+    ///arrange
+    CBrokerMocks mocks;
+    BROKER_CONFIG config = { BROKER_DELIVERY_ZERO_COPY };
+    auto broker = Broker_CreateWithConfig(&config);
+
+    unsigned char fake;
+    MESSAGE_CONFIG c = { 1, &fake, (MAP_HANDLE)&fake };
+    auto telemetry = Message_Create(&c);
+    auto other = Message_Create(&c);
+    fake_property_message = telemetry;
+    fake_property_value = "bleTelemetry";
+
+    char key[] = "source";
+    char value[] = "bleTelemetry";
+    const char* values[] = { value };
+    BROKER_FILTER_CONDITION condition = { key, BROKER_FILTER_EQUALS, values, 1 };
+    BROKER_LINK_FILTER filter = { &condition, 1 };
+    BROKER_LINK_DATA bld =
+    {
+        fake_module_handle,
+        fake_module_handle,
+        &filter
+    };
+    auto result = Broker_AddModule(broker, &fake_module);
+    result = Broker_AddLink(broker, &bld);
+    /*the broker keeps copies of the filter*/
+    value[0] = 'B';
+    mocks.ResetAllCalls();
+
+    STRICT_EXPECTED_CALL(mocks, Message_GetProperty(telemetry, IGNORED_PTR_ARG))
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, Message_GetProperty(other, IGNORED_PTR_ARG))
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, Message_Clone(telemetry));
+
+    ///act
+    auto result1 = Broker_Publish(broker, fake_module_handle, telemetry);
+    auto result2 = Broker_Publish(broker, fake_module_handle, other);
+
+    ///assert
+    BROKER_QUEUE_STATS stats;
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result, BROKER_OK);
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result1, BROKER_OK);
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result2, BROKER_OK);
+    mocks.AssertActualAndExpectedCalls();
+    ASSERT_ARE_EQUAL(BROKER_RESULT, Broker_GetSinkQueueStats(broker, fake_module_handle, &stats), BROKER_OK);
+    ASSERT_ARE_EQUAL(size_t, stats.queued, 1);
+    ASSERT_ARE_EQUAL(size_t, stats.dropped, 0);
+
+    ///cleanup
+    Message_Destroy(telemetry);
+    Message_Destroy(other);
+    Broker_RemoveModule(broker, &fake_module);
+    Broker_Destroy(broker);
+}
+
+//Tests_SRS_BROKER_30_133: [ If the link to a sink has a filter, `Broker_Publish` and `Broker_PublishBatch` shall only clone, queue or deliver to the sink the messages whose properties pass all of its conditions. ]
+TEST_FUNCTION(Broker_PublishBatch_zero_copy_filters_every_message)
+{
+    ///arrange
+    CBrokerMocks mocks;
+    BROKER_CONFIG config = { BROKER_DELIVERY_ZERO_COPY };
+    auto broker = Broker_CreateWithConfig(&config);
+
+    unsigned char fake;
+    MESSAGE_CONFIG c = { 1, &fake, (MAP_HANDLE)&fake };
+    auto telemetry = Message_Create(&c);
+    auto other = Message_Create(&c);
+    MESSAGE_HANDLE messages[4] = { telemetry, other, telemetry, other };
+    fake_property_message = telemetry;
+    fake_property_value = "simulatedTelemetry";
+
+    const char* prefixes[] = { "ble", "simulated" };
+    BROKER_FILTER_CONDITION condition = { "source", BROKER_FILTER_PREFIX, prefixes, 2 };
+    BROKER_LINK_FILTER filter = { &condition, 1 };
+    BROKER_LINK_DATA bld =
+    {
+        fake_module_handle,
+        fake_module_handle,
+        &filter
+    };
+    auto result = Broker_AddModule(broker, &fake_module);
+    result = Broker_AddLink(broker, &bld);
+    mocks.ResetAllCalls();
+
+    STRICT_EXPECTED_CALL(mocks, Message_GetProperty(telemetry, IGNORED_PTR_ARG))
+        .IgnoreArgument(2)
+        .ExpectedTimesExactly(2);
+    STRICT_EXPECTED_CALL(mocks, Message_GetProperty(other, IGNORED_PTR_ARG))
+        .IgnoreArgument(2)
+        .ExpectedTimesExactly(2);
+    STRICT_EXPECTED_CALL(mocks, Message_Clone(telemetry))
+        .ExpectedTimesExactly(2);
+
+    ///act
+    result = Broker_PublishBatch(broker, fake_module_handle, messages, 4);
+
+    ///assert
+    BROKER_QUEUE_STATS stats;
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result, BROKER_OK);
+    mocks.AssertActualAndExpectedCalls();
+    ASSERT_ARE_EQUAL(BROKER_RESULT, Broker_GetSinkQueueStats(broker, fake_module_handle, &stats), BROKER_OK);
+    ASSERT_ARE_EQUAL(size_t, stats.queued, 2);
+
+    ///cleanup
+    Message_Destroy(telemetry);
+    Message_Destroy(other);
+    Broker_RemoveModule(broker, &fake_module);
+    Broker_Destroy(broker);
+}
+
+//Tests_SRS_BROKER_30_133: [ If the link to a sink has a filter, `Broker_Publish` and `Broker_PublishBatch` shall only clone, queue or deliver to the sink the messages whose properties pass all of its conditions. ]
+TEST_FUNCTION(Broker_PublishBatch_zero_copy_hands_filtered_runs_to_inline_sink)
+{
+    ///arrange
+    CBrokerMocks mocks;
+    BROKER_CONFIG config = { BROKER_DELIVERY_ZERO_COPY, 0, 2 };
+    auto broker = Broker_CreateWithConfig(&config);
+
+    unsigned char fake;
+    MESSAGE_CONFIG c = { 1, &fake, (MAP_HANDLE)&fake };
+    auto telemetry = Message_Create(&c);
+    auto other = Message_Create(&c);
+    MESSAGE_HANDLE messages[5] = { telemetry, other, telemetry, telemetry, telemetry };
+    fake_property_message = telemetry;
+    fake_property_value = "bleTelemetry";
+
+    const char* values[] = { "bleTelemetry", "simulatedTelemetry" };
+    BROKER_FILTER_CONDITION condition = { "source", BROKER_FILTER_EQUALS, values, 2 };
+    BROKER_LINK_FILTER filter = { &condition, 1 };
+    BROKER_LINK_DATA bld =
+    {
+        fake_batch_module_handle,
+        fake_batch_module_handle,
+        &filter
+    };
+    auto result = Broker_AddModule(broker, &fake_batch_module);
+    result = Broker_SetSinkInline(broker, fake_batch_module_handle, true);
+    result = Broker_AddLink(broker, &bld);
+    mocks.ResetAllCalls();
+
+    STRICT_EXPECTED_CALL(mocks, Message_GetProperty(telemetry, IGNORED_PTR_ARG))
+        .IgnoreArgument(2)
+        .ExpectedTimesExactly(4);
+    STRICT_EXPECTED_CALL(mocks, Message_GetProperty(other, IGNORED_PTR_ARG))
+        .IgnoreArgument(2);
+
+    ///act
+    result = Broker_PublishBatch(broker, fake_batch_module_handle, messages, 5);
+
+    ///assert
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result, BROKER_OK);
+    /*{ telemetry }, then { telemetry, telemetry } and { telemetry }*/
+    ASSERT_ARE_EQUAL(size_t, 3, fake_batch_call_count);
+    ASSERT_ARE_EQUAL(size_t, 4, fake_batch_message_count);
+    mocks.AssertActualAndExpectedCalls();
+
+    ///cleanup
+    Message_Destroy(telemetry);
+    Message_Destroy(other);
+    Broker_RemoveModule(broker, &fake_batch_module);
+    Broker_Destroy(broker);
+}
+
+//Tests_SRS_BROKER_30_134: [ In zero-copy mode `Broker_RemoveLink` shall release the link's reference to its filter once the new route is swapped in, the filter being freed with the last route that still holds it. ]
+TEST_FUNCTION(Broker_RemoveLink_zero_copy_frees_the_filter)
+{
+    ///arrange
+    CBrokerMocks mocks;
+    BROKER_CONFIG config = { BROKER_DELIVERY_ZERO_COPY };
+    auto broker = Broker_CreateWithConfig(&config);
+    const char* values[] = { "bleTelemetry" };
+    BROKER_FILTER_CONDITION condition = { "source", BROKER_FILTER_EQUALS, values, 1 };
+    BROKER_LINK_FILTER filter = { &condition, 1 };
+    BROKER_LINK_DATA bld =
+    {
+        fake_module_handle,
+        fake_module_handle,
+        &filter
+    };
+    auto result = Broker_AddModule(broker, &fake_module);
+    result = Broker_AddLink(broker, &bld);
+    mocks.ResetAllCalls();
+
+    STRICT_EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
+    expect_route_create(mocks, 1, false);
+    STRICT_EXPECTED_CALL(mocks, VECTOR_erase(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)) /*the previous route*/
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)) /*the new route, it has no sinks*/
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)) /*the filter*/
+        .IgnoreArgument(1);
+
+    ///act
+    result = Broker_RemoveLink(broker, &bld);
+
+    ///assert
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result, BROKER_OK);
+    mocks.AssertActualAndExpectedCalls();
+
+    ///cleanup
+    Broker_RemoveModule(broker, &fake_module);
+    Broker_Destroy(broker);
+}
+
+//Tests_SRS_BROKER_30_140: [ `Broker_AddModule` shall add the new `BROKER_MODULEINFO` to the broker's module index, keyed by `module->module_handle`. ]
+//Tests_SRS_BROKER_13_047: [This function shall return BROKER_ERROR if an underlying API call to the platform causes an error or BROKER_OK otherwise.]
+TEST_FUNCTION(Broker_AddModule_fails_when_module_index_cannot_be_allocated)
+{
+    ///arrange
+    CBrokerMocks mocks;
+    auto broker = Broker_Create();
+    mocks.ResetAllCalls();
+
+    STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is for the module_info*/
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is for the module struct*/
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, Lock_Init());
+    STRICT_EXPECTED_CALL(mocks, Lock_Deinit(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, UniqueId_Generate(IGNORED_PTR_ARG, 37))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, STRING_construct(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, singlylinkedlist_add(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
+    STRICT_EXPECTED_CALL(mocks, singlylinkedlist_remove(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
+    STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is for the module index*/
+        .IgnoreArgument(1);
+    whenShallmalloc_fail = currentmalloc_call + 3;
+
+    ///act
+    auto result = Broker_AddModule(broker, &fake_module);
+
+    ///assert
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result, BROKER_ERROR);
+    mocks.AssertActualAndExpectedCalls();
+
+    ///cleanup
+    Broker_Destroy(broker);
+}
+
+//Tests_SRS_BROKER_30_140: [ `Broker_AddModule` shall add the new `BROKER_MODULEINFO` to the broker's module index, keyed by `module->module_handle`. ]
+//Tests_SRS_BROKER_13_049: [Broker_RemoveModule shall look module up in the broker's module index.]
+//Tests_SRS_BROKER_17_031: [ Broker_AddLink shall find the BROKER_HANDLE_DATA::module_info for link->sink. ]
+//Tests_SRS_BROKER_17_041: [ Broker_AddLink shall find the BROKER_HANDLE_DATA::module_info for link->module_source_handle. ]
+TEST_FUNCTION(Broker_AddLink_finds_modules_among_many)
+{
+    ///arrange
+    CBrokerMocks mocks;
+    auto broker = Broker_Create();
+    /*enough modules for the index to grow twice*/
+    MODULE modules[40];
+    const size_t module_count = sizeof(modules) / sizeof(modules[0]);
+    BROKER_RESULT add_results[40];
+    BROKER_RESULT remove_results[40];
+    BROKER_RESULT kept_results[40];
+    BROKER_RESULT removed_results[40];
+    for (size_t i = 0; i < module_count; i++)
+    {
+        modules[i].module_apis = fake_module.module_apis;
+        modules[i].module_handle = (MODULE_HANDLE)(0x1000 + i);
+        add_results[i] = Broker_AddModule(broker, &modules[i]);
+    }
+    /*every other module goes away, the modules probed past them have to be found still*/
+    for (size_t i = 0; i < module_count; i += 2)
+    {
+        remove_results[i] = Broker_RemoveModule(broker, &modules[i]);
+    }
+    mocks.ResetAllCalls();
+
+    ///act
+    for (size_t i = 1; i < module_count; i += 2)
+    {
+        BROKER_LINK_DATA kept =
+        {
+            modules[i].module_handle,
+            modules[(i + 2) % module_count].module_handle
+        };
+        BROKER_LINK_DATA removed =
+        {
+            modules[i].module_handle,
+            modules[i - 1].module_handle
+        };
+        kept_results[i] = Broker_AddLink(broker, &kept);
+        removed_results[i] = Broker_AddLink(broker, &removed);
+    }
+
+    ///assert
+    for (size_t i = 0; i < module_count; i++)
+    {
+        ASSERT_ARE_EQUAL(BROKER_RESULT, add_results[i], BROKER_OK);
+        if (i % 2 == 0)
+        {
+            ASSERT_ARE_EQUAL(BROKER_RESULT, remove_results[i], BROKER_OK);
+        }
+        else
+        {
+            ASSERT_ARE_EQUAL(BROKER_RESULT, kept_results[i], BROKER_OK);
+            ASSERT_ARE_EQUAL(BROKER_RESULT, removed_results[i], BROKER_ADD_LINK_ERROR);
+        }
+    }
+
+    ///cleanup
+    for (size_t i = 1; i < module_count; i += 2)
+    {
+        Broker_RemoveModule(broker, &modules[i]);
+    }
+    Broker_Destroy(broker);
+}
+
+/*the first slot of handle in a module or routing index of BROKER_INDEX_MIN_SIZE (16) slots*/
+static size_t first_index_slot(MODULE_HANDLE handle)
+{
+    size_t hash = (size_t)(uintptr_t)handle;
+    hash ^= hash >> 16;
+    hash *= 0x45d9f3b;
+    hash ^= hash >> 16;
+    return hash & 15;
+}
+
+//Tests_SRS_BROKER_13_052: [The function shall remove the module from BROKER_HANDLE_DATA::modules.]
+//Tests_SRS_BROKER_13_049: [Broker_RemoveModule shall look module up in the broker's module index.]
+TEST_FUNCTION(Broker_RemoveModule_keeps_finding_modules_of_the_same_index_slot)
+{
+    ///arrange
+    CBrokerMocks mocks;
+    auto broker = Broker_Create();
+    /*modules whose handles start probing the index at the same slot*/
+    MODULE modules[3];
+    const size_t module_count = sizeof(modules) / sizeof(modules[0]);
+    size_t found = 0;
+    for (uintptr_t handle = 0x1000; found < module_count; handle++)
+    {
+        if (first_index_slot((MODULE_HANDLE)handle) == first_index_slot((MODULE_HANDLE)0x1000))
+        {
+            modules[found].module_apis = fake_module.module_apis;
+            modules[found].module_handle = (MODULE_HANDLE)handle;
+            (void)Broker_AddModule(broker, &modules[found]);
+            found++;
+        }
+    }
+    BROKER_LINK_DATA link =
+    {
+        modules[1].module_handle,
+        modules[2].module_handle
+    };
+    mocks.ResetAllCalls();
+
+    ///act
+    auto removed_result = Broker_RemoveModule(broker, &modules[0]);
+    auto link_result = Broker_AddLink(broker, &link);
+    auto removed_again_result = Broker_RemoveModule(broker, &modules[0]);
+
+    ///assert
+    ASSERT_ARE_EQUAL(BROKER_RESULT, removed_result, BROKER_OK);
+    ASSERT_ARE_EQUAL(BROKER_RESULT, link_result, BROKER_OK);
+    ASSERT_ARE_EQUAL(BROKER_RESULT, removed_again_result, BROKER_ERROR);
+    ASSERT_ARE_EQUAL(BROKER_RESULT, Broker_RemoveLink(broker, &link), BROKER_OK);
+    ASSERT_ARE_EQUAL(BROKER_RESULT, Broker_RemoveModule(broker, &modules[2]), BROKER_OK);
+    ASSERT_ARE_EQUAL(BROKER_RESULT, Broker_RemoveModule(broker, &modules[1]), BROKER_OK);
+
+    ///cleanup
+    Broker_Destroy(broker);
+}
+
+//Tests_SRS_BROKER_30_034: [ In zero-copy mode `Broker_Publish` shall look up the sinks of `source` in the current routing table without taking any lock. ]
+//Tests_SRS_BROKER_30_032: [ In zero-copy mode, if `source` is not attached to the broker or has no sinks, `Broker_Publish` shall return `BROKER_OK` without delivering the message. ]
+TEST_FUNCTION(Broker_Publish_zero_copy_finds_the_route_of_each_source)
+{
+    ///arrange
+    CBrokerMocks mocks;
+    BROKER_CONFIG config = { BROKER_DELIVERY_ZERO_COPY };
+    auto broker = Broker_CreateWithConfig(&config);
+
+    unsigned char fake;
+    MESSAGE_CONFIG c = { 1, &fake, (MAP_HANDLE)&fake };
+    auto message = Message_Create(&c);
+
+    MODULE modules[40];
+    const size_t module_count = sizeof(modules) / sizeof(modules[0]);
+    BROKER_RESULT publish_results[40];
+    for (size_t i = 0; i < module_count; i++)
+    {
+        modules[i].module_apis = fake_module.module_apis;
+        modules[i].module_handle = (MODULE_HANDLE)(0x1000 + i);
+        (void)Broker_AddModule(broker, &modules[i]);
+    }
+    /*the even modules send to the next one, the odd ones have no route*/
+    for (size_t i = 0; i < module_count; i += 2)
+    {
+        BROKER_LINK_DATA bld =
+        {
+            modules[i].module_handle,
+            modules[i + 1].module_handle
+        };
+        (void)Broker_AddLink(broker, &bld);
+    }
+    mocks.ResetAllCalls();
+
+    ///act
+    for (size_t i = 0; i < module_count; i++)
+    {
+        publish_results[i] = Broker_Publish(broker, modules[i].module_handle, message);
+    }
+
+    ///assert
+    for (size_t i = 0; i < module_count; i++)
+    {
+        BROKER_QUEUE_STATS stats;
+        ASSERT_ARE_EQUAL(BROKER_RESULT, publish_results[i], BROKER_OK);
+        ASSERT_ARE_EQUAL(BROKER_RESULT, Broker_GetSinkQueueStats(broker, modules[i].module_handle, &stats), BROKER_OK);
+        ASSERT_ARE_EQUAL(size_t, stats.queued, (size_t)(i % 2));
+    }
+
+    ///cleanup
+    Message_Destroy(message);
+    for (size_t i = 0; i < module_count; i++)
+    {
+        Broker_RemoveModule(broker, &modules[i]);
+    }
+    Broker_Destroy(broker);
+}
+
+//Tests_SRS_BROKER_30_043: [ In zero-copy mode `Broker_AddLink` and `Broker_RemoveLink` shall build a new route for the source only and swap it in for `Broker_Publish`, freeing the route it replaces once no publisher can be reading it. ]
+//Tests_SRS_BROKER_30_032: [ In zero-copy mode, if `source` is not attached to the broker or has no sinks, `Broker_Publish` shall return `BROKER_OK` without delivering the message. ]
+TEST_FUNCTION(Broker_Publish_zero_copy_routes_when_modules_without_sinks_follow_the_last_route)
+{
+    ///arrange
+    CBrokerMocks mocks;
+    BROKER_CONFIG config = { BROKER_DELIVERY_ZERO_COPY };
+    auto broker = Broker_CreateWithConfig(&config);
+
+    unsigned char fake;
+    MESSAGE_CONFIG c = { 1, &fake, (MAP_HANDLE)&fake };
+    auto message = Message_Create(&c);
+
+    /*the only route is in the first slot of the routing index, right after the
+      routes: writing a route for the modules without sinks would overwrite it*/
+    uintptr_t source_handle = 0x1000;
+    while (first_index_slot((MODULE_HANDLE)source_handle) != 0)
+    {
+        source_handle++;
+    }
+    MODULE modules[4];
+    const size_t module_count = sizeof(modules) / sizeof(modules[0]);
+    BROKER_RESULT publish_results[4];
+    for (size_t i = 0; i < module_count; i++)
+    {
+        modules[i].module_apis = fake_module.module_apis;
+        modules[i].module_handle = (i == 0) ? (MODULE_HANDLE)source_handle : (MODULE_HANDLE)(0x100 + i);
+        (void)Broker_AddModule(broker, &modules[i]);
+    }
+    BROKER_LINK_DATA bld =
+    {
+        modules[0].module_handle,
+        modules[1].module_handle
+    };
+    (void)Broker_AddLink(broker, &bld);
+    mocks.ResetAllCalls();
+
+    ///act
+    for (size_t i = 0; i < module_count; i++)
+    {
+        publish_results[i] = Broker_Publish(broker, modules[i].module_handle, message);
+    }
+
+    ///assert
+    for (size_t i = 0; i < module_count; i++)
+    {
+        BROKER_QUEUE_STATS stats;
+        ASSERT_ARE_EQUAL(BROKER_RESULT, publish_results[i], BROKER_OK);
+        ASSERT_ARE_EQUAL(BROKER_RESULT, Broker_GetSinkQueueStats(broker, modules[i].module_handle, &stats), BROKER_OK);
+        ASSERT_ARE_EQUAL(size_t, stats.queued, (size_t)((i == 1) ? 1 : 0));
+    }
+
+    ///cleanup
+    Message_Destroy(message);
+    for (size_t i = 0; i < module_count; i++)
+    {
+        Broker_RemoveModule(broker, &modules[i]);
+    }
+    Broker_Destroy(broker);
+}
+
+//Tests_SRS_BROKER_30_150: [ If `link->high_priority` is `true` and the broker does not use `BROKER_DELIVERY_ZERO_COPY`, `Broker_AddLink` shall return `BROKER_ADD_LINK_ERROR`. ]
+TEST_FUNCTION(Broker_AddLink_high_priority_fails_for_serialized_broker)
+{
+    ///arrange
+    CBrokerMocks mocks;
+    auto broker = Broker_Create();
+    BROKER_LINK_DATA bld =
+    {
+        fake_module_handle,
+        fake_module_handle,
+        NULL,
+        true
+    };
+    mocks.ResetAllCalls();
+
+    ///act
+    auto result = Broker_AddLink(broker, &bld);
+
+    ///assert
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result, BROKER_ADD_LINK_ERROR);
+    mocks.AssertActualAndExpectedCalls();
+
+    ///cleanup
+    Broker_Destroy(broker);
+}
+
+//Tests_SRS_BROKER_30_151: [ In zero-copy mode, if `link->high_priority` is `true` and the sink has no priority lane yet, `Broker_AddLink` shall create one holding `BROKER_HANDLE_DATA::queue_capacity` messages with the `BROKER_OVERFLOW_DROP_NEWEST` policy, and fail with `BROKER_ADD_LINK_ERROR` if that fails. ]
+TEST_FUNCTION(Broker_AddLink_zero_copy_fails_when_priority_lane_cannot_be_allocated)
+{
+    ///arrange
+    CBrokerMocks mocks;
+    BROKER_CONFIG config = { BROKER_DELIVERY_ZERO_COPY };
+    auto broker = Broker_CreateWithConfig(&config);
+    auto result = Broker_AddModule(broker, &fake_module);
+    BROKER_LINK_DATA bld =
+    {
+        fake_module_handle,
+        fake_module_handle,
+        NULL,
+        true
+    };
+    mocks.ResetAllCalls();
+
+    STRICT_EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
+    whenShallmalloc_fail = currentmalloc_call + 1;
+    STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*the priority lane*/
+        .IgnoreArgument(1);
+
+    ///act
+    result = Broker_AddLink(broker, &bld);
+
+    ///assert
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result, BROKER_ADD_LINK_ERROR);
+    mocks.AssertActualAndExpectedCalls();
+
+    ///cleanup
+    Broker_RemoveModule(broker, &fake_module);
+    Broker_Destroy(broker);
+}
+
+//Tests_SRS_BROKER_30_151: [ In zero-copy mode, if `link->high_priority` is `true` and the sink has no priority lane yet, `Broker_AddLink` shall create one holding `BROKER_HANDLE_DATA::queue_capacity` messages with the `BROKER_OVERFLOW_DROP_NEWEST` policy, and fail with `BROKER_ADD_LINK_ERROR` if that fails. ]
+//Tests_SRS_BROKER_30_152: [ If the link to a sink is a high priority link, `Broker_Publish` and `Broker_PublishBatch` shall queue the clones for the sink on its priority lane. ]
+//Tests_SRS_BROKER_30_156: [ `Broker_GetSinkQueueStats` shall set `stats->priority_queued` to the number of messages waiting on the sink's priority lane, 0 if it has none. ]
+//Tests_SRS_BROKER_30_155: [ In zero-copy mode the function shall destroy every message waiting on the module's priority lane and free the lane. ]
+TEST_FUNCTION(Broker_Publish_zero_copy_queues_high_priority_link_on_the_priority_lane)
+{
+    ///arrange
+    CBrokerMocks mocks;
+    BROKER_CONFIG config = { BROKER_DELIVERY_ZERO_COPY };
+    auto broker = Broker_CreateWithConfig(&config);
+
+    unsigned char fake;
+    MESSAGE_CONFIG c = { 1, &fake, (MAP_HANDLE)&fake };
+    auto telemetry = Message_Create(&c);
+    auto command = Message_Create(&c);
+
+    auto result = Broker_AddModule(broker, &fake_batch_module);
+    result = Broker_AddModule(broker, &fake_module);
+    BROKER_LINK_DATA telemetry_link =
+    {
+        fake_module_handle,
+        fake_module_handle
+    };
+    BROKER_LINK_DATA command_link =
+    {
+        fake_batch_module_handle,
+        fake_module_handle,
+        NULL,
+        true
+    };
+    result = Broker_AddLink(broker, &telemetry_link);
+    result = Broker_AddLink(broker, &command_link);
+    mocks.ResetAllCalls();
+
+    STRICT_EXPECTED_CALL(mocks, Message_Clone(telemetry));
+    STRICT_EXPECTED_CALL(mocks, Message_Clone(command));
+
+    ///act
+    auto result1 = Broker_Publish(broker, fake_module_handle, telemetry);
+    auto result2 = Broker_Publish(broker, fake_batch_module_handle, command);
+
+    ///assert
+    BROKER_QUEUE_STATS stats;
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result, BROKER_OK);
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result1, BROKER_OK);
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result2, BROKER_OK);
+    mocks.AssertActualAndExpectedCalls();
+    ASSERT_ARE_EQUAL(BROKER_RESULT, Broker_GetSinkQueueStats(broker, fake_module_handle, &stats), BROKER_OK);
+    ASSERT_ARE_EQUAL(size_t, stats.queued, 1);
+    ASSERT_ARE_EQUAL(size_t, stats.priority_queued, 1);
+
+    ///cleanup
+    Message_Destroy(telemetry);
+    Message_Destroy(command);
+    Broker_RemoveModule(broker, &fake_module);
+    Broker_RemoveModule(broker, &fake_batch_module);
+    Broker_Destroy(broker);
+}
+
+//Tests_SRS_BROKER_30_153: [ The zero-copy worker shall take messages off the module's priority lane before its queue, except that after delivering `BROKER_PRIORITY_BURST` messages off the priority lane in a row it shall deliver a message waiting in the queue first. ]
+TEST_FUNCTION(module_queue_worker_delivers_the_priority_lane_first)
+{
+    ///arrange
+    CBrokerMocks mocks;
+    BROKER_CONFIG config = { BROKER_DELIVERY_ZERO_COPY };
+    auto broker = Broker_CreateWithConfig(&config);
+
+    unsigned char fake;
+    MESSAGE_CONFIG c = { 1, &fake, (MAP_HANDLE)&fake };
+    auto telemetry = Message_Create(&c);
+    auto command = Message_Create(&c);
+    call_status_for_FakeModule_Receive.module = fake_module.module_handle;
+
+    /*the worker of the module added last is the one thread_func_to_call runs*/
+    auto result = Broker_AddModule(broker, &fake_batch_module);
+    result = Broker_AddModule(broker, &fake_module);
+    BROKER_LINK_DATA telemetry_link =
+    {
+        fake_module_handle,
+        fake_module_handle
+    };
+    BROKER_LINK_DATA command_link =
+    {
+        fake_batch_module_handle,
+        fake_module_handle,
+        NULL,
+        true
+    };
+    result = Broker_AddLink(broker, &telemetry_link);
+    result = Broker_AddLink(broker, &command_link);
+    result = Broker_Publish(broker, fake_module_handle, telemetry);
+    result = Broker_Publish(broker, fake_module_handle, telemetry);
+    result = Broker_Publish(broker, fake_batch_module_handle, command);
+    mocks.ResetAllCalls();
+
+    STRICT_EXPECTED_CALL(mocks, Message_Destroy(command));
+    STRICT_EXPECTED_CALL(mocks, Message_Destroy(telemetry));
+    STRICT_EXPECTED_CALL(mocks, Message_Destroy(telemetry));
+    whenShallLock_fail = currentLock_call + 1;
+    STRICT_EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+
+    ///act
+    auto thread_result = thread_func_to_call(thread_func_args);
+
+    ///assert
+    ASSERT_ARE_EQUAL(int, thread_result, 0);
+    ASSERT_ARE_EQUAL(size_t, 3, fake_received_count);
+    ASSERT_ARE_EQUAL(void_ptr, command, fake_received[0]);
+    ASSERT_ARE_EQUAL(void_ptr, telemetry, fake_received[1]);
+    ASSERT_ARE_EQUAL(void_ptr, telemetry, fake_received[2]);
+    mocks.AssertActualAndExpectedCalls();
+
+    ///cleanup
+    Message_Destroy(telemetry);
+    Message_Destroy(command);
+    Broker_RemoveModule(broker, &fake_module);
+    Broker_RemoveModule(broker, &fake_batch_module);
+    Broker_Destroy(broker);
+}
+
+//Tests_SRS_BROKER_30_153: [ The zero-copy worker shall take messages off the module's priority lane before its queue, except that after delivering `BROKER_PRIORITY_BURST` messages off the priority lane in a row it shall deliver a message waiting in the queue first. ]
+TEST_FUNCTION(module_queue_worker_lets_the_queue_through_after_a_priority_burst)
+{
+    ///arrange
+    CBrokerMocks mocks;
+    BROKER_CONFIG config = { BROKER_DELIVERY_ZERO_COPY };
+    auto broker = Broker_CreateWithConfig(&config);
+
+    unsigned char fake;
+    MESSAGE_CONFIG c = { 1, &fake, (MAP_HANDLE)&fake };
+    auto telemetry = Message_Create(&c);
+    auto command = Message_Create(&c);
+    call_status_for_FakeModule_Receive.module = fake_module.module_handle;
+
+    auto result = Broker_AddModule(broker, &fake_batch_module);
+    result = Broker_AddModule(broker, &fake_module);
+    BROKER_LINK_DATA telemetry_link =
+    {
+        fake_module_handle,
+        fake_module_handle
+    };
+    BROKER_LINK_DATA command_link =
+    {
+        fake_batch_module_handle,
+        fake_module_handle,
+        NULL,
+        true
+    };
+    result = Broker_AddLink(broker, &telemetry_link);
+    result = Broker_AddLink(broker, &command_link);
+    result = Broker_Publish(broker, fake_module_handle, telemetry);
+    for (size_t i = 0; i < BROKER_PRIORITY_BURST + 2; i++)
+    {
+        result = Broker_Publish(broker, fake_batch_module_handle, command);
+    }
+    mocks.ResetAllCalls();
+
+    STRICT_EXPECTED_CALL(mocks, Message_Destroy(command))
+        .ExpectedTimesExactly(BROKER_PRIORITY_BURST + 2);
+    STRICT_EXPECTED_CALL(mocks, Message_Destroy(telemetry));
+    whenShallLock_fail = currentLock_call + 1;
+    STRICT_EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+
+    ///act
+    auto thread_result = thread_func_to_call(thread_func_args);
+
+    ///assert
+    ASSERT_ARE_EQUAL(int, thread_result, 0);
+    ASSERT_ARE_EQUAL(size_t, BROKER_PRIORITY_BURST + 3, fake_received_count);
+    for (size_t i = 0; i < BROKER_PRIORITY_BURST; i++)
+    {
+        ASSERT_ARE_EQUAL(void_ptr, command, fake_received[i]);
+    }
+    ASSERT_ARE_EQUAL(void_ptr, telemetry, fake_received[BROKER_PRIORITY_BURST]);
+    ASSERT_ARE_EQUAL(void_ptr, command, fake_received[BROKER_PRIORITY_BURST + 1]);
+    ASSERT_ARE_EQUAL(void_ptr, command, fake_received[BROKER_PRIORITY_BURST + 2]);
+    mocks.AssertActualAndExpectedCalls();
+
+    ///cleanup
+    Message_Destroy(telemetry);
+    Message_Destroy(command);
+    Broker_RemoveModule(broker, &fake_module);
+    Broker_RemoveModule(broker, &fake_batch_module);
+    Broker_Destroy(broker);
+}
+
 END_TEST_SUITE(broker_ut)
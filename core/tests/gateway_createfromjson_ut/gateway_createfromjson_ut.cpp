@@ -50,6 +50,13 @@ namespace BASEIMPLEMENTATION
 
 static MODULE_API_1 dummyAPIs;
 static size_t currentBroker_ref_count;
+
+/*what the last filtered link handed to Broker_AddLink looked like*/
+static size_t addedFilter_condition_count;
+static BROKER_FILTER_CONDITION addedFilter_conditions[2];
+static const char* addedFilter_values[3];
+/*how many links handed to Broker_AddLink were high priority*/
+static size_t addedHighPriority_link_count;
 static MODULE_LOADER_API default_module_loader;
 static MODULE_LOADER dummyModuleLoader;
 static GATEWAY_MODULE_LOADER_INFO dummyLoaderInfo;
@@ -103,6 +110,12 @@ public:
         }
     MOCK_METHOD_END(const char*, string);
 
+    MOCK_STATIC_METHOD_2(, double, json_object_get_number, const JSON_Object*, object, const char*, name)
+    MOCK_METHOD_END(double, 0);
+
+    MOCK_STATIC_METHOD_2(, int, json_object_get_boolean, const JSON_Object*, object, const char*, name)
+    MOCK_METHOD_END(int, -1);
+
     MOCK_STATIC_METHOD_2(, JSON_Object*, json_object_get_object, const JSON_Object*, object, const char*, name)
         JSON_Object* object1 = NULL;
         if (object != NULL && name != NULL)
@@ -137,6 +150,24 @@ public:
         BASEIMPLEMENTATION::gballoc_free(string);
     MOCK_VOID_METHOD_END();
 
+    MOCK_STATIC_METHOD_1(, size_t, json_object_get_count, const JSON_Object*, object)
+    MOCK_METHOD_END(size_t, 0);
+
+    MOCK_STATIC_METHOD_2(, const char*, json_object_get_name, const JSON_Object*, object, size_t, index)
+    MOCK_METHOD_END(const char*, NULL);
+
+    MOCK_STATIC_METHOD_1(, JSON_Value_Type, json_value_get_type, const JSON_Value*, value)
+    MOCK_METHOD_END(JSON_Value_Type, JSONError);
+
+    MOCK_STATIC_METHOD_1(, const char*, json_value_get_string, const JSON_Value*, value)
+    MOCK_METHOD_END(const char*, NULL);
+
+    MOCK_STATIC_METHOD_1(, JSON_Array*, json_value_get_array, const JSON_Value*, value)
+    MOCK_METHOD_END(JSON_Array*, NULL);
+
+    MOCK_STATIC_METHOD_2(, const char*, json_array_get_string, const JSON_Array*, arr, size_t, index)
+    MOCK_METHOD_END(const char*, NULL);
+
     /*Gateway Mocks*/
     MOCK_STATIC_METHOD_1(, GATEWAY_HANDLE, Gateway_Create, const GATEWAY_PROPERTIES*, properties)
         GATEWAY_HANDLE handle = (GATEWAY_HANDLE)BASEIMPLEMENTATION::gballoc_malloc(1);
@@ -155,6 +186,17 @@ public:
         BROKER_HANDLE result1 = (BROKER_HANDLE)BASEIMPLEMENTATION::gballoc_malloc(1);
     MOCK_METHOD_END(BROKER_HANDLE, result1);
 
+    MOCK_STATIC_METHOD_1(, BROKER_HANDLE, Broker_CreateWithConfig, const BROKER_CONFIG*, config)
+        ++currentBroker_ref_count;
+        BROKER_HANDLE result1 = (BROKER_HANDLE)BASEIMPLEMENTATION::gballoc_malloc(1);
+    MOCK_METHOD_END(BROKER_HANDLE, result1);
+
+    MOCK_STATIC_METHOD_1(, int, MessagePool_Enable, const MESSAGE_POOL_CONFIG*, config)
+    MOCK_METHOD_END(int, 0);
+
+    MOCK_STATIC_METHOD_0(, void, MessagePool_Disable)
+    MOCK_VOID_METHOD_END();
+
     MOCK_STATIC_METHOD_1(, void, Broker_Destroy, BROKER_HANDLE, broker)
         if (currentBroker_ref_count > 0)
         {
@@ -184,10 +226,33 @@ public:
     MOCK_STATIC_METHOD_2(, BROKER_RESULT, Broker_AddModule, BROKER_HANDLE, handle, const MODULE*, module)
     MOCK_METHOD_END(BROKER_RESULT, BROKER_OK);
 
+    MOCK_STATIC_METHOD_3(, BROKER_RESULT, Broker_AddModuleWithConfig, BROKER_HANDLE, handle, const MODULE*, module, const BROKER_MODULE_CONFIG*, config)
+    MOCK_METHOD_END(BROKER_RESULT, BROKER_OK);
+
     MOCK_STATIC_METHOD_2(, BROKER_RESULT, Broker_RemoveModule, BROKER_HANDLE, handle, const MODULE*, module)
     MOCK_METHOD_END(BROKER_RESULT, BROKER_OK);
 
     MOCK_STATIC_METHOD_2(, BROKER_RESULT, Broker_AddLink, BROKER_HANDLE, handle, const BROKER_LINK_DATA*, link)
+        if (link->filter != NULL && link->filter->condition_count == 2)
+        {
+            /*the filter is freed with the properties, keep what the tests look at*/
+            addedFilter_condition_count = link->filter->condition_count;
+            addedFilter_conditions[0] = link->filter->conditions[0];
+            addedFilter_conditions[1] = link->filter->conditions[1];
+            addedFilter_values[0] = link->filter->conditions[0].values[0];
+            addedFilter_values[1] = link->filter->conditions[1].values[0];
+            addedFilter_values[2] = link->filter->conditions[1].values[1];
+        }
+        if (link->high_priority)
+        {
+            addedHighPriority_link_count++;
+        }
+    MOCK_METHOD_END(BROKER_RESULT, BROKER_OK)
+
+    MOCK_STATIC_METHOD_3(, BROKER_RESULT, Broker_SetSinkQueue, BROKER_HANDLE, broker, MODULE_HANDLE, sink, const BROKER_QUEUE_CONFIG*, config)
+    MOCK_METHOD_END(BROKER_RESULT, BROKER_OK)
+
+    MOCK_STATIC_METHOD_3(, BROKER_RESULT, Broker_SetSinkInline, BROKER_HANDLE, broker, MODULE_HANDLE, sink, bool, deliver_inline)
     MOCK_METHOD_END(BROKER_RESULT, BROKER_OK)
 
     MOCK_STATIC_METHOD_2(, BROKER_RESULT, Broker_RemoveLink, BROKER_HANDLE, handle, const BROKER_LINK_DATA*, link)
@@ -338,24 +403,38 @@ DECLARE_GLOBAL_MOCK_METHOD_2(CGatewayMocks, , JSON_Array*, json_object_get_array
 DECLARE_GLOBAL_MOCK_METHOD_1(CGatewayMocks, , size_t, json_array_get_count, const JSON_Array*, arr);
 DECLARE_GLOBAL_MOCK_METHOD_2(CGatewayMocks, , JSON_Object*, json_array_get_object, const JSON_Array*, arr, size_t, index);
 DECLARE_GLOBAL_MOCK_METHOD_2(CGatewayMocks, , const char*, json_object_get_string, const JSON_Object*, object, const char*, name);
+DECLARE_GLOBAL_MOCK_METHOD_2(CGatewayMocks, , double, json_object_get_number, const JSON_Object*, object, const char*, name);
+DECLARE_GLOBAL_MOCK_METHOD_2(CGatewayMocks, , int, json_object_get_boolean, const JSON_Object*, object, const char*, name);
 DECLARE_GLOBAL_MOCK_METHOD_2(CGatewayMocks, , JSON_Object*, json_object_get_object, const JSON_Object*, object, const char*, name);
 
 DECLARE_GLOBAL_MOCK_METHOD_2(CGatewayMocks, , JSON_Value*, json_object_get_value, const JSON_Object*, object, const char*, name);
 DECLARE_GLOBAL_MOCK_METHOD_1(CGatewayMocks, , char*, json_serialize_to_string, const JSON_Value*, value);
 DECLARE_GLOBAL_MOCK_METHOD_1(CGatewayMocks, , void, json_value_free, JSON_Value*, value);
 DECLARE_GLOBAL_MOCK_METHOD_1(CGatewayMocks, , void, json_free_serialized_string, char*, string);
+DECLARE_GLOBAL_MOCK_METHOD_1(CGatewayMocks, , size_t, json_object_get_count, const JSON_Object*, object);
+DECLARE_GLOBAL_MOCK_METHOD_2(CGatewayMocks, , const char*, json_object_get_name, const JSON_Object*, object, size_t, index);
+DECLARE_GLOBAL_MOCK_METHOD_1(CGatewayMocks, , JSON_Value_Type, json_value_get_type, const JSON_Value*, value);
+DECLARE_GLOBAL_MOCK_METHOD_1(CGatewayMocks, , const char*, json_value_get_string, const JSON_Value*, value);
+DECLARE_GLOBAL_MOCK_METHOD_1(CGatewayMocks, , JSON_Array*, json_value_get_array, const JSON_Value*, value);
+DECLARE_GLOBAL_MOCK_METHOD_2(CGatewayMocks, , const char*, json_array_get_string, const JSON_Array*, arr, size_t, index);
 
 DECLARE_GLOBAL_MOCK_METHOD_1(CGatewayMocks, , GATEWAY_HANDLE, Gateway_Create, const GATEWAY_PROPERTIES*, properties);
 DECLARE_GLOBAL_MOCK_METHOD_1(CGatewayMocks, , void, Gateway_Destroy, GATEWAY_HANDLE, gw);
 DECLARE_GLOBAL_MOCK_METHOD_1(CGatewayMocks, , GATEWAY_START_RESULT, Gateway_Start, GATEWAY_HANDLE, gw);
 
 DECLARE_GLOBAL_MOCK_METHOD_0(CGatewayMocks, , BROKER_HANDLE, Broker_Create);
+DECLARE_GLOBAL_MOCK_METHOD_1(CGatewayMocks, , BROKER_HANDLE, Broker_CreateWithConfig, const BROKER_CONFIG*, config);
+DECLARE_GLOBAL_MOCK_METHOD_1(CGatewayMocks, , int, MessagePool_Enable, const MESSAGE_POOL_CONFIG*, config);
+DECLARE_GLOBAL_MOCK_METHOD_0(CGatewayMocks, , void, MessagePool_Disable);
 DECLARE_GLOBAL_MOCK_METHOD_1(CGatewayMocks, , void, Broker_Destroy, BROKER_HANDLE, broker);
 DECLARE_GLOBAL_MOCK_METHOD_1(CGatewayMocks, , void, Broker_IncRef, BROKER_HANDLE, broker);
 DECLARE_GLOBAL_MOCK_METHOD_1(CGatewayMocks, , void, Broker_DecRef, BROKER_HANDLE, broker);
 DECLARE_GLOBAL_MOCK_METHOD_2(CGatewayMocks, , BROKER_RESULT, Broker_AddModule, BROKER_HANDLE, handle, const MODULE*, module);
+DECLARE_GLOBAL_MOCK_METHOD_3(CGatewayMocks, , BROKER_RESULT, Broker_AddModuleWithConfig, BROKER_HANDLE, handle, const MODULE*, module, const BROKER_MODULE_CONFIG*, config);
 DECLARE_GLOBAL_MOCK_METHOD_2(CGatewayMocks, , BROKER_RESULT, Broker_RemoveModule, BROKER_HANDLE, handle, const MODULE*, module);
 DECLARE_GLOBAL_MOCK_METHOD_2(CGatewayMocks, , BROKER_RESULT, Broker_AddLink, BROKER_HANDLE, handle, const BROKER_LINK_DATA*, link);
+DECLARE_GLOBAL_MOCK_METHOD_3(CGatewayMocks, , BROKER_RESULT, Broker_SetSinkQueue, BROKER_HANDLE, broker, MODULE_HANDLE, sink, const BROKER_QUEUE_CONFIG*, config);
+DECLARE_GLOBAL_MOCK_METHOD_3(CGatewayMocks, , BROKER_RESULT, Broker_SetSinkInline, BROKER_HANDLE, broker, MODULE_HANDLE, sink, bool, deliver_inline);
 DECLARE_GLOBAL_MOCK_METHOD_2(CGatewayMocks, , BROKER_RESULT, Broker_RemoveLink, BROKER_HANDLE, handle, const BROKER_LINK_DATA*, link);
 
 DECLARE_GLOBAL_MOCK_METHOD_0(CGatewayMocks, , const MODULE_LOADER_API*, DynamicLoader_GetApi);
@@ -465,6 +544,9 @@ TEST_FUNCTION_INITIALIZE(TestMethodInitialize)
     {
         ASSERT_FAIL("our mutex is ABANDONED. Failure in test framework");
     }
+
+    addedFilter_condition_count = 0;
+    addedHighPriority_link_count = 0;
 }
 
 TEST_FUNCTION_CLEANUP(TestMethodCleanup)
@@ -577,6 +659,49 @@ TEST_FUNCTION(Gateway_CreateFromJson_Returns_NULL_On_Properties_Malloc_Failure)
 
 }
 
+static void setup_broker_entry(CGatewayMocks& mocks, const char* delivery, double queue_capacity = 0, double batch_size = 0, JSON_Object* message_pool = NULL, double thread_cache_size = 0, double depot_size = 0, const char* scheduler = NULL, double worker_threads = 0)
+{
+    if (delivery == NULL)
+    {
+        STRICT_EXPECTED_CALL(mocks, json_object_get_object(IGNORED_PTR_ARG, "broker"))
+            .IgnoreArgument(1)
+            .SetReturn((JSON_Object*)NULL);
+    }
+    else
+    {
+        STRICT_EXPECTED_CALL(mocks, json_object_get_object(IGNORED_PTR_ARG, "broker"))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, json_object_get_string(IGNORED_PTR_ARG, "delivery"))
+            .IgnoreArgument(1)
+            .SetReturn(delivery);
+        STRICT_EXPECTED_CALL(mocks, json_object_get_number(IGNORED_PTR_ARG, "queue-capacity"))
+            .IgnoreArgument(1)
+            .SetReturn(queue_capacity);
+        STRICT_EXPECTED_CALL(mocks, json_object_get_number(IGNORED_PTR_ARG, "batch-size"))
+            .IgnoreArgument(1)
+            .SetReturn(batch_size);
+        STRICT_EXPECTED_CALL(mocks, json_object_get_number(IGNORED_PTR_ARG, "batch-window-ms"))
+            .IgnoreArgument(1)
+            .SetReturn((double)0);
+        STRICT_EXPECTED_CALL(mocks, json_object_get_string(IGNORED_PTR_ARG, "scheduler"))
+            .IgnoreArgument(1)
+            .SetReturn(scheduler);
+        STRICT_EXPECTED_CALL(mocks, json_object_get_number(IGNORED_PTR_ARG, "worker-threads"))
+            .IgnoreArgument(1)
+            .SetReturn(worker_threads);
+        STRICT_EXPECTED_CALL(mocks, json_object_get_object(IGNORED_PTR_ARG, "message-pool"))
+            .IgnoreArgument(1)
+            .SetReturn(message_pool);
+        if (message_pool != NULL)
+        {
+            STRICT_EXPECTED_CALL(mocks, json_object_get_number(message_pool, "thread-cache-size"))
+                .SetReturn(thread_cache_size);
+            STRICT_EXPECTED_CALL(mocks, json_object_get_number(message_pool, "depot-size"))
+                .SetReturn(depot_size);
+        }
+    }
+}
+
 static void setup_2module_gw(CGatewayMocks& mocks, char * path)
 {
     STRICT_EXPECTED_CALL(mocks, ModuleLoader_Initialize());
@@ -599,7 +724,7 @@ static void setup_2module_gw(CGatewayMocks& mocks, char * path)
     STRICT_EXPECTED_CALL(mocks, VECTOR_create(sizeof(GATEWAY_MODULES_ENTRY)));
 }
 
-static void setup_parse_modules_entry(CGatewayMocks& mocks, size_t index, const char * modulename, const char* loadername = "loader1")
+static void setup_parse_modules_entry(CGatewayMocks& mocks, size_t index, const char * modulename, const char* loadername = "loader1", int dedicated_thread = -1, int deliver_inline = -1)
 {
     STRICT_EXPECTED_CALL(mocks, json_array_get_object(IGNORED_PTR_ARG, index))
         .IgnoreArgument(1);
@@ -622,12 +747,45 @@ static void setup_parse_modules_entry(CGatewayMocks& mocks, size_t index, const
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, json_serialize_to_string(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, json_object_get_boolean(IGNORED_PTR_ARG, "dedicated-thread"))
+        .IgnoreArgument(1)
+        .SetReturn(dedicated_thread);
+    STRICT_EXPECTED_CALL(mocks, json_object_get_boolean(IGNORED_PTR_ARG, "inline"))
+        .IgnoreArgument(1)
+        .SetReturn(deliver_inline);
     STRICT_EXPECTED_CALL(mocks, VECTOR_push_back(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1))
         .IgnoreArgument(1)
         .IgnoreArgument(2);
 }
 
-static void setup_links_entry(CGatewayMocks& mocks, size_t index, const char * source, const char * sink)
+static void setup_link_queue_entry(CGatewayMocks& mocks, double queue_capacity, const char* overflow, double sample_interval)
+{
+    STRICT_EXPECTED_CALL(mocks, json_object_get_number(IGNORED_PTR_ARG, "queue-capacity"))
+        .IgnoreArgument(1)
+        .SetReturn(queue_capacity);
+    STRICT_EXPECTED_CALL(mocks, json_object_get_string(IGNORED_PTR_ARG, "overflow"))
+        .IgnoreArgument(1)
+        .SetReturn(overflow);
+    STRICT_EXPECTED_CALL(mocks, json_object_get_number(IGNORED_PTR_ARG, "sample-interval"))
+        .IgnoreArgument(1)
+        .SetReturn(sample_interval);
+}
+
+static void setup_link_filter_entry(CGatewayMocks& mocks, JSON_Object* filter = NULL)
+{
+    STRICT_EXPECTED_CALL(mocks, json_object_get_object(IGNORED_PTR_ARG, "filter"))
+        .IgnoreArgument(1)
+        .SetReturn(filter);
+}
+
+static void setup_link_priority_entry(CGatewayMocks& mocks, int high_priority)
+{
+    STRICT_EXPECTED_CALL(mocks, json_object_get_boolean(IGNORED_PTR_ARG, "high-priority"))
+        .IgnoreArgument(1)
+        .SetReturn(high_priority);
+}
+
+static void setup_links_entry(CGatewayMocks& mocks, size_t index, const char * source, const char * sink, int high_priority = -1)
 {
     STRICT_EXPECTED_CALL(mocks, json_array_get_object(IGNORED_PTR_ARG, index))
         .IgnoreArgument(1);
@@ -637,12 +795,27 @@ static void setup_links_entry(CGatewayMocks& mocks, size_t index, const char * s
     STRICT_EXPECTED_CALL(mocks, json_object_get_string(IGNORED_PTR_ARG, "sink"))
         .IgnoreArgument(1)
         .SetReturn(sink);
+    setup_link_queue_entry(mocks, 0, NULL, 0);
+    setup_link_filter_entry(mocks);
+    setup_link_priority_entry(mocks, high_priority);
     STRICT_EXPECTED_CALL(mocks, VECTOR_push_back(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1))
         .IgnoreArgument(1)
         .IgnoreArgument(2);
 }
 
-static void add_a_module(CGatewayMocks& mocks, size_t index)
+/*destroying the properties walks the links to free their queue configurations*/
+static void expect_links_destroyed(CGatewayMocks& mocks, size_t link_count)
+{
+    STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    for (size_t index = 0; index < link_count; index++)
+    {
+        STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, index))
+            .IgnoreArgument(1);
+    }
+}
+
+static void add_a_module(CGatewayMocks& mocks, size_t index, bool dedicated_thread = false, bool deliver_inline = false)
 {
     STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, index))
         .IgnoreArgument(1);
@@ -664,9 +837,23 @@ static void add_a_module(CGatewayMocks& mocks, size_t index)
 	STRICT_EXPECTED_CALL(mocks, DynamicModuleLoader_FreeModuleConfiguration(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
 		.IgnoreArgument(1)
         .IgnoreArgument(2);
-    STRICT_EXPECTED_CALL(mocks, Broker_AddModule(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreArgument(1)
-        .IgnoreArgument(2);
+    if (dedicated_thread)
+    {
+        STRICT_EXPECTED_CALL(mocks, Broker_AddModuleWithConfig(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .IgnoreAllArguments();
+    }
+    else
+    {
+        STRICT_EXPECTED_CALL(mocks, Broker_AddModule(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .IgnoreArgument(1)
+            .IgnoreArgument(2);
+    }
+    if (deliver_inline)
+    {
+        STRICT_EXPECTED_CALL(mocks, Broker_SetSinkInline(IGNORED_PTR_ARG, IGNORED_PTR_ARG, true))
+            .IgnoreArgument(1)
+            .IgnoreArgument(2);
+    }
     EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
     STRICT_EXPECTED_CALL(mocks, Broker_IncRef(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
@@ -675,8 +862,6 @@ static void add_a_module(CGatewayMocks& mocks, size_t index)
         .IgnoreArgument(2);
     STRICT_EXPECTED_CALL(mocks, VECTOR_back(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
 }
 
 static void add_a_link(CGatewayMocks& mocks, size_t index)
@@ -724,6 +909,8 @@ TEST_FUNCTION(Gateway_CreateFromJson_Returns_NULL_on_gateway_create_internal_fai
     setup_links_entry(mocks, 0, "module1", "module2");
     setup_links_entry(mocks, 1, "module2", "module1");
 
+    setup_broker_entry(mocks, NULL);
+
     STRICT_EXPECTED_CALL(mocks, gballoc_malloc(sizeof(GATEWAY_HANDLE_DATA)))
         .SetFailReturn(nullptr);
 
@@ -738,6 +925,7 @@ TEST_FUNCTION(Gateway_CreateFromJson_Returns_NULL_on_gateway_create_internal_fai
     STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 1))
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, json_free_serialized_string((char *)"[serialized string]"));
+    expect_links_destroyed(mocks, 2);
     STRICT_EXPECTED_CALL(mocks, VECTOR_destroy(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, VECTOR_destroy(IGNORED_PTR_ARG))
@@ -797,6 +985,8 @@ TEST_FUNCTION(Gateway_CreateFromJson_Parses_Valid_JSON_Configuration_File)
     setup_links_entry(mocks, 1, "module2", "module1");
 
 
+    setup_broker_entry(mocks, NULL);
+
     STRICT_EXPECTED_CALL(mocks, gballoc_malloc(sizeof(GATEWAY_HANDLE_DATA)));
     STRICT_EXPECTED_CALL(mocks, Broker_Create());
     STRICT_EXPECTED_CALL(mocks, VECTOR_create(sizeof(MODULE_DATA*)));
@@ -840,6 +1030,7 @@ TEST_FUNCTION(Gateway_CreateFromJson_Parses_Valid_JSON_Configuration_File)
 		   .IgnoreArgument(1)
            .IgnoreArgument(2);
        STRICT_EXPECTED_CALL(mocks, json_free_serialized_string((char*)"[serialized string]"));
+       expect_links_destroyed(mocks, 2);
        STRICT_EXPECTED_CALL(mocks, VECTOR_destroy(IGNORED_PTR_ARG))
            .IgnoreArgument(1);
        STRICT_EXPECTED_CALL(mocks, VECTOR_destroy(IGNORED_PTR_ARG))
@@ -882,6 +1073,8 @@ TEST_FUNCTION(Gateway_Create_Start_fails_returns_null)
     setup_links_entry(mocks, 1, "module2", "module1");
 
 
+    setup_broker_entry(mocks, NULL);
+
     STRICT_EXPECTED_CALL(mocks, gballoc_malloc(sizeof(GATEWAY_HANDLE_DATA)));
     STRICT_EXPECTED_CALL(mocks, Broker_Create());
     STRICT_EXPECTED_CALL(mocks, VECTOR_create(sizeof(MODULE_DATA*)));
@@ -918,6 +1111,7 @@ TEST_FUNCTION(Gateway_Create_Start_fails_returns_null)
     STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG,1))
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, json_free_serialized_string((char *)"[serialized string]"));
+    expect_links_destroyed(mocks, 2);
     STRICT_EXPECTED_CALL(mocks, VECTOR_destroy(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, VECTOR_destroy(IGNORED_PTR_ARG))
@@ -958,10 +1152,6 @@ TEST_FUNCTION(Gateway_Create_Start_fails_returns_null)
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, Broker_RemoveLink(IGNORED_PTR_ARG,IGNORED_PTR_ARG))
         .IgnoreArgument(1)
         .IgnoreArgument(2);
@@ -1079,6 +1269,10 @@ TEST_FUNCTION(Gateway_CreateFromJson_Traverses_JSON_Push_Back_Fail)
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, json_serialize_to_string(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, json_object_get_boolean(IGNORED_PTR_ARG, "dedicated-thread"))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, json_object_get_boolean(IGNORED_PTR_ARG, "inline"))
+        .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, VECTOR_push_back(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1))
         .IgnoreArgument(1)
         .IgnoreArgument(2)
@@ -1188,6 +1382,8 @@ TEST_FUNCTION(Gateway_CreateFromJson_Traverses_JSON_Value_NULL_Loaders_Array_suc
     setup_links_entry(mocks, 0, "module1", "module2");
     setup_links_entry(mocks, 1, "module2", "module1");
 
+    setup_broker_entry(mocks, NULL);
+
     STRICT_EXPECTED_CALL(mocks, gballoc_malloc(sizeof(GATEWAY_HANDLE_DATA)));
     STRICT_EXPECTED_CALL(mocks, Broker_Create());
     STRICT_EXPECTED_CALL(mocks, VECTOR_create(sizeof(MODULE_DATA*)));
@@ -1231,6 +1427,7 @@ TEST_FUNCTION(Gateway_CreateFromJson_Traverses_JSON_Value_NULL_Loaders_Array_suc
 		.IgnoreArgument(1)
         .IgnoreArgument(2);
     STRICT_EXPECTED_CALL(mocks, json_free_serialized_string((char *)"[serialized string]"));
+    expect_links_destroyed(mocks, 2);
     STRICT_EXPECTED_CALL(mocks, VECTOR_destroy(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, VECTOR_destroy(IGNORED_PTR_ARG))
@@ -1471,6 +1668,8 @@ TEST_FUNCTION(Gateway_CreateFromJson_uses_native_loader_when_loader_name_is_miss
     setup_links_entry(mocks, 0, "module1", "module2");
     setup_links_entry(mocks, 1, "module2", "module1");
 
+    setup_broker_entry(mocks, NULL);
+
     STRICT_EXPECTED_CALL(mocks, gballoc_malloc(sizeof(GATEWAY_HANDLE_DATA)));
     STRICT_EXPECTED_CALL(mocks, Broker_Create());
     STRICT_EXPECTED_CALL(mocks, VECTOR_create(sizeof(MODULE_DATA*)));
@@ -1513,6 +1712,7 @@ TEST_FUNCTION(Gateway_CreateFromJson_uses_native_loader_when_loader_name_is_miss
         .IgnoreArgument(1)
         .IgnoreArgument(2);
     STRICT_EXPECTED_CALL(mocks, json_free_serialized_string((char *)"[serialized string]"));
+    expect_links_destroyed(mocks, 2);
     STRICT_EXPECTED_CALL(mocks, VECTOR_destroy(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, VECTOR_destroy(IGNORED_PTR_ARG))
@@ -1600,6 +1800,10 @@ TEST_FUNCTION(Gateway_CreateFromJson_fails_with_no_entry_point)
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, json_serialize_to_string(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, json_object_get_boolean(IGNORED_PTR_ARG, "dedicated-thread"))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, json_object_get_boolean(IGNORED_PTR_ARG, "inline"))
+        .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, VECTOR_push_back(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1))
         .IgnoreArgument(1)
         .IgnoreArgument(2);
@@ -1616,6 +1820,8 @@ TEST_FUNCTION(Gateway_CreateFromJson_fails_with_no_entry_point)
     setup_links_entry(mocks, 1, "module2", "module1");
 
     // Create gateway until 1st module fails immediately
+    setup_broker_entry(mocks, NULL);
+
     STRICT_EXPECTED_CALL(mocks, gballoc_malloc(sizeof(GATEWAY_HANDLE_DATA)));
     STRICT_EXPECTED_CALL(mocks, Broker_Create());
     STRICT_EXPECTED_CALL(mocks, VECTOR_create(sizeof(MODULE_DATA*)));
@@ -1651,6 +1857,7 @@ TEST_FUNCTION(Gateway_CreateFromJson_fails_with_no_entry_point)
 		.IgnoreArgument(1)
         .IgnoreArgument(2);
     STRICT_EXPECTED_CALL(mocks, json_free_serialized_string((char *)"[serialized string]"));
+    expect_links_destroyed(mocks, 2);
     STRICT_EXPECTED_CALL(mocks, VECTOR_destroy(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, VECTOR_destroy(IGNORED_PTR_ARG))
@@ -1762,6 +1969,7 @@ TEST_FUNCTION(Gateway_CreateFromJson_Fails_links_parsing_no_source)
 		.IgnoreArgument(1)
         .IgnoreArgument(2);
     STRICT_EXPECTED_CALL(mocks, json_free_serialized_string((char *)"[serialized string]"));
+    expect_links_destroyed(mocks, 1);
     STRICT_EXPECTED_CALL(mocks, VECTOR_destroy(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, VECTOR_destroy(IGNORED_PTR_ARG))
@@ -1807,6 +2015,9 @@ TEST_FUNCTION(Gateway_CreateFromJson_Fails_links_parsing_pushback_fails)
     STRICT_EXPECTED_CALL(mocks, json_object_get_string(IGNORED_PTR_ARG, "sink"))
         .IgnoreArgument(1)
         .SetReturn("module1");
+    setup_link_queue_entry(mocks, 0, NULL, 0);
+    setup_link_filter_entry(mocks);
+    setup_link_priority_entry(mocks, -1);
     STRICT_EXPECTED_CALL(mocks, VECTOR_push_back(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1))
         .IgnoreArgument(1)
         .IgnoreArgument(2)
@@ -1826,6 +2037,1233 @@ TEST_FUNCTION(Gateway_CreateFromJson_Fails_links_parsing_pushback_fails)
 		.IgnoreArgument(1)
         .IgnoreArgument(2);
     STRICT_EXPECTED_CALL(mocks, json_free_serialized_string((char *)"[serialized string]"));
+    expect_links_destroyed(mocks, 1);
+    STRICT_EXPECTED_CALL(mocks, VECTOR_destroy(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, VECTOR_destroy(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, json_value_free(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, ModuleLoader_Destroy());
+
+    //Act
+    GATEWAY_HANDLE gateway = Gateway_CreateFromJson(VALID_JSON_PATH);
+
+    //Assert
+    ASSERT_IS_NULL(gateway);
+    mocks.AssertActualAndExpectedCalls();
+}
+
+/*Tests_SRS_GATEWAY_JSON_30_001: [ The function shall parse the optional "broker" JSON object and set `GATEWAY_PROPERTIES::broker_config` when it is present. ]*/
+/*Tests_SRS_GATEWAY_JSON_30_002: [ The function shall parse the "broker" object for "delivery", which may be "serialized" or "zero-copy". ]*/
+TEST_FUNCTION(Gateway_CreateFromJson_Parses_zero_copy_broker_delivery)
+{
+    //Arrange
+    CGatewayMocks mocks;
+
+    setup_2module_gw(mocks, (char *)VALID_JSON_PATH);
+
+    // modules array
+    setup_parse_modules_entry(mocks, 0, "module1");
+    setup_parse_modules_entry(mocks, 1, "module2");
+
+    // links entry
+    STRICT_EXPECTED_CALL(mocks, VECTOR_create(sizeof(GATEWAY_LINK_ENTRY)));
+    STRICT_EXPECTED_CALL(mocks, json_array_get_count(IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .SetReturn(2);
+
+    setup_links_entry(mocks, 0, "module1", "module2");
+    setup_links_entry(mocks, 1, "module2", "module1");
+
+
+    setup_broker_entry(mocks, "zero-copy");
+
+    STRICT_EXPECTED_CALL(mocks, gballoc_malloc(sizeof(GATEWAY_HANDLE_DATA)));
+    STRICT_EXPECTED_CALL(mocks, Broker_CreateWithConfig(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, VECTOR_create(sizeof(MODULE_DATA*)));
+    STRICT_EXPECTED_CALL(mocks, VECTOR_create(sizeof(LINK_DATA)));
+    STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+
+    //Adding module 1 (Success)
+    add_a_module(mocks, 0);
+    //Adding module 2 (Success)
+    add_a_module(mocks, 1);
+
+    //process the links
+    STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    add_a_link(mocks, 0);
+    add_a_link(mocks, 1);
+
+
+    //Gateway start
+       STRICT_EXPECTED_CALL(mocks, EventSystem_Init());
+       STRICT_EXPECTED_CALL(mocks, EventSystem_ReportEvent(IGNORED_PTR_ARG, IGNORED_PTR_ARG, GATEWAY_CREATED))
+           .IgnoreArgument(1)
+           .IgnoreArgument(2);
+       STRICT_EXPECTED_CALL(mocks, EventSystem_ReportEvent(IGNORED_PTR_ARG, IGNORED_PTR_ARG, GATEWAY_MODULE_LIST_CHANGED))
+           .IgnoreArgument(1)
+           .IgnoreArgument(2);
+       STRICT_EXPECTED_CALL(mocks, Gateway_Start(IGNORED_PTR_ARG))
+           .IgnoreArgument(1);
+       STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
+           .IgnoreArgument(1);
+       STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 0))
+           .IgnoreArgument(1);
+	   STRICT_EXPECTED_CALL(mocks, DynamicModuleLoader_FreeEntrypoint(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		   .IgnoreArgument(1)
+           .IgnoreArgument(2);
+       STRICT_EXPECTED_CALL(mocks, json_free_serialized_string((char*)"[serialized string]"));
+       STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 1))
+           .IgnoreArgument(1);
+	   STRICT_EXPECTED_CALL(mocks, DynamicModuleLoader_FreeEntrypoint(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		   .IgnoreArgument(1)
+           .IgnoreArgument(2);
+       STRICT_EXPECTED_CALL(mocks, json_free_serialized_string((char*)"[serialized string]"));
+       expect_links_destroyed(mocks, 2);
+       STRICT_EXPECTED_CALL(mocks, VECTOR_destroy(IGNORED_PTR_ARG))
+           .IgnoreArgument(1);
+       STRICT_EXPECTED_CALL(mocks, VECTOR_destroy(IGNORED_PTR_ARG))
+           .IgnoreArgument(1);
+       STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+           .IgnoreArgument(1);
+       STRICT_EXPECTED_CALL(mocks, json_value_free(IGNORED_PTR_ARG))
+          .IgnoreArgument(1);
+
+    //Act
+    GATEWAY_HANDLE gateway = Gateway_CreateFromJson(VALID_JSON_PATH);
+
+    //Assert
+    ASSERT_IS_NOT_NULL(gateway);
+    mocks.AssertActualAndExpectedCalls();
+
+    //Cleanup
+    gateway_destroy_internal(gateway);
+}
+
+/*Tests_SRS_GATEWAY_JSON_30_004: [ If "delivery" has any other value the function shall fail and return NULL. ]*/
+TEST_FUNCTION(Gateway_CreateFromJson_Fails_for_unknown_broker_delivery)
+{
+    //Arrange
+    CGatewayMocks mocks;
+
+    setup_2module_gw(mocks, (char*)VALID_JSON_PATH);
+
+    // modules array
+    setup_parse_modules_entry(mocks, 0, "module1");
+    setup_parse_modules_entry(mocks, 1, "module2");
+
+    // links entry
+    STRICT_EXPECTED_CALL(mocks, VECTOR_create(sizeof(GATEWAY_LINK_ENTRY)));
+    STRICT_EXPECTED_CALL(mocks, json_array_get_count(IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .SetReturn(2);
+
+    setup_links_entry(mocks, 0, "module1", "module2");
+    setup_links_entry(mocks, 1, "module2", "module1");
+
+    setup_broker_entry(mocks, "carrier-pigeon");
+
+    STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 0))
+        .IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, DynamicModuleLoader_FreeEntrypoint(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(1)
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, json_free_serialized_string((char *)"[serialized string]"));
+    STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 1))
+        .IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, DynamicModuleLoader_FreeEntrypoint(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(1)
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, json_free_serialized_string((char *)"[serialized string]"));
+    expect_links_destroyed(mocks, 2);
+    STRICT_EXPECTED_CALL(mocks, VECTOR_destroy(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, VECTOR_destroy(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, json_value_free(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, ModuleLoader_Destroy());
+
+    //Act
+    GATEWAY_HANDLE gateway = Gateway_CreateFromJson(VALID_JSON_PATH);
+
+    //Assert
+    ASSERT_IS_NULL(gateway);
+    mocks.AssertActualAndExpectedCalls();
+}
+
+/*Tests_SRS_GATEWAY_JSON_30_006: [ If "queue-capacity" is negative the function shall fail and return NULL. ]*/
+TEST_FUNCTION(Gateway_CreateFromJson_Fails_for_negative_broker_queue_capacity)
+{
+    //Arrange
+    CGatewayMocks mocks;
+
+    setup_2module_gw(mocks, (char*)VALID_JSON_PATH);
+
+    // modules array
+    setup_parse_modules_entry(mocks, 0, "module1");
+    setup_parse_modules_entry(mocks, 1, "module2");
+
+    // links entry
+    STRICT_EXPECTED_CALL(mocks, VECTOR_create(sizeof(GATEWAY_LINK_ENTRY)));
+    STRICT_EXPECTED_CALL(mocks, json_array_get_count(IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .SetReturn(2);
+
+    setup_links_entry(mocks, 0, "module1", "module2");
+    setup_links_entry(mocks, 1, "module2", "module1");
+
+    setup_broker_entry(mocks, "zero-copy", -1);
+
+    STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 0))
+        .IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, DynamicModuleLoader_FreeEntrypoint(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(1)
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, json_free_serialized_string((char *)"[serialized string]"));
+    STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 1))
+        .IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, DynamicModuleLoader_FreeEntrypoint(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(1)
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, json_free_serialized_string((char *)"[serialized string]"));
+    expect_links_destroyed(mocks, 2);
+    STRICT_EXPECTED_CALL(mocks, VECTOR_destroy(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, VECTOR_destroy(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, json_value_free(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, ModuleLoader_Destroy());
+
+    //Act
+    GATEWAY_HANDLE gateway = Gateway_CreateFromJson(VALID_JSON_PATH);
+
+    //Assert
+    ASSERT_IS_NULL(gateway);
+    mocks.AssertActualAndExpectedCalls();
+}
+
+/*Tests_SRS_GATEWAY_JSON_30_018: [ If "thread-cache-size" or "depot-size" is negative the function shall fail and return NULL. ]*/
+TEST_FUNCTION(Gateway_CreateFromJson_Fails_for_negative_message_pool_depot_size)
+{
+    //Arrange
+    CGatewayMocks mocks;
+
+    setup_2module_gw(mocks, (char*)VALID_JSON_PATH);
+
+    // modules array
+    setup_parse_modules_entry(mocks, 0, "module1");
+    setup_parse_modules_entry(mocks, 1, "module2");
+
+    // links entry
+    STRICT_EXPECTED_CALL(mocks, VECTOR_create(sizeof(GATEWAY_LINK_ENTRY)));
+    STRICT_EXPECTED_CALL(mocks, json_array_get_count(IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .SetReturn(2);
+
+    setup_links_entry(mocks, 0, "module1", "module2");
+    setup_links_entry(mocks, 1, "module2", "module1");
+
+    setup_broker_entry(mocks, "zero-copy", 0, 0, (JSON_Object*)0x42, 16, -1);
+
+    STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 0))
+        .IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, DynamicModuleLoader_FreeEntrypoint(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(1)
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, json_free_serialized_string((char *)"[serialized string]"));
+    STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 1))
+        .IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, DynamicModuleLoader_FreeEntrypoint(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(1)
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, json_free_serialized_string((char *)"[serialized string]"));
+    expect_links_destroyed(mocks, 2);
+    STRICT_EXPECTED_CALL(mocks, VECTOR_destroy(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, VECTOR_destroy(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, json_value_free(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, ModuleLoader_Destroy());
+
+    //Act
+    GATEWAY_HANDLE gateway = Gateway_CreateFromJson(VALID_JSON_PATH);
+
+    //Assert
+    ASSERT_IS_NULL(gateway);
+    mocks.AssertActualAndExpectedCalls();
+}
+
+/*Tests_SRS_GATEWAY_JSON_30_017: [ The function shall parse the optional "message-pool" object of "broker" for "thread-cache-size" and "depot-size" and set `GATEWAY_PROPERTIES::message_pool_config` when it is present, 0 being used for missing sizes. ]*/
+TEST_FUNCTION(Gateway_CreateFromJson_Parses_the_message_pool)
+{
+    //Arrange
+    CGatewayMocks mocks;
+
+    setup_2module_gw(mocks, (char *)VALID_JSON_PATH);
+
+    // modules array
+    setup_parse_modules_entry(mocks, 0, "module1");
+    setup_parse_modules_entry(mocks, 1, "module2");
+
+    // links entry
+    STRICT_EXPECTED_CALL(mocks, VECTOR_create(sizeof(GATEWAY_LINK_ENTRY)));
+    STRICT_EXPECTED_CALL(mocks, json_array_get_count(IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .SetReturn(2);
+
+    setup_links_entry(mocks, 0, "module1", "module2");
+    setup_links_entry(mocks, 1, "module2", "module1");
+
+
+    setup_broker_entry(mocks, "zero-copy", 0, 0, (JSON_Object*)0x42, 16, 0);
+
+    STRICT_EXPECTED_CALL(mocks, gballoc_malloc(sizeof(GATEWAY_HANDLE_DATA)));
+    STRICT_EXPECTED_CALL(mocks, MessagePool_Enable(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, Broker_CreateWithConfig(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, VECTOR_create(sizeof(MODULE_DATA*)));
+    STRICT_EXPECTED_CALL(mocks, VECTOR_create(sizeof(LINK_DATA)));
+    STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+
+    //Adding module 1 (Success)
+    add_a_module(mocks, 0);
+    //Adding module 2 (Success)
+    add_a_module(mocks, 1);
+
+    //process the links
+    STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    add_a_link(mocks, 0);
+    add_a_link(mocks, 1);
+
+
+    //Gateway start
+       STRICT_EXPECTED_CALL(mocks, EventSystem_Init());
+       STRICT_EXPECTED_CALL(mocks, EventSystem_ReportEvent(IGNORED_PTR_ARG, IGNORED_PTR_ARG, GATEWAY_CREATED))
+           .IgnoreArgument(1)
+           .IgnoreArgument(2);
+       STRICT_EXPECTED_CALL(mocks, EventSystem_ReportEvent(IGNORED_PTR_ARG, IGNORED_PTR_ARG, GATEWAY_MODULE_LIST_CHANGED))
+           .IgnoreArgument(1)
+           .IgnoreArgument(2);
+       STRICT_EXPECTED_CALL(mocks, Gateway_Start(IGNORED_PTR_ARG))
+           .IgnoreArgument(1);
+       STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
+           .IgnoreArgument(1);
+       STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 0))
+           .IgnoreArgument(1);
+	   STRICT_EXPECTED_CALL(mocks, DynamicModuleLoader_FreeEntrypoint(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		   .IgnoreArgument(1)
+           .IgnoreArgument(2);
+       STRICT_EXPECTED_CALL(mocks, json_free_serialized_string((char*)"[serialized string]"));
+       STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 1))
+           .IgnoreArgument(1);
+	   STRICT_EXPECTED_CALL(mocks, DynamicModuleLoader_FreeEntrypoint(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		   .IgnoreArgument(1)
+           .IgnoreArgument(2);
+       STRICT_EXPECTED_CALL(mocks, json_free_serialized_string((char*)"[serialized string]"));
+       expect_links_destroyed(mocks, 2);
+       STRICT_EXPECTED_CALL(mocks, VECTOR_destroy(IGNORED_PTR_ARG))
+           .IgnoreArgument(1);
+       STRICT_EXPECTED_CALL(mocks, VECTOR_destroy(IGNORED_PTR_ARG))
+           .IgnoreArgument(1);
+       STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+           .IgnoreArgument(1);
+       STRICT_EXPECTED_CALL(mocks, json_value_free(IGNORED_PTR_ARG))
+          .IgnoreArgument(1);
+
+    //Act
+    GATEWAY_HANDLE gateway = Gateway_CreateFromJson(VALID_JSON_PATH);
+
+    //Assert
+    ASSERT_IS_NOT_NULL(gateway);
+    mocks.AssertActualAndExpectedCalls();
+
+    //Cleanup
+    gateway_destroy_internal(gateway);
+}
+
+/*Tests_SRS_GATEWAY_JSON_30_015: [ The function shall parse the "broker" object for "batch-size" and "batch-window-ms" and use them as `BROKER_CONFIG::batch_size` and `BROKER_CONFIG::batch_window_ms`, 0 when they are missing. ]*/
+/*Tests_SRS_GATEWAY_JSON_30_016: [ If "batch-size" or "batch-window-ms" is negative the function shall fail and return NULL. ]*/
+TEST_FUNCTION(Gateway_CreateFromJson_Fails_for_negative_broker_batch_size)
+{
+    //Arrange
+    CGatewayMocks mocks;
+
+    setup_2module_gw(mocks, (char*)VALID_JSON_PATH);
+
+    // modules array
+    setup_parse_modules_entry(mocks, 0, "module1");
+    setup_parse_modules_entry(mocks, 1, "module2");
+
+    // links entry
+    STRICT_EXPECTED_CALL(mocks, VECTOR_create(sizeof(GATEWAY_LINK_ENTRY)));
+    STRICT_EXPECTED_CALL(mocks, json_array_get_count(IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .SetReturn(2);
+
+    setup_links_entry(mocks, 0, "module1", "module2");
+    setup_links_entry(mocks, 1, "module2", "module1");
+
+    setup_broker_entry(mocks, "zero-copy", 0, -1);
+
+    STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 0))
+        .IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, DynamicModuleLoader_FreeEntrypoint(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(1)
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, json_free_serialized_string((char *)"[serialized string]"));
+    STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 1))
+        .IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, DynamicModuleLoader_FreeEntrypoint(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(1)
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, json_free_serialized_string((char *)"[serialized string]"));
+    expect_links_destroyed(mocks, 2);
+    STRICT_EXPECTED_CALL(mocks, VECTOR_destroy(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, VECTOR_destroy(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, json_value_free(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, ModuleLoader_Destroy());
+
+    //Act
+    GATEWAY_HANDLE gateway = Gateway_CreateFromJson(VALID_JSON_PATH);
+
+    //Assert
+    ASSERT_IS_NULL(gateway);
+    mocks.AssertActualAndExpectedCalls();
+}
+
+/*Tests_SRS_GATEWAY_JSON_30_019: [ The function shall parse the "broker" object for "scheduler", which may be "dedicated-threads" or "thread-pool", and "worker-threads", used as `BROKER_CONFIG::worker_count`, 0 when it is missing. ]*/
+/*Tests_SRS_GATEWAY_JSON_30_022: [ The function shall set `GATEWAY_MODULES_ENTRY::dedicated_thread` when the module's "dedicated-thread" is true. ]*/
+TEST_FUNCTION(Gateway_CreateFromJson_Parses_thread_pool_scheduler_and_dedicated_thread)
+{
+    //Arrange
+    CGatewayMocks mocks;
+
+    setup_2module_gw(mocks, (char *)VALID_JSON_PATH);
+
+    // modules array
+    setup_parse_modules_entry(mocks, 0, "module1", "loader1", 1);
+    setup_parse_modules_entry(mocks, 1, "module2");
+
+    // links entry
+    STRICT_EXPECTED_CALL(mocks, VECTOR_create(sizeof(GATEWAY_LINK_ENTRY)));
+    STRICT_EXPECTED_CALL(mocks, json_array_get_count(IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .SetReturn(2);
+
+    setup_links_entry(mocks, 0, "module1", "module2");
+    setup_links_entry(mocks, 1, "module2", "module1");
+
+    setup_broker_entry(mocks, "zero-copy", 0, 0, NULL, 0, 0, "thread-pool", 4);
+
+    STRICT_EXPECTED_CALL(mocks, gballoc_malloc(sizeof(GATEWAY_HANDLE_DATA)));
+    STRICT_EXPECTED_CALL(mocks, Broker_CreateWithConfig(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, VECTOR_create(sizeof(MODULE_DATA*)));
+    STRICT_EXPECTED_CALL(mocks, VECTOR_create(sizeof(LINK_DATA)));
+    STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+
+    //Adding module 1 on a thread of its own (Success)
+    add_a_module(mocks, 0, true);
+    //Adding module 2 (Success)
+    add_a_module(mocks, 1);
+
+    //process the links
+    STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    add_a_link(mocks, 0);
+    add_a_link(mocks, 1);
+
+    //Gateway start
+    STRICT_EXPECTED_CALL(mocks, EventSystem_Init());
+    STRICT_EXPECTED_CALL(mocks, EventSystem_ReportEvent(IGNORED_PTR_ARG, IGNORED_PTR_ARG, GATEWAY_CREATED))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, EventSystem_ReportEvent(IGNORED_PTR_ARG, IGNORED_PTR_ARG, GATEWAY_MODULE_LIST_CHANGED))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, Gateway_Start(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 0))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, DynamicModuleLoader_FreeEntrypoint(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, json_free_serialized_string((char*)"[serialized string]"));
+    STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 1))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, DynamicModuleLoader_FreeEntrypoint(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, json_free_serialized_string((char*)"[serialized string]"));
+    expect_links_destroyed(mocks, 2);
+    STRICT_EXPECTED_CALL(mocks, VECTOR_destroy(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, VECTOR_destroy(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, json_value_free(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+
+    //Act
+    GATEWAY_HANDLE gateway = Gateway_CreateFromJson(VALID_JSON_PATH);
+
+    //Assert
+    ASSERT_IS_NOT_NULL(gateway);
+    mocks.AssertActualAndExpectedCalls();
+
+    //Cleanup
+    gateway_destroy_internal(gateway);
+}
+
+static void expect_broker_parse_failure(CGatewayMocks& mocks, const char* scheduler, double worker_threads)
+{
+    setup_2module_gw(mocks, (char*)VALID_JSON_PATH);
+
+    // modules array
+    setup_parse_modules_entry(mocks, 0, "module1");
+    setup_parse_modules_entry(mocks, 1, "module2");
+
+    // links entry
+    STRICT_EXPECTED_CALL(mocks, VECTOR_create(sizeof(GATEWAY_LINK_ENTRY)));
+    STRICT_EXPECTED_CALL(mocks, json_array_get_count(IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .SetReturn(2);
+
+    setup_links_entry(mocks, 0, "module1", "module2");
+    setup_links_entry(mocks, 1, "module2", "module1");
+
+    setup_broker_entry(mocks, "zero-copy", 0, 0, NULL, 0, 0, scheduler, worker_threads);
+
+    STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 0))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, DynamicModuleLoader_FreeEntrypoint(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, json_free_serialized_string((char *)"[serialized string]"));
+    STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 1))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, DynamicModuleLoader_FreeEntrypoint(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, json_free_serialized_string((char *)"[serialized string]"));
+    expect_links_destroyed(mocks, 2);
+    STRICT_EXPECTED_CALL(mocks, VECTOR_destroy(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, VECTOR_destroy(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, json_value_free(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, ModuleLoader_Destroy());
+}
+
+/*Tests_SRS_GATEWAY_JSON_30_021: [ If "worker-threads" is negative or "scheduler" has any other value the function shall fail and return NULL. ]*/
+TEST_FUNCTION(Gateway_CreateFromJson_Fails_for_unknown_broker_scheduler)
+{
+    //Arrange
+    CGatewayMocks mocks;
+    expect_broker_parse_failure(mocks, "round-robin", 0);
+
+    //Act
+    GATEWAY_HANDLE gateway = Gateway_CreateFromJson(VALID_JSON_PATH);
+
+    //Assert
+    ASSERT_IS_NULL(gateway);
+    mocks.AssertActualAndExpectedCalls();
+}
+
+/*Tests_SRS_GATEWAY_JSON_30_021: [ If "worker-threads" is negative or "scheduler" has any other value the function shall fail and return NULL. ]*/
+TEST_FUNCTION(Gateway_CreateFromJson_Fails_for_negative_broker_worker_threads)
+{
+    //Arrange
+    CGatewayMocks mocks;
+    expect_broker_parse_failure(mocks, "thread-pool", -2);
+
+    //Act
+    GATEWAY_HANDLE gateway = Gateway_CreateFromJson(VALID_JSON_PATH);
+
+    //Assert
+    ASSERT_IS_NULL(gateway);
+    mocks.AssertActualAndExpectedCalls();
+}
+
+/*Tests_SRS_GATEWAY_JSON_30_010: [ The function shall parse each link for "queue-capacity", "overflow" and "sample-interval". ]*/
+/*Tests_SRS_GATEWAY_JSON_30_014: [ Otherwise the function shall allocate a `BROKER_QUEUE_CONFIG` for the link's `GATEWAY_LINK_ENTRY::sink_queue`, using 0 for missing numbers and "drop-newest" for a missing "overflow". ]*/
+TEST_FUNCTION(Gateway_CreateFromJson_Parses_link_queue_settings)
+{
+    //Arrange
+    CGatewayMocks mocks;
+
+    setup_2module_gw(mocks, (char *)VALID_JSON_PATH);
+
+    // modules array
+    setup_parse_modules_entry(mocks, 0, "module1");
+    setup_parse_modules_entry(mocks, 1, "module2");
+
+    // links entry
+    STRICT_EXPECTED_CALL(mocks, VECTOR_create(sizeof(GATEWAY_LINK_ENTRY)));
+    STRICT_EXPECTED_CALL(mocks, json_array_get_count(IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .SetReturn(2);
+
+    STRICT_EXPECTED_CALL(mocks, json_array_get_object(IGNORED_PTR_ARG, 0))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, json_object_get_string(IGNORED_PTR_ARG, "source"))
+        .IgnoreArgument(1)
+        .SetReturn("module1");
+    STRICT_EXPECTED_CALL(mocks, json_object_get_string(IGNORED_PTR_ARG, "sink"))
+        .IgnoreArgument(1)
+        .SetReturn("module2");
+    setup_link_queue_entry(mocks, 256, "drop-oldest", 0);
+    STRICT_EXPECTED_CALL(mocks, gballoc_malloc(sizeof(BROKER_QUEUE_CONFIG)));
+    setup_link_filter_entry(mocks);
+    setup_link_priority_entry(mocks, -1);
+    STRICT_EXPECTED_CALL(mocks, VECTOR_push_back(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
+    setup_links_entry(mocks, 1, "module2", "module1");
+
+
+    setup_broker_entry(mocks, "zero-copy");
+
+    STRICT_EXPECTED_CALL(mocks, gballoc_malloc(sizeof(GATEWAY_HANDLE_DATA)));
+    STRICT_EXPECTED_CALL(mocks, Broker_CreateWithConfig(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, VECTOR_create(sizeof(MODULE_DATA*)));
+    STRICT_EXPECTED_CALL(mocks, VECTOR_create(sizeof(LINK_DATA)));
+    STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+
+    //Adding module 1 (Success)
+    add_a_module(mocks, 0);
+    //Adding module 2 (Success)
+    add_a_module(mocks, 1);
+
+    //process the links
+    STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2)
+        .IgnoreArgument(3);
+    STRICT_EXPECTED_CALL(mocks, Broker_SetSinkQueue(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
+    add_a_link(mocks, 0);
+    add_a_link(mocks, 1);
+
+
+    //Gateway start
+       STRICT_EXPECTED_CALL(mocks, EventSystem_Init());
+       STRICT_EXPECTED_CALL(mocks, EventSystem_ReportEvent(IGNORED_PTR_ARG, IGNORED_PTR_ARG, GATEWAY_CREATED))
+           .IgnoreArgument(1)
+           .IgnoreArgument(2);
+       STRICT_EXPECTED_CALL(mocks, EventSystem_ReportEvent(IGNORED_PTR_ARG, IGNORED_PTR_ARG, GATEWAY_MODULE_LIST_CHANGED))
+           .IgnoreArgument(1)
+           .IgnoreArgument(2);
+       STRICT_EXPECTED_CALL(mocks, Gateway_Start(IGNORED_PTR_ARG))
+           .IgnoreArgument(1);
+       STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
+           .IgnoreArgument(1);
+       STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 0))
+           .IgnoreArgument(1);
+	   STRICT_EXPECTED_CALL(mocks, DynamicModuleLoader_FreeEntrypoint(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		   .IgnoreArgument(1)
+           .IgnoreArgument(2);
+       STRICT_EXPECTED_CALL(mocks, json_free_serialized_string((char*)"[serialized string]"));
+       STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 1))
+           .IgnoreArgument(1);
+	   STRICT_EXPECTED_CALL(mocks, DynamicModuleLoader_FreeEntrypoint(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		   .IgnoreArgument(1)
+           .IgnoreArgument(2);
+       STRICT_EXPECTED_CALL(mocks, json_free_serialized_string((char*)"[serialized string]"));
+       expect_links_destroyed(mocks, 2);
+       STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+           .IgnoreArgument(1);
+       STRICT_EXPECTED_CALL(mocks, VECTOR_destroy(IGNORED_PTR_ARG))
+           .IgnoreArgument(1);
+       STRICT_EXPECTED_CALL(mocks, VECTOR_destroy(IGNORED_PTR_ARG))
+           .IgnoreArgument(1);
+       STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+           .IgnoreArgument(1);
+       STRICT_EXPECTED_CALL(mocks, json_value_free(IGNORED_PTR_ARG))
+          .IgnoreArgument(1);
+
+    //Act
+    GATEWAY_HANDLE gateway = Gateway_CreateFromJson(VALID_JSON_PATH);
+
+    //Assert
+    ASSERT_IS_NOT_NULL(gateway);
+    mocks.AssertActualAndExpectedCalls();
+
+    //Cleanup
+    gateway_destroy_internal(gateway);
+}
+
+/*Tests_SRS_GATEWAY_JSON_30_023: [ The function shall set `GATEWAY_MODULES_ENTRY::deliver_inline` when the module's "inline" is true. ]*/
+TEST_FUNCTION(Gateway_CreateFromJson_Parses_inline_module)
+{
+    //Arrange
+    CGatewayMocks mocks;
+
+    setup_2module_gw(mocks, (char *)VALID_JSON_PATH);
+
+    // modules array
+    setup_parse_modules_entry(mocks, 0, "module1");
+    setup_parse_modules_entry(mocks, 1, "module2", "loader1", -1, 1);
+
+    // links entry
+    STRICT_EXPECTED_CALL(mocks, VECTOR_create(sizeof(GATEWAY_LINK_ENTRY)));
+    STRICT_EXPECTED_CALL(mocks, json_array_get_count(IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .SetReturn(2);
+
+    setup_links_entry(mocks, 0, "module1", "module2");
+    setup_links_entry(mocks, 1, "module2", "module1");
+
+
+    setup_broker_entry(mocks, "zero-copy");
+
+    STRICT_EXPECTED_CALL(mocks, gballoc_malloc(sizeof(GATEWAY_HANDLE_DATA)));
+    STRICT_EXPECTED_CALL(mocks, Broker_CreateWithConfig(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, VECTOR_create(sizeof(MODULE_DATA*)));
+    STRICT_EXPECTED_CALL(mocks, VECTOR_create(sizeof(LINK_DATA)));
+    STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+
+    //Adding module 1 (Success)
+    add_a_module(mocks, 0);
+    //Adding module 2, delivered inline (Success)
+    add_a_module(mocks, 1, false, true);
+
+    //process the links
+    STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    add_a_link(mocks, 0);
+    add_a_link(mocks, 1);
+
+
+    //Gateway start
+       STRICT_EXPECTED_CALL(mocks, EventSystem_Init());
+       STRICT_EXPECTED_CALL(mocks, EventSystem_ReportEvent(IGNORED_PTR_ARG, IGNORED_PTR_ARG, GATEWAY_CREATED))
+           .IgnoreArgument(1)
+           .IgnoreArgument(2);
+       STRICT_EXPECTED_CALL(mocks, EventSystem_ReportEvent(IGNORED_PTR_ARG, IGNORED_PTR_ARG, GATEWAY_MODULE_LIST_CHANGED))
+           .IgnoreArgument(1)
+           .IgnoreArgument(2);
+       STRICT_EXPECTED_CALL(mocks, Gateway_Start(IGNORED_PTR_ARG))
+           .IgnoreArgument(1);
+       STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
+           .IgnoreArgument(1);
+       STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 0))
+           .IgnoreArgument(1);
+	   STRICT_EXPECTED_CALL(mocks, DynamicModuleLoader_FreeEntrypoint(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		   .IgnoreArgument(1)
+           .IgnoreArgument(2);
+       STRICT_EXPECTED_CALL(mocks, json_free_serialized_string((char*)"[serialized string]"));
+       STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 1))
+           .IgnoreArgument(1);
+	   STRICT_EXPECTED_CALL(mocks, DynamicModuleLoader_FreeEntrypoint(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		   .IgnoreArgument(1)
+           .IgnoreArgument(2);
+       STRICT_EXPECTED_CALL(mocks, json_free_serialized_string((char*)"[serialized string]"));
+       expect_links_destroyed(mocks, 2);
+       STRICT_EXPECTED_CALL(mocks, VECTOR_destroy(IGNORED_PTR_ARG))
+           .IgnoreArgument(1);
+       STRICT_EXPECTED_CALL(mocks, VECTOR_destroy(IGNORED_PTR_ARG))
+           .IgnoreArgument(1);
+       STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+           .IgnoreArgument(1);
+       STRICT_EXPECTED_CALL(mocks, json_value_free(IGNORED_PTR_ARG))
+          .IgnoreArgument(1);
+
+    //Act
+    GATEWAY_HANDLE gateway = Gateway_CreateFromJson(VALID_JSON_PATH);
+
+    //Assert
+    ASSERT_IS_NOT_NULL(gateway);
+    mocks.AssertActualAndExpectedCalls();
+
+    //Cleanup
+    gateway_destroy_internal(gateway);
+}
+
+/*Tests_SRS_GATEWAY_JSON_30_029: [ The function shall set `GATEWAY_LINK_ENTRY::high_priority` when the link's "high-priority" is true. ]*/
+TEST_FUNCTION(Gateway_CreateFromJson_Parses_high_priority_link)
+{
+    //Arrange
+    CGatewayMocks mocks;
+
+    setup_2module_gw(mocks, (char *)VALID_JSON_PATH);
+
+    // modules array
+    setup_parse_modules_entry(mocks, 0, "module1");
+    setup_parse_modules_entry(mocks, 1, "module2");
+
+    // links entry
+    STRICT_EXPECTED_CALL(mocks, VECTOR_create(sizeof(GATEWAY_LINK_ENTRY)));
+    STRICT_EXPECTED_CALL(mocks, json_array_get_count(IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .SetReturn(2);
+
+    setup_links_entry(mocks, 0, "module1", "module2", 1);
+    setup_links_entry(mocks, 1, "module2", "module1");
+
+
+    setup_broker_entry(mocks, "zero-copy");
+
+    STRICT_EXPECTED_CALL(mocks, gballoc_malloc(sizeof(GATEWAY_HANDLE_DATA)));
+    STRICT_EXPECTED_CALL(mocks, Broker_CreateWithConfig(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, VECTOR_create(sizeof(MODULE_DATA*)));
+    STRICT_EXPECTED_CALL(mocks, VECTOR_create(sizeof(LINK_DATA)));
+    STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+
+    //Adding module 1 (Success)
+    add_a_module(mocks, 0);
+    //Adding module 2 (Success)
+    add_a_module(mocks, 1);
+
+    //process the links
+    STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    add_a_link(mocks, 0);
+    add_a_link(mocks, 1);
+
+
+    //Gateway start
+       STRICT_EXPECTED_CALL(mocks, EventSystem_Init());
+       STRICT_EXPECTED_CALL(mocks, EventSystem_ReportEvent(IGNORED_PTR_ARG, IGNORED_PTR_ARG, GATEWAY_CREATED))
+           .IgnoreArgument(1)
+           .IgnoreArgument(2);
+       STRICT_EXPECTED_CALL(mocks, EventSystem_ReportEvent(IGNORED_PTR_ARG, IGNORED_PTR_ARG, GATEWAY_MODULE_LIST_CHANGED))
+           .IgnoreArgument(1)
+           .IgnoreArgument(2);
+       STRICT_EXPECTED_CALL(mocks, Gateway_Start(IGNORED_PTR_ARG))
+           .IgnoreArgument(1);
+       STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
+           .IgnoreArgument(1);
+       STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 0))
+           .IgnoreArgument(1);
+	   STRICT_EXPECTED_CALL(mocks, DynamicModuleLoader_FreeEntrypoint(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		   .IgnoreArgument(1)
+           .IgnoreArgument(2);
+       STRICT_EXPECTED_CALL(mocks, json_free_serialized_string((char*)"[serialized string]"));
+       STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 1))
+           .IgnoreArgument(1);
+	   STRICT_EXPECTED_CALL(mocks, DynamicModuleLoader_FreeEntrypoint(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		   .IgnoreArgument(1)
+           .IgnoreArgument(2);
+       STRICT_EXPECTED_CALL(mocks, json_free_serialized_string((char*)"[serialized string]"));
+       expect_links_destroyed(mocks, 2);
+       STRICT_EXPECTED_CALL(mocks, VECTOR_destroy(IGNORED_PTR_ARG))
+           .IgnoreArgument(1);
+       STRICT_EXPECTED_CALL(mocks, VECTOR_destroy(IGNORED_PTR_ARG))
+           .IgnoreArgument(1);
+       STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+           .IgnoreArgument(1);
+       STRICT_EXPECTED_CALL(mocks, json_value_free(IGNORED_PTR_ARG))
+          .IgnoreArgument(1);
+
+    //Act
+    GATEWAY_HANDLE gateway = Gateway_CreateFromJson(VALID_JSON_PATH);
+
+    //Assert
+    ASSERT_IS_NOT_NULL(gateway);
+    ASSERT_ARE_EQUAL(size_t, 1, addedHighPriority_link_count);
+    mocks.AssertActualAndExpectedCalls();
+
+    //Cleanup
+    gateway_destroy_internal(gateway);
+}
+
+/*Tests_SRS_GATEWAY_JSON_30_011: [ If "queue-capacity" or "sample-interval" is negative the function shall fail and return NULL. ]*/
+TEST_FUNCTION(Gateway_CreateFromJson_Fails_for_negative_link_queue_capacity)
+{
+    //Arrange
+    CGatewayMocks mocks;
+
+    setup_2module_gw(mocks, (char*)VALID_JSON_PATH);
+
+    // modules array
+    setup_parse_modules_entry(mocks, 0, "module1");
+    setup_parse_modules_entry(mocks, 1, "module2");
+
+    // links entry
+    STRICT_EXPECTED_CALL(mocks, VECTOR_create(sizeof(GATEWAY_LINK_ENTRY)));
+    STRICT_EXPECTED_CALL(mocks, json_array_get_count(IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .SetReturn(2);
+
+    STRICT_EXPECTED_CALL(mocks, json_array_get_object(IGNORED_PTR_ARG, 0))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, json_object_get_string(IGNORED_PTR_ARG, "source"))
+        .IgnoreArgument(1)
+        .SetReturn("module1");
+    STRICT_EXPECTED_CALL(mocks, json_object_get_string(IGNORED_PTR_ARG, "sink"))
+        .IgnoreArgument(1)
+        .SetReturn("module2");
+    setup_link_queue_entry(mocks, -1, NULL, 0);
+
+    STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 0))
+        .IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, DynamicModuleLoader_FreeEntrypoint(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(1)
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, json_free_serialized_string((char *)"[serialized string]"));
+    STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 1))
+        .IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, DynamicModuleLoader_FreeEntrypoint(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(1)
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, json_free_serialized_string((char *)"[serialized string]"));
+    expect_links_destroyed(mocks, 0);
+    STRICT_EXPECTED_CALL(mocks, VECTOR_destroy(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, VECTOR_destroy(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, json_value_free(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, ModuleLoader_Destroy());
+
+    //Act
+    GATEWAY_HANDLE gateway = Gateway_CreateFromJson(VALID_JSON_PATH);
+
+    //Assert
+    ASSERT_IS_NULL(gateway);
+    mocks.AssertActualAndExpectedCalls();
+}
+
+/*Tests_SRS_GATEWAY_JSON_30_012: [ "overflow" may be "drop-newest", "drop-oldest", "block" or "sample", any other value shall make the function fail and return NULL. ]*/
+TEST_FUNCTION(Gateway_CreateFromJson_Fails_for_unknown_link_overflow)
+{
+    //Arrange
+    CGatewayMocks mocks;
+
+    setup_2module_gw(mocks, (char*)VALID_JSON_PATH);
+
+    // modules array
+    setup_parse_modules_entry(mocks, 0, "module1");
+    setup_parse_modules_entry(mocks, 1, "module2");
+
+    // links entry
+    STRICT_EXPECTED_CALL(mocks, VECTOR_create(sizeof(GATEWAY_LINK_ENTRY)));
+    STRICT_EXPECTED_CALL(mocks, json_array_get_count(IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .SetReturn(2);
+
+    STRICT_EXPECTED_CALL(mocks, json_array_get_object(IGNORED_PTR_ARG, 0))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, json_object_get_string(IGNORED_PTR_ARG, "source"))
+        .IgnoreArgument(1)
+        .SetReturn("module1");
+    STRICT_EXPECTED_CALL(mocks, json_object_get_string(IGNORED_PTR_ARG, "sink"))
+        .IgnoreArgument(1)
+        .SetReturn("module2");
+    setup_link_queue_entry(mocks, 0, "drop-everything", 0);
+
+    STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 0))
+        .IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, DynamicModuleLoader_FreeEntrypoint(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(1)
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, json_free_serialized_string((char *)"[serialized string]"));
+    STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 1))
+        .IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, DynamicModuleLoader_FreeEntrypoint(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(1)
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, json_free_serialized_string((char *)"[serialized string]"));
+    expect_links_destroyed(mocks, 0);
+    STRICT_EXPECTED_CALL(mocks, VECTOR_destroy(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, VECTOR_destroy(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, json_value_free(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, ModuleLoader_Destroy());
+
+    //Act
+    GATEWAY_HANDLE gateway = Gateway_CreateFromJson(VALID_JSON_PATH);
+
+    //Assert
+    ASSERT_IS_NULL(gateway);
+    mocks.AssertActualAndExpectedCalls();
+}
+
+/*Tests_SRS_GATEWAY_JSON_30_024: [ The function shall parse the optional "filter" object of each link, whose members name message properties. ]*/
+/*Tests_SRS_GATEWAY_JSON_30_025: [ A member whose value is a string or an array of strings shall make the link only deliver messages whose property equals one of them, a member whose value is an object with a "prefix" string or array of strings shall make it only deliver messages whose property starts with one of them. ]*/
+/*Tests_SRS_GATEWAY_JSON_30_028: [ Otherwise the function shall allocate a `BROKER_LINK_FILTER` for the link's `GATEWAY_LINK_ENTRY::filter`. ]*/
+TEST_FUNCTION(Gateway_CreateFromJson_Parses_link_filter)
+{
+    //Arrange
+    CGatewayMocks mocks;
+    JSON_Object* filter = (JSON_Object*)0x61;
+    JSON_Value* source_condition = (JSON_Value*)0x51;
+    JSON_Value* name_condition = (JSON_Value*)0x52;
+    JSON_Object* name_object = (JSON_Object*)0x62;
+    JSON_Value* prefixes_value = (JSON_Value*)0x53;
+    JSON_Array* prefixes = (JSON_Array*)0x71;
+
+    setup_2module_gw(mocks, (char *)VALID_JSON_PATH);
+
+    // modules array
+    setup_parse_modules_entry(mocks, 0, "module1");
+    setup_parse_modules_entry(mocks, 1, "module2");
+
+    // links entry
+    STRICT_EXPECTED_CALL(mocks, VECTOR_create(sizeof(GATEWAY_LINK_ENTRY)));
+    STRICT_EXPECTED_CALL(mocks, json_array_get_count(IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .SetReturn(2);
+
+    STRICT_EXPECTED_CALL(mocks, json_array_get_object(IGNORED_PTR_ARG, 0))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, json_object_get_string(IGNORED_PTR_ARG, "source"))
+        .IgnoreArgument(1)
+        .SetReturn("module1");
+    STRICT_EXPECTED_CALL(mocks, json_object_get_string(IGNORED_PTR_ARG, "sink"))
+        .IgnoreArgument(1)
+        .SetReturn("module2");
+    setup_link_queue_entry(mocks, 0, NULL, 0);
+    // "filter": { "source": "bleTelemetry", "deviceName": { "prefix": [ "sensor-", "probe-" ] } }
+    setup_link_filter_entry(mocks, filter);
+    STRICT_EXPECTED_CALL(mocks, json_object_get_count(filter))
+        .SetReturn(2);
+    STRICT_EXPECTED_CALL(mocks, json_object_get_name(filter, 0))
+        .SetReturn("source")
+        .ExpectedTimesExactly(2);
+    STRICT_EXPECTED_CALL(mocks, json_object_get_name(filter, 1))
+        .SetReturn("deviceName")
+        .ExpectedTimesExactly(2);
+    STRICT_EXPECTED_CALL(mocks, json_object_get_value(filter, "source"))
+        .SetReturn(source_condition)
+        .ExpectedTimesExactly(2);
+    STRICT_EXPECTED_CALL(mocks, json_object_get_value(filter, "deviceName"))
+        .SetReturn(name_condition)
+        .ExpectedTimesExactly(2);
+    STRICT_EXPECTED_CALL(mocks, json_value_get_type(source_condition))
+        .SetReturn(JSONString)
+        .ExpectedTimesExactly(4);
+    STRICT_EXPECTED_CALL(mocks, json_value_get_string(source_condition))
+        .SetReturn("bleTelemetry");
+    STRICT_EXPECTED_CALL(mocks, json_value_get_type(name_condition))
+        .SetReturn(JSONObject)
+        .ExpectedTimesExactly(2);
+    STRICT_EXPECTED_CALL(mocks, json_value_get_object(name_condition))
+        .SetReturn(name_object)
+        .ExpectedTimesExactly(2);
+    STRICT_EXPECTED_CALL(mocks, json_object_get_count(name_object))
+        .SetReturn(1)
+        .ExpectedTimesExactly(2);
+    STRICT_EXPECTED_CALL(mocks, json_object_get_value(name_object, "prefix"))
+        .SetReturn(prefixes_value)
+        .ExpectedTimesExactly(2);
+    STRICT_EXPECTED_CALL(mocks, json_value_get_type(prefixes_value))
+        .SetReturn(JSONArray)
+        .ExpectedTimesExactly(4);
+    STRICT_EXPECTED_CALL(mocks, json_value_get_array(prefixes_value))
+        .SetReturn(prefixes)
+        .ExpectedTimesExactly(2);
+    STRICT_EXPECTED_CALL(mocks, json_array_get_count(prefixes))
+        .SetReturn(2)
+        .ExpectedTimesExactly(2);
+    STRICT_EXPECTED_CALL(mocks, json_array_get_string(prefixes, 0))
+        .SetReturn("sensor-")
+        .ExpectedTimesExactly(2);
+    STRICT_EXPECTED_CALL(mocks, json_array_get_string(prefixes, 1))
+        .SetReturn("probe-")
+        .ExpectedTimesExactly(2);
+    STRICT_EXPECTED_CALL(mocks, gballoc_malloc(sizeof(BROKER_LINK_FILTER) + 2 * sizeof(BROKER_FILTER_CONDITION) + 3 * sizeof(const char*)));
+    setup_link_priority_entry(mocks, -1);
+    STRICT_EXPECTED_CALL(mocks, VECTOR_push_back(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
+    setup_links_entry(mocks, 1, "module2", "module1");
+
+
+    setup_broker_entry(mocks, "zero-copy");
+
+    STRICT_EXPECTED_CALL(mocks, gballoc_malloc(sizeof(GATEWAY_HANDLE_DATA)));
+    STRICT_EXPECTED_CALL(mocks, Broker_CreateWithConfig(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, VECTOR_create(sizeof(MODULE_DATA*)));
+    STRICT_EXPECTED_CALL(mocks, VECTOR_create(sizeof(LINK_DATA)));
+    STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+
+    //Adding module 1 (Success)
+    add_a_module(mocks, 0);
+    //Adding module 2 (Success)
+    add_a_module(mocks, 1);
+
+    //process the links
+    STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    add_a_link(mocks, 0);
+    add_a_link(mocks, 1);
+
+
+    //Gateway start
+       STRICT_EXPECTED_CALL(mocks, EventSystem_Init());
+       STRICT_EXPECTED_CALL(mocks, EventSystem_ReportEvent(IGNORED_PTR_ARG, IGNORED_PTR_ARG, GATEWAY_CREATED))
+           .IgnoreArgument(1)
+           .IgnoreArgument(2);
+       STRICT_EXPECTED_CALL(mocks, EventSystem_ReportEvent(IGNORED_PTR_ARG, IGNORED_PTR_ARG, GATEWAY_MODULE_LIST_CHANGED))
+           .IgnoreArgument(1)
+           .IgnoreArgument(2);
+       STRICT_EXPECTED_CALL(mocks, Gateway_Start(IGNORED_PTR_ARG))
+           .IgnoreArgument(1);
+       STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
+           .IgnoreArgument(1);
+       STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 0))
+           .IgnoreArgument(1);
+	   STRICT_EXPECTED_CALL(mocks, DynamicModuleLoader_FreeEntrypoint(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		   .IgnoreArgument(1)
+           .IgnoreArgument(2);
+       STRICT_EXPECTED_CALL(mocks, json_free_serialized_string((char*)"[serialized string]"));
+       STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 1))
+           .IgnoreArgument(1);
+	   STRICT_EXPECTED_CALL(mocks, DynamicModuleLoader_FreeEntrypoint(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		   .IgnoreArgument(1)
+           .IgnoreArgument(2);
+       STRICT_EXPECTED_CALL(mocks, json_free_serialized_string((char*)"[serialized string]"));
+       expect_links_destroyed(mocks, 2);
+       STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+           .IgnoreArgument(1);
+       STRICT_EXPECTED_CALL(mocks, VECTOR_destroy(IGNORED_PTR_ARG))
+           .IgnoreArgument(1);
+       STRICT_EXPECTED_CALL(mocks, VECTOR_destroy(IGNORED_PTR_ARG))
+           .IgnoreArgument(1);
+       STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+           .IgnoreArgument(1);
+       STRICT_EXPECTED_CALL(mocks, json_value_free(IGNORED_PTR_ARG))
+          .IgnoreArgument(1);
+
+    //Act
+    GATEWAY_HANDLE gateway = Gateway_CreateFromJson(VALID_JSON_PATH);
+
+    //Assert
+    ASSERT_IS_NOT_NULL(gateway);
+    mocks.AssertActualAndExpectedCalls();
+    ASSERT_ARE_EQUAL(size_t, 2, addedFilter_condition_count);
+    ASSERT_ARE_EQUAL(char_ptr, "source", addedFilter_conditions[0].key);
+    ASSERT_IS_TRUE(addedFilter_conditions[0].match == BROKER_FILTER_EQUALS);
+    ASSERT_ARE_EQUAL(size_t, 1, addedFilter_conditions[0].value_count);
+    ASSERT_ARE_EQUAL(char_ptr, "bleTelemetry", addedFilter_values[0]);
+    ASSERT_ARE_EQUAL(char_ptr, "deviceName", addedFilter_conditions[1].key);
+    ASSERT_IS_TRUE(addedFilter_conditions[1].match == BROKER_FILTER_PREFIX);
+    ASSERT_ARE_EQUAL(size_t, 2, addedFilter_conditions[1].value_count);
+    ASSERT_ARE_EQUAL(char_ptr, "sensor-", addedFilter_values[1]);
+    ASSERT_ARE_EQUAL(char_ptr, "probe-", addedFilter_values[2]);
+
+    //Cleanup
+    gateway_destroy_internal(gateway);
+}
+
+/*Tests_SRS_GATEWAY_JSON_30_026: [ If "filter" is empty or one of its members has any other value the function shall fail and return NULL. ]*/
+TEST_FUNCTION(Gateway_CreateFromJson_Fails_for_invalid_link_filter)
+{
+    //Arrange
+    CGatewayMocks mocks;
+    JSON_Object* filter = (JSON_Object*)0x61;
+    JSON_Value* condition = (JSON_Value*)0x51;
+
+    setup_2module_gw(mocks, (char*)VALID_JSON_PATH);
+
+    // modules array
+    setup_parse_modules_entry(mocks, 0, "module1");
+    setup_parse_modules_entry(mocks, 1, "module2");
+
+    // links entry
+    STRICT_EXPECTED_CALL(mocks, VECTOR_create(sizeof(GATEWAY_LINK_ENTRY)));
+    STRICT_EXPECTED_CALL(mocks, json_array_get_count(IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .SetReturn(2);
+
+    STRICT_EXPECTED_CALL(mocks, json_array_get_object(IGNORED_PTR_ARG, 0))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, json_object_get_string(IGNORED_PTR_ARG, "source"))
+        .IgnoreArgument(1)
+        .SetReturn("module1");
+    STRICT_EXPECTED_CALL(mocks, json_object_get_string(IGNORED_PTR_ARG, "sink"))
+        .IgnoreArgument(1)
+        .SetReturn("module2");
+    setup_link_queue_entry(mocks, 0, NULL, 0);
+    // "filter": { "source": 42 }
+    setup_link_filter_entry(mocks, filter);
+    STRICT_EXPECTED_CALL(mocks, json_object_get_count(filter))
+        .SetReturn(1);
+    STRICT_EXPECTED_CALL(mocks, json_object_get_name(filter, 0))
+        .SetReturn("source");
+    STRICT_EXPECTED_CALL(mocks, json_object_get_value(filter, "source"))
+        .SetReturn(condition);
+    STRICT_EXPECTED_CALL(mocks, json_value_get_type(condition))
+        .SetReturn(JSONNumber)
+        .ExpectedTimesExactly(3);
+
+    STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 0))
+        .IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, DynamicModuleLoader_FreeEntrypoint(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(1)
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, json_free_serialized_string((char *)"[serialized string]"));
+    STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 1))
+        .IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, DynamicModuleLoader_FreeEntrypoint(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(1)
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, json_free_serialized_string((char *)"[serialized string]"));
+    expect_links_destroyed(mocks, 0);
     STRICT_EXPECTED_CALL(mocks, VECTOR_destroy(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, VECTOR_destroy(IGNORED_PTR_ARG))
@@ -181,6 +181,7 @@ BEGIN_TEST_SUITE(gateway_e2e)
                 ASSERT_FAIL("Could not push data into vector for identity map configuration.");
             }
         }
+        IDENTITY_MAP_MODULE_CONFIG e2eIdentityMapConfig = { e2eModuleMappingVector, NULL, 0 };
         
         GATEWAY_MODULES_ENTRY modules[3];
 		DYNAMIC_LOADER_ENTRYPOINT loader_info[3];
@@ -193,7 +194,7 @@ BEGIN_TEST_SUITE(gateway_e2e)
 		modules[0].module_loader_info.entrypoint = (void*)&(loader_info[0]);
 
 		modules[1].module_name = GW_IDMAP_MODULE;
-		modules[1].module_configuration = e2eModuleMappingVector;
+		modules[1].module_configuration = &e2eIdentityMapConfig;
 		modules[1].module_loader_info.loader = DynamicLoader_Get();
 		loader_info[1].moduleLibraryFileName = STRING_construct(identity_map_module_path());
 		modules[1].module_loader_info.entrypoint = (void*)&(loader_info[1]);
@@ -222,6 +223,8 @@ BEGIN_TEST_SUITE(gateway_e2e)
         ///act
         m6GatewayProperties.gateway_modules = gatewayProps;
         m6GatewayProperties.gateway_links = gatewayLinks; 
+        m6GatewayProperties.broker_config = NULL;
+        m6GatewayProperties.message_pool_config = NULL;
         e2eGatewayInstance = Gateway_Create(&m6GatewayProperties);
         auto start_result = Gateway_Start(e2eGatewayInstance);
 
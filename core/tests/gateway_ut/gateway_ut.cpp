@@ -69,6 +69,9 @@ static size_t whenShallVECTOR_push_back_fail;
 static size_t currentVECTOR_find_if_call;
 static size_t whenShallVECTOR_find_if_fail;
 
+static const BROKER_LINK_FILTER* lastBroker_AddLink_filter;
+static bool lastBroker_AddLink_high_priority;
+
 static MODULE_API_1 dummyAPIs;
 
 TYPED_MOCK_CLASS(CGatewayLLMocks, CGlobalMock)
@@ -127,6 +130,17 @@ public:
     }
     MOCK_METHOD_END(BROKER_HANDLE, result1);
 
+    MOCK_STATIC_METHOD_1(, BROKER_HANDLE, Broker_CreateWithConfig, const BROKER_CONFIG*, config)
+        ++currentBroker_ref_count;
+        BROKER_HANDLE result1 = (BROKER_HANDLE)BASEIMPLEMENTATION::gballoc_malloc(1);
+    MOCK_METHOD_END(BROKER_HANDLE, result1);
+
+    MOCK_STATIC_METHOD_1(, int, MessagePool_Enable, const MESSAGE_POOL_CONFIG*, config)
+    MOCK_METHOD_END(int, 0);
+
+    MOCK_STATIC_METHOD_0(, void, MessagePool_Disable)
+    MOCK_VOID_METHOD_END();
+
     MOCK_STATIC_METHOD_1(, void, Broker_Destroy, BROKER_HANDLE, broker)
         if (currentBroker_ref_count > 0)
         {
@@ -151,6 +165,15 @@ public:
         }
     MOCK_METHOD_END(BROKER_RESULT, result1);
 
+    MOCK_STATIC_METHOD_3(, BROKER_RESULT, Broker_AddModuleWithConfig, BROKER_HANDLE, handle, const MODULE*, module, const BROKER_MODULE_CONFIG*, config)
+        BROKER_RESULT result1 = BROKER_ERROR;
+        if (handle != NULL && module != NULL && config != NULL)
+        {
+            ++currentBroker_module_count;
+            result1 = BROKER_OK;
+        }
+    MOCK_METHOD_END(BROKER_RESULT, result1);
+
     MOCK_STATIC_METHOD_2(, BROKER_RESULT, Broker_RemoveModule, BROKER_HANDLE, handle, const MODULE*, module)
         currentBroker_RemoveModule_call++;
         BROKER_RESULT result1 = BROKER_ERROR;
@@ -162,11 +185,26 @@ public:
     MOCK_METHOD_END(BROKER_RESULT, result1);
 
     MOCK_STATIC_METHOD_2(, BROKER_RESULT, Broker_AddLink, BROKER_HANDLE, handle, const BROKER_LINK_DATA*, link)
+        lastBroker_AddLink_filter = link->filter;
+        lastBroker_AddLink_high_priority = link->high_priority;
     MOCK_METHOD_END(BROKER_RESULT, BROKER_OK)
 
     MOCK_STATIC_METHOD_2(, BROKER_RESULT, Broker_RemoveLink, BROKER_HANDLE, handle, const BROKER_LINK_DATA*, link)
     MOCK_METHOD_END(BROKER_RESULT, BROKER_OK)
 
+    MOCK_STATIC_METHOD_3(, BROKER_RESULT, Broker_SetSinkQueue, BROKER_HANDLE, broker, MODULE_HANDLE, sink, const BROKER_QUEUE_CONFIG*, config)
+    MOCK_METHOD_END(BROKER_RESULT, BROKER_OK)
+
+    MOCK_STATIC_METHOD_3(, BROKER_RESULT, Broker_SetSinkInline, BROKER_HANDLE, broker, MODULE_HANDLE, sink, bool, deliver_inline)
+    MOCK_METHOD_END(BROKER_RESULT, BROKER_OK)
+
+    MOCK_STATIC_METHOD_3(, BROKER_RESULT, Broker_GetSinkQueueStats, BROKER_HANDLE, broker, MODULE_HANDLE, sink, BROKER_QUEUE_STATS*, stats)
+        stats->capacity = 16;
+        stats->queued = 3;
+        stats->dropped = 2;
+        stats->blocked = 1;
+    MOCK_METHOD_END(BROKER_RESULT, BROKER_OK)
+
     MOCK_STATIC_METHOD_2(, MODULE_LIBRARY_HANDLE, DynamicModuleLoader_Load, const struct MODULE_LOADER_TAG*, loader, const void*, entrypoint)
         currentModuleLoader_Load_call++;
         MODULE_LIBRARY_HANDLE handle = NULL;
@@ -325,11 +363,18 @@ DECLARE_GLOBAL_MOCK_METHOD_2(CGatewayLLMocks, , void, mock_Module_Receive, MODUL
 DECLARE_GLOBAL_MOCK_METHOD_1(CGatewayLLMocks, , void, mock_Module_Start, MODULE_HANDLE, moduleHandle);
 
 DECLARE_GLOBAL_MOCK_METHOD_0(CGatewayLLMocks, , BROKER_HANDLE, Broker_Create);
+DECLARE_GLOBAL_MOCK_METHOD_1(CGatewayLLMocks, , BROKER_HANDLE, Broker_CreateWithConfig, const BROKER_CONFIG*, config);
+DECLARE_GLOBAL_MOCK_METHOD_1(CGatewayLLMocks, , int, MessagePool_Enable, const MESSAGE_POOL_CONFIG*, config);
+DECLARE_GLOBAL_MOCK_METHOD_0(CGatewayLLMocks, , void, MessagePool_Disable);
 DECLARE_GLOBAL_MOCK_METHOD_1(CGatewayLLMocks, , void, Broker_Destroy, BROKER_HANDLE, broker);
 DECLARE_GLOBAL_MOCK_METHOD_2(CGatewayLLMocks, , BROKER_RESULT, Broker_AddModule, BROKER_HANDLE, handle, const MODULE*, module);
+DECLARE_GLOBAL_MOCK_METHOD_3(CGatewayLLMocks, , BROKER_RESULT, Broker_AddModuleWithConfig, BROKER_HANDLE, handle, const MODULE*, module, const BROKER_MODULE_CONFIG*, config);
 DECLARE_GLOBAL_MOCK_METHOD_2(CGatewayLLMocks, , BROKER_RESULT, Broker_RemoveModule, BROKER_HANDLE, handle, const MODULE*, module);
 DECLARE_GLOBAL_MOCK_METHOD_2(CGatewayLLMocks, , BROKER_RESULT, Broker_AddLink, BROKER_HANDLE, handle, const BROKER_LINK_DATA*, link);
 DECLARE_GLOBAL_MOCK_METHOD_2(CGatewayLLMocks, , BROKER_RESULT, Broker_RemoveLink, BROKER_HANDLE, handle, const BROKER_LINK_DATA*, link);
+DECLARE_GLOBAL_MOCK_METHOD_3(CGatewayLLMocks, , BROKER_RESULT, Broker_SetSinkQueue, BROKER_HANDLE, broker, MODULE_HANDLE, sink, const BROKER_QUEUE_CONFIG*, config);
+DECLARE_GLOBAL_MOCK_METHOD_3(CGatewayLLMocks, , BROKER_RESULT, Broker_SetSinkInline, BROKER_HANDLE, broker, MODULE_HANDLE, sink, bool, deliver_inline);
+DECLARE_GLOBAL_MOCK_METHOD_3(CGatewayLLMocks, , BROKER_RESULT, Broker_GetSinkQueueStats, BROKER_HANDLE, broker, MODULE_HANDLE, sink, BROKER_QUEUE_STATS*, stats);
 DECLARE_GLOBAL_MOCK_METHOD_1(CGatewayLLMocks, , void, Broker_IncRef, BROKER_HANDLE, broker);
 DECLARE_GLOBAL_MOCK_METHOD_1(CGatewayLLMocks, , void, Broker_DecRef, BROKER_HANDLE, broker);
 
@@ -464,6 +509,8 @@ TEST_FUNCTION_INITIALIZE(TestMethodInitialize)
 
     currentVECTOR_create_call = 0;
     whenShallVECTOR_create_fail = 0;
+    lastBroker_AddLink_filter = NULL;
+    lastBroker_AddLink_high_priority = false;
     currentVECTOR_push_back_call = 0;
     whenShallVECTOR_push_back_fail = 0;
     currentVECTOR_find_if_call = 0;
@@ -492,6 +539,8 @@ TEST_FUNCTION_INITIALIZE(TestMethodInitialize)
     dummyProps = (GATEWAY_PROPERTIES*)malloc(sizeof(GATEWAY_PROPERTIES));
     dummyProps->gateway_modules = BASEIMPLEMENTATION::VECTOR_create(sizeof(GATEWAY_MODULES_ENTRY));
     dummyProps->gateway_links = BASEIMPLEMENTATION::VECTOR_create(sizeof(GATEWAY_LINK_ENTRY));
+    dummyProps->broker_config = NULL;
+    dummyProps->message_pool_config = NULL;
     BASEIMPLEMENTATION::VECTOR_push_back(dummyProps->gateway_modules, &dummyEntry, 1);
 }
 
@@ -549,6 +598,138 @@ TEST_FUNCTION(Gateway_Create_Creates_Handle_Success)
     Gateway_Destroy(gateway);
 }
 
+/*Tests_SRS_GATEWAY_30_001: [ If `properties->broker_config` is not `NULL`, this function shall create the broker with `Broker_CreateWithConfig`. ]*/
+TEST_FUNCTION(Gateway_Create_uses_broker_config_when_present)
+{
+    //Arrange
+    CGatewayLLMocks mocks;
+    BROKER_CONFIG config = { BROKER_DELIVERY_ZERO_COPY };
+    dummyProps->broker_config = &config;
+    BASEIMPLEMENTATION::VECTOR_clear(dummyProps->gateway_modules);
+
+    //Expectations
+	STRICT_EXPECTED_CALL(mocks, ModuleLoader_Initialize());
+    STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, Broker_CreateWithConfig(&config));
+    STRICT_EXPECTED_CALL(mocks, VECTOR_create(IGNORED_NUM_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, VECTOR_create(IGNORED_NUM_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    expectEventSystemInit(mocks);
+
+    //Act
+    GATEWAY_HANDLE gateway = Gateway_Create(dummyProps);
+
+    //Assert
+    ASSERT_IS_NOT_NULL(gateway);
+    mocks.AssertActualAndExpectedCalls();
+
+    //Cleanup
+    Gateway_Destroy(gateway);
+}
+
+/*Tests_SRS_GATEWAY_30_002: [ If `properties->message_pool_config` is not `NULL`, this function shall enable the message pool with `MessagePool_Enable` before creating the broker. ]*/
+TEST_FUNCTION(Gateway_Create_enables_the_message_pool_when_configured)
+{
+    //Arrange
+    CGatewayLLMocks mocks;
+    MESSAGE_POOL_CONFIG poolConfig = { 16, 256 };
+    dummyProps->message_pool_config = &poolConfig;
+    BASEIMPLEMENTATION::VECTOR_clear(dummyProps->gateway_modules);
+
+    //Expectations
+    STRICT_EXPECTED_CALL(mocks, ModuleLoader_Initialize());
+    STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, MessagePool_Enable(&poolConfig));
+    STRICT_EXPECTED_CALL(mocks, Broker_Create());
+    STRICT_EXPECTED_CALL(mocks, VECTOR_create(IGNORED_NUM_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, VECTOR_create(IGNORED_NUM_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    expectEventSystemInit(mocks);
+
+    //Act
+    GATEWAY_HANDLE gateway = Gateway_Create(dummyProps);
+
+    //Assert
+    ASSERT_IS_NOT_NULL(gateway);
+    mocks.AssertActualAndExpectedCalls();
+
+    //Cleanup
+    Gateway_Destroy(gateway);
+}
+
+/*Tests_SRS_GATEWAY_30_003: [ If `MessagePool_Enable` fails, this function shall free the gateway and return NULL. ]*/
+TEST_FUNCTION(Gateway_Create_returns_null_when_MessagePool_Enable_fails)
+{
+    //Arrange
+    CGatewayLLMocks mocks;
+    MESSAGE_POOL_CONFIG poolConfig = { 0, 0 };
+    dummyProps->message_pool_config = &poolConfig;
+
+    //Expectations
+    STRICT_EXPECTED_CALL(mocks, ModuleLoader_Initialize());
+    STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, MessagePool_Enable(&poolConfig))
+        .SetReturn(__LINE__);
+    STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, ModuleLoader_Destroy());
+
+    //Act
+    GATEWAY_HANDLE gateway = Gateway_Create(dummyProps);
+
+    //Assert
+    ASSERT_IS_NULL(gateway);
+    mocks.AssertActualAndExpectedCalls();
+}
+
+/*Tests_SRS_GATEWAY_30_004: [ If the gateway enabled the message pool, the function shall disable it with `MessagePool_Disable` after destroying the broker. ]*/
+TEST_FUNCTION(Gateway_Destroy_disables_the_message_pool_after_destroying_the_broker)
+{
+    //Arrange
+    CGatewayLLMocks mocks;
+    MESSAGE_POOL_CONFIG poolConfig = { 0, 0 };
+    dummyProps->message_pool_config = &poolConfig;
+    BASEIMPLEMENTATION::VECTOR_clear(dummyProps->gateway_modules);
+    GATEWAY_HANDLE gateway = Gateway_Create(dummyProps);
+    mocks.ResetAllCalls();
+
+    //Expectations
+    expectEventSystemDestroy(mocks);
+    STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
+        .IgnoreArgument(1); //Links
+    STRICT_EXPECTED_CALL(mocks, VECTOR_destroy(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
+        .IgnoreArgument(1); //Modules
+    STRICT_EXPECTED_CALL(mocks, VECTOR_destroy(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, Broker_Destroy(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, MessagePool_Disable());
+    STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, ModuleLoader_Destroy());
+
+    //Act
+    Gateway_Destroy(gateway);
+
+    //Assert
+    mocks.AssertActualAndExpectedCalls();
+}
+
 /*Tests_SRS_GATEWAY_14_011: [ If gw, entry, or GATEWAY_MODULES_ENTRY's loader_configuration or loader_api is NULL the function shall return NULL. ]*/
 /*Tests_SRS_GATEWAY_17_017: [ This function shall destroy the default module loaders upon any failure. ]*/
 TEST_FUNCTION(Gateway_Create_returns_null_on_bad_module_api_entry)
@@ -580,6 +761,8 @@ TEST_FUNCTION(Gateway_Create_returns_null_on_bad_module_api_entry)
     ASSERT_IS_NOT_NULL(newdummyProps.gateway_modules);
     BASEIMPLEMENTATION::VECTOR_push_back(newdummyProps.gateway_modules, &dummyEntry2, 1);
     newdummyProps.gateway_links = NULL;
+    newdummyProps.broker_config = NULL;
+    newdummyProps.message_pool_config = NULL;
 
 
     //Expectations
@@ -824,8 +1007,6 @@ TEST_FUNCTION(Gateway_Create_VECTOR_push_back_Fails_To_Add_All_Modules_In_Props)
         .IgnoreArgument(2);
     STRICT_EXPECTED_CALL(mocks, VECTOR_back(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
 
     //Adding module 2 (Failure)
     STRICT_EXPECTED_CALL(mocks, VECTOR_element(dummyProps->gateway_modules, 1));
@@ -871,8 +1052,6 @@ TEST_FUNCTION(Gateway_Create_VECTOR_push_back_Fails_To_Add_All_Modules_In_Props)
         .IgnoreArgument(2);
 
     //Removing previous module in Gateway_Destroy()
-    STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, VECTOR_front(IGNORED_PTR_ARG))
@@ -978,8 +1157,6 @@ TEST_FUNCTION(Gateway_Create_Broker_AddModule_Fails_To_Add_All_Modules_In_Props)
         .IgnoreArgument(2);
     STRICT_EXPECTED_CALL(mocks, VECTOR_back(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
 
     //Adding module 2 (Failure)
     STRICT_EXPECTED_CALL(mocks, VECTOR_element(dummyProps->gateway_modules, 1));
@@ -1014,8 +1191,6 @@ TEST_FUNCTION(Gateway_Create_Broker_AddModule_Fails_To_Add_All_Modules_In_Props)
         .IgnoreArgument(2);
 
     //Removing previous module in Gateway_Destroy()
-    STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, VECTOR_front(IGNORED_PTR_ARG))
@@ -1124,8 +1299,6 @@ TEST_FUNCTION(Gateway_Create_AddModule_WithDuplicatedModuleName_Fails)
         .IgnoreArgument(2);
     STRICT_EXPECTED_CALL(mocks, VECTOR_back(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
 
     //Adding module 2 (Failure)
     STRICT_EXPECTED_CALL(mocks, VECTOR_element(dummyProps->gateway_modules, 1));
@@ -1133,8 +1306,6 @@ TEST_FUNCTION(Gateway_Create_AddModule_WithDuplicatedModuleName_Fails)
         .IgnoreAllArguments();
 
     //Removing previous module
-    STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, VECTOR_front(IGNORED_PTR_ARG))
@@ -1244,8 +1415,6 @@ TEST_FUNCTION(Gateway_Create_Adds_All_Modules_In_Props_Success)
         .IgnoreArgument(2);
     STRICT_EXPECTED_CALL(mocks, VECTOR_back(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
 
     //Adding module 2 (Success)
     STRICT_EXPECTED_CALL(mocks, VECTOR_element(dummyProps->gateway_modules, 1));
@@ -1277,8 +1446,6 @@ TEST_FUNCTION(Gateway_Create_Adds_All_Modules_In_Props_Success)
         .IgnoreArgument(2);
     STRICT_EXPECTED_CALL(mocks, VECTOR_back(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
 
     STRICT_EXPECTED_CALL(mocks, VECTOR_size(dummyProps->gateway_links)); //Links
 
@@ -1376,8 +1543,6 @@ TEST_FUNCTION(Gateway_Create_Adds_All_Modules_And_All_Links_In_Props_Success)
         .IgnoreArgument(2);
     STRICT_EXPECTED_CALL(mocks, VECTOR_back(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
 
     //Adding module 2 (Success)
     STRICT_EXPECTED_CALL(mocks, VECTOR_element(dummyProps->gateway_modules, 1));
@@ -1410,8 +1575,6 @@ TEST_FUNCTION(Gateway_Create_Adds_All_Modules_And_All_Links_In_Props_Success)
         .IgnoreArgument(2);
     STRICT_EXPECTED_CALL(mocks, VECTOR_back(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
 
     STRICT_EXPECTED_CALL(mocks, VECTOR_size(dummyProps->gateway_links)); //Links
 
@@ -1499,8 +1662,6 @@ TEST_FUNCTION(Gateway_Create_Adds_All_Modules_And_Links_fromNonExistingModule_Fa
         .IgnoreArgument(2);
     STRICT_EXPECTED_CALL(mocks, VECTOR_back(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
 
     STRICT_EXPECTED_CALL(mocks, VECTOR_size(dummyProps->gateway_links)); //Links
 
@@ -1513,8 +1674,6 @@ TEST_FUNCTION(Gateway_Create_Adds_All_Modules_And_Links_fromNonExistingModule_Fa
 
 
     //Removing previous module
-    STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, VECTOR_front(IGNORED_PTR_ARG))
@@ -1600,8 +1759,6 @@ TEST_FUNCTION(Gateway_Destroy_Continues_Unloading_If_Broker_RemoveModule_Fails)
 
     STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
         .IgnoreArgument(1); //Modules
-    STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
-        .IgnoreArgument(1); //Links
     STRICT_EXPECTED_CALL(mocks, VECTOR_front(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
@@ -1627,8 +1784,6 @@ TEST_FUNCTION(Gateway_Destroy_Continues_Unloading_If_Broker_RemoveModule_Fails)
     STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
 
-    STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, VECTOR_front(IGNORED_PTR_ARG))
@@ -1704,8 +1859,6 @@ TEST_FUNCTION(Gateway_Destroy_Removes_All_Modules_And_Destroys_Vector_Success)
     //Gateway_Destroy Expectations
     expectEventSystemDestroy(mocks);
 
-    STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, VECTOR_front(IGNORED_PTR_ARG))
@@ -1733,8 +1886,6 @@ TEST_FUNCTION(Gateway_Destroy_Removes_All_Modules_And_Destroys_Vector_Success)
     STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
 
-    STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, VECTOR_front(IGNORED_PTR_ARG))
@@ -1925,8 +2076,6 @@ TEST_FUNCTION(Gateway_AddModule_Loads_Module_From_Library_Path)
         .IgnoreArgument(2);
     STRICT_EXPECTED_CALL(mocks, VECTOR_back(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, EventSystem_ReportEvent(IGNORED_PTR_ARG, gw, GATEWAY_MODULE_LIST_CHANGED))
         .IgnoreArgument(1);
 
@@ -1941,79 +2090,69 @@ TEST_FUNCTION(Gateway_AddModule_Loads_Module_From_Library_Path)
     Gateway_Destroy(gw);
 }
 
-/*Tests_SRS_GATEWAY_14_031: [ If unsuccessful, the function shall return NULL. ]*/
-TEST_FUNCTION(Gateway_AddModule_Malloc_data_Fails)
+/*Tests_SRS_GATEWAY_30_030: [ If `module_entry->dedicated_thread` is true, the function shall attach the module using `Broker_AddModuleWithConfig` with `BROKER_MODULE_CONFIG::dedicated_thread` set instead. ]*/
+TEST_FUNCTION(Gateway_AddModule_gives_a_dedicated_thread_when_asked)
 {
     //Arrange
     CGatewayLLMocks mocks;
 
     GATEWAY_HANDLE gw = Gateway_Create(NULL);
-    mocks.ResetActualCalls();
+    GATEWAY_MODULES_ENTRY entry = *(GATEWAY_MODULES_ENTRY*)BASEIMPLEMENTATION::VECTOR_front(dummyProps->gateway_modules);
+    entry.dedicated_thread = true;
+    mocks.ResetAllCalls();
 
     //Expectations
-    whenShallModuleLoader_Load_fail = 1;
     STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreAllArguments();
     STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
+        .IgnoreArgument(1);
+    EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(mocks, DynamicModuleLoader_Load(IGNORED_PTR_ARG, dummyLoaderInfo.entrypoint))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, DynamicModuleLoader_GetModuleApi(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreArgument(1)
-        .SetFailReturn(nullptr);
-
-    MODULE_HANDLE handle = Gateway_AddModule(gw, (GATEWAY_MODULES_ENTRY*)BASEIMPLEMENTATION::VECTOR_front(dummyProps->gateway_modules));
-
-    //Assert
-    ASSERT_IS_NULL(handle);
-    mocks.AssertActualAndExpectedCalls();
-
-    //Cleanup
-    Gateway_Destroy(gw);
-}
-
-/*Tests_SRS_GATEWAY_14_031: [ If unsuccessful, the function shall return NULL. ]*/
-TEST_FUNCTION(Gateway_AddModule_Fails)
-{
-    //Arrange
-    CGatewayLLMocks mocks;
-
-    GATEWAY_HANDLE gw = Gateway_Create(NULL);
-    mocks.ResetActualCalls();
-
-    //Expectations
-    whenShallModuleLoader_Load_fail = 1;
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, DynamicModuleLoader_BuildModuleConfiguration(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreAllArguments();
-    STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
+    STRICT_EXPECTED_CALL(mocks, DynamicModuleLoader_FreeModuleConfiguration(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, mock_Module_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, Broker_AddModuleWithConfig(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
+    STRICT_EXPECTED_CALL(mocks, Broker_IncRef(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+    STRICT_EXPECTED_CALL(mocks, VECTOR_push_back(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, VECTOR_back(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, DynamicModuleLoader_Load(IGNORED_PTR_ARG, dummyLoaderInfo.entrypoint))
+    STRICT_EXPECTED_CALL(mocks, EventSystem_ReportEvent(IGNORED_PTR_ARG, gw, GATEWAY_MODULE_LIST_CHANGED))
         .IgnoreArgument(1);
 
-    MODULE_HANDLE handle = Gateway_AddModule(gw, (GATEWAY_MODULES_ENTRY*)BASEIMPLEMENTATION::VECTOR_front(dummyProps->gateway_modules));
+    //Act
+    MODULE_HANDLE handle = Gateway_AddModule(gw, &entry);
 
     //Assert
-    ASSERT_IS_NULL(handle);
+    ASSERT_IS_NOT_NULL(handle);
     mocks.AssertActualAndExpectedCalls();
 
     //Cleanup
     Gateway_Destroy(gw);
 }
 
-/*Tests_SRS_GATEWAY_14_015: [ The function shall use the MODULE_API to create a MODULE_HANDLE using the GATEWAY_MODULES_ENTRY's module_properties. ]*/
-/*Tests_SRS_GATEWAY_14_039: [ The function shall increment the BROKER_HANDLE reference count if the MODULE_HANDLE was successfully added to the GATEWAY_HANDLE_DATA's broker. ]*/
-TEST_FUNCTION(Gateway_AddModule_Creates_Module_Using_Module_Properties)
+/*Tests_SRS_GATEWAY_30_031: [ If `module_entry->deliver_inline` is true, the function shall make the module inline by calling `Broker_SetSinkInline` before linking it to anything, and fail if that fails. ]*/
+TEST_FUNCTION(Gateway_AddModule_makes_the_module_inline_when_asked)
 {
     //Arrange
     CGatewayLLMocks mocks;
 
     GATEWAY_HANDLE gw = Gateway_Create(NULL);
+    GATEWAY_MODULES_ENTRY entry = *(GATEWAY_MODULES_ENTRY*)BASEIMPLEMENTATION::VECTOR_front(dummyProps->gateway_modules);
+    entry.deliver_inline = true;
     mocks.ResetAllCalls();
-    bool* properties = (bool*)malloc(sizeof(bool));
-    *properties = true;
-    GATEWAY_MODULES_ENTRY entry = {
-        "Test module",
-		dummyLoaderInfo,
-        properties
-    };
 
     //Expectations
     STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
@@ -2026,15 +2165,17 @@ TEST_FUNCTION(Gateway_AddModule_Creates_Module_Using_Module_Properties)
     STRICT_EXPECTED_CALL(mocks, DynamicModuleLoader_GetModuleApi(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreArgument(1)
         .IgnoreArgument(2);
-	STRICT_EXPECTED_CALL(mocks, DynamicModuleLoader_BuildModuleConfiguration(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-		.IgnoreAllArguments();
-	STRICT_EXPECTED_CALL(mocks, DynamicModuleLoader_FreeModuleConfiguration(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-		.IgnoreArgument(1)
+    STRICT_EXPECTED_CALL(mocks, DynamicModuleLoader_BuildModuleConfiguration(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
+    STRICT_EXPECTED_CALL(mocks, DynamicModuleLoader_FreeModuleConfiguration(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
         .IgnoreArgument(2);
     STRICT_EXPECTED_CALL(mocks, mock_Module_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreArgument(1)
-		.IgnoreArgument(2);
+        .IgnoreArgument(2);
     STRICT_EXPECTED_CALL(mocks, Broker_AddModule(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
+    STRICT_EXPECTED_CALL(mocks, Broker_SetSinkInline(IGNORED_PTR_ARG, IGNORED_PTR_ARG, true))
         .IgnoreArgument(1)
         .IgnoreArgument(2);
     STRICT_EXPECTED_CALL(mocks, Broker_IncRef(IGNORED_PTR_ARG))
@@ -2044,8 +2185,6 @@ TEST_FUNCTION(Gateway_AddModule_Creates_Module_Using_Module_Properties)
         .IgnoreArgument(2);
     STRICT_EXPECTED_CALL(mocks, VECTOR_back(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, EventSystem_ReportEvent(IGNORED_PTR_ARG, gw, GATEWAY_MODULE_LIST_CHANGED))
         .IgnoreArgument(1);
 
@@ -2058,36 +2197,197 @@ TEST_FUNCTION(Gateway_AddModule_Creates_Module_Using_Module_Properties)
 
     //Cleanup
     Gateway_Destroy(gw);
-    free(properties);
 }
 
-/*Tests_SRS_GATEWAY_14_011: [ If gw, entry, or GATEWAY_MODULES_ENTRY's specified loader or entrypoint is NULL the function shall return NULL. ]*/
-TEST_FUNCTION(Gateway_AddModule_fails_on_null_loader_api)
+/*Tests_SRS_GATEWAY_30_031: [ If `module_entry->deliver_inline` is true, the function shall make the module inline by calling `Broker_SetSinkInline` before linking it to anything, and fail if that fails. ]*/
+/*Tests_SRS_GATEWAY_14_030: [ If any internal API call is unsuccessful after a module is created, the library will be unloaded and the module destroyed. ] */
+TEST_FUNCTION(Gateway_AddModule_fails_when_Broker_SetSinkInline_fails)
 {
     //Arrange
     CGatewayLLMocks mocks;
 
     GATEWAY_HANDLE gw = Gateway_Create(NULL);
+    GATEWAY_MODULES_ENTRY entry = *(GATEWAY_MODULES_ENTRY*)BASEIMPLEMENTATION::VECTOR_front(dummyProps->gateway_modules);
+    entry.deliver_inline = true;
     mocks.ResetAllCalls();
-    bool* properties = (bool*)malloc(sizeof(bool));
-    *properties = true;
-    GATEWAY_MODULES_ENTRY entry = {
-        "Test module",
-		{ NULL,
-		NULL},
-        properties
-    };
-	
-    //Expectations
 
-    //Act
-    MODULE_HANDLE handle = Gateway_AddModule(gw, &entry);
-
-    //Assert
-    ASSERT_IS_NULL(handle);
-    mocks.AssertActualAndExpectedCalls();
-
-    //Cleanup
+    //Expectations
+    EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG));
+    EXPECTED_CALL(mocks, DynamicModuleLoader_Load(IGNORED_PTR_ARG, dummyLoaderInfo.entrypoint));
+    EXPECTED_CALL(mocks, DynamicModuleLoader_GetModuleApi(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(mocks, DynamicModuleLoader_BuildModuleConfiguration(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
+    STRICT_EXPECTED_CALL(mocks, DynamicModuleLoader_FreeModuleConfiguration(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
+    EXPECTED_CALL(mocks, mock_Module_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    EXPECTED_CALL(mocks, Broker_AddModule(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(mocks, Broker_SetSinkInline(IGNORED_PTR_ARG, IGNORED_PTR_ARG, true))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2)
+        .SetFailReturn(BROKER_ERROR);
+    EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG));
+    EXPECTED_CALL(mocks, Broker_RemoveModule(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    EXPECTED_CALL(mocks, mock_Module_Destroy(IGNORED_PTR_ARG));
+    EXPECTED_CALL(mocks, DynamicModuleLoader_Unload(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+
+    //Act
+    MODULE_HANDLE handle = Gateway_AddModule(gw, &entry);
+
+    //Assert
+    ASSERT_IS_NULL(handle);
+    mocks.AssertActualAndExpectedCalls();
+
+    //Cleanup
+    Gateway_Destroy(gw);
+}
+
+/*Tests_SRS_GATEWAY_14_031: [ If unsuccessful, the function shall return NULL. ]*/
+TEST_FUNCTION(Gateway_AddModule_Malloc_data_Fails)
+{
+    //Arrange
+    CGatewayLLMocks mocks;
+
+    GATEWAY_HANDLE gw = Gateway_Create(NULL);
+    mocks.ResetActualCalls();
+
+    //Expectations
+    whenShallModuleLoader_Load_fail = 1;
+    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
+    STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
+        .IgnoreArgument(1)
+        .SetFailReturn(nullptr);
+
+    MODULE_HANDLE handle = Gateway_AddModule(gw, (GATEWAY_MODULES_ENTRY*)BASEIMPLEMENTATION::VECTOR_front(dummyProps->gateway_modules));
+
+    //Assert
+    ASSERT_IS_NULL(handle);
+    mocks.AssertActualAndExpectedCalls();
+
+    //Cleanup
+    Gateway_Destroy(gw);
+}
+
+/*Tests_SRS_GATEWAY_14_031: [ If unsuccessful, the function shall return NULL. ]*/
+TEST_FUNCTION(Gateway_AddModule_Fails)
+{
+    //Arrange
+    CGatewayLLMocks mocks;
+
+    GATEWAY_HANDLE gw = Gateway_Create(NULL);
+    mocks.ResetActualCalls();
+
+    //Expectations
+    whenShallModuleLoader_Load_fail = 1;
+    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
+    STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, DynamicModuleLoader_Load(IGNORED_PTR_ARG, dummyLoaderInfo.entrypoint))
+        .IgnoreArgument(1);
+
+    MODULE_HANDLE handle = Gateway_AddModule(gw, (GATEWAY_MODULES_ENTRY*)BASEIMPLEMENTATION::VECTOR_front(dummyProps->gateway_modules));
+
+    //Assert
+    ASSERT_IS_NULL(handle);
+    mocks.AssertActualAndExpectedCalls();
+
+    //Cleanup
+    Gateway_Destroy(gw);
+}
+
+/*Tests_SRS_GATEWAY_14_015: [ The function shall use the MODULE_API to create a MODULE_HANDLE using the GATEWAY_MODULES_ENTRY's module_properties. ]*/
+/*Tests_SRS_GATEWAY_14_039: [ The function shall increment the BROKER_HANDLE reference count if the MODULE_HANDLE was successfully added to the GATEWAY_HANDLE_DATA's broker. ]*/
+TEST_FUNCTION(Gateway_AddModule_Creates_Module_Using_Module_Properties)
+{
+    //Arrange
+    CGatewayLLMocks mocks;
+
+    GATEWAY_HANDLE gw = Gateway_Create(NULL);
+    mocks.ResetAllCalls();
+    bool* properties = (bool*)malloc(sizeof(bool));
+    *properties = true;
+    GATEWAY_MODULES_ENTRY entry = {
+        "Test module",
+		dummyLoaderInfo,
+        properties
+    };
+
+    //Expectations
+    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
+    STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
+        .IgnoreArgument(1);
+    EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(mocks, DynamicModuleLoader_Load(IGNORED_PTR_ARG, dummyLoaderInfo.entrypoint))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, DynamicModuleLoader_GetModuleApi(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
+	STRICT_EXPECTED_CALL(mocks, DynamicModuleLoader_BuildModuleConfiguration(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreAllArguments();
+	STRICT_EXPECTED_CALL(mocks, DynamicModuleLoader_FreeModuleConfiguration(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(1)
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, mock_Module_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+		.IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, Broker_AddModule(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, Broker_IncRef(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, VECTOR_push_back(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, VECTOR_back(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, EventSystem_ReportEvent(IGNORED_PTR_ARG, gw, GATEWAY_MODULE_LIST_CHANGED))
+        .IgnoreArgument(1);
+
+    //Act
+    MODULE_HANDLE handle = Gateway_AddModule(gw, &entry);
+
+    //Assert
+    ASSERT_IS_NOT_NULL(handle);
+    mocks.AssertActualAndExpectedCalls();
+
+    //Cleanup
+    Gateway_Destroy(gw);
+    free(properties);
+}
+
+/*Tests_SRS_GATEWAY_14_011: [ If gw, entry, or GATEWAY_MODULES_ENTRY's specified loader or entrypoint is NULL the function shall return NULL. ]*/
+TEST_FUNCTION(Gateway_AddModule_fails_on_null_loader_api)
+{
+    //Arrange
+    CGatewayLLMocks mocks;
+
+    GATEWAY_HANDLE gw = Gateway_Create(NULL);
+    mocks.ResetAllCalls();
+    bool* properties = (bool*)malloc(sizeof(bool));
+    *properties = true;
+    GATEWAY_MODULES_ENTRY entry = {
+        "Test module",
+		{ NULL,
+		NULL},
+        properties
+    };
+	
+    //Expectations
+
+    //Act
+    MODULE_HANDLE handle = Gateway_AddModule(gw, &entry);
+
+    //Assert
+    ASSERT_IS_NULL(handle);
+    mocks.AssertActualAndExpectedCalls();
+
+    //Cleanup
     Gateway_Destroy(gw);
     free(properties);
 }
@@ -2316,8 +2616,6 @@ TEST_FUNCTION(Gateway_RemoveModule_Finds_Module_Data_Success)
     //Expectations
     STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreAllArguments();
-    STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreAllArguments();
     EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG));
@@ -2389,8 +2687,6 @@ TEST_FUNCTION(Gateway_RemoveModule_Broker_RemoveModule_Failure)
     //Expectations
     STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreAllArguments();
-    STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreAllArguments();
     whenShallBroker_RemoveModule_fail = 1;
@@ -2571,8 +2867,8 @@ TEST_FUNCTION(Gateway_RemoveLink_NonExistingSinkModule_Find_Link_Data_Failure)
     Gateway_Destroy(gw);
 }
 
-/*Codes_SRS_GATEWAY_04_006: [ The function shall locate the LINK_DATA object in GATEWAY_HANDLE_DATA's links containing link and return if it cannot be found. ]*/
-TEST_FUNCTION(Gateway_RemoveLink_NonExistingSinkModule_Find_star_Link_Data_Failure)
+/*Tests_SRS_GATEWAY_30_014: [ The gateway shall link a "*" source to its sink through the sink's module data kept by the link, without looking the sink up by name. ]*/
+TEST_FUNCTION(Gateway_RemoveLink_star_link_does_not_look_up_the_sink)
 {
     //Arrange
     CGatewayLLMocks mocks;
@@ -2602,11 +2898,14 @@ TEST_FUNCTION(Gateway_RemoveLink_NonExistingSinkModule_Find_star_Link_Data_Failu
     STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, &dummyLink))
         .IgnoreArgument(1)
         .IgnoreArgument(2);
-    whenShallVECTOR_find_if_fail = currentVECTOR_find_if_call + 2;
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreArgument(1)
-        .IgnoreArgument(2)
-        .IgnoreArgument(3);
+    STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 0))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, Broker_RemoveLink(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
+    STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 1))
+        .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, VECTOR_erase(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1))
         .IgnoreArgument(1)
         .IgnoreArgument(2);
@@ -3113,52 +3412,296 @@ TEST_FUNCTION(Gateway_AddLink_NonExistingSourceModule_Fail)
     Gateway_Destroy(gateway);
 }
 
-/*Tests_SRS_GATEWAY_04_011: [If the module referenced by the entryLink->module_source or entryLink->module_sink doesn't exists this function shall return GATEWAY_ADD_LINK_ERROR ]*/
-TEST_FUNCTION(Gateway_AddLink_NonExistingSinkModule_Fail)
+/*Tests_SRS_GATEWAY_04_011: [If the module referenced by the entryLink->module_source or entryLink->module_sink doesn't exists this function shall return GATEWAY_ADD_LINK_ERROR ]*/
+TEST_FUNCTION(Gateway_AddLink_NonExistingSinkModule_Fail)
+{
+    //Arrange
+    CGatewayLLMocks mocks;
+
+    //Add another entry to the properties
+    GATEWAY_MODULES_ENTRY dummyEntry2 = {
+        "dummy module 2",
+		dummyLoaderInfo,
+        NULL
+    };
+
+    const char * nem = "NonExisting";
+    const char * dm2 = "dummy module 2";
+    GATEWAY_LINK_ENTRY dummyLink = {
+        "dummy module",
+        dm2
+    };
+
+    GATEWAY_LINK_ENTRY nonExistingModuleLink = {
+        dm2,
+        nem
+    };
+
+    BASEIMPLEMENTATION::VECTOR_push_back(dummyProps->gateway_modules, &dummyEntry2, 1);
+    BASEIMPLEMENTATION::VECTOR_push_back(dummyProps->gateway_links, &dummyLink, 1);
+
+    GATEWAY_HANDLE gateway = Gateway_Create(dummyProps);
+    mocks.ResetAllCalls();
+
+    //Act
+    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, &nonExistingModuleLink))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, dm2))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);//Check Source Module.
+    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, nem))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);//Check Sink Module.
+
+    GATEWAY_ADD_LINK_RESULT result = Gateway_AddLink(gateway, &nonExistingModuleLink);
+
+    //Assert
+    ASSERT_ARE_EQUAL(GATEWAY_ADD_LINK_RESULT, GATEWAY_ADD_LINK_ERROR, result);
+
+    mocks.AssertActualAndExpectedCalls();
+
+    //Cleanup
+    Gateway_Destroy(gateway);
+}
+
+/*Tests_SRS_GATEWAY_04_012: [ This function shall add the entryLink to the gw->links ] */
+/*Tests_SRS_GATEWAY_04_013: [If adding the link succeed this function shall return GATEWAY_ADD_LINK_SUCCESS]*/
+TEST_FUNCTION(Gateway_AddLink_Succeeds)
+{
+    //Arrange
+    CGatewayLLMocks mocks;
+
+    //Add another entry to the properties
+    GATEWAY_MODULES_ENTRY dummyEntry2 = {
+        "dummy module 2",
+		dummyLoaderInfo,
+        NULL
+    };
+
+    GATEWAY_LINK_ENTRY dummyLink = {
+        "dummy module",
+        "dummy module 2"
+    };
+
+    BASEIMPLEMENTATION::VECTOR_push_back(dummyProps->gateway_modules, &dummyEntry2, 1);
+
+    GATEWAY_HANDLE gateway = Gateway_Create(dummyProps);
+    mocks.ResetAllCalls();
+
+    //Act
+    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();//Check link
+    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();//Check Source Module.
+    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();//Check Sink Module.
+    STRICT_EXPECTED_CALL(mocks, Broker_AddLink(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
+    STRICT_EXPECTED_CALL(mocks, VECTOR_push_back(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, EventSystem_ReportEvent(IGNORED_PTR_ARG, IGNORED_PTR_ARG, GATEWAY_MODULE_LIST_CHANGED))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
+
+    GATEWAY_ADD_LINK_RESULT result = Gateway_AddLink(gateway, &dummyLink);
+
+    //Assert
+    ASSERT_ARE_EQUAL(GATEWAY_ADD_LINK_RESULT, GATEWAY_ADD_LINK_SUCCESS, result);
+
+    mocks.AssertActualAndExpectedCalls();
+
+    //Cleanup
+    Gateway_Destroy(gateway);
+}
+
+/*Tests_SRS_GATEWAY_30_010: [ If `entryLink->sink_queue` is not `NULL`, the function shall configure the queue of the sink by calling `Broker_SetSinkQueue` before adding the link, and fail if that fails. ]*/
+TEST_FUNCTION(Gateway_AddLink_with_sink_queue_configures_the_sink)
+{
+    //Arrange
+    CGatewayLLMocks mocks;
+
+    //Add another entry to the properties
+    GATEWAY_MODULES_ENTRY dummyEntry2 = {
+        "dummy module 2",
+        dummyLoaderInfo,
+        NULL
+    };
+
+    BROKER_QUEUE_CONFIG queue_config = { 64, BROKER_OVERFLOW_DROP_OLDEST, 0 };
+    GATEWAY_LINK_ENTRY dummyLink = {
+        "dummy module",
+        "dummy module 2",
+        &queue_config
+    };
+
+    BASEIMPLEMENTATION::VECTOR_push_back(dummyProps->gateway_modules, &dummyEntry2, 1);
+
+    GATEWAY_HANDLE gateway = Gateway_Create(dummyProps);
+    mocks.ResetAllCalls();
+
+    //Act
+    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();//Check link
+    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();//Find sink for its queue.
+    STRICT_EXPECTED_CALL(mocks, Broker_SetSinkQueue(IGNORED_PTR_ARG, IGNORED_PTR_ARG, &queue_config))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();//Check Source Module.
+    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();//Check Sink Module.
+    STRICT_EXPECTED_CALL(mocks, Broker_AddLink(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
+    STRICT_EXPECTED_CALL(mocks, VECTOR_push_back(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, EventSystem_ReportEvent(IGNORED_PTR_ARG, IGNORED_PTR_ARG, GATEWAY_MODULE_LIST_CHANGED))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
+
+    GATEWAY_ADD_LINK_RESULT result = Gateway_AddLink(gateway, &dummyLink);
+
+    //Assert
+    ASSERT_ARE_EQUAL(GATEWAY_ADD_LINK_RESULT, GATEWAY_ADD_LINK_SUCCESS, result);
+
+    mocks.AssertActualAndExpectedCalls();
+
+    //Cleanup
+    Gateway_Destroy(gateway);
+}
+
+/*Tests_SRS_GATEWAY_30_010: [ If `entryLink->sink_queue` is not `NULL`, the function shall configure the queue of the sink by calling `Broker_SetSinkQueue` before adding the link, and fail if that fails. ]*/
+TEST_FUNCTION(Gateway_AddLink_fails_when_Broker_SetSinkQueue_fails)
+{
+    //Arrange
+    CGatewayLLMocks mocks;
+
+    //Add another entry to the properties
+    GATEWAY_MODULES_ENTRY dummyEntry2 = {
+        "dummy module 2",
+        dummyLoaderInfo,
+        NULL
+    };
+
+    BROKER_QUEUE_CONFIG queue_config = { 64, BROKER_OVERFLOW_BLOCK, 0 };
+    GATEWAY_LINK_ENTRY dummyLink = {
+        "dummy module",
+        "dummy module 2",
+        &queue_config
+    };
+
+    BASEIMPLEMENTATION::VECTOR_push_back(dummyProps->gateway_modules, &dummyEntry2, 1);
+
+    GATEWAY_HANDLE gateway = Gateway_Create(dummyProps);
+    mocks.ResetAllCalls();
+
+    //Act
+    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();//Check link
+    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();//Find sink for its queue.
+    STRICT_EXPECTED_CALL(mocks, Broker_SetSinkQueue(IGNORED_PTR_ARG, IGNORED_PTR_ARG, &queue_config))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2)
+        .SetFailReturn(BROKER_ERROR);
+
+    GATEWAY_ADD_LINK_RESULT result = Gateway_AddLink(gateway, &dummyLink);
+
+    //Assert
+    ASSERT_ARE_EQUAL(GATEWAY_ADD_LINK_RESULT, GATEWAY_ADD_LINK_ERROR, result);
+
+    mocks.AssertActualAndExpectedCalls();
+
+    //Cleanup
+    Gateway_Destroy(gateway);
+}
+
+/*Tests_SRS_GATEWAY_30_012: [ If `entryLink->filter` is not `NULL` and `entryLink->module_source` is "*", the function shall return `GATEWAY_ADD_LINK_ERROR`. ]*/
+TEST_FUNCTION(Gateway_AddLink_with_filter_from_any_source_fails)
+{
+    //Arrange
+    CGatewayLLMocks mocks;
+    const char* values[] = { "bleTelemetry" };
+    BROKER_FILTER_CONDITION condition = { "source", BROKER_FILTER_EQUALS, values, 1 };
+    BROKER_LINK_FILTER filter = { &condition, 1 };
+
+    GATEWAY_LINK_ENTRY dummyLink = {
+        "*",
+        "dummy module",
+        NULL,
+        &filter
+    };
+
+    GATEWAY_HANDLE gateway = Gateway_Create(dummyProps);
+    mocks.ResetAllCalls();
+
+    //Act
+    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();//Check link
+
+    GATEWAY_ADD_LINK_RESULT result = Gateway_AddLink(gateway, &dummyLink);
+
+    //Assert
+    ASSERT_ARE_EQUAL(GATEWAY_ADD_LINK_RESULT, GATEWAY_ADD_LINK_ERROR, result);
+
+    mocks.AssertActualAndExpectedCalls();
+
+    //Cleanup
+    Gateway_Destroy(gateway);
+}
+
+/*Tests_SRS_GATEWAY_30_013: [ The function shall pass `entryLink->filter` to `Broker_AddLink` for a link whose source is a module. ]*/
+TEST_FUNCTION(Gateway_AddLink_with_filter_passes_it_to_the_broker)
 {
     //Arrange
     CGatewayLLMocks mocks;
+    const char* values[] = { "bleTelemetry" };
+    BROKER_FILTER_CONDITION condition = { "source", BROKER_FILTER_EQUALS, values, 1 };
+    BROKER_LINK_FILTER filter = { &condition, 1 };
 
     //Add another entry to the properties
     GATEWAY_MODULES_ENTRY dummyEntry2 = {
         "dummy module 2",
-		dummyLoaderInfo,
+        dummyLoaderInfo,
         NULL
     };
 
-    const char * nem = "NonExisting";
-    const char * dm2 = "dummy module 2";
     GATEWAY_LINK_ENTRY dummyLink = {
         "dummy module",
-        dm2
-    };
-
-    GATEWAY_LINK_ENTRY nonExistingModuleLink = {
-        dm2,
-        nem
+        "dummy module 2",
+        NULL,
+        &filter
     };
 
     BASEIMPLEMENTATION::VECTOR_push_back(dummyProps->gateway_modules, &dummyEntry2, 1);
-    BASEIMPLEMENTATION::VECTOR_push_back(dummyProps->gateway_links, &dummyLink, 1);
 
     GATEWAY_HANDLE gateway = Gateway_Create(dummyProps);
     mocks.ResetAllCalls();
 
     //Act
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, &nonExistingModuleLink))
+    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();//Check link
+    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();//Check Source Module.
+    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();//Check Sink Module.
+    STRICT_EXPECTED_CALL(mocks, Broker_AddLink(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
+    STRICT_EXPECTED_CALL(mocks, VECTOR_push_back(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1))
         .IgnoreArgument(1)
         .IgnoreArgument(2);
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, dm2))
-        .IgnoreArgument(1)
-        .IgnoreArgument(2);//Check Source Module.
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, nem))
+    STRICT_EXPECTED_CALL(mocks, EventSystem_ReportEvent(IGNORED_PTR_ARG, IGNORED_PTR_ARG, GATEWAY_MODULE_LIST_CHANGED))
         .IgnoreArgument(1)
-        .IgnoreArgument(2);//Check Sink Module.
+        .IgnoreArgument(2);
 
-    GATEWAY_ADD_LINK_RESULT result = Gateway_AddLink(gateway, &nonExistingModuleLink);
+    GATEWAY_ADD_LINK_RESULT result = Gateway_AddLink(gateway, &dummyLink);
 
     //Assert
-    ASSERT_ARE_EQUAL(GATEWAY_ADD_LINK_RESULT, GATEWAY_ADD_LINK_ERROR, result);
+    ASSERT_ARE_EQUAL(GATEWAY_ADD_LINK_RESULT, GATEWAY_ADD_LINK_SUCCESS, result);
+    ASSERT_ARE_EQUAL(void_ptr, (void*)&filter, (void*)lastBroker_AddLink_filter);
 
     mocks.AssertActualAndExpectedCalls();
 
@@ -3166,9 +3709,8 @@ TEST_FUNCTION(Gateway_AddLink_NonExistingSinkModule_Fail)
     Gateway_Destroy(gateway);
 }
 
-/*Tests_SRS_GATEWAY_04_012: [ This function shall add the entryLink to the gw->links ] */
-/*Tests_SRS_GATEWAY_04_013: [If adding the link succeed this function shall return GATEWAY_ADD_LINK_SUCCESS]*/
-TEST_FUNCTION(Gateway_AddLink_Succeeds)
+/*Tests_SRS_GATEWAY_30_015: [ The function shall pass `entryLink->high_priority` to `Broker_AddLink` for every broker link it makes, including the links of a "*" source to modules added later. ]*/
+TEST_FUNCTION(Gateway_AddLink_high_priority_is_passed_to_the_broker)
 {
     //Arrange
     CGatewayLLMocks mocks;
@@ -3176,13 +3718,16 @@ TEST_FUNCTION(Gateway_AddLink_Succeeds)
     //Add another entry to the properties
     GATEWAY_MODULES_ENTRY dummyEntry2 = {
         "dummy module 2",
-		dummyLoaderInfo,
+        dummyLoaderInfo,
         NULL
     };
 
     GATEWAY_LINK_ENTRY dummyLink = {
         "dummy module",
-        "dummy module 2"
+        "dummy module 2",
+        NULL,
+        NULL,
+        true
     };
 
     BASEIMPLEMENTATION::VECTOR_push_back(dummyProps->gateway_modules, &dummyEntry2, 1);
@@ -3210,7 +3755,116 @@ TEST_FUNCTION(Gateway_AddLink_Succeeds)
 
     //Assert
     ASSERT_ARE_EQUAL(GATEWAY_ADD_LINK_RESULT, GATEWAY_ADD_LINK_SUCCESS, result);
+    ASSERT_IS_TRUE(lastBroker_AddLink_high_priority);
+
+    mocks.AssertActualAndExpectedCalls();
+
+    //Cleanup
+    Gateway_Destroy(gateway);
+}
+
+/*Tests_SRS_GATEWAY_30_020: [ If `gw`, `module_name` or `stats` is `NULL` the function shall return a non-zero value. ]*/
+TEST_FUNCTION(Gateway_GetSinkQueueStats_fails_with_NULL_arguments)
+{
+    //Arrange
+    CGatewayLLMocks mocks;
+    BROKER_QUEUE_STATS stats;
+
+    GATEWAY_HANDLE gateway = Gateway_Create(dummyProps);
+    mocks.ResetAllCalls();
+
+    //Act
+    int result1 = Gateway_GetSinkQueueStats(NULL, "dummy module", &stats);
+    int result2 = Gateway_GetSinkQueueStats(gateway, NULL, &stats);
+    int result3 = Gateway_GetSinkQueueStats(gateway, "dummy module", NULL);
+
+    //Assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result1);
+    ASSERT_ARE_NOT_EQUAL(int, 0, result2);
+    ASSERT_ARE_NOT_EQUAL(int, 0, result3);
+    mocks.AssertActualAndExpectedCalls();
+
+    //Cleanup
+    Gateway_Destroy(gateway);
+}
+
+/*Tests_SRS_GATEWAY_30_021: [ If no module is named `module_name` the function shall return a non-zero value. ]*/
+TEST_FUNCTION(Gateway_GetSinkQueueStats_fails_for_unknown_module)
+{
+    //Arrange
+    CGatewayLLMocks mocks;
+    BROKER_QUEUE_STATS stats;
+
+    GATEWAY_HANDLE gateway = Gateway_Create(dummyProps);
+    mocks.ResetAllCalls();
+
+    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
+
+    //Act
+    int result = Gateway_GetSinkQueueStats(gateway, "no such module", &stats);
+
+    //Assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    mocks.AssertActualAndExpectedCalls();
+
+    //Cleanup
+    Gateway_Destroy(gateway);
+}
+
+/*Tests_SRS_GATEWAY_30_022: [ The function shall read the counters by calling `Broker_GetSinkQueueStats` with the module's handle and return a non-zero value if that fails, 0 otherwise. ]*/
+TEST_FUNCTION(Gateway_GetSinkQueueStats_reads_the_broker_counters)
+{
+    //Arrange
+    CGatewayLLMocks mocks;
+    BROKER_QUEUE_STATS stats;
+
+    GATEWAY_HANDLE gateway = Gateway_Create(dummyProps);
+    mocks.ResetAllCalls();
+
+    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
+    STRICT_EXPECTED_CALL(mocks, Broker_GetSinkQueueStats(IGNORED_PTR_ARG, IGNORED_PTR_ARG, &stats))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
+
+    //Act
+    int result = Gateway_GetSinkQueueStats(gateway, "dummy module", &stats);
+
+    //Assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(size_t, 16, stats.capacity);
+    ASSERT_ARE_EQUAL(size_t, 3, stats.queued);
+    ASSERT_ARE_EQUAL(size_t, 2, stats.dropped);
+    ASSERT_ARE_EQUAL(size_t, 1, stats.blocked);
+    mocks.AssertActualAndExpectedCalls();
+
+    //Cleanup
+    Gateway_Destroy(gateway);
+}
+
+/*Tests_SRS_GATEWAY_30_022: [ The function shall read the counters by calling `Broker_GetSinkQueueStats` with the module's handle and return a non-zero value if that fails, 0 otherwise. ]*/
+TEST_FUNCTION(Gateway_GetSinkQueueStats_fails_when_the_broker_fails)
+{
+    //Arrange
+    CGatewayLLMocks mocks;
+    BROKER_QUEUE_STATS stats;
+
+    GATEWAY_HANDLE gateway = Gateway_Create(dummyProps);
+    mocks.ResetAllCalls();
+
+    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
+    STRICT_EXPECTED_CALL(mocks, Broker_GetSinkQueueStats(IGNORED_PTR_ARG, IGNORED_PTR_ARG, &stats))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2)
+        .SetFailReturn(BROKER_INVALIDARG);
+
+    //Act
+    int result = Gateway_GetSinkQueueStats(gateway, "dummy module", &stats);
 
+    //Assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
     mocks.AssertActualAndExpectedCalls();
 
     //Cleanup
@@ -3352,6 +4006,10 @@ TEST_FUNCTION(Gateway_AddLink_star_2nd_addbroker_fails)
     STRICT_EXPECTED_CALL(mocks, VECTOR_push_back(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1))
         .IgnoreArgument(1)
         .IgnoreArgument(2); // Add link to links vector
+    STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 1))
+        .IgnoreArgument(1); // first link behind the "*" links
+    STRICT_EXPECTED_CALL(mocks, VECTOR_back(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
         .IgnoreArgument(1); // for each module.
     STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 0))
@@ -3365,8 +4023,6 @@ TEST_FUNCTION(Gateway_AddLink_star_2nd_addbroker_fails)
         .SetFailReturn(BROKER_ADD_LINK_ERROR);
 
     //Remove link
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreAllArguments();
     STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
         .IgnoreArgument(1); // for each module.
     STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 0))
@@ -3379,8 +4035,6 @@ TEST_FUNCTION(Gateway_AddLink_star_2nd_addbroker_fails)
         .IgnoreAllArguments();
     STRICT_EXPECTED_CALL(mocks, Broker_RemoveLink(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreAllArguments();
-    STRICT_EXPECTED_CALL(mocks, VECTOR_back(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, VECTOR_erase(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1))
         .IgnoreArgument(1)
         .IgnoreArgument(2);
@@ -3454,6 +4108,7 @@ TEST_FUNCTION(Gateway_AddLink_star_2nd_add_push_fails)
 
 //Tests_SRS_GATEWAY_17_003: [ The gateway shall treat a source of "*" as link to the sink module from every other module in gateway. ]
 //Tests_SRS_GATEWAY_17_005: [ For this link, the sink shall receive all messages publish by other modules. ]
+//Tests_SRS_GATEWAY_30_014: [ The gateway shall link a "*" source to its sink through the sink's module data kept by the link, without looking the sink up by name. ]
 TEST_FUNCTION(Gateway_AddModule_Creates_Module_with_star_links)
 {
     //Arrange
@@ -3517,20 +4172,14 @@ TEST_FUNCTION(Gateway_AddModule_Creates_Module_with_star_links)
         .IgnoreArgument(2);
     STRICT_EXPECTED_CALL(mocks, VECTOR_back(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
     // 1st broadcast link
     STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 0))
         .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreAllArguments();
     STRICT_EXPECTED_CALL(mocks, Broker_AddLink(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreAllArguments();
     // 2nd broadcast link
     STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 1))
         .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreAllArguments();
     STRICT_EXPECTED_CALL(mocks, Broker_AddLink(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreAllArguments();
     STRICT_EXPECTED_CALL(mocks, EventSystem_ReportEvent(IGNORED_PTR_ARG, gateway, GATEWAY_MODULE_LIST_CHANGED))
@@ -3548,31 +4197,30 @@ TEST_FUNCTION(Gateway_AddModule_Creates_Module_with_star_links)
     Gateway_Destroy(gateway);
 }
 
-//Tests_SRS_GATEWAY_17_003: [ The gateway shall treat a source of "*" as link to the sink module from every other module in gateway. ]
-//Tests_SRS_GATEWAY_17_005: [ For this link, the sink shall receive all messages publish by other modules. ]
-TEST_FUNCTION(Gateway_AddModule_Creates_Module_star_2nd_addLink_fails)
+//Tests_SRS_GATEWAY_30_016: [ The gateway shall keep the "*" links ahead of the other links, so that adding or removing a module visits only the "*" links. ]
+TEST_FUNCTION(Gateway_AddModule_visits_only_the_star_links)
 {
     //Arrange
     CGatewayLLMocks mocks;
 
     GATEWAY_MODULES_ENTRY dummyEntry2 = {
         "dummy module 2",
-		dummyLoaderInfo,
+        dummyLoaderInfo,
         NULL
     };
     GATEWAY_MODULES_ENTRY dummyEntry3 = {
         "dummy module 3",
-		dummyLoaderInfo,
+        dummyLoaderInfo,
         NULL
     };
 
     GATEWAY_LINK_ENTRY dummyLink1 = {
-        "*",
+        "dummy module",
         "dummy module 2"
     };
     GATEWAY_LINK_ENTRY dummyLink2 = {
         "*",
-        "dummy module"
+        "dummy module 2"
     };
 
     BASEIMPLEMENTATION::VECTOR_push_back(dummyProps->gateway_modules, &dummyEntry2, 1);
@@ -3588,17 +4236,15 @@ TEST_FUNCTION(Gateway_AddModule_Creates_Module_star_2nd_addLink_fails)
     STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
         .IgnoreArgument(1);
     EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
-    STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, DynamicModuleLoader_Load(IGNORED_PTR_ARG, dummyLoaderInfo.entrypoint))
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, DynamicModuleLoader_GetModuleApi(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreArgument(1)
         .IgnoreArgument(2);
-	STRICT_EXPECTED_CALL(mocks, DynamicModuleLoader_BuildModuleConfiguration(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-		.IgnoreAllArguments();
-	STRICT_EXPECTED_CALL(mocks, DynamicModuleLoader_FreeModuleConfiguration(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-		.IgnoreArgument(1)
+    STRICT_EXPECTED_CALL(mocks, DynamicModuleLoader_BuildModuleConfiguration(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
+    STRICT_EXPECTED_CALL(mocks, DynamicModuleLoader_FreeModuleConfiguration(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
         .IgnoreArgument(2);
     STRICT_EXPECTED_CALL(mocks, mock_Module_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreArgument(1)
@@ -3613,63 +4259,19 @@ TEST_FUNCTION(Gateway_AddModule_Creates_Module_star_2nd_addLink_fails)
         .IgnoreArgument(2);
     STRICT_EXPECTED_CALL(mocks, VECTOR_back(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
-    // 1st broadcast link
+    // the "*" link was added last but sits in front, the other link is not visited
     STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 0))
         .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreAllArguments();
-    STRICT_EXPECTED_CALL(mocks, Broker_AddLink(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreAllArguments();
-    // 2nd broadcast link
-    STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 1))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreAllArguments();
     STRICT_EXPECTED_CALL(mocks, Broker_AddLink(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreAllArguments()
-        .SetFailReturn(BROKER_ADD_LINK_ERROR);
-
-    // tear down the star link for each module
-    STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
-        .IgnoreArgument(1); // for each module.
-    STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 0))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreAllArguments();
-    STRICT_EXPECTED_CALL(mocks, Broker_RemoveLink(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreAllArguments();
-    STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 1))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreAllArguments();
-    STRICT_EXPECTED_CALL(mocks, Broker_RemoveLink(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreAllArguments();
-    // and remove the rest.
-    STRICT_EXPECTED_CALL(mocks, Broker_RemoveModule(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreArgument(1)
-        .IgnoreArgument(2)
-        .SetFailReturn(BROKER_ERROR);
-    STRICT_EXPECTED_CALL(mocks, Broker_DecRef(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, VECTOR_back(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, VECTOR_erase(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1))
-        .IgnoreArgument(1)
-        .IgnoreArgument(2);
-    EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG));
-    STRICT_EXPECTED_CALL(mocks, mock_Module_Destroy(IGNORED_PTR_ARG))
+    STRICT_EXPECTED_CALL(mocks, EventSystem_ReportEvent(IGNORED_PTR_ARG, gateway, GATEWAY_MODULE_LIST_CHANGED))
         .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, DynamicModuleLoader_Unload(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreArgument(1)
-        .IgnoreArgument(2);
 
     //Act
     MODULE_HANDLE handle = Gateway_AddModule(gateway, &dummyEntry3);
 
     //Assert
-    ASSERT_IS_NULL(handle);
+    ASSERT_IS_NOT_NULL(handle);
     mocks.AssertActualAndExpectedCalls();
 
     //Cleanup
@@ -3678,7 +4280,7 @@ TEST_FUNCTION(Gateway_AddModule_Creates_Module_star_2nd_addLink_fails)
 
 //Tests_SRS_GATEWAY_17_003: [ The gateway shall treat a source of "*" as link to the sink module from every other module in gateway. ]
 //Tests_SRS_GATEWAY_17_005: [ For this link, the sink shall receive all messages publish by other modules. ]
-TEST_FUNCTION(Gateway_AddModule_Creates_Module_star_2nd_find_fails)
+TEST_FUNCTION(Gateway_AddModule_Creates_Module_star_2nd_addLink_fails)
 {
     //Arrange
     CGatewayLLMocks mocks;
@@ -3741,43 +4343,32 @@ TEST_FUNCTION(Gateway_AddModule_Creates_Module_star_2nd_find_fails)
         .IgnoreArgument(2);
     STRICT_EXPECTED_CALL(mocks, VECTOR_back(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
     // 1st broadcast link
     STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 0))
         .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreAllArguments();
     STRICT_EXPECTED_CALL(mocks, Broker_AddLink(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreAllArguments();
     // 2nd broadcast link
     STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 1))
         .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+    STRICT_EXPECTED_CALL(mocks, Broker_AddLink(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreAllArguments()
-        .SetFailReturn(nullptr);
-
+        .SetFailReturn(BROKER_ADD_LINK_ERROR);
 
-    // tear down broadcast link.
-    STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
+    // tear down the star link for each module
     STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 0))
         .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreAllArguments();
     STRICT_EXPECTED_CALL(mocks, Broker_RemoveLink(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreAllArguments()
-        .SetFailReturn(BROKER_REMOVE_LINK_ERROR);
+        .IgnoreAllArguments();
     STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 1))
         .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreAllArguments();
     STRICT_EXPECTED_CALL(mocks, Broker_RemoveLink(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreAllArguments();
     // and remove the rest.
     STRICT_EXPECTED_CALL(mocks, Broker_RemoveModule(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreArgument(1)
-        .IgnoreArgument(2);
+        .IgnoreArgument(2)
+        .SetFailReturn(BROKER_ERROR);
     STRICT_EXPECTED_CALL(mocks, Broker_DecRef(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, VECTOR_back(IGNORED_PTR_ARG))
@@ -3849,6 +4440,10 @@ TEST_FUNCTION(Gateway_AddLink_star_success)
     STRICT_EXPECTED_CALL(mocks, VECTOR_push_back(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1))
         .IgnoreArgument(1)
         .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 1))
+        .IgnoreArgument(1); // first link behind the "*" links
+    STRICT_EXPECTED_CALL(mocks, VECTOR_back(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 0))
@@ -3975,6 +4570,10 @@ TEST_FUNCTION(Gateway_AddLink_star_failure_to_add)
     STRICT_EXPECTED_CALL(mocks, VECTOR_push_back(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1))
         .IgnoreArgument(1)
         .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 1))
+        .IgnoreArgument(1); // first link behind the "*" links
+    STRICT_EXPECTED_CALL(mocks, VECTOR_back(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 0))
@@ -3986,8 +4585,6 @@ TEST_FUNCTION(Gateway_AddLink_star_failure_to_add)
         .SetFailReturn(BROKER_ADD_LINK_ERROR);
 
     //Remove link
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreAllArguments();
     STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
         .IgnoreArgument(1); // for each module.
     STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 0))
@@ -4001,8 +4598,6 @@ TEST_FUNCTION(Gateway_AddLink_star_failure_to_add)
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, Broker_RemoveLink(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreAllArguments();
-    STRICT_EXPECTED_CALL(mocks, VECTOR_back(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, VECTOR_erase(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1))
         .IgnoreArgument(1)
         .IgnoreArgument(2);
@@ -4058,20 +4653,14 @@ TEST_FUNCTION(Gateway_RemoveModule_with_star_links)
     //Expectations
     STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, module_handle))
         .IgnoreAllArguments();
-    STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
     // 1st broadcast link
     STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 0))
         .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreAllArguments();
     STRICT_EXPECTED_CALL(mocks, Broker_RemoveLink(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreAllArguments();
     // 2nd broadcast link
     STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 1))
         .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreAllArguments();
     STRICT_EXPECTED_CALL(mocks, Broker_RemoveLink(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreAllArguments();
     // and the rest of the remove...
@@ -4147,19 +4736,15 @@ TEST_FUNCTION(Gateway_RemoveModule_with_star_links_has_errors)
     //Expectations
     STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, module_handle))
         .IgnoreAllArguments();
-    STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
     // 1st broadcast link
     STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 0))
         .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+    STRICT_EXPECTED_CALL(mocks, Broker_RemoveLink(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreAllArguments()
-        .SetFailReturn(nullptr);
+        .SetFailReturn(BROKER_REMOVE_LINK_ERROR);
     // 2nd broadcast link
     STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 1))
         .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreAllArguments();
     EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG));
     STRICT_EXPECTED_CALL(mocks, Broker_RemoveLink(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreAllArguments()
@@ -4239,8 +4824,6 @@ TEST_FUNCTION(Gateway_RemoveLink_star_link_success)
     //Expectations
     STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, &dummyLink2))
         .IgnoreAllArguments();
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, "dummy module"))
-        .IgnoreAllArguments();
     STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
     // 1st broadcast link
@@ -4428,6 +5011,8 @@ TEST_FUNCTION(Gateway_GetModuleList_Links_basic_tree)
     };
 
     GATEWAY_PROPERTIES props;
+    props.broker_config = NULL;
+    props.message_pool_config = NULL;
     props.gateway_modules = VECTOR_create(sizeof(GATEWAY_MODULES_ENTRY));
     props.gateway_links = VECTOR_create(sizeof(GATEWAY_LINK_ENTRY));
     VECTOR_push_back(props.gateway_modules, module_entries, module_count);
@@ -4498,6 +5083,8 @@ TEST_FUNCTION(Gateway_GetModuleList_links_cycle)
     };
 
     GATEWAY_PROPERTIES props;
+    props.broker_config = NULL;
+    props.message_pool_config = NULL;
     props.gateway_modules = VECTOR_create(sizeof(GATEWAY_MODULES_ENTRY));
     props.gateway_links = VECTOR_create(sizeof(GATEWAY_LINK_ENTRY));
     VECTOR_push_back(props.gateway_modules, module_entries, module_count);
@@ -4557,6 +5144,8 @@ TEST_FUNCTION(Gateway_GetModuleList_links_to_itself)
     };
 
     GATEWAY_PROPERTIES props;
+    props.broker_config = NULL;
+    props.message_pool_config = NULL;
     props.gateway_modules = VECTOR_create(sizeof(GATEWAY_MODULES_ENTRY));
     props.gateway_links = VECTOR_create(sizeof(GATEWAY_LINK_ENTRY));
     VECTOR_push_back(props.gateway_modules, module_entries, module_count);
@@ -4636,6 +5225,8 @@ TEST_FUNCTION(Gateway_GetModuleList_links_star)
     };
 
     GATEWAY_PROPERTIES props;
+    props.broker_config = NULL;
+    props.message_pool_config = NULL;
     props.gateway_modules = VECTOR_create(sizeof(GATEWAY_MODULES_ENTRY));
     props.gateway_links = VECTOR_create(sizeof(GATEWAY_LINK_ENTRY));
     VECTOR_push_back(props.gateway_modules, module_entries, module_count);
@@ -4684,6 +5275,8 @@ TEST_FUNCTION(Gateway_GetModuleList_calloc_fail)
     };
 
     GATEWAY_PROPERTIES props;
+    props.broker_config = NULL;
+    props.message_pool_config = NULL;
     props.gateway_modules = VECTOR_create(sizeof(GATEWAY_MODULES_ENTRY));
     props.gateway_links = VECTOR_create(sizeof(GATEWAY_LINK_ENTRY));
     VECTOR_push_back(props.gateway_modules, module_entries, module_count);
@@ -4733,6 +5326,8 @@ TEST_FUNCTION(Gateway_modules_sources_vector_create_fail)
     };
 
     GATEWAY_PROPERTIES props;
+    props.broker_config = NULL;
+    props.message_pool_config = NULL;
     props.gateway_modules = VECTOR_create(sizeof(GATEWAY_MODULES_ENTRY));
     props.gateway_links = VECTOR_create(sizeof(GATEWAY_LINK_ENTRY));
     VECTOR_push_back(props.gateway_modules, module_entries, module_count);
@@ -4789,6 +5384,8 @@ TEST_FUNCTION(Gateway_GetModuleList_link_push_back_fail)
     };
 
     GATEWAY_PROPERTIES props;
+    props.broker_config = NULL;
+    props.message_pool_config = NULL;
     props.gateway_modules = VECTOR_create(sizeof(GATEWAY_MODULES_ENTRY));
     props.gateway_links = VECTOR_create(sizeof(GATEWAY_LINK_ENTRY));
     VECTOR_push_back(props.gateway_modules, module_entries, module_count);
@@ -4859,6 +5456,8 @@ TEST_FUNCTION(Gateway_DestroyModuleList_basic)
     };
 
     GATEWAY_PROPERTIES props;
+    props.broker_config = NULL;
+    props.message_pool_config = NULL;
     props.gateway_modules = VECTOR_create(sizeof(GATEWAY_MODULES_ENTRY));
     props.gateway_links = VECTOR_create(sizeof(GATEWAY_LINK_ENTRY));
     VECTOR_push_back(props.gateway_modules, module_entries, module_count);
@@ -4998,7 +5597,6 @@ TEST_FUNCTION(Gateway_RemoveModuleByName_success)
     //Expect
     EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .ExpectedTimesExactly(2);
-    EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG));
     EXPECTED_CALL(mocks, Broker_RemoveModule(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
     EXPECTED_CALL(mocks, Broker_DecRef(IGNORED_PTR_ARG));
     EXPECTED_CALL(mocks, DynamicModuleLoader_GetModuleApi(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
@@ -5060,6 +5658,8 @@ TEST_FUNCTION(Gateway_RemoveModule_removes_links)
     };
 
     GATEWAY_PROPERTIES props;
+    props.broker_config = NULL;
+    props.message_pool_config = NULL;
     props.gateway_modules = VECTOR_create(sizeof(GATEWAY_MODULES_ENTRY));
     props.gateway_links = VECTOR_create(sizeof(GATEWAY_LINK_ENTRY));
     VECTOR_push_back(props.gateway_modules, modules, 3);
@@ -5185,6 +5785,8 @@ TEST_FUNCTION(Gateway_AddModule_name_is_copied)
         NULL
     };
     GATEWAY_PROPERTIES props;
+    props.broker_config = NULL;
+    props.message_pool_config = NULL;
     props.gateway_modules = VECTOR_create(sizeof(GATEWAY_MODULES_ENTRY));
     props.gateway_links = NULL;
     VECTOR_push_back(props.gateway_modules, &module, 1);
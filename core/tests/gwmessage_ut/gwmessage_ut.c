@@ -19,6 +19,7 @@ static TEST_MUTEX_HANDLE g_testByTest;
 static TEST_MUTEX_HANDLE g_dllByDll;
 
 #include "message.h"
+#include "message_pool.h"
 
 static size_t currentmalloc_call;
 static size_t whenShallmalloc_fail;
@@ -36,6 +37,15 @@ static size_t currentCONSTBUFFER_refCount;
 static size_t currentCONSTBUFFER_Clone_call;
 static size_t whenShallCONSTBUFFER_Clone_fail;
 
+static size_t currentfree_buffer_call;
+static void* lastfree_buffer_context;
+
+static void test_free_buffer(void* context)
+{
+    currentfree_buffer_call++;
+    lastfree_buffer_context = context;
+}
+
 static void* my_gballoc_malloc(size_t size)
 {
     void* result;
@@ -268,6 +278,18 @@ static const unsigned char notFail__2Property_2bytes[] =
     '3', '4'
 };
 
+/*notFail__2Property_2bytes with its properties in key order*/
+static const unsigned char notFail__2Property_2bytes_keyOrder[] =
+{
+    0xA1, 0x60,             /*header*/
+    0x00, 0x00, 0x00, 64,   /*size of this array*/
+    0x00, 0x00, 0x00, 0x02, /*two properties*/
+    'A', 'z','u','r','e',' ','I','o','T',' ','G','a','t','e','w','a','y',' ','i','s','\0','a','w','e','s','o','m','e','\0',
+    'B','l','e','e','d','i','n','g','E','d','g','e','\0','r','o','c','k','s','\0',
+    0x00, 0x00, 0x00, 0x02,  /*2 message content size*/
+    '3', '4'
+};
+
 static const unsigned char fail_____firstByteNot0xA1[] =
 {
     0xA2, 0x60,             /*header - wrong*/
@@ -333,10 +355,28 @@ static const unsigned char fail_whenThereIsOnly1ByteOfcontentSize[] =
 #define TEST_MESSAGE_HANDLE ((MESSAGE_HANDLE)4)
 #define TEST_MESSAGE_HANDLE_EMPTY ((MESSAGE_HANDLE)5)
 #define TEST_MESSAGE_HANDLE_EMPTY_PROPERTIES ((CONSTMAP_HANDLE)6)
+#define TEST_LOCK_HANDLE ((LOCK_HANDLE)7)
 
 //TEST_DEFINE_ENUM_TYPE(MAP_RESULT, MAP_RESULT_VALUES);
 IMPLEMENT_UMOCK_C_ENUM_TYPE(MAP_RESULT, MAP_RESULT_VALUES);
 IMPLEMENT_UMOCK_C_ENUM_TYPE(CONSTMAP_RESULT, CONSTMAP_RESULT_VALUES);
+IMPLEMENT_UMOCK_C_ENUM_TYPE(LOCK_RESULT, LOCK_RESULT_VALUES);
+
+static const char* pooled_keys[] = { "BleedingEdge", "Azure IoT Gateway is" };
+static const char* pooled_values[] = { "rocks", "awesome" };
+
+/*Message_Create with the pool enabled reads the properties straight from the MAP_HANDLE*/
+static void expect_pooled_message_properties(void)
+{
+    static size_t two = 2;
+    static const char* const* pkeys = (const char* const*)pooled_keys;
+    static const char* const* pvalues = (const char* const*)pooled_values;
+
+    STRICT_EXPECTED_CALL(Map_GetInternals(TEST_MAP_HANDLE, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .CopyOutArgumentBuffer(2, &pkeys, sizeof(pkeys))
+        .CopyOutArgumentBuffer(3, &pvalues, sizeof(pvalues))
+        .CopyOutArgumentBuffer(4, &two, sizeof(two));
+}
 
 BEGIN_TEST_SUITE(gwmessage_ut)
 
@@ -371,6 +411,9 @@ BEGIN_TEST_SUITE(gwmessage_ut)
         
         REGISTER_TYPE(MAP_RESULT, MAP_RESULT);
         REGISTER_TYPE(CONSTMAP_RESULT, CONSTMAP_RESULT);
+        REGISTER_TYPE(LOCK_RESULT, LOCK_RESULT);
+        REGISTER_UMOCK_ALIAS_TYPE(LOCK_HANDLE, void*);
+        REGISTER_GLOBAL_MOCK_RETURN(Lock_Init, TEST_LOCK_HANDLE);
         
         REGISTER_UMOCK_ALIAS_TYPE(const unsigned char*, void*);
         REGISTER_UMOCK_ALIAS_TYPE(const char* const*, void*);
@@ -407,6 +450,8 @@ BEGIN_TEST_SUITE(gwmessage_ut)
         currentCONSTBUFFER_refCount = 0;
         currentCONSTBUFFER_Clone_call = 0;
         whenShallCONSTBUFFER_Clone_fail = 0;
+        currentfree_buffer_call = 0;
+        lastfree_buffer_context = NULL;
 
     }
 
@@ -2149,4 +2194,641 @@ BEGIN_TEST_SUITE(gwmessage_ut)
         Message_Destroy(messageHandle);
     }
 
+    /*Tests_SRS_MESSAGE_30_005: [ Message_ToByteArray shall compute the needed memory size only once per message and remember it. ]*/
+    /*Tests_SRS_MESSAGE_30_006: [ Once the needed memory size is known, Message_ToByteArray shall return it without looking at the properties and content again. ]*/
+    TEST_FUNCTION(Message_ToByteArray_returns_cached_size_the_second_time)
+    {
+        ///arrange
+        STRICT_EXPECTED_CALL(Map_Create(IGNORED_PTR_ARG))
+            .IgnoreArgument_mapFilterFunc()
+            .SetReturn(TEST_MAP_HANDLE);
+        EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
+            .IgnoreAllCalls();
+        STRICT_EXPECTED_CALL(CONSTBUFFER_Create(IGNORED_PTR_ARG, 0))
+            .IgnoreArgument_source();
+        STRICT_EXPECTED_CALL(ConstMap_Create(TEST_MAP_HANDLE));
+        STRICT_EXPECTED_CALL(Map_Destroy(TEST_MAP_HANDLE));
+
+        MESSAGE_HANDLE messageHandle = Message_CreateFromByteArray(notFail____minimalMessage, sizeof(notFail____minimalMessage));
+
+        size_t zero = 0;
+        const CONSTBUFFER bufferContent = { NULL, 0 };
+
+        STRICT_EXPECTED_CALL(ConstMap_GetInternals(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .IgnoreArgument_handle()
+            .IgnoreArgument_keys()
+            .IgnoreArgument_values()
+            .CopyOutArgumentBuffer(4, &zero, sizeof(zero));
+        STRICT_EXPECTED_CALL(CONSTBUFFER_GetContent(IGNORED_PTR_ARG))
+            .IgnoreArgument_constbufferHandle()
+            .SetReturn(&bufferContent);
+
+        (void)Message_ToByteArray(messageHandle, NULL, 0);
+        umock_c_reset_all_calls();
+
+        ///act
+        int32_t nbytes = Message_ToByteArray(messageHandle, NULL, 0);
+
+        ///assert
+        ASSERT_ARE_EQUAL(int32_t, sizeof(notFail____minimalMessage), nbytes);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        ///cleanup
+        Message_Destroy(messageHandle);
+    }
+
+    /*Tests_SRS_MESSAGE_30_001: [ If source is NULL or size is smaller than 14 then Message_CreateFromByteArrayNoCopy shall fail and return NULL. ]*/
+    /*Tests_SRS_MESSAGE_30_004: [ If Message_CreateFromByteArrayNoCopy fails, it shall not call free_buffer. ]*/
+    TEST_FUNCTION(Message_CreateFromByteArrayNoCopy_with_NULL_source_fails)
+    {
+        ///arrange
+
+        ///act
+        MESSAGE_HANDLE handle = Message_CreateFromByteArrayNoCopy(NULL, sizeof(notFail____minimalMessage), test_free_buffer, NULL);
+
+        ///assert
+        ASSERT_IS_NULL(handle);
+        ASSERT_ARE_EQUAL(size_t, 0, currentfree_buffer_call);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    }
+
+    /*Tests_SRS_MESSAGE_30_001: [ If source is NULL or size is smaller than 14 then Message_CreateFromByteArrayNoCopy shall fail and return NULL. ]*/
+    TEST_FUNCTION(Message_CreateFromByteArrayNoCopy_with_size_too_small_fails)
+    {
+        ///arrange
+
+        ///act
+        MESSAGE_HANDLE handle = Message_CreateFromByteArrayNoCopy(notFail____minimalMessage, sizeof(notFail____minimalMessage) - 1, test_free_buffer, NULL);
+
+        ///assert
+        ASSERT_IS_NULL(handle);
+        ASSERT_ARE_EQUAL(size_t, 0, currentfree_buffer_call);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    }
+
+    /*Tests_SRS_MESSAGE_30_002: [ Message_CreateFromByteArrayNoCopy shall validate source the same way Message_CreateFromByteArray does, without allocating memory, and shall fail and return NULL if it is not a valid serialization. ]*/
+    TEST_FUNCTION(Message_CreateFromByteArrayNoCopy_when_first_byte_is_not_0xA1_fails)
+    {
+        ///arrange
+
+        ///act
+        MESSAGE_HANDLE handle = Message_CreateFromByteArrayNoCopy(fail_____firstByteNot0xA1, sizeof(fail_____firstByteNot0xA1), test_free_buffer, NULL);
+
+        ///assert
+        ASSERT_IS_NULL(handle);
+        ASSERT_ARE_EQUAL(size_t, 0, currentfree_buffer_call);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    }
+
+    /*Tests_SRS_MESSAGE_30_002: [ Message_CreateFromByteArrayNoCopy shall validate source the same way Message_CreateFromByteArray does, without allocating memory, and shall fail and return NULL if it is not a valid serialization. ]*/
+    TEST_FUNCTION(Message_CreateFromByteArrayNoCopy_with_1_property_when_1st_property_value_doesnt_end_fails)
+    {
+        ///arrange
+
+        ///act
+        MESSAGE_HANDLE handle = Message_CreateFromByteArrayNoCopy(fail_firstPropertyValueDoesNotEnd, sizeof(fail_firstPropertyValueDoesNotEnd), test_free_buffer, NULL);
+
+        ///assert
+        ASSERT_IS_NULL(handle);
+        ASSERT_ARE_EQUAL(size_t, 0, currentfree_buffer_call);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    }
+
+    /*Tests_SRS_MESSAGE_30_002: [ Message_CreateFromByteArrayNoCopy shall validate source the same way Message_CreateFromByteArray does, without allocating memory, and shall fail and return NULL if it is not a valid serialization. ]*/
+    TEST_FUNCTION(Message_CreateFromByteArrayNoCopy_with_1_byte_of_content_size_fails)
+    {
+        ///arrange
+
+        ///act
+        MESSAGE_HANDLE handle = Message_CreateFromByteArrayNoCopy(fail_whenThereIsOnly1ByteOfcontentSize, sizeof(fail_whenThereIsOnly1ByteOfcontentSize), test_free_buffer, NULL);
+
+        ///assert
+        ASSERT_IS_NULL(handle);
+        ASSERT_ARE_EQUAL(size_t, 0, currentfree_buffer_call);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    }
+
+    /*Tests_SRS_MESSAGE_30_003: [ Message_CreateFromByteArrayNoCopy shall allocate the message and set its internal ref count to "1", it shall not copy the properties nor the content. ]*/
+    /*Tests_SRS_MESSAGE_30_010: [ If message wraps a byte array, Message_GetContent shall return a CONSTBUFFER pointing into the byte array. ]*/
+    TEST_FUNCTION(Message_CreateFromByteArrayNoCopy_notFail__2Property_2bytes)
+    {
+        ///arrange
+        STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
+            .IgnoreArgument(1);
+
+        ///act
+        MESSAGE_HANDLE handle = Message_CreateFromByteArrayNoCopy(notFail__2Property_2bytes, sizeof(notFail__2Property_2bytes), test_free_buffer, (void*)notFail__2Property_2bytes);
+        const CONSTBUFFER* content = Message_GetContent(handle);
+
+        ///assert
+        ASSERT_IS_NOT_NULL(handle);
+        ASSERT_IS_NOT_NULL(content);
+        ASSERT_ARE_EQUAL(size_t, 2, content->size);
+        ASSERT_ARE_EQUAL(void_ptr, (void*)(notFail__2Property_2bytes + sizeof(notFail__2Property_2bytes) - 2), (void*)content->buffer);
+        ASSERT_ARE_EQUAL(size_t, 0, currentfree_buffer_call);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        ///cleanup
+        Message_Destroy(handle);
+    }
+
+    /*Tests_SRS_MESSAGE_30_004: [ If Message_CreateFromByteArrayNoCopy fails, it shall not call free_buffer. ]*/
+    TEST_FUNCTION(Message_CreateFromByteArrayNoCopy_fails_when_malloc_fails)
+    {
+        ///arrange
+        whenShallmalloc_fail = 1;
+        STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
+            .IgnoreArgument(1);
+
+        ///act
+        MESSAGE_HANDLE handle = Message_CreateFromByteArrayNoCopy(notFail__2Property_2bytes, sizeof(notFail__2Property_2bytes), test_free_buffer, NULL);
+
+        ///assert
+        ASSERT_IS_NULL(handle);
+        ASSERT_ARE_EQUAL(size_t, 0, currentfree_buffer_call);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    }
+
+    /*Tests_SRS_MESSAGE_30_008: [ If message wraps a byte array, Message_Clone shall only increment the internal ref count. ]*/
+    /*Tests_SRS_MESSAGE_30_013: [ If message wraps a byte array, Message_Destroy shall destroy the properties and content handles created for it, if any, and shall call free_buffer with free_context. ]*/
+    TEST_FUNCTION(Message_Destroy_on_wrapped_message_calls_free_buffer_on_last_reference)
+    {
+        ///arrange
+        MESSAGE_HANDLE handle = Message_CreateFromByteArrayNoCopy(notFail__2Property_2bytes, sizeof(notFail__2Property_2bytes), test_free_buffer, (void*)notFail__2Property_2bytes);
+        MESSAGE_HANDLE clone = Message_Clone(handle);
+        umock_c_reset_all_calls();
+
+        STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+
+        ///act
+        Message_Destroy(clone);
+        size_t callsAfterFirstDestroy = currentfree_buffer_call;
+        Message_Destroy(handle);
+
+        ///assert
+        ASSERT_ARE_EQUAL(void_ptr, handle, clone);
+        ASSERT_ARE_EQUAL(size_t, 0, callsAfterFirstDestroy);
+        ASSERT_ARE_EQUAL(size_t, 1, currentfree_buffer_call);
+        ASSERT_ARE_EQUAL(void_ptr, (void*)notFail__2Property_2bytes, lastfree_buffer_context);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    }
+
+    /*Tests_SRS_MESSAGE_30_009: [ If message wraps a byte array, the first call to Message_GetProperties shall build a CONSTMAP out of the properties in the byte array and keep it for the lifetime of the message. ]*/
+    TEST_FUNCTION(Message_GetProperties_on_wrapped_message_builds_the_properties_once)
+    {
+        ///arrange
+        MESSAGE_HANDLE handle = Message_CreateFromByteArrayNoCopy(notFail__2Property_2bytes, sizeof(notFail__2Property_2bytes), test_free_buffer, NULL);
+        umock_c_reset_all_calls();
+
+        STRICT_EXPECTED_CALL(Map_Create(IGNORED_PTR_ARG))
+            .IgnoreArgument_mapFilterFunc()
+            .SetReturn(TEST_MAP_HANDLE);
+        STRICT_EXPECTED_CALL(Map_Add(TEST_MAP_HANDLE, "BleedingEdge", "rocks"));
+        STRICT_EXPECTED_CALL(Map_Add(TEST_MAP_HANDLE, "Azure IoT Gateway is", "awesome"));
+        STRICT_EXPECTED_CALL(ConstMap_Create(TEST_MAP_HANDLE));
+        STRICT_EXPECTED_CALL(Map_Destroy(TEST_MAP_HANDLE));
+        STRICT_EXPECTED_CALL(ConstMap_Clone(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(ConstMap_Clone(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+
+        ///act
+        CONSTMAP_HANDLE first = Message_GetProperties(handle);
+        CONSTMAP_HANDLE second = Message_GetProperties(handle);
+
+        ///assert
+        ASSERT_IS_NOT_NULL(first);
+        ASSERT_ARE_EQUAL(void_ptr, first, second);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        ///cleanup
+        ConstMap_Destroy(first);
+        ConstMap_Destroy(second);
+        Message_Destroy(handle);
+    }
+
+    /*Tests_SRS_MESSAGE_30_007: [ If building the properties fails, Message_GetProperties shall return NULL. ]*/
+    TEST_FUNCTION(Message_GetProperties_on_wrapped_message_fails_when_Map_Add_fails)
+    {
+        ///arrange
+        MESSAGE_HANDLE handle = Message_CreateFromByteArrayNoCopy(notFail__2Property_2bytes, sizeof(notFail__2Property_2bytes), test_free_buffer, NULL);
+        umock_c_reset_all_calls();
+
+        STRICT_EXPECTED_CALL(Map_Create(IGNORED_PTR_ARG))
+            .IgnoreArgument_mapFilterFunc()
+            .SetReturn(TEST_MAP_HANDLE);
+        STRICT_EXPECTED_CALL(Map_Add(TEST_MAP_HANDLE, "BleedingEdge", "rocks"))
+            .SetReturn(MAP_ERROR);
+        STRICT_EXPECTED_CALL(Map_Destroy(TEST_MAP_HANDLE));
+
+        ///act
+        CONSTMAP_HANDLE properties = Message_GetProperties(handle);
+
+        ///assert
+        ASSERT_IS_NULL(properties);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        ///cleanup
+        Message_Destroy(handle);
+    }
+
+    /*Tests_SRS_MESSAGE_30_011: [ If message wraps a byte array, the first call to Message_GetContentHandle shall create a CONSTBUFFER from the content in the byte array and keep it for the lifetime of the message. ]*/
+    TEST_FUNCTION(Message_GetContentHandle_on_wrapped_message_creates_the_handle_once)
+    {
+        ///arrange
+        MESSAGE_HANDLE handle = Message_CreateFromByteArrayNoCopy(notFail__2Property_2bytes, sizeof(notFail__2Property_2bytes), test_free_buffer, NULL);
+        umock_c_reset_all_calls();
+
+        STRICT_EXPECTED_CALL(CONSTBUFFER_Create(IGNORED_PTR_ARG, 2))
+            .ValidateArgumentBuffer(1, "34", 2);
+        STRICT_EXPECTED_CALL(CONSTBUFFER_Clone(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(CONSTBUFFER_Clone(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+
+        ///act
+        CONSTBUFFER_HANDLE first = Message_GetContentHandle(handle);
+        CONSTBUFFER_HANDLE second = Message_GetContentHandle(handle);
+
+        ///assert
+        ASSERT_IS_NOT_NULL(first);
+        ASSERT_ARE_EQUAL(void_ptr, first, second);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        ///cleanup
+        CONSTBUFFER_Destroy(first);
+        CONSTBUFFER_Destroy(second);
+        Message_Destroy(handle);
+    }
+
+    /*Tests_SRS_MESSAGE_30_012: [ If messageHandle wraps a byte array, Message_ToByteArray shall copy the byte array as is. ]*/
+    TEST_FUNCTION(Message_ToByteArray_on_wrapped_message_copies_the_byte_array)
+    {
+        ///arrange
+        unsigned char buf[sizeof(notFail__2Property_2bytes)];
+        MESSAGE_HANDLE handle = Message_CreateFromByteArrayNoCopy(notFail__2Property_2bytes, sizeof(notFail__2Property_2bytes), test_free_buffer, NULL);
+        umock_c_reset_all_calls();
+
+        ///act
+        int32_t size = Message_ToByteArray(handle, NULL, 0);
+        int32_t nbytes = Message_ToByteArray(handle, buf, sizeof(buf));
+        int32_t tooSmall = Message_ToByteArray(handle, buf, sizeof(buf) - 1);
+
+        ///assert
+        ASSERT_ARE_EQUAL(int32_t, sizeof(notFail__2Property_2bytes), size);
+        ASSERT_ARE_EQUAL(int32_t, sizeof(notFail__2Property_2bytes), nbytes);
+        ASSERT_ARE_EQUAL(int, 0, memcmp(buf, notFail__2Property_2bytes, sizeof(buf)));
+        ASSERT_IS_TRUE(tooSmall < 0);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        ///cleanup
+        Message_Destroy(handle);
+    }
+
+    /*Tests_SRS_MESSAGE_30_015: [ If the message pool is enabled, Message_Create shall allocate the message, its properties and its content in a single block from the pool. ]*/
+    /*Tests_SRS_MESSAGE_30_031: [ If messageHandle is compact, Message_ToByteArray shall serialize its properties in key order, followed by its content. ]*/
+    TEST_FUNCTION(Message_Create_with_the_pool_enabled_builds_the_message_in_a_pooled_block)
+    {
+        ///arrange
+        MESSAGE_POOL_CONFIG poolConfig = { 0, 0 };
+        MESSAGE_CONFIG c = { 2, (const unsigned char*)"34", TEST_MAP_HANDLE };
+        unsigned char buf[sizeof(notFail__2Property_2bytes)];
+        ASSERT_ARE_EQUAL(int, 0, MessagePool_Enable(&poolConfig));
+
+        /*the first message takes its block from malloc, the next ones reuse it*/
+        expect_pooled_message_properties();
+        Message_Destroy(Message_Create(&c));
+        umock_c_reset_all_calls();
+
+        expect_pooled_message_properties();
+
+        ///act
+        MESSAGE_HANDLE handle = Message_Create(&c);
+        const CONSTBUFFER* content = Message_GetContent(handle);
+        int32_t nbytes = Message_ToByteArray(handle, buf, sizeof(buf));
+        Message_Destroy(handle);
+
+        ///assert
+        ASSERT_IS_NOT_NULL(handle);
+        ASSERT_IS_NOT_NULL(content);
+        ASSERT_ARE_EQUAL(size_t, 2, content->size);
+        ASSERT_ARE_EQUAL(int, 0, memcmp(content->buffer, "34", 2));
+        ASSERT_ARE_EQUAL(int32_t, sizeof(notFail__2Property_2bytes_keyOrder), nbytes);
+        ASSERT_ARE_EQUAL(int, 0, memcmp(buf, notFail__2Property_2bytes_keyOrder, sizeof(buf)));
+        /*no malloc, no CONSTBUFFER and no CONSTMAP*/
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        ///cleanup
+        MessagePool_Disable();
+    }
+
+    /*Tests_SRS_MESSAGE_30_016: [ If any step fails, Message_Create shall fail and return NULL. ]*/
+    TEST_FUNCTION(Message_Create_with_the_pool_enabled_fails_when_Map_GetInternals_fails)
+    {
+        ///arrange
+        MESSAGE_POOL_CONFIG poolConfig = { 0, 0 };
+        MESSAGE_CONFIG c = { 2, (const unsigned char*)"34", TEST_MAP_HANDLE };
+        ASSERT_ARE_EQUAL(int, 0, MessagePool_Enable(&poolConfig));
+        umock_c_reset_all_calls();
+
+        STRICT_EXPECTED_CALL(Map_GetInternals(TEST_MAP_HANDLE, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .SetReturn(MAP_ERROR);
+
+        ///act
+        MESSAGE_HANDLE handle = Message_Create(&c);
+
+        ///assert
+        ASSERT_IS_NULL(handle);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        ///cleanup
+        MessagePool_Disable();
+    }
+
+    /*Tests_SRS_MESSAGE_30_017: [ If the message pool is enabled, Message_CreateFromByteArray shall copy source as is in a single block from the pool, right behind the message, and the message shall wrap that copy. ]*/
+    TEST_FUNCTION(Message_CreateFromByteArray_with_the_pool_enabled_copies_the_byte_array_in_a_pooled_block)
+    {
+        ///arrange
+        MESSAGE_POOL_CONFIG poolConfig = { 0, 0 };
+        unsigned char buf[sizeof(notFail__2Property_2bytes)];
+        ASSERT_ARE_EQUAL(int, 0, MessagePool_Enable(&poolConfig));
+        Message_Destroy(Message_CreateFromByteArray(notFail__2Property_2bytes, sizeof(notFail__2Property_2bytes)));
+        umock_c_reset_all_calls();
+
+        ///act
+        MESSAGE_HANDLE handle = Message_CreateFromByteArray(notFail__2Property_2bytes, sizeof(notFail__2Property_2bytes));
+        const CONSTBUFFER* content = Message_GetContent(handle);
+        int32_t nbytes = Message_ToByteArray(handle, buf, sizeof(buf));
+
+        ///assert
+        ASSERT_IS_NOT_NULL(handle);
+        ASSERT_ARE_EQUAL(size_t, 2, content->size);
+        ASSERT_ARE_EQUAL(int, 0, memcmp(content->buffer, "34", 2));
+        /*the content is a copy, not a view into the source*/
+        ASSERT_IS_TRUE(content->buffer != notFail__2Property_2bytes + sizeof(notFail__2Property_2bytes) - 2);
+        ASSERT_ARE_EQUAL(int32_t, sizeof(notFail__2Property_2bytes), nbytes);
+        ASSERT_ARE_EQUAL(int, 0, memcmp(buf, notFail__2Property_2bytes, sizeof(buf)));
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        ///cleanup
+        Message_Destroy(handle);
+        MessagePool_Disable();
+    }
+
+    /*Tests_SRS_MESSAGE_30_017: [ If the message pool is enabled, Message_CreateFromByteArray shall copy source as is in a single block from the pool, right behind the message, and the message shall wrap that copy. ]*/
+    TEST_FUNCTION(Message_CreateFromByteArray_with_the_pool_enabled_fails_on_an_invalid_byte_array)
+    {
+        ///arrange
+        MESSAGE_POOL_CONFIG poolConfig = { 0, 0 };
+        ASSERT_ARE_EQUAL(int, 0, MessagePool_Enable(&poolConfig));
+        umock_c_reset_all_calls();
+
+        ///act
+        MESSAGE_HANDLE handle = Message_CreateFromByteArray(fail_____firstByteNot0xA1, sizeof(fail_____firstByteNot0xA1));
+
+        ///assert
+        ASSERT_IS_NULL(handle);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        ///cleanup
+        MessagePool_Disable();
+    }
+
+    /*Tests_SRS_MESSAGE_30_019: [ Message_Create shall keep the properties sorted by key. ]*/
+    /*Tests_SRS_MESSAGE_30_023: [ If message is compact, the first call to Message_GetProperties shall build a CONSTMAP out of its properties and keep it for the lifetime of the message. ]*/
+    TEST_FUNCTION(Message_GetProperties_on_compact_message_builds_the_properties_once_in_key_order)
+    {
+        ///arrange
+        MESSAGE_POOL_CONFIG poolConfig = { 0, 0 };
+        MESSAGE_CONFIG c = { 2, (const unsigned char*)"34", TEST_MAP_HANDLE };
+        ASSERT_ARE_EQUAL(int, 0, MessagePool_Enable(&poolConfig));
+        expect_pooled_message_properties();
+        MESSAGE_HANDLE handle = Message_Create(&c);
+        umock_c_reset_all_calls();
+
+        STRICT_EXPECTED_CALL(Map_Create(IGNORED_PTR_ARG))
+            .IgnoreArgument_mapFilterFunc()
+            .SetReturn(TEST_MAP_HANDLE);
+        STRICT_EXPECTED_CALL(Map_Add(TEST_MAP_HANDLE, "Azure IoT Gateway is", "awesome"));
+        STRICT_EXPECTED_CALL(Map_Add(TEST_MAP_HANDLE, "BleedingEdge", "rocks"));
+        STRICT_EXPECTED_CALL(ConstMap_Create(TEST_MAP_HANDLE));
+        STRICT_EXPECTED_CALL(Map_Destroy(TEST_MAP_HANDLE));
+        STRICT_EXPECTED_CALL(ConstMap_Clone(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(ConstMap_Clone(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+
+        ///act
+        CONSTMAP_HANDLE first = Message_GetProperties(handle);
+        CONSTMAP_HANDLE second = Message_GetProperties(handle);
+
+        ///assert
+        ASSERT_IS_NOT_NULL(first);
+        ASSERT_ARE_EQUAL(void_ptr, first, second);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        ///cleanup
+        ConstMap_Destroy(first);
+        ConstMap_Destroy(second);
+        Message_Destroy(handle);
+        MessagePool_Disable();
+    }
+
+    /*Tests_SRS_MESSAGE_30_020: [ If message is compact, Message_Clone shall only increment the internal ref count. ]*/
+    /*Tests_SRS_MESSAGE_30_022: [ If message is compact, Message_Destroy shall destroy the properties and content handles created for it, if any. ]*/
+    TEST_FUNCTION(Message_Destroy_on_compact_message_destroys_the_handles_created_for_it)
+    {
+        ///arrange
+        MESSAGE_POOL_CONFIG poolConfig = { 0, 0 };
+        MESSAGE_CONFIG c = { 2, (const unsigned char*)"34", TEST_MAP_HANDLE };
+        ASSERT_ARE_EQUAL(int, 0, MessagePool_Enable(&poolConfig));
+        expect_pooled_message_properties();
+        MESSAGE_HANDLE handle = Message_Create(&c);
+        CONSTBUFFER_HANDLE content = Message_GetContentHandle(handle);
+        CONSTBUFFER_Destroy(content);
+        umock_c_reset_all_calls();
+
+        STRICT_EXPECTED_CALL(CONSTBUFFER_Destroy(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+
+        ///act
+        MESSAGE_HANDLE clone = Message_Clone(handle);
+        Message_Destroy(clone);
+        size_t refCountAfterFirstDestroy = currentCONSTBUFFER_refCount;
+        Message_Destroy(handle);
+
+        ///assert
+        ASSERT_ARE_EQUAL(void_ptr, handle, clone);
+        ASSERT_ARE_EQUAL(size_t, 1, refCountAfterFirstDestroy);
+        ASSERT_ARE_EQUAL(size_t, 0, currentCONSTBUFFER_refCount);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        ///cleanup
+        MessagePool_Disable();
+    }
+
+    /*Tests_SRS_MESSAGE_30_024: [ If message or key is NULL, Message_GetProperty shall return NULL. ]*/
+    TEST_FUNCTION(Message_GetProperty_with_NULL_message_returns_NULL)
+    {
+        ///arrange
+
+        ///act
+        const char* value = Message_GetProperty(NULL, "BleedingEdge");
+
+        ///assert
+        ASSERT_IS_NULL(value);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    }
+
+    /*Tests_SRS_MESSAGE_30_024: [ If message or key is NULL, Message_GetProperty shall return NULL. ]*/
+    TEST_FUNCTION(Message_GetProperty_with_NULL_key_returns_NULL)
+    {
+        ///arrange
+        MESSAGE_HANDLE handle = Message_CreateFromByteArrayNoCopy(notFail__2Property_2bytes, sizeof(notFail__2Property_2bytes), NULL, NULL);
+        umock_c_reset_all_calls();
+
+        ///act
+        const char* value = Message_GetProperty(handle, NULL);
+
+        ///assert
+        ASSERT_IS_NULL(value);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        ///cleanup
+        Message_Destroy(handle);
+    }
+
+    /*Tests_SRS_MESSAGE_30_025: [ Message_GetProperty shall return the value of the property called key, or NULL if the message has no such property. ]*/
+    /*Tests_SRS_MESSAGE_30_027: [ Unless message is compact, the first call to Message_GetProperty shall build a sorted index of the properties of the message and keep it for the lifetime of the message. ]*/
+    TEST_FUNCTION(Message_GetProperty_on_wrapped_message_indexes_the_properties_once)
+    {
+        ///arrange
+        MESSAGE_HANDLE handle = Message_CreateFromByteArrayNoCopy(notFail__2Property_2bytes, sizeof(notFail__2Property_2bytes), NULL, NULL);
+        umock_c_reset_all_calls();
+
+        STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
+            .IgnoreArgument(1);
+
+        ///act
+        const char* rocks = Message_GetProperty(handle, "BleedingEdge");
+        const char* awesome = Message_GetProperty(handle, "Azure IoT Gateway is");
+        const char* missing = Message_GetProperty(handle, "Bleeding");
+
+        ///assert
+        ASSERT_ARE_EQUAL(char_ptr, "rocks", rocks);
+        ASSERT_ARE_EQUAL(char_ptr, "awesome", awesome);
+        ASSERT_IS_NULL(missing);
+        /*the values are not copied*/
+        ASSERT_IS_TRUE((const unsigned char*)rocks > notFail__2Property_2bytes);
+        ASSERT_IS_TRUE((const unsigned char*)rocks < notFail__2Property_2bytes + sizeof(notFail__2Property_2bytes));
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        ///cleanup
+        Message_Destroy(handle);
+    }
+
+    /*Tests_SRS_MESSAGE_30_029: [ If building the index fails, Message_GetProperty shall return NULL. ]*/
+    TEST_FUNCTION(Message_GetProperty_fails_when_the_index_cannot_be_allocated)
+    {
+        ///arrange
+        MESSAGE_HANDLE handle = Message_CreateFromByteArrayNoCopy(notFail__2Property_2bytes, sizeof(notFail__2Property_2bytes), NULL, NULL);
+        umock_c_reset_all_calls();
+        whenShallmalloc_fail = currentmalloc_call + 1;
+
+        STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
+            .IgnoreArgument(1);
+
+        ///act
+        const char* value = Message_GetProperty(handle, "BleedingEdge");
+
+        ///assert
+        ASSERT_IS_NULL(value);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        ///cleanup
+        Message_Destroy(handle);
+    }
+
+    /*Tests_SRS_MESSAGE_30_025: [ Message_GetProperty shall return the value of the property called key, or NULL if the message has no such property. ]*/
+    /*Tests_SRS_MESSAGE_30_026: [ Message_Destroy shall free the property index built for the message, if any. ]*/
+    TEST_FUNCTION(Message_GetProperty_on_message_with_handles_indexes_the_constmap)
+    {
+        ///arrange
+        MESSAGE_CONFIG c = { 2, (const unsigned char*)"34", TEST_MAP_HANDLE };
+        size_t two = 2;
+        const char* const* pkeys = (const char* const*)pooled_keys;
+        const char* const* pvalues = (const char* const*)pooled_values;
+        MESSAGE_HANDLE handle = Message_Create(&c);
+        umock_c_reset_all_calls();
+
+        STRICT_EXPECTED_CALL(ConstMap_GetInternals(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .IgnoreArgument_handle()
+            .CopyOutArgumentBuffer(2, &pkeys, sizeof(pkeys))
+            .CopyOutArgumentBuffer(3, &pvalues, sizeof(pvalues))
+            .CopyOutArgumentBuffer(4, &two, sizeof(two));
+        STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(ConstMap_Destroy(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(CONSTBUFFER_Destroy(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+
+        ///act
+        const char* awesome = Message_GetProperty(handle, "Azure IoT Gateway is");
+        const char* rocks = Message_GetProperty(handle, "BleedingEdge");
+        Message_Destroy(handle);
+
+        ///assert
+        ASSERT_ARE_EQUAL(void_ptr, (void*)pooled_values[1], (void*)awesome);
+        ASSERT_ARE_EQUAL(void_ptr, (void*)pooled_values[0], (void*)rocks);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    }
+
+    /*Tests_SRS_MESSAGE_30_018: [ Message_Create shall not copy the keys that are interned, the properties shall refer to the interned keys instead. ]*/
+    /*Tests_SRS_MESSAGE_30_030: [ Message_GetProperty shall binary search the index, comparing key to the keys of the index by pointer before comparing the strings. ]*/
+    TEST_FUNCTION(Message_GetProperty_on_compact_message_finds_interned_and_other_keys)
+    {
+        ///arrange
+        MESSAGE_POOL_CONFIG poolConfig = { 0, 0 };
+        MESSAGE_CONFIG c = { 0, NULL, TEST_MAP_HANDLE };
+        size_t three = 3;
+        static const char* keys[] = { "timestamp", "source", "custom" };
+        static const char* values[] = { "now", "mapping", "value" };
+        const char* const* pkeys = (const char* const*)keys;
+        const char* const* pvalues = (const char* const*)values;
+        ASSERT_ARE_EQUAL(int, 0, MessagePool_Enable(&poolConfig));
+
+        STRICT_EXPECTED_CALL(Map_GetInternals(TEST_MAP_HANDLE, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .CopyOutArgumentBuffer(2, &pkeys, sizeof(pkeys))
+            .CopyOutArgumentBuffer(3, &pvalues, sizeof(pvalues))
+            .CopyOutArgumentBuffer(4, &three, sizeof(three));
+        MESSAGE_HANDLE handle = Message_Create(&c);
+        umock_c_reset_all_calls();
+
+        ///act
+        const char* source = Message_GetProperty(handle, PropertyKey_Find("source"));
+        const char* timestamp = Message_GetProperty(handle, "timestamp");
+        const char* custom = Message_GetProperty(handle, "custom");
+        const char* missing = Message_GetProperty(handle, "deviceName");
+
+        ///assert
+        ASSERT_ARE_EQUAL(char_ptr, "mapping", source);
+        ASSERT_ARE_EQUAL(char_ptr, "now", timestamp);
+        ASSERT_ARE_EQUAL(char_ptr, "value", custom);
+        ASSERT_IS_NULL(missing);
+        /*values are copies*/
+        ASSERT_ARE_NOT_EQUAL(void_ptr, (void*)values[1], (void*)source);
+        /*no index to build*/
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        ///cleanup
+        Message_Destroy(handle);
+        MessagePool_Disable();
+    }
+
 END_TEST_SUITE(gwmessage_ut)
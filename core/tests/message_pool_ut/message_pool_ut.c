@@ -0,0 +1,384 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <stdlib.h>
+#include <stddef.h>
+#include "testrunnerswitcher.h"
+#include "umock_c.h"
+#include "umocktypes_charptr.h"
+
+#define ENABLE_MOCKS
+#include "azure_c_shared_utility/lock.h"
+#include "azure_c_shared_utility/gballoc.h"
+#undef ENABLE_MOCKS
+
+#include "azure_c_shared_utility/threadapi.h"
+#include "message_pool.h"
+
+static TEST_MUTEX_HANDLE g_testByTest;
+static TEST_MUTEX_HANDLE g_dllByDll;
+
+#define TEST_LOCK_HANDLE ((LOCK_HANDLE)1)
+
+static size_t currentmalloc_call;
+static size_t currentfree_call;
+
+static void* my_gballoc_malloc(size_t size)
+{
+    currentmalloc_call++;
+    return malloc(size);
+}
+
+static void my_gballoc_free(void* ptr)
+{
+    currentfree_call++;
+    free(ptr);
+}
+
+static void on_umock_c_error(UMOCK_C_ERROR_CODE error_code)
+{
+    ASSERT_FAIL("umock_c reported error");
+}
+
+IMPLEMENT_UMOCK_C_ENUM_TYPE(LOCK_RESULT, LOCK_RESULT_VALUES);
+
+static void enable_pool(size_t thread_cache_size, size_t depot_size)
+{
+    MESSAGE_POOL_CONFIG config = { thread_cache_size, depot_size };
+    ASSERT_ARE_EQUAL(int, 0, MessagePool_Enable(&config));
+}
+
+static int allocate_and_free_a_block(void* arg)
+{
+    (void)arg;
+    MessagePool_Free(MessagePool_Allocate(100));
+    return 0;
+}
+
+static MESSAGE_POOL_STATISTICS get_statistics(void)
+{
+    MESSAGE_POOL_STATISTICS statistics;
+    ASSERT_ARE_EQUAL(int, 0, MessagePool_GetStatistics(&statistics));
+    return statistics;
+}
+
+BEGIN_TEST_SUITE(message_pool_ut)
+
+    TEST_SUITE_INITIALIZE(TestClassInitialize)
+    {
+        TEST_INITIALIZE_MEMORY_DEBUG(g_dllByDll);
+        g_testByTest = TEST_MUTEX_CREATE();
+        ASSERT_IS_NOT_NULL(g_testByTest);
+
+        umock_c_init(on_umock_c_error);
+
+        int result = umocktypes_charptr_register_types();
+        ASSERT_ARE_EQUAL(int, 0, result);
+
+        REGISTER_GLOBAL_MOCK_HOOK(gballoc_malloc, my_gballoc_malloc);
+        REGISTER_GLOBAL_MOCK_HOOK(gballoc_free, my_gballoc_free);
+
+        REGISTER_TYPE(LOCK_RESULT, LOCK_RESULT);
+        REGISTER_UMOCK_ALIAS_TYPE(LOCK_HANDLE, void*);
+        REGISTER_GLOBAL_MOCK_RETURN(Lock_Init, TEST_LOCK_HANDLE);
+    }
+
+    TEST_SUITE_CLEANUP(TestClassCleanup)
+    {
+        TEST_MUTEX_DESTROY(g_testByTest);
+        umock_c_deinit();
+        TEST_DEINITIALIZE_MEMORY_DEBUG(g_dllByDll);
+    }
+
+    TEST_FUNCTION_INITIALIZE(TestMethodInitialize)
+    {
+        if (TEST_MUTEX_ACQUIRE(g_testByTest) != 0)
+        {
+            ASSERT_FAIL("our mutex is ABANDONED. Failure in test framework");
+        }
+
+        umock_c_reset_all_calls();
+        currentmalloc_call = 0;
+        currentfree_call = 0;
+    }
+
+    TEST_FUNCTION_CLEANUP(TestMethodCleanup)
+    {
+        TEST_MUTEX_RELEASE(g_testByTest);
+    }
+
+    /*Tests_SRS_MESSAGE_POOL_30_001: [ If config is NULL, MessagePool_Enable shall fail and return a non-zero value. ]*/
+    TEST_FUNCTION(MessagePool_Enable_with_NULL_config_fails)
+    {
+        ///arrange
+
+        ///act
+        int result = MessagePool_Enable(NULL);
+
+        ///assert
+        ASSERT_ARE_NOT_EQUAL(int, 0, result);
+        ASSERT_ARE_EQUAL(int, 0, MessagePool_IsEnabled());
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    }
+
+    /*Tests_SRS_MESSAGE_POOL_30_002: [ MessagePool_Enable shall create the lock guarding the shared depot and enable the pool with the sizes in config, using the defaults for the ones that are 0. ]*/
+    TEST_FUNCTION(MessagePool_Enable_creates_the_lock_and_enables_the_pool)
+    {
+        ///arrange
+        MESSAGE_POOL_CONFIG config = { 0, 0 };
+        STRICT_EXPECTED_CALL(Lock_Init());
+
+        ///act
+        int result = MessagePool_Enable(&config);
+
+        ///assert
+        ASSERT_ARE_EQUAL(int, 0, result);
+        ASSERT_ARE_NOT_EQUAL(int, 0, MessagePool_IsEnabled());
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+        ///cleanup
+        MessagePool_Disable();
+    }
+
+    /*Tests_SRS_MESSAGE_POOL_30_004: [ If creating the lock fails, MessagePool_Enable shall fail and return a non-zero value. ]*/
+    TEST_FUNCTION(MessagePool_Enable_fails_when_Lock_Init_fails)
+    {
+        ///arrange
+        MESSAGE_POOL_CONFIG config = { 0, 0 };
+        STRICT_EXPECTED_CALL(Lock_Init())
+            .SetReturn(NULL);
+
+        ///act
+        int result = MessagePool_Enable(&config);
+
+        ///assert
+        ASSERT_ARE_NOT_EQUAL(int, 0, result);
+        ASSERT_ARE_EQUAL(int, 0, MessagePool_IsEnabled());
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    }
+
+    /*Tests_SRS_MESSAGE_POOL_30_003: [ If the pool is already enabled, MessagePool_Enable shall only count the call and return 0. ]*/
+    TEST_FUNCTION(MessagePool_Enable_twice_needs_two_MessagePool_Disable)
+    {
+        ///arrange
+        enable_pool(0, 0);
+        umock_c_reset_all_calls();
+
+        ///act
+        enable_pool(0, 0);
+        MessagePool_Disable();
+        int stillEnabled = MessagePool_IsEnabled();
+        MessagePool_Disable();
+
+        ///assert
+        ASSERT_ARE_NOT_EQUAL(int, 0, stillEnabled);
+        ASSERT_ARE_EQUAL(int, 0, MessagePool_IsEnabled());
+    }
+
+    /*Tests_SRS_MESSAGE_POOL_30_005: [ If the pool is not enabled, MessagePool_Disable shall do nothing. ]*/
+    TEST_FUNCTION(MessagePool_Disable_when_not_enabled_does_nothing)
+    {
+        ///arrange
+
+        ///act
+        MessagePool_Disable();
+
+        ///assert
+        ASSERT_ARE_EQUAL(int, 0, MessagePool_IsEnabled());
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    }
+
+    /*Tests_SRS_MESSAGE_POOL_30_006: [ When the last enable is undone, MessagePool_Disable shall log the statistics of the pool, free every block in the depot and in the thread caches, free the caches and destroy the lock. ]*/
+    TEST_FUNCTION(MessagePool_Disable_frees_the_cached_blocks)
+    {
+        ///arrange
+        enable_pool(0, 0);
+        MessagePool_Free(MessagePool_Allocate(100));
+        umock_c_reset_all_calls();
+        currentfree_call = 0;
+
+        STRICT_EXPECTED_CALL(Lock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(Unlock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(Lock_Deinit(TEST_LOCK_HANDLE));
+
+        ///act
+        MessagePool_Disable();
+
+        ///assert
+        /*the block and the thread cache*/
+        ASSERT_ARE_EQUAL(size_t, 2, currentfree_call);
+        ASSERT_ARE_EQUAL(int, 0, MessagePool_IsEnabled());
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    }
+
+    /*Tests_SRS_MESSAGE_POOL_30_007: [ If statistics is NULL, MessagePool_GetStatistics shall fail and return a non-zero value. ]*/
+    TEST_FUNCTION(MessagePool_GetStatistics_with_NULL_fails)
+    {
+        ///arrange
+
+        ///act
+        int result = MessagePool_GetStatistics(NULL);
+
+        ///assert
+        ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    }
+
+    /*Tests_SRS_MESSAGE_POOL_30_008: [ If the pool is not enabled, MessagePool_GetStatistics shall report zeros and return 0. ]*/
+    /*Tests_SRS_MESSAGE_POOL_30_010: [ If the pool is not enabled, MessagePool_Allocate shall allocate the block with malloc. ]*/
+    /*Tests_SRS_MESSAGE_POOL_30_015: [ If the block was not pooled or the pool is not enabled anymore, MessagePool_Free shall free the block. ]*/
+    TEST_FUNCTION(MessagePool_Allocate_when_disabled_uses_malloc)
+    {
+        ///arrange
+        STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+        STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+
+        ///act
+        void* block = MessagePool_Allocate(100);
+        MessagePool_Free(block);
+        MESSAGE_POOL_STATISTICS statistics = get_statistics();
+
+        ///assert
+        ASSERT_IS_NOT_NULL(block);
+        ASSERT_ARE_EQUAL(size_t, 0, statistics.allocations);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    }
+
+    /*Tests_SRS_MESSAGE_POOL_30_009: [ MessagePool_GetStatistics shall add up the counters of every thread cache, including the caches of the threads that exited, and return 0. ]*/
+    /*Tests_SRS_MESSAGE_POOL_30_012: [ MessagePool_Allocate shall take a free block of the smallest size class that fits size from the thread cache, refilling the cache from the depot when it is empty, and count it as a hit. ]*/
+    /*Tests_SRS_MESSAGE_POOL_30_013: [ If there is no free block of that size class, MessagePool_Allocate shall allocate one with malloc and count it as a miss. ]*/
+    /*Tests_SRS_MESSAGE_POOL_30_016: [ Otherwise MessagePool_Free shall put the block in the thread cache, moving half of the cache to the depot first when it is full. ]*/
+    TEST_FUNCTION(MessagePool_Allocate_reuses_freed_blocks_of_the_same_size_class)
+    {
+        ///arrange
+        enable_pool(0, 0);
+        void* first = MessagePool_Allocate(100);
+        MessagePool_Free(first);
+        umock_c_reset_all_calls();
+
+        ///act
+        void* second = MessagePool_Allocate(120);
+        void* bigger = MessagePool_Allocate(1000);
+        MESSAGE_POOL_STATISTICS statistics = get_statistics();
+
+        ///assert
+        ASSERT_ARE_EQUAL(void_ptr, first, second);
+        ASSERT_ARE_NOT_EQUAL(void_ptr, first, bigger);
+        ASSERT_ARE_EQUAL(size_t, 3, statistics.allocations);
+        ASSERT_ARE_EQUAL(size_t, 1, statistics.hits);
+        ASSERT_ARE_EQUAL(size_t, 2, statistics.misses);
+        ASSERT_ARE_EQUAL(size_t, 0, statistics.oversized);
+
+        ///cleanup
+        MessagePool_Free(second);
+        MessagePool_Free(bigger);
+        MessagePool_Disable();
+    }
+
+    /*Tests_SRS_MESSAGE_POOL_30_011: [ If size is bigger than MESSAGE_POOL_MAX_BLOCK_SIZE, MessagePool_Allocate shall allocate the block with malloc and count it as an oversized miss. ]*/
+    /*Tests_SRS_MESSAGE_POOL_30_015: [ If the block was not pooled or the pool is not enabled anymore, MessagePool_Free shall free the block. ]*/
+    TEST_FUNCTION(MessagePool_Allocate_of_an_oversized_block_uses_malloc)
+    {
+        ///arrange
+        enable_pool(0, 0);
+        MessagePool_Free(MessagePool_Allocate(100)); /*creates the thread cache*/
+        umock_c_reset_all_calls();
+
+        STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+        STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+
+        ///act
+        void* block = MessagePool_Allocate(MESSAGE_POOL_MAX_BLOCK_SIZE + 1);
+        MessagePool_Free(block);
+
+        ///assert
+        ASSERT_IS_NOT_NULL(block);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+        MESSAGE_POOL_STATISTICS statistics = get_statistics();
+        ASSERT_ARE_EQUAL(size_t, 1, statistics.oversized);
+        ASSERT_ARE_EQUAL(size_t, 2, statistics.misses);
+
+        ///cleanup
+        MessagePool_Disable();
+    }
+
+    /*Tests_SRS_MESSAGE_POOL_30_012: [ MessagePool_Allocate shall take a free block of the smallest size class that fits size from the thread cache, refilling the cache from the depot when it is empty, and count it as a hit. ]*/
+    /*Tests_SRS_MESSAGE_POOL_30_016: [ Otherwise MessagePool_Free shall put the block in the thread cache, moving half of the cache to the depot first when it is full. ]*/
+    TEST_FUNCTION(MessagePool_Free_moves_blocks_to_the_depot_and_frees_what_does_not_fit)
+    {
+        ///arrange
+        enable_pool(1, 1);
+        void* a = MessagePool_Allocate(100);
+        void* b = MessagePool_Allocate(100);
+        void* c = MessagePool_Allocate(100);
+        umock_c_reset_all_calls();
+
+        ///act
+        MessagePool_Free(a); /*goes to the thread cache*/
+        MessagePool_Free(b); /*a goes to the depot*/
+        size_t freedBeforeThird = currentfree_call;
+        MessagePool_Free(c); /*the depot is full, b is freed*/
+        size_t freedAfterThird = currentfree_call;
+        void* fromCache = MessagePool_Allocate(100);
+        void* fromDepot = MessagePool_Allocate(100);
+
+        ///assert
+        ASSERT_ARE_EQUAL(size_t, freedBeforeThird + 1, freedAfterThird);
+        ASSERT_ARE_EQUAL(void_ptr, c, fromCache);
+        ASSERT_ARE_EQUAL(void_ptr, a, fromDepot);
+        MESSAGE_POOL_STATISTICS statistics = get_statistics();
+        ASSERT_ARE_EQUAL(size_t, 5, statistics.allocations);
+        ASSERT_ARE_EQUAL(size_t, 2, statistics.hits);
+
+        ///cleanup
+        MessagePool_Free(fromCache);
+        MessagePool_Free(fromDepot);
+        MessagePool_Disable();
+    }
+
+    /*Tests_SRS_MESSAGE_POOL_30_009: [ MessagePool_GetStatistics shall add up the counters of every thread cache, including the caches of the threads that exited, and return 0. ]*/
+    /*Tests_SRS_MESSAGE_POOL_30_018: [ When a thread that has a cache exits, the pool shall move the blocks of its cache to the depot, free those that do not fit, keep the counters of the cache for the statistics and free the cache. ]*/
+    TEST_FUNCTION(MessagePool_thread_exit_moves_the_thread_cache_to_the_depot)
+    {
+        ///arrange
+        THREAD_HANDLE thread;
+        int thread_result;
+        enable_pool(0, 0);
+        ASSERT_ARE_EQUAL(int, THREADAPI_OK, ThreadAPI_Create(&thread, allocate_and_free_a_block, NULL));
+        ASSERT_ARE_EQUAL(int, THREADAPI_OK, ThreadAPI_Join(thread, &thread_result));
+        umock_c_reset_all_calls();
+        currentmalloc_call = 0;
+
+        ///act
+        void* block = MessagePool_Allocate(100);
+        MESSAGE_POOL_STATISTICS statistics = get_statistics();
+
+        ///assert
+        /*only this thread's cache, the block comes from the depot*/
+        ASSERT_ARE_EQUAL(size_t, 1, currentmalloc_call);
+        ASSERT_ARE_EQUAL(size_t, 2, statistics.allocations);
+        ASSERT_ARE_EQUAL(size_t, 1, statistics.hits);
+        ASSERT_ARE_EQUAL(size_t, 1, statistics.misses);
+
+        ///cleanup
+        MessagePool_Free(block);
+        MessagePool_Disable();
+    }
+
+    /*Tests_SRS_MESSAGE_POOL_30_014: [ If allocating the block fails, MessagePool_Allocate shall return NULL. ]*/
+    TEST_FUNCTION(MessagePool_Allocate_fails_when_malloc_fails)
+    {
+        ///arrange
+        STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
+            .SetReturn(NULL);
+
+        ///act
+        void* block = MessagePool_Allocate(100);
+
+        ///assert
+        ASSERT_IS_NULL(block);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    }
+
+END_TEST_SUITE(message_pool_ut)
@@ -0,0 +1,182 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include "testrunnerswitcher.h"
+#include "umock_c.h"
+#include "umocktypes_charptr.h"
+
+#include "property_key.h"
+
+static TEST_MUTEX_HANDLE g_testByTest;
+static TEST_MUTEX_HANDLE g_dllByDll;
+
+static void on_umock_c_error(UMOCK_C_ERROR_CODE error_code)
+{
+    ASSERT_FAIL("umock_c reported error");
+}
+
+/*the table is process-wide, every test uses keys of its own*/
+BEGIN_TEST_SUITE(property_key_ut)
+
+    TEST_SUITE_INITIALIZE(TestClassInitialize)
+    {
+        TEST_INITIALIZE_MEMORY_DEBUG(g_dllByDll);
+        g_testByTest = TEST_MUTEX_CREATE();
+        ASSERT_IS_NOT_NULL(g_testByTest);
+
+        umock_c_init(on_umock_c_error);
+
+        int result = umocktypes_charptr_register_types();
+        ASSERT_ARE_EQUAL(int, 0, result);
+    }
+
+    TEST_SUITE_CLEANUP(TestClassCleanup)
+    {
+        TEST_MUTEX_DESTROY(g_testByTest);
+        umock_c_deinit();
+        TEST_DEINITIALIZE_MEMORY_DEBUG(g_dllByDll);
+    }
+
+    TEST_FUNCTION_INITIALIZE(TestMethodInitialize)
+    {
+        if (TEST_MUTEX_ACQUIRE(g_testByTest) != 0)
+        {
+            ASSERT_FAIL("our mutex is ABANDONED. Failure in test framework");
+        }
+
+        umock_c_reset_all_calls();
+    }
+
+    TEST_FUNCTION_CLEANUP(TestMethodCleanup)
+    {
+        TEST_MUTEX_RELEASE(g_testByTest);
+    }
+
+    /*Tests_SRS_PROPERTY_KEY_30_001: [ If key is NULL, PropertyKey_Intern shall fail and return NULL. ]*/
+    TEST_FUNCTION(PropertyKey_Intern_with_NULL_key_fails)
+    {
+        ///arrange
+
+        ///act
+        const char* result = PropertyKey_Intern(NULL);
+
+        ///assert
+        ASSERT_IS_NULL(result);
+    }
+
+    /*Tests_SRS_PROPERTY_KEY_30_005: [ If key is NULL, PropertyKey_Find shall return NULL. ]*/
+    TEST_FUNCTION(PropertyKey_Find_with_NULL_key_returns_NULL)
+    {
+        ///arrange
+
+        ///act
+        const char* result = PropertyKey_Find(NULL);
+
+        ///assert
+        ASSERT_IS_NULL(result);
+    }
+
+    /*Tests_SRS_PROPERTY_KEY_30_002: [ If key is one of the well-known keys, PropertyKey_Intern shall return the canonical pointer of that key. ]*/
+    /*Tests_SRS_PROPERTY_KEY_30_006: [ PropertyKey_Find shall return the canonical pointer of key if key is interned, and NULL otherwise. ]*/
+    TEST_FUNCTION(PropertyKey_well_known_keys_are_interned_from_the_start)
+    {
+        ///arrange
+        static const char* const keys[] = { "source", "macAddress", "deviceName", "deviceKey", "deviceId", "timestamp", "characteristicUUID", "bleControllerIndex" };
+        size_t i;
+
+        for (i = 0; i < sizeof(keys) / sizeof(keys[0]); i++)
+        {
+            char key[32];
+            (void)strcpy(key, keys[i]);
+
+            ///act
+            const char* found = PropertyKey_Find(key);
+            const char* interned = PropertyKey_Intern(key);
+
+            ///assert
+            ASSERT_IS_NOT_NULL(found);
+            ASSERT_ARE_EQUAL(void_ptr, (void*)found, (void*)interned);
+            ASSERT_ARE_NOT_EQUAL(void_ptr, (void*)key, (void*)found);
+            ASSERT_ARE_EQUAL(char_ptr, keys[i], found);
+        }
+    }
+
+    /*Tests_SRS_PROPERTY_KEY_30_003: [ Otherwise PropertyKey_Intern shall return the pointer to the copy of key made by the first call interning it, making that copy if there is none. ]*/
+    TEST_FUNCTION(PropertyKey_Intern_copies_a_new_key_once)
+    {
+        ///arrange
+        char key[] = "temperature";
+        const char* before = PropertyKey_Find(key);
+
+        ///act
+        const char* first = PropertyKey_Intern(key);
+        key[0] = 'T';
+        const char* other = PropertyKey_Intern(key);
+        key[0] = 't';
+        const char* second = PropertyKey_Intern(key);
+        const char* found = PropertyKey_Find("temperature");
+
+        ///assert
+        ASSERT_IS_NULL(before);
+        ASSERT_IS_NOT_NULL(first);
+        ASSERT_ARE_NOT_EQUAL(void_ptr, (void*)key, (void*)first);
+        ASSERT_ARE_EQUAL(char_ptr, "temperature", first);
+        ASSERT_ARE_EQUAL(void_ptr, (void*)first, (void*)second);
+        ASSERT_ARE_EQUAL(void_ptr, (void*)first, (void*)found);
+        ASSERT_ARE_EQUAL(char_ptr, "Temperature", other);
+        ASSERT_ARE_NOT_EQUAL(void_ptr, (void*)first, (void*)other);
+    }
+
+    /*Tests_SRS_PROPERTY_KEY_30_004: [ If key is longer than PROPERTY_KEY_MAX_LENGTH, or if PROPERTY_KEY_MAX_INTERNED keys have already been interned, PropertyKey_Intern shall fail and return NULL. ]*/
+    TEST_FUNCTION(PropertyKey_Intern_fails_on_a_key_that_is_too_long)
+    {
+        ///arrange
+        char key[PROPERTY_KEY_MAX_LENGTH + 2];
+        (void)memset(key, 'k', PROPERTY_KEY_MAX_LENGTH + 1);
+        key[PROPERTY_KEY_MAX_LENGTH + 1] = '\0';
+
+        ///act
+        const char* tooLong = PropertyKey_Intern(key);
+        key[PROPERTY_KEY_MAX_LENGTH] = '\0';
+        const char* longest = PropertyKey_Intern(key);
+
+        ///assert
+        ASSERT_IS_NULL(tooLong);
+        ASSERT_IS_NOT_NULL(longest);
+        ASSERT_ARE_EQUAL(char_ptr, key, longest);
+    }
+
+    /*Tests_SRS_PROPERTY_KEY_30_004: [ If key is longer than PROPERTY_KEY_MAX_LENGTH, or if PROPERTY_KEY_MAX_INTERNED keys have already been interned, PropertyKey_Intern shall fail and return NULL. ]*/
+    /*this one fills the table, it has to stay the last test*/
+    TEST_FUNCTION(PropertyKey_Intern_fails_when_the_table_is_full)
+    {
+        ///arrange
+        char key[16];
+        size_t interned = 0;
+        size_t i;
+
+        ///act
+        for (i = 0; i < PROPERTY_KEY_MAX_INTERNED + 1; i++)
+        {
+            (void)sprintf(key, "key%lu", (unsigned long)i);
+            if (PropertyKey_Intern(key) != NULL)
+            {
+                interned++;
+            }
+        }
+
+        ///assert
+        /*the previous tests interned 3 keys already*/
+        ASSERT_ARE_EQUAL(size_t, PROPERTY_KEY_MAX_INTERNED - 3, interned);
+        ASSERT_IS_NOT_NULL(PropertyKey_Find("key0"));
+        ASSERT_IS_NULL(PropertyKey_Find(key));
+        /*well-known and already interned keys are still found*/
+        ASSERT_IS_NOT_NULL(PropertyKey_Intern("source"));
+        ASSERT_IS_NOT_NULL(PropertyKey_Intern("temperature"));
+    }
+
+END_TEST_SUITE(property_key_ut)
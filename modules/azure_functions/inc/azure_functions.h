@@ -12,11 +12,17 @@ extern "C"
 {
 #endif
 
+#define AZURE_FUNCTIONS_DEFAULT_MAX_IN_FLIGHT 4
+#define AZURE_FUNCTIONS_MAX_IN_FLIGHT 64
+#define AZURE_FUNCTIONS_MAX_BATCH_SIZE 1000
+
 typedef struct AZURE_FUNCTIONS_CONFIG_TAG
 {
     STRING_HANDLE hostAddress;
     STRING_HANDLE relativePath;
     STRING_HANDLE securityKey;
+    size_t maxInFlight; /*requests sent at the same time, 0 means AZURE_FUNCTIONS_DEFAULT_MAX_IN_FLIGHT*/
+    size_t batchSize; /*most messages posted in one request, 0 or 1 posts every message on its own*/
 } AZURE_FUNCTIONS_CONFIG;
 
 MODULE_EXPORT const MODULE_API* MODULE_STATIC_GETAPI(AZUREFUNCTIONS_MODULE)(MODULE_API_VERSION gateway_api_version);
@@ -3,6 +3,8 @@
 
 #include <stdlib.h>
 #include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
 #include <ctype.h>
 #include "azure_c_shared_utility/gballoc.h"
 #include "azure_c_shared_utility/strings.h"
@@ -11,19 +13,56 @@
 #include "message.h"
 #include "broker.h"
 #include "azure_functions.h"
+#include "base64_write.h"
 #include "azure_c_shared_utility/constmap.h"
 #include "azure_c_shared_utility/constbuffer.h"
 #include "azure_c_shared_utility/xlogging.h"
 #include "azure_c_shared_utility/vector.h"
 #include "azure_c_shared_utility/httpapiex.h"
-#include "azure_c_shared_utility/base64.h"
+#include "azure_c_shared_utility/lock.h"
+#include "azure_c_shared_utility/condition.h"
+#include "azure_c_shared_utility/threadapi.h"
 
 #include <parson.h>
 
+/*batches of every sender the queue holds before Receive waits*/
+#define AZURE_FUNCTIONS_QUEUED_BATCHES 2
+/*first size of the request body of a sender, it grows to the largest batch*/
+#define AZURE_FUNCTIONS_INITIAL_BODY 256
+
+struct AZURE_FUNCTIONS_DATA_TAG;
+
+/*one request in flight: its connection, headers and buffers are made once and reused for every POST*/
+typedef struct AZURE_FUNCTIONS_SENDER_TAG
+{
+    struct AZURE_FUNCTIONS_DATA_TAG * module;
+    THREAD_HANDLE thread;
+    HTTPAPIEX_HANDLE httpHandle;
+    HTTP_HEADERS_HANDLE httpHeaders;
+    BUFFER_HANDLE postContent;
+    BUFFER_HANDLE responseContent;
+    unsigned char * body; /*the JSON body is built here, then copied to postContent*/
+    size_t bodyCapacity;
+    MESSAGE_HANDLE * batch; /*the messages taken from the queue*/
+} AZURE_FUNCTIONS_SENDER;
+
 typedef struct AZURE_FUNCTIONS_DATA_TAG
 {
     BROKER_HANDLE broker;
     AZURE_FUNCTIONS_CONFIG *azureFunctionsConfiguration;
+    STRING_HANDLE requestPath;
+    size_t maxInFlight;
+    size_t batchSize;
+    LOCK_HANDLE lock;
+    COND_HANDLE queueCondition; /*the senders wait on it for messages*/
+    COND_HANDLE spaceCondition; /*Receive waits on it for room in the queue*/
+    MESSAGE_HANDLE * queue; /*ring of queueCapacity messages, guarded by lock*/
+    size_t queueCapacity;
+    size_t queueHead;
+    size_t queueCount;
+    bool stopping;
+    AZURE_FUNCTIONS_SENDER * senders;
+    size_t senderCount; /*senders with a thread*/
 } AZURE_FUNCTIONS_DATA;
 
 #define AZURE_FUNCTIONS_RESULT_VALUES \
@@ -35,6 +74,412 @@ DEFINE_ENUM(AZURE_FUNCTIONS_RESULT, AZURE_FUNCTIONS_RESULT_VALUES)
 
 DEFINE_ENUM_STRINGS(BROKER_RESULT, BROKER_RESULT_VALUES);
 
+#define CONTENT_PREFIX "{\"content\":\""
+#define CONTENT_SUFFIX "\"}"
+
+/*
+ * @brief    Append one message to the body of the sender, false when the body cannot grow.
+ */
+static bool AzureFunctions_AppendToBody(AZURE_FUNCTIONS_SENDER * sender, size_t * bodySize, const CONSTBUFFER * content, bool separator)
+{
+    bool result;
+    /* the separator, the object, and room for the closing bracket */
+    size_t needed = *bodySize + 1 + (sizeof(CONTENT_PREFIX) - 1) + BASE64_WRITE_LENGTH(content->size) + (sizeof(CONTENT_SUFFIX) - 1) + 1;
+    if (needed > sender->bodyCapacity)
+    {
+        size_t newCapacity = (needed > 2 * sender->bodyCapacity) ? needed : 2 * sender->bodyCapacity;
+        unsigned char * newBody = (unsigned char *)realloc(sender->body, newCapacity);
+        if (newBody == NULL)
+        {
+            LogError("unable to grow the request body to %lu bytes", (unsigned long)newCapacity);
+            result = false;
+        }
+        else
+        {
+            sender->body = newBody;
+            sender->bodyCapacity = newCapacity;
+            result = true;
+        }
+    }
+    else
+    {
+        result = true;
+    }
+
+    if (result == true)
+    {
+        unsigned char * position = sender->body + *bodySize;
+        if (separator)
+        {
+            *position++ = ',';
+        }
+        (void)memcpy(position, CONTENT_PREFIX, sizeof(CONTENT_PREFIX) - 1);
+        position += sizeof(CONTENT_PREFIX) - 1;
+        position = (unsigned char *)base64_write((char *)position, content->buffer, content->size);
+        (void)memcpy(position, CONTENT_SUFFIX, sizeof(CONTENT_SUFFIX) - 1);
+        position += sizeof(CONTENT_SUFFIX) - 1;
+        *bodySize = (size_t)(position - sender->body);
+    }
+    return result;
+}
+
+/*
+ * @brief    POST the messages a sender took from the queue and release them.
+ */
+static void AzureFunctions_PostBatch(AZURE_FUNCTIONS_SENDER * sender, size_t count)
+{
+    AZURE_FUNCTIONS_DATA * moduleData = sender->module;
+    bool asArray = (moduleData->batchSize > 1);
+    size_t bodySize = 0;
+    size_t posted = 0;
+    size_t i;
+    bool bodyBuilt = true;
+
+    /*Codes_SRS_AZUREFUNCTIONS_30_008: [ A sender shall POST the messages it took as a JSON array of { "content": base64 content } objects when batchSize is above 1, and as one such object otherwise. ]*/
+    if (bodyBuilt && asArray)
+    {
+        sender->body[bodySize++] = '[';
+    }
+    for (i = 0; (i < count) && (bodyBuilt == true); i++)
+    {
+        /* Codes_SRS_AZUREFUNCTIONS_04_012: [ The sender shall get the message content by calling Message_GetContent, a message without content is not posted. ] */
+        const CONSTBUFFER* content = Message_GetContent(sender->batch[i]);
+        if (content == NULL)
+        {
+            LogError("unable to get message content.");
+        }
+        /* Codes_SRS_AZUREFUNCTIONS_04_024: [ The sender shall create a JSON body with the content of the messages, base64 encoded in a buffer it reuses for every request. If it fails it shall fail and release the messages. ] */
+        else if (AzureFunctions_AppendToBody(sender, &bodySize, content, (posted > 0)) == false)
+        {
+            bodyBuilt = false;
+        }
+        else
+        {
+            posted++;
+        }
+    }
+    if (bodyBuilt && asArray)
+    {
+        sender->body[bodySize++] = ']';
+    }
+
+    if ((bodyBuilt == false) || (posted == 0))
+    {
+        LogError("no request body for %lu messages", (unsigned long)count);
+    }
+    else if (BUFFER_build(sender->postContent, sender->body, bodySize) != 0)
+    {
+        LogError("Error building post content.");
+    }
+    else
+    {
+        unsigned int statuscodeBack = 0;
+        /* Codes_SRS_AZUREFUNCTIONS_04_017: [ The sender shall call HTTPAPIEX_ExecuteRequest on its HTTPAPIEX handle to send the HTTP POST to Azure Functions. If it fails it shall log it and release the messages. ] */
+        HTTPAPIEX_RESULT requestResult = HTTPAPIEX_ExecuteRequest(sender->httpHandle, HTTPAPI_REQUEST_POST, STRING_c_str(moduleData->requestPath), sender->httpHeaders, sender->postContent, &statuscodeBack, NULL, sender->responseContent);
+        if (requestResult != HTTPAPIEX_OK || statuscodeBack != 200)
+        {
+            LogError("Error Sending Request. Status Code: %d", statuscodeBack);
+        }
+        else
+        {
+            /* Codes_SRS_AZUREFUNCTIONS_04_018: [ Upon success the sender shall log the response from HTTP POST. ] */
+            size_t responseSize = BUFFER_length(sender->responseContent);
+            LogInfo("Request Sent to Function Succesfully (%lu messages). Response from Functions: %.*s",
+                (unsigned long)posted, (int)responseSize, (responseSize == 0) ? "" : (const char*)BUFFER_u_char(sender->responseContent));
+        }
+    }
+
+    /* Codes_SRS_AZUREFUNCTIONS_04_019: [ The sender shall destroy the messages it took once they are posted. ] */
+    for (i = 0; i < count; i++)
+    {
+        Message_Destroy(sender->batch[i]);
+    }
+}
+
+/*
+ * @brief    Take batches of messages from the queue and POST them until the module stops and the queue is empty.
+ */
+static int AzureFunctions_Sender(void * param)
+{
+    AZURE_FUNCTIONS_SENDER * sender = (AZURE_FUNCTIONS_SENDER*)param;
+    AZURE_FUNCTIONS_DATA * moduleData = sender->module;
+    if (Lock(moduleData->lock) != LOCK_OK)
+    {
+        LogError("unable to Lock, the sender stops");
+    }
+    else
+    {
+        bool locked = true;
+        while (locked == true)
+        {
+            size_t count = 0;
+            while ((moduleData->queueCount == 0) && (moduleData->stopping == false))
+            {
+                (void)Condition_Wait(moduleData->queueCondition, moduleData->lock, 0);
+            }
+            if (moduleData->queueCount == 0)
+            {
+                /* stopping, and every queued message was posted */
+                break;
+            }
+
+            /*Codes_SRS_AZUREFUNCTIONS_30_009: [ A sender shall take up to batchSize messages from the queue at once, and post them without holding the lock. ]*/
+            while ((count < moduleData->batchSize) && (moduleData->queueCount > 0))
+            {
+                sender->batch[count++] = moduleData->queue[moduleData->queueHead];
+                moduleData->queueHead = (moduleData->queueHead + 1) % moduleData->queueCapacity;
+                moduleData->queueCount--;
+            }
+            (void)Condition_Post(moduleData->spaceCondition);
+            (void)Unlock(moduleData->lock);
+
+            AzureFunctions_PostBatch(sender, count);
+
+            if (Lock(moduleData->lock) != LOCK_OK)
+            {
+                LogError("unable to Lock, the sender stops");
+                locked = false;
+            }
+        }
+        if (locked == true)
+        {
+            (void)Unlock(moduleData->lock);
+        }
+    }
+    return 0;
+}
+
+/*
+ * @brief    Make the connection, headers and buffers of a sender.
+ */
+static int AzureFunctions_CreateSender(AZURE_FUNCTIONS_DATA * moduleData, AZURE_FUNCTIONS_SENDER * sender)
+{
+    int result;
+    AZURE_FUNCTIONS_CONFIG * config = moduleData->azureFunctionsConfiguration;
+    sender->module = moduleData;
+    sender->bodyCapacity = AZURE_FUNCTIONS_INITIAL_BODY;
+    sender->body = (unsigned char*)malloc(sender->bodyCapacity);
+    sender->httpHeaders = NULL;
+    sender->postContent = NULL;
+    sender->responseContent = NULL;
+
+    /* Codes_SRS_AZUREFUNCTIONS_04_014: [ AzureFunctions_Create shall call HTTPAPIEX_Create, passing hostAddress, once per sender, which keeps it for every request. If it fails it shall fail and return NULL. ] */
+    sender->httpHandle = HTTPAPIEX_Create(STRING_c_str(config->hostAddress));
+    if (sender->body == NULL)
+    {
+        LogError("Could not allocate the request body");
+        result = __LINE__;
+    }
+    else if (sender->httpHandle == NULL)
+    {
+        LogError("Failed to create HTTPAPIEX handle.");
+        result = __LINE__;
+    }
+    else if ((sender->httpHeaders = HTTPHeaders_Alloc()) == NULL)
+    {
+        LogError("Error creating HttpHeaders");
+        result = __LINE__;
+    }
+    /* Codes_SRS_AZUREFUNCTIONS_04_025: [ AzureFunctions_Create shall add 2 HTTP Headers to the requests of every sender. Content-Type:application/json and, if securityKey exists x-functions-key:securityKey. If it fails it shall fail and return NULL. ] */
+    else if (HTTPHeaders_AddHeaderNameValuePair(sender->httpHeaders, "Content-Type", "application/json") != HTTP_HEADERS_OK)
+    {
+        LogError("Error Adding Content-Type header.");
+        result = __LINE__;
+    }
+    else if (config->securityKey != NULL &&
+        (HTTPHeaders_AddHeaderNameValuePair(sender->httpHeaders, "x-functions-key", STRING_c_str(config->securityKey)) != HTTP_HEADERS_OK))
+    {
+        LogError("Error Adding x-functions-key header.");
+        result = __LINE__;
+    }
+    /* Codes_SRS_AZUREFUNCTIONS_04_015: [ AzureFunctions_Create shall allocate the request and response buffers of every sender by calling BUFFER_new, if it fails it shall fail and return NULL. ] */
+    else if (((sender->postContent = BUFFER_new()) == NULL) ||
+        ((sender->responseContent = BUFFER_new()) == NULL))
+    {
+        LogError("Failed to create request Buffers.");
+        result = __LINE__;
+    }
+    else
+    {
+        result = 0;
+    }
+    return result;
+}
+
+static void AzureFunctions_DestroySender(AZURE_FUNCTIONS_SENDER * sender)
+{
+    if (sender->httpHandle != NULL)
+    {
+        HTTPAPIEX_Destroy(sender->httpHandle);
+    }
+    if (sender->httpHeaders != NULL)
+    {
+        HTTPHeaders_Free(sender->httpHeaders);
+    }
+    if (sender->postContent != NULL)
+    {
+        BUFFER_delete(sender->postContent);
+    }
+    if (sender->responseContent != NULL)
+    {
+        BUFFER_delete(sender->responseContent);
+    }
+    free(sender->body);
+}
+
+/*
+ * @brief    Ask the senders to post what is queued and stop, then wait for them.
+ */
+static void AzureFunctions_StopSenders(AZURE_FUNCTIONS_DATA * moduleData)
+{
+    size_t i;
+    if (Lock(moduleData->lock) != LOCK_OK)
+    {
+        LogError("unable to Lock, stopping the senders anyway");
+        moduleData->stopping = true;
+        for (i = 0; i < moduleData->senderCount; i++)
+        {
+            (void)Condition_Post(moduleData->queueCondition);
+        }
+    }
+    else
+    {
+        moduleData->stopping = true;
+        for (i = 0; i < moduleData->senderCount; i++)
+        {
+            (void)Condition_Post(moduleData->queueCondition);
+        }
+        (void)Unlock(moduleData->lock);
+    }
+
+    for (i = 0; i < moduleData->senderCount; i++)
+    {
+        int notUsed;
+        if (ThreadAPI_Join(moduleData->senders[i].thread, &notUsed) != THREADAPI_OK)
+        {
+            LogError("unable to ThreadAPI_Join, the sender may outlive the module");
+        }
+    }
+    moduleData->senderCount = 0;
+}
+
+/*
+ * @brief    Release the senders of the module and what they share, whatever part of it was created.
+ */
+static void AzureFunctions_FreeSenders(AZURE_FUNCTIONS_DATA * moduleData, size_t createdSenders)
+{
+    size_t i;
+    for (i = 0; i < createdSenders; i++)
+    {
+        AzureFunctions_DestroySender(&(moduleData->senders[i]));
+    }
+    if (moduleData->spaceCondition != NULL)
+    {
+        Condition_Deinit(moduleData->spaceCondition);
+    }
+    if (moduleData->queueCondition != NULL)
+    {
+        Condition_Deinit(moduleData->queueCondition);
+    }
+    if (moduleData->lock != NULL)
+    {
+        (void)Lock_Deinit(moduleData->lock);
+    }
+    /* the senders, their batches and the queue are one block */
+    free(moduleData->senders);
+    STRING_delete(moduleData->requestPath);
+}
+
+/*
+ * @brief    Start maxInFlight senders, each with its own connection, and the queue they share.
+ */
+static int AzureFunctions_StartSenders(AZURE_FUNCTIONS_DATA * moduleData)
+{
+    int result;
+    size_t maxInFlight = moduleData->azureFunctionsConfiguration->maxInFlight;
+    size_t batchSize = moduleData->azureFunctionsConfiguration->batchSize;
+    moduleData->maxInFlight = (maxInFlight == 0) ? AZURE_FUNCTIONS_DEFAULT_MAX_IN_FLIGHT : maxInFlight;
+    moduleData->batchSize = (batchSize == 0) ? 1 : batchSize;
+    moduleData->queueCapacity = moduleData->maxInFlight * moduleData->batchSize * AZURE_FUNCTIONS_QUEUED_BATCHES;
+    moduleData->queueHead = 0;
+    moduleData->queueCount = 0;
+    moduleData->stopping = false;
+    moduleData->senderCount = 0;
+    moduleData->lock = NULL;
+    moduleData->queueCondition = NULL;
+    moduleData->spaceCondition = NULL;
+    moduleData->senders = NULL;
+
+    if (moduleData->maxInFlight > AZURE_FUNCTIONS_MAX_IN_FLIGHT || moduleData->batchSize > AZURE_FUNCTIONS_MAX_BATCH_SIZE)
+    {
+        /*Codes_SRS_AZUREFUNCTIONS_30_003: [ If maxInFlight is above AZURE_FUNCTIONS_MAX_IN_FLIGHT or batchSize is above AZURE_FUNCTIONS_MAX_BATCH_SIZE, AzureFunctions_Create shall fail and return NULL. ]*/
+        LogError("maxInFlight %lu or batchSize %lu out of range", (unsigned long)moduleData->maxInFlight, (unsigned long)moduleData->batchSize);
+        result = __LINE__;
+    }
+    /* Codes_SRS_AZUREFUNCTIONS_04_016: [ AzureFunctions_Create shall add name to a copy of the relative path the senders use for every request, if it fails it shall fail and return NULL. ] */
+    else if ((moduleData->requestPath = STRING_clone(moduleData->azureFunctionsConfiguration->relativePath)) == NULL)
+    {
+        LogError("Error building request String.");
+        result = __LINE__;
+    }
+    else if (STRING_concat(moduleData->requestPath, "?name=myGatewayDevice") != 0)
+    {
+        LogError("Error building request String.");
+        STRING_delete(moduleData->requestPath);
+        result = __LINE__;
+    }
+    else if ((moduleData->senders = (AZURE_FUNCTIONS_SENDER*)malloc(
+        moduleData->maxInFlight * sizeof(AZURE_FUNCTIONS_SENDER) +
+        (moduleData->queueCapacity + moduleData->maxInFlight * moduleData->batchSize) * sizeof(MESSAGE_HANDLE))) == NULL)
+    {
+        LogError("Could not allocate the senders");
+        STRING_delete(moduleData->requestPath);
+        result = __LINE__;
+    }
+    else if (((moduleData->lock = Lock_Init()) == NULL) ||
+        ((moduleData->queueCondition = Condition_Init()) == NULL) ||
+        ((moduleData->spaceCondition = Condition_Init()) == NULL))
+    {
+        LogError("unable to create the lock and conditions");
+        AzureFunctions_FreeSenders(moduleData, 0);
+        result = __LINE__;
+    }
+    else
+    {
+        /*Codes_SRS_AZUREFUNCTIONS_30_004: [ AzureFunctions_Create shall start maxInFlight senders, AZURE_FUNCTIONS_DEFAULT_MAX_IN_FLIGHT when it is 0, each with its own HTTPAPIEX handle, headers and buffers, and its own thread. ]*/
+        size_t created;
+        moduleData->queue = (MESSAGE_HANDLE*)(moduleData->senders + moduleData->maxInFlight);
+        result = 0;
+        for (created = 0; created < moduleData->maxInFlight; created++)
+        {
+            AZURE_FUNCTIONS_SENDER * sender = &(moduleData->senders[created]);
+            sender->batch = moduleData->queue + moduleData->queueCapacity + created * moduleData->batchSize;
+            if (AzureFunctions_CreateSender(moduleData, sender) != 0)
+            {
+                AzureFunctions_DestroySender(sender);
+                result = __LINE__;
+                break;
+            }
+        }
+        for (; moduleData->senderCount < created; moduleData->senderCount++)
+        {
+            if (ThreadAPI_Create(&(moduleData->senders[moduleData->senderCount].thread), AzureFunctions_Sender, &(moduleData->senders[moduleData->senderCount])) != THREADAPI_OK)
+            {
+                LogError("unable to ThreadAPI_Create");
+                result = __LINE__;
+                break;
+            }
+        }
+        if (result != 0)
+        {
+            /*Codes_SRS_AZUREFUNCTIONS_30_005: [ If starting a sender fails, AzureFunctions_Create shall stop the started senders, release all resources and return NULL. ]*/
+            AzureFunctions_StopSenders(moduleData);
+            AzureFunctions_FreeSenders(moduleData, created);
+        }
+    }
+    return result;
+}
+
 /*
  * @brief    Create an Azure Functions module.
  */
@@ -114,18 +559,32 @@ static MODULE_HANDLE AzureFunctions_Create(BROKER_HANDLE broker, const void* con
                                     free(result);
                                     result = NULL;
                                 }
+                            }
+                            else
+                            {
+                                result->azureFunctionsConfiguration->securityKey = NULL;
+                            }
+
+                            if (result != NULL)
+                            {
+                                result->azureFunctionsConfiguration->maxInFlight = config->maxInFlight;
+                                result->azureFunctionsConfiguration->batchSize = config->batchSize;
+                                if (AzureFunctions_StartSenders(result) != 0)
+                                {
+                                    LogError("unable to start the senders");
+                                    STRING_delete(result->azureFunctionsConfiguration->securityKey);
+                                    STRING_delete(result->azureFunctionsConfiguration->relativePath);
+                                    STRING_delete(result->azureFunctionsConfiguration->hostAddress);
+                                    free(result->azureFunctionsConfiguration);
+                                    free(result);
+                                    result = NULL;
+                                }
                                 else
                                 {
                                     /* Codes_SRS_AZUREFUNCTIONS_04_001: [ Upon success, this function shall return a valid pointer to a MODULE_HANDLE. ] */
                                     result->broker = broker;
                                 }
                             }
-                            else
-                            {
-                                result->azureFunctionsConfiguration->securityKey = NULL;
-                                /* Codes_SRS_AZUREFUNCTIONS_04_001: [ Upon success, this function shall return a valid pointer to a MODULE_HANDLE. ] */
-                                result->broker = broker;
-                            }
                         }
                     }
                 }
@@ -188,52 +647,67 @@ static void * AzureFunctions_ParseConfigurationFromJson(const char* configuratio
                     {
                         const char* key = json_object_get_string(obj, "key");
 
-                        AZURE_FUNCTIONS_CONFIG config;
-                        /* Codes_SRS_AZUREFUNCTIONS_05_019: [ If the array object contains a value named "key" then AzureFunctions_CreateFromJson shall create a securityKey based on input key ] */
-                        config.securityKey = STRING_construct(key); //Doesn't need to test key. If key is null will mean we are sending an anonymous request.
-                        config.relativePath = NULL;
-                        /* Codes_SRS_AZUREFUNCTIONS_05_008: [ Azure_Functions_CreateFromJson shall call STRING_construct to create hostAddress based on input host address. ] */
-                        config.hostAddress = STRING_construct(hostAddress);
-
-                        if (config.hostAddress == NULL)
+                        /*Codes_SRS_AZUREFUNCTIONS_30_001: [ AzureFunctions_ParseConfigurationFromJson shall read the numbers "maxInFlight" and "batchSize", 0 when they are missing. ]*/
+                        double maxInFlight = json_object_get_number(obj, "maxInFlight");
+                        double batchSize = json_object_get_number(obj, "batchSize");
+                        if ((maxInFlight < 0) || (maxInFlight > AZURE_FUNCTIONS_MAX_IN_FLIGHT) ||
+                            (batchSize < 0) || (batchSize > AZURE_FUNCTIONS_MAX_BATCH_SIZE))
                         {
-                            /* Codes_SRS_AZUREFUNCTIONS_05_010: [ If creating the strings fails, then Azure_Functions_CreateFromJson shall fail and return NULL. ] */
-                            LogError("error buliding hostAddress String.");
+                            /*Codes_SRS_AZUREFUNCTIONS_30_002: [ If "maxInFlight" is negative or above AZURE_FUNCTIONS_MAX_IN_FLIGHT, or "batchSize" is negative or above AZURE_FUNCTIONS_MAX_BATCH_SIZE, AzureFunctions_ParseConfigurationFromJson shall fail and return NULL. ]*/
+                            LogError("maxInFlight or batchSize out of range.");
                             result = NULL;
                         }
                         else
                         {
-                            /* Codes_SRS_AZUREFUNCTIONS_05_009: [ Azure_Functions_CreateFromJson shall call STRING_construct to create relativePath based on input host address. ] */
-                            config.relativePath = STRING_construct(relativePath);
-                            if (config.relativePath == NULL)
+                            AZURE_FUNCTIONS_CONFIG config;
+                            /* Codes_SRS_AZUREFUNCTIONS_05_019: [ If the array object contains a value named "key" then AzureFunctions_CreateFromJson shall create a securityKey based on input key ] */
+                            config.securityKey = STRING_construct(key); //Doesn't need to test key. If key is null will mean we are sending an anonymous request.
+                            config.relativePath = NULL;
+                            /* Codes_SRS_AZUREFUNCTIONS_05_008: [ Azure_Functions_CreateFromJson shall call STRING_construct to create hostAddress based on input host address. ] */
+                            config.hostAddress = STRING_construct(hostAddress);
+                            config.maxInFlight = (size_t)maxInFlight;
+                            config.batchSize = (size_t)batchSize;
+
+                            if (config.hostAddress == NULL)
                             {
                                 /* Codes_SRS_AZUREFUNCTIONS_05_010: [ If creating the strings fails, then Azure_Functions_CreateFromJson shall fail and return NULL. ] */
-                                LogError("error buliding relative path String.");
+                                LogError("error buliding hostAddress String.");
                                 result = NULL;
                             }
                             else
                             {
-                                /* Codes_SRS_AZUREFUNCTIONS_17_001: [ AzureFunctions_ParseConfigurationFromJson shall allocate an AZURE_FUNCTIONS_CONFIG structure. ]*/
-								result = malloc(sizeof(AZURE_FUNCTIONS_CONFIG));
-								if (result == NULL)
-								{
-                                    /*Codes_SRS_AZUREFUNCTIONS_17_003: [ AzureFunctions_ParseConfigurationFromJson shall return NULL on failure. ]*/
-									LogError("could not allocate AZURE_FUNCTIONS_CONFIG");
-								}
-								else
-								{
-                                    /*Codes_SRS_AZUREFUNCTIONS_17_002: [ AzureFunctions_ParseConfigurationFromJson shall fill the structure with the constructed strings and return it upon success. ]*/
-									*result = config;
-								}
+                                /* Codes_SRS_AZUREFUNCTIONS_05_009: [ Azure_Functions_CreateFromJson shall call STRING_construct to create relativePath based on input host address. ] */
+                                config.relativePath = STRING_construct(relativePath);
+                                if (config.relativePath == NULL)
+                                {
+                                    /* Codes_SRS_AZUREFUNCTIONS_05_010: [ If creating the strings fails, then Azure_Functions_CreateFromJson shall fail and return NULL. ] */
+                                    LogError("error buliding relative path String.");
+                                    result = NULL;
+                                }
+                                else
+                                {
+                                    /* Codes_SRS_AZUREFUNCTIONS_17_001: [ AzureFunctions_ParseConfigurationFromJson shall allocate an AZURE_FUNCTIONS_CONFIG structure. ]*/
+                                    result = malloc(sizeof(AZURE_FUNCTIONS_CONFIG));
+                                    if (result == NULL)
+                                    {
+                                        /*Codes_SRS_AZUREFUNCTIONS_17_003: [ AzureFunctions_ParseConfigurationFromJson shall return NULL on failure. ]*/
+                                        LogError("could not allocate AZURE_FUNCTIONS_CONFIG");
+                                    }
+                                    else
+                                    {
+                                        /*Codes_SRS_AZUREFUNCTIONS_17_002: [ AzureFunctions_ParseConfigurationFromJson shall fill the structure with the constructed strings and return it upon success. ]*/
+                                        *result = config;
+                                    }
+                                }
+                            }
+                            if (result == NULL)
+                            {
+                                /* Codes_SRS_AZUREFUNCTIONS_05_014: [ Azure_Functions_CreateFromJson shall release all data it allocated. ] */
+                                STRING_delete(config.hostAddress);
+                                STRING_delete(config.relativePath);
+                                STRING_delete(config.securityKey);
                             }
                         }
-						if (result == NULL)
-						{
-                            /* Codes_SRS_AZUREFUNCTIONS_05_014: [ Azure_Functions_CreateFromJson shall release all data it allocated. ] */
-							STRING_delete(config.hostAddress);
-							STRING_delete(config.relativePath);
-							STRING_delete(config.securityKey);
-						}
                     }
                 }
             }
@@ -267,8 +741,14 @@ static void AzureFunctions_Destroy(MODULE_HANDLE moduleHandle)
     /* Codes_SRS_AZUREFUNCTIONS_04_008: [ If moduleHandle is NULL, azureFunctions_Destroy shall return. ] */
     if (moduleHandle != NULL)
     {
-        /* Codes_SRS_AZUREFUNCTIONS_04_009: [ azureFunctions_Destroy shall release all resources allocated for the module. ] */
         AZURE_FUNCTIONS_DATA * moduleData = (AZURE_FUNCTIONS_DATA*)moduleHandle;
+        size_t senders = moduleData->maxInFlight;
+
+        /*Codes_SRS_AZUREFUNCTIONS_30_010: [ azureFunctions_Destroy shall wait for the senders to post the queued messages and stop. ]*/
+        AzureFunctions_StopSenders(moduleData);
+
+        /* Codes_SRS_AZUREFUNCTIONS_04_009: [ azureFunctions_Destroy shall release all resources allocated for the module. ] */
+        AzureFunctions_FreeSenders(moduleData, senders);
         STRING_delete(moduleData->azureFunctionsConfiguration->hostAddress);
         STRING_delete(moduleData->azureFunctionsConfiguration->relativePath);
         STRING_delete(moduleData->azureFunctionsConfiguration->securityKey);
@@ -294,139 +774,28 @@ static void AzureFunctions_Receive(MODULE_HANDLE moduleHandle, MESSAGE_HANDLE me
     {
         AZURE_FUNCTIONS_DATA*module_data = (AZURE_FUNCTIONS_DATA*)moduleHandle;
 
-        /* Codes_SRS_AZUREFUNCTIONS_04_012: [ azureFunctions_Receive shall get the message content by calling Message_GetContent, if it fails it shall fail and return. ] */
-        const CONSTBUFFER* content = Message_GetContent(messageHandle);
-
-        if (content == NULL)
+        /*Codes_SRS_AZUREFUNCTIONS_30_006: [ azureFunctions_Receive shall queue a clone of the message for the senders, waiting while the queue is full, and return without waiting for the request. ]*/
+        MESSAGE_HANDLE clone = Message_Clone(messageHandle);
+        if (clone == NULL)
         {
-            LogError("unable to get message content.");
+            /*Codes_SRS_AZUREFUNCTIONS_30_007: [ If Message_Clone fails, azureFunctions_Receive shall fail and return. ]*/
+            LogError("unable to Message_Clone");
+        }
+        else if (Lock(module_data->lock) != LOCK_OK)
+        {
+            LogError("unable to Lock");
+            Message_Destroy(clone);
         }
         else
         {
-            /* Codes_SRS_AZUREFUNCTIONS_04_013: [ AzureFunctions_Receive shall base64 encode by calling Base64_Encode_Bytes, if it fails it shall fail and return. ] */
-            STRING_HANDLE contentAsJSON = Base64_Encode_Bytes(content->buffer, content->size);
-            if (contentAsJSON == NULL)
-            {
-                LogError("unable to Base64_Encode_Bytes");
-            }
-            else
+            while (module_data->queueCount == module_data->queueCapacity)
             {
-                STRING_HANDLE jsonToBeAppended = STRING_construct("{");
-                if (jsonToBeAppended == NULL)
-                {
-                    LogError("unable to STRING_construct");
-                }
-                else
-                {
-                    /* Codes_SRS_AZUREFUNCTIONS_04_024: [ AzureFunctions_Receive shall create a JSON STRING with the content of the message received. If it fails it shall fail and return. ] */
-                    if (!((STRING_concat(jsonToBeAppended, "\"content\":\"") == 0) &&
-                        (STRING_concat_with_STRING(jsonToBeAppended, contentAsJSON) == 0) &&
-                        (STRING_concat(jsonToBeAppended, "\"}") == 0)
-                        ))
-                    {
-                        LogError("STRING concatenation error");
-                    }
-                    else
-                    {
-                        /* Codes_SRS_AZUREFUNCTIONS_04_014: [ azureFunctions_Receive shall call HTTPAPIEX_Create, passing hostAddress, it if fails it shall fail and return. ] */
-                        HTTPAPIEX_HANDLE myHTTPEXHandle = HTTPAPIEX_Create(STRING_c_str(module_data->azureFunctionsConfiguration->hostAddress));
-                        if (myHTTPEXHandle == NULL)
-                        {
-                            LogError("Failed to create HTTPAPIEX handle.");
-                        }
-                        else
-                        {
-                            /* Codes_SRS_AZUREFUNCTIONS_04_015: [ azureFunctions_Receive shall call allocate memory to receive data from HTTPAPI by calling BUFFER_new, if it fail it shall fail and return. ] */
-                            BUFFER_HANDLE myResponseBuffer = BUFFER_new();
-
-                            if (myResponseBuffer == NULL)
-                            {
-                                LogError("Failed to create response Buffer.");
-                            }
-                            else
-                            {
-                                /* Codes_SRS_AZUREFUNCTIONS_04_016: [ azureFunctions_Receive shall add name to relative path, if it fail it shall fail and return. ] */
-                                STRING_HANDLE relativePathInfoForRequest = STRING_clone(module_data->azureFunctionsConfiguration->relativePath);
-
-                                if (relativePathInfoForRequest == NULL)
-                                {
-                                    LogError("Error building request String.");
-                                }
-                                else
-                                {
-                                    if ((STRING_concat(relativePathInfoForRequest, "?name=myGatewayDevice") != 0))
-                                    {
-                                        LogError("Error building request String.");
-                                    }
-                                    else
-                                    {
-                                        //Adding HTTP HEaders here. 
-                                        HTTP_HEADERS_HANDLE httpHeaders = HTTPHeaders_Alloc();
-
-                                        if (httpHeaders == NULL)
-                                        {
-                                            LogError("Error creating HttpHeaders");
-                                        }
-                                        else
-                                        {
-                                            /* Codes_SRS_AZUREFUNCTIONS_04_025: [ AzureFunctions_Receive shall add 2 HTTP Headers to POST Request. Content-Type:application/json and, if securityKey exists x-functions-key:securityKey. If it fails it shall fail and return. ] */
-                                            if (HTTPHeaders_AddHeaderNameValuePair(httpHeaders, "Content-Type", "application/json") != HTTP_HEADERS_OK)
-                                            {
-                                                LogError("Error Adding Content-Type header.");
-                                            }
-                                            else if (module_data->azureFunctionsConfiguration->securityKey != NULL &&
-                                                (HTTPHeaders_AddHeaderNameValuePair(httpHeaders, "x-functions-key", STRING_c_str(module_data->azureFunctionsConfiguration->securityKey)) != HTTP_HEADERS_OK))
-                                            {
-                                                LogError("Error Adding Content-Type.");
-                                            }
-                                            else
-                                            {
-
-                                                //Add here the content on the body.
-                                                BUFFER_HANDLE postContent = BUFFER_create(STRING_c_str(jsonToBeAppended), STRING_length(jsonToBeAppended));
-
-                                                if (postContent == NULL)
-                                                {
-                                                    LogError("Error building post content.");
-                                                }
-                                                else
-                                                {
-                                                    unsigned int statuscodeBack = 0;
-                                                    /* Codes_SRS_AZUREFUNCTIONS_04_017: [ azureFunctions_Receive shall HTTPAPIEX_ExecuteRequest to send the HTTP POST to Azure Functions. If it fail it shall fail and return. ] */
-                                                    HTTPAPIEX_RESULT requestResult = HTTPAPIEX_ExecuteRequest(myHTTPEXHandle, HTTPAPI_REQUEST_POST, STRING_c_str(relativePathInfoForRequest), httpHeaders, postContent, &statuscodeBack, NULL, myResponseBuffer);
-
-                                                    if (requestResult != HTTPAPIEX_OK || statuscodeBack != 200)
-                                                    {
-                                                        LogError("Error Sending Request. Status Code: %d", statuscodeBack);
-                                                    }
-                                                    else
-                                                    {
-                                                        /* Codes_SRS_AZUREFUNCTIONS_04_018: [ Upon success azureFunctions_Receive shall log the response from HTTP POST and return. ] */
-                                                        LogInfo("Request Sent to Function Succesfully. Response from Functions: %s", BUFFER_u_char(myResponseBuffer));
-                                                    }
-                                                    BUFFER_delete(postContent);
-                                                }
-                                            }
-                                            /* Codes_SRS_AZUREFUNCTIONS_04_019: [ azureFunctions_Receive shall destroy any allocated memory before returning. ] */
-                                            HTTPHeaders_Free(httpHeaders);
-                                        }
-                                    }
-                                    /* Codes_SRS_AZUREFUNCTIONS_04_019: [ azureFunctions_Receive shall destroy any allocated memory before returning. ] */
-                                    STRING_delete(relativePathInfoForRequest);
-                                }
-                                /* Codes_SRS_AZUREFUNCTIONS_04_019: [ azureFunctions_Receive shall destroy any allocated memory before returning. ] */
-                                BUFFER_delete(myResponseBuffer);
-                            }
-                            /* Codes_SRS_AZUREFUNCTIONS_04_019: [ azureFunctions_Receive shall destroy any allocated memory before returning. ] */
-                            HTTPAPIEX_Destroy(myHTTPEXHandle);
-                        }
-                    }
-                    /* Codes_SRS_AZUREFUNCTIONS_04_019: [ azureFunctions_Receive shall destroy any allocated memory before returning. ] */
-                    STRING_delete(jsonToBeAppended);
-                }
-                /* Codes_SRS_AZUREFUNCTIONS_04_019: [ azureFunctions_Receive shall destroy any allocated memory before returning. ] */
-                STRING_delete(contentAsJSON);
+                (void)Condition_Wait(module_data->spaceCondition, module_data->lock, 0);
             }
+            module_data->queue[(module_data->queueHead + module_data->queueCount) % module_data->queueCapacity] = clone;
+            module_data->queueCount++;
+            (void)Condition_Post(module_data->queueCondition);
+            (void)Unlock(module_data->lock);
         }
     }
 }
@@ -3,8 +3,11 @@
 
 #ifdef __cplusplus
 #include <cstdlib>
+#include <cstring>
 #else
 #include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
 #endif
 
 #include "testrunnerswitcher.h"
@@ -23,6 +26,11 @@ static void* my_gballoc_malloc(size_t size)
     return malloc(size);
 }
 
+static void* my_gballoc_realloc(void* ptr, size_t size)
+{
+    return realloc(ptr, size);
+}
+
 static void my_gballoc_free(void* s)
 {
     free(s);
@@ -34,8 +42,10 @@ static void my_gballoc_free(void* s)
 #include "module_access.h"
 #include "azure_c_shared_utility/strings.h"
 #include "azure_c_shared_utility/httpapiex.h"
+#include "azure_c_shared_utility/lock.h"
+#include "azure_c_shared_utility/condition.h"
+#include "azure_c_shared_utility/threadapi.h"
 #include "message.h"
-#include "azure_c_shared_utility/base64.h"
 #include "azure_c_shared_utility/gballoc.h"
 #include "parson.h"
 
@@ -43,8 +53,11 @@ MOCKABLE_FUNCTION(, JSON_Value*, json_parse_string, const char *, string);
 MOCKABLE_FUNCTION(, const char*, json_object_get_string, const JSON_Object *, object, const char *, name);
 MOCKABLE_FUNCTION(, void, json_value_free, JSON_Value *, value);
 MOCKABLE_FUNCTION(, JSON_Object*, json_value_get_object, const JSON_Value *, value);
+MOCKABLE_FUNCTION(, double, json_object_get_number, const JSON_Object *, object, const char *, name);
 
 MOCKABLE_FUNCTION(, const CONSTBUFFER*, Message_GetContent, MESSAGE_HANDLE, message);
+MOCKABLE_FUNCTION(, MESSAGE_HANDLE, Message_Clone, MESSAGE_HANDLE, message);
+MOCKABLE_FUNCTION(, void, Message_Destroy, MESSAGE_HANDLE, message);
 
 #undef ENABLE_MOCKS
 
@@ -55,6 +68,99 @@ MOCKABLE_FUNCTION(, const CONSTBUFFER*, Message_GetContent, MESSAGE_HANDLE, mess
 static TEST_MUTEX_HANDLE g_testByTest;
 static TEST_MUTEX_HANDLE g_dllByDll;
 
+/*the sender threads are run by ThreadAPI_Join, once Destroy has asked them to stop*/
+#define TEST_MAX_THREADS 4
+static THREAD_START_FUNC g_threadFunc[TEST_MAX_THREADS];
+static void* g_threadArg[TEST_MAX_THREADS];
+static size_t g_threadCount;
+
+static THREADAPI_RESULT my_ThreadAPI_Create(THREAD_HANDLE* threadHandle, THREAD_START_FUNC func, void* arg)
+{
+    THREADAPI_RESULT result;
+    if (g_threadCount == TEST_MAX_THREADS)
+    {
+        result = THREADAPI_ERROR;
+    }
+    else
+    {
+        g_threadFunc[g_threadCount] = func;
+        g_threadArg[g_threadCount] = arg;
+        g_threadCount++;
+        *threadHandle = (THREAD_HANDLE)g_threadCount;
+        result = THREADAPI_OK;
+    }
+    return result;
+}
+
+static THREADAPI_RESULT my_ThreadAPI_Join(THREAD_HANDLE threadHandle, int* res)
+{
+    size_t thread = (size_t)threadHandle - 1;
+    *res = g_threadFunc[thread](g_threadArg[thread]);
+    return THREADAPI_OK;
+}
+
+static MESSAGE_HANDLE my_Message_Clone(MESSAGE_HANDLE message)
+{
+    return message;
+}
+
+static size_t g_destroyedMessages;
+
+static void my_Message_Destroy(MESSAGE_HANDLE message)
+{
+    (void)message;
+    g_destroyedMessages++;
+}
+
+/*messages 0x42, 0x43... carry the contents below, 0x44 does not fit in the first body of a sender*/
+#define TEST_LONG_CONTENT "0123456789abcdef0123456789abcdef0123456789abcdef0123456789abcdef"
+static const char* g_messageContent[] = { "12345", "abc", TEST_LONG_CONTENT TEST_LONG_CONTENT TEST_LONG_CONTENT };
+static CONSTBUFFER g_content[3];
+
+static const CONSTBUFFER* my_Message_GetContent(MESSAGE_HANDLE message)
+{
+    size_t index = (size_t)message - 0x42;
+    g_content[index].buffer = (const unsigned char*)g_messageContent[index];
+    g_content[index].size = strlen(g_messageContent[index]);
+    return &g_content[index];
+}
+
+/*stand-in for the Azure Functions endpoint: it keeps the body of every request it is sent*/
+#define TEST_MAX_BODY 256
+#define TEST_MAX_POSTS 4
+static char g_builtBody[TEST_MAX_BODY];
+static char g_postedBody[TEST_MAX_POSTS][TEST_MAX_BODY];
+static size_t g_postCount;
+static unsigned int g_statusCode;
+static HTTPAPIEX_RESULT g_requestResult;
+
+static int my_BUFFER_build(BUFFER_HANDLE handle, const unsigned char* source, size_t size)
+{
+    (void)handle;
+    ASSERT_IS_TRUE(size < TEST_MAX_BODY);
+    (void)memcpy(g_builtBody, source, size);
+    g_builtBody[size] = '\0';
+    return 0;
+}
+
+static HTTPAPIEX_RESULT my_HTTPAPIEX_ExecuteRequest(HTTPAPIEX_HANDLE handle, HTTPAPI_REQUEST_TYPE requestType, const char* relativePath, HTTP_HEADERS_HANDLE requestHttpHeadersHandle, BUFFER_HANDLE requestContent, unsigned int* statusCode, HTTP_HEADERS_HANDLE responseHttpHeadersHandle, BUFFER_HANDLE responseContent)
+{
+    (void)handle;
+    (void)requestType;
+    (void)relativePath;
+    (void)requestHttpHeadersHandle;
+    (void)requestContent;
+    (void)responseHttpHeadersHandle;
+    (void)responseContent;
+    if (g_postCount < TEST_MAX_POSTS)
+    {
+        (void)strcpy(g_postedBody[g_postCount], g_builtBody);
+    }
+    g_postCount++;
+    *statusCode = g_statusCode;
+    return g_requestResult;
+}
+
 DEFINE_ENUM_STRINGS(UMOCK_C_ERROR_CODE, UMOCK_C_ERROR_CODE_VALUES)
 
 static void on_umock_c_error(UMOCK_C_ERROR_CODE error_code)
@@ -77,8 +183,22 @@ TEST_SUITE_INITIALIZE(suite_init)
 
     REGISTER_GLOBAL_MOCK_HOOK(gballoc_malloc, my_gballoc_malloc);
     REGISTER_GLOBAL_MOCK_FAIL_RETURN(gballoc_malloc, NULL);
+    REGISTER_GLOBAL_MOCK_HOOK(gballoc_realloc, my_gballoc_realloc);
     REGISTER_GLOBAL_MOCK_HOOK(gballoc_free, my_gballoc_free);
 
+    REGISTER_GLOBAL_MOCK_RETURN(Lock_Init, (LOCK_HANDLE)0x44);
+    REGISTER_GLOBAL_MOCK_RETURN(Condition_Init, (COND_HANDLE)0x45);
+    REGISTER_GLOBAL_MOCK_RETURN(HTTPAPIEX_Create, (HTTPAPIEX_HANDLE)0x42);
+    REGISTER_GLOBAL_MOCK_RETURN(HTTPHeaders_Alloc, (HTTP_HEADERS_HANDLE)0x42);
+    REGISTER_GLOBAL_MOCK_RETURN(BUFFER_new, (BUFFER_HANDLE)0x42);
+    REGISTER_GLOBAL_MOCK_HOOK(ThreadAPI_Create, my_ThreadAPI_Create);
+    REGISTER_GLOBAL_MOCK_HOOK(ThreadAPI_Join, my_ThreadAPI_Join);
+    REGISTER_GLOBAL_MOCK_HOOK(Message_Clone, my_Message_Clone);
+    REGISTER_GLOBAL_MOCK_HOOK(Message_Destroy, my_Message_Destroy);
+    REGISTER_GLOBAL_MOCK_HOOK(Message_GetContent, my_Message_GetContent);
+    REGISTER_GLOBAL_MOCK_HOOK(BUFFER_build, my_BUFFER_build);
+    REGISTER_GLOBAL_MOCK_HOOK(HTTPAPIEX_ExecuteRequest, my_HTTPAPIEX_ExecuteRequest);
+
     REGISTER_UMOCK_ALIAS_TYPE(STRING_HANDLE, void*);
 
     REGISTER_UMOCK_ALIAS_TYPE(MODULE_HANDLE, void*);
@@ -96,6 +216,20 @@ TEST_SUITE_INITIALIZE(suite_init)
     REGISTER_UMOCK_ALIAS_TYPE(HTTPAPI_REQUEST_TYPE, int);
 
     REGISTER_UMOCK_ALIAS_TYPE(HTTPAPIEX_RESULT, int);
+
+    REGISTER_UMOCK_ALIAS_TYPE(LOCK_HANDLE, void*);
+
+    REGISTER_UMOCK_ALIAS_TYPE(LOCK_RESULT, int);
+
+    REGISTER_UMOCK_ALIAS_TYPE(COND_HANDLE, void*);
+
+    REGISTER_UMOCK_ALIAS_TYPE(COND_RESULT, int);
+
+    REGISTER_UMOCK_ALIAS_TYPE(THREAD_HANDLE, void*);
+
+    REGISTER_UMOCK_ALIAS_TYPE(THREAD_START_FUNC, void*);
+
+    REGISTER_UMOCK_ALIAS_TYPE(THREADAPI_RESULT, int);
 }
 
 TEST_SUITE_CLEANUP(suite_cleanup)
@@ -113,6 +247,11 @@ TEST_FUNCTION_INITIALIZE(method_init)
     }
 
     umock_c_reset_all_calls();
+    g_threadCount = 0;
+    g_destroyedMessages = 0;
+    g_postCount = 0;
+    g_statusCode = 200;
+    g_requestResult = HTTPAPIEX_OK;
 }
 
 TEST_FUNCTION_CLEANUP(method_cleanup)
@@ -120,6 +259,126 @@ TEST_FUNCTION_CLEANUP(method_cleanup)
     TEST_MUTEX_RELEASE(g_testByTest);
 }
 
+/*the calls of AzureFunctions_Create for a module of one sender*/
+static void expected_calls_create(bool withKey)
+{
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
+        .IgnoreArgument(1);
+
+    STRICT_EXPECTED_CALL(gballoc_malloc(sizeof(AZURE_FUNCTIONS_CONFIG)));
+
+    STRICT_EXPECTED_CALL(STRING_clone((STRING_HANDLE)IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .SetReturn((STRING_HANDLE)0x42);
+
+    STRICT_EXPECTED_CALL(STRING_clone((STRING_HANDLE)IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .SetReturn((STRING_HANDLE)0x42);
+
+    if (withKey)
+    {
+        STRICT_EXPECTED_CALL(STRING_clone((STRING_HANDLE)IGNORED_PTR_ARG))
+            .IgnoreArgument(1)
+            .SetReturn((STRING_HANDLE)0x42);
+    }
+
+    STRICT_EXPECTED_CALL(STRING_clone((STRING_HANDLE)0x42))
+        .SetReturn((STRING_HANDLE)0x42);
+
+    STRICT_EXPECTED_CALL(STRING_concat((STRING_HANDLE)0x42, "?name=myGatewayDevice"));
+
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
+        .IgnoreArgument(1);
+
+    STRICT_EXPECTED_CALL(Lock_Init());
+
+    STRICT_EXPECTED_CALL(Condition_Init());
+
+    STRICT_EXPECTED_CALL(Condition_Init());
+
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
+        .IgnoreArgument(1);
+
+    STRICT_EXPECTED_CALL(STRING_c_str((STRING_HANDLE)0x42))
+        .SetReturn("HostName42");
+
+    STRICT_EXPECTED_CALL(HTTPAPIEX_Create("HostName42"));
+
+    STRICT_EXPECTED_CALL(HTTPHeaders_Alloc());
+
+    STRICT_EXPECTED_CALL(HTTPHeaders_AddHeaderNameValuePair((HTTP_HEADERS_HANDLE)0x42, "Content-Type", "application/json"));
+
+    if (withKey)
+    {
+        STRICT_EXPECTED_CALL(STRING_c_str((STRING_HANDLE)0x42))
+            .SetReturn("codeKey42");
+
+        STRICT_EXPECTED_CALL(HTTPHeaders_AddHeaderNameValuePair((HTTP_HEADERS_HANDLE)0x42, "x-functions-key", "codeKey42"));
+    }
+
+    STRICT_EXPECTED_CALL(BUFFER_new());
+
+    STRICT_EXPECTED_CALL(BUFFER_new());
+
+    STRICT_EXPECTED_CALL(ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
+}
+
+/*the calls of AzureFunctions_Destroy for a module of one sender and an empty queue*/
+static void expected_calls_destroy(bool withKey)
+{
+    STRICT_EXPECTED_CALL(Lock((LOCK_HANDLE)0x44));
+
+    STRICT_EXPECTED_CALL(Condition_Post((COND_HANDLE)0x45));
+
+    STRICT_EXPECTED_CALL(Unlock((LOCK_HANDLE)0x44));
+
+    STRICT_EXPECTED_CALL(ThreadAPI_Join(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
+
+    STRICT_EXPECTED_CALL(Lock((LOCK_HANDLE)0x44));
+
+    STRICT_EXPECTED_CALL(Unlock((LOCK_HANDLE)0x44));
+
+    STRICT_EXPECTED_CALL(HTTPAPIEX_Destroy((HTTPAPIEX_HANDLE)0x42));
+
+    STRICT_EXPECTED_CALL(HTTPHeaders_Free((HTTP_HEADERS_HANDLE)0x42));
+
+    STRICT_EXPECTED_CALL(BUFFER_delete((BUFFER_HANDLE)0x42));
+
+    STRICT_EXPECTED_CALL(BUFFER_delete((BUFFER_HANDLE)0x42));
+
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
+
+    STRICT_EXPECTED_CALL(Condition_Deinit((COND_HANDLE)0x45));
+
+    STRICT_EXPECTED_CALL(Condition_Deinit((COND_HANDLE)0x45));
+
+    STRICT_EXPECTED_CALL(Lock_Deinit((LOCK_HANDLE)0x44));
+
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
+
+    STRICT_EXPECTED_CALL(STRING_delete((STRING_HANDLE)0x42));
+
+    STRICT_EXPECTED_CALL(STRING_delete((STRING_HANDLE)0x42));
+    STRICT_EXPECTED_CALL(STRING_delete((STRING_HANDLE)0x42));
+    if (withKey)
+    {
+        STRICT_EXPECTED_CALL(STRING_delete((STRING_HANDLE)0x42));
+    }
+    else
+    {
+        STRICT_EXPECTED_CALL(STRING_delete(NULL));
+    }
+
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
+
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
+}
 
 /* Tests_SRS_AZUREFUNCTIONS_04_020: [ Module_GetApi shall return the MODULE_API structure. ] */
 TEST_FUNCTION(AZURE_FUNCTIONS_Module_GetApi_returns_non_NULL)
@@ -276,6 +535,10 @@ TEST_FUNCTION(AZUREFUNCTIONS_CreateFromJson_returns_NULL_when_STRING_construct__
         .IgnoreArgument(2)
         .SetReturn("KeyCode42");
 
+    STRICT_EXPECTED_CALL(json_object_get_number((const JSON_Object*)0x42, "maxInFlight"));
+
+    STRICT_EXPECTED_CALL(json_object_get_number((const JSON_Object*)0x42, "batchSize"));
+
     STRICT_EXPECTED_CALL(STRING_construct((const char *)IGNORED_PTR_ARG))
         .IgnoreAllArguments()
         .SetReturn((STRING_HANDLE)0x42);
@@ -324,6 +587,10 @@ TEST_FUNCTION(AZUREFUNCTIONS_CreateFromJson_returns_NULL_when_STRING_construct__
     STRICT_EXPECTED_CALL(json_object_get_string((const JSON_Object*)0x42, "key"))
          .IgnoreArgument(2)
          .SetReturn(NULL);
+
+    STRICT_EXPECTED_CALL(json_object_get_number((const JSON_Object*)0x42, "maxInFlight"));
+
+    STRICT_EXPECTED_CALL(json_object_get_number((const JSON_Object*)0x42, "batchSize"));
  
      STRICT_EXPECTED_CALL(STRING_construct((const char *)IGNORED_PTR_ARG))
          .IgnoreAllArguments()
@@ -378,6 +645,10 @@ TEST_FUNCTION(AZUREFUNCTIONS_CreateFromJson_returns_NULL_when_alloc_fails)
     STRICT_EXPECTED_CALL(json_object_get_string((const JSON_Object*)0x42, "key"))
         .IgnoreArgument(2)
         .SetReturn(NULL);
+
+    STRICT_EXPECTED_CALL(json_object_get_number((const JSON_Object*)0x42, "maxInFlight"));
+
+    STRICT_EXPECTED_CALL(json_object_get_number((const JSON_Object*)0x42, "batchSize"));
  
     STRICT_EXPECTED_CALL(STRING_construct((const char *)IGNORED_PTR_ARG))
         .IgnoreAllArguments();
@@ -446,6 +717,10 @@ TEST_FUNCTION(AZUREFUNCTIONS_CreateFromJson_happy_path)
     STRICT_EXPECTED_CALL(json_object_get_string((const JSON_Object*)0x42, "key"))
          .IgnoreArgument(2)
          .SetReturn("codeKey42");
+
+    STRICT_EXPECTED_CALL(json_object_get_number((const JSON_Object*)0x42, "maxInFlight"));
+
+    STRICT_EXPECTED_CALL(json_object_get_number((const JSON_Object*)0x42, "batchSize"));
  
      STRICT_EXPECTED_CALL(STRING_construct((const char *)IGNORED_PTR_ARG))
          .IgnoreAllArguments()
@@ -473,6 +748,84 @@ TEST_FUNCTION(AZUREFUNCTIONS_CreateFromJson_happy_path)
 
 }
 
+/*Tests_SRS_AZUREFUNCTIONS_30_002: [ If "maxInFlight" is negative or above AZURE_FUNCTIONS_MAX_IN_FLIGHT, or "batchSize" is negative or above AZURE_FUNCTIONS_MAX_BATCH_SIZE, AzureFunctions_ParseConfigurationFromJson shall fail and return NULL. ]*/
+TEST_FUNCTION(AZUREFUNCTIONS_CreateFromJson_returns_NULL_when_maxInFlight_out_of_range)
+{
+    // arrange
+    const MODULE_API* apis = Module_GetApi(MODULE_API_VERSION_1);
+
+    STRICT_EXPECTED_CALL(json_parse_string((const char*)0x42))
+        .SetReturn((JSON_Value*)0x42);
+
+    STRICT_EXPECTED_CALL(json_value_get_object((JSON_Value*)0x42))
+        .SetReturn((JSON_Object*)0x42);
+
+    STRICT_EXPECTED_CALL(json_object_get_string((const JSON_Object*)0x42, "hostname"))
+        .IgnoreArgument(2)
+        .SetReturn("HostName42");
+
+    STRICT_EXPECTED_CALL(json_object_get_string((const JSON_Object*)0x42, "relativePath"))
+        .IgnoreArgument(2)
+        .SetReturn("relativePath42");
+
+    STRICT_EXPECTED_CALL(json_object_get_string((const JSON_Object*)0x42, "key"))
+        .IgnoreArgument(2)
+        .SetReturn("codeKey42");
+
+    STRICT_EXPECTED_CALL(json_object_get_number((const JSON_Object*)0x42, "maxInFlight"))
+        .SetReturn(AZURE_FUNCTIONS_MAX_IN_FLIGHT + 1);
+
+    STRICT_EXPECTED_CALL(json_object_get_number((const JSON_Object*)0x42, "batchSize"));
+
+    STRICT_EXPECTED_CALL(json_value_free((JSON_Value*)0x42));
+
+    // act
+    void* result = MODULE_PARSE_CONFIGURATION_FROM_JSON(apis)((const char*)0x42);
+
+    //assert
+    ASSERT_IS_NULL(result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/*Tests_SRS_AZUREFUNCTIONS_30_002: [ If "maxInFlight" is negative or above AZURE_FUNCTIONS_MAX_IN_FLIGHT, or "batchSize" is negative or above AZURE_FUNCTIONS_MAX_BATCH_SIZE, AzureFunctions_ParseConfigurationFromJson shall fail and return NULL. ]*/
+TEST_FUNCTION(AZUREFUNCTIONS_CreateFromJson_returns_NULL_when_batchSize_negative)
+{
+    // arrange
+    const MODULE_API* apis = Module_GetApi(MODULE_API_VERSION_1);
+
+    STRICT_EXPECTED_CALL(json_parse_string((const char*)0x42))
+        .SetReturn((JSON_Value*)0x42);
+
+    STRICT_EXPECTED_CALL(json_value_get_object((JSON_Value*)0x42))
+        .SetReturn((JSON_Object*)0x42);
+
+    STRICT_EXPECTED_CALL(json_object_get_string((const JSON_Object*)0x42, "hostname"))
+        .IgnoreArgument(2)
+        .SetReturn("HostName42");
+
+    STRICT_EXPECTED_CALL(json_object_get_string((const JSON_Object*)0x42, "relativePath"))
+        .IgnoreArgument(2)
+        .SetReturn("relativePath42");
+
+    STRICT_EXPECTED_CALL(json_object_get_string((const JSON_Object*)0x42, "key"))
+        .IgnoreArgument(2)
+        .SetReturn("codeKey42");
+
+    STRICT_EXPECTED_CALL(json_object_get_number((const JSON_Object*)0x42, "maxInFlight"));
+
+    STRICT_EXPECTED_CALL(json_object_get_number((const JSON_Object*)0x42, "batchSize"))
+        .SetReturn(-1);
+
+    STRICT_EXPECTED_CALL(json_value_free((JSON_Value*)0x42));
+
+    // act
+    void* result = MODULE_PARSE_CONFIGURATION_FROM_JSON(apis)((const char*)0x42);
+
+    //assert
+    ASSERT_IS_NULL(result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
 /*Tests_SRS_AZUREFUNCTIONS_17_004: [ AzureFunctions_FreeConfiguration shall do nothing if configuration is NULL. ]*/
 TEST_FUNCTION(AZURE_FUNCTIONS_FreeConfiguration_null_does_nothing)
 {
@@ -508,6 +861,10 @@ TEST_FUNCTION(AZURE_FUNCTIONS_FreeConfiguration_frees_config)
 		.IgnoreArgument(2)
 		.SetReturn("codeKey42");
 
+	STRICT_EXPECTED_CALL(json_object_get_number((const JSON_Object*)0x42, "maxInFlight"));
+
+	STRICT_EXPECTED_CALL(json_object_get_number((const JSON_Object*)0x42, "batchSize"));
+
 	STRICT_EXPECTED_CALL(STRING_construct((const char *)IGNORED_PTR_ARG))
 		.IgnoreAllArguments()
 		.SetReturn((STRING_HANDLE)0x42);
@@ -558,25 +915,12 @@ TEST_FUNCTION(AZURE_FUNCTIONS_Create_happy_Path_with_key)
     config.relativePath = (STRING_HANDLE)0x42;
     config.hostAddress = (STRING_HANDLE)0x42;
     config.securityKey = (STRING_HANDLE)0x42;
+    config.maxInFlight = 1;
+    config.batchSize = 0;
 
     umock_c_reset_all_calls();
 
-    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
-        .IgnoreArgument(1);
-
-    STRICT_EXPECTED_CALL(gballoc_malloc(sizeof(AZURE_FUNCTIONS_CONFIG)));
-
-    STRICT_EXPECTED_CALL(STRING_clone((STRING_HANDLE)IGNORED_PTR_ARG))
-        .IgnoreArgument(1)
-        .SetReturn((STRING_HANDLE)0x42);
-
-    STRICT_EXPECTED_CALL(STRING_clone((STRING_HANDLE)IGNORED_PTR_ARG))
-        .IgnoreArgument(1)
-        .SetReturn((STRING_HANDLE)0x42);
-
-    STRICT_EXPECTED_CALL(STRING_clone((STRING_HANDLE)IGNORED_PTR_ARG))
-        .IgnoreArgument(1)
-        .SetReturn((STRING_HANDLE)0x42);
+    expected_calls_create(true);
 
   //act
     MODULE_HANDLE result = MODULE_CREATE(apis)((BROKER_HANDLE)0x42,  (const void*)&config);
@@ -604,21 +948,12 @@ TEST_FUNCTION(AZURE_FUNCTIONS_Create_happy_Path_without_key)
     config.relativePath = (STRING_HANDLE)0x42;
     config.hostAddress = (STRING_HANDLE)0x42;
     config.securityKey = NULL;
+    config.maxInFlight = 1;
+    config.batchSize = 0;
 
     umock_c_reset_all_calls();
 
-    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
-        .IgnoreArgument(1);
-
-    STRICT_EXPECTED_CALL(gballoc_malloc(sizeof(AZURE_FUNCTIONS_CONFIG)));
-
-    STRICT_EXPECTED_CALL(STRING_clone((STRING_HANDLE)IGNORED_PTR_ARG))
-        .IgnoreArgument(1)
-        .SetReturn((STRING_HANDLE)0x42);
-
-    STRICT_EXPECTED_CALL(STRING_clone((STRING_HANDLE)IGNORED_PTR_ARG))
-        .IgnoreArgument(1)
-        .SetReturn((STRING_HANDLE)0x42);
+    expected_calls_create(false);
 
     //act
     MODULE_HANDLE result = MODULE_CREATE(apis)((BROKER_HANDLE)0x42, (const void*)&config);
@@ -675,6 +1010,8 @@ TEST_FUNCTION(AZURE_FUNCTIONS_Create_returns_NULL_when_hostAddress_is_NULL)
     AZURE_FUNCTIONS_CONFIG config;
     config.relativePath = (STRING_HANDLE)0x42;
     config.hostAddress = NULL;
+    config.maxInFlight = 1;
+    config.batchSize = 0;
 
     umock_c_reset_all_calls();
 
@@ -696,6 +1033,8 @@ TEST_FUNCTION(AZURE_FUNCTIONS_Create_returns_NULL_when_relativePath_is_NULL)
     AZURE_FUNCTIONS_CONFIG config;
     config.relativePath = NULL;
     config.hostAddress = (STRING_HANDLE)0x42;
+    config.maxInFlight = 1;
+    config.batchSize = 0;
 
     umock_c_reset_all_calls();
 
@@ -717,6 +1056,8 @@ TEST_FUNCTION(AZURE_FUNCTIONS_Create_returns_NULL_failed_To_Allocate_Handle)
     AZURE_FUNCTIONS_CONFIG config;
     config.relativePath = (STRING_HANDLE)0x42;
     config.hostAddress = (STRING_HANDLE)0x42;
+    config.maxInFlight = 1;
+    config.batchSize = 0;
     
     umock_c_reset_all_calls();
 
@@ -742,6 +1083,8 @@ TEST_FUNCTION(AZURE_FUNCTIONS_Create_returns_NULL_failed_To_Allocate_configurati
     AZURE_FUNCTIONS_CONFIG config;
     config.relativePath = (STRING_HANDLE)0x42;
     config.hostAddress = (STRING_HANDLE)0x42;
+    config.maxInFlight = 1;
+    config.batchSize = 0;
 
     umock_c_reset_all_calls();
 
@@ -773,6 +1116,8 @@ TEST_FUNCTION(AZURE_FUNCTIONS_Create_returns_NULL_failed_to_clone_hostAddress)
     AZURE_FUNCTIONS_CONFIG config;
     config.relativePath = (STRING_HANDLE)0x42;
     config.hostAddress = (STRING_HANDLE)0x42;
+    config.maxInFlight = 1;
+    config.batchSize = 0;
 
     umock_c_reset_all_calls();
 
@@ -810,6 +1155,8 @@ TEST_FUNCTION(AZURE_FUNCTIONS_Create_returns_NULL_failed_to_clone_relativePath)
     AZURE_FUNCTIONS_CONFIG config;
     config.relativePath = (STRING_HANDLE)0x42;
     config.hostAddress = (STRING_HANDLE)0x42;
+    config.maxInFlight = 1;
+    config.batchSize = 0;
 
     umock_c_reset_all_calls();
 
@@ -853,6 +1200,8 @@ TEST_FUNCTION(AZURE_FUNCTIONS_Create_returns_NULL_failed_to_clone_securityKey)
     config.relativePath = (STRING_HANDLE)0x42;
     config.hostAddress = (STRING_HANDLE)0x42;
     config.securityKey = (STRING_HANDLE)0x42;
+    config.maxInFlight = 1;
+    config.batchSize = 0;
 
     umock_c_reset_all_calls();
 
@@ -892,29 +1241,20 @@ TEST_FUNCTION(AZURE_FUNCTIONS_Create_returns_NULL_failed_to_clone_securityKey)
     ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
 }
 
-/* Tests_SRS_AZUREFUNCTIONS_04_008: [ If moduleHandle is NULL, azure_functions_Destroy shall return. ] */
-TEST_FUNCTION(AZURE_FUNCTIONS_Destroy_does_nothing_if_module_handle_null)
-{
-    // arrange
-    const MODULE_API* apis = Module_GetApi(MODULE_API_VERSION_1);
-
-    MODULE_DESTROY(apis)(NULL);
-
-    //assert
-    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
-}
-
-/* Tests_SRS_AZUREFUNCTIONS_04_009: [ azure_functions_Destroy shall release all resources allocated for the module. ] */
-TEST_FUNCTION(AZURE_FUNCTIONS_Destroy_happy_path_with_securityKey)
+/*Tests_SRS_AZUREFUNCTIONS_30_003: [ If maxInFlight is above AZURE_FUNCTIONS_MAX_IN_FLIGHT or batchSize is above AZURE_FUNCTIONS_MAX_BATCH_SIZE, AzureFunctions_Create shall fail and return NULL. ]*/
+TEST_FUNCTION(AZURE_FUNCTIONS_Create_returns_NULL_when_batchSize_out_of_range)
 {
-
     // arrange
     const MODULE_API* apis = Module_GetApi(MODULE_API_VERSION_1);
 
     AZURE_FUNCTIONS_CONFIG config;
     config.relativePath = (STRING_HANDLE)0x42;
     config.hostAddress = (STRING_HANDLE)0x42;
-    config.securityKey = (STRING_HANDLE)0x42;
+    config.securityKey = NULL;
+    config.maxInFlight = 1;
+    config.batchSize = AZURE_FUNCTIONS_MAX_BATCH_SIZE + 1;
+
+    umock_c_reset_all_calls();
 
     STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
         .IgnoreArgument(1);
@@ -929,17 +1269,10 @@ TEST_FUNCTION(AZURE_FUNCTIONS_Destroy_happy_path_with_securityKey)
         .IgnoreArgument(1)
         .SetReturn((STRING_HANDLE)0x42);
 
-    STRICT_EXPECTED_CALL(STRING_clone((STRING_HANDLE)IGNORED_PTR_ARG))
-        .IgnoreArgument(1)
-        .SetReturn((STRING_HANDLE)0x42);
-
-    MODULE_HANDLE result = MODULE_CREATE(apis)((BROKER_HANDLE)0x42, (const void*)&config);
-    ASSERT_IS_NOT_NULL(result);
-
-    umock_c_reset_all_calls();
+    STRICT_EXPECTED_CALL(STRING_delete(NULL));
 
     STRICT_EXPECTED_CALL(STRING_delete((STRING_HANDLE)0x42));
-    STRICT_EXPECTED_CALL(STRING_delete((STRING_HANDLE)0x42));
+
     STRICT_EXPECTED_CALL(STRING_delete((STRING_HANDLE)0x42));
 
     STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG))
@@ -948,18 +1281,18 @@ TEST_FUNCTION(AZURE_FUNCTIONS_Destroy_happy_path_with_securityKey)
     STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG))
         .IgnoreAllArguments();
 
-
     //act
-    MODULE_DESTROY(apis)(result);
+    MODULE_HANDLE result = MODULE_CREATE(apis)((BROKER_HANDLE)0x42, (const void*)&config);
 
     //assert
+    ASSERT_IS_NULL(result);
     ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
 }
 
-/* Tests_SRS_AZUREFUNCTIONS_04_009: [ azure_functions_Destroy shall release all resources allocated for the module. ] */
-TEST_FUNCTION(AZURE_FUNCTIONS_Destroy_happy_path_without_securityKey)
+/* Tests_SRS_AZUREFUNCTIONS_04_014: [ AzureFunctions_Create shall call HTTPAPIEX_Create, passing hostAddress, once per sender, which keeps it for every request. If it fails it shall fail and return NULL. ] */
+/*Tests_SRS_AZUREFUNCTIONS_30_005: [ If starting a sender fails, AzureFunctions_Create shall stop the started senders, release all resources and return NULL. ]*/
+TEST_FUNCTION(AZURE_FUNCTIONS_Create_returns_NULL_when_HTTPAPIEX_Create_fails)
 {
-
     // arrange
     const MODULE_API* apis = Module_GetApi(MODULE_API_VERSION_1);
 
@@ -967,6 +1300,10 @@ TEST_FUNCTION(AZURE_FUNCTIONS_Destroy_happy_path_without_securityKey)
     config.relativePath = (STRING_HANDLE)0x42;
     config.hostAddress = (STRING_HANDLE)0x42;
     config.securityKey = NULL;
+    config.maxInFlight = 1;
+    config.batchSize = 0;
+
+    umock_c_reset_all_calls();
 
     STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
         .IgnoreArgument(1);
@@ -981,273 +1318,259 @@ TEST_FUNCTION(AZURE_FUNCTIONS_Destroy_happy_path_without_securityKey)
         .IgnoreArgument(1)
         .SetReturn((STRING_HANDLE)0x42);
 
-    MODULE_HANDLE result = MODULE_CREATE(apis)((BROKER_HANDLE)0x42, (const void*)&config);
-    ASSERT_IS_NOT_NULL(result);
+    STRICT_EXPECTED_CALL(STRING_clone((STRING_HANDLE)0x42))
+        .SetReturn((STRING_HANDLE)0x42);
 
-    umock_c_reset_all_calls();
+    STRICT_EXPECTED_CALL(STRING_concat((STRING_HANDLE)0x42, "?name=myGatewayDevice"));
 
-    STRICT_EXPECTED_CALL(STRING_delete((STRING_HANDLE)0x42));
-    STRICT_EXPECTED_CALL(STRING_delete((STRING_HANDLE)0x42));
-    STRICT_EXPECTED_CALL(STRING_delete(NULL));
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
+        .IgnoreArgument(1);
 
-    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG))
-        .IgnoreAllArguments();
+    STRICT_EXPECTED_CALL(Lock_Init());
+
+    STRICT_EXPECTED_CALL(Condition_Init());
+
+    STRICT_EXPECTED_CALL(Condition_Init());
+
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
+        .IgnoreArgument(1);
+
+    STRICT_EXPECTED_CALL(STRING_c_str((STRING_HANDLE)0x42))
+        .SetReturn("HostName42");
+
+    STRICT_EXPECTED_CALL(HTTPAPIEX_Create("HostName42"))
+        .SetReturn(NULL);
+
+    // cleanup after forced failure
 
     STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG))
         .IgnoreAllArguments();
 
+    STRICT_EXPECTED_CALL(Lock((LOCK_HANDLE)0x44));
 
-    //act
-    MODULE_DESTROY(apis)(result);
+    STRICT_EXPECTED_CALL(Unlock((LOCK_HANDLE)0x44));
 
-    //assert
-    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
-}
+    STRICT_EXPECTED_CALL(Condition_Deinit((COND_HANDLE)0x45));
 
+    STRICT_EXPECTED_CALL(Condition_Deinit((COND_HANDLE)0x45));
 
-/* Tests_SRS_AZUREFUNCTIONS_04_010: [If moduleHandle is NULL than azure_functions_Receive shall fail and return.] */
-TEST_FUNCTION(AZURE_FUNCTIONS_Receive_doesNothing_if_moduleHandleIsNull)
-{
-    // arrange
-    const MODULE_API* apis = Module_GetApi(MODULE_API_VERSION_1);
+    STRICT_EXPECTED_CALL(Lock_Deinit((LOCK_HANDLE)0x44));
 
-    //act
-    MODULE_RECEIVE(apis)(NULL, (MESSAGE_HANDLE)0x42);
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
 
-    //assert
-    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
-}
+    STRICT_EXPECTED_CALL(STRING_delete((STRING_HANDLE)0x42));
 
-/* Tests_SRS_AZUREFUNCTIONS_04_011: [ If messageHandle is NULL than azure_functions_Receive shall fail and return. ] */
-TEST_FUNCTION(AZURE_FUNCTIONS_Receive_doesNothing_if_messageHandleIsNull)
-{
-    // arrange
-    const MODULE_API* apis = Module_GetApi(MODULE_API_VERSION_1);
+    STRICT_EXPECTED_CALL(STRING_delete(NULL));
 
-    //act
-    MODULE_RECEIVE(apis)((MODULE_HANDLE)0x42, NULL);
+    STRICT_EXPECTED_CALL(STRING_delete((STRING_HANDLE)0x42));
 
-    //assert
-    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
-}
+    STRICT_EXPECTED_CALL(STRING_delete((STRING_HANDLE)0x42));
 
-/* Tests_SRS_AZUREFUNCTIONS_04_012: [ azure_functions_Receive shall get the message content by calling Message_GetContent, if it fails it shall fail and return. ] */
-TEST_FUNCTION(AZURE_FUNCTIONS_Receive_fails_when_Message_getContent_fail)
-{
-    // arrange
-    const MODULE_API* apis = Module_GetApi(MODULE_API_VERSION_1);
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
 
-    STRICT_EXPECTED_CALL(Message_GetContent((MESSAGE_HANDLE)0x42))
-        .SetReturn(NULL);
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
 
     //act
-    MODULE_RECEIVE(apis)((MODULE_HANDLE)0x42, (MESSAGE_HANDLE)0x42);
+    MODULE_HANDLE result = MODULE_CREATE(apis)((BROKER_HANDLE)0x42, (const void*)&config);
 
     //assert
+    ASSERT_IS_NULL(result);
     ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
 }
 
-/* Tests_SRS_AZUREFUNCTIONS_04_013: [ azure_functions_Receive shall base64 encode by calling Base64_Encode_Bytes, if it fails it shall fail and return. ] */
-TEST_FUNCTION(AZURE_FUNCTIONS_Receive_fails_when_Base64_Encode_fail)
+/*Tests_SRS_AZUREFUNCTIONS_30_005: [ If starting a sender fails, AzureFunctions_Create shall stop the started senders, release all resources and return NULL. ]*/
+TEST_FUNCTION(AZURE_FUNCTIONS_Create_returns_NULL_when_ThreadAPI_Create_fails)
 {
     // arrange
     const MODULE_API* apis = Module_GetApi(MODULE_API_VERSION_1);
 
-    CONSTBUFFER buffer;
-    buffer.buffer = (const unsigned char*)"12345";
-    buffer.size = sizeof("12345");
-    
-    umock_c_reset_all_calls();
+    AZURE_FUNCTIONS_CONFIG config;
+    config.relativePath = (STRING_HANDLE)0x42;
+    config.hostAddress = (STRING_HANDLE)0x42;
+    config.securityKey = NULL;
+    config.maxInFlight = TEST_MAX_THREADS + 1;
+    config.batchSize = 0;
 
-    STRICT_EXPECTED_CALL(Message_GetContent((MESSAGE_HANDLE)0x42))
-        .SetReturn(&buffer);
+    STRICT_EXPECTED_CALL(STRING_clone((STRING_HANDLE)IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .SetReturn((STRING_HANDLE)0x42);
 
-    STRICT_EXPECTED_CALL(Base64_Encode_Bytes(buffer.buffer, buffer.size))
-        .SetReturn(NULL);
+    STRICT_EXPECTED_CALL(STRING_clone((STRING_HANDLE)IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .SetReturn((STRING_HANDLE)0x42);
+
+    STRICT_EXPECTED_CALL(STRING_clone((STRING_HANDLE)0x42))
+        .SetReturn((STRING_HANDLE)0x42);
 
     //act
-    MODULE_RECEIVE(apis)((MODULE_HANDLE)0x42, (MESSAGE_HANDLE)0x42);
+    MODULE_HANDLE result = MODULE_CREATE(apis)((BROKER_HANDLE)0x42, (const void*)&config);
 
     //assert
-    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_IS_NULL(result);
+    ASSERT_ARE_EQUAL(size_t, TEST_MAX_THREADS, g_threadCount);
+    /*the senders that started were joined, every sender made was released*/
+    ASSERT_IS_NOT_NULL(strstr(umock_c_get_actual_calls(), "[ThreadAPI_Join("));
+    ASSERT_IS_NOT_NULL(strstr(umock_c_get_actual_calls(), "[HTTPAPIEX_Destroy("));
 }
 
-
-/* Tests_SRS_AZUREFUNCTIONS_04_024: [ AzureFunctions_Receive shall create a JSON STRING with the content of the message received. If it fails it shall fail and return. ] */
-TEST_FUNCTION(AZURE_FUNCTIONS_Receive_fails_when_STRING_construct_fail)
+/* Tests_SRS_AZUREFUNCTIONS_04_016: [ AzureFunctions_Create shall add name to a copy of the relative path the senders use for every request, if it fails it shall fail and return NULL. ] */
+TEST_FUNCTION(AZURE_FUNCTIONS_Create_returns_NULL_when_request_path_STRING_clone_fails)
 {
     // arrange
     const MODULE_API* apis = Module_GetApi(MODULE_API_VERSION_1);
 
-    CONSTBUFFER buffer;
-    buffer.buffer = (const unsigned char*)"12345";
-    buffer.size = sizeof("12345");
-
-    umock_c_reset_all_calls();
+    AZURE_FUNCTIONS_CONFIG config;
+    config.relativePath = (STRING_HANDLE)0x42;
+    config.hostAddress = (STRING_HANDLE)0x42;
+    config.securityKey = NULL;
+    config.maxInFlight = 1;
+    config.batchSize = 0;
 
-    STRICT_EXPECTED_CALL(Message_GetContent((MESSAGE_HANDLE)0x42))
-        .SetReturn(&buffer);
+    STRICT_EXPECTED_CALL(STRING_clone((STRING_HANDLE)IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .SetReturn((STRING_HANDLE)0x42);
 
-    STRICT_EXPECTED_CALL(Base64_Encode_Bytes(buffer.buffer, buffer.size))
+    STRICT_EXPECTED_CALL(STRING_clone((STRING_HANDLE)IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
         .SetReturn((STRING_HANDLE)0x42);
 
-    STRICT_EXPECTED_CALL(STRING_construct(IGNORED_PTR_ARG))
-        .IgnoreAllArguments()
+    STRICT_EXPECTED_CALL(STRING_clone((STRING_HANDLE)0x42))
         .SetReturn(NULL);
 
-    STRICT_EXPECTED_CALL(STRING_delete((STRING_HANDLE)0x42));
-
-
     //act
-    MODULE_RECEIVE(apis)((MODULE_HANDLE)0x42, (MESSAGE_HANDLE)0x42);
+    MODULE_HANDLE result = MODULE_CREATE(apis)((BROKER_HANDLE)0x42, (const void*)&config);
 
     //assert
-    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_IS_NULL(result);
+    /*no sender was started*/
+    ASSERT_IS_NULL(strstr(umock_c_get_actual_calls(), "[HTTPAPIEX_Create("));
 }
 
-/* Tests_SRS_AZUREFUNCTIONS_04_024: [ AzureFunctions_Receive shall create a JSON STRING with the content of the message received. If it fails it shall fail and return. ] */
-TEST_FUNCTION(AZURE_FUNCTIONS_Receive_fails_when_STRING_concat1_fail)
+/* Tests_SRS_AZUREFUNCTIONS_04_016: [ AzureFunctions_Create shall add name to a copy of the relative path the senders use for every request, if it fails it shall fail and return NULL. ] */
+TEST_FUNCTION(AZURE_FUNCTIONS_Create_returns_NULL_when_request_path_STRING_concat_fails)
 {
     // arrange
     const MODULE_API* apis = Module_GetApi(MODULE_API_VERSION_1);
 
-    CONSTBUFFER buffer;
-    buffer.buffer = (const unsigned char*)"12345";
-    buffer.size = sizeof("12345");
-
-    umock_c_reset_all_calls();
-
-    STRICT_EXPECTED_CALL(Message_GetContent((MESSAGE_HANDLE)0x42))
-        .SetReturn(&buffer);
+    AZURE_FUNCTIONS_CONFIG config;
+    config.relativePath = (STRING_HANDLE)0x42;
+    config.hostAddress = (STRING_HANDLE)0x42;
+    config.securityKey = NULL;
+    config.maxInFlight = 1;
+    config.batchSize = 0;
 
-    STRICT_EXPECTED_CALL(Base64_Encode_Bytes(buffer.buffer, buffer.size))
+    STRICT_EXPECTED_CALL(STRING_clone((STRING_HANDLE)IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
         .SetReturn((STRING_HANDLE)0x42);
 
-    STRICT_EXPECTED_CALL(STRING_construct(IGNORED_PTR_ARG))
-        .IgnoreAllArguments()
+    STRICT_EXPECTED_CALL(STRING_clone((STRING_HANDLE)IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
         .SetReturn((STRING_HANDLE)0x42);
 
-    STRICT_EXPECTED_CALL(STRING_concat((STRING_HANDLE)0x42, IGNORED_PTR_ARG))
-        .IgnoreArgument(2)
-        .SetReturn(-1);
-
-    STRICT_EXPECTED_CALL(STRING_delete((STRING_HANDLE)0x42));
-
-    STRICT_EXPECTED_CALL(STRING_delete((STRING_HANDLE)0x42));
+    STRICT_EXPECTED_CALL(STRING_clone((STRING_HANDLE)0x42))
+        .SetReturn((STRING_HANDLE)0x42);
 
+    STRICT_EXPECTED_CALL(STRING_concat((STRING_HANDLE)0x42, "?name=myGatewayDevice"))
+        .SetReturn(__LINE__);
 
     //act
-    MODULE_RECEIVE(apis)((MODULE_HANDLE)0x42, (MESSAGE_HANDLE)0x42);
+    MODULE_HANDLE result = MODULE_CREATE(apis)((BROKER_HANDLE)0x42, (const void*)&config);
 
     //assert
-    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_IS_NULL(result);
+    /*no sender was started*/
+    ASSERT_IS_NULL(strstr(umock_c_get_actual_calls(), "[HTTPAPIEX_Create("));
 }
 
-/* Tests_SRS_AZUREFUNCTIONS_04_024: [ AzureFunctions_Receive shall create a JSON STRING with the content of the message received. If it fails it shall fail and return. ] */
-TEST_FUNCTION(AZURE_FUNCTIONS_Receive_fails_when_STRING_concat_with_STRING_fail)
+/*Tests_SRS_AZUREFUNCTIONS_30_005: [ If starting a sender fails, AzureFunctions_Create shall stop the started senders, release all resources and return NULL. ]*/
+TEST_FUNCTION(AZURE_FUNCTIONS_Create_returns_NULL_when_HTTPHeaders_Alloc_fails)
 {
     // arrange
     const MODULE_API* apis = Module_GetApi(MODULE_API_VERSION_1);
 
-    CONSTBUFFER buffer;
-    buffer.buffer = (const unsigned char*)"12345";
-    buffer.size = sizeof("12345");
-
-    umock_c_reset_all_calls();
-
-    STRICT_EXPECTED_CALL(Message_GetContent((MESSAGE_HANDLE)0x42))
-        .SetReturn(&buffer);
+    AZURE_FUNCTIONS_CONFIG config;
+    config.relativePath = (STRING_HANDLE)0x42;
+    config.hostAddress = (STRING_HANDLE)0x42;
+    config.securityKey = NULL;
+    config.maxInFlight = 1;
+    config.batchSize = 0;
 
-    STRICT_EXPECTED_CALL(Base64_Encode_Bytes(buffer.buffer, buffer.size))
+    STRICT_EXPECTED_CALL(STRING_clone((STRING_HANDLE)IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
         .SetReturn((STRING_HANDLE)0x42);
 
-    STRICT_EXPECTED_CALL(STRING_construct(IGNORED_PTR_ARG))
-        .IgnoreAllArguments()
+    STRICT_EXPECTED_CALL(STRING_clone((STRING_HANDLE)IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
         .SetReturn((STRING_HANDLE)0x42);
 
-    STRICT_EXPECTED_CALL(STRING_concat((STRING_HANDLE)0x42, IGNORED_PTR_ARG))
-        .IgnoreArgument(2)
-        .SetReturn(0);
-
-    STRICT_EXPECTED_CALL(STRING_concat_with_STRING((STRING_HANDLE)0x42, (STRING_HANDLE)0x42))
-        .SetReturn(-1);
-
-    STRICT_EXPECTED_CALL(STRING_delete((STRING_HANDLE)0x42));
-
-    STRICT_EXPECTED_CALL(STRING_delete((STRING_HANDLE)0x42));
+    STRICT_EXPECTED_CALL(STRING_clone((STRING_HANDLE)0x42))
+        .SetReturn((STRING_HANDLE)0x42);
 
+    STRICT_EXPECTED_CALL(HTTPHeaders_Alloc())
+        .SetReturn(NULL);
 
     //act
-    MODULE_RECEIVE(apis)((MODULE_HANDLE)0x42, (MESSAGE_HANDLE)0x42);
+    MODULE_HANDLE result = MODULE_CREATE(apis)((BROKER_HANDLE)0x42, (const void*)&config);
 
     //assert
-    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_IS_NULL(result);
+    /*the sender was released*/
+    ASSERT_IS_NOT_NULL(strstr(umock_c_get_actual_calls(), "[HTTPAPIEX_Destroy("));
+    ASSERT_IS_NULL(strstr(umock_c_get_actual_calls(), "[ThreadAPI_Create("));
 }
 
-/* Tests_SRS_AZUREFUNCTIONS_04_024: [ AzureFunctions_Receive shall create a JSON STRING with the content of the message received. If it fails it shall fail and return. ] */
-TEST_FUNCTION(AZURE_FUNCTIONS_Receive_fails_when_STRING_concat2_fail)
+/* Tests_SRS_AZUREFUNCTIONS_04_025: [ AzureFunctions_Create shall add 2 HTTP Headers to the requests of every sender. Content-Type:application/json and, if securityKey exists x-functions-key:securityKey. If it fails it shall fail and return NULL. ] */
+TEST_FUNCTION(AZURE_FUNCTIONS_Create_returns_NULL_when_HTTPHeaders_AddHeaderNameValuePair_fails)
 {
     // arrange
     const MODULE_API* apis = Module_GetApi(MODULE_API_VERSION_1);
 
-    CONSTBUFFER buffer;
-    buffer.buffer = (const unsigned char*)"12345";
-    buffer.size = sizeof("12345");
-
-    umock_c_reset_all_calls();
-
-    STRICT_EXPECTED_CALL(Message_GetContent((MESSAGE_HANDLE)0x42))
-        .SetReturn(&buffer);
+    AZURE_FUNCTIONS_CONFIG config;
+    config.relativePath = (STRING_HANDLE)0x42;
+    config.hostAddress = (STRING_HANDLE)0x42;
+    config.securityKey = NULL;
+    config.maxInFlight = 1;
+    config.batchSize = 0;
 
-    STRICT_EXPECTED_CALL(Base64_Encode_Bytes(buffer.buffer, buffer.size))
+    STRICT_EXPECTED_CALL(STRING_clone((STRING_HANDLE)IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
         .SetReturn((STRING_HANDLE)0x42);
 
-    STRICT_EXPECTED_CALL(STRING_construct(IGNORED_PTR_ARG))
-        .IgnoreAllArguments()
+    STRICT_EXPECTED_CALL(STRING_clone((STRING_HANDLE)IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
         .SetReturn((STRING_HANDLE)0x42);
 
-    STRICT_EXPECTED_CALL(STRING_concat((STRING_HANDLE)0x42, IGNORED_PTR_ARG))
-        .IgnoreArgument(2)
-        .SetReturn(0);
-
-    STRICT_EXPECTED_CALL(STRING_concat_with_STRING((STRING_HANDLE)0x42, (STRING_HANDLE)0x42))
-        .SetReturn(0);
-
-    STRICT_EXPECTED_CALL(STRING_concat((STRING_HANDLE)0x42, IGNORED_PTR_ARG))
-        .IgnoreArgument(2)
-        .SetReturn(-1);
-
-    STRICT_EXPECTED_CALL(STRING_delete((STRING_HANDLE)0x42));
-
-    STRICT_EXPECTED_CALL(STRING_delete((STRING_HANDLE)0x42));
+    STRICT_EXPECTED_CALL(STRING_clone((STRING_HANDLE)0x42))
+        .SetReturn((STRING_HANDLE)0x42);
 
+    STRICT_EXPECTED_CALL(HTTPHeaders_AddHeaderNameValuePair((HTTP_HEADERS_HANDLE)0x42, "Content-Type", "application/json"))
+        .SetReturn(HTTP_HEADERS_ERROR);
 
     //act
-    MODULE_RECEIVE(apis)((MODULE_HANDLE)0x42, (MESSAGE_HANDLE)0x42);
+    MODULE_HANDLE result = MODULE_CREATE(apis)((BROKER_HANDLE)0x42, (const void*)&config);
 
     //assert
-    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_IS_NULL(result);
+    /*the sender was released*/
+    ASSERT_IS_NOT_NULL(strstr(umock_c_get_actual_calls(), "[HTTPAPIEX_Destroy("));
+    ASSERT_IS_NULL(strstr(umock_c_get_actual_calls(), "[ThreadAPI_Create("));
 }
 
-/* Tests_SRS_AZUREFUNCTIONS_04_014: [ azure_functions_Receive shall call HTTPAPIEX_Create, passing hostAddress, it if fails it shall fail and return. ] */
-TEST_FUNCTION(AZURE_FUNCTIONS_Receive_fail_when_HTTPAPIEX_create_Fail)
+/* Tests_SRS_AZUREFUNCTIONS_04_025: [ AzureFunctions_Create shall add 2 HTTP Headers to the requests of every sender. Content-Type:application/json and, if securityKey exists x-functions-key:securityKey. If it fails it shall fail and return NULL. ] */
+TEST_FUNCTION(AZURE_FUNCTIONS_Create_returns_NULL_when_HTTPHeaders_AddHeaderNameValuePair2_fails)
 {
     // arrange
     const MODULE_API* apis = Module_GetApi(MODULE_API_VERSION_1);
 
-    CONSTBUFFER buffer;
-    buffer.buffer = (const unsigned char*)"12345";
-    buffer.size = sizeof("12345");
-    
     AZURE_FUNCTIONS_CONFIG config;
     config.relativePath = (STRING_HANDLE)0x42;
     config.hostAddress = (STRING_HANDLE)0x42;
     config.securityKey = (STRING_HANDLE)0x42;
-
-    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
-        .IgnoreArgument(1);
-
-    STRICT_EXPECTED_CALL(gballoc_malloc(sizeof(AZURE_FUNCTIONS_CONFIG)));
+    config.maxInFlight = 1;
+    config.batchSize = 0;
 
     STRICT_EXPECTED_CALL(STRING_clone((STRING_HANDLE)IGNORED_PTR_ARG))
         .IgnoreArgument(1)
@@ -1261,72 +1584,35 @@ TEST_FUNCTION(AZURE_FUNCTIONS_Receive_fail_when_HTTPAPIEX_create_Fail)
         .IgnoreArgument(1)
         .SetReturn((STRING_HANDLE)0x42);
 
-    MODULE_HANDLE moduleInfo = MODULE_CREATE(apis)((BROKER_HANDLE)0x42, &config);
-
-    umock_c_reset_all_calls();
-
-    STRICT_EXPECTED_CALL(Message_GetContent((MESSAGE_HANDLE)0x42))
-        .SetReturn(&buffer);
-
-    STRICT_EXPECTED_CALL(Base64_Encode_Bytes(buffer.buffer, buffer.size))
-        .SetReturn((STRING_HANDLE)0x42);
-
-    STRICT_EXPECTED_CALL(STRING_construct(IGNORED_PTR_ARG))
-        .IgnoreAllArguments()
+    STRICT_EXPECTED_CALL(STRING_clone((STRING_HANDLE)0x42))
         .SetReturn((STRING_HANDLE)0x42);
 
-    STRICT_EXPECTED_CALL(STRING_concat((STRING_HANDLE)0x42, IGNORED_PTR_ARG))
-        .IgnoreArgument(2)
-        .SetReturn(0);
-
-    STRICT_EXPECTED_CALL(STRING_concat_with_STRING((STRING_HANDLE)0x42, (STRING_HANDLE)0x42))
-        .SetReturn(0);
-
-    STRICT_EXPECTED_CALL(STRING_concat((STRING_HANDLE)0x42, IGNORED_PTR_ARG))
-        .IgnoreArgument(2)
-        .SetReturn(0);
-
-    STRICT_EXPECTED_CALL(STRING_c_str((STRING_HANDLE)0x42))
-        .SetReturn("AnyContent42");
-
-    STRICT_EXPECTED_CALL(HTTPAPIEX_Create(IGNORED_PTR_ARG))
-        .IgnoreAllArguments()
-        .SetReturn(NULL);
-
-    STRICT_EXPECTED_CALL(STRING_delete((STRING_HANDLE)0x42));
-
-    STRICT_EXPECTED_CALL(STRING_delete((STRING_HANDLE)0x42));
-
+    STRICT_EXPECTED_CALL(HTTPHeaders_AddHeaderNameValuePair((HTTP_HEADERS_HANDLE)0x42, "x-functions-key", IGNORED_PTR_ARG))
+        .IgnoreArgument(3)
+        .SetReturn(HTTP_HEADERS_ERROR);
 
     //act
-    MODULE_RECEIVE(apis)(moduleInfo, (MESSAGE_HANDLE)0x42);
+    MODULE_HANDLE result = MODULE_CREATE(apis)((BROKER_HANDLE)0x42, (const void*)&config);
 
     //assert
-    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
-
-    //Cleanup
-    MODULE_DESTROY(apis)(moduleInfo);
+    ASSERT_IS_NULL(result);
+    /*the sender was released*/
+    ASSERT_IS_NOT_NULL(strstr(umock_c_get_actual_calls(), "[HTTPAPIEX_Destroy("));
+    ASSERT_IS_NULL(strstr(umock_c_get_actual_calls(), "[ThreadAPI_Create("));
 }
 
-/* Tests_SRS_AZUREFUNCTIONS_04_015: [ azure_functions_Receive shall call allocate memory to receive data from HTTPAPI by calling BUFFER_new, if it fail it shall fail and return. ] */
-TEST_FUNCTION(AZURE_FUNCTIONS_Receive_fail_if_buffer_new_fails)
+/* Tests_SRS_AZUREFUNCTIONS_04_015: [ AzureFunctions_Create shall allocate the request and response buffers of every sender by calling BUFFER_new, if it fails it shall fail and return NULL. ] */
+TEST_FUNCTION(AZURE_FUNCTIONS_Create_returns_NULL_when_BUFFER_new_fails)
 {
     // arrange
     const MODULE_API* apis = Module_GetApi(MODULE_API_VERSION_1);
 
-    CONSTBUFFER buffer;
-    buffer.buffer = (const unsigned char*)"12345";
-    buffer.size = sizeof("12345");
-
     AZURE_FUNCTIONS_CONFIG config;
     config.relativePath = (STRING_HANDLE)0x42;
     config.hostAddress = (STRING_HANDLE)0x42;
-    config.securityKey = (STRING_HANDLE)0x42;
-
-    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
-        .IgnoreArgument(1);
-
-    STRICT_EXPECTED_CALL(gballoc_malloc(sizeof(AZURE_FUNCTIONS_CONFIG)));
+    config.securityKey = NULL;
+    config.maxInFlight = 1;
+    config.batchSize = 0;
 
     STRICT_EXPECTED_CALL(STRING_clone((STRING_HANDLE)IGNORED_PTR_ARG))
         .IgnoreArgument(1)
@@ -1336,266 +1622,273 @@ TEST_FUNCTION(AZURE_FUNCTIONS_Receive_fail_if_buffer_new_fails)
         .IgnoreArgument(1)
         .SetReturn((STRING_HANDLE)0x42);
 
-    STRICT_EXPECTED_CALL(STRING_clone((STRING_HANDLE)IGNORED_PTR_ARG))
-        .IgnoreArgument(1)
+    STRICT_EXPECTED_CALL(STRING_clone((STRING_HANDLE)0x42))
         .SetReturn((STRING_HANDLE)0x42);
 
-    MODULE_HANDLE moduleInfo = MODULE_CREATE(apis)((BROKER_HANDLE)0x42, &config);
+    STRICT_EXPECTED_CALL(BUFFER_new())
+        .SetReturn(NULL);
 
-    umock_c_reset_all_calls();
+    //act
+    MODULE_HANDLE result = MODULE_CREATE(apis)((BROKER_HANDLE)0x42, (const void*)&config);
 
-    STRICT_EXPECTED_CALL(Message_GetContent((MESSAGE_HANDLE)0x42))
-        .SetReturn(&buffer);
-
-    STRICT_EXPECTED_CALL(Base64_Encode_Bytes(buffer.buffer, buffer.size))
-        .SetReturn((STRING_HANDLE)0x42);
-
-    STRICT_EXPECTED_CALL(STRING_construct(IGNORED_PTR_ARG))
-        .IgnoreAllArguments()
-        .SetReturn((STRING_HANDLE)0x42);
+    //assert
+    ASSERT_IS_NULL(result);
+    /*the sender was released*/
+    ASSERT_IS_NOT_NULL(strstr(umock_c_get_actual_calls(), "[HTTPAPIEX_Destroy("));
+    ASSERT_IS_NULL(strstr(umock_c_get_actual_calls(), "[ThreadAPI_Create("));
+}
 
-    STRICT_EXPECTED_CALL(STRING_concat((STRING_HANDLE)0x42, IGNORED_PTR_ARG))
-        .IgnoreArgument(2)
-        .SetReturn(0);
+/* Tests_SRS_AZUREFUNCTIONS_04_008: [ If moduleHandle is NULL, azure_functions_Destroy shall return. ] */
+TEST_FUNCTION(AZURE_FUNCTIONS_Destroy_does_nothing_if_module_handle_null)
+{
+    // arrange
+    const MODULE_API* apis = Module_GetApi(MODULE_API_VERSION_1);
 
-    STRICT_EXPECTED_CALL(STRING_concat_with_STRING((STRING_HANDLE)0x42, (STRING_HANDLE)0x42))
-        .SetReturn(0);
+    MODULE_DESTROY(apis)(NULL);
 
-    STRICT_EXPECTED_CALL(STRING_concat((STRING_HANDLE)0x42, IGNORED_PTR_ARG))
-        .IgnoreArgument(2)
-        .SetReturn(0);
+    //assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
 
-    STRICT_EXPECTED_CALL(STRING_c_str((STRING_HANDLE)0x42))
-        .SetReturn("AnyContent42");
+/* Tests_SRS_AZUREFUNCTIONS_04_009: [ azure_functions_Destroy shall release all resources allocated for the module. ] */
+TEST_FUNCTION(AZURE_FUNCTIONS_Destroy_happy_path_with_securityKey)
+{
 
-    STRICT_EXPECTED_CALL(HTTPAPIEX_Create(IGNORED_PTR_ARG))
-        .IgnoreAllArguments()
-        .SetReturn((HTTPAPIEX_HANDLE)0x42);
+    // arrange
+    const MODULE_API* apis = Module_GetApi(MODULE_API_VERSION_1);
 
-    STRICT_EXPECTED_CALL(BUFFER_new())
-        .SetReturn(NULL);
+    AZURE_FUNCTIONS_CONFIG config;
+    config.relativePath = (STRING_HANDLE)0x42;
+    config.hostAddress = (STRING_HANDLE)0x42;
+    config.securityKey = (STRING_HANDLE)0x42;
+    config.maxInFlight = 1;
+    config.batchSize = 0;
 
-    STRICT_EXPECTED_CALL(HTTPAPIEX_Destroy((HTTPAPIEX_HANDLE)0x42));
+    expected_calls_create(true);
 
-    STRICT_EXPECTED_CALL(STRING_delete((STRING_HANDLE)0x42));
+    MODULE_HANDLE result = MODULE_CREATE(apis)((BROKER_HANDLE)0x42, (const void*)&config);
+    ASSERT_IS_NOT_NULL(result);
 
-    STRICT_EXPECTED_CALL(STRING_delete((STRING_HANDLE)0x42));
+    umock_c_reset_all_calls();
 
+    expected_calls_destroy(true);
 
     //act
-    MODULE_RECEIVE(apis)(moduleInfo, (MESSAGE_HANDLE)0x42);
+    MODULE_DESTROY(apis)(result);
 
     //assert
     ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
-
-    //cleanup 
-    MODULE_DESTROY(apis)(moduleInfo);
 }
 
-/* Tests_SRS_AZUREFUNCTIONS_04_016: [ azure_functions_Receive shall add name parameter to relative path, if it fail it shall fail and return. ] */
-TEST_FUNCTION(AZURE_FUNCTIONS_Receive_fail_when_String_clone_fails)
+/* Tests_SRS_AZUREFUNCTIONS_04_009: [ azure_functions_Destroy shall release all resources allocated for the module. ] */
+TEST_FUNCTION(AZURE_FUNCTIONS_Destroy_happy_path_without_securityKey)
 {
+
     // arrange
     const MODULE_API* apis = Module_GetApi(MODULE_API_VERSION_1);
 
-    CONSTBUFFER buffer;
-    buffer.buffer = (const unsigned char*)"12345";
-    buffer.size = sizeof("12345");
-
     AZURE_FUNCTIONS_CONFIG config;
     config.relativePath = (STRING_HANDLE)0x42;
     config.hostAddress = (STRING_HANDLE)0x42;
-    config.securityKey = (STRING_HANDLE)0x42;
-
-    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
-        .IgnoreArgument(1);
+    config.securityKey = NULL;
+    config.maxInFlight = 1;
+    config.batchSize = 0;
 
-    STRICT_EXPECTED_CALL(gballoc_malloc(sizeof(AZURE_FUNCTIONS_CONFIG)));
+    expected_calls_create(false);
 
-    STRICT_EXPECTED_CALL(STRING_clone((STRING_HANDLE)IGNORED_PTR_ARG))
-        .IgnoreArgument(1)
-        .SetReturn((STRING_HANDLE)0x42);
+    MODULE_HANDLE result = MODULE_CREATE(apis)((BROKER_HANDLE)0x42, (const void*)&config);
+    ASSERT_IS_NOT_NULL(result);
 
-    STRICT_EXPECTED_CALL(STRING_clone((STRING_HANDLE)IGNORED_PTR_ARG))
-        .IgnoreArgument(1)
-        .SetReturn((STRING_HANDLE)0x42);
+    umock_c_reset_all_calls();
 
-    STRICT_EXPECTED_CALL(STRING_clone((STRING_HANDLE)IGNORED_PTR_ARG))
-        .IgnoreArgument(1)
-        .SetReturn((STRING_HANDLE)0x42);
+    expected_calls_destroy(false);
 
-    MODULE_HANDLE moduleInfo = MODULE_CREATE(apis)((BROKER_HANDLE)0x42, &config);
+    //act
+    MODULE_DESTROY(apis)(result);
 
-    umock_c_reset_all_calls();
+    //assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
 
-    STRICT_EXPECTED_CALL(Message_GetContent((MESSAGE_HANDLE)0x42))
-        .SetReturn(&buffer);
 
-    STRICT_EXPECTED_CALL(Base64_Encode_Bytes(buffer.buffer, buffer.size))
-        .SetReturn((STRING_HANDLE)0x42);
+/* Tests_SRS_AZUREFUNCTIONS_04_010: [If moduleHandle is NULL than azure_functions_Receive shall fail and return.] */
+TEST_FUNCTION(AZURE_FUNCTIONS_Receive_doesNothing_if_moduleHandleIsNull)
+{
+    // arrange
+    const MODULE_API* apis = Module_GetApi(MODULE_API_VERSION_1);
 
-    STRICT_EXPECTED_CALL(STRING_construct(IGNORED_PTR_ARG))
-        .IgnoreAllArguments()
-        .SetReturn((STRING_HANDLE)0x42);
+    //act
+    MODULE_RECEIVE(apis)(NULL, (MESSAGE_HANDLE)0x42);
 
-    STRICT_EXPECTED_CALL(STRING_concat((STRING_HANDLE)0x42, IGNORED_PTR_ARG))
-        .IgnoreArgument(2)
-        .SetReturn(0);
+    //assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
 
-    STRICT_EXPECTED_CALL(STRING_concat_with_STRING((STRING_HANDLE)0x42, (STRING_HANDLE)0x42))
-        .SetReturn(0);
+/* Tests_SRS_AZUREFUNCTIONS_04_011: [ If messageHandle is NULL than azure_functions_Receive shall fail and return. ] */
+TEST_FUNCTION(AZURE_FUNCTIONS_Receive_doesNothing_if_messageHandleIsNull)
+{
+    // arrange
+    const MODULE_API* apis = Module_GetApi(MODULE_API_VERSION_1);
 
-    STRICT_EXPECTED_CALL(STRING_concat((STRING_HANDLE)0x42, IGNORED_PTR_ARG))
-        .IgnoreArgument(2)
-        .SetReturn(0);
+    //act
+    MODULE_RECEIVE(apis)((MODULE_HANDLE)0x42, NULL);
 
-    STRICT_EXPECTED_CALL(STRING_c_str((STRING_HANDLE)0x42))
-        .SetReturn("AnyContent42");
+    //assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
 
-    STRICT_EXPECTED_CALL(HTTPAPIEX_Create(IGNORED_PTR_ARG))
-        .IgnoreAllArguments()
-        .SetReturn((HTTPAPIEX_HANDLE)0x42);
+/*Tests_SRS_AZUREFUNCTIONS_30_006: [ azureFunctions_Receive shall queue a clone of the message for the senders, waiting while the queue is full, and return without waiting for the request. ]*/
+TEST_FUNCTION(AZURE_FUNCTIONS_Receive_queues_a_clone_of_the_message)
+{
+    // arrange
+    const MODULE_API* apis = Module_GetApi(MODULE_API_VERSION_1);
 
-    STRICT_EXPECTED_CALL(BUFFER_new())
-        .SetReturn((BUFFER_HANDLE)0x42);
+    AZURE_FUNCTIONS_CONFIG config;
+    config.relativePath = (STRING_HANDLE)0x42;
+    config.hostAddress = (STRING_HANDLE)0x42;
+    config.securityKey = (STRING_HANDLE)0x42;
+    config.maxInFlight = 1;
+    config.batchSize = 0;
 
-    STRICT_EXPECTED_CALL(STRING_clone((STRING_HANDLE)0x42))
-        .SetReturn(NULL);
+    expected_calls_create(true);
 
-    STRICT_EXPECTED_CALL(BUFFER_delete((BUFFER_HANDLE)0x42));
+    MODULE_HANDLE moduleInfo = MODULE_CREATE(apis)((BROKER_HANDLE)0x42, &config);
 
+    umock_c_reset_all_calls();
 
-    STRICT_EXPECTED_CALL(HTTPAPIEX_Destroy((HTTPAPIEX_HANDLE)0x42));
+    STRICT_EXPECTED_CALL(Message_Clone((MESSAGE_HANDLE)0x42));
 
-    STRICT_EXPECTED_CALL(STRING_delete((STRING_HANDLE)0x42));
+    STRICT_EXPECTED_CALL(Lock((LOCK_HANDLE)0x44));
 
-    STRICT_EXPECTED_CALL(STRING_delete((STRING_HANDLE)0x42));
+    STRICT_EXPECTED_CALL(Condition_Post((COND_HANDLE)0x45));
 
+    STRICT_EXPECTED_CALL(Unlock((LOCK_HANDLE)0x44));
 
     //act
     MODULE_RECEIVE(apis)(moduleInfo, (MESSAGE_HANDLE)0x42);
 
     //assert
     ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(size_t, 0, g_postCount);
 
-    //cleanup 
+    //cleanup
     MODULE_DESTROY(apis)(moduleInfo);
 }
 
-/* Tests_SRS_AZUREFUNCTIONS_04_016: [ azure_functions_Receive shall add name parameter to relative path, if it fail it shall fail and return. ] */
-TEST_FUNCTION(AZURE_FUNCTIONS_Receive_fail_when_String_concat1_fails)
+/*Tests_SRS_AZUREFUNCTIONS_30_007: [ If Message_Clone fails, azureFunctions_Receive shall fail and return. ]*/
+TEST_FUNCTION(AZURE_FUNCTIONS_Receive_fails_when_Message_Clone_fails)
 {
     // arrange
     const MODULE_API* apis = Module_GetApi(MODULE_API_VERSION_1);
 
-    CONSTBUFFER buffer;
-    buffer.buffer = (const unsigned char*)"12345";
-    buffer.size = sizeof("12345");
-
     AZURE_FUNCTIONS_CONFIG config;
     config.relativePath = (STRING_HANDLE)0x42;
     config.hostAddress = (STRING_HANDLE)0x42;
     config.securityKey = (STRING_HANDLE)0x42;
+    config.maxInFlight = 1;
+    config.batchSize = 0;
 
-    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
-        .IgnoreArgument(1);
-
-    STRICT_EXPECTED_CALL(gballoc_malloc(sizeof(AZURE_FUNCTIONS_CONFIG)));
-
-    STRICT_EXPECTED_CALL(STRING_clone((STRING_HANDLE)IGNORED_PTR_ARG))
-        .IgnoreArgument(1)
-        .SetReturn((STRING_HANDLE)0x42);
-
-    STRICT_EXPECTED_CALL(STRING_clone((STRING_HANDLE)IGNORED_PTR_ARG))
-        .IgnoreArgument(1)
-        .SetReturn((STRING_HANDLE)0x42);
-
-    STRICT_EXPECTED_CALL(STRING_clone((STRING_HANDLE)IGNORED_PTR_ARG))
-        .IgnoreArgument(1)
-        .SetReturn((STRING_HANDLE)0x42);
+    expected_calls_create(true);
 
     MODULE_HANDLE moduleInfo = MODULE_CREATE(apis)((BROKER_HANDLE)0x42, &config);
 
     umock_c_reset_all_calls();
 
-    STRICT_EXPECTED_CALL(Message_GetContent((MESSAGE_HANDLE)0x42))
-        .SetReturn(&buffer);
-
-    STRICT_EXPECTED_CALL(Base64_Encode_Bytes(buffer.buffer, buffer.size))
-        .SetReturn((STRING_HANDLE)0x42);
+    STRICT_EXPECTED_CALL(Message_Clone((MESSAGE_HANDLE)0x42))
+        .SetReturn(NULL);
 
-    STRICT_EXPECTED_CALL(STRING_construct(IGNORED_PTR_ARG))
-        .IgnoreAllArguments()
-        .SetReturn((STRING_HANDLE)0x42);
+    //act
+    MODULE_RECEIVE(apis)(moduleInfo, (MESSAGE_HANDLE)0x42);
 
-    STRICT_EXPECTED_CALL(STRING_concat((STRING_HANDLE)0x42, IGNORED_PTR_ARG))
-        .IgnoreArgument(2)
-        .SetReturn(0);
+    //assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
 
-    STRICT_EXPECTED_CALL(STRING_concat_with_STRING((STRING_HANDLE)0x42, (STRING_HANDLE)0x42))
-        .SetReturn(0);
+    //cleanup
+    MODULE_DESTROY(apis)(moduleInfo);
+    ASSERT_ARE_EQUAL(size_t, 0, g_postCount);
+}
 
-    STRICT_EXPECTED_CALL(STRING_concat((STRING_HANDLE)0x42, IGNORED_PTR_ARG))
-        .IgnoreArgument(2)
-        .SetReturn(0);
+/* Tests_SRS_AZUREFUNCTIONS_04_024: [ The sender shall create a JSON body with the content of the messages, base64 encoded in a buffer it reuses for every request. If it fails it shall fail and release the messages. ] */
+/* Tests_SRS_AZUREFUNCTIONS_04_018: [ Upon success the sender shall log the response from HTTP POST. ] */
+/* Tests_SRS_AZUREFUNCTIONS_04_017: [ The sender shall call HTTPAPIEX_ExecuteRequest on its HTTPAPIEX handle to send the HTTP POST to Azure Functions. If it fails it shall log it and release the messages. ] */
+/* Tests_SRS_AZUREFUNCTIONS_04_012: [ The sender shall get the message content by calling Message_GetContent, a message without content is not posted. ] */
+/*Tests_SRS_AZUREFUNCTIONS_30_010: [ azureFunctions_Destroy shall wait for the senders to post the queued messages and stop. ]*/
+TEST_FUNCTION(AZURE_FUNCTIONS_Receive_posts_the_message)
+{
+    // arrange
+    const MODULE_API* apis = Module_GetApi(MODULE_API_VERSION_1);
 
-    STRICT_EXPECTED_CALL(STRING_c_str((STRING_HANDLE)0x42))
-        .SetReturn("AnyContent42");
+    AZURE_FUNCTIONS_CONFIG config;
+    config.relativePath = (STRING_HANDLE)0x42;
+    config.hostAddress = (STRING_HANDLE)0x42;
+    config.securityKey = (STRING_HANDLE)0x42;
+    config.maxInFlight = 1;
+    config.batchSize = 0;
 
-    STRICT_EXPECTED_CALL(HTTPAPIEX_Create(IGNORED_PTR_ARG))
-        .IgnoreAllArguments()
-        .SetReturn((HTTPAPIEX_HANDLE)0x42);
+    expected_calls_create(true);
 
-    STRICT_EXPECTED_CALL(BUFFER_new())
-        .SetReturn((BUFFER_HANDLE)0x42);
+    MODULE_HANDLE moduleInfo = MODULE_CREATE(apis)((BROKER_HANDLE)0x42, &config);
 
-    STRICT_EXPECTED_CALL(STRING_clone((STRING_HANDLE)0x42))
-        .SetReturn((STRING_HANDLE)0x42);
+    umock_c_reset_all_calls();
 
-    STRICT_EXPECTED_CALL(STRING_concat((STRING_HANDLE)0x42, IGNORED_PTR_ARG))
-        .IgnoreArgument(2)
-        .SetReturn(-1);
+    //act
+    MODULE_RECEIVE(apis)(moduleInfo, (MESSAGE_HANDLE)0x42);
+    MODULE_DESTROY(apis)(moduleInfo);
 
-    STRICT_EXPECTED_CALL(STRING_delete((STRING_HANDLE)0x42));
+    //assert
+    ASSERT_ARE_EQUAL(size_t, 1, g_postCount);
+    ASSERT_ARE_EQUAL(char_ptr, "{\"content\":\"MTIzNDU=\"}", g_postedBody[0]);
+    ASSERT_ARE_EQUAL(size_t, 1, g_destroyedMessages);
+}
 
-    STRICT_EXPECTED_CALL(BUFFER_delete((BUFFER_HANDLE)0x42));
+/* Tests_SRS_AZUREFUNCTIONS_04_014: [ AzureFunctions_Create shall call HTTPAPIEX_Create, passing hostAddress, once per sender, which keeps it for every request. If it fails it shall fail and return NULL. ] */
+/* Tests_SRS_AZUREFUNCTIONS_04_024: [ The sender shall create a JSON body with the content of the messages, base64 encoded in a buffer it reuses for every request. If it fails it shall fail and release the messages. ] */
+TEST_FUNCTION(AZURE_FUNCTIONS_Receive_reuses_the_connection)
+{
+    // arrange
+    const MODULE_API* apis = Module_GetApi(MODULE_API_VERSION_1);
 
-    STRICT_EXPECTED_CALL(HTTPAPIEX_Destroy((HTTPAPIEX_HANDLE)0x42));
+    AZURE_FUNCTIONS_CONFIG config;
+    config.relativePath = (STRING_HANDLE)0x42;
+    config.hostAddress = (STRING_HANDLE)0x42;
+    config.securityKey = (STRING_HANDLE)0x42;
+    config.maxInFlight = 1;
+    config.batchSize = 0;
 
-    STRICT_EXPECTED_CALL(STRING_delete((STRING_HANDLE)0x42));
+    expected_calls_create(true);
 
-    STRICT_EXPECTED_CALL(STRING_delete((STRING_HANDLE)0x42));
+    MODULE_HANDLE moduleInfo = MODULE_CREATE(apis)((BROKER_HANDLE)0x42, &config);
 
+    umock_c_reset_all_calls();
 
     //act
     MODULE_RECEIVE(apis)(moduleInfo, (MESSAGE_HANDLE)0x42);
+    MODULE_RECEIVE(apis)(moduleInfo, (MESSAGE_HANDLE)0x43);
+    MODULE_DESTROY(apis)(moduleInfo);
 
     //assert
-    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
-
-    //cleanup 
-    MODULE_DESTROY(apis)(moduleInfo);
+    ASSERT_ARE_EQUAL(size_t, 2, g_postCount);
+    ASSERT_ARE_EQUAL(char_ptr, "{\"content\":\"MTIzNDU=\"}", g_postedBody[0]);
+    ASSERT_ARE_EQUAL(char_ptr, "{\"content\":\"YWJj\"}", g_postedBody[1]);
+    ASSERT_ARE_EQUAL(size_t, 2, g_destroyedMessages);
+    /*both requests went through the connection made by Create*/
+    ASSERT_IS_NULL(strstr(umock_c_get_actual_calls(), "[HTTPAPIEX_Create("));
+    ASSERT_IS_NULL(strstr(umock_c_get_actual_calls(), "[HTTPHeaders_Alloc("));
 }
 
-/* Tests_SRS_AZUREFUNCTIONS_04_025: [ AzureFunctions_Receive shall add 2 HTTP Headers to POST Request. Content-Type:application/json and, if securityKey exists x-functions-key:securityKey. If it fails it shall fail and return. ] */
-TEST_FUNCTION(AZURE_FUNCTIONS_Receive_fail_when_HTTPHeaders_Alloc_fails)
+/*Tests_SRS_AZUREFUNCTIONS_30_008: [ A sender shall POST the messages it took as a JSON array of { "content": base64 content } objects when batchSize is above 1, and as one such object otherwise. ]*/
+/*Tests_SRS_AZUREFUNCTIONS_30_009: [ A sender shall take up to batchSize messages from the queue at once, and post them without holding the lock. ]*/
+TEST_FUNCTION(AZURE_FUNCTIONS_Receive_posts_a_batch_as_an_array)
 {
     // arrange
     const MODULE_API* apis = Module_GetApi(MODULE_API_VERSION_1);
 
-    CONSTBUFFER buffer;
-    buffer.buffer = (const unsigned char*)"12345";
-    buffer.size = sizeof("12345");
-
     AZURE_FUNCTIONS_CONFIG config;
     config.relativePath = (STRING_HANDLE)0x42;
     config.hostAddress = (STRING_HANDLE)0x42;
-    config.securityKey = (STRING_HANDLE)0x42;
-
-    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
-        .IgnoreArgument(1);
-
-    STRICT_EXPECTED_CALL(gballoc_malloc(sizeof(AZURE_FUNCTIONS_CONFIG)));
+    config.securityKey = NULL;
+    config.maxInFlight = 1;
+    config.batchSize = 3;
 
     STRICT_EXPECTED_CALL(STRING_clone((STRING_HANDLE)IGNORED_PTR_ARG))
         .IgnoreArgument(1)
@@ -1605,95 +1898,104 @@ TEST_FUNCTION(AZURE_FUNCTIONS_Receive_fail_when_HTTPHeaders_Alloc_fails)
         .IgnoreArgument(1)
         .SetReturn((STRING_HANDLE)0x42);
 
-    STRICT_EXPECTED_CALL(STRING_clone((STRING_HANDLE)IGNORED_PTR_ARG))
-        .IgnoreArgument(1)
+    STRICT_EXPECTED_CALL(STRING_clone((STRING_HANDLE)0x42))
         .SetReturn((STRING_HANDLE)0x42);
 
     MODULE_HANDLE moduleInfo = MODULE_CREATE(apis)((BROKER_HANDLE)0x42, &config);
+    ASSERT_IS_NOT_NULL(moduleInfo);
 
     umock_c_reset_all_calls();
 
-    STRICT_EXPECTED_CALL(Message_GetContent((MESSAGE_HANDLE)0x42))
-        .SetReturn(&buffer);
-
-    STRICT_EXPECTED_CALL(Base64_Encode_Bytes(buffer.buffer, buffer.size))
-        .SetReturn((STRING_HANDLE)0x42);
+    //act
+    MODULE_RECEIVE(apis)(moduleInfo, (MESSAGE_HANDLE)0x42);
+    MODULE_RECEIVE(apis)(moduleInfo, (MESSAGE_HANDLE)0x43);
+    MODULE_DESTROY(apis)(moduleInfo);
 
-    STRICT_EXPECTED_CALL(STRING_construct(IGNORED_PTR_ARG))
-        .IgnoreAllArguments()
-        .SetReturn((STRING_HANDLE)0x42);
+    //assert
+    ASSERT_ARE_EQUAL(size_t, 1, g_postCount);
+    ASSERT_ARE_EQUAL(char_ptr, "[{\"content\":\"MTIzNDU=\"},{\"content\":\"YWJj\"}]", g_postedBody[0]);
+    ASSERT_ARE_EQUAL(size_t, 2, g_destroyedMessages);
+}
 
-    STRICT_EXPECTED_CALL(STRING_concat((STRING_HANDLE)0x42, IGNORED_PTR_ARG))
-        .IgnoreArgument(2)
-        .SetReturn(0);
+/* Tests_SRS_AZUREFUNCTIONS_04_017: [ The sender shall call HTTPAPIEX_ExecuteRequest on its HTTPAPIEX handle to send the HTTP POST to Azure Functions. If it fails it shall log it and release the messages. ] */
+/* Tests_SRS_AZUREFUNCTIONS_04_019: [ The sender shall destroy the messages it took once they are posted. ] */
+TEST_FUNCTION(AZURE_FUNCTIONS_Receive_releases_the_message_when_the_request_fails)
+{
+    // arrange
+    const MODULE_API* apis = Module_GetApi(MODULE_API_VERSION_1);
 
-    STRICT_EXPECTED_CALL(STRING_concat_with_STRING((STRING_HANDLE)0x42, (STRING_HANDLE)0x42))
-        .SetReturn(0);
+    AZURE_FUNCTIONS_CONFIG config;
+    config.relativePath = (STRING_HANDLE)0x42;
+    config.hostAddress = (STRING_HANDLE)0x42;
+    config.securityKey = (STRING_HANDLE)0x42;
+    config.maxInFlight = 1;
+    config.batchSize = 0;
 
-    STRICT_EXPECTED_CALL(STRING_concat((STRING_HANDLE)0x42, IGNORED_PTR_ARG))
-        .IgnoreArgument(2)
-        .SetReturn(0);
+    expected_calls_create(true);
 
-    STRICT_EXPECTED_CALL(STRING_c_str((STRING_HANDLE)0x42))
-        .SetReturn("AnyContent42");
+    MODULE_HANDLE moduleInfo = MODULE_CREATE(apis)((BROKER_HANDLE)0x42, &config);
 
-    STRICT_EXPECTED_CALL(HTTPAPIEX_Create(IGNORED_PTR_ARG))
-        .IgnoreAllArguments()
-        .SetReturn((HTTPAPIEX_HANDLE)0x42);
+    umock_c_reset_all_calls();
+    g_statusCode = 500;
 
-    STRICT_EXPECTED_CALL(BUFFER_new())
-        .SetReturn((BUFFER_HANDLE)0x42);
+    //act
+    MODULE_RECEIVE(apis)(moduleInfo, (MESSAGE_HANDLE)0x42);
+    MODULE_DESTROY(apis)(moduleInfo);
 
-    STRICT_EXPECTED_CALL(STRING_clone((STRING_HANDLE)0x42))
-        .SetReturn((STRING_HANDLE)0x42);
+    //assert
+    ASSERT_ARE_EQUAL(size_t, 1, g_postCount);
+    ASSERT_ARE_EQUAL(size_t, 1, g_destroyedMessages);
+}
 
-    STRICT_EXPECTED_CALL(STRING_concat((STRING_HANDLE)0x42, IGNORED_PTR_ARG))
-        .IgnoreArgument(2)
-        .SetReturn(0);
+/*Tests_SRS_AZUREFUNCTIONS_30_006: [ azureFunctions_Receive shall queue a clone of the message for the senders, waiting while the queue is full, and return without waiting for the request. ]*/
+TEST_FUNCTION(AZURE_FUNCTIONS_Receive_releases_the_clone_when_Lock_fails)
+{
+    // arrange
+    const MODULE_API* apis = Module_GetApi(MODULE_API_VERSION_1);
 
-    STRICT_EXPECTED_CALL(HTTPHeaders_Alloc())
-        .SetReturn(NULL);
+    AZURE_FUNCTIONS_CONFIG config;
+    config.relativePath = (STRING_HANDLE)0x42;
+    config.hostAddress = (STRING_HANDLE)0x42;
+    config.securityKey = (STRING_HANDLE)0x42;
+    config.maxInFlight = 1;
+    config.batchSize = 0;
 
-    STRICT_EXPECTED_CALL(STRING_delete((STRING_HANDLE)0x42));
+    expected_calls_create(true);
 
-    STRICT_EXPECTED_CALL(BUFFER_delete((BUFFER_HANDLE)0x42));
+    MODULE_HANDLE moduleInfo = MODULE_CREATE(apis)((BROKER_HANDLE)0x42, &config);
+    ASSERT_IS_NOT_NULL(moduleInfo);
 
-    STRICT_EXPECTED_CALL(HTTPAPIEX_Destroy((HTTPAPIEX_HANDLE)0x42));
+    umock_c_reset_all_calls();
 
-    STRICT_EXPECTED_CALL(STRING_delete((STRING_HANDLE)0x42));
+    STRICT_EXPECTED_CALL(Message_Clone((MESSAGE_HANDLE)0x42));
 
-    STRICT_EXPECTED_CALL(STRING_delete((STRING_HANDLE)0x42));
+    STRICT_EXPECTED_CALL(Lock((LOCK_HANDLE)0x44))
+        .SetReturn(LOCK_ERROR);
 
+    STRICT_EXPECTED_CALL(Message_Destroy((MESSAGE_HANDLE)0x42));
 
     //act
     MODULE_RECEIVE(apis)(moduleInfo, (MESSAGE_HANDLE)0x42);
-
-    //assert
     ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
-
-    //cleanup 
     MODULE_DESTROY(apis)(moduleInfo);
+
+    //assert
+    ASSERT_ARE_EQUAL(size_t, 0, g_postCount);
+    ASSERT_ARE_EQUAL(size_t, 1, g_destroyedMessages);
 }
 
-/* Tests_SRS_AZUREFUNCTIONS_04_025: [ AzureFunctions_Receive shall add 2 HTTP Headers to POST Request. Content-Type:application/json and, if securityKey exists x-functions-key:securityKey. If it fails it shall fail and return. ] */
-TEST_FUNCTION(AZURE_FUNCTIONS_Receive_fail_when_HTTPHeaders_AddHeaderNameValuePair_fails)
+/* Tests_SRS_AZUREFUNCTIONS_04_012: [ The sender shall get the message content by calling Message_GetContent, a message without content is not posted. ] */
+TEST_FUNCTION(AZURE_FUNCTIONS_Receive_does_not_post_a_message_without_content)
 {
     // arrange
     const MODULE_API* apis = Module_GetApi(MODULE_API_VERSION_1);
 
-    CONSTBUFFER buffer;
-    buffer.buffer = (const unsigned char*)"12345";
-    buffer.size = sizeof("12345");
-
     AZURE_FUNCTIONS_CONFIG config;
     config.relativePath = (STRING_HANDLE)0x42;
     config.hostAddress = (STRING_HANDLE)0x42;
-    config.securityKey = (STRING_HANDLE)0x42;
-
-    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
-        .IgnoreArgument(1);
-
-    STRICT_EXPECTED_CALL(gballoc_malloc(sizeof(AZURE_FUNCTIONS_CONFIG)));
+    config.securityKey = NULL;
+    config.maxInFlight = 1;
+    config.batchSize = 3;
 
     STRICT_EXPECTED_CALL(STRING_clone((STRING_HANDLE)IGNORED_PTR_ARG))
         .IgnoreArgument(1)
@@ -1703,592 +2005,157 @@ TEST_FUNCTION(AZURE_FUNCTIONS_Receive_fail_when_HTTPHeaders_AddHeaderNameValuePa
         .IgnoreArgument(1)
         .SetReturn((STRING_HANDLE)0x42);
 
-    STRICT_EXPECTED_CALL(STRING_clone((STRING_HANDLE)IGNORED_PTR_ARG))
-        .IgnoreArgument(1)
+    STRICT_EXPECTED_CALL(STRING_clone((STRING_HANDLE)0x42))
         .SetReturn((STRING_HANDLE)0x42);
 
     MODULE_HANDLE moduleInfo = MODULE_CREATE(apis)((BROKER_HANDLE)0x42, &config);
+    ASSERT_IS_NOT_NULL(moduleInfo);
 
     umock_c_reset_all_calls();
 
     STRICT_EXPECTED_CALL(Message_GetContent((MESSAGE_HANDLE)0x42))
-        .SetReturn(&buffer);
-
-    STRICT_EXPECTED_CALL(Base64_Encode_Bytes(buffer.buffer, buffer.size))
-        .SetReturn((STRING_HANDLE)0x42);
-
-    STRICT_EXPECTED_CALL(STRING_construct(IGNORED_PTR_ARG))
-        .IgnoreAllArguments()
-        .SetReturn((STRING_HANDLE)0x42);
-
-    STRICT_EXPECTED_CALL(STRING_concat((STRING_HANDLE)0x42, IGNORED_PTR_ARG))
-        .IgnoreArgument(2)
-        .SetReturn(0);
-
-    STRICT_EXPECTED_CALL(STRING_concat_with_STRING((STRING_HANDLE)0x42, (STRING_HANDLE)0x42))
-        .SetReturn(0);
-
-    STRICT_EXPECTED_CALL(STRING_concat((STRING_HANDLE)0x42, IGNORED_PTR_ARG))
-        .IgnoreArgument(2)
-        .SetReturn(0);
-
-    STRICT_EXPECTED_CALL(STRING_c_str((STRING_HANDLE)0x42))
-        .SetReturn("AnyContent42");
-
-    STRICT_EXPECTED_CALL(HTTPAPIEX_Create(IGNORED_PTR_ARG))
-        .IgnoreAllArguments()
-        .SetReturn((HTTPAPIEX_HANDLE)0x42);
-
-    STRICT_EXPECTED_CALL(BUFFER_new())
-        .SetReturn((BUFFER_HANDLE)0x42);
-
-    STRICT_EXPECTED_CALL(STRING_clone((STRING_HANDLE)0x42))
-        .SetReturn((STRING_HANDLE)0x42);
-
-    STRICT_EXPECTED_CALL(STRING_concat((STRING_HANDLE)0x42, IGNORED_PTR_ARG))
-        .IgnoreArgument(2)
-        .SetReturn(0);
-
-    STRICT_EXPECTED_CALL(HTTPHeaders_Alloc())
-        .SetReturn((HTTP_HEADERS_HANDLE)0x42);
-
-    STRICT_EXPECTED_CALL(HTTPHeaders_AddHeaderNameValuePair((HTTP_HEADERS_HANDLE)0x42, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreArgument(2)
-        .IgnoreArgument(3)
-        .SetReturn(HTTP_HEADERS_ERROR);
-
-    STRICT_EXPECTED_CALL(HTTPHeaders_Free((HTTP_HEADERS_HANDLE)0x42));
-
-    STRICT_EXPECTED_CALL(STRING_delete((STRING_HANDLE)0x42));
-
-    STRICT_EXPECTED_CALL(BUFFER_delete((BUFFER_HANDLE)0x42));
-
-    STRICT_EXPECTED_CALL(HTTPAPIEX_Destroy((HTTPAPIEX_HANDLE)0x42));
-
-    STRICT_EXPECTED_CALL(STRING_delete((STRING_HANDLE)0x42));
-
-    STRICT_EXPECTED_CALL(STRING_delete((STRING_HANDLE)0x42));
+        .SetReturn(NULL);
 
     //act
     MODULE_RECEIVE(apis)(moduleInfo, (MESSAGE_HANDLE)0x42);
+    MODULE_RECEIVE(apis)(moduleInfo, (MESSAGE_HANDLE)0x43);
+    MODULE_DESTROY(apis)(moduleInfo);
 
     //assert
-    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
-
-    //cleanup 
-    MODULE_DESTROY(apis)(moduleInfo);
+    ASSERT_ARE_EQUAL(size_t, 1, g_postCount);
+    ASSERT_ARE_EQUAL(char_ptr, "[{\"content\":\"YWJj\"}]", g_postedBody[0]);
+    ASSERT_ARE_EQUAL(size_t, 2, g_destroyedMessages);
 }
 
-/* Tests_SRS_AZUREFUNCTIONS_04_025: [ AzureFunctions_Receive shall add 2 HTTP Headers to POST Request. Content-Type:application/json and, if securityKey exists x-functions-key:securityKey. If it fails it shall fail and return. ] */
-TEST_FUNCTION(AZURE_FUNCTIONS_Receive_fail_when_HTTPHeaders_AddHeaderNameValuePair2_fails)
+/* Tests_SRS_AZUREFUNCTIONS_04_012: [ The sender shall get the message content by calling Message_GetContent, a message without content is not posted. ] */
+/* Tests_SRS_AZUREFUNCTIONS_04_019: [ The sender shall destroy the messages it took once they are posted. ] */
+TEST_FUNCTION(AZURE_FUNCTIONS_Receive_releases_the_message_when_Message_GetContent_fails)
 {
     // arrange
     const MODULE_API* apis = Module_GetApi(MODULE_API_VERSION_1);
 
-    CONSTBUFFER buffer;
-    buffer.buffer = (const unsigned char*)"12345";
-    buffer.size = sizeof("12345");
-
     AZURE_FUNCTIONS_CONFIG config;
     config.relativePath = (STRING_HANDLE)0x42;
     config.hostAddress = (STRING_HANDLE)0x42;
     config.securityKey = (STRING_HANDLE)0x42;
+    config.maxInFlight = 1;
+    config.batchSize = 0;
 
-    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
-        .IgnoreArgument(1);
-
-    STRICT_EXPECTED_CALL(gballoc_malloc(sizeof(AZURE_FUNCTIONS_CONFIG)));
-
-    STRICT_EXPECTED_CALL(STRING_clone((STRING_HANDLE)IGNORED_PTR_ARG))
-        .IgnoreArgument(1)
-        .SetReturn((STRING_HANDLE)0x42);
-
-    STRICT_EXPECTED_CALL(STRING_clone((STRING_HANDLE)IGNORED_PTR_ARG))
-        .IgnoreArgument(1)
-        .SetReturn((STRING_HANDLE)0x42);
-
-    STRICT_EXPECTED_CALL(STRING_clone((STRING_HANDLE)IGNORED_PTR_ARG))
-        .IgnoreArgument(1)
-        .SetReturn((STRING_HANDLE)0x42);
+    expected_calls_create(true);
 
     MODULE_HANDLE moduleInfo = MODULE_CREATE(apis)((BROKER_HANDLE)0x42, &config);
+    ASSERT_IS_NOT_NULL(moduleInfo);
 
     umock_c_reset_all_calls();
 
     STRICT_EXPECTED_CALL(Message_GetContent((MESSAGE_HANDLE)0x42))
-        .SetReturn(&buffer);
-
-    STRICT_EXPECTED_CALL(Base64_Encode_Bytes(buffer.buffer, buffer.size))
-        .SetReturn((STRING_HANDLE)0x42);
-
-    STRICT_EXPECTED_CALL(STRING_construct(IGNORED_PTR_ARG))
-        .IgnoreAllArguments()
-        .SetReturn((STRING_HANDLE)0x42);
-
-    STRICT_EXPECTED_CALL(STRING_concat((STRING_HANDLE)0x42, IGNORED_PTR_ARG))
-        .IgnoreArgument(2)
-        .SetReturn(0);
-
-    STRICT_EXPECTED_CALL(STRING_concat_with_STRING((STRING_HANDLE)0x42, (STRING_HANDLE)0x42))
-        .SetReturn(0);
-
-    STRICT_EXPECTED_CALL(STRING_concat((STRING_HANDLE)0x42, IGNORED_PTR_ARG))
-        .IgnoreArgument(2)
-        .SetReturn(0);
-
-    STRICT_EXPECTED_CALL(STRING_c_str((STRING_HANDLE)0x42))
-        .SetReturn("AnyContent42");
-
-    STRICT_EXPECTED_CALL(HTTPAPIEX_Create(IGNORED_PTR_ARG))
-        .IgnoreAllArguments()
-        .SetReturn((HTTPAPIEX_HANDLE)0x42);
-
-    STRICT_EXPECTED_CALL(BUFFER_new())
-        .SetReturn((BUFFER_HANDLE)0x42);
-
-    STRICT_EXPECTED_CALL(STRING_clone((STRING_HANDLE)0x42))
-        .SetReturn((STRING_HANDLE)0x42);
-
-    STRICT_EXPECTED_CALL(STRING_concat((STRING_HANDLE)0x42, IGNORED_PTR_ARG))
-        .IgnoreArgument(2)
-        .SetReturn(0);
-
-    STRICT_EXPECTED_CALL(HTTPHeaders_Alloc())
-        .SetReturn((HTTP_HEADERS_HANDLE)0x42);
-
-    STRICT_EXPECTED_CALL(HTTPHeaders_AddHeaderNameValuePair((HTTP_HEADERS_HANDLE)0x42, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreArgument(2)
-        .IgnoreArgument(3)
-        .SetReturn(HTTP_HEADERS_OK);
-
-    STRICT_EXPECTED_CALL(STRING_c_str((STRING_HANDLE)0x42))
-        .SetReturn("AnyContent42");
-
-    STRICT_EXPECTED_CALL(HTTPHeaders_AddHeaderNameValuePair((HTTP_HEADERS_HANDLE)0x42, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreArgument(2)
-        .IgnoreArgument(3)
-        .SetReturn(HTTP_HEADERS_ERROR);
-
-    STRICT_EXPECTED_CALL(HTTPHeaders_Free((HTTP_HEADERS_HANDLE)0x42));
-
-    STRICT_EXPECTED_CALL(STRING_delete((STRING_HANDLE)0x42));
-
-    STRICT_EXPECTED_CALL(BUFFER_delete((BUFFER_HANDLE)0x42));
-
-    STRICT_EXPECTED_CALL(HTTPAPIEX_Destroy((HTTPAPIEX_HANDLE)0x42));
-
-    STRICT_EXPECTED_CALL(STRING_delete((STRING_HANDLE)0x42));
-
-    STRICT_EXPECTED_CALL(STRING_delete((STRING_HANDLE)0x42));
+        .SetReturn(NULL);
 
     //act
     MODULE_RECEIVE(apis)(moduleInfo, (MESSAGE_HANDLE)0x42);
+    MODULE_DESTROY(apis)(moduleInfo);
 
     //assert
-    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
-
-    //cleanup 
-    MODULE_DESTROY(apis)(moduleInfo);
+    ASSERT_ARE_EQUAL(size_t, 0, g_postCount);
+    ASSERT_ARE_EQUAL(size_t, 1, g_destroyedMessages);
 }
 
-/* Tests_SRS_AZUREFUNCTIONS_04_017: [ azure_functions_Receive shall HTTPAPIEX_ExecuteRequest to send the HTTP POST to Azure Functions. If it fail it shall fail and return. ] */
-TEST_FUNCTION(AZURE_FUNCTIONS_Receive_fail_when_BUFFER_create_PostContent_fails)
+/* Tests_SRS_AZUREFUNCTIONS_04_024: [ The sender shall create a JSON body with the content of the messages, base64 encoded in a buffer it reuses for every request. If it fails it shall fail and release the messages. ] */
+TEST_FUNCTION(AZURE_FUNCTIONS_Receive_releases_the_message_when_the_body_cannot_grow)
 {
     // arrange
     const MODULE_API* apis = Module_GetApi(MODULE_API_VERSION_1);
 
-    CONSTBUFFER buffer;
-    buffer.buffer = (const unsigned char*)"12345";
-    buffer.size = sizeof("12345");
-
     AZURE_FUNCTIONS_CONFIG config;
     config.relativePath = (STRING_HANDLE)0x42;
     config.hostAddress = (STRING_HANDLE)0x42;
     config.securityKey = (STRING_HANDLE)0x42;
+    config.maxInFlight = 1;
+    config.batchSize = 0;
 
-    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
-        .IgnoreArgument(1);
-
-    STRICT_EXPECTED_CALL(gballoc_malloc(sizeof(AZURE_FUNCTIONS_CONFIG)));
-
-    STRICT_EXPECTED_CALL(STRING_clone((STRING_HANDLE)IGNORED_PTR_ARG))
-        .IgnoreArgument(1)
-        .SetReturn((STRING_HANDLE)0x42);
-
-    STRICT_EXPECTED_CALL(STRING_clone((STRING_HANDLE)IGNORED_PTR_ARG))
-        .IgnoreArgument(1)
-        .SetReturn((STRING_HANDLE)0x42);
-
-    STRICT_EXPECTED_CALL(STRING_clone((STRING_HANDLE)IGNORED_PTR_ARG))
-        .IgnoreArgument(1)
-        .SetReturn((STRING_HANDLE)0x42);
+    expected_calls_create(true);
 
     MODULE_HANDLE moduleInfo = MODULE_CREATE(apis)((BROKER_HANDLE)0x42, &config);
+    ASSERT_IS_NOT_NULL(moduleInfo);
 
     umock_c_reset_all_calls();
 
-    STRICT_EXPECTED_CALL(Message_GetContent((MESSAGE_HANDLE)0x42))
-        .SetReturn(&buffer);
-
-    STRICT_EXPECTED_CALL(Base64_Encode_Bytes(buffer.buffer, buffer.size))
-        .SetReturn((STRING_HANDLE)0x42);
-
-    STRICT_EXPECTED_CALL(STRING_construct(IGNORED_PTR_ARG))
-        .IgnoreAllArguments()
-        .SetReturn((STRING_HANDLE)0x42);
-
-    STRICT_EXPECTED_CALL(STRING_concat((STRING_HANDLE)0x42, IGNORED_PTR_ARG))
-        .IgnoreArgument(2)
-        .SetReturn(0);
-
-    STRICT_EXPECTED_CALL(STRING_concat_with_STRING((STRING_HANDLE)0x42, (STRING_HANDLE)0x42))
-        .SetReturn(0);
-
-    STRICT_EXPECTED_CALL(STRING_concat((STRING_HANDLE)0x42, IGNORED_PTR_ARG))
-        .IgnoreArgument(2)
-        .SetReturn(0);
-
-    STRICT_EXPECTED_CALL(STRING_c_str((STRING_HANDLE)0x42))
-        .SetReturn("AnyContent42");
-
-    STRICT_EXPECTED_CALL(HTTPAPIEX_Create(IGNORED_PTR_ARG))
-        .IgnoreAllArguments()
-        .SetReturn((HTTPAPIEX_HANDLE)0x42);
-
-    STRICT_EXPECTED_CALL(BUFFER_new())
-        .SetReturn((BUFFER_HANDLE)0x42);
-
-    STRICT_EXPECTED_CALL(STRING_clone((STRING_HANDLE)0x42))
-        .SetReturn((STRING_HANDLE)0x42);
-
-    STRICT_EXPECTED_CALL(STRING_concat((STRING_HANDLE)0x42, IGNORED_PTR_ARG))
-        .IgnoreArgument(2)
-        .SetReturn(0);
-
-    STRICT_EXPECTED_CALL(HTTPHeaders_Alloc())
-        .SetReturn((HTTP_HEADERS_HANDLE)0x42);
-
-    STRICT_EXPECTED_CALL(HTTPHeaders_AddHeaderNameValuePair((HTTP_HEADERS_HANDLE)0x42, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreArgument(2)
-        .IgnoreArgument(3)
-        .SetReturn(HTTP_HEADERS_OK);
-
-    STRICT_EXPECTED_CALL(STRING_c_str((STRING_HANDLE)0x42))
-        .SetReturn("AnyContent42");
-
-    STRICT_EXPECTED_CALL(HTTPHeaders_AddHeaderNameValuePair((HTTP_HEADERS_HANDLE)0x42, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreArgument(2)
-        .IgnoreArgument(3)
-        .SetReturn(HTTP_HEADERS_OK);
-
-
-    STRICT_EXPECTED_CALL(STRING_length((STRING_HANDLE)0x42))
-        .SetReturn(42);
-
-    STRICT_EXPECTED_CALL(STRING_c_str((STRING_HANDLE)0x42))
-        .SetReturn("AnyContent42");
-
-    STRICT_EXPECTED_CALL(BUFFER_create(IGNORED_PTR_ARG, IGNORED_NUM_ARG))
+    STRICT_EXPECTED_CALL(gballoc_realloc(IGNORED_PTR_ARG, IGNORED_NUM_ARG))
         .IgnoreAllArguments()
         .SetReturn(NULL);
 
-    STRICT_EXPECTED_CALL(HTTPHeaders_Free((HTTP_HEADERS_HANDLE)0x42));
-
-    STRICT_EXPECTED_CALL(STRING_delete((STRING_HANDLE)0x42));
-
-    STRICT_EXPECTED_CALL(BUFFER_delete((BUFFER_HANDLE)0x42));
-
-    STRICT_EXPECTED_CALL(HTTPAPIEX_Destroy((HTTPAPIEX_HANDLE)0x42));
-
-    STRICT_EXPECTED_CALL(STRING_delete((STRING_HANDLE)0x42));
-
-    STRICT_EXPECTED_CALL(STRING_delete((STRING_HANDLE)0x42));
-
-
     //act
-    MODULE_RECEIVE(apis)(moduleInfo, (MESSAGE_HANDLE)0x42);
+    MODULE_RECEIVE(apis)(moduleInfo, (MESSAGE_HANDLE)0x44);
+    MODULE_DESTROY(apis)(moduleInfo);
 
     //assert
-    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
-
-    //cleanup 
-    MODULE_DESTROY(apis)(moduleInfo);
+    ASSERT_ARE_EQUAL(size_t, 0, g_postCount);
+    ASSERT_ARE_EQUAL(size_t, 1, g_destroyedMessages);
 }
 
-/* Tests_SRS_AZUREFUNCTIONS_04_017: [ azure_functions_Receive shall HTTPAPIEX_ExecuteRequest to send the HTTP POST to Azure Functions. If it fail it shall fail and return. ] */
-TEST_FUNCTION(AZURE_FUNCTIONS_Receive_fail_when_httpapiex_executeRequest_fail)
+/* Tests_SRS_AZUREFUNCTIONS_04_024: [ The sender shall create a JSON body with the content of the messages, base64 encoded in a buffer it reuses for every request. If it fails it shall fail and release the messages. ] */
+TEST_FUNCTION(AZURE_FUNCTIONS_Receive_releases_the_message_when_BUFFER_build_fails)
 {
     // arrange
     const MODULE_API* apis = Module_GetApi(MODULE_API_VERSION_1);
 
-    CONSTBUFFER buffer;
-    buffer.buffer = (const unsigned char*)"12345";
-    buffer.size = sizeof("12345");
-
     AZURE_FUNCTIONS_CONFIG config;
     config.relativePath = (STRING_HANDLE)0x42;
     config.hostAddress = (STRING_HANDLE)0x42;
     config.securityKey = (STRING_HANDLE)0x42;
+    config.maxInFlight = 1;
+    config.batchSize = 0;
 
-    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
-        .IgnoreArgument(1);
-
-    STRICT_EXPECTED_CALL(gballoc_malloc(sizeof(AZURE_FUNCTIONS_CONFIG)));
-
-    STRICT_EXPECTED_CALL(STRING_clone((STRING_HANDLE)IGNORED_PTR_ARG))
-        .IgnoreArgument(1)
-        .SetReturn((STRING_HANDLE)0x42);
-
-    STRICT_EXPECTED_CALL(STRING_clone((STRING_HANDLE)IGNORED_PTR_ARG))
-        .IgnoreArgument(1)
-        .SetReturn((STRING_HANDLE)0x42);
-
-    STRICT_EXPECTED_CALL(STRING_clone((STRING_HANDLE)IGNORED_PTR_ARG))
-        .IgnoreArgument(1)
-        .SetReturn((STRING_HANDLE)0x42);
+    expected_calls_create(true);
 
     MODULE_HANDLE moduleInfo = MODULE_CREATE(apis)((BROKER_HANDLE)0x42, &config);
+    ASSERT_IS_NOT_NULL(moduleInfo);
 
     umock_c_reset_all_calls();
 
-    STRICT_EXPECTED_CALL(Message_GetContent((MESSAGE_HANDLE)0x42))
-        .SetReturn(&buffer);
-
-    STRICT_EXPECTED_CALL(Base64_Encode_Bytes(buffer.buffer, buffer.size))
-        .SetReturn((STRING_HANDLE)0x42);
-
-    STRICT_EXPECTED_CALL(STRING_construct(IGNORED_PTR_ARG))
-        .IgnoreAllArguments()
-        .SetReturn((STRING_HANDLE)0x42);
-
-    STRICT_EXPECTED_CALL(STRING_concat((STRING_HANDLE)0x42, IGNORED_PTR_ARG))
-        .IgnoreArgument(2)
-        .SetReturn(0);
-
-    STRICT_EXPECTED_CALL(STRING_concat_with_STRING((STRING_HANDLE)0x42, (STRING_HANDLE)0x42))
-        .SetReturn(0);
-
-    STRICT_EXPECTED_CALL(STRING_concat((STRING_HANDLE)0x42, IGNORED_PTR_ARG))
-        .IgnoreArgument(2)
-        .SetReturn(0);
-
-    STRICT_EXPECTED_CALL(STRING_c_str((STRING_HANDLE)0x42))
-        .SetReturn("AnyContent42");
-
-    STRICT_EXPECTED_CALL(HTTPAPIEX_Create(IGNORED_PTR_ARG))
-        .IgnoreAllArguments()
-        .SetReturn((HTTPAPIEX_HANDLE)0x42);
-
-    STRICT_EXPECTED_CALL(BUFFER_new())
-        .SetReturn((BUFFER_HANDLE)0x42);
-
-    STRICT_EXPECTED_CALL(STRING_clone((STRING_HANDLE)0x42))
-        .SetReturn((STRING_HANDLE)0x42);
-
-    STRICT_EXPECTED_CALL(STRING_concat((STRING_HANDLE)0x42, IGNORED_PTR_ARG))
-        .IgnoreArgument(2)
-        .SetReturn(0);
-
-    STRICT_EXPECTED_CALL(HTTPHeaders_Alloc())
-        .SetReturn((HTTP_HEADERS_HANDLE)0x42);
-
-    STRICT_EXPECTED_CALL(HTTPHeaders_AddHeaderNameValuePair((HTTP_HEADERS_HANDLE)0x42, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+    STRICT_EXPECTED_CALL(BUFFER_build((BUFFER_HANDLE)0x42, IGNORED_PTR_ARG, IGNORED_NUM_ARG))
         .IgnoreArgument(2)
         .IgnoreArgument(3)
-        .SetReturn(HTTP_HEADERS_OK);
-
-    STRICT_EXPECTED_CALL(STRING_c_str((STRING_HANDLE)0x42))
-        .SetReturn("AnyContent42");
-
-    STRICT_EXPECTED_CALL(HTTPHeaders_AddHeaderNameValuePair((HTTP_HEADERS_HANDLE)0x42, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreArgument(2)
-        .IgnoreArgument(3)
-        .SetReturn(HTTP_HEADERS_OK);
-
-
-    STRICT_EXPECTED_CALL(STRING_length((STRING_HANDLE)0x42))
-        .SetReturn(42);
-
-    STRICT_EXPECTED_CALL(STRING_c_str((STRING_HANDLE)0x42))
-        .SetReturn("AnyContent42");
-
-    STRICT_EXPECTED_CALL(BUFFER_create(IGNORED_PTR_ARG, IGNORED_NUM_ARG))
-        .IgnoreAllArguments()
-        .SetReturn((BUFFER_HANDLE)0x42);
-
-    STRICT_EXPECTED_CALL(STRING_c_str((STRING_HANDLE)0x42))
-        .SetReturn("AnyContent42");
-
-    STRICT_EXPECTED_CALL(HTTPAPIEX_ExecuteRequest((HTTPAPIEX_HANDLE)0x42, HTTPAPI_REQUEST_POST, IGNORED_PTR_ARG, (HTTP_HEADERS_HANDLE)0x42, (BUFFER_HANDLE)0x42, IGNORED_PTR_ARG, NULL, (BUFFER_HANDLE)0x42))
-        .IgnoreArgument(3)
-        .IgnoreArgument(6)
-        .SetReturn(HTTPAPIEX_ERROR);
-
-    STRICT_EXPECTED_CALL(BUFFER_delete((BUFFER_HANDLE)0x42));
-
-    STRICT_EXPECTED_CALL(HTTPHeaders_Free((HTTP_HEADERS_HANDLE)0x42));
-
-    STRICT_EXPECTED_CALL(STRING_delete((STRING_HANDLE)0x42));
-
-    STRICT_EXPECTED_CALL(BUFFER_delete((BUFFER_HANDLE)0x42));
-
-    STRICT_EXPECTED_CALL(HTTPAPIEX_Destroy((HTTPAPIEX_HANDLE)0x42));
-
-    STRICT_EXPECTED_CALL(STRING_delete((STRING_HANDLE)0x42));
-
-    STRICT_EXPECTED_CALL(STRING_delete((STRING_HANDLE)0x42));
-
+        .SetReturn(__LINE__);
 
     //act
     MODULE_RECEIVE(apis)(moduleInfo, (MESSAGE_HANDLE)0x42);
+    MODULE_DESTROY(apis)(moduleInfo);
 
     //assert
-    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
-
-    //cleanup 
-    MODULE_DESTROY(apis)(moduleInfo);
+    ASSERT_ARE_EQUAL(size_t, 0, g_postCount);
+    ASSERT_ARE_EQUAL(size_t, 1, g_destroyedMessages);
 }
 
-/* Tests_SRS_AZUREFUNCTIONS_04_025: [ AzureFunctions_Receive shall add 2 HTTP Headers to POST Request. Content-Type:application/json and, if securityKey exists x-functions-key:securityKey. If it fails it shall fail and return. ] */
-/* Tests_SRS_AZUREFUNCTIONS_04_024: [ AzureFunctions_Receive shall create a JSON STRING with the content of the message received. If it fails it shall fail and return. ] */
-/* Tests_SRS_AZUREFUNCTIONS_04_019: [ azure_functions_Receive shall destroy any allocated memory before returning. ] */
-/* Tests_SRS_AZUREFUNCTIONS_04_018: [ Upon success azure_functions_Receive shall log the response from HTTP POST and return. ] */
-/* Tests_SRS_AZUREFUNCTIONS_04_017: [ azure_functions_Receive shall HTTPAPIEX_ExecuteRequest to send the HTTP POST to Azure Functions. If it fail it shall fail and return. ] */
-/* Tests_SRS_AZUREFUNCTIONS_04_016: [ azure_functions_Receive shall add name and content parameter to relative path, if it fail it shall fail and return. ] */
-/* Tests_SRS_AZUREFUNCTIONS_04_015: [ azure_functions_Receive shall call allocate memory to receive data from HTTPAPI by calling BUFFER_new, if it fail it shall fail and return. ] */
-/* Tests_SRS_AZUREFUNCTIONS_04_014: [ azure_functions_Receive shall call HTTPAPIEX_Create, passing hostAddress, it if fails it shall fail and return. ] */
-/* Tests_SRS_AZUREFUNCTIONS_04_013: [ azure_functions_Receive shall base64 encode by calling Base64_Encode_Bytes, if it fails it shall fail and return. ] */
-/* Tests_SRS_AZUREFUNCTIONS_04_012: [ azure_functions_Receive shall get the message content by calling Message_GetContent, if it fails it shall fail and return. ] */
-TEST_FUNCTION(AZURE_FUNCTIONS_Receive_happy_path)
+/* Tests_SRS_AZUREFUNCTIONS_04_017: [ The sender shall call HTTPAPIEX_ExecuteRequest on its HTTPAPIEX handle to send the HTTP POST to Azure Functions. If it fails it shall log it and release the messages. ] */
+/* Tests_SRS_AZUREFUNCTIONS_04_019: [ The sender shall destroy the messages it took once they are posted. ] */
+TEST_FUNCTION(AZURE_FUNCTIONS_Receive_releases_the_message_when_HTTPAPIEX_ExecuteRequest_fails)
 {
     // arrange
     const MODULE_API* apis = Module_GetApi(MODULE_API_VERSION_1);
 
-    CONSTBUFFER buffer;
-    buffer.buffer = (const unsigned char*)"12345";
-    buffer.size = sizeof("12345");
-
     AZURE_FUNCTIONS_CONFIG config;
     config.relativePath = (STRING_HANDLE)0x42;
     config.hostAddress = (STRING_HANDLE)0x42;
     config.securityKey = (STRING_HANDLE)0x42;
+    config.maxInFlight = 1;
+    config.batchSize = 0;
 
-    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
-        .IgnoreArgument(1);
-
-    STRICT_EXPECTED_CALL(gballoc_malloc(sizeof(AZURE_FUNCTIONS_CONFIG)));
-
-    STRICT_EXPECTED_CALL(STRING_clone((STRING_HANDLE)IGNORED_PTR_ARG))
-        .IgnoreArgument(1)
-        .SetReturn((STRING_HANDLE)0x42);
-
-    STRICT_EXPECTED_CALL(STRING_clone((STRING_HANDLE)IGNORED_PTR_ARG))
-        .IgnoreArgument(1)
-        .SetReturn((STRING_HANDLE)0x42);
-
-    STRICT_EXPECTED_CALL(STRING_clone((STRING_HANDLE)IGNORED_PTR_ARG))
-        .IgnoreArgument(1)
-        .SetReturn((STRING_HANDLE)0x42);
+    expected_calls_create(true);
 
     MODULE_HANDLE moduleInfo = MODULE_CREATE(apis)((BROKER_HANDLE)0x42, &config);
+    ASSERT_IS_NOT_NULL(moduleInfo);
 
     umock_c_reset_all_calls();
-
-    STRICT_EXPECTED_CALL(Message_GetContent((MESSAGE_HANDLE)0x42))
-        .SetReturn(&buffer);
-
-    STRICT_EXPECTED_CALL(Base64_Encode_Bytes(buffer.buffer, buffer.size))
-        .SetReturn((STRING_HANDLE)0x42);
-
-    STRICT_EXPECTED_CALL(STRING_construct(IGNORED_PTR_ARG))
-        .IgnoreAllArguments()
-        .SetReturn((STRING_HANDLE)0x42);
-
-    STRICT_EXPECTED_CALL(STRING_concat((STRING_HANDLE)0x42, IGNORED_PTR_ARG))
-        .IgnoreArgument(2)
-        .SetReturn(0);
-
-    STRICT_EXPECTED_CALL(STRING_concat_with_STRING((STRING_HANDLE)0x42, (STRING_HANDLE)0x42))
-        .SetReturn(0);
-
-    STRICT_EXPECTED_CALL(STRING_concat((STRING_HANDLE)0x42, IGNORED_PTR_ARG))
-        .IgnoreArgument(2)
-        .SetReturn(0);
-
-    STRICT_EXPECTED_CALL(STRING_c_str((STRING_HANDLE)0x42))
-        .SetReturn("AnyContent42");
-
-    STRICT_EXPECTED_CALL(HTTPAPIEX_Create(IGNORED_PTR_ARG))
-        .IgnoreAllArguments()
-        .SetReturn((HTTPAPIEX_HANDLE)0x42);
-
-    STRICT_EXPECTED_CALL(BUFFER_new())
-        .SetReturn((BUFFER_HANDLE)0x42);
-
-    STRICT_EXPECTED_CALL(STRING_clone((STRING_HANDLE)0x42))
-        .SetReturn((STRING_HANDLE)0x42);
-
-    STRICT_EXPECTED_CALL(STRING_concat((STRING_HANDLE)0x42, IGNORED_PTR_ARG))
-        .IgnoreArgument(2)
-        .SetReturn(0);
-
-    STRICT_EXPECTED_CALL(HTTPHeaders_Alloc())
-        .SetReturn((HTTP_HEADERS_HANDLE)0x42);
-
-    STRICT_EXPECTED_CALL(HTTPHeaders_AddHeaderNameValuePair((HTTP_HEADERS_HANDLE)0x42, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreArgument(2)
-        .IgnoreArgument(3)
-        .SetReturn(HTTP_HEADERS_OK);
-
-    STRICT_EXPECTED_CALL(STRING_c_str((STRING_HANDLE)0x42))
-        .SetReturn("AnyContent42");
-
-    STRICT_EXPECTED_CALL(HTTPHeaders_AddHeaderNameValuePair((HTTP_HEADERS_HANDLE)0x42, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreArgument(2)
-        .IgnoreArgument(3)
-        .SetReturn(HTTP_HEADERS_OK);
-
-
-    STRICT_EXPECTED_CALL(STRING_length((STRING_HANDLE)0x42))
-        .SetReturn(42);
-
-    STRICT_EXPECTED_CALL(STRING_c_str((STRING_HANDLE)0x42))
-        .SetReturn("AnyContent42");
-
-    STRICT_EXPECTED_CALL(BUFFER_create(IGNORED_PTR_ARG, IGNORED_NUM_ARG))
-        .IgnoreAllArguments()
-        .SetReturn((BUFFER_HANDLE)0x42);
-
-    STRICT_EXPECTED_CALL(STRING_c_str((STRING_HANDLE)0x42))
-        .SetReturn("AnyContent42");
-
-    STRICT_EXPECTED_CALL(HTTPAPIEX_ExecuteRequest((HTTPAPIEX_HANDLE)0x42, HTTPAPI_REQUEST_POST, IGNORED_PTR_ARG, (HTTP_HEADERS_HANDLE)0x42, (BUFFER_HANDLE)0x42, IGNORED_PTR_ARG, NULL, (BUFFER_HANDLE)0x42))
-        .IgnoreArgument(3)
-        .IgnoreArgument(6)
-        .SetReturn(HTTPAPIEX_OK);
-
-    STRICT_EXPECTED_CALL(BUFFER_delete((BUFFER_HANDLE)0x42));
-
-    STRICT_EXPECTED_CALL(HTTPHeaders_Free((HTTP_HEADERS_HANDLE)0x42));
-
-    STRICT_EXPECTED_CALL(STRING_delete((STRING_HANDLE)0x42));
-    
-    STRICT_EXPECTED_CALL(BUFFER_delete((BUFFER_HANDLE)0x42));
-
-    STRICT_EXPECTED_CALL(HTTPAPIEX_Destroy((HTTPAPIEX_HANDLE)0x42));
-
-    STRICT_EXPECTED_CALL(STRING_delete((STRING_HANDLE)0x42));
-
-    STRICT_EXPECTED_CALL(STRING_delete((STRING_HANDLE)0x42));
+    g_requestResult = HTTPAPIEX_ERROR;
 
     //act
     MODULE_RECEIVE(apis)(moduleInfo, (MESSAGE_HANDLE)0x42);
+    MODULE_DESTROY(apis)(moduleInfo);
 
     //assert
-    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
-
-    //cleanup 
-    MODULE_DESTROY(apis)(moduleInfo);
+    ASSERT_ARE_EQUAL(size_t, 1, g_postCount);
+    ASSERT_ARE_EQUAL(size_t, 1, g_destroyedMessages);
 }
 
 END_TEST_SUITE(azure_functions_ut)
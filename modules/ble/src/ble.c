@@ -20,6 +20,7 @@
 
 #include "module.h"
 #include "message.h"
+#include "property_key.h"
 #include "broker.h"
 #include "ble_gatt_io.h"
 #include "bleio_seq.h"
@@ -40,6 +41,8 @@ typedef struct BLE_HANDLE_DATA_TAG
     BLEIO_SEQ_HANDLE    bleio_seq;
     bool                is_connected;
     bool                is_destroy_complete;
+    const char*         source_key;
+    const char*         mac_address_key;
 #if __linux__
     GMainLoop*          main_loop;
     THREAD_HANDLE       event_thread;
@@ -234,6 +237,12 @@ static MODULE_HANDLE BLE_Create(BROKER_HANDLE broker, const void* configuration)
                                 * GATT I/O object.
                                 */
                             }
+                            else
+                            {
+                                /*Codes_SRS_BLE_30_001: [ BLE_Create shall get the interned "source" and "macAddress" property keys by calling PropertyKey_Intern. ]*/
+                                result->source_key = PropertyKey_Intern(GW_SOURCE_PROPERTY);
+                                result->mac_address_key = PropertyKey_Intern(GW_MAC_ADDRESS_PROPERTY);
+                            }
 #if __linux__
                         }
 #endif
@@ -782,7 +791,6 @@ static void BLE_Receive(MODULE_HANDLE module, MESSAGE_HANDLE message)
     if (module != NULL && message != NULL)
     {
         BLE_HANDLE_DATA* handle_data = (BLE_HANDLE_DATA*)module;
-        CONSTMAP_HANDLE properties = Message_GetProperties(message);
 
         /*Codes_SRS_BLE_13_020: [ BLE_Receive shall ignore all messages except those that have the following properties:
             >| Property Name           | Description                                                             |
@@ -790,12 +798,13 @@ static void BLE_Receive(MODULE_HANDLE module, MESSAGE_HANDLE message)
             >| source                  | This property should have the value "BLE".                              |
             >| macAddress              | MAC address of the BLE device to which the data to should be written.   |
         ]*/
+        /*Codes_SRS_BLE_30_002: [ BLE_Receive shall read the "source" and "macAddress" properties by calling Message_GetProperty with the interned keys. ]*/
         // fetch the 'source' property
-        const char* source = ConstMap_GetValue(properties, GW_SOURCE_PROPERTY);
+        const char* source = Message_GetProperty(message, handle_data->source_key);
         if (source != NULL && strcmp(source, GW_SOURCE_BLE_COMMAND) == 0)
         {
             // fetch the 'macAddress' property
-            const char* mac_address = ConstMap_GetValue(properties, GW_MAC_ADDRESS_PROPERTY);
+            const char* mac_address = Message_GetProperty(message, handle_data->mac_address_key);
             if (mac_address != NULL && is_message_for_module(mac_address, handle_data) == true)
             {
                 const CONSTBUFFER* content = Message_GetContent(message);
@@ -821,8 +830,6 @@ static void BLE_Receive(MODULE_HANDLE module, MESSAGE_HANDLE message)
                 }
             }
         }
-
-        ConstMap_Destroy(properties);
     }
     else
     {
@@ -20,12 +20,15 @@
 #include "azure_c_shared_utility/base64.h"
 #include "messageproperties.h"
 #include "message.h"
+#include "property_key.h"
 #include "azure_c_shared_utility/constmap.h"
 #include "azure_c_shared_utility/map.h"
 
 typedef struct BLE_C2D_HANDLE_DATA_TAG
 {
     BROKER_HANDLE broker;
+    const char* mac_address_key;
+    const char* source_key;
 }BLE_C2D_HANDLE_DATA;
 
 static MODULE_HANDLE BLE_C2D_Create(BROKER_HANDLE broker, const void* configuration)
@@ -49,6 +52,9 @@ static MODULE_HANDLE BLE_C2D_Create(BROKER_HANDLE broker, const void* configurat
         else
         {
             result->broker = broker;
+            /*Codes_SRS_BLE_CTOD_30_001: [ BLE_C2D_Create shall get the interned "macAddress" and "source" property keys by calling PropertyKey_Intern. ]*/
+            result->mac_address_key = PropertyKey_Intern(GW_MAC_ADDRESS_PROPERTY);
+            result->source_key = PropertyKey_Intern(GW_SOURCE_PROPERTY);
         }
     }
     
@@ -82,13 +88,14 @@ static void BLE_C2D_Destroy(MODULE_HANDLE module)
     }
 }
 
-static bool validate_message(BLE_C2D_HANDLE_DATA* handle_data, CONSTMAP_HANDLE properties)
+static bool validate_message(BLE_C2D_HANDLE_DATA* handle_data, MESSAGE_HANDLE message_handle)
 {
     bool result;
-    const char * message_mac = ConstMap_GetValue(properties, GW_MAC_ADDRESS_PROPERTY);
+    /*Codes_SRS_BLE_CTOD_30_002: [ BLE_C2D_Receive shall read the "macAddress" and "source" properties by calling Message_GetProperty with the interned keys. ]*/
+    const char * message_mac = Message_GetProperty(message_handle, handle_data->mac_address_key);
     if (message_mac != NULL)
     {
-        const char * message_source = ConstMap_GetValue(properties, GW_SOURCE_PROPERTY);
+        const char * message_source = Message_GetProperty(message_handle, handle_data->source_key);
         if ((message_source != NULL) && (strcmp(message_source, GW_IDMAP_MODULE) == 0))
         {
             result = true; /* recognized */
@@ -109,56 +116,66 @@ static bool validate_message(BLE_C2D_HANDLE_DATA* handle_data, CONSTMAP_HANDLE p
     return result;
 }
 
-static int publish_instruction(BLE_C2D_HANDLE_DATA* handle_data, CONSTMAP_HANDLE properties, BLE_INSTRUCTION* ble_instr)
+static int publish_instruction(BLE_C2D_HANDLE_DATA* handle_data, MESSAGE_HANDLE message_handle, BLE_INSTRUCTION* ble_instr)
 {
     int result;
 
-    MAP_HANDLE new_message_props = ConstMap_CloneWriteable(properties);
-    if (new_message_props != NULL)
+    CONSTMAP_HANDLE properties = Message_GetProperties(message_handle);
+    if (properties == NULL)
     {
-        /*Codes_SRS_BLE_CTOD_17_020: [ BLE_C2D_Receive shall call add a property with key of "source" and value of "bleCommand". ]*/
-        if (Map_AddOrUpdate(new_message_props, GW_SOURCE_PROPERTY, GW_SOURCE_BLE_COMMAND) == MAP_OK)
+        LogError("Unable to get the message properties");
+        result = __LINE__;
+    }
+    else
+    {
+        MAP_HANDLE new_message_props = ConstMap_CloneWriteable(properties);
+        ConstMap_Destroy(properties);
+        if (new_message_props != NULL)
         {
-            MESSAGE_CONFIG cfg;
-            cfg.size = sizeof(BLE_INSTRUCTION);
-            cfg.source = (const unsigned char *)ble_instr;
-            cfg.sourceProperties = new_message_props;
-
-            /*Codes_SRS_BLE_CTOD_17_023: [ BLE_C2D_Receive shall create a new message by calling Message_Create with new map and BLE_INSTRUCTION as the buffer. ]*/
-            MESSAGE_HANDLE new_message_handle = Message_Create(&cfg);
-            if (new_message_handle != NULL)
+            /*Codes_SRS_BLE_CTOD_17_020: [ BLE_C2D_Receive shall call add a property with key of "source" and value of "bleCommand". ]*/
+            if (Map_AddOrUpdate(new_message_props, GW_SOURCE_PROPERTY, GW_SOURCE_BLE_COMMAND) == MAP_OK)
             {
-                /*Codes_SRS_BLE_CTOD_13_018: [ BLE_C2D_Receive shall publish the new message to the broker. ]*/
-                if (Broker_Publish(handle_data->broker, (MODULE_HANDLE)handle_data, new_message_handle) != BROKER_OK)
+                MESSAGE_CONFIG cfg;
+                cfg.size = sizeof(BLE_INSTRUCTION);
+                cfg.source = (const unsigned char *)ble_instr;
+                cfg.sourceProperties = new_message_props;
+
+                /*Codes_SRS_BLE_CTOD_17_023: [ BLE_C2D_Receive shall create a new message by calling Message_Create with new map and BLE_INSTRUCTION as the buffer. ]*/
+                MESSAGE_HANDLE new_message_handle = Message_Create(&cfg);
+                if (new_message_handle != NULL)
                 {
-                    LogError("Broker_Publish failed");
-                    result = __LINE__;
+                    /*Codes_SRS_BLE_CTOD_13_018: [ BLE_C2D_Receive shall publish the new message to the broker. ]*/
+                    if (Broker_Publish(handle_data->broker, (MODULE_HANDLE)handle_data, new_message_handle) != BROKER_OK)
+                    {
+                        LogError("Broker_Publish failed");
+                        result = __LINE__;
+                    }
+                    else
+                    {
+                        result = 0;
+                    }
+
+                    Message_Destroy(new_message_handle);
                 }
                 else
                 {
-                    result = 0;
+                    /*Codes_SRS_BLE_CTOD_17_024: [ If creating new message fails, BLE_C2D_Receive shall de-allocate all resources and return. ]*/
+                    LogError("Message creation failed");
+                    result = __LINE__;
                 }
-
-                Message_Destroy(new_message_handle);
             }
             else
             {
-                /*Codes_SRS_BLE_CTOD_17_024: [ If creating new message fails, BLE_C2D_Receive shall de-allocate all resources and return. ]*/
-                LogError("Message creation failed");
+                LogError("Unable to set properties");
                 result = __LINE__;
             }
+            Map_Destroy(new_message_props);
         }
         else
         {
-            LogError("Unable to set properties");
+            LogError("Unable to get writeable properties");
             result = __LINE__;
         }
-        Map_Destroy(new_message_props);
-    }
-    else
-    {
-        LogError("Unable to get writeable properties");
-        result = __LINE__;
     }
 
     return result;
@@ -169,92 +186,86 @@ static void BLE_C2D_Receive(MODULE_HANDLE module, MESSAGE_HANDLE message_handle)
     if(module != NULL && message_handle != NULL)
     {
         BLE_C2D_HANDLE_DATA* handle_data = (BLE_C2D_HANDLE_DATA*)module;
-        CONSTMAP_HANDLE properties = Message_GetProperties(message_handle);
-        if (properties != NULL)
+        if (validate_message(handle_data, message_handle) == true)
         {
-            if (validate_message(handle_data, properties) == true)
+            const CONSTBUFFER * message_content = Message_GetContent(message_handle);
+            if (message_content != NULL)
             {
-                const CONSTBUFFER * message_content = Message_GetContent(message_handle);
-                if (message_content != NULL)
+                /*Codes_SRS_BLE_CTOD_17_006: [ BLE_C2D_Receive shall parse the message contents as a JSON object. ]*/
+                JSON_Value* json = json_parse_string((const char*)(message_content->buffer));
+                if (json != NULL)
                 {
-                    /*Codes_SRS_BLE_CTOD_17_006: [ BLE_C2D_Receive shall parse the message contents as a JSON object. ]*/
-                    JSON_Value* json = json_parse_string((const char*)(message_content->buffer));
-                    if (json != NULL)
+                    JSON_Object* instr = json_value_get_object(json);
+                    if (instr != NULL)
                     {
-                        JSON_Object* instr = json_value_get_object(json);
-                        if (instr != NULL)
+                        const char* type = json_object_get_string(instr, "type");
+                        if (type != NULL)
                         {
-                            const char* type = json_object_get_string(instr, "type");
-                            if (type != NULL)
+                            const char* characteristic_uuid = json_object_get_string(instr, "characteristic_uuid");
+                            if (characteristic_uuid != NULL)
                             {
-                                const char* characteristic_uuid = json_object_get_string(instr, "characteristic_uuid");
-                                if (characteristic_uuid != NULL)
-                                {
-                                    BLE_INSTRUCTION ble_instr = { 0 };
+                                BLE_INSTRUCTION ble_instr = { 0 };
 
-                                    ble_instr.characteristic_uuid = STRING_construct(characteristic_uuid);
-                                    if (ble_instr.characteristic_uuid != NULL)
+                                ble_instr.characteristic_uuid = STRING_construct(characteristic_uuid);
+                                if (ble_instr.characteristic_uuid != NULL)
+                                {
+                                    /*Codes_SRS_BLE_CTOD_17_014: [ BLE_C2D_Receive shall parse the json object to fill in a new BLE_INSTRUCTION. ]*/
+                                    if (parse_instruction(type, instr, &ble_instr, 0) == true)
                                     {
-                                        /*Codes_SRS_BLE_CTOD_17_014: [ BLE_C2D_Receive shall parse the json object to fill in a new BLE_INSTRUCTION. ]*/
-                                        if (parse_instruction(type, instr, &ble_instr, 0) == true)
-                                        {
-                                            if (publish_instruction(handle_data, properties, &ble_instr) != 0)
-                                            {
-                                                free_instruction(&ble_instr);
-                                            }
-
-                                            /**
-                                             * NOTE:
-                                             *  We don't free the instruction if the publish is successful because the
-                                             *  BLE module will do that. Note that we are passing the string handle for
-                                             *  the characteristic UUID and the data buffer (in case of write instructions)
-                                             *  as pointers. This means that this won't really work with out-process modules.
-                                             */
-                                        }
-                                        else
+                                        if (publish_instruction(handle_data, message_handle, &ble_instr) != 0)
                                         {
-                                            /*Codes_SRS_BLE_CTOD_17_026: [ If the json object does not parse, BLE_C2D_Receive shall return. ]*/
-                                            LogError("Not a valid BLE instruction");
                                             free_instruction(&ble_instr);
                                         }
+
+                                        /**
+                                         * NOTE:
+                                         *  We don't free the instruction if the publish is successful because the
+                                         *  BLE module will do that. Note that we are passing the string handle for
+                                         *  the characteristic UUID and the data buffer (in case of write instructions)
+                                         *  as pointers. This means that this won't really work with out-process modules.
+                                         */
                                     }
                                     else
                                     {
-                                        /*Codes_SRS_BLE_CTOD_13_024: [ BLE_C2D_Receive shall do nothing if an underlying API call fails. ]*/
-                                        LogError("Characteristic uuid string creation failed.");
+                                        /*Codes_SRS_BLE_CTOD_17_026: [ If the json object does not parse, BLE_C2D_Receive shall return. ]*/
+                                        LogError("Not a valid BLE instruction");
+                                        free_instruction(&ble_instr);
                                     }
                                 }
                                 else
                                 {
-                                    /*Codes_SRS_BLE_CTOD_17_008: [ BLE_C2D_Receive shall return if the JSON object does not contain the following fields: "type" and "characteristic_uuid". ]*/
-                                    LogError("Characteristic uuid not found");
+                                    /*Codes_SRS_BLE_CTOD_13_024: [ BLE_C2D_Receive shall do nothing if an underlying API call fails. ]*/
+                                    LogError("Characteristic uuid string creation failed.");
                                 }
                             }
                             else
                             {
                                 /*Codes_SRS_BLE_CTOD_17_008: [ BLE_C2D_Receive shall return if the JSON object does not contain the following fields: "type" and "characteristic_uuid". ]*/
-                                LogError("BLE Instruction type not found");
+                                LogError("Characteristic uuid not found");
                             }
                         }
                         else
                         {
-                            LogError("JSON Object expected, not received.");
+                            /*Codes_SRS_BLE_CTOD_17_008: [ BLE_C2D_Receive shall return if the JSON object does not contain the following fields: "type" and "characteristic_uuid". ]*/
+                            LogError("BLE Instruction type not found");
                         }
-                        json_value_free(json);
                     }
                     else
                     {
-                        /*Codes_SRS_BLE_CTOD_17_007: [ If the message contents do not parse, then BLE_C2D_Receive shall do nothing. ]*/
-                        LogError("JSON parsing failed");
+                        LogError("JSON Object expected, not received.");
                     }
+                    json_value_free(json);
                 }
                 else
                 {
-                    LogError("No Message Content");
+                    /*Codes_SRS_BLE_CTOD_17_007: [ If the message contents do not parse, then BLE_C2D_Receive shall do nothing. ]*/
+                    LogError("JSON parsing failed");
                 }
             }
-
-            ConstMap_Destroy(properties);
+            else
+            {
+                LogError("No Message Content");
+            }
         }
     }
     else
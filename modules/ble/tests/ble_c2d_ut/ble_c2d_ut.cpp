@@ -11,6 +11,7 @@
 #include "ble.h"
 #include "ble_c2d.h"
 #include "message.h"
+#include "property_key.h"
 #include "azure_c_shared_utility/constmap.h"
 #include "azure_c_shared_utility/map.h"
 #include "messageproperties.h"
@@ -442,6 +443,9 @@ public:
     MOCK_STATIC_METHOD_1(, CONSTMAP_HANDLE, Message_GetProperties, MESSAGE_HANDLE, message)
     MOCK_METHOD_END(CONSTMAP_HANDLE, (CONSTMAP_HANDLE)BASEIMPLEMENTATION::gballoc_malloc(1))
 
+    MOCK_STATIC_METHOD_2(, const char*, Message_GetProperty, MESSAGE_HANDLE, message, const char*, key)
+    MOCK_METHOD_END(const char*, (const char*)NULL)
+
     MOCK_STATIC_METHOD_1(, const CONSTBUFFER*, Message_GetContent, MESSAGE_HANDLE, message)
     MOCK_METHOD_END(const CONSTBUFFER*, (const CONSTBUFFER*)NULL);
 
@@ -470,6 +474,9 @@ public:
     MOCK_STATIC_METHOD_3(, BROKER_RESULT, Broker_Publish, BROKER_HANDLE, broker, MODULE_HANDLE, source, MESSAGE_HANDLE, message)
         auto result2 = BROKER_OK;
     MOCK_METHOD_END(BROKER_RESULT, result2)
+
+    MOCK_STATIC_METHOD_1(, const char*, PropertyKey_Intern, const char*, key)
+    MOCK_METHOD_END(const char*, key)
 };
 
 DECLARE_GLOBAL_MOCK_METHOD_1(CBLEC2DMocks, , JSON_Value*, json_parse_string, const char *, filename);
@@ -500,6 +507,7 @@ DECLARE_GLOBAL_MOCK_METHOD_1(CBLEC2DMocks, , void, BUFFER_delete, BUFFER_HANDLE,
 
 DECLARE_GLOBAL_MOCK_METHOD_1(CBLEC2DMocks, , MESSAGE_HANDLE, Message_Create, const MESSAGE_CONFIG*, cfg);
 DECLARE_GLOBAL_MOCK_METHOD_1(CBLEC2DMocks, , CONSTMAP_HANDLE, Message_GetProperties, MESSAGE_HANDLE, message);
+DECLARE_GLOBAL_MOCK_METHOD_2(CBLEC2DMocks, , const char*, Message_GetProperty, MESSAGE_HANDLE, message, const char*, key);
 DECLARE_GLOBAL_MOCK_METHOD_1(CBLEC2DMocks, , const CONSTBUFFER*, Message_GetContent, MESSAGE_HANDLE, message);
 DECLARE_GLOBAL_MOCK_METHOD_1(CBLEC2DMocks, , void, Message_Destroy, MESSAGE_HANDLE, message);
 
@@ -512,6 +520,8 @@ DECLARE_GLOBAL_MOCK_METHOD_1(CBLEC2DMocks, , void, Map_Destroy, MAP_HANDLE, hand
 
 DECLARE_GLOBAL_MOCK_METHOD_3(CBLEC2DMocks, , BROKER_RESULT, Broker_Publish, BROKER_HANDLE, broker, MODULE_HANDLE, source, MESSAGE_HANDLE, message);
 
+DECLARE_GLOBAL_MOCK_METHOD_1(CBLEC2DMocks, , const char*, PropertyKey_Intern, const char*, key);
+
 BEGIN_TEST_SUITE(ble_c2d_ut)
 
     TEST_SUITE_INITIALIZE(TestClassInitialize)
@@ -636,6 +646,7 @@ BEGIN_TEST_SUITE(ble_c2d_ut)
     }
 
     /*Tests_SRS_BLE_CTOD_13_023: [ BLE_C2D_Create shall return a non-NULL handle when the function succeeds. ]*/
+    /*Tests_SRS_BLE_CTOD_30_001: [ BLE_C2D_Create shall get the interned "macAddress" and "source" property keys by calling PropertyKey_Intern. ]*/
     TEST_FUNCTION(BLE_C2D_Create_succeeds)
     {
         ///arrange
@@ -643,6 +654,8 @@ BEGIN_TEST_SUITE(ble_c2d_ut)
 
         STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
             .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, PropertyKey_Intern(GW_MAC_ADDRESS_PROPERTY));
+        STRICT_EXPECTED_CALL(mocks, PropertyKey_Intern(GW_SOURCE_PROPERTY));
 
         ///act
         auto result = BLE_C2D_Create((BROKER_HANDLE)0x42, NULL);
@@ -715,6 +728,7 @@ BEGIN_TEST_SUITE(ble_c2d_ut)
     /*Tests_SRS_BLE_CTOD_17_020: [ BLE_C2D_Receive shall call add a property with key of "source" and value of "bleCommand". ]*/
     /*Tests_SRS_BLE_CTOD_17_014: [ BLE_C2D_Receive shall parse the json object to fill in a new BLE_INSTRUCTION. ]*/
     /*Tests_SRS_BLE_CTOD_17_006: [ BLE_C2D_Receive shall parse the message contents as a JSON object. ]*/
+    /*Tests_SRS_BLE_CTOD_30_002: [ BLE_C2D_Receive shall read the "macAddress" and "source" properties by calling Message_GetProperty with the interned keys. ]*/
     TEST_FUNCTION(BLE_C2D_Receive_publishes_message)
     {
         ///arrange
@@ -734,12 +748,9 @@ BEGIN_TEST_SUITE(ble_c2d_ut)
         mocks.ResetAllCalls();
 
         MESSAGE_HANDLE fakeMessage = (MESSAGE_HANDLE)0x42;
-        STRICT_EXPECTED_CALL(mocks, Message_GetProperties(fakeMessage));
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_MAC_ADDRESS_PROPERTY))
-            .IgnoreArgument(1)
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(fakeMessage, GW_MAC_ADDRESS_PROPERTY))
             .SetReturn((const char *)"AA:BB:CC:DD:EE:FF");
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_SOURCE_PROPERTY))
-            .IgnoreArgument(1)
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(fakeMessage, GW_SOURCE_PROPERTY))
             .SetReturn((const char *)GW_IDMAP_MODULE);
         STRICT_EXPECTED_CALL(mocks, Message_GetContent(fakeMessage))
             .SetReturn((const CONSTBUFFER *)&messageBuffer);
@@ -762,6 +773,7 @@ BEGIN_TEST_SUITE(ble_c2d_ut)
         STRICT_EXPECTED_CALL(mocks, Base64_Decoder(IGNORED_PTR_ARG))
             .IgnoreArgument(1);
 
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperties(fakeMessage));
         STRICT_EXPECTED_CALL(mocks, ConstMap_CloneWriteable(IGNORED_PTR_ARG))
             .IgnoreArgument(1)
             .SetReturn((MAP_HANDLE)0x42);
@@ -854,12 +866,8 @@ BEGIN_TEST_SUITE(ble_c2d_ut)
         mocks.ResetAllCalls();
 
         MESSAGE_HANDLE fakeMessage = (MESSAGE_HANDLE)0x42;
-        STRICT_EXPECTED_CALL(mocks, Message_GetProperties(fakeMessage));
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_MAC_ADDRESS_PROPERTY))
-            .IgnoreArgument(1)
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(fakeMessage, GW_MAC_ADDRESS_PROPERTY))
             .SetFailReturn((const char *)NULL);
-        STRICT_EXPECTED_CALL(mocks, ConstMap_Destroy(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
 
         ///act
         BLE_C2D_Receive(module, (MESSAGE_HANDLE)0x42);
@@ -891,15 +899,10 @@ BEGIN_TEST_SUITE(ble_c2d_ut)
         mocks.ResetAllCalls();
 
         MESSAGE_HANDLE fakeMessage = (MESSAGE_HANDLE)0x42;
-        STRICT_EXPECTED_CALL(mocks, Message_GetProperties(fakeMessage));
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_MAC_ADDRESS_PROPERTY))
-            .IgnoreArgument(1)
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(fakeMessage, GW_MAC_ADDRESS_PROPERTY))
             .SetReturn((const char *)"AA:BB:CC:DD:EE:FF");
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_SOURCE_PROPERTY))
-            .IgnoreArgument(1)
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(fakeMessage, GW_SOURCE_PROPERTY))
             .SetFailReturn((const char *)NULL);
-        STRICT_EXPECTED_CALL(mocks, ConstMap_Destroy(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
 
         ///act
         BLE_C2D_Receive(module, (MESSAGE_HANDLE)0x42);
@@ -931,15 +934,10 @@ BEGIN_TEST_SUITE(ble_c2d_ut)
         mocks.ResetAllCalls();
 
         MESSAGE_HANDLE fakeMessage = (MESSAGE_HANDLE)0x42;
-        STRICT_EXPECTED_CALL(mocks, Message_GetProperties(fakeMessage));
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_MAC_ADDRESS_PROPERTY))
-            .IgnoreArgument(1)
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(fakeMessage, GW_MAC_ADDRESS_PROPERTY))
             .SetReturn((const char *)"AA:BB:CC:DD:EE:FF");
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_SOURCE_PROPERTY))
-            .IgnoreArgument(1)
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(fakeMessage, GW_SOURCE_PROPERTY))
             .SetReturn((const char *)"Nope. Not mapping");
-        STRICT_EXPECTED_CALL(mocks, ConstMap_Destroy(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
 
         ///act
         BLE_C2D_Receive(module, (MESSAGE_HANDLE)0x42);
@@ -971,18 +969,13 @@ BEGIN_TEST_SUITE(ble_c2d_ut)
         mocks.ResetAllCalls();
 
         MESSAGE_HANDLE fakeMessage = (MESSAGE_HANDLE)0x42;
-        STRICT_EXPECTED_CALL(mocks, Message_GetProperties(fakeMessage));
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_MAC_ADDRESS_PROPERTY))
-            .IgnoreArgument(1)
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(fakeMessage, GW_MAC_ADDRESS_PROPERTY))
             .SetReturn((const char *)"AA:BB:CC:DD:EE:FF");
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_SOURCE_PROPERTY))
-            .IgnoreArgument(1)
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(fakeMessage, GW_SOURCE_PROPERTY))
             .SetReturn((const char *)GW_IDMAP_MODULE);
         STRICT_EXPECTED_CALL(mocks, Message_GetContent(fakeMessage))
             .SetFailReturn((const CONSTBUFFER *)NULL);
 
-        STRICT_EXPECTED_CALL(mocks, ConstMap_Destroy(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
 
         ///act
         BLE_C2D_Receive(module, (MESSAGE_HANDLE)0x42);
@@ -1014,12 +1007,9 @@ BEGIN_TEST_SUITE(ble_c2d_ut)
         mocks.ResetAllCalls();
 
         MESSAGE_HANDLE fakeMessage = (MESSAGE_HANDLE)0x42;
-        STRICT_EXPECTED_CALL(mocks, Message_GetProperties(fakeMessage));
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_MAC_ADDRESS_PROPERTY))
-            .IgnoreArgument(1)
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(fakeMessage, GW_MAC_ADDRESS_PROPERTY))
             .SetReturn((const char *)"AA:BB:CC:DD:EE:FF");
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_SOURCE_PROPERTY))
-            .IgnoreArgument(1)
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(fakeMessage, GW_SOURCE_PROPERTY))
             .SetReturn((const char *)GW_IDMAP_MODULE);
         STRICT_EXPECTED_CALL(mocks, Message_GetContent(fakeMessage))
             .SetReturn((const CONSTBUFFER *)&messageBuffer);
@@ -1027,8 +1017,6 @@ BEGIN_TEST_SUITE(ble_c2d_ut)
             .IgnoreArgument(1)
             .SetFailReturn((JSON_Value*)NULL);
 
-        STRICT_EXPECTED_CALL(mocks, ConstMap_Destroy(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
 
         ///act
         BLE_C2D_Receive(module, (MESSAGE_HANDLE)0x42);
@@ -1060,12 +1048,9 @@ BEGIN_TEST_SUITE(ble_c2d_ut)
         mocks.ResetAllCalls();
 
         MESSAGE_HANDLE fakeMessage = (MESSAGE_HANDLE)0x42;
-        STRICT_EXPECTED_CALL(mocks, Message_GetProperties(fakeMessage));
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_MAC_ADDRESS_PROPERTY))
-            .IgnoreArgument(1)
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(fakeMessage, GW_MAC_ADDRESS_PROPERTY))
             .SetReturn((const char *)"AA:BB:CC:DD:EE:FF");
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_SOURCE_PROPERTY))
-            .IgnoreArgument(1)
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(fakeMessage, GW_SOURCE_PROPERTY))
             .SetReturn((const char *)GW_IDMAP_MODULE);
         STRICT_EXPECTED_CALL(mocks, Message_GetContent(fakeMessage))
             .SetReturn((const CONSTBUFFER *)&messageBuffer);
@@ -1077,8 +1062,6 @@ BEGIN_TEST_SUITE(ble_c2d_ut)
             .IgnoreArgument(1)
             .SetFailReturn((JSON_Object*)NULL);
 
-        STRICT_EXPECTED_CALL(mocks, ConstMap_Destroy(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
 
         ///act
         BLE_C2D_Receive(module, (MESSAGE_HANDLE)0x42);
@@ -1110,12 +1093,9 @@ BEGIN_TEST_SUITE(ble_c2d_ut)
         mocks.ResetAllCalls();
 
         MESSAGE_HANDLE fakeMessage = (MESSAGE_HANDLE)0x42;
-        STRICT_EXPECTED_CALL(mocks, Message_GetProperties(fakeMessage));
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_MAC_ADDRESS_PROPERTY))
-            .IgnoreArgument(1)
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(fakeMessage, GW_MAC_ADDRESS_PROPERTY))
             .SetReturn((const char *)"AA:BB:CC:DD:EE:FF");
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_SOURCE_PROPERTY))
-            .IgnoreArgument(1)
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(fakeMessage, GW_SOURCE_PROPERTY))
             .SetReturn((const char *)GW_IDMAP_MODULE);
         STRICT_EXPECTED_CALL(mocks, Message_GetContent(fakeMessage))
             .SetReturn((const CONSTBUFFER *)&messageBuffer);
@@ -1129,8 +1109,6 @@ BEGIN_TEST_SUITE(ble_c2d_ut)
             .IgnoreArgument(1)
             .SetFailReturn((const char*)NULL);
 
-        STRICT_EXPECTED_CALL(mocks, ConstMap_Destroy(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
 
         ///act
         BLE_C2D_Receive(module, (MESSAGE_HANDLE)0x42);
@@ -1162,12 +1140,9 @@ BEGIN_TEST_SUITE(ble_c2d_ut)
         mocks.ResetAllCalls();
 
         MESSAGE_HANDLE fakeMessage = (MESSAGE_HANDLE)0x42;
-        STRICT_EXPECTED_CALL(mocks, Message_GetProperties(fakeMessage));
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_MAC_ADDRESS_PROPERTY))
-            .IgnoreArgument(1)
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(fakeMessage, GW_MAC_ADDRESS_PROPERTY))
             .SetReturn((const char *)"AA:BB:CC:DD:EE:FF");
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_SOURCE_PROPERTY))
-            .IgnoreArgument(1)
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(fakeMessage, GW_SOURCE_PROPERTY))
             .SetReturn((const char *)GW_IDMAP_MODULE);
         STRICT_EXPECTED_CALL(mocks, Message_GetContent(fakeMessage))
             .SetReturn((const CONSTBUFFER *)&messageBuffer);
@@ -1184,8 +1159,6 @@ BEGIN_TEST_SUITE(ble_c2d_ut)
             .IgnoreArgument(1)
             .SetFailReturn((const char*)NULL);
 
-        STRICT_EXPECTED_CALL(mocks, ConstMap_Destroy(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
 
         ///act
         BLE_C2D_Receive(module, (MESSAGE_HANDLE)0x42);
@@ -1217,12 +1190,9 @@ BEGIN_TEST_SUITE(ble_c2d_ut)
         mocks.ResetAllCalls();
 
         MESSAGE_HANDLE fakeMessage = (MESSAGE_HANDLE)0x42;
-        STRICT_EXPECTED_CALL(mocks, Message_GetProperties(fakeMessage));
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_MAC_ADDRESS_PROPERTY))
-            .IgnoreArgument(1)
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(fakeMessage, GW_MAC_ADDRESS_PROPERTY))
             .SetReturn((const char *)"AA:BB:CC:DD:EE:FF");
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_SOURCE_PROPERTY))
-            .IgnoreArgument(1)
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(fakeMessage, GW_SOURCE_PROPERTY))
             .SetReturn((const char *)GW_IDMAP_MODULE);
         STRICT_EXPECTED_CALL(mocks, Message_GetContent(fakeMessage))
             .SetReturn((const CONSTBUFFER *)&messageBuffer);
@@ -1242,8 +1212,6 @@ BEGIN_TEST_SUITE(ble_c2d_ut)
             .IgnoreArgument(1)
             .SetFailReturn((STRING_HANDLE)NULL);
 
-        STRICT_EXPECTED_CALL(mocks, ConstMap_Destroy(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
 
         ///act
         BLE_C2D_Receive(module, (MESSAGE_HANDLE)0x42);
@@ -1275,12 +1243,9 @@ BEGIN_TEST_SUITE(ble_c2d_ut)
         mocks.ResetAllCalls();
 
         MESSAGE_HANDLE fakeMessage = (MESSAGE_HANDLE)0x42;
-        STRICT_EXPECTED_CALL(mocks, Message_GetProperties(fakeMessage));
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_MAC_ADDRESS_PROPERTY))
-            .IgnoreArgument(1)
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(fakeMessage, GW_MAC_ADDRESS_PROPERTY))
             .SetReturn((const char *)"AA:BB:CC:DD:EE:FF");
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_SOURCE_PROPERTY))
-            .IgnoreArgument(1)
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(fakeMessage, GW_SOURCE_PROPERTY))
             .SetReturn((const char *)GW_IDMAP_MODULE);
         STRICT_EXPECTED_CALL(mocks, Message_GetContent(fakeMessage))
             .SetReturn((const CONSTBUFFER *)&messageBuffer);
@@ -1304,8 +1269,6 @@ BEGIN_TEST_SUITE(ble_c2d_ut)
             .IgnoreArgument(1)
             .SetFailReturn((const char*)NULL);
 
-        STRICT_EXPECTED_CALL(mocks, ConstMap_Destroy(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
 
         ///act
         BLE_C2D_Receive(module, (MESSAGE_HANDLE)0x42);
@@ -1337,12 +1300,9 @@ BEGIN_TEST_SUITE(ble_c2d_ut)
         mocks.ResetAllCalls();
 
         MESSAGE_HANDLE fakeMessage = (MESSAGE_HANDLE)0x42;
-        STRICT_EXPECTED_CALL(mocks, Message_GetProperties(fakeMessage));
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_MAC_ADDRESS_PROPERTY))
-            .IgnoreArgument(1)
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(fakeMessage, GW_MAC_ADDRESS_PROPERTY))
             .SetReturn((const char *)"AA:BB:CC:DD:EE:FF");
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_SOURCE_PROPERTY))
-            .IgnoreArgument(1)
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(fakeMessage, GW_SOURCE_PROPERTY))
             .SetReturn((const char *)GW_IDMAP_MODULE);
         STRICT_EXPECTED_CALL(mocks, Message_GetContent(fakeMessage))
             .SetReturn((const CONSTBUFFER *)&messageBuffer);
@@ -1368,8 +1328,68 @@ BEGIN_TEST_SUITE(ble_c2d_ut)
             .IgnoreArgument(1)
             .SetFailReturn((BUFFER_HANDLE)NULL);
 
-        STRICT_EXPECTED_CALL(mocks, ConstMap_Destroy(IGNORED_PTR_ARG))
+
+        ///act
+        BLE_C2D_Receive(module, (MESSAGE_HANDLE)0x42);
+
+        ///assert
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        BLE_C2D_Destroy(module);
+    }
+
+    /*Tests_SRS_BLE_CTOD_13_024: [ BLE_C2D_Receive shall do nothing if an underlying API call fails. ]*/
+    TEST_FUNCTION(BLE_C2D_Receive_does_nothing_when_Message_GetProperties_fails)
+    {
+        ///arrange
+        CBLEC2DMocks mocks;
+        unsigned char fake = '\0';
+        CONSTBUFFER messageBuffer;
+        messageBuffer.buffer = &fake;
+        messageBuffer.size = 1;
+        STRICT_EXPECTED_CALL(mocks, json_object_get_string(IGNORED_PTR_ARG, "type"))
+            .IgnoreArgument(1)
+            .SetReturn((const char*)"write_at_init");
+        STRICT_EXPECTED_CALL(mocks, json_array_get_count(IGNORED_PTR_ARG))
+            .IgnoreArgument(1)
+            .SetReturn((size_t)1);
+
+        auto module = BLE_C2D_Create((BROKER_HANDLE)0x42, (const void*)FAKE_CONFIG);
+        mocks.ResetAllCalls();
+
+        MESSAGE_HANDLE fakeMessage = (MESSAGE_HANDLE)0x42;
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(fakeMessage, GW_MAC_ADDRESS_PROPERTY))
+            .SetReturn((const char *)"AA:BB:CC:DD:EE:FF");
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(fakeMessage, GW_SOURCE_PROPERTY))
+            .SetReturn((const char *)GW_IDMAP_MODULE);
+        STRICT_EXPECTED_CALL(mocks, Message_GetContent(fakeMessage))
+            .SetReturn((const CONSTBUFFER *)&messageBuffer);
+        STRICT_EXPECTED_CALL(mocks, json_parse_string(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, json_value_free(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, json_value_get_object(IGNORED_PTR_ARG))
             .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, json_object_get_string(IGNORED_PTR_ARG, "type"))
+            .IgnoreArgument(1)
+            .SetReturn("write_once");
+        STRICT_EXPECTED_CALL(mocks, json_object_get_string(IGNORED_PTR_ARG, "characteristic_uuid"))
+            .IgnoreArgument(1)
+            .SetReturn("F000AA02-0451-4000-B000-000000000000");
+        STRICT_EXPECTED_CALL(mocks, STRING_construct(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, json_object_get_string(IGNORED_PTR_ARG, "data"))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, Base64_Decoder(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, BUFFER_delete(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperties(fakeMessage))
+            .SetFailReturn((CONSTMAP_HANDLE)NULL);
 
         ///act
         BLE_C2D_Receive(module, (MESSAGE_HANDLE)0x42);
@@ -1401,12 +1421,9 @@ BEGIN_TEST_SUITE(ble_c2d_ut)
         mocks.ResetAllCalls();
 
         MESSAGE_HANDLE fakeMessage = (MESSAGE_HANDLE)0x42;
-        STRICT_EXPECTED_CALL(mocks, Message_GetProperties(fakeMessage));
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_MAC_ADDRESS_PROPERTY))
-            .IgnoreArgument(1)
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(fakeMessage, GW_MAC_ADDRESS_PROPERTY))
             .SetReturn((const char *)"AA:BB:CC:DD:EE:FF");
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_SOURCE_PROPERTY))
-            .IgnoreArgument(1)
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(fakeMessage, GW_SOURCE_PROPERTY))
             .SetReturn((const char *)GW_IDMAP_MODULE);
         STRICT_EXPECTED_CALL(mocks, Message_GetContent(fakeMessage))
             .SetReturn((const CONSTBUFFER *)&messageBuffer);
@@ -1433,6 +1450,7 @@ BEGIN_TEST_SUITE(ble_c2d_ut)
         STRICT_EXPECTED_CALL(mocks, BUFFER_delete(IGNORED_PTR_ARG))
             .IgnoreArgument(1);
 
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperties(fakeMessage));
         STRICT_EXPECTED_CALL(mocks, ConstMap_CloneWriteable(IGNORED_PTR_ARG))
             .IgnoreArgument(1)
             .SetFailReturn((MAP_HANDLE)NULL);
@@ -1470,12 +1488,9 @@ BEGIN_TEST_SUITE(ble_c2d_ut)
         mocks.ResetAllCalls();
 
         MESSAGE_HANDLE fakeMessage = (MESSAGE_HANDLE)0x42;
-        STRICT_EXPECTED_CALL(mocks, Message_GetProperties(fakeMessage));
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_MAC_ADDRESS_PROPERTY))
-            .IgnoreArgument(1)
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(fakeMessage, GW_MAC_ADDRESS_PROPERTY))
             .SetReturn((const char *)"AA:BB:CC:DD:EE:FF");
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_SOURCE_PROPERTY))
-            .IgnoreArgument(1)
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(fakeMessage, GW_SOURCE_PROPERTY))
             .SetReturn((const char *)GW_IDMAP_MODULE);
         STRICT_EXPECTED_CALL(mocks, Message_GetContent(fakeMessage))
             .SetReturn((const CONSTBUFFER *)&messageBuffer);
@@ -1502,6 +1517,7 @@ BEGIN_TEST_SUITE(ble_c2d_ut)
         STRICT_EXPECTED_CALL(mocks, BUFFER_delete(IGNORED_PTR_ARG))
             .IgnoreArgument(1);
 
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperties(fakeMessage));
         STRICT_EXPECTED_CALL(mocks, ConstMap_CloneWriteable(IGNORED_PTR_ARG))
             .IgnoreArgument(1)
             .SetReturn((MAP_HANDLE)0x42);
@@ -1544,12 +1560,9 @@ BEGIN_TEST_SUITE(ble_c2d_ut)
         mocks.ResetAllCalls();
 
         MESSAGE_HANDLE fakeMessage = (MESSAGE_HANDLE)0x42;
-        STRICT_EXPECTED_CALL(mocks, Message_GetProperties(fakeMessage));
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_MAC_ADDRESS_PROPERTY))
-            .IgnoreArgument(1)
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(fakeMessage, GW_MAC_ADDRESS_PROPERTY))
             .SetReturn((const char *)"AA:BB:CC:DD:EE:FF");
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_SOURCE_PROPERTY))
-            .IgnoreArgument(1)
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(fakeMessage, GW_SOURCE_PROPERTY))
             .SetReturn((const char *)GW_IDMAP_MODULE);
         STRICT_EXPECTED_CALL(mocks, Message_GetContent(fakeMessage))
             .SetReturn((const CONSTBUFFER *)&messageBuffer);
@@ -1576,6 +1589,7 @@ BEGIN_TEST_SUITE(ble_c2d_ut)
         STRICT_EXPECTED_CALL(mocks, BUFFER_delete(IGNORED_PTR_ARG))
             .IgnoreArgument(1);
 
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperties(fakeMessage));
         STRICT_EXPECTED_CALL(mocks, ConstMap_CloneWriteable(IGNORED_PTR_ARG))
             .IgnoreArgument(1)
             .SetReturn((MAP_HANDLE)0x42);
@@ -1621,12 +1635,9 @@ BEGIN_TEST_SUITE(ble_c2d_ut)
         mocks.ResetAllCalls();
 
         MESSAGE_HANDLE fakeMessage = (MESSAGE_HANDLE)0x42;
-        STRICT_EXPECTED_CALL(mocks, Message_GetProperties(fakeMessage));
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_MAC_ADDRESS_PROPERTY))
-            .IgnoreArgument(1)
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(fakeMessage, GW_MAC_ADDRESS_PROPERTY))
             .SetReturn((const char *)"AA:BB:CC:DD:EE:FF");
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_SOURCE_PROPERTY))
-            .IgnoreArgument(1)
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(fakeMessage, GW_SOURCE_PROPERTY))
             .SetReturn((const char *)GW_IDMAP_MODULE);
         STRICT_EXPECTED_CALL(mocks, Message_GetContent(fakeMessage))
             .SetReturn((const CONSTBUFFER *)&messageBuffer);
@@ -1653,6 +1664,7 @@ BEGIN_TEST_SUITE(ble_c2d_ut)
         STRICT_EXPECTED_CALL(mocks, BUFFER_delete(IGNORED_PTR_ARG))
             .IgnoreArgument(1);
 
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperties(fakeMessage));
         STRICT_EXPECTED_CALL(mocks, ConstMap_CloneWriteable(IGNORED_PTR_ARG))
             .IgnoreArgument(1)
             .SetReturn((MAP_HANDLE)0x42);
@@ -343,6 +343,10 @@ public:
         CONSTMAP_HANDLE result1 = BASEIMPLEMENTATION::Message_GetProperties(message);
     MOCK_METHOD_END(CONSTMAP_HANDLE, result1)
 
+    MOCK_STATIC_METHOD_2(, const char*, Message_GetProperty, MESSAGE_HANDLE, message, const char*, key)
+        const char* result1 = BASEIMPLEMENTATION::Message_GetProperty(message, key);
+    MOCK_METHOD_END(const char*, result1)
+
     MOCK_STATIC_METHOD_1(, const CONSTBUFFER*, Message_GetContent, MESSAGE_HANDLE, message)
         const CONSTBUFFER* result1 = BASEIMPLEMENTATION::Message_GetContent(message);
     MOCK_METHOD_END(const CONSTBUFFER*, result1)
@@ -715,6 +719,7 @@ DECLARE_GLOBAL_MOCK_METHOD_1(CBLEMocks, , MESSAGE_HANDLE, Message_Create, const
 DECLARE_GLOBAL_MOCK_METHOD_1(CBLEMocks, , MESSAGE_HANDLE, Message_CreateFromBuffer, const MESSAGE_BUFFER_CONFIG*, cfg);
 DECLARE_GLOBAL_MOCK_METHOD_1(CBLEMocks, , MESSAGE_HANDLE, Message_Clone, MESSAGE_HANDLE, message);
 DECLARE_GLOBAL_MOCK_METHOD_1(CBLEMocks, , CONSTMAP_HANDLE, Message_GetProperties, MESSAGE_HANDLE, message);
+DECLARE_GLOBAL_MOCK_METHOD_2(CBLEMocks, , const char*, Message_GetProperty, MESSAGE_HANDLE, message, const char*, key);
 DECLARE_GLOBAL_MOCK_METHOD_1(CBLEMocks, , const CONSTBUFFER*, Message_GetContent, MESSAGE_HANDLE, message);
 DECLARE_GLOBAL_MOCK_METHOD_1(CBLEMocks, , CONSTBUFFER_HANDLE, Message_GetContentHandle, MESSAGE_HANDLE, message);
 DECLARE_GLOBAL_MOCK_METHOD_1(CBLEMocks, , void, Message_Destroy, MESSAGE_HANDLE, message);
@@ -4109,16 +4114,14 @@ BEGIN_TEST_SUITE(ble_ut)
         MESSAGE_HANDLE message = Message_Create(&message_config);
         mocks.ResetAllCalls();
 
-        STRICT_EXPECTED_CALL(mocks, Message_GetProperties(message));
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(message, GW_SOURCE_PROPERTY));
 
-        STRICT_EXPECTED_CALL(mocks, ConstMap_Clone(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, ConstMap_Destroy(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_SOURCE_PROPERTY))
-            .IgnoreArgument(1);
-
-        STRICT_EXPECTED_CALL(mocks, Map_GetValueFromKey(IGNORED_PTR_ARG, GW_SOURCE_PROPERTY))
+        // the first lookup indexes the properties of the message
+        STRICT_EXPECTED_CALL(mocks, ConstMap_GetInternals(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .IgnoreAllArguments();
+        STRICT_EXPECTED_CALL(mocks, Map_GetInternals(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .IgnoreAllArguments();
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
             .IgnoreArgument(1);
 
         ///act
@@ -4177,16 +4180,14 @@ BEGIN_TEST_SUITE(ble_ut)
         MESSAGE_HANDLE message = Message_Create(&message_config);
         mocks.ResetAllCalls();
 
-        STRICT_EXPECTED_CALL(mocks, Message_GetProperties(message));
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(message, GW_SOURCE_PROPERTY));
 
-        STRICT_EXPECTED_CALL(mocks, ConstMap_Clone(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, ConstMap_Destroy(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_SOURCE_PROPERTY))
-            .IgnoreArgument(1);
-
-        STRICT_EXPECTED_CALL(mocks, Map_GetValueFromKey(IGNORED_PTR_ARG, GW_SOURCE_PROPERTY))
+        // the first lookup indexes the properties of the message
+        STRICT_EXPECTED_CALL(mocks, ConstMap_GetInternals(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .IgnoreAllArguments();
+        STRICT_EXPECTED_CALL(mocks, Map_GetInternals(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .IgnoreAllArguments();
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
             .IgnoreArgument(1);
 
         ///act
@@ -4245,20 +4246,15 @@ BEGIN_TEST_SUITE(ble_ut)
         MESSAGE_HANDLE message = Message_Create(&message_config);
         mocks.ResetAllCalls();
 
-        STRICT_EXPECTED_CALL(mocks, Message_GetProperties(message));
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(message, GW_SOURCE_PROPERTY));
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(message, GW_MAC_ADDRESS_PROPERTY));
 
-        STRICT_EXPECTED_CALL(mocks, ConstMap_Clone(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, ConstMap_Destroy(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_SOURCE_PROPERTY))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_MAC_ADDRESS_PROPERTY))
-            .IgnoreArgument(1);
-
-        STRICT_EXPECTED_CALL(mocks, Map_GetValueFromKey(IGNORED_PTR_ARG, GW_SOURCE_PROPERTY))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, Map_GetValueFromKey(IGNORED_PTR_ARG, GW_MAC_ADDRESS_PROPERTY))
+        // the first lookup indexes the properties of the message
+        STRICT_EXPECTED_CALL(mocks, ConstMap_GetInternals(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .IgnoreAllArguments();
+        STRICT_EXPECTED_CALL(mocks, Map_GetInternals(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .IgnoreAllArguments();
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
             .IgnoreArgument(1);
 
         ///act
@@ -4319,20 +4315,15 @@ BEGIN_TEST_SUITE(ble_ut)
         MESSAGE_HANDLE message = Message_Create(&message_config);
         mocks.ResetAllCalls();
 
-        STRICT_EXPECTED_CALL(mocks, Message_GetProperties(message));
-
-        STRICT_EXPECTED_CALL(mocks, ConstMap_Clone(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, ConstMap_Destroy(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_SOURCE_PROPERTY))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_MAC_ADDRESS_PROPERTY))
-            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(message, GW_SOURCE_PROPERTY));
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(message, GW_MAC_ADDRESS_PROPERTY));
 
-        STRICT_EXPECTED_CALL(mocks, Map_GetValueFromKey(IGNORED_PTR_ARG, GW_SOURCE_PROPERTY))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, Map_GetValueFromKey(IGNORED_PTR_ARG, GW_MAC_ADDRESS_PROPERTY))
+        // the first lookup indexes the properties of the message
+        STRICT_EXPECTED_CALL(mocks, ConstMap_GetInternals(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .IgnoreAllArguments();
+        STRICT_EXPECTED_CALL(mocks, Map_GetInternals(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .IgnoreAllArguments();
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
             .IgnoreArgument(1);
 
         ///act
@@ -4388,20 +4379,15 @@ BEGIN_TEST_SUITE(ble_ut)
         MESSAGE_HANDLE message = Message_Create(&message_config);
         mocks.ResetAllCalls();
 
-        STRICT_EXPECTED_CALL(mocks, Message_GetProperties(message));
-
-        STRICT_EXPECTED_CALL(mocks, ConstMap_Clone(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, ConstMap_Destroy(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_SOURCE_PROPERTY))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_MAC_ADDRESS_PROPERTY))
-            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(message, GW_SOURCE_PROPERTY));
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(message, GW_MAC_ADDRESS_PROPERTY));
 
-        STRICT_EXPECTED_CALL(mocks, Map_GetValueFromKey(IGNORED_PTR_ARG, GW_SOURCE_PROPERTY))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, Map_GetValueFromKey(IGNORED_PTR_ARG, GW_MAC_ADDRESS_PROPERTY))
+        // the first lookup indexes the properties of the message
+        STRICT_EXPECTED_CALL(mocks, ConstMap_GetInternals(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .IgnoreAllArguments();
+        STRICT_EXPECTED_CALL(mocks, Map_GetInternals(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .IgnoreAllArguments();
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
             .IgnoreArgument(1);
 
         ///act
@@ -4456,26 +4442,21 @@ BEGIN_TEST_SUITE(ble_ut)
         MESSAGE_HANDLE message = Message_Create(&message_config);
         mocks.ResetAllCalls();
 
-        STRICT_EXPECTED_CALL(mocks, Message_GetProperties(message));
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(message, GW_SOURCE_PROPERTY));
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(message, GW_MAC_ADDRESS_PROPERTY));
         STRICT_EXPECTED_CALL(mocks, Message_GetContent(message));
 
-        STRICT_EXPECTED_CALL(mocks, ConstMap_Clone(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, ConstMap_Destroy(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_SOURCE_PROPERTY))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_MAC_ADDRESS_PROPERTY))
+        // the first lookup indexes the properties of the message
+        STRICT_EXPECTED_CALL(mocks, ConstMap_GetInternals(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .IgnoreAllArguments();
+        STRICT_EXPECTED_CALL(mocks, Map_GetInternals(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .IgnoreAllArguments();
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
             .IgnoreArgument(1);
 
         STRICT_EXPECTED_CALL(mocks, CONSTBUFFER_GetContent(IGNORED_PTR_ARG))
             .IgnoreArgument(1);
 
-        STRICT_EXPECTED_CALL(mocks, Map_GetValueFromKey(IGNORED_PTR_ARG, GW_SOURCE_PROPERTY))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, Map_GetValueFromKey(IGNORED_PTR_ARG, GW_MAC_ADDRESS_PROPERTY))
-            .IgnoreArgument(1);
-
         ///act
         BLE_Receive(handle, message);
 
@@ -4492,6 +4473,7 @@ BEGIN_TEST_SUITE(ble_ut)
     }
 
     /*Tests_SRS_BLE_13_021: [ BLE_Receive shall treat the content of the message as a BLE_INSTRUCTION and schedule it for execution by calling BLEIO_Seq_AddInstruction. ]*/
+    /*Tests_SRS_BLE_30_002: [ BLE_Receive shall read the "source" and "macAddress" properties by calling Message_GetProperty with the interned keys. ]*/
     TEST_FUNCTION(BLE_Receive_calls_BLEIO_Seq_AddInstruction)
     {
         ///arrrange
@@ -4537,26 +4519,21 @@ BEGIN_TEST_SUITE(ble_ut)
         MESSAGE_HANDLE message = Message_Create(&message_config);
         mocks.ResetAllCalls();
 
-        STRICT_EXPECTED_CALL(mocks, Message_GetProperties(message));
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(message, GW_SOURCE_PROPERTY));
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(message, GW_MAC_ADDRESS_PROPERTY));
         STRICT_EXPECTED_CALL(mocks, Message_GetContent(message));
 
-        STRICT_EXPECTED_CALL(mocks, ConstMap_Clone(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, ConstMap_Destroy(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_SOURCE_PROPERTY))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_MAC_ADDRESS_PROPERTY))
+        // the first lookup indexes the properties of the message
+        STRICT_EXPECTED_CALL(mocks, ConstMap_GetInternals(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .IgnoreAllArguments();
+        STRICT_EXPECTED_CALL(mocks, Map_GetInternals(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .IgnoreAllArguments();
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
             .IgnoreArgument(1);
 
         STRICT_EXPECTED_CALL(mocks, CONSTBUFFER_GetContent(IGNORED_PTR_ARG))
             .IgnoreArgument(1);
 
-        STRICT_EXPECTED_CALL(mocks, Map_GetValueFromKey(IGNORED_PTR_ARG, GW_SOURCE_PROPERTY))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, Map_GetValueFromKey(IGNORED_PTR_ARG, GW_MAC_ADDRESS_PROPERTY))
-            .IgnoreArgument(1);
-
         STRICT_EXPECTED_CALL(mocks, BLEIO_Seq_AddInstruction(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
             .IgnoreArgument(1)
             .IgnoreArgument(2);
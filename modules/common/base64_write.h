@@ -0,0 +1,42 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifndef BASE64_WRITE_H
+#define BASE64_WRITE_H
+
+#include <stddef.h>
+
+/*characters base64_write writes for size bytes*/
+#define BASE64_WRITE_LENGTH(size) ((((size) + 2) / 3) * 4)
+
+/*base64 encodes size bytes into destination, which has room for BASE64_WRITE_LENGTH(size) characters, without allocating like
+Base64_Encode_Bytes does. Returns the end of what was written, nothing is NUL terminated.*/
+static char* base64_write(char* destination, const unsigned char* source, size_t size)
+{
+    static const char base64Digits[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    size_t i;
+    for (i = 0; i + 2 < size; i += 3)
+    {
+        *destination++ = base64Digits[source[i] >> 2];
+        *destination++ = base64Digits[((source[i] & 0x03) << 4) | (source[i + 1] >> 4)];
+        *destination++ = base64Digits[((source[i + 1] & 0x0F) << 2) | (source[i + 2] >> 6)];
+        *destination++ = base64Digits[source[i + 2] & 0x3F];
+    }
+    if (i + 1 == size)
+    {
+        *destination++ = base64Digits[source[i] >> 2];
+        *destination++ = base64Digits[(source[i] & 0x03) << 4];
+        *destination++ = '=';
+        *destination++ = '=';
+    }
+    else if (i + 2 == size)
+    {
+        *destination++ = base64Digits[source[i] >> 2];
+        *destination++ = base64Digits[((source[i] & 0x03) << 4) | (source[i + 1] >> 4)];
+        *destination++ = base64Digits[(source[i + 1] & 0x0F) << 2];
+        *destination++ = '=';
+    }
+    return destination;
+}
+
+#endif /*BASE64_WRITE_H*/
@@ -11,6 +11,7 @@
 
 #define GW_SOURCE_BLE_COMMAND               "bleCommand"
 #define GW_SOURCE_BLE_TELEMETRY             "bleTelemetry"
+#define GW_SOURCE_LATENCY_REPORT            "latencyReport"
 
 #define GW_IDMAP_MODULE                     "mapping"
 #define GW_IOTHUB_MODULE                    "iothub"
@@ -18,5 +19,7 @@
 #define GW_BLE_CONTROLLER_INDEX_PROPERTY    "bleControllerIndex"
 #define GW_TIMESTAMP_PROPERTY               "timestamp"
 #define GW_CHARACTERISTIC_UUID_PROPERTY     "characteristicUUID"
+#define GW_SEQUENCE_PROPERTY                "sequence"
+#define GW_SEND_TIME_PROPERTY               "sendTime" /*microseconds of the monotonic clock of the machine*/
 
 #endif /*MESSAGEPROPERTIES_H*/
@@ -0,0 +1,37 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifndef MONOTONIC_CLOCK_H
+#define MONOTONIC_CLOCK_H
+
+#include <stdint.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+/*nanoseconds of the monotonic clock of the machine, the same for every process*/
+static uint64_t MonotonicClock_GetNs(void)
+{
+#ifdef _WIN32
+    static LARGE_INTEGER frequency;
+    LARGE_INTEGER counter;
+    if (frequency.QuadPart == 0)
+    {
+        (void)QueryPerformanceFrequency(&frequency);
+    }
+    (void)QueryPerformanceCounter(&counter);
+    return (uint64_t)((double)counter.QuadPart * 1000000000.0 / (double)frequency.QuadPart);
+#else
+    struct timespec now;
+    (void)clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + (uint64_t)now.tv_nsec;
+#endif
+}
+
+/*microseconds of the same clock, the time GW_SEND_TIME_PROPERTY is in*/
+#define MonotonicClock_GetUs() (MonotonicClock_GetNs() / 1000)
+
+#endif /*MONOTONIC_CLOCK_H*/
@@ -5,6 +5,7 @@
 #define IDENTITYMAP_H
 
 #include "module.h"
+#include "azure_c_shared_utility/vector.h"
 
 #ifdef __cplusplus
 extern "C"
@@ -18,6 +19,15 @@ typedef struct IDENTITY_MAP_CONFIG_TAG
     const char* deviceKey;
 } IDENTITY_MAP_CONFIG;
 
+#define IDENTITY_MAP_DEFAULT_RELOAD_INTERVAL_MS 1000
+
+typedef struct IDENTITY_MAP_MODULE_CONFIG_TAG
+{
+    VECTOR_HANDLE mapping; /*vector of IDENTITY_MAP_CONFIG, NULL when mappingFile is set*/
+    const char* mappingFile; /*JSON array of IDENTITY_MAP_CONFIG objects, reloaded when it changes, NULL when mapping is set*/
+    unsigned int reloadIntervalMs; /*how often mappingFile is checked, 0 means IDENTITY_MAP_DEFAULT_RELOAD_INTERVAL_MS*/
+} IDENTITY_MAP_MODULE_CONFIG;
+
 MODULE_EXPORT const MODULE_API* MODULE_STATIC_GETAPI(IDENTITYMAP_MODULE)(MODULE_API_VERSION gateway_api_version);
 
 #ifdef __cplusplus
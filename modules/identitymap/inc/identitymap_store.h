@@ -0,0 +1,42 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifndef IDENTITYMAP_STORE_H
+#define IDENTITYMAP_STORE_H
+
+#include <stdint.h>
+
+/*
+ * An identity store is a mapping file the identity map module maps read-only and searches in place.
+ * identitymap_store_builder writes it from a JSON mapping. The layout is:
+ *
+ *     IDENTITY_MAP_STORE_HEADER
+ *     IDENTITY_MAP_STORE_RECORD[count]    sorted by MAC address
+ *     uint32_t[count]                     record numbers sorted by deviceId
+ *     char[stringsSize]                   the NUL terminated strings of the records
+ *
+ * Numbers are in the byte order of the machine that built the store, the magic number does not
+ * match on a machine of the other byte order.
+ */
+
+#define IDENTITY_MAP_STORE_MAGIC 0x534D4449 /*"IDMS" in little endian*/
+#define IDENTITY_MAP_STORE_VERSION 1
+
+typedef struct IDENTITY_MAP_STORE_HEADER_TAG
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t count;
+    uint32_t stringsSize;
+} IDENTITY_MAP_STORE_HEADER;
+
+typedef struct IDENTITY_MAP_STORE_RECORD_TAG
+{
+    uint32_t macHigh; /*the 16 high bits of the MAC address*/
+    uint32_t macLow; /*its 32 low bits*/
+    uint32_t macAddress; /*offsets of the strings, the MAC address is in upper case*/
+    uint32_t deviceId;
+    uint32_t deviceKey;
+} IDENTITY_MAP_STORE_RECORD;
+
+#endif /*IDENTITYMAP_STORE_H*/
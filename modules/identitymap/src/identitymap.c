@@ -4,6 +4,17 @@
 #include <stdlib.h>
 #include <stddef.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <limits.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
 #include "azure_c_shared_utility/gballoc.h"
 
 #include <stddef.h>
@@ -13,21 +24,58 @@
 #include "azure_c_shared_utility/crt_abstractions.h"
 #include "messageproperties.h"
 #include "message.h"
+#include "property_key.h"
 #include "broker.h"
 #include "identitymap.h"
+#include "identitymap_store.h"
 #include "azure_c_shared_utility/constmap.h"
 #include "azure_c_shared_utility/constbuffer.h"
 #include "azure_c_shared_utility/xlogging.h"
 #include "azure_c_shared_utility/vector.h"
+#include "azure_c_shared_utility/lock.h"
+#include "azure_c_shared_utility/condition.h"
+#include "azure_c_shared_utility/threadapi.h"
 
 #include <parson.h>
 
+typedef struct IDENTITY_MAP_SLOT_TAG
+{
+    uint64_t mac;
+    const IDENTITY_MAP_CONFIG * entry; /*NULL when the slot is free*/
+} IDENTITY_MAP_SLOT;
+
+/*one generation of the mapping, replaced as a whole when the mapping file changes*/
+typedef struct IDENTITY_MAP_TABLE_TAG
+{
+    size_t mappingSize;
+    IDENTITY_MAP_CONFIG * entries; /*sorted by deviceId, NULL for an identity store*/
+    IDENTITY_MAP_SLOT * slots; /*open addressing by MAC address, at most half full*/
+    size_t slotMask;
+    const unsigned char * store; /*the mapped identity store, searched in place, NULL when the mapping was read from JSON*/
+    size_t storeSize;
+    const IDENTITY_MAP_STORE_RECORD * records;
+    const uint32_t * deviceIndex;
+    const char * strings;
+    size_t stringsSize;
+    size_t refCount; /*the module and every Receive using the table, guarded by lock*/
+} IDENTITY_MAP_TABLE;
+
 typedef struct IDENTITY_MAP_DATA_TAG
 {
     BROKER_HANDLE broker;
-    size_t mappingSize;
-    IDENTITY_MAP_CONFIG * macToDevIdArray;
-    IDENTITY_MAP_CONFIG * devIdToMacArray;
+    IDENTITY_MAP_TABLE * table;
+    char * mappingFile; /*NULL when the mapping is given inline, there is then no lock and no reloader*/
+    unsigned int reloadIntervalMs;
+    time_t fileTime;
+    off_t fileSize;
+    LOCK_HANDLE lock;
+    COND_HANDLE reloadCondition;
+    THREAD_HANDLE reloader;
+    bool stopping;
+    const char * sourceKey;
+    const char * deviceNameKey;
+    const char * deviceKeyKey;
+    const char * macAddressKey;
 } IDENTITY_MAP_DATA;
 
 #define IDENTITYMAP_RESULT_VALUES \
@@ -42,6 +90,10 @@ DEFINE_ENUM_STRINGS(BROKER_RESULT, BROKER_RESULT_VALUES);
 #define MACADDR "macAddress"
 #define DEVICENAME "deviceId"
 #define DEVICEKEY "deviceKey"
+#define MAPPINGFILE "mappingFile"
+#define RELOADINTERVAL "reloadIntervalMs"
+
+#define IDENTITY_MAP_MAC_LENGTH 17
 
 static IDENTITYMAP_RESULT IdentityMapConfig_CopyDeep(IDENTITY_MAP_CONFIG * dest, IDENTITY_MAP_CONFIG * source);
 static void IdentityMapConfig_Free(IDENTITY_MAP_CONFIG * element);
@@ -183,120 +235,746 @@ static IDENTITYMAP_RESULT IdentityMapConfig_CopyDeep(IDENTITY_MAP_CONFIG * dest,
 }
 
 /*
- * @brief    Free strings associated with IDENTITY_MAP_CONFIG structure
+ * @brief    Free strings associated with IDENTITY_MAP_CONFIG structure
+ */
+static void IdentityMapConfig_Free(IDENTITY_MAP_CONFIG * element)
+{
+    /*Codes_SRS_IDMAP_17_015: [IdentityMap_Destroy shall release all resources allocated for the module.]*/
+    free((void*)element->macAddress);
+    free((void*)element->deviceId);
+    free((void*)element->deviceKey);
+}
+
+/*
+ * @brief    Read the 48 bits of a MAC address in canonical form, whatever the case of its digits.
+ */
+static bool IdentityMapConfig_ParseMAC(const char * macAddress, uint64_t * mac)
+{
+    /* Every MAC address must be in the form "XX:XX:XX:XX:XX:XX" X=[0-9,a-f,A-F] */
+    bool recognized = true;
+    uint64_t value = 0;
+    size_t i;
+    for (i = 0; (i < IDENTITY_MAP_MAC_LENGTH) && (recognized == true); i++)
+    {
+        char c = macAddress[i];
+        if ((i % 3) == 2)
+        {
+            recognized = (c == ':');
+        }
+        else if ((c >= '0') && (c <= '9'))
+        {
+            value = (value << 4) | (uint64_t)(c - '0');
+        }
+        else if ((c >= 'a') && (c <= 'f'))
+        {
+            value = (value << 4) | (uint64_t)(c - 'a' + 10);
+        }
+        else if ((c >= 'A') && (c <= 'F'))
+        {
+            value = (value << 4) | (uint64_t)(c - 'A' + 10);
+        }
+        else
+        {
+            recognized = false;
+        }
+    }
+    if ((recognized == true) && (macAddress[IDENTITY_MAP_MAC_LENGTH] == '\0'))
+    {
+        *mac = value;
+    }
+    else
+    {
+        recognized = false;
+    }
+    return recognized;
+}
+
+/*
+ * @brief    Spread a MAC address over the slots, devices of one vendor differ in the low bits only.
+ */
+static size_t IdentityMapConfig_HashMAC(uint64_t mac)
+{
+    mac ^= mac >> 29;
+    mac *= 0xbf58476d1ce4e5b9ULL;
+    mac ^= mac >> 32;
+    return (size_t)mac;
+}
+
+/*
+* @brief    Comparison function by deviceId for two IDENTITY_MAP_CONFIG structures
+*/
+static int IdentityMapConfig_IdCompare(const void * a, const void * b)
+{
+    const IDENTITY_MAP_CONFIG * idA = a;
+    const IDENTITY_MAP_CONFIG * idB = b;
+    return strcmp(idA->deviceId, idB->deviceId);
+}
+
+/*
+ * @brief    Walks through our mappingVector to ensure it is correct for our identity map module.
+ */
+static bool IdentityMap_ValidateConfig(const VECTOR_HANDLE mappingVector)
+{
+    size_t mappingSize = VECTOR_size(mappingVector);
+    bool mappingOk;
+    if (mappingSize == 0)
+    {
+        /*Codes_SRS_IDMAP_17_041: [If the configuration has no vector elements, this function shall fail and return NULL.*/
+        LogError("nothing for this module to do, no mapping data");
+        mappingOk = false;
+    }
+    else
+    {
+        mappingOk = true;
+        size_t index;
+        for (index = 0; (index < mappingSize) && (mappingOk != false); index++)
+        {
+            IDENTITY_MAP_CONFIG * element = (IDENTITY_MAP_CONFIG *)VECTOR_element(mappingVector, index);
+            if ((element->deviceId == NULL) ||
+                (element->deviceKey == NULL) ||
+                (element->macAddress == NULL))
+            {
+                /*Codes_SRS_IDMAP_17_019: [If any macAddress, deviceId or deviceKey are NULL, this function shall fail and return NULL.]*/
+                LogError("Empty mapping data values, mac=%p, ID=%p, key=%p",
+                    element->macAddress, element->deviceId, element->deviceKey);
+                mappingOk = false;
+                break;
+            }
+            else
+            {
+                uint64_t mac;
+                if (IdentityMapConfig_ParseMAC(element->macAddress, &mac) == false)
+                {
+                    /*Codes_SRS_IDMAP_17_006: [If any macAddress string in configuration is not a MAC address in canonical form, this function shall fail and return NULL.]*/
+                    LogError("Non-canonical MAC Address: %s", element->macAddress);
+                    mappingOk = false;
+                    break;
+                }
+            }
+        }
+    }
+    return mappingOk;
+}
+
+/*
+ * @brief    Map a whole file read-only, NULL when it is empty or cannot be mapped.
+ */
+static const unsigned char * IdentityMap_MapFile(const char * fileName, size_t * size)
+{
+    const unsigned char * result;
+#ifdef _WIN32
+    HANDLE file = CreateFileA(fileName, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        LogError("unable to open %s", fileName);
+        result = NULL;
+    }
+    else
+    {
+        LARGE_INTEGER fileSize;
+        HANDLE mapping;
+        if ((GetFileSizeEx(file, &fileSize) == FALSE) || (fileSize.QuadPart == 0) || ((ULONGLONG)fileSize.QuadPart > SIZE_MAX))
+        {
+            result = NULL;
+        }
+        else if ((mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL)) == NULL)
+        {
+            LogError("unable to CreateFileMapping %s", fileName);
+            result = NULL;
+        }
+        else
+        {
+            /* the view keeps the mapping alive */
+            result = (const unsigned char *)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+            if (result == NULL)
+            {
+                LogError("unable to MapViewOfFile %s", fileName);
+            }
+            else
+            {
+                *size = (size_t)fileSize.QuadPart;
+            }
+            (void)CloseHandle(mapping);
+        }
+        (void)CloseHandle(file);
+    }
+#else
+    int file = open(fileName, O_RDONLY);
+    if (file == -1)
+    {
+        LogError("unable to open %s", fileName);
+        result = NULL;
+    }
+    else
+    {
+        struct stat fileStat;
+        void * view;
+        if ((fstat(file, &fileStat) != 0) || (fileStat.st_size == 0) || ((uintmax_t)fileStat.st_size > SIZE_MAX))
+        {
+            result = NULL;
+        }
+        else if ((view = mmap(NULL, (size_t)fileStat.st_size, PROT_READ, MAP_SHARED, file, 0)) == MAP_FAILED)
+        {
+            LogError("unable to mmap %s", fileName);
+            result = NULL;
+        }
+        else
+        {
+            result = (const unsigned char *)view;
+            *size = (size_t)fileStat.st_size;
+        }
+        /* the mapping outlives the descriptor */
+        (void)close(file);
+    }
+#endif
+    return result;
+}
+
+static void IdentityMap_UnmapFile(const unsigned char * view, size_t size)
+{
+#ifdef _WIN32
+    (void)size;
+    (void)UnmapViewOfFile(view);
+#else
+    (void)munmap((void*)view, size);
+#endif
+}
+
+/*
+ * @brief    Release a mapping table and the triplets it owns.
+ */
+static void IdentityMap_DestroyTable(IDENTITY_MAP_TABLE * table)
+{
+    if (table->store != NULL)
+    {
+        IdentityMap_UnmapFile(table->store, table->storeSize);
+    }
+    else
+    {
+        size_t index;
+        for (index = 0; index < table->mappingSize; index++)
+        {
+            IdentityMapConfig_Free(&(table->entries[index]));
+        }
+        free(table->slots);
+        free(table->entries);
+    }
+    free(table);
+}
+
+/*
+ * @brief    Copy a validated mapping into a table searched by MAC address and by deviceId.
+ */
+static IDENTITY_MAP_TABLE * IdentityMap_CreateTable(const VECTOR_HANDLE mappingVector)
+{
+    IDENTITY_MAP_TABLE * result;
+    /* validation ensures the vector is greater than zero */
+    size_t mappingSize = VECTOR_size(mappingVector);
+    size_t slotCount = 2;
+    while ((slotCount < 2 * mappingSize) && (slotCount < SIZE_MAX / (2 * sizeof(IDENTITY_MAP_SLOT))))
+    {
+        slotCount *= 2;
+    }
+
+    if (slotCount < 2 * mappingSize)
+    {
+        LogError("too many mappings: %lu", (unsigned long)mappingSize);
+        result = NULL;
+    }
+    else if ((result = (IDENTITY_MAP_TABLE*)malloc(sizeof(IDENTITY_MAP_TABLE))) == NULL)
+    {
+        /*Codes_SRS_IDMAP_17_011: [If IdentityMap_Create fails to allocate the mapping table, then this function shall fail and return NULL.]*/
+        LogError("Could not allocate mapping table");
+    }
+    else if ((result->entries = (IDENTITY_MAP_CONFIG*)malloc(mappingSize*sizeof(IDENTITY_MAP_CONFIG))) == NULL)
+    {
+        /*Codes_SRS_IDMAP_17_011: [If IdentityMap_Create fails to allocate the mapping table, then this function shall fail and return NULL.]*/
+        LogError("Could not allocate mapping table entries");
+        free(result);
+        result = NULL;
+    }
+    else if ((result->slots = (IDENTITY_MAP_SLOT*)malloc(slotCount*sizeof(IDENTITY_MAP_SLOT))) == NULL)
+    {
+        /*Codes_SRS_IDMAP_17_042: [ If IdentityMap_Create fails to allocate the MAC address index, then this function shall fail and return NULL. ]*/
+        LogError("Could not allocate mac to device index");
+        free(result->entries);
+        free(result);
+        result = NULL;
+    }
+    else
+    {
+        size_t index;
+        size_t failureIndex = mappingSize;
+        (void)memset(result->slots, 0, slotCount*sizeof(IDENTITY_MAP_SLOT));
+        for (index = 0; index < mappingSize; index++)
+        {
+            IDENTITY_MAP_CONFIG * element = (IDENTITY_MAP_CONFIG *)VECTOR_element(mappingVector, index);
+            if (IdentityMapConfig_CopyDeep(&(result->entries[index]), element) != IDENTITYMAP_OK)
+            {
+                failureIndex = index;
+                break;
+            }
+        }
+        if (failureIndex < mappingSize)
+        {
+            /*Codes_SRS_IDMAP_17_012: [If IdentityMap_Create fails to copy a MAC address triplet, then this function shall fail, release all resources, and return NULL.]*/
+            for (index = 0; index < failureIndex; index++)
+            {
+                IdentityMapConfig_Free(&(result->entries[index]));
+            }
+            free(result->slots);
+            free(result->entries);
+            free(result);
+            result = NULL;
+        }
+        else
+        {
+            /*Codes_SRS_IDMAP_30_005: [ IdentityMap_Create shall sort the triplets by deviceId and index them by the 48 bit value of their MAC address in an open addressing hash table. ]*/
+            qsort(result->entries, mappingSize, sizeof(IDENTITY_MAP_CONFIG),
+                IdentityMapConfig_IdCompare);
+            result->mappingSize = mappingSize;
+            result->slotMask = slotCount - 1;
+            result->store = NULL;
+            result->refCount = 1;
+            for (index = 0; index < mappingSize; index++)
+            {
+                uint64_t mac;
+                size_t slot;
+                /* validation ensures the MAC address is canonical */
+                (void)IdentityMapConfig_ParseMAC(result->entries[index].macAddress, &mac);
+                slot = IdentityMapConfig_HashMAC(mac) & result->slotMask;
+                while ((result->slots[slot].entry != NULL) && (result->slots[slot].mac != mac))
+                {
+                    slot = (slot + 1) & result->slotMask;
+                }
+                if (result->slots[slot].entry != NULL)
+                {
+                    LogInfo("MAC address %s is mapped more than once, using device %s",
+                        result->entries[index].macAddress, result->slots[slot].entry->deviceId);
+                }
+                else
+                {
+                    result->slots[slot].mac = mac;
+                    result->slots[slot].entry = &(result->entries[index]);
+                }
+            }
+        }
+    }
+    return result;
+}
+
+/*
+ * @brief    Point the triplet at the strings of a store record, false when they are out of the store.
+ */
+static bool IdentityMap_StoreTriplet(const IDENTITY_MAP_TABLE * table, uint32_t record, IDENTITY_MAP_CONFIG * match)
+{
+    bool result;
+    const IDENTITY_MAP_STORE_RECORD * storeRecord = &(table->records[record]);
+    /* the strings end with a NUL, any offset inside them is a terminated string */
+    if ((storeRecord->macAddress >= table->stringsSize) ||
+        (storeRecord->deviceId >= table->stringsSize) ||
+        (storeRecord->deviceKey >= table->stringsSize))
+    {
+        LogError("identity store record %lu is corrupted", (unsigned long)record);
+        result = false;
+    }
+    else
+    {
+        match->macAddress = table->strings + storeRecord->macAddress;
+        match->deviceId = table->strings + storeRecord->deviceId;
+        match->deviceKey = table->strings + storeRecord->deviceKey;
+        result = true;
+    }
+    return result;
+}
+
+/*
+ * @brief    Find the triplet of a MAC address, false when there is none.
+ */
+static bool IdentityMap_FindMAC(const IDENTITY_MAP_TABLE * table, uint64_t mac, IDENTITY_MAP_CONFIG * match)
+{
+    bool result;
+    if (table->store != NULL)
+    {
+        /*Codes_SRS_IDMAP_30_014: [ IdentityMap_Receive shall binary search the records of an identity store by MAC address and the record numbers by deviceId, in place. ]*/
+        size_t low = 0;
+        size_t high = table->mappingSize;
+        result = false;
+        while (low < high)
+        {
+            size_t middle = low + (high - low) / 2;
+            uint64_t recordMac = ((uint64_t)table->records[middle].macHigh << 32) | table->records[middle].macLow;
+            if (recordMac < mac)
+            {
+                low = middle + 1;
+            }
+            else if (recordMac > mac)
+            {
+                high = middle;
+            }
+            else
+            {
+                result = IdentityMap_StoreTriplet(table, (uint32_t)middle, match);
+                break;
+            }
+        }
+    }
+    else
+    {
+        /* the table is at most half full, the probe always ends on a free slot */
+        size_t slot = IdentityMapConfig_HashMAC(mac) & table->slotMask;
+        while ((table->slots[slot].entry != NULL) && (table->slots[slot].mac != mac))
+        {
+            slot = (slot + 1) & table->slotMask;
+        }
+        if (table->slots[slot].entry == NULL)
+        {
+            result = false;
+        }
+        else
+        {
+            *match = *(table->slots[slot].entry);
+            result = true;
+        }
+    }
+    return result;
+}
+
+/*
+ * @brief    Find the triplet of a deviceId, false when there is none.
+ */
+static bool IdentityMap_FindDevice(const IDENTITY_MAP_TABLE * table, const char * deviceId, IDENTITY_MAP_CONFIG * match)
+{
+    bool result;
+    if (table->store != NULL)
+    {
+        /*Codes_SRS_IDMAP_30_014: [ IdentityMap_Receive shall binary search the records of an identity store by MAC address and the record numbers by deviceId, in place. ]*/
+        size_t low = 0;
+        size_t high = table->mappingSize;
+        result = false;
+        while (low < high)
+        {
+            size_t middle = low + (high - low) / 2;
+            uint32_t record = table->deviceIndex[middle];
+            int comparison;
+            if ((record >= table->mappingSize) ||
+                (IdentityMap_StoreTriplet(table, record, match) == false))
+            {
+                LogError("identity store device index %lu is corrupted", (unsigned long)middle);
+                break;
+            }
+            else if ((comparison = strcmp(match->deviceId, deviceId)) < 0)
+            {
+                low = middle + 1;
+            }
+            else if (comparison > 0)
+            {
+                high = middle;
+            }
+            else
+            {
+                result = true;
+                break;
+            }
+        }
+    }
+    else
+    {
+        IDENTITY_MAP_CONFIG key = { NULL, deviceId, NULL };
+        const IDENTITY_MAP_CONFIG * entry = bsearch(&key,
+            table->entries, table->mappingSize,
+            sizeof(IDENTITY_MAP_CONFIG),
+            IdentityMapConfig_IdCompare);
+        if (entry == NULL)
+        {
+            result = false;
+        }
+        else
+        {
+            *match = *entry;
+            result = true;
+        }
+    }
+    return result;
+}
+
+/*
+ * @brief    Make a table of a mapped identity store, the store is unmapped when it is not valid.
+ */
+static IDENTITY_MAP_TABLE * IdentityMap_CreateStoreTable(const char * mappingFile, const unsigned char * store, size_t storeSize)
+{
+    IDENTITY_MAP_TABLE * result;
+    const IDENTITY_MAP_STORE_HEADER * header = (const IDENTITY_MAP_STORE_HEADER *)store;
+    const size_t entrySize = sizeof(IDENTITY_MAP_STORE_RECORD) + sizeof(uint32_t);
+    /*Codes_SRS_IDMAP_30_013: [ If the identity store has another version, no record, a size that does not match its header, or strings that do not end with a NUL, the mapping file shall not be loaded. ]*/
+    if (header->version != IDENTITY_MAP_STORE_VERSION)
+    {
+        LogError("identity store %s has version %lu, expected %d", mappingFile, (unsigned long)header->version, IDENTITY_MAP_STORE_VERSION);
+        IdentityMap_UnmapFile(store, storeSize);
+        result = NULL;
+    }
+    else if ((header->count == 0) ||
+        (header->count > (storeSize - sizeof(IDENTITY_MAP_STORE_HEADER)) / entrySize) ||
+        (header->stringsSize == 0) ||
+        (storeSize != sizeof(IDENTITY_MAP_STORE_HEADER) + header->count * entrySize + header->stringsSize) ||
+        (store[storeSize - 1] != '\0'))
+    {
+        LogError("identity store %s is truncated or corrupted", mappingFile);
+        IdentityMap_UnmapFile(store, storeSize);
+        result = NULL;
+    }
+    else if ((result = (IDENTITY_MAP_TABLE*)malloc(sizeof(IDENTITY_MAP_TABLE))) == NULL)
+    {
+        /*Codes_SRS_IDMAP_17_011: [If IdentityMap_Create fails to allocate the mapping table, then this function shall fail and return NULL.]*/
+        LogError("Could not allocate mapping table");
+        IdentityMap_UnmapFile(store, storeSize);
+    }
+    else
+    {
+        /*Codes_SRS_IDMAP_30_012: [ If the mapping file starts with the identity store magic number, it shall be mapped read-only and searched in place instead of being read as JSON. ]*/
+        result->mappingSize = header->count;
+        result->entries = NULL;
+        result->slots = NULL;
+        result->slotMask = 0;
+        result->store = store;
+        result->storeSize = storeSize;
+        result->records = (const IDENTITY_MAP_STORE_RECORD *)(store + sizeof(IDENTITY_MAP_STORE_HEADER));
+        result->deviceIndex = (const uint32_t *)(result->records + header->count);
+        result->strings = (const char *)(result->deviceIndex + header->count);
+        result->stringsSize = header->stringsSize;
+        result->refCount = 1;
+    }
+    return result;
+}
+
+static VECTOR_HANDLE IdentityMap_ParseMappingArray(JSON_Array * jsonArray);
+static void IdentityMap_FreeMapping(VECTOR_HANDLE mappingVector);
+
+/*
+ * @brief    Read the mapping file, a JSON array like the inline configuration, into a new table.
+ */
+static IDENTITY_MAP_TABLE * IdentityMap_LoadJsonFile(const char * mappingFile)
+{
+    IDENTITY_MAP_TABLE * result;
+    JSON_Value * json = json_parse_file(mappingFile);
+    if (json == NULL)
+    {
+        LogError("Unable to parse mapping file %s", mappingFile);
+        result = NULL;
+    }
+    else
+    {
+        JSON_Array * jsonArray = json_value_get_array(json);
+        VECTOR_HANDLE mappingVector;
+        if (jsonArray == NULL)
+        {
+            LogError("Expected a JSON Array in mapping file %s", mappingFile);
+            result = NULL;
+        }
+        else if ((mappingVector = IdentityMap_ParseMappingArray(jsonArray)) == NULL)
+        {
+            LogError("Unable to read the mappings of file %s", mappingFile);
+            result = NULL;
+        }
+        else
+        {
+            if (IdentityMap_ValidateConfig(mappingVector) == false)
+            {
+                LogError("unable to validate mapping file %s", mappingFile);
+                result = NULL;
+            }
+            else
+            {
+                result = IdentityMap_CreateTable(mappingVector);
+            }
+            IdentityMap_FreeMapping(mappingVector);
+        }
+        json_value_free(json);
+    }
+    return result;
+}
+
+/*
+ * @brief    Load the mapping file, an identity store or a JSON array, into a new table.
+ */
+static IDENTITY_MAP_TABLE * IdentityMap_LoadFile(const char * mappingFile)
+{
+    IDENTITY_MAP_TABLE * result;
+    size_t storeSize;
+    const unsigned char * store = IdentityMap_MapFile(mappingFile, &storeSize);
+    if ((store != NULL) &&
+        (storeSize >= sizeof(IDENTITY_MAP_STORE_HEADER)) &&
+        (((const IDENTITY_MAP_STORE_HEADER *)store)->magic == IDENTITY_MAP_STORE_MAGIC))
+    {
+        result = IdentityMap_CreateStoreTable(mappingFile, store, storeSize);
+    }
+    else
+    {
+        if (store != NULL)
+        {
+            IdentityMap_UnmapFile(store, storeSize);
+        }
+        result = IdentityMap_LoadJsonFile(mappingFile);
+    }
+    return result;
+}
+
+/*
+ * @brief    Load the mapping file if its size or time changed since it was last read, NULL otherwise.
  */
-static void IdentityMapConfig_Free(IDENTITY_MAP_CONFIG * element)
+static IDENTITY_MAP_TABLE * IdentityMap_LoadFileIfChanged(IDENTITY_MAP_DATA * idModule)
 {
-    /*Codes_SRS_IDMAP_17_015: [IdentityMap_Destroy shall release all resources allocated for the module.]*/
-    free((void*)element->macAddress);
-    free((void*)element->deviceId);
-    free((void*)element->deviceKey);
+    IDENTITY_MAP_TABLE * result;
+    struct stat fileStat;
+    if (stat(idModule->mappingFile, &fileStat) != 0)
+    {
+        LogError("Unable to stat mapping file %s", idModule->mappingFile);
+        result = NULL;
+    }
+    else if ((idModule->table != NULL) &&
+        (fileStat.st_mtime == idModule->fileTime) &&
+        (fileStat.st_size == idModule->fileSize))
+    {
+        result = NULL;
+    }
+    else
+    {
+        /*Codes_SRS_IDMAP_30_009: [ If the changed mapping file cannot be loaded, the module shall keep the current mapping and not read the file again before it changes. ]*/
+        idModule->fileTime = fileStat.st_mtime;
+        idModule->fileSize = fileStat.st_size;
+        result = IdentityMap_LoadFile(idModule->mappingFile);
+    }
+    return result;
 }
 
-/*Codes_SRS_IDMAP_17_006: [If any macAddress string in configuration is not a MAC address in canonical form, this function shall fail and return NULL.]*/
-static bool IdentityMapConfig_IsCanonicalMAC(const char * macAddress)
+/*
+ * @brief    Take a reference on the current table, the mapping file may replace it meanwhile.
+ */
+static IDENTITY_MAP_TABLE * IdentityMap_AcquireTable(IDENTITY_MAP_DATA * idModule)
 {
-    /* Every MAC address must be in the form "XX:XX:XX:XX:XX:XX" X=[0-9,a-f,A-F] */
-    bool recognized;
-    const size_t fixedSize = 17;
-    const size_t numDigits = 12;
-    const size_t numColons = 5;
-    const size_t digits[] = { 0, 1, 3, 4, 6, 7, 9, 10, 12, 13, 15, 16 };
-    const size_t colons[] = { 2, 5, 8, 11, 14 };
-    size_t macSize = strlen(macAddress);
-    if (macSize != fixedSize)
+    IDENTITY_MAP_TABLE * result;
+    if (idModule->lock == NULL)
     {
-        recognized = false;
+        /* an inline mapping never changes */
+        result = idModule->table;
+    }
+    else if (Lock(idModule->lock) != LOCK_OK)
+    {
+        LogError("unable to Lock");
+        result = NULL;
     }
     else
     {
-        recognized = true;
-        size_t i;
-        for (i = 0; i < numDigits; i++)
+        result = idModule->table;
+        result->refCount++;
+        (void)Unlock(idModule->lock);
+    }
+    return result;
+}
+
+static void IdentityMap_ReleaseTable(IDENTITY_MAP_DATA * idModule, IDENTITY_MAP_TABLE * table)
+{
+    if (idModule->lock != NULL)
+    {
+        if (Lock(idModule->lock) != LOCK_OK)
         {
-            if (!isxdigit(macAddress[digits[i]]))
-            {
-                recognized = false;
-                break;
-            }
+            LogError("unable to Lock, the table is leaked");
         }
-        if (recognized == true)
+        else
         {
-            for (i = 0; i < numColons; i++)
+            bool last = (--table->refCount == 0);
+            (void)Unlock(idModule->lock);
+            if (last)
             {
-                if (macAddress[colons[i]] != ':')
-                {
-                    recognized = false;
-                    break;
-                }
+                IdentityMap_DestroyTable(table);
             }
         }
     }
-    return recognized;
 }
 
 /*
- * @brief    Comparison function by MAC address for two IDENTITY_MAP_CONFIG structures
+ * @brief    Replace the mapping when the mapping file changed.
  */
-static int IdentityMapConfig_MacCompare(const void * a, const void * b)
-{
-    const IDENTITY_MAP_CONFIG * idA = a;
-    const IDENTITY_MAP_CONFIG * idB = b;
-    return strcmp(idA->macAddress, idB->macAddress);
-}
-/*
-* @brief    Comparison function by deviceId for two IDENTITY_MAP_CONFIG structures
-*/
-static int IdentityMapConfig_IdCompare(const void * a, const void * b)
+static void IdentityMap_Reload(IDENTITY_MAP_DATA * idModule)
 {
-    const IDENTITY_MAP_CONFIG * idA = a;
-    const IDENTITY_MAP_CONFIG * idB = b;
-    return strcmp(idA->deviceId, idB->deviceId);
+    IDENTITY_MAP_TABLE * newTable = IdentityMap_LoadFileIfChanged(idModule);
+    if (newTable != NULL)
+    {
+        if (Lock(idModule->lock) != LOCK_OK)
+        {
+            LogError("unable to Lock, keeping the current mapping");
+            IdentityMap_DestroyTable(newTable);
+        }
+        else
+        {
+            /*Codes_SRS_IDMAP_30_008: [ When the size or the modification time of the mapping file changed, the reloader shall load it and replace the whole mapping, the messages being processed shall keep the mapping they started with. ]*/
+            IDENTITY_MAP_TABLE * oldTable = idModule->table;
+            bool last;
+            idModule->table = newTable;
+            last = (--oldTable->refCount == 0);
+            (void)Unlock(idModule->lock);
+            LogInfo("loaded %lu mappings from %s", (unsigned long)newTable->mappingSize, idModule->mappingFile);
+            if (last)
+            {
+                IdentityMap_DestroyTable(oldTable);
+            }
+        }
+    }
 }
 
-/*
- * @brief    Walks through our mappingVector to ensure it is correct for our identity map module.
- */
-static bool IdentityMap_ValidateConfig(const VECTOR_HANDLE mappingVector)
+static int IdentityMap_Reloader(void * param)
 {
-    size_t mappingSize = VECTOR_size(mappingVector);
-    bool mappingOk;
-    if (mappingSize == 0)
+    IDENTITY_MAP_DATA * idModule = (IDENTITY_MAP_DATA*)param;
+    if (Lock(idModule->lock) != LOCK_OK)
     {
-        /*Codes_SRS_IDMAP_17_041: [If the configuration has no vector elements, this function shall fail and return NULL.*/
-        LogError("nothing for this module to do, no mapping data");
-        mappingOk = false;
+        LogError("unable to Lock, the mapping file will not be reloaded");
     }
     else
     {
-        mappingOk = true;
-        size_t index;
-        for (index = 0; (index < mappingSize) && (mappingOk != false); index++)
+        bool locked = true;
+        while ((locked == true) && (idModule->stopping == false))
         {
-            IDENTITY_MAP_CONFIG * element = (IDENTITY_MAP_CONFIG *)VECTOR_element(mappingVector, index);
-            if ((element->deviceId == NULL) ||
-                (element->deviceKey == NULL) ||
-                (element->macAddress == NULL))
-            {
-                /*Codes_SRS_IDMAP_17_019: [If any macAddress, deviceId or deviceKey are NULL, this function shall fail and return NULL.]*/
-                LogError("Empty mapping data values, mac=%p, ID=%p, key=%p",
-                    element->macAddress, element->deviceId, element->deviceKey);
-                mappingOk = false;
-                break;
-            }
-            else
+            /*Codes_SRS_IDMAP_30_003: [ The reloader shall check the mapping file every reloadIntervalMs milliseconds until the module is destroyed. ]*/
+            (void)Condition_Wait(idModule->reloadCondition, idModule->lock, (int)idModule->reloadIntervalMs);
+            if (idModule->stopping == false)
             {
-                if (IdentityMapConfig_IsCanonicalMAC(element->macAddress) == false)
+                (void)Unlock(idModule->lock);
+                IdentityMap_Reload(idModule);
+                if (Lock(idModule->lock) != LOCK_OK)
                 {
-                    /*Codes_SRS_IDMAP_17_006: [If any macAddress string in configuration is not a MAC address in canonical form, this function shall fail and return NULL.]*/
-                    LogError("Non-canonical MAC Address: %s", element->macAddress);
-                    mappingOk = false;
-                    break;
+                    LogError("unable to Lock, the mapping file will not be reloaded");
+                    locked = false;
                 }
             }
         }
+        if (locked == true)
+        {
+            (void)Unlock(idModule->lock);
+        }
     }
-    return mappingOk;
+    return 0;
+}
+
+/*
+ * @brief    Release a module, whatever part of it was created.
+ */
+static void IdentityMap_Free(IDENTITY_MAP_DATA * idModule)
+{
+    /*Codes_SRS_IDMAP_17_015: [IdentityMap_Destroy shall release all resources allocated for the module.]*/
+    if (idModule->table != NULL)
+    {
+        IdentityMap_DestroyTable(idModule->table);
+    }
+    if (idModule->reloadCondition != NULL)
+    {
+        Condition_Deinit(idModule->reloadCondition);
+    }
+    if (idModule->lock != NULL)
+    {
+        (void)Lock_Deinit(idModule->lock);
+    }
+    free(idModule->mappingFile);
+    free(idModule);
 }
 
 /*
@@ -305,6 +983,7 @@ static bool IdentityMap_ValidateConfig(const VECTOR_HANDLE mappingVector)
 static MODULE_HANDLE IdentityMap_Create(BROKER_HANDLE broker, const void* configuration)
 {
     IDENTITY_MAP_DATA* result;
+    const IDENTITY_MAP_MODULE_CONFIG * config = (const IDENTITY_MAP_MODULE_CONFIG *)configuration;
     if (broker == NULL || configuration == NULL)
     {
         /*Codes_SRS_IDMAP_17_004: [If the broker is NULL, this function shall fail and return NULL.]*/
@@ -312,98 +991,171 @@ static MODULE_HANDLE IdentityMap_Create(BROKER_HANDLE broker, const void* config
         LogError("invalid parameter (NULL).");
         result = NULL;
     }
+    else if ((config->mapping == NULL) == (config->mappingFile == NULL))
+    {
+        /*Codes_SRS_IDMAP_30_004: [ If the configuration has both or none of mapping and mappingFile, this function shall fail and return NULL. ]*/
+        LogError("expected one of mapping and mappingFile");
+        result = NULL;
+    }
+    else if ((config->mapping != NULL) && (IdentityMap_ValidateConfig(config->mapping) == false))
+    {
+        LogError("unable to validate mapping table");
+        result = NULL;
+    }
+    else if ((result = (IDENTITY_MAP_DATA*)malloc(sizeof(IDENTITY_MAP_DATA))) == NULL)
+    {
+        /*Codes_SRS_IDMAP_17_010: [If IdentityMap_Create fails to allocate a new IDENTITY_MAP_DATA structure, then this function shall fail, and return NULL.]*/
+        LogError("Could not Allocate Module");
+    }
     else
     {
-        VECTOR_HANDLE mappingVector = (VECTOR_HANDLE)configuration;
-        if (IdentityMap_ValidateConfig(mappingVector) == false)
+        (void)memset(result, 0, sizeof(IDENTITY_MAP_DATA));
+        result->broker = broker;
+        if (config->mapping != NULL)
         {
-            LogError("unable to validate mapping table");
-            result = NULL;
+            if ((result->table = IdentityMap_CreateTable(config->mapping)) == NULL)
+            {
+                LogError("unable to create the mapping table");
+                IdentityMap_Free(result);
+                result = NULL;
+            }
+            else
+            {
+                /*Codes_SRS_IDMAP_17_003: [Upon success, this function shall return a valid pointer to a MODULE_HANDLE.]*/
+            }
         }
         else
         {
-            result = (IDENTITY_MAP_DATA*)malloc(sizeof(IDENTITY_MAP_DATA));
-            if (result == NULL)
+            result->reloadIntervalMs = (config->reloadIntervalMs == 0) ? IDENTITY_MAP_DEFAULT_RELOAD_INTERVAL_MS : config->reloadIntervalMs;
+            if (mallocAndStrcpy_s(&result->mappingFile, config->mappingFile) != 0)
+            {
+                LogError("unable to copy the mapping file name");
+                IdentityMap_Free(result);
+                result = NULL;
+            }
+            /*Codes_SRS_IDMAP_30_006: [ If mappingFile is set, IdentityMap_Create shall load it as a JSON array of triplets validated like the inline mapping, and fail and return NULL if it cannot. ]*/
+            else if ((result->table = IdentityMap_LoadFileIfChanged(result)) == NULL)
             {
-                /*Codes_SRS_IDMAP_17_010: [If IdentityMap_Create fails to allocate a new IDENTITY_MAP_DATA structure, then this function shall fail, and return NULL.]*/
-                LogError("Could not Allocate Module");
+                LogError("unable to load the mapping file");
+                IdentityMap_Free(result);
+                result = NULL;
+            }
+            /*Codes_SRS_IDMAP_30_007: [ If mappingFile is set, IdentityMap_Create shall create a lock, a condition and a reloader thread. ]*/
+            else if (((result->lock = Lock_Init()) == NULL) ||
+                ((result->reloadCondition = Condition_Init()) == NULL))
+            {
+                LogError("unable to create the lock and condition");
+                IdentityMap_Free(result);
+                result = NULL;
+            }
+            else if (ThreadAPI_Create(&result->reloader, IdentityMap_Reloader, result) != THREADAPI_OK)
+            {
+                LogError("unable to ThreadAPI_Create");
+                IdentityMap_Free(result);
+                result = NULL;
             }
             else
             {
-                size_t mappingSize = VECTOR_size(mappingVector);
-                /* validation ensures the vector is greater than zero */
-                result->macToDevIdArray = (IDENTITY_MAP_CONFIG*)malloc(mappingSize*sizeof(IDENTITY_MAP_CONFIG));
-                if (result->macToDevIdArray == NULL)
-                {
-                    /*Codes_SRS_IDMAP_17_011: [If IdentityMap_Create fails to create memory for the macToDeviceArray, then this function shall fail and return NULL.*/
-                    LogError("Could not allocate mac to device mapping table");
-                    free(result);
-                    result = NULL;
-                }
-                else
-                {
-                    result->devIdToMacArray = (IDENTITY_MAP_CONFIG*)malloc(mappingSize*sizeof(IDENTITY_MAP_CONFIG));
-                    if (result->devIdToMacArray == NULL)
-                    {
-                        /*Codes_SRS_IDMAP_17_042: [ If IdentityMap_Create fails to create memory for the deviceToMacArray, then this function shall fail and return NULL. */
-                        LogError("Could not allocate devicee to mac mapping table");
-                        free(result->macToDevIdArray);
-                        free(result);
-                        result = NULL;
-                    }
-                    else
-                    {
+                /*Codes_SRS_IDMAP_17_003: [Upon success, this function shall return a valid pointer to a MODULE_HANDLE.]*/
+            }
+        }
 
-                        size_t index;
-                        size_t failureIndex = mappingSize;
-                        for (index = 0; index < mappingSize; index++)
-                        {
-                            IDENTITY_MAP_CONFIG * element = (IDENTITY_MAP_CONFIG *)VECTOR_element(mappingVector, index);
-                            IDENTITY_MAP_CONFIG * dest = &(result->macToDevIdArray[index]);
-                            IDENTITYMAP_RESULT copyResult;
-                            copyResult = IdentityMapConfig_CopyDeep(dest, element);
-                            if (copyResult != IDENTITYMAP_OK)
-                            {
-                                failureIndex = index;
-                                break;
-                            }
-                            dest = &(result->devIdToMacArray[index]);
-                            copyResult = IdentityMapConfig_CopyDeep(dest, element);
-                            if (copyResult != IDENTITYMAP_OK)
-                            {
-                                IdentityMapConfig_Free(&(result->macToDevIdArray[index]));
-                                failureIndex = index;
-                                break;
-                            }
-                        }
-                        if (failureIndex < mappingSize)
-                        {
-                            /*Codes_SRS_IDMAP_17_012: [If IdentityMap_Create fails to add a MAC address triplet to the macToDeviceArray, then this function shall fail, release all resources, and return NULL.]*/
-                            /*Codes_SRS_IDMAP_17_043: [ If IdentityMap_Create fails to add a MAC address triplet to the deviceToMacArray, then this function shall fail, release all resources, and return NULL. */
-                            for (index = 0; index < failureIndex; index++)
-                            {
-                                IdentityMapConfig_Free(&(result->macToDevIdArray[index]));
-                                IdentityMapConfig_Free(&(result->devIdToMacArray[index]));
-                            }
-                            free(result->macToDevIdArray);
-                            free(result->devIdToMacArray);
-                            free(result);
-                            result = NULL;
-                        }
-                        else
-                        {
-                            /*Codes_SRS_IDMAP_17_003: [Upon success, this function shall return a valid pointer to a MODULE_HANDLE.]*/
-                            qsort(result->macToDevIdArray, mappingSize, sizeof(IDENTITY_MAP_CONFIG),
-                                IdentityMapConfig_MacCompare);
-                            qsort(result->devIdToMacArray, mappingSize, sizeof(IDENTITY_MAP_CONFIG),
-                                IdentityMapConfig_IdCompare);
-                            result->mappingSize = mappingSize;
-                            result->broker = broker;
-                        }
-                    }
-                }
+        if (result != NULL)
+        {
+            /*Codes_SRS_IDMAP_30_015: [ Upon success, IdentityMap_Create shall get the interned "source", "deviceName", "deviceKey" and "macAddress" property keys by calling PropertyKey_Intern. ]*/
+            result->sourceKey = PropertyKey_Intern(GW_SOURCE_PROPERTY);
+            result->deviceNameKey = PropertyKey_Intern(GW_DEVICENAME_PROPERTY);
+            result->deviceKeyKey = PropertyKey_Intern(GW_DEVICEKEY_PROPERTY);
+            result->macAddressKey = PropertyKey_Intern(GW_MAC_ADDRESS_PROPERTY);
+        }
+    }
+    return result;
+}
+
+/*
+* @brief    Release a vector of triplets read from JSON.
+*/
+static void IdentityMap_FreeMapping(VECTOR_HANDLE mappingVector)
+{
+    size_t numberOfRecords = VECTOR_size(mappingVector);
+    size_t record;
+    for (record = 0; record < numberOfRecords; record++)
+    {
+        IDENTITY_MAP_CONFIG *element = (IDENTITY_MAP_CONFIG *)VECTOR_element(mappingVector, record);
+        IdentityMapConfig_Free(element);
+    }
+    VECTOR_destroy(mappingVector);
+}
+
+/*
+* @brief    Read a JSON array of triplets into a vector.
+*/
+static VECTOR_HANDLE IdentityMap_ParseMappingArray(JSON_Array * jsonArray)
+{
+    /*Codes_SRS_IDMAP_05_007: [ IdentityMap_ParseConfigurationFromJson shall call VECTOR_create to make the identity map module input vector. ]*/
+    VECTOR_HANDLE result = VECTOR_create(sizeof(IDENTITY_MAP_CONFIG));
+    if (result == NULL)
+    {
+        //Codes_SRS_IDMAP_17_061: [ If allocation fails, IdentityMap_ParseConfigurationFromJson shall fail and return NULL. ]
+        /*Codes_SRS_IDMAP_05_019: [ If creating the vector fails, then IdentityMap_ParseConfigurationFromJson shall fail and return NULL. ]*/
+        LogError("Failed to create the input vector");
+    }
+    else
+    {
+        size_t numberOfRecords = json_array_get_count(jsonArray);
+        size_t record;
+        bool arrayParsed = true;
+        /*Codes_SRS_IDMAP_05_008: [ IdentityMap_ParseConfigurationFromJson shall walk through each object of the array. ]*/
+        for (record = 0; record < numberOfRecords; record++)
+        {
+            /*Codes_SRS_IDMAP_05_006: [ IdentityMap_ParseConfigurationFromJson shall parse the configuration as a JSON array of objects. ]*/
+            if (addOneRecord(result, json_array_get_object(jsonArray, record)) != true)
+            {
+                arrayParsed = false;
+                break;
             }
         }
+        if (arrayParsed != true)
+        {
+            IdentityMap_FreeMapping(result);
+            /*Codes_SRS_IDMAP_05_005: [ If configuration is not a JSON array of JSON objects, then IdentityMap_ParseConfigurationFromJson shall fail and return NULL. ]*/
+            result = NULL;
+        }
+    }
+    return result;
+}
+
+/*
+* @brief    Read the mapping file form of the configuration.
+*/
+static bool IdentityMap_ParseFileConfiguration(JSON_Object * jsonObject, IDENTITY_MAP_MODULE_CONFIG * config)
+{
+    bool result;
+    /*Codes_SRS_IDMAP_30_001: [ If configuration is a JSON object, IdentityMap_ParseConfigurationFromJson shall read the string "mappingFile" and the number "reloadIntervalMs", 0 when it is missing. ]*/
+    const char * mappingFile = json_object_get_string(jsonObject, MAPPINGFILE);
+    double reloadIntervalMs = json_object_get_number(jsonObject, RELOADINTERVAL);
+    if (mappingFile == NULL)
+    {
+        /*Codes_SRS_IDMAP_30_002: [ If the JSON object has no "mappingFile", or "reloadIntervalMs" is negative or too large, IdentityMap_ParseConfigurationFromJson shall fail and return NULL. ]*/
+        LogError("Did not find expected %s configuration", MAPPINGFILE);
+        result = false;
+    }
+    else if ((reloadIntervalMs < 0) || (reloadIntervalMs > INT_MAX))
+    {
+        /*Codes_SRS_IDMAP_30_002: [ If the JSON object has no "mappingFile", or "reloadIntervalMs" is negative or too large, IdentityMap_ParseConfigurationFromJson shall fail and return NULL. ]*/
+        LogError("%s is out of range", RELOADINTERVAL);
+        result = false;
+    }
+    else if (mallocAndStrcpy_s((char**)&config->mappingFile, mappingFile) != 0)
+    {
+        LogError("Unable to copy %s", MAPPINGFILE);
+        result = false;
+    }
+    else
+    {
+        config->mapping = NULL;
+        config->reloadIntervalMs = (unsigned int)reloadIntervalMs;
+        result = true;
     }
     return result;
 }
@@ -413,7 +1165,7 @@ static MODULE_HANDLE IdentityMap_Create(BROKER_HANDLE broker, const void* config
 */
 static void * IdentityMap_ParseConfigurationFromJson(const char* configuration)
 {
-    VECTOR_HANDLE result;
+    IDENTITY_MAP_MODULE_CONFIG * result;
     if (configuration == NULL)
     {
         /*Codes_SRS_IDMAP_05_004: [ If configuration is NULL then IdentityMap_ParseConfigurationFromJson shall fail and return NULL. ]*/
@@ -434,59 +1186,55 @@ static void * IdentityMap_ParseConfigurationFromJson(const char* configuration)
         {
             /*Codes_SRS_IDMAP_05_006: [ IdentityMap_ParseConfigurationFromJson shall parse the configuration as a JSON array of objects. ]*/
             JSON_Array *jsonArray = json_value_get_array(json);
-            if (jsonArray == NULL)
+            JSON_Object *jsonObject;
+            if (jsonArray != NULL)
             {
-                /*Codes_SRS_IDMAP_05_005: [ If configuration is not a JSON array of JSON objects, then IdentityMap_ParseConfigurationFromJson shall fail and return NULL. ]*/
-                LogError("Expected a JSON Array in configuration");
-                result = NULL;
+                VECTOR_HANDLE mappingVector = IdentityMap_ParseMappingArray(jsonArray);
+                if (mappingVector == NULL)
+                {
+                    result = NULL;
+                }
+                /*Codes_SRS_IDMAP_17_060: [ IdentityMap_ParseConfigurationFromJson shall allocate memory for the configuration. ]*/
+                else if ((result = (IDENTITY_MAP_MODULE_CONFIG*)malloc(sizeof(IDENTITY_MAP_MODULE_CONFIG))) == NULL)
+                {
+                    //Codes_SRS_IDMAP_17_061: [ If allocation fails, IdentityMap_ParseConfigurationFromJson shall fail and return NULL. ]
+                    LogError("Failed to allocate the configuration");
+                    IdentityMap_FreeMapping(mappingVector);
+                }
+                else
+                {
+                    /*Codes_SRS_IDMAP_17_062: [ IdentityMap_ParseConfigurationFromJson shall return the pointer to the configuration on success. ]*/
+                    result->mapping = mappingVector;
+                    result->mappingFile = NULL;
+                    result->reloadIntervalMs = 0;
+                }
             }
-            else
+            else if ((jsonObject = json_value_get_object(json)) != NULL)
             {
-				/*Codes_SRS_IDMAP_17_060: [ IdentityMap_ParseConfigurationFromJson shall allocate memory for the configuration vector. ]*/
-				/*Codes_SRS_IDMAP_05_007: [ IdentityMap_ParseConfigurationFromJson shall call VECTOR_create to make the identity map module input vector. ]*/
-                result = VECTOR_create(sizeof(IDENTITY_MAP_CONFIG));
-                if (result == NULL)
+                /*Codes_SRS_IDMAP_17_060: [ IdentityMap_ParseConfigurationFromJson shall allocate memory for the configuration. ]*/
+                if ((result = (IDENTITY_MAP_MODULE_CONFIG*)malloc(sizeof(IDENTITY_MAP_MODULE_CONFIG))) == NULL)
                 {
                     //Codes_SRS_IDMAP_17_061: [ If allocation fails, IdentityMap_ParseConfigurationFromJson shall fail and return NULL. ]
-                    /*Codes_SRS_IDMAP_05_019: [ If creating the vector fails, then IdentityMap_ParseConfigurationFromJson shall fail and return NULL. ]*/
-                    LogError("Failed to create the input vector");
+                    LogError("Failed to allocate the configuration");
+                }
+                else if (IdentityMap_ParseFileConfiguration(jsonObject, result) == false)
+                {
+                    free(result);
                     result = NULL;
                 }
                 else
                 {
-                    size_t numberOfRecords = json_array_get_count(jsonArray);
-                    size_t record;
-                    bool arrayParsed = true;
-                    /*Codes_SRS_IDMAP_05_008: [ IdentityMap_ParseConfigurationFromJson shall walk through each object of the array. ]*/
-                    for (record = 0; record < numberOfRecords; record++)
-                    {
-                        /*Codes_SRS_IDMAP_05_006: [ IdentityMap_ParseConfigurationFromJson shall parse the configuration as a JSON array of objects. ]*/
-                        if (addOneRecord(result, json_array_get_object(jsonArray, record)) != true)
-                        {
-                            arrayParsed = false;
-                            break;
-                        }
-                    }
-                    if (arrayParsed != true)
-                    {
-                        numberOfRecords = VECTOR_size(result);
-                        for (record = 0; record < numberOfRecords; record++)
-                        {
-                            IDENTITY_MAP_CONFIG *element = (IDENTITY_MAP_CONFIG *)VECTOR_element(result, record);
-                            IdentityMapConfig_Free(element);
-                        }
-                        VECTOR_destroy(result);
-                        /*Codes_SRS_IDMAP_05_005: [ If configuration is not a JSON array of JSON objects, then IdentityMap_ParseConfigurationFromJson shall fail and return NULL. ]*/
-                        result = NULL;
-                    }
-                    else
-                    {
-                        /*Codes_SRS_IDMAP_17_062: [ IdentityMap_ParseConfigurationFromJson shall return the pointer to the configuration vector on success. ]*/
-                    }
+                    /*Codes_SRS_IDMAP_17_062: [ IdentityMap_ParseConfigurationFromJson shall return the pointer to the configuration on success. ]*/
                 }
             }
-			json_value_free(json);
-		}
+            else
+            {
+                /*Codes_SRS_IDMAP_05_005: [ If configuration is not a JSON array of JSON objects, then IdentityMap_ParseConfigurationFromJson shall fail and return NULL. ]*/
+                LogError("Expected a JSON Array or Object in configuration");
+                result = NULL;
+            }
+            json_value_free(json);
+        }
     }
     return result;
 }
@@ -497,16 +1245,14 @@ static void IdentityMap_FreeConfiguration(void * configuration)
     /*Codes_SRS_IDMAP_17_059: [ IdentityMap_FreeConfiguration shall do nothing if configuration is NULL. ]*/
     if (configuration != NULL)
     {
-        VECTOR_HANDLE map_vector = (VECTOR_HANDLE)configuration;
-        size_t map_size = VECTOR_size(map_vector);
-        size_t record;
-        for (record = 0; record < map_size; record++)
+        /*Codes_SRS_IDMAP_05_016: [ IdentityMap_FreeConfiguration shall release all data IdentityMap_ParseConfigurationFromJson allocated. ]*/
+        IDENTITY_MAP_MODULE_CONFIG * config = (IDENTITY_MAP_MODULE_CONFIG *)configuration;
+        if (config->mapping != NULL)
         {
-            /*Codes_SRS_IDMAP_05_016: [ IdentityMap_FreeConfiguration shall release all data IdentityMap_ParseConfigurationFromJson allocated. ]*/
-            IDENTITY_MAP_CONFIG * element = (IDENTITY_MAP_CONFIG *)VECTOR_element(map_vector, record);
-            IdentityMapConfig_Free(element);
+            IdentityMap_FreeMapping(config->mapping);
         }
-        VECTOR_destroy(map_vector);
+        free((void*)config->mappingFile);
+        free(config);
     }
 }
 /*
@@ -517,16 +1263,29 @@ static void IdentityMap_Destroy(MODULE_HANDLE moduleHandle)
     /*Codes_SRS_IDMAP_17_018: [If moduleHandle is NULL, IdentityMap_Destroy shall return.]*/
     if (moduleHandle != NULL)
     {
-        /*Codes_SRS_IDMAP_17_015: [IdentityMap_Destroy shall release all resources allocated for the module.]*/
         IDENTITY_MAP_DATA * idModule = (IDENTITY_MAP_DATA*)moduleHandle;
-        for (size_t index = 0; index < idModule->mappingSize; index++)
+        if (idModule->reloader != NULL)
         {
-            IdentityMapConfig_Free(&(idModule->macToDevIdArray[index]));
-            IdentityMapConfig_Free(&(idModule->devIdToMacArray[index]));
+            /*Codes_SRS_IDMAP_30_010: [ IdentityMap_Destroy shall stop the reloader and wait for it before releasing the mapping. ]*/
+            int notUsed;
+            if (Lock(idModule->lock) != LOCK_OK)
+            {
+                LogError("unable to Lock, stopping the reloader anyway");
+                idModule->stopping = true;
+            }
+            else
+            {
+                idModule->stopping = true;
+                (void)Condition_Post(idModule->reloadCondition);
+                (void)Unlock(idModule->lock);
+            }
+            if (ThreadAPI_Join(idModule->reloader, &notUsed) != THREADAPI_OK)
+            {
+                LogError("unable to ThreadAPI_Join, the reloader may outlive the module");
+            }
         }
-        free(idModule->macToDevIdArray);
-        free(idModule->devIdToMacArray);
-        free(idModule);
+        /*Codes_SRS_IDMAP_17_015: [IdentityMap_Destroy shall release all resources allocated for the module.]*/
+        IdentityMap_Free(idModule);
     }
 }
 
@@ -575,7 +1334,7 @@ static void publish_with_new_properties(MAP_HANDLE newProperties, MESSAGE_HANDLE
 static void IdentityMap_RepublishD2C(
     IDENTITY_MAP_DATA * idModule,
     MESSAGE_HANDLE messageHandle,
-    IDENTITY_MAP_CONFIG * match)
+    const IDENTITY_MAP_CONFIG * match)
 {
     CONSTMAP_HANDLE properties = Message_GetProperties(messageHandle);
     if (properties == NULL)
@@ -634,7 +1393,7 @@ static void IdentityMap_RepublishD2C(
 static void IdentityMap_RepublishC2D(
     IDENTITY_MAP_DATA * idModule,
     MESSAGE_HANDLE messageHandle,
-    IDENTITY_MAP_CONFIG * match)
+    const IDENTITY_MAP_CONFIG * match)
 {
     CONSTMAP_HANDLE properties = Message_GetProperties(messageHandle);
     if (properties == NULL)
@@ -734,78 +1493,68 @@ static void IdentityMap_Receive(MODULE_HANDLE moduleHandle, MESSAGE_HANDLE messa
     {
         IDENTITY_MAP_DATA * idModule = (IDENTITY_MAP_DATA*)moduleHandle;
 
-        CONSTMAP_HANDLE properties = Message_GetProperties(messageHandle);
-
-        const char * source = ConstMap_GetValue(properties, GW_SOURCE_PROPERTY);
+        /*Codes_SRS_IDMAP_30_016: [ IdentityMap_Receive shall read the properties of messageHandle by calling Message_GetProperty with the interned keys. ]*/
+        const char * source = Message_GetProperty(messageHandle, idModule->sourceKey);
         bool isC2DMessage;
         if (determine_message_direction(source, &isC2DMessage))
         {
             if (isC2DMessage == true)
             {
-                const char * deviceName = ConstMap_GetValue(properties, GW_DEVICENAME_PROPERTY);
+                const char * deviceName = Message_GetProperty(messageHandle, idModule->deviceNameKey);
+                IDENTITY_MAP_TABLE * table;
                 /*Codes_SRS_IDMAP_17_045: [ If messageHandle properties does not contain "deviceName" property, then the message shall not be marked as a C2D message. */
-                if (deviceName != NULL)
+                if ((deviceName != NULL) && ((table = IdentityMap_AcquireTable(idModule)) != NULL))
                 {
-                    IDENTITY_MAP_CONFIG key = { NULL,deviceName,NULL };
-
-                    IDENTITY_MAP_CONFIG * match = bsearch(&key,
-                        idModule->devIdToMacArray, idModule->mappingSize,
-                        sizeof(IDENTITY_MAP_CONFIG),
-                        IdentityMapConfig_IdCompare);
-                    if (match == NULL)
+                    IDENTITY_MAP_CONFIG match;
+                    if (IdentityMap_FindDevice(table, deviceName, &match) == false)
                     {
                         /*Codes_SRS_IDMAP_17_048: [ If the deviceName of the message is not found in deviceToMacArray, then the message shall not be marked as a C2D message. ]*/
                         LogInfo("Did not find device Id [%s] of current message", deviceName);
                     }
                     else
                     {
-                        IdentityMap_RepublishC2D(idModule, messageHandle, match);
+                        IdentityMap_RepublishC2D(idModule, messageHandle, &match);
                     }
+                    IdentityMap_ReleaseTable(idModule, table);
                 }
             }
             else
             {
-                const char * messageMac = IdentityMapConfig_ToUpperCase(
-                    ConstMap_GetValue(properties, GW_MAC_ADDRESS_PROPERTY));
+                const char * messageMac = Message_GetProperty(messageHandle, idModule->macAddressKey);
 
                 /*Codes_SRS_IDMAP_17_021: [If messageHandle properties does not contain "macAddress" property, then the function shall return.]*/
                 if (messageMac != NULL)
                 {
                     /*Codes_SRS_IDMAP_17_024: [If messageHandle properties contains properties "deviceName" and "deviceKey", then this function shall return.] */
-                    if ((ConstMap_GetValue(properties, GW_DEVICENAME_PROPERTY) == NULL ||
-                        ConstMap_GetValue(properties, GW_DEVICEKEY_PROPERTY) == NULL))
+                    if ((Message_GetProperty(messageHandle, idModule->deviceNameKey) == NULL ||
+                        Message_GetProperty(messageHandle, idModule->deviceKeyKey) == NULL))
                     {
-                        if (IdentityMapConfig_IsCanonicalMAC(messageMac) == false)
+                        uint64_t mac;
+                        IDENTITY_MAP_TABLE * table;
+                        /*Codes_SRS_IDMAP_30_011: [ IdentityMap_Receive shall read the message macAddress as a 48 bit number, whatever the case of its digits, without allocating memory. ]*/
+                        if (IdentityMapConfig_ParseMAC(messageMac, &mac) == false)
                         {
                             /*Codes_SRS_IDMAP_17_040: [If the macAddress of the message is not in canonical form, then this function shall return.]*/
                             LogInfo("MAC address not valid: %s", messageMac);
                         }
-                        else
+                        else if ((table = IdentityMap_AcquireTable(idModule)) != NULL)
                         {
-                            IDENTITY_MAP_CONFIG key = { messageMac,NULL,NULL };
-
-                            IDENTITY_MAP_CONFIG * match = bsearch(&key,
-                                idModule->macToDevIdArray, idModule->mappingSize,
-                                sizeof(IDENTITY_MAP_CONFIG),
-                                IdentityMapConfig_MacCompare);
-                            if (match == NULL)
+                            IDENTITY_MAP_CONFIG match;
+                            if (IdentityMap_FindMAC(table, mac, &match) == false)
                             {
                                 /*Codes_SRS_IDMAP_17_025: [If the macAddress of the message is not found in the macToDeviceArray list, then this function shall return.]*/
                                 LogInfo("Did not find message MAC Address: %s", messageMac);
                             }
                             else
                             {
-                                IdentityMap_RepublishD2C(idModule, messageHandle, match);
+                                IdentityMap_RepublishD2C(idModule, messageHandle, &match);
                             }
+                            IdentityMap_ReleaseTable(idModule, table);
                         }
                     }
-                    /*Codes_SRS_IDMAP_17_039: [IdentityMap_Receive will destroy all resources it created.]*/
-                    free((void*)messageMac);
                 }
             }
         }
-        ConstMap_Destroy(properties);
-
     }
 }
 
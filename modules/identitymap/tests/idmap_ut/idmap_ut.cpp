@@ -3,11 +3,17 @@
 
 #include <cstdlib>
 #include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <sys/types.h>
 #include "testrunnerswitcher.h"
 #include "micromock.h"
 #include "micromockcharstararenullterminatedstrings.h"
 #include "azure_c_shared_utility/map.h"
 #include "azure_c_shared_utility/lock.h"
+#include "azure_c_shared_utility/condition.h"
+#include "azure_c_shared_utility/threadapi.h"
 #include "azure_c_shared_utility/vector.h"
 #include "messageproperties.h"
 #include "module_access.h"
@@ -49,6 +55,8 @@ namespace BASEIMPLEMENTATION
 };
 
 #include "identitymap.h"
+#include "identitymap_store.h"
+#include "property_key.h"
 #include "azure_c_shared_utility/crt_abstractions.h"
 
 static size_t currentmalloc_call;
@@ -109,11 +117,20 @@ public:
 typedef struct IDENTITY_MAP_DATA_TAG
 {
     BROKER_HANDLE broker;
-    size_t mappingSize;
-    IDENTITY_MAP_CONFIG * macToDevIdArray;
-    IDENTITY_MAP_CONFIG * devIdToMacArray;
+    void * table;
+    char * mappingFile;
+    unsigned int reloadIntervalMs;
+    time_t fileTime;
+    off_t fileSize;
+    LOCK_HANDLE lock;
+    COND_HANDLE reloadCondition;
+    THREAD_HANDLE reloader;
+    bool stopping;
 } IDENTITY_MAP_DATA;
 
+#define MAPPING_FILE "idmap_ut_mapping.json"
+#define MAPPING_STORE "idmap_ut_mapping.store"
+
 #define VALID_MAP_HANDLE    0xDEAF
 #define VALID_VALUE         "value"
 static MAP_RESULT currentMapResult;
@@ -128,6 +145,91 @@ static const char* deviceKeyProperties;
 
 static VECTOR_HANDLE testVector1;
 static VECTOR_HANDLE testVector2;
+static IDENTITY_MAP_MODULE_CONFIG testConfig1;
+static IDENTITY_MAP_MODULE_CONFIG testConfig2;
+
+//parson mocks
+static const char* jsonMacAddress;
+static const char* jsonMappingFile;
+static double jsonReloadIntervalMs;
+static size_t jsonArrayCount;
+static bool jsonParseFileFails;
+static size_t jsonParseFileCount;
+
+static size_t publishCount;
+
+/*the reloader captured by ThreadAPI_Create, ThreadAPI_Join runs it, it stops after this many waits (0 never)*/
+static THREAD_START_FUNC reloaderFunc;
+static void* reloaderArg;
+static size_t conditionWaitCount;
+static int conditionWaitMs;
+static size_t whenShallReloaderStop;
+
+static void write_mapping_file(const char* content)
+{
+    FILE* f = fopen(MAPPING_FILE, "w");
+    ASSERT_IS_NOT_NULL(f);
+    (void)fputs(content, f);
+    (void)fclose(f);
+}
+
+/*the triplets must be sorted both by MAC address and by deviceId, in upper case*/
+static void write_mapping_store(const IDENTITY_MAP_CONFIG* triplets, uint32_t count, uint32_t version)
+{
+    IDENTITY_MAP_STORE_HEADER header = { IDENTITY_MAP_STORE_MAGIC, version, count, 0 };
+    uint32_t offset = 0;
+    uint32_t i;
+    FILE* f = fopen(MAPPING_STORE, "wb");
+    ASSERT_IS_NOT_NULL(f);
+    for (i = 0; i < count; i++)
+    {
+        header.stringsSize += (uint32_t)(strlen(triplets[i].macAddress) + strlen(triplets[i].deviceId) + strlen(triplets[i].deviceKey) + 3);
+    }
+    (void)fwrite(&header, sizeof(header), 1, f);
+    for (i = 0; i < count; i++)
+    {
+        unsigned int b[6];
+        IDENTITY_MAP_STORE_RECORD record;
+        (void)sscanf(triplets[i].macAddress, "%x:%x:%x:%x:%x:%x", &b[0], &b[1], &b[2], &b[3], &b[4], &b[5]);
+        record.macHigh = (b[0] << 8) | b[1];
+        record.macLow = (b[2] << 24) | (b[3] << 16) | (b[4] << 8) | b[5];
+        record.macAddress = offset;
+        record.deviceId = (offset += (uint32_t)strlen(triplets[i].macAddress) + 1);
+        record.deviceKey = (offset += (uint32_t)strlen(triplets[i].deviceId) + 1);
+        offset += (uint32_t)strlen(triplets[i].deviceKey) + 1;
+        (void)fwrite(&record, sizeof(record), 1, f);
+    }
+    for (i = 0; i < count; i++)
+    {
+        (void)fwrite(&i, sizeof(i), 1, f);
+    }
+    for (i = 0; i < count; i++)
+    {
+        (void)fwrite(triplets[i].macAddress, strlen(triplets[i].macAddress) + 1, 1, f);
+        (void)fwrite(triplets[i].deviceId, strlen(triplets[i].deviceId) + 1, 1, f);
+        (void)fwrite(triplets[i].deviceKey, strlen(triplets[i].deviceKey) + 1, 1, f);
+    }
+    (void)fclose(f);
+}
+
+static const IDENTITY_MAP_CONFIG storeTriplets[] =
+{
+    { "01:01:01:01:01:01", "Sensor1", "theKeyFor1" },
+    { "02:02:02:02:02:02", "Sensor2", "theKeyFor2" },
+    { "AA:AA:BB:BB:CC:CC", "Sensor3", "theKeyFor3" }
+};
+
+/*publishCount tells whether the module mapped the MAC address*/
+static void receive_d2c(const MODULE_API* theAPIS, MODULE_HANDLE n, const char* macAddress)
+{
+    unsigned char fake;
+    MESSAGE_CONFIG cfg = { 1, &fake, (MAP_HANDLE)&fake };
+    MESSAGE_HANDLE m = Message_Create(&cfg);
+    macAddressProperties = macAddress;
+    sourceProperties = GW_SOURCE_BLE_TELEMETRY;
+    MODULE_RECEIVE(theAPIS)(n, m);
+    Message_Destroy(m);
+}
 
 TYPED_MOCK_CLASS(CIdentitymapMocks, CGlobalMock)
     {
@@ -173,6 +275,7 @@ TYPED_MOCK_CLASS(CIdentitymapMocks, CGlobalMock)
 
     MOCK_STATIC_METHOD_3(, BROKER_RESULT, Broker_Publish, BROKER_HANDLE, broker, MODULE_HANDLE, source, MESSAGE_HANDLE, message)
         BROKER_RESULT brokerResult = currentBrokerResult;
+        publishCount++;
     MOCK_METHOD_END(BROKER_RESULT, brokerResult)
 
     // ConstMap mocks
@@ -333,6 +436,29 @@ TYPED_MOCK_CLASS(CIdentitymapMocks, CGlobalMock)
         }
     MOCK_METHOD_END(CONSTMAP_HANDLE, result1)
 
+    MOCK_STATIC_METHOD_2(, const char*, Message_GetProperty, MESSAGE_HANDLE, message, const char*, key)
+        const char * result1 = VALID_VALUE;
+        if (strcmp(GW_MAC_ADDRESS_PROPERTY, key) == 0)
+        {
+            result1 = macAddressProperties;
+        }
+        else if (strcmp(GW_SOURCE_PROPERTY, key) == 0)
+        {
+            result1 = sourceProperties;
+        }
+        else if (strcmp(GW_DEVICENAME_PROPERTY, key) == 0)
+        {
+            result1 = deviceNameProperties;
+        }
+        else if (strcmp(GW_DEVICEKEY_PROPERTY, key) == 0)
+        {
+            result1 = deviceKeyProperties;
+        }
+    MOCK_METHOD_END(const char *, result1)
+
+    MOCK_STATIC_METHOD_1(, const char*, PropertyKey_Intern, const char*, key)
+    MOCK_METHOD_END(const char*, key)
+
     MOCK_STATIC_METHOD_1(, const CONSTBUFFER*, Message_GetContent, MESSAGE_HANDLE, message)
         CONSTBUFFER* result1 = &messageContent;
     MOCK_METHOD_END(const CONSTBUFFER*, result1)
@@ -363,6 +489,21 @@ TYPED_MOCK_CLASS(CIdentitymapMocks, CGlobalMock)
         }
     MOCK_METHOD_END(JSON_Value*, value);
 
+    MOCK_STATIC_METHOD_1(, JSON_Value*, json_parse_file, const char *, filename)
+        JSON_Value* value = NULL;
+        jsonParseFileCount++;
+        if ((filename != NULL) && (jsonParseFileFails == false))
+        {
+            value = (JSON_Value*)malloc(1);
+        }
+    MOCK_METHOD_END(JSON_Value*, value);
+
+    MOCK_STATIC_METHOD_1(, JSON_Object*, json_value_get_object, const JSON_Value*, value)
+    MOCK_METHOD_END(JSON_Object*, (JSON_Object*)NULL);
+
+    MOCK_STATIC_METHOD_2(, double, json_object_get_number, const JSON_Object*, object, const char*, name)
+    MOCK_METHOD_END(double, jsonReloadIntervalMs);
+
     MOCK_STATIC_METHOD_2(, JSON_Object *, json_array_get_object, const JSON_Array *, array, size_t, index)
         JSON_Object* object = NULL;
         if (array != NULL)
@@ -380,13 +521,13 @@ TYPED_MOCK_CLASS(CIdentitymapMocks, CGlobalMock)
     MOCK_METHOD_END(JSON_Array*, object);
 
     MOCK_STATIC_METHOD_1(, size_t, json_array_get_count, const JSON_Array *, array)
-    MOCK_METHOD_END(size_t, (size_t)0);
+    MOCK_METHOD_END(size_t, jsonArrayCount);
 
     MOCK_STATIC_METHOD_2(, const char*, json_object_get_string, const JSON_Object*, object, const char*, name)
         const char * result2;
         if (strcmp(name, "macAddress") == 0)
         {
-            result2 = "00:00:00:00:00:00";
+            result2 = jsonMacAddress;
         }
         else if (strcmp(name, "deviceId") == 0)
         {
@@ -396,6 +537,10 @@ TYPED_MOCK_CLASS(CIdentitymapMocks, CGlobalMock)
         {
             result2 = "key";
         }
+        else if (strcmp(name, "mappingFile") == 0)
+        {
+            result2 = jsonMappingFile;
+        }
         else
         {
             result2 = NULL;
@@ -486,6 +631,50 @@ TYPED_MOCK_CLASS(CIdentitymapMocks, CGlobalMock)
 
     MOCK_STATIC_METHOD_3(, int, size_tToString, char*, destination, size_t, destinationSize, size_t, value)
     MOCK_METHOD_END(int, 0)
+
+    // mapping file reloader
+    MOCK_STATIC_METHOD_0(, LOCK_HANDLE, Lock_Init)
+    MOCK_METHOD_END(LOCK_HANDLE, (LOCK_HANDLE)malloc(1))
+
+    MOCK_STATIC_METHOD_1(, LOCK_RESULT, Lock, LOCK_HANDLE, lock)
+    MOCK_METHOD_END(LOCK_RESULT, LOCK_OK)
+
+    MOCK_STATIC_METHOD_1(, LOCK_RESULT, Unlock, LOCK_HANDLE, lock)
+    MOCK_METHOD_END(LOCK_RESULT, LOCK_OK)
+
+    MOCK_STATIC_METHOD_1(, LOCK_RESULT, Lock_Deinit, LOCK_HANDLE, lock)
+        free(lock);
+    MOCK_METHOD_END(LOCK_RESULT, LOCK_OK)
+
+    MOCK_STATIC_METHOD_0(, COND_HANDLE, Condition_Init)
+    MOCK_METHOD_END(COND_HANDLE, (COND_HANDLE)malloc(1))
+
+    MOCK_STATIC_METHOD_1(, COND_RESULT, Condition_Post, COND_HANDLE, handle)
+    MOCK_METHOD_END(COND_RESULT, COND_OK)
+
+    MOCK_STATIC_METHOD_3(, COND_RESULT, Condition_Wait, COND_HANDLE, handle, LOCK_HANDLE, lock, int, timeout_milliseconds)
+        conditionWaitCount++;
+        conditionWaitMs = timeout_milliseconds;
+        if (conditionWaitCount == whenShallReloaderStop)
+        {
+            ((IDENTITY_MAP_DATA*)reloaderArg)->stopping = true;
+        }
+    MOCK_METHOD_END(COND_RESULT, COND_TIMEOUT)
+
+    MOCK_STATIC_METHOD_1(, void, Condition_Deinit, COND_HANDLE, handle)
+        free(handle);
+    MOCK_VOID_METHOD_END()
+
+    MOCK_STATIC_METHOD_3(, THREADAPI_RESULT, ThreadAPI_Create, THREAD_HANDLE*, threadHandle, THREAD_START_FUNC, func, void*, arg)
+        /*the tests run the reloader in ThreadAPI_Join*/
+        *threadHandle = (THREAD_HANDLE)0x42;
+        reloaderFunc = func;
+        reloaderArg = arg;
+    MOCK_METHOD_END(THREADAPI_RESULT, THREADAPI_OK)
+
+    MOCK_STATIC_METHOD_2(, THREADAPI_RESULT, ThreadAPI_Join, THREAD_HANDLE, threadHandle, int*, res)
+        *res = reloaderFunc(reloaderArg);
+    MOCK_METHOD_END(THREADAPI_RESULT, THREADAPI_OK)
     };
 
 DECLARE_GLOBAL_MOCK_METHOD_1(CIdentitymapMocks, , void*, gballoc_malloc, size_t, size);
@@ -515,12 +704,17 @@ DECLARE_GLOBAL_MOCK_METHOD_1(CIdentitymapMocks, , MESSAGE_HANDLE, Message_Create
 DECLARE_GLOBAL_MOCK_METHOD_1(CIdentitymapMocks, , MESSAGE_HANDLE, Message_CreateFromBuffer, const MESSAGE_BUFFER_CONFIG*, cfg);
 DECLARE_GLOBAL_MOCK_METHOD_1(CIdentitymapMocks, , MESSAGE_HANDLE, Message_Clone, MESSAGE_HANDLE, message);
 DECLARE_GLOBAL_MOCK_METHOD_1(CIdentitymapMocks, , CONSTMAP_HANDLE, Message_GetProperties, MESSAGE_HANDLE, message);
+DECLARE_GLOBAL_MOCK_METHOD_2(CIdentitymapMocks, , const char*, Message_GetProperty, MESSAGE_HANDLE, message, const char*, key);
+DECLARE_GLOBAL_MOCK_METHOD_1(CIdentitymapMocks, , const char*, PropertyKey_Intern, const char*, key);
 DECLARE_GLOBAL_MOCK_METHOD_1(CIdentitymapMocks, , const CONSTBUFFER*, Message_GetContent, MESSAGE_HANDLE, message);
 DECLARE_GLOBAL_MOCK_METHOD_1(CIdentitymapMocks, , CONSTBUFFER_HANDLE, Message_GetContentHandle, MESSAGE_HANDLE, message);
 DECLARE_GLOBAL_MOCK_METHOD_1(CIdentitymapMocks, , void, Message_Destroy, MESSAGE_HANDLE, message);
 
 //parson
 DECLARE_GLOBAL_MOCK_METHOD_1(CIdentitymapMocks, , JSON_Value*, json_parse_string, const char *, filename);
+DECLARE_GLOBAL_MOCK_METHOD_1(CIdentitymapMocks, , JSON_Value*, json_parse_file, const char *, filename);
+DECLARE_GLOBAL_MOCK_METHOD_1(CIdentitymapMocks, , JSON_Object*, json_value_get_object, const JSON_Value*, value);
+DECLARE_GLOBAL_MOCK_METHOD_2(CIdentitymapMocks, , double, json_object_get_number, const JSON_Object*, object, const char*, name);
 DECLARE_GLOBAL_MOCK_METHOD_2(CIdentitymapMocks, , JSON_Object *, json_array_get_object, const JSON_Array *, array, size_t, index);
 DECLARE_GLOBAL_MOCK_METHOD_1(CIdentitymapMocks, , JSON_Array*, json_value_get_array, const JSON_Value*, value);
 DECLARE_GLOBAL_MOCK_METHOD_2(CIdentitymapMocks, , const char*, json_object_get_string, const JSON_Object*, object, const char*, name);
@@ -543,6 +737,17 @@ DECLARE_GLOBAL_MOCK_METHOD_2(CIdentitymapMocks, , int, mallocAndStrcpy_s, char**
 DECLARE_GLOBAL_MOCK_METHOD_3(CIdentitymapMocks, , int, unsignedIntToString, char*, destination, size_t, destinationSize, unsigned int, value);
 DECLARE_GLOBAL_MOCK_METHOD_3(CIdentitymapMocks, , int, size_tToString, char*, destination, size_t, destinationSize, size_t, value);
 
+DECLARE_GLOBAL_MOCK_METHOD_0(CIdentitymapMocks, , LOCK_HANDLE, Lock_Init);
+DECLARE_GLOBAL_MOCK_METHOD_1(CIdentitymapMocks, , LOCK_RESULT, Lock, LOCK_HANDLE, lock);
+DECLARE_GLOBAL_MOCK_METHOD_1(CIdentitymapMocks, , LOCK_RESULT, Unlock, LOCK_HANDLE, lock);
+DECLARE_GLOBAL_MOCK_METHOD_1(CIdentitymapMocks, , LOCK_RESULT, Lock_Deinit, LOCK_HANDLE, lock);
+DECLARE_GLOBAL_MOCK_METHOD_0(CIdentitymapMocks, , COND_HANDLE, Condition_Init);
+DECLARE_GLOBAL_MOCK_METHOD_1(CIdentitymapMocks, , COND_RESULT, Condition_Post, COND_HANDLE, handle);
+DECLARE_GLOBAL_MOCK_METHOD_3(CIdentitymapMocks, , COND_RESULT, Condition_Wait, COND_HANDLE, handle, LOCK_HANDLE, lock, int, timeout_milliseconds);
+DECLARE_GLOBAL_MOCK_METHOD_1(CIdentitymapMocks, , void, Condition_Deinit, COND_HANDLE, handle);
+DECLARE_GLOBAL_MOCK_METHOD_3(CIdentitymapMocks, , THREADAPI_RESULT, ThreadAPI_Create, THREAD_HANDLE*, threadHandle, THREAD_START_FUNC, func, void*, arg);
+DECLARE_GLOBAL_MOCK_METHOD_2(CIdentitymapMocks, , THREADAPI_RESULT, ThreadAPI_Join, THREAD_HANDLE, threadHandle, int*, res);
+
 
 BEGIN_TEST_SUITE(idmap_ut)
 
@@ -594,6 +799,18 @@ BEGIN_TEST_SUITE(idmap_ut)
         currentMap_call = 0;
         whenShallMap_fail = 0;
         currentBrokerResult = BROKER_OK;
+        jsonMacAddress = "00:00:00:00:00:00";
+        jsonMappingFile = NULL;
+        jsonReloadIntervalMs = 0;
+        jsonArrayCount = 0;
+        jsonParseFileFails = false;
+        jsonParseFileCount = 0;
+        publishCount = 0;
+        reloaderFunc = NULL;
+        reloaderArg = NULL;
+        conditionWaitCount = 0;
+        conditionWaitMs = 0;
+        whenShallReloaderStop = 0;
 
         testVector1 = VECTOR_create(sizeof(IDENTITY_MAP_CONFIG));
         IDENTITY_MAP_CONFIG c1 =
@@ -613,6 +830,8 @@ BEGIN_TEST_SUITE(idmap_ut)
         };
         VECTOR_push_back(testVector2, &c1, 1);
         VECTOR_push_back(testVector2, &c2, 1);
+        testConfig1 = { testVector1, NULL, 0 };
+        testConfig2 = { testVector2, NULL, 0 };
         mocks.ResetAllCalls();
 
     }
@@ -626,6 +845,8 @@ BEGIN_TEST_SUITE(idmap_ut)
         CIdentitymapMocks mocks;
         VECTOR_destroy(testVector1);
         VECTOR_destroy(testVector2);
+        (void)remove(MAPPING_FILE);
+        (void)remove(MAPPING_STORE);
         mocks.ResetAllCalls();
 
     }
@@ -671,8 +892,8 @@ BEGIN_TEST_SUITE(idmap_ut)
     //Tests_SRS_IDMAP_05_007: [ IdentityMap_ParseConfigurationFromJson shall call VECTOR_create to make the identity map module input vector. ]
     //Tests_SRS_IDMAP_05_008: [ IdentityMap_ParseConfigurationFromJson shall walk through each object of the array. ]
     //Tests_SRS_IDMAP_05_012: [ IdentityMap_ParseConfigurationFromJson shall use "macAddress", "deviceId", and "deviceKey" values as the fields for an IDENTITY_MAP_CONFIG structure and call VECTOR_push_back to add this element to the vector. ]
-    //Tests_SRS_IDMAP_17_060: [ IdentityMap_ParseConfigurationFromJson shall allocate memory for the configuration vector. ]
-    //Tests_SRS_IDMAP_17_062: [ IdentityMap_ParseConfigurationFromJson shall return the pointer to the configuration vector on success. ]
+    //Tests_SRS_IDMAP_17_060: [ IdentityMap_ParseConfigurationFromJson shall allocate memory for the configuration. ]
+    //Tests_SRS_IDMAP_17_062: [ IdentityMap_ParseConfigurationFromJson shall return the pointer to the configuration on success. ]
     TEST_FUNCTION(IdentityMap_ParseConfigurationFromJson_Success)
     {
         ///Arrange
@@ -707,6 +928,7 @@ BEGIN_TEST_SUITE(idmap_ut)
         STRICT_EXPECTED_CALL(mocks, VECTOR_push_back(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1))
             .IgnoreArgument(1)
             .IgnoreArgument(2);
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(sizeof(IDENTITY_MAP_MODULE_CONFIG)));
 
         STRICT_EXPECTED_CALL(mocks, json_value_free(IGNORED_PTR_ARG))
             .IgnoreArgument(1);
@@ -718,6 +940,8 @@ BEGIN_TEST_SUITE(idmap_ut)
         ///Assert
         ASSERT_IS_NOT_NULL(n);
         mocks.AssertActualAndExpectedCalls();
+        ASSERT_IS_NOT_NULL(((IDENTITY_MAP_MODULE_CONFIG*)n)->mapping);
+        ASSERT_IS_NULL(((IDENTITY_MAP_MODULE_CONFIG*)n)->mappingFile);
 
         ///Cleanup
 		MODULE_FREE_CONFIGURATION(theAPIS)(n);
@@ -1054,6 +1278,8 @@ BEGIN_TEST_SUITE(idmap_ut)
         STRICT_EXPECTED_CALL(mocks, json_value_get_array(IGNORED_PTR_ARG))
             .IgnoreArgument(1)
             .SetFailReturn((JSON_Array*)NULL);
+        STRICT_EXPECTED_CALL(mocks, json_value_get_object(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
 
         //Act
         auto n = MODULE_PARSE_CONFIGURATION_FROM_JSON(theAPIS)(config);
@@ -1123,6 +1349,7 @@ BEGIN_TEST_SUITE(idmap_ut)
         STRICT_EXPECTED_CALL(mocks, VECTOR_push_back(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1))
             .IgnoreArgument(1)
             .IgnoreArgument(2);
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(sizeof(IDENTITY_MAP_MODULE_CONFIG)));
 
         STRICT_EXPECTED_CALL(mocks, json_value_free(IGNORED_PTR_ARG))
             .IgnoreArgument(1);
@@ -1135,7 +1362,7 @@ BEGIN_TEST_SUITE(idmap_ut)
             .IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
             .IgnoreArgument(1)
-            .ExpectedTimesExactly(3);
+            .ExpectedTimesExactly(5); /*the triplet, the mapping file name and the configuration*/
         STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 0))
             .IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, VECTOR_destroy(IGNORED_PTR_ARG))
@@ -1169,6 +1396,113 @@ BEGIN_TEST_SUITE(idmap_ut)
         ///Cleanup
     }
 
+    /*Tests_SRS_IDMAP_30_001: [ If configuration is a JSON object, IdentityMap_ParseConfigurationFromJson shall read the string "mappingFile" and the number "reloadIntervalMs", 0 when it is missing. ]*/
+    TEST_FUNCTION(IdentityMap_ParseConfigurationFromJson_mapping_file_Success)
+    {
+        ///Arrange
+        CIdentitymapMocks mocks;
+        const MODULE_API* theAPIS = Module_GetApi(MODULE_API_VERSION_1);
+        const char* config = "pretend this is a valid JSON object";
+        jsonMappingFile = "mapping.json";
+        jsonReloadIntervalMs = 250;
+
+        STRICT_EXPECTED_CALL(mocks, json_parse_string(config));
+        STRICT_EXPECTED_CALL(mocks, json_value_get_array(IGNORED_PTR_ARG))
+            .IgnoreArgument(1)
+            .SetFailReturn((JSON_Array*)NULL);
+        STRICT_EXPECTED_CALL(mocks, json_value_get_object(IGNORED_PTR_ARG))
+            .IgnoreArgument(1)
+            .SetReturn((JSON_Object*)0x44);
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(sizeof(IDENTITY_MAP_MODULE_CONFIG)));
+        STRICT_EXPECTED_CALL(mocks, json_object_get_string((JSON_Object*)0x44, "mappingFile"));
+        STRICT_EXPECTED_CALL(mocks, json_object_get_number((JSON_Object*)0x44, "reloadIntervalMs"));
+        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, "mapping.json"))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, json_value_free(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+
+        ///Act
+        auto n = (IDENTITY_MAP_MODULE_CONFIG*)MODULE_PARSE_CONFIGURATION_FROM_JSON(theAPIS)(config);
+
+        ///Assert
+        ASSERT_IS_NOT_NULL(n);
+        mocks.AssertActualAndExpectedCalls();
+        ASSERT_IS_NULL(n->mapping);
+        ASSERT_ARE_EQUAL(char_ptr, "mapping.json", n->mappingFile);
+        ASSERT_ARE_EQUAL(int, 250, (int)n->reloadIntervalMs);
+
+        ///Cleanup
+        MODULE_FREE_CONFIGURATION(theAPIS)(n);
+    }
+
+    /*Tests_SRS_IDMAP_30_002: [ If the JSON object has no "mappingFile", or "reloadIntervalMs" is negative or too large, IdentityMap_ParseConfigurationFromJson shall fail and return NULL. ]*/
+    TEST_FUNCTION(IdentityMap_ParseConfigurationFromJson_no_mapping_file_returns_null)
+    {
+        ///Arrange
+        CIdentitymapMocks mocks;
+        const MODULE_API* theAPIS = Module_GetApi(MODULE_API_VERSION_1);
+        const char* config = "pretend this is a valid JSON object";
+
+        STRICT_EXPECTED_CALL(mocks, json_parse_string(config));
+        STRICT_EXPECTED_CALL(mocks, json_value_get_array(IGNORED_PTR_ARG))
+            .IgnoreArgument(1)
+            .SetFailReturn((JSON_Array*)NULL);
+        STRICT_EXPECTED_CALL(mocks, json_value_get_object(IGNORED_PTR_ARG))
+            .IgnoreArgument(1)
+            .SetReturn((JSON_Object*)0x44);
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(sizeof(IDENTITY_MAP_MODULE_CONFIG)));
+        STRICT_EXPECTED_CALL(mocks, json_object_get_string((JSON_Object*)0x44, "mappingFile"));
+        STRICT_EXPECTED_CALL(mocks, json_object_get_number((JSON_Object*)0x44, "reloadIntervalMs"));
+        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, json_value_free(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+
+        ///Act
+        auto n = MODULE_PARSE_CONFIGURATION_FROM_JSON(theAPIS)(config);
+
+        ///Assert
+        ASSERT_IS_NULL(n);
+        mocks.AssertActualAndExpectedCalls();
+
+        ///Cleanup
+    }
+
+    /*Tests_SRS_IDMAP_30_002: [ If the JSON object has no "mappingFile", or "reloadIntervalMs" is negative or too large, IdentityMap_ParseConfigurationFromJson shall fail and return NULL. ]*/
+    TEST_FUNCTION(IdentityMap_ParseConfigurationFromJson_negative_interval_returns_null)
+    {
+        ///Arrange
+        CIdentitymapMocks mocks;
+        const MODULE_API* theAPIS = Module_GetApi(MODULE_API_VERSION_1);
+        const char* config = "pretend this is a valid JSON object";
+        jsonMappingFile = "mapping.json";
+        jsonReloadIntervalMs = -1;
+
+        STRICT_EXPECTED_CALL(mocks, json_parse_string(config));
+        STRICT_EXPECTED_CALL(mocks, json_value_get_array(IGNORED_PTR_ARG))
+            .IgnoreArgument(1)
+            .SetFailReturn((JSON_Array*)NULL);
+        STRICT_EXPECTED_CALL(mocks, json_value_get_object(IGNORED_PTR_ARG))
+            .IgnoreArgument(1)
+            .SetReturn((JSON_Object*)0x44);
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(sizeof(IDENTITY_MAP_MODULE_CONFIG)));
+        STRICT_EXPECTED_CALL(mocks, json_object_get_string((JSON_Object*)0x44, "mappingFile"));
+        STRICT_EXPECTED_CALL(mocks, json_object_get_number((JSON_Object*)0x44, "reloadIntervalMs"));
+        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, json_value_free(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+
+        ///Act
+        auto n = MODULE_PARSE_CONFIGURATION_FROM_JSON(theAPIS)(config);
+
+        ///Assert
+        ASSERT_IS_NULL(n);
+        mocks.AssertActualAndExpectedCalls();
+
+        ///Cleanup
+    }
+
     /*Tests_SRS_IDMAP_17_004: [If the broker is NULL, this function shall fail and return NULL.]*/
     TEST_FUNCTION(IdentityMap_Create_Broker_Null)
     {
@@ -1207,6 +1541,8 @@ BEGIN_TEST_SUITE(idmap_ut)
     }
 
     /*Tests_SRS_IDMAP_17_003: [Upon success, this function shall return a valid pointer to a MODULE_HANDLE.]*/
+    /*Tests_SRS_IDMAP_30_005: [ IdentityMap_Create shall sort the triplets by deviceId and index them by the 48 bit value of their MAC address in an open addressing hash table. ]*/
+    /*Tests_SRS_IDMAP_30_015: [ Upon success, IdentityMap_Create shall get the interned "source", "deviceName", "deviceKey" and "macAddress" property keys by calling PropertyKey_Intern. ]*/
     TEST_FUNCTION(IdentityMap_Create_Success_SingleEntry)
     {
         ///Arrange
@@ -1224,10 +1560,13 @@ BEGIN_TEST_SUITE(idmap_ut)
 
         STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG)).IgnoreArgument(1);
 
-        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is for the d2c internal array*/
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is for the mapping table*/
+            .IgnoreArgument(1);
+
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is for the table entries*/
             .IgnoreArgument(1);
 
-        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is for the c2d internal array*/
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is for the MAC address index*/
             .IgnoreArgument(1);
 
         STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 0)).IgnoreArgument(1);
@@ -1239,15 +1578,13 @@ BEGIN_TEST_SUITE(idmap_ut)
         STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is for the device key*/
             .IgnoreAllArguments();
 
-        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is for the mac address*/
-            .IgnoreAllArguments();
-        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is for the device name*/
-            .IgnoreAllArguments();
-        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is for the device key*/
-            .IgnoreAllArguments();
+        STRICT_EXPECTED_CALL(mocks, PropertyKey_Intern(GW_SOURCE_PROPERTY));
+        STRICT_EXPECTED_CALL(mocks, PropertyKey_Intern(GW_DEVICENAME_PROPERTY));
+        STRICT_EXPECTED_CALL(mocks, PropertyKey_Intern(GW_DEVICEKEY_PROPERTY));
+        STRICT_EXPECTED_CALL(mocks, PropertyKey_Intern(GW_MAC_ADDRESS_PROPERTY));
 
         ///Act
-        auto n = MODULE_CREATE(theAPIS)(broker, testVector1);
+        auto n = MODULE_CREATE(theAPIS)(broker, &testConfig1);
 
         ///Assert
         ASSERT_IS_NOT_NULL(n);
@@ -1273,7 +1610,8 @@ BEGIN_TEST_SUITE(idmap_ut)
 
 
         ///Act
-        auto n = MODULE_CREATE(theAPIS)(broker, v);
+        IDENTITY_MAP_MODULE_CONFIG config = { v, NULL, 0 };
+        auto n = MODULE_CREATE(theAPIS)(broker, &config);
 
         ///Assert
         ASSERT_IS_NULL(n);
@@ -1325,11 +1663,14 @@ BEGIN_TEST_SUITE(idmap_ut)
         STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 0)).IgnoreArgument(1);
 
         ///Act
-        auto n1 = MODULE_CREATE(theAPIS)(broker, v1);
+        IDENTITY_MAP_MODULE_CONFIG config1 = { v1, NULL, 0 };
+        auto n1 = MODULE_CREATE(theAPIS)(broker, &config1);
         ASSERT_IS_NULL(n1);
-        auto n2 = MODULE_CREATE(theAPIS)(broker, v2);
+        IDENTITY_MAP_MODULE_CONFIG config2 = { v2, NULL, 0 };
+        auto n2 = MODULE_CREATE(theAPIS)(broker, &config2);
         ASSERT_IS_NULL(n2);
-        auto n3 = MODULE_CREATE(theAPIS)(broker, v3);
+        IDENTITY_MAP_MODULE_CONFIG config3 = { v3, NULL, 0 };
+        auto n3 = MODULE_CREATE(theAPIS)(broker, &config3);
         ASSERT_IS_NULL(n3);
 
         ///Assert
@@ -1366,7 +1707,8 @@ BEGIN_TEST_SUITE(idmap_ut)
 
 
         ///Act
-        auto n1 = MODULE_CREATE(theAPIS)(broker, v1);
+        IDENTITY_MAP_MODULE_CONFIG config1 = { v1, NULL, 0 };
+        auto n1 = MODULE_CREATE(theAPIS)(broker, &config1);
         ASSERT_IS_NULL(n1);
 
 
@@ -1404,7 +1746,8 @@ BEGIN_TEST_SUITE(idmap_ut)
 
 
         ///Act
-        auto n2 = MODULE_CREATE(theAPIS)(broker, v2);
+        IDENTITY_MAP_MODULE_CONFIG config2 = { v2, NULL, 0 };
+        auto n2 = MODULE_CREATE(theAPIS)(broker, &config2);
         ASSERT_IS_NULL(n2);
 
 
@@ -1442,7 +1785,8 @@ BEGIN_TEST_SUITE(idmap_ut)
 
         ///Act
 
-        auto n3 = MODULE_CREATE(theAPIS)(broker, v3);
+        IDENTITY_MAP_MODULE_CONFIG config3 = { v3, NULL, 0 };
+        auto n3 = MODULE_CREATE(theAPIS)(broker, &config3);
         ASSERT_IS_NULL(n3);
 
         ///Assert
@@ -1471,7 +1815,7 @@ BEGIN_TEST_SUITE(idmap_ut)
 
 
         ///Act
-        auto n = MODULE_CREATE(theAPIS)(broker, testVector1);
+        auto n = MODULE_CREATE(theAPIS)(broker, &testConfig1);
 
         ///Assert
         ASSERT_IS_NULL(n);
@@ -1480,8 +1824,8 @@ BEGIN_TEST_SUITE(idmap_ut)
         ///Ablution
     }
 
-    /*Tests_SRS_IDMAP_17_011: [If IdentityMap_Create fails to create memory for the macToDeviceArray, then this function shall fail and return NULL.]*/
-    TEST_FUNCTION(IdentityMap_Create_internal_d2c_alloc_fail)
+    /*Tests_SRS_IDMAP_17_011: [If IdentityMap_Create fails to allocate the mapping table, then this function shall fail and return NULL.]*/
+    TEST_FUNCTION(IdentityMap_Create_table_alloc_fail)
     {
         ///Arrange
         CIdentitymapMocks mocks;
@@ -1496,17 +1840,18 @@ BEGIN_TEST_SUITE(idmap_ut)
 
         STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is for the module struct*/
             .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
-
 
         STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG)).IgnoreArgument(1);
 
-        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is for the internal array*/
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is for the mapping table*/
             .IgnoreArgument(1);
 
+        /*the mapping file name (NULL) and the module*/
+        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
 
         ///Act
-        auto n = MODULE_CREATE(theAPIS)(broker, testVector1);
+        auto n = MODULE_CREATE(theAPIS)(broker, &testConfig1);
 
         ///Assert
         ASSERT_IS_NULL(n);
@@ -1515,8 +1860,8 @@ BEGIN_TEST_SUITE(idmap_ut)
         ///Ablution
     }
 
-    /*Tests_SRS_IDMAP_17_042: [ If IdentityMap_Create fails to create memory for the deviceToMacArray, then this function shall fail and return NULL. */
-    TEST_FUNCTION(IdentityMap_Create_internal_c2d_alloc_fail)
+    /*Tests_SRS_IDMAP_17_011: [If IdentityMap_Create fails to allocate the mapping table, then this function shall fail and return NULL.]*/
+    TEST_FUNCTION(IdentityMap_Create_table_entries_alloc_fail)
     {
         ///Arrange
         CIdentitymapMocks mocks;
@@ -1524,26 +1869,31 @@ BEGIN_TEST_SUITE(idmap_ut)
         unsigned char fake;
         BROKER_HANDLE broker = (BROKER_HANDLE)&fake;
 
+        whenShallmalloc_fail = 3;
+
         STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG)).IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 0)).IgnoreArgument(1);
 
         STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is for the module struct*/
             .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
-
 
         STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG)).IgnoreArgument(1);
 
-        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is for the internal array*/
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is for the mapping table*/
+            .IgnoreArgument(1);
+
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is for the table entries*/
             .IgnoreArgument(1);
+
+        /*the table allocated so far*/
         STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is for the internal array*/
-            .IgnoreArgument(1)
-            .SetFailReturn((void_ptr)NULL);
 
+        /*the mapping file name (NULL) and the module*/
+        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
 
         ///Act
-        auto n = MODULE_CREATE(theAPIS)(broker, testVector1);
+        auto n = MODULE_CREATE(theAPIS)(broker, &testConfig1);
 
         ///Assert
         ASSERT_IS_NULL(n);
@@ -1551,8 +1901,9 @@ BEGIN_TEST_SUITE(idmap_ut)
 
         ///Ablution
     }
-    /*Tests_SRS_IDMAP_17_012: [If IdentityMap_Create fails to add a MAC address triplet to the macToDeviceArray, then this function shall fail, release all resources, and return NULL.]*/
-    TEST_FUNCTION(IdentityMap_Create_DeepCopy_fail_mac1)
+
+    /*Tests_SRS_IDMAP_17_042: [ If IdentityMap_Create fails to allocate the MAC address index, then this function shall fail and return NULL. ]*/
+    TEST_FUNCTION(IdentityMap_Create_mac_index_alloc_fail)
     {
         ///Arrange
         CIdentitymapMocks mocks;
@@ -1560,56 +1911,35 @@ BEGIN_TEST_SUITE(idmap_ut)
         unsigned char fake;
         BROKER_HANDLE broker = (BROKER_HANDLE)&fake;
 
-        whenShallStrdup_fail =7;
+        whenShallmalloc_fail = 4;
 
         STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG)).IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 0)).IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 1)).IgnoreArgument(1);
 
         STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is for the module struct*/
             .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
 
         STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG)).IgnoreArgument(1);
 
-        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is for the D2C internal array*/
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is for the mapping table*/
             .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
 
-        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is for the C2D internal array*/
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is for the table entries*/
             .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
 
-        STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 0)).IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 1)).IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is for the MAC address index*/
+            .IgnoreArgument(1);
 
-        /* 1st vector element */
-        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is for the mac address*/
-            .IgnoreAllArguments();
-        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is for the device name*/
-            .IgnoreAllArguments();
-        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is for the device key*/
-            .IgnoreAllArguments();
-        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
+        /*the table allocated so far*/
         STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
 
-        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is for the mac address*/
-            .IgnoreAllArguments();
-        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is for the device name*/
-            .IgnoreAllArguments();
-        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is for the device key*/
-            .IgnoreAllArguments();
-        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
+        /*the mapping file name (NULL) and the module*/
         STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
 
-        /* 2nd vector element */
-        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is for the mac address*/
-            .IgnoreAllArguments();
-
         ///Act
-        auto n = MODULE_CREATE(theAPIS)(broker, testVector2);
+        auto n = MODULE_CREATE(theAPIS)(broker, &testConfig1);
 
         ///Assert
         ASSERT_IS_NULL(n);
@@ -1618,8 +1948,8 @@ BEGIN_TEST_SUITE(idmap_ut)
         ///Ablution
     }
 
-    //Tests_SRS_IDMAP_17_043: [ If IdentityMap_Create fails to add a MAC address triplet to the deviceToMacArray, then this function shall fail, release all resources, and return NULL. 
-    TEST_FUNCTION(IdentityMap_Create_DeepCopy_fail_mac2)
+    /*Tests_SRS_IDMAP_17_012: [If IdentityMap_Create fails to copy a MAC address triplet, then this function shall fail, release all resources, and return NULL.]*/
+    TEST_FUNCTION(IdentityMap_Create_DeepCopy_fail_mac1)
     {
         ///Arrange
         CIdentitymapMocks mocks;
@@ -1627,7 +1957,7 @@ BEGIN_TEST_SUITE(idmap_ut)
         unsigned char fake;
         BROKER_HANDLE broker = (BROKER_HANDLE)&fake;
 
-        whenShallStrdup_fail = 10;
+        whenShallStrdup_fail = 1;
 
         STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG)).IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 0)).IgnoreArgument(1);
@@ -1635,58 +1965,34 @@ BEGIN_TEST_SUITE(idmap_ut)
 
         STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is for the module struct*/
             .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
 
         STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG)).IgnoreArgument(1);
 
-        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is for the D2C internal array*/
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is for the mapping table*/
             .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
 
-        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is for the C2D internal array*/
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is for the table entries*/
             .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
 
-        STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 0)).IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 1)).IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is for the MAC address index*/
+            .IgnoreArgument(1);
 
         /* 1st vector element */
+        STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 0)).IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is for the mac address*/
             .IgnoreAllArguments();
-        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is for the device name*/
-            .IgnoreAllArguments();
-        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is for the device key*/
-            .IgnoreAllArguments();
-        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
 
-        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is for the mac address*/
-            .IgnoreAllArguments();
-        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is for the device name*/
-            .IgnoreAllArguments();
-        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is for the device key*/
-            .IgnoreAllArguments();
+        /*the table*/
         STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
 
-        /* 2nd vector element */
-        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is for the mac address*/
-            .IgnoreAllArguments();
-        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is for the device name*/
-            .IgnoreAllArguments();
-        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is for the device key*/
-            .IgnoreAllArguments();
-        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
+        /*the mapping file name (NULL) and the module*/
         STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
 
-        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is for the mac address*/
-            .IgnoreAllArguments();
-
         ///Act
-        auto n = MODULE_CREATE(theAPIS)(broker, testVector2);
+        auto n = MODULE_CREATE(theAPIS)(broker, &testConfig2);
 
         ///Assert
         ASSERT_IS_NULL(n);
@@ -1695,8 +2001,8 @@ BEGIN_TEST_SUITE(idmap_ut)
         ///Ablution
     }
 
-    /*Tests_SRS_IDMAP_17_012: [If IdentityMap_Create fails to add a MAC address triplet to the macToDeviceArray, then this function shall fail, release all resources, and return NULL.]*/
-    TEST_FUNCTION(IdentityMap_Create_DeepCopy_fail_id1)
+    /*Tests_SRS_IDMAP_17_012: [If IdentityMap_Create fails to copy a MAC address triplet, then this function shall fail, release all resources, and return NULL.]*/
+    TEST_FUNCTION(IdentityMap_Create_DeepCopy_fail_mac2)
     {
         ///Arrange
         CIdentitymapMocks mocks;
@@ -1704,8 +2010,7 @@ BEGIN_TEST_SUITE(idmap_ut)
         unsigned char fake;
         BROKER_HANDLE broker = (BROKER_HANDLE)&fake;
 
-
-        whenShallStrdup_fail = 8;
+        whenShallStrdup_fail = 4;
 
         STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG)).IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 0)).IgnoreArgument(1);
@@ -1713,22 +2018,20 @@ BEGIN_TEST_SUITE(idmap_ut)
 
         STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is for the module struct*/
             .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
 
         STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG)).IgnoreArgument(1);
 
-        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is for the d2c internal array*/
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is for the mapping table*/
             .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
 
-        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is for the c2d internal array*/
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is for the table entries*/
             .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
 
-        STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 0)).IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 1)).IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is for the MAC address index*/
+            .IgnoreArgument(1);
 
-        //1st vector element
+        /* 1st vector element */
+        STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 0)).IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is for the mac address*/
             .IgnoreAllArguments();
         STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is for the device name*/
@@ -1738,25 +2041,23 @@ BEGIN_TEST_SUITE(idmap_ut)
         STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
+
+        /* 2nd vector element */
+        STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 1)).IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is for the mac address*/
             .IgnoreAllArguments();
-        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is for the device name*/
-            .IgnoreAllArguments();
-        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is for the device key*/
-            .IgnoreAllArguments();
+
+        /*the table*/
         STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
 
-        /* 2nd vector element */
-        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is for the mac address*/
-            .IgnoreAllArguments();
+        /*the mapping file name (NULL) and the module*/
+        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is for the mac address*/
-            .IgnoreAllArguments();
 
         ///Act
-        auto n = MODULE_CREATE(theAPIS)(broker, testVector2);
+        auto n = MODULE_CREATE(theAPIS)(broker, &testConfig2);
 
         ///Assert
         ASSERT_IS_NULL(n);
@@ -1765,7 +2066,8 @@ BEGIN_TEST_SUITE(idmap_ut)
         ///Ablution
     }
 
-    TEST_FUNCTION(IdentityMap_Create_DeepCopy_fail_id2)
+    /*Tests_SRS_IDMAP_17_012: [If IdentityMap_Create fails to copy a MAC address triplet, then this function shall fail, release all resources, and return NULL.]*/
+    TEST_FUNCTION(IdentityMap_Create_DeepCopy_fail_id1)
     {
         ///Arrange
         CIdentitymapMocks mocks;
@@ -1773,8 +2075,7 @@ BEGIN_TEST_SUITE(idmap_ut)
         unsigned char fake;
         BROKER_HANDLE broker = (BROKER_HANDLE)&fake;
 
-
-        whenShallStrdup_fail = 11;
+        whenShallStrdup_fail = 2;
 
         STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG)).IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 0)).IgnoreArgument(1);
@@ -1782,33 +2083,78 @@ BEGIN_TEST_SUITE(idmap_ut)
 
         STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is for the module struct*/
             .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
 
         STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG)).IgnoreArgument(1);
 
-        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is for the d2c internal array*/
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is for the mapping table*/
             .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
 
-        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is for the c2d internal array*/
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is for the table entries*/
             .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
 
-        STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 0)).IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 1)).IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is for the MAC address index*/
+            .IgnoreArgument(1);
 
-        //1st vector element
+        /* 1st vector element */
+        STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 0)).IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is for the mac address*/
             .IgnoreAllArguments();
         STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is for the device name*/
             .IgnoreAllArguments();
-        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is for the device key*/
-            .IgnoreAllArguments();
         STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
+
+        /*the table*/
         STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is for the mac address*/
-            .IgnoreAllArguments();
+        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
+
+        /*the mapping file name (NULL) and the module*/
+        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
+
+        ///Act
+        auto n = MODULE_CREATE(theAPIS)(broker, &testConfig2);
+
+        ///Assert
+        ASSERT_IS_NULL(n);
+        mocks.AssertActualAndExpectedCalls();
+
+        ///Ablution
+    }
+
+    /*Tests_SRS_IDMAP_17_012: [If IdentityMap_Create fails to copy a MAC address triplet, then this function shall fail, release all resources, and return NULL.]*/
+    TEST_FUNCTION(IdentityMap_Create_DeepCopy_fail_id2)
+    {
+        ///Arrange
+        CIdentitymapMocks mocks;
+        const MODULE_API* theAPIS= Module_GetApi(MODULE_API_VERSION_1);
+        unsigned char fake;
+        BROKER_HANDLE broker = (BROKER_HANDLE)&fake;
+
+        whenShallStrdup_fail = 5;
+
+        STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG)).IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 0)).IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 1)).IgnoreArgument(1);
+
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is for the module struct*/
+            .IgnoreArgument(1);
+
+        STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG)).IgnoreArgument(1);
+
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is for the mapping table*/
+            .IgnoreArgument(1);
+
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is for the table entries*/
+            .IgnoreArgument(1);
+
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is for the MAC address index*/
+            .IgnoreArgument(1);
+
+        /* 1st vector element */
+        STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 0)).IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is for the mac address*/
+            .IgnoreAllArguments();
         STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is for the device name*/
             .IgnoreAllArguments();
         STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is for the device key*/
@@ -1818,24 +2164,24 @@ BEGIN_TEST_SUITE(idmap_ut)
         STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
 
         /* 2nd vector element */
+        STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 1)).IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is for the mac address*/
             .IgnoreAllArguments();
         STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is for the device name*/
             .IgnoreAllArguments();
-        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is for the device key*/
-            .IgnoreAllArguments();
+        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
+
+        /*the table*/
         STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
 
-        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is for the mac address*/
-            .IgnoreAllArguments();
+        /*the mapping file name (NULL) and the module*/
+        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is for the mac address*/
-            .IgnoreAllArguments();
 
         ///Act
-        auto n = MODULE_CREATE(theAPIS)(broker, testVector2);
+        auto n = MODULE_CREATE(theAPIS)(broker, &testConfig2);
 
         ///Assert
         ASSERT_IS_NULL(n);
@@ -1844,8 +2190,7 @@ BEGIN_TEST_SUITE(idmap_ut)
         ///Ablution
     }
 
-
-    /*Tests_SRS_IDMAP_17_012: [If IdentityMap_Create fails to add a MAC address triplet to the macToDeviceArray, then this function shall fail, release all resources, and return NULL.]*/
+    /*Tests_SRS_IDMAP_17_012: [If IdentityMap_Create fails to copy a MAC address triplet, then this function shall fail, release all resources, and return NULL.]*/
     TEST_FUNCTION(IdentityMap_Create_DeepCopy_fail_key1)
     {
         ///Arrange
@@ -1854,7 +2199,7 @@ BEGIN_TEST_SUITE(idmap_ut)
         unsigned char fake;
         BROKER_HANDLE broker = (BROKER_HANDLE)&fake;
 
-        whenShallStrdup_fail = 9;
+        whenShallStrdup_fail = 3;
 
         STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG)).IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 0)).IgnoreArgument(1);
@@ -1862,22 +2207,20 @@ BEGIN_TEST_SUITE(idmap_ut)
 
         STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is for the module struct*/
             .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
 
         STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG)).IgnoreArgument(1);
 
-        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is for the D2C internal array*/
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is for the mapping table*/
             .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
 
-        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is for the C2D internal array*/
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is for the table entries*/
             .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
 
-        STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 0)).IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 1)).IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is for the MAC address index*/
+            .IgnoreArgument(1);
 
-        //1st vector element
+        /* 1st vector element */
+        STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 0)).IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is for the mac address*/
             .IgnoreAllArguments();
         STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is for the device name*/
@@ -1886,33 +2229,18 @@ BEGIN_TEST_SUITE(idmap_ut)
             .IgnoreAllArguments();
         STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
 
-        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is for the mac address*/
-            .IgnoreAllArguments();
-        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is for the device name*/
-            .IgnoreAllArguments();
-        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is for the device key*/
-            .IgnoreAllArguments();
+        /*the table*/
         STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
 
-        // 2nd vector element
-        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is for the mac address*/
-            .IgnoreAllArguments();
-        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is for the device name*/
-            .IgnoreAllArguments();
+        /*the mapping file name (NULL) and the module*/
         STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
 
-        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is for the device key*/
-            .IgnoreAllArguments();
-
-
-
         ///Act
-        auto n = MODULE_CREATE(theAPIS)(broker, testVector2);
+        auto n = MODULE_CREATE(theAPIS)(broker, &testConfig2);
 
         ///Assert
         ASSERT_IS_NULL(n);
@@ -1921,6 +2249,7 @@ BEGIN_TEST_SUITE(idmap_ut)
         ///Ablution
     }
 
+    /*Tests_SRS_IDMAP_17_012: [If IdentityMap_Create fails to copy a MAC address triplet, then this function shall fail, release all resources, and return NULL.]*/
     TEST_FUNCTION(IdentityMap_Create_DeepCopy_fail_key2)
     {
         ///Arrange
@@ -1929,7 +2258,7 @@ BEGIN_TEST_SUITE(idmap_ut)
         unsigned char fake;
         BROKER_HANDLE broker = (BROKER_HANDLE)&fake;
 
-        whenShallStrdup_fail = 12;
+        whenShallStrdup_fail = 6;
 
         STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG)).IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 0)).IgnoreArgument(1);
@@ -1937,22 +2266,20 @@ BEGIN_TEST_SUITE(idmap_ut)
 
         STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is for the module struct*/
             .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
 
         STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG)).IgnoreArgument(1);
 
-        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is for the D2C internal array*/
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is for the mapping table*/
             .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
 
-        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is for the C2D internal array*/
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is for the table entries*/
             .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
 
-        STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 0)).IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 1)).IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is for the MAC address index*/
+            .IgnoreArgument(1);
 
-        //1st vector element
+        /* 1st vector element */
+        STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 0)).IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is for the mac address*/
             .IgnoreAllArguments();
         STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is for the device name*/
@@ -1963,6 +2290,8 @@ BEGIN_TEST_SUITE(idmap_ut)
         STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
 
+        /* 2nd vector element */
+        STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 1)).IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is for the mac address*/
             .IgnoreAllArguments();
         STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is for the device name*/
@@ -1971,33 +2300,128 @@ BEGIN_TEST_SUITE(idmap_ut)
             .IgnoreAllArguments();
         STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
+
+        /*the table*/
+        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
 
-        // 2nd vector element
-        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is for the mac address*/
-            .IgnoreAllArguments();
-        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is for the device name*/
-            .IgnoreAllArguments();
-        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is for the device key*/
-            .IgnoreAllArguments();
+        /*the mapping file name (NULL) and the module*/
+        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
+
+        ///Act
+        auto n = MODULE_CREATE(theAPIS)(broker, &testConfig2);
+
+        ///Assert
+        ASSERT_IS_NULL(n);
+        mocks.AssertActualAndExpectedCalls();
+
+        ///Ablution
+    }
+
+    /*Tests_SRS_IDMAP_17_018: [If moduleHandle is NULL, IdentityMap_Destroy shall return.]*/
+    TEST_FUNCTION(IdentityMap_Destroy_NULL)
+    {
+        ///Arrange
+        CIdentitymapMocks mocks;
+        const MODULE_API* theAPIS= Module_GetApi(MODULE_API_VERSION_1);
+
+        ///Act
+        MODULE_DESTROY(theAPIS)(NULL);
+
+        ///Assert
+        mocks.AssertActualAndExpectedCalls();
+
+        ///Ablution
+    }
+
+    /*Tests_SRS_IDMAP_17_015: [IdentityMap_Destroy shall release all resources allocated for the module.]*/
+    TEST_FUNCTION(IdentityMap_Destroy_2Element)
+    {
+        ///Arrange
+        CIdentitymapMocks mocks;
+        const MODULE_API* theAPIS= Module_GetApi(MODULE_API_VERSION_1);
+        BROKER_HANDLE broker = Broker_Create();
+
+        auto n = MODULE_CREATE(theAPIS)(broker, &testConfig2);
+
+        mocks.ResetAllCalls();
+
+        //1st vector element
         STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
 
-        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is for the mac address*/
-            .IgnoreAllArguments();
-        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is for the device name*/
-            .IgnoreAllArguments();
+        //2nd vector element
+        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
 
-        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is for the device key*/
-            .IgnoreAllArguments();
+        //MAC address index, entries and table
+        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
+
+        //mapping file name (NULL) and module data
+        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
+
+        ///Act
+        MODULE_DESTROY(theAPIS)(n);
+
+        ///Assert
+        mocks.AssertActualAndExpectedCalls();
 
+        ///Ablution
+        Broker_Destroy(broker);
 
+    }
+
+    /*Tests_SRS_IDMAP_30_004: [ If the configuration has both or none of mapping and mappingFile, this function shall fail and return NULL. ]*/
+    TEST_FUNCTION(IdentityMap_Create_mapping_and_mapping_file_fails)
+    {
+        ///Arrange
+        CIdentitymapMocks mocks;
+        const MODULE_API* theAPIS= Module_GetApi(MODULE_API_VERSION_1);
+        unsigned char fake;
+        BROKER_HANDLE broker = (BROKER_HANDLE)&fake;
+        IDENTITY_MAP_MODULE_CONFIG both = { testVector1, MAPPING_FILE, 0 };
+        IDENTITY_MAP_MODULE_CONFIG none = { NULL, NULL, 0 };
 
         ///Act
-        auto n = MODULE_CREATE(theAPIS)(broker, testVector2);
+        auto n1 = MODULE_CREATE(theAPIS)(broker, &both);
+        auto n2 = MODULE_CREATE(theAPIS)(broker, &none);
+
+        ///Assert
+        ASSERT_IS_NULL(n1);
+        ASSERT_IS_NULL(n2);
+        mocks.AssertActualAndExpectedCalls();
+
+        ///Ablution
+    }
+
+    /*Tests_SRS_IDMAP_30_006: [ If mappingFile is set, IdentityMap_Create shall load it as a JSON array of triplets validated like the inline mapping, and fail and return NULL if it cannot. ]*/
+    TEST_FUNCTION(IdentityMap_Create_missing_mapping_file_fails)
+    {
+        ///Arrange
+        CIdentitymapMocks mocks;
+        const MODULE_API* theAPIS= Module_GetApi(MODULE_API_VERSION_1);
+        unsigned char fake;
+        BROKER_HANDLE broker = (BROKER_HANDLE)&fake;
+        IDENTITY_MAP_MODULE_CONFIG config = { NULL, MAPPING_FILE, 0 };
+        (void)remove(MAPPING_FILE);
+
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is for the module struct*/
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, MAPPING_FILE))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)) /*the mapping file name and the module*/
+            .IgnoreArgument(1)
+            .ExpectedTimesExactly(2);
+
+        ///Act
+        auto n = MODULE_CREATE(theAPIS)(broker, &config);
 
         ///Assert
         ASSERT_IS_NULL(n);
@@ -2006,64 +2430,359 @@ BEGIN_TEST_SUITE(idmap_ut)
         ///Ablution
     }
 
-    /*Tests_SRS_IDMAP_17_018: [If moduleHandle is NULL, IdentityMap_Destroy shall return.]*/
-    TEST_FUNCTION(IdentityMap_Destroy_NULL)
+    /*Tests_SRS_IDMAP_30_006: [ If mappingFile is set, IdentityMap_Create shall load it as a JSON array of triplets validated like the inline mapping, and fail and return NULL if it cannot. ]*/
+    /*Tests_SRS_IDMAP_30_007: [ If mappingFile is set, IdentityMap_Create shall create a lock, a condition and a reloader thread. ]*/
+    TEST_FUNCTION(IdentityMap_Create_mapping_file_Success)
+    {
+        ///Arrange
+        CIdentitymapMocks mocks;
+        const MODULE_API* theAPIS= Module_GetApi(MODULE_API_VERSION_1);
+        BROKER_HANDLE broker = Broker_Create();
+        IDENTITY_MAP_MODULE_CONFIG config = { NULL, MAPPING_FILE, 0 };
+        write_mapping_file("a");
+        jsonArrayCount = 1;
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*the module, the table, its entries and its MAC address index*/
+            .IgnoreArgument(1)
+            .ExpectedTimesExactly(4);
+        STRICT_EXPECTED_CALL(mocks, json_parse_file(MAPPING_FILE));
+        STRICT_EXPECTED_CALL(mocks, json_value_get_array(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, VECTOR_create(sizeof(IDENTITY_MAP_CONFIG)));
+        STRICT_EXPECTED_CALL(mocks, json_array_get_count(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, json_array_get_object(IGNORED_PTR_ARG, 0))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, json_object_get_string(IGNORED_PTR_ARG, "macAddress"))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, json_object_get_string(IGNORED_PTR_ARG, "deviceId"))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, json_object_get_string(IGNORED_PTR_ARG, "deviceKey"))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*the file name, the triplet read from the file, then its copy in the table*/
+            .IgnoreAllArguments()
+            .ExpectedTimesExactly(7);
+        STRICT_EXPECTED_CALL(mocks, VECTOR_push_back(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1))
+            .IgnoreArgument(1)
+            .IgnoreArgument(2);
+        STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG)) /*validation, table and release*/
+            .IgnoreArgument(1)
+            .ExpectedTimesExactly(3);
+        STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 0)) /*validation, table and release*/
+            .IgnoreArgument(1)
+            .ExpectedTimesExactly(3);
+        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)) /*the triplet read from the file*/
+            .IgnoreArgument(1)
+            .ExpectedTimesExactly(3);
+        STRICT_EXPECTED_CALL(mocks, VECTOR_destroy(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, json_value_free(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, Lock_Init());
+        STRICT_EXPECTED_CALL(mocks, Condition_Init());
+        STRICT_EXPECTED_CALL(mocks, ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .IgnoreAllArguments();
+
+        STRICT_EXPECTED_CALL(mocks, PropertyKey_Intern(GW_SOURCE_PROPERTY));
+        STRICT_EXPECTED_CALL(mocks, PropertyKey_Intern(GW_DEVICENAME_PROPERTY));
+        STRICT_EXPECTED_CALL(mocks, PropertyKey_Intern(GW_DEVICEKEY_PROPERTY));
+        STRICT_EXPECTED_CALL(mocks, PropertyKey_Intern(GW_MAC_ADDRESS_PROPERTY));
+
+        ///Act
+        auto n = MODULE_CREATE(theAPIS)(broker, &config);
+
+        ///Assert
+        ASSERT_IS_NOT_NULL(n);
+        mocks.AssertActualAndExpectedCalls();
+        receive_d2c(theAPIS, n, "00:00:00:00:00:00");
+        ASSERT_ARE_EQUAL(size_t, (size_t)1, publishCount);
+
+        ///Ablution
+        MODULE_DESTROY(theAPIS)(n);
+        Broker_Destroy(broker);
+    }
+
+    /*Tests_SRS_IDMAP_30_010: [ IdentityMap_Destroy shall stop the reloader and wait for it before releasing the mapping. ]*/
+    TEST_FUNCTION(IdentityMap_Destroy_stops_reloader)
     {
         ///Arrange
         CIdentitymapMocks mocks;
         const MODULE_API* theAPIS= Module_GetApi(MODULE_API_VERSION_1);
+        BROKER_HANDLE broker = Broker_Create();
+        IDENTITY_MAP_MODULE_CONFIG config = { NULL, MAPPING_FILE, 0 };
+        write_mapping_file("a");
+        jsonArrayCount = 1;
+        auto n = MODULE_CREATE(theAPIS)(broker, &config);
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG)) /*destroy, then the reloader*/
+            .IgnoreArgument(1)
+            .ExpectedTimesExactly(2);
+        STRICT_EXPECTED_CALL(mocks, Condition_Post(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
+            .IgnoreArgument(1)
+            .ExpectedTimesExactly(2);
+        STRICT_EXPECTED_CALL(mocks, ThreadAPI_Join(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .IgnoreAllArguments();
+        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)) /*the triplet, the table, the mapping file name and the module*/
+            .IgnoreArgument(1)
+            .ExpectedTimesExactly(8);
+        STRICT_EXPECTED_CALL(mocks, Condition_Deinit(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, Lock_Deinit(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+
+        ///Act
+        MODULE_DESTROY(theAPIS)(n);
+
+        ///Assert
+        mocks.AssertActualAndExpectedCalls();
+        ASSERT_ARE_EQUAL(size_t, (size_t)0, conditionWaitCount);
+
+        ///Ablution
+        Broker_Destroy(broker);
+    }
+
+    /*Tests_SRS_IDMAP_30_003: [ The reloader shall check the mapping file every reloadIntervalMs milliseconds until the module is destroyed. ]*/
+    /*Tests_SRS_IDMAP_30_008: [ When the size or the modification time of the mapping file changed, the reloader shall load it and replace the whole mapping, the messages being processed shall keep the mapping they started with. ]*/
+    TEST_FUNCTION(IdentityMap_reloads_changed_mapping_file)
+    {
+        ///Arrange
+        CIdentitymapMocks mocks;
+        const MODULE_API* theAPIS= Module_GetApi(MODULE_API_VERSION_1);
+        BROKER_HANDLE broker = Broker_Create();
+        IDENTITY_MAP_MODULE_CONFIG config = { NULL, MAPPING_FILE, 25 };
+        write_mapping_file("a");
+        jsonArrayCount = 1;
+        auto n = MODULE_CREATE(theAPIS)(broker, &config);
+        write_mapping_file("ab");
+        jsonMacAddress = "11:22:33:44:55:66";
+        whenShallReloaderStop = 2;
+        jsonParseFileCount = 0;
+
+        ///Act
+        (void)reloaderFunc(reloaderArg);
+
+        ///Assert
+        ASSERT_ARE_EQUAL(size_t, (size_t)2, conditionWaitCount);
+        ASSERT_ARE_EQUAL(int, 25, conditionWaitMs);
+        ASSERT_ARE_EQUAL(size_t, (size_t)1, jsonParseFileCount);
+        receive_d2c(theAPIS, n, "00:00:00:00:00:00");
+        ASSERT_ARE_EQUAL(size_t, (size_t)0, publishCount);
+        receive_d2c(theAPIS, n, "11:22:33:44:55:66");
+        ASSERT_ARE_EQUAL(size_t, (size_t)1, publishCount);
+
+        ///Ablution
+        MODULE_DESTROY(theAPIS)(n);
+        Broker_Destroy(broker);
+    }
+
+    /*Tests_SRS_IDMAP_30_009: [ If the changed mapping file cannot be loaded, the module shall keep the current mapping and not read the file again before it changes. ]*/
+    TEST_FUNCTION(IdentityMap_keeps_mapping_when_reload_fails)
+    {
+        ///Arrange
+        CIdentitymapMocks mocks;
+        const MODULE_API* theAPIS= Module_GetApi(MODULE_API_VERSION_1);
+        BROKER_HANDLE broker = Broker_Create();
+        IDENTITY_MAP_MODULE_CONFIG config = { NULL, MAPPING_FILE, 0 };
+        write_mapping_file("a");
+        jsonArrayCount = 1;
+        auto n = MODULE_CREATE(theAPIS)(broker, &config);
+        write_mapping_file("ab");
+        jsonParseFileFails = true;
+        whenShallReloaderStop = 3;
+        jsonParseFileCount = 0;
+
+        ///Act
+        (void)reloaderFunc(reloaderArg);
+
+        ///Assert
+        ASSERT_ARE_EQUAL(int, IDENTITY_MAP_DEFAULT_RELOAD_INTERVAL_MS, conditionWaitMs);
+        ASSERT_ARE_EQUAL(size_t, (size_t)1, jsonParseFileCount); /*the file did not change again*/
+        receive_d2c(theAPIS, n, "00:00:00:00:00:00");
+        ASSERT_ARE_EQUAL(size_t, (size_t)1, publishCount);
+
+        ///Ablution
+        MODULE_DESTROY(theAPIS)(n);
+        Broker_Destroy(broker);
+    }
+
+    /*Tests_SRS_IDMAP_30_012: [ If the mapping file starts with the identity store magic number, it shall be mapped read-only and searched in place instead of being read as JSON. ]*/
+    /*Tests_SRS_IDMAP_30_014: [ IdentityMap_Receive shall binary search the records of an identity store by MAC address and the record numbers by deviceId, in place. ]*/
+    TEST_FUNCTION(IdentityMap_Create_mapping_store_Success)
+    {
+        ///Arrange
+        CIdentitymapMocks mocks;
+        const MODULE_API* theAPIS= Module_GetApi(MODULE_API_VERSION_1);
+        BROKER_HANDLE broker = Broker_Create();
+        IDENTITY_MAP_MODULE_CONFIG config = { NULL, MAPPING_STORE, 0 };
+        write_mapping_store(storeTriplets, 3, IDENTITY_MAP_STORE_VERSION);
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*the module and the table, not the triplets*/
+            .IgnoreArgument(1)
+            .ExpectedTimesExactly(2);
+        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, MAPPING_STORE))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, Lock_Init());
+        STRICT_EXPECTED_CALL(mocks, Condition_Init());
+        STRICT_EXPECTED_CALL(mocks, ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .IgnoreAllArguments();
+
+        STRICT_EXPECTED_CALL(mocks, PropertyKey_Intern(GW_SOURCE_PROPERTY));
+        STRICT_EXPECTED_CALL(mocks, PropertyKey_Intern(GW_DEVICENAME_PROPERTY));
+        STRICT_EXPECTED_CALL(mocks, PropertyKey_Intern(GW_DEVICEKEY_PROPERTY));
+        STRICT_EXPECTED_CALL(mocks, PropertyKey_Intern(GW_MAC_ADDRESS_PROPERTY));
+
+        ///Act
+        auto n = MODULE_CREATE(theAPIS)(broker, &config);
+
+        ///Assert
+        ASSERT_IS_NOT_NULL(n);
+        mocks.AssertActualAndExpectedCalls();
+        ASSERT_ARE_EQUAL(size_t, (size_t)0, jsonParseFileCount);
+        receive_d2c(theAPIS, n, "01:01:01:01:01:01");
+        receive_d2c(theAPIS, n, "aa:aa:bb:bb:cc:cc");
+        ASSERT_ARE_EQUAL(size_t, (size_t)2, publishCount);
+        receive_d2c(theAPIS, n, "02:02:02:02:02:03");
+        receive_d2c(theAPIS, n, "00:00:00:00:00:00");
+        receive_d2c(theAPIS, n, "FF:FF:FF:FF:FF:FF");
+        ASSERT_ARE_EQUAL(size_t, (size_t)2, publishCount);
+
+        ///Ablution
+        MODULE_DESTROY(theAPIS)(n);
+        Broker_Destroy(broker);
+    }
+
+    /*Tests_SRS_IDMAP_30_014: [ IdentityMap_Receive shall binary search the records of an identity store by MAC address and the record numbers by deviceId, in place. ]*/
+    TEST_FUNCTION(IdentityMap_Receive_C2D_mapping_store_Success)
+    {
+        ///Arrange
+        CIdentitymapMocks mocks;
+        const MODULE_API* theAPIS= Module_GetApi(MODULE_API_VERSION_1);
+        BROKER_HANDLE broker = Broker_Create();
+        IDENTITY_MAP_MODULE_CONFIG config = { NULL, MAPPING_STORE, 0 };
+        write_mapping_store(storeTriplets, 3, IDENTITY_MAP_STORE_VERSION);
+        auto n = MODULE_CREATE(theAPIS)(broker, &config);
+
+        unsigned char fake;
+        MESSAGE_CONFIG cfg = { 1, &fake, (MAP_HANDLE)&fake };
+        auto m = Message_Create(&cfg);
+
+        deviceNameProperties = "Sensor3";
+        sourceProperties = GW_IOTHUB_MODULE;
+
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperties(m));
+        STRICT_EXPECTED_CALL(mocks, ConstMap_Create(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, ConstMap_Destroy(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(m, GW_SOURCE_PROPERTY));
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(m, GW_DEVICENAME_PROPERTY));
+        STRICT_EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG)) /*acquire and release the table*/
+            .IgnoreArgument(1)
+            .ExpectedTimesExactly(2);
+        STRICT_EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
+            .IgnoreArgument(1)
+            .ExpectedTimesExactly(2);
+        STRICT_EXPECTED_CALL(mocks, ConstMap_CloneWriteable(IGNORED_PTR_ARG)).IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, Map_Destroy(IGNORED_PTR_ARG)).IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, Map_AddOrUpdate(IGNORED_PTR_ARG, GW_MAC_ADDRESS_PROPERTY, "AA:AA:BB:BB:CC:CC"))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, Map_AddOrUpdate(IGNORED_PTR_ARG, GW_SOURCE_PROPERTY, GW_IDMAP_MODULE))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, Map_Delete(IGNORED_PTR_ARG, GW_DEVICENAME_PROPERTY))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, Map_Delete(IGNORED_PTR_ARG, GW_DEVICEKEY_PROPERTY))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, Message_GetContentHandle(m));
+        STRICT_EXPECTED_CALL(mocks, Message_CreateFromBuffer(IGNORED_PTR_ARG)).IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, Message_Destroy(IGNORED_PTR_ARG)).IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, CONSTBUFFER_Create(IGNORED_PTR_ARG, IGNORED_NUM_ARG))
+            .IgnoreAllArguments();
+        STRICT_EXPECTED_CALL(mocks, CONSTBUFFER_Destroy(IGNORED_PTR_ARG)).IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, Broker_Publish(broker, n, IGNORED_PTR_ARG))
+            .IgnoreArgument(3);
+
+        ///Act
+        MODULE_RECEIVE(theAPIS)(n, m);
+
+        ///Assert
+        mocks.AssertActualAndExpectedCalls();
+
+        ///Ablution
+        Message_Destroy(m);
+        MODULE_DESTROY(theAPIS)(n);
+        Broker_Destroy(broker);
+    }
+
+    /*Tests_SRS_IDMAP_30_013: [ If the identity store has another version, no record, a size that does not match its header, or strings that do not end with a NUL, the mapping file shall not be loaded. ]*/
+    TEST_FUNCTION(IdentityMap_Create_mapping_store_other_version_fails)
+    {
+        ///Arrange
+        CIdentitymapMocks mocks;
+        const MODULE_API* theAPIS= Module_GetApi(MODULE_API_VERSION_1);
+        BROKER_HANDLE broker = Broker_Create();
+        IDENTITY_MAP_MODULE_CONFIG config = { NULL, MAPPING_STORE, 0 };
+        write_mapping_store(storeTriplets, 3, IDENTITY_MAP_STORE_VERSION + 1);
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, MAPPING_STORE))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)) /*the mapping file name and the module*/
+            .IgnoreArgument(1)
+            .ExpectedTimesExactly(2);
 
         ///Act
-        MODULE_DESTROY(theAPIS)(NULL);
+        auto n = MODULE_CREATE(theAPIS)(broker, &config);
 
         ///Assert
+        ASSERT_IS_NULL(n);
         mocks.AssertActualAndExpectedCalls();
+        ASSERT_ARE_EQUAL(size_t, (size_t)0, jsonParseFileCount);
 
         ///Ablution
+        Broker_Destroy(broker);
     }
 
-    /*Tests_SRS_IDMAP_17_015: [IdentityMap_Destroy shall release all resources allocated for the module.]*/
-    TEST_FUNCTION(IdentityMap_Destroy_2Element)
+    /*Tests_SRS_IDMAP_30_013: [ If the identity store has another version, no record, a size that does not match its header, or strings that do not end with a NUL, the mapping file shall not be loaded. ]*/
+    TEST_FUNCTION(IdentityMap_Create_truncated_mapping_store_fails)
     {
         ///Arrange
         CIdentitymapMocks mocks;
         const MODULE_API* theAPIS= Module_GetApi(MODULE_API_VERSION_1);
         BROKER_HANDLE broker = Broker_Create();
-
-        auto n = MODULE_CREATE(theAPIS)(broker, testVector2);
-
+        IDENTITY_MAP_MODULE_CONFIG config = { NULL, MAPPING_STORE, 0 };
+        IDENTITY_MAP_STORE_HEADER header = { IDENTITY_MAP_STORE_MAGIC, IDENTITY_MAP_STORE_VERSION, 1000000, 100 };
+        FILE* f = fopen(MAPPING_STORE, "wb");
+        ASSERT_IS_NOT_NULL(f);
+        (void)fwrite(&header, sizeof(header), 1, f);
+        (void)fclose(f);
         mocks.ResetAllCalls();
 
-        //1st vector element
-        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
-
-        //2nd vector element
-        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
-
-        //internal struct and module data
-        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, MAPPING_STORE))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)) /*the mapping file name and the module*/
+            .IgnoreArgument(1)
+            .ExpectedTimesExactly(2);
 
         ///Act
-        MODULE_DESTROY(theAPIS)(n);
+        auto n = MODULE_CREATE(theAPIS)(broker, &config);
 
         ///Assert
+        ASSERT_IS_NULL(n);
         mocks.AssertActualAndExpectedCalls();
 
         ///Ablution
         Broker_Destroy(broker);
-
     }
 
     /*Tests_SRS_IDMAP_17_020: [If moduleHandle or messageHandle is NULL, then the function shall return.]*/
@@ -2093,18 +2812,14 @@ BEGIN_TEST_SUITE(idmap_ut)
 
         unsigned char fake;
         BROKER_HANDLE broker = Broker_Create();
-        auto n = MODULE_CREATE(theAPIS)(broker, testVector2);
+        auto n = MODULE_CREATE(theAPIS)(broker, &testConfig2);
 
         MESSAGE_CONFIG cfg = { 1, &fake, (MAP_HANDLE)&fake };
         auto m = Message_Create(&cfg);
 
         mocks.ResetAllCalls();
 
-        STRICT_EXPECTED_CALL(mocks, Message_GetProperties(m));
-        STRICT_EXPECTED_CALL(mocks, ConstMap_Create(IGNORED_PTR_ARG)).IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, ConstMap_Destroy(IGNORED_PTR_ARG)).IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_SOURCE_PROPERTY))
-            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(m, GW_SOURCE_PROPERTY));
 
 
         ///Act
@@ -2128,7 +2843,7 @@ BEGIN_TEST_SUITE(idmap_ut)
 
         unsigned char fake;
         BROKER_HANDLE broker = Broker_Create();
-        auto n = MODULE_CREATE(theAPIS)(broker, testVector2);
+        auto n = MODULE_CREATE(theAPIS)(broker, &testConfig2);
 
         MESSAGE_CONFIG cfg = { 1, &fake, (MAP_HANDLE)&fake };
         auto m = Message_Create(&cfg);
@@ -2137,15 +2852,8 @@ BEGIN_TEST_SUITE(idmap_ut)
 
         mocks.ResetAllCalls();
 
-        STRICT_EXPECTED_CALL(mocks, Message_GetProperties(m));
-        STRICT_EXPECTED_CALL(mocks, ConstMap_Create(IGNORED_PTR_ARG)).IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, ConstMap_Destroy(IGNORED_PTR_ARG)).IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_SOURCE_PROPERTY))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_MAC_ADDRESS_PROPERTY))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreAllArguments();
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(m, GW_SOURCE_PROPERTY));
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(m, GW_MAC_ADDRESS_PROPERTY));
 
 
         ///Act
@@ -2170,7 +2878,7 @@ BEGIN_TEST_SUITE(idmap_ut)
 
         unsigned char fake;
         BROKER_HANDLE broker = Broker_Create();
-        auto n = MODULE_CREATE(theAPIS)(broker, testVector2);
+        auto n = MODULE_CREATE(theAPIS)(broker, &testConfig2);
 
         MESSAGE_CONFIG cfg = { 1, &fake, (MAP_HANDLE)&fake };
         auto m = Message_Create(&cfg);
@@ -2182,20 +2890,10 @@ BEGIN_TEST_SUITE(idmap_ut)
 
         mocks.ResetAllCalls();
 
-        STRICT_EXPECTED_CALL(mocks, Message_GetProperties(m));
-        STRICT_EXPECTED_CALL(mocks, ConstMap_Create(IGNORED_PTR_ARG)).IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, ConstMap_Destroy(IGNORED_PTR_ARG)).IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_SOURCE_PROPERTY))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_MAC_ADDRESS_PROPERTY))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreAllArguments();
-        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_DEVICENAME_PROPERTY))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_DEVICEKEY_PROPERTY))
-            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(m, GW_SOURCE_PROPERTY));
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(m, GW_MAC_ADDRESS_PROPERTY));
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(m, GW_DEVICENAME_PROPERTY));
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(m, GW_DEVICEKEY_PROPERTY));
 
 
         ///Act
@@ -2220,7 +2918,7 @@ BEGIN_TEST_SUITE(idmap_ut)
 
         unsigned char fake;
         BROKER_HANDLE broker = Broker_Create();
-        auto n = MODULE_CREATE(theAPIS)(broker, testVector2);
+        auto n = MODULE_CREATE(theAPIS)(broker, &testConfig2);
 
         MESSAGE_CONFIG cfg = { 1, &fake, (MAP_HANDLE)&fake };
         auto m = Message_Create(&cfg);
@@ -2232,20 +2930,10 @@ BEGIN_TEST_SUITE(idmap_ut)
 
         mocks.ResetAllCalls();
 
-        STRICT_EXPECTED_CALL(mocks, Message_GetProperties(m));
-        STRICT_EXPECTED_CALL(mocks, ConstMap_Create(IGNORED_PTR_ARG)).IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, ConstMap_Destroy(IGNORED_PTR_ARG)).IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_SOURCE_PROPERTY))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_MAC_ADDRESS_PROPERTY))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreAllArguments();
-        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_DEVICENAME_PROPERTY))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_DEVICEKEY_PROPERTY))
-            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(m, GW_SOURCE_PROPERTY));
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(m, GW_MAC_ADDRESS_PROPERTY));
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(m, GW_DEVICENAME_PROPERTY));
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(m, GW_DEVICEKEY_PROPERTY));
 
 
         ///Act
@@ -2271,7 +2959,7 @@ BEGIN_TEST_SUITE(idmap_ut)
 
         unsigned char fake;
         BROKER_HANDLE broker = Broker_Create();
-        auto n = MODULE_CREATE(theAPIS)(broker, testVector2);
+        auto n = MODULE_CREATE(theAPIS)(broker, &testConfig2);
 
         MESSAGE_CONFIG cfg = { 1, &fake, (MAP_HANDLE)&fake };
         auto m = Message_Create(&cfg);
@@ -2282,20 +2970,10 @@ BEGIN_TEST_SUITE(idmap_ut)
 
         mocks.ResetAllCalls();
 
-        STRICT_EXPECTED_CALL(mocks, Message_GetProperties(m));
-        STRICT_EXPECTED_CALL(mocks, ConstMap_Create(IGNORED_PTR_ARG)).IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, ConstMap_Destroy(IGNORED_PTR_ARG)).IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_SOURCE_PROPERTY))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_MAC_ADDRESS_PROPERTY))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreAllArguments();
-        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_DEVICENAME_PROPERTY))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_DEVICEKEY_PROPERTY))
-            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(m, GW_SOURCE_PROPERTY));
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(m, GW_MAC_ADDRESS_PROPERTY));
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(m, GW_DEVICENAME_PROPERTY));
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(m, GW_DEVICEKEY_PROPERTY));
 
 
 
@@ -2321,7 +2999,7 @@ BEGIN_TEST_SUITE(idmap_ut)
 
         unsigned char fake;
         BROKER_HANDLE broker = Broker_Create();
-        auto n = MODULE_CREATE(theAPIS)(broker, testVector1);
+        auto n = MODULE_CREATE(theAPIS)(broker, &testConfig1);
 
         MESSAGE_CONFIG cfg = { 1, &fake, (MAP_HANDLE)&fake };
         auto m = Message_Create(&cfg);
@@ -2332,20 +3010,10 @@ BEGIN_TEST_SUITE(idmap_ut)
 
         mocks.ResetAllCalls();
 
-        STRICT_EXPECTED_CALL(mocks, Message_GetProperties(m));
-        STRICT_EXPECTED_CALL(mocks, ConstMap_Create(IGNORED_PTR_ARG)).IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, ConstMap_Destroy(IGNORED_PTR_ARG)).IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_SOURCE_PROPERTY))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_MAC_ADDRESS_PROPERTY))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreAllArguments();
-        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_DEVICENAME_PROPERTY))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_DEVICEKEY_PROPERTY))
-            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(m, GW_SOURCE_PROPERTY));
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(m, GW_MAC_ADDRESS_PROPERTY));
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(m, GW_DEVICENAME_PROPERTY));
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(m, GW_DEVICEKEY_PROPERTY));
 
 
         ///Act
@@ -2370,7 +3038,7 @@ BEGIN_TEST_SUITE(idmap_ut)
 
         unsigned char fake;
         BROKER_HANDLE broker = Broker_Create();
-        auto n = MODULE_CREATE(theAPIS)(broker, testVector2);
+        auto n = MODULE_CREATE(theAPIS)(broker, &testConfig2);
 
         MESSAGE_CONFIG cfg = { 1, &fake, (MAP_HANDLE)&fake };
         auto m = Message_Create(&cfg);
@@ -2380,20 +3048,11 @@ BEGIN_TEST_SUITE(idmap_ut)
 
         mocks.ResetAllCalls();
 
-        STRICT_EXPECTED_CALL(mocks, Message_GetProperties(m));
-        STRICT_EXPECTED_CALL(mocks, ConstMap_Create(IGNORED_PTR_ARG)).IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, ConstMap_Destroy(IGNORED_PTR_ARG)).IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_SOURCE_PROPERTY))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_MAC_ADDRESS_PROPERTY))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreAllArguments();
-        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_DEVICENAME_PROPERTY))
-            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(m, GW_SOURCE_PROPERTY));
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(m, GW_MAC_ADDRESS_PROPERTY));
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(m, GW_DEVICENAME_PROPERTY));
 
-        whenShallMessage_fail = 2;
+        whenShallMessage_fail = 1;
         STRICT_EXPECTED_CALL(mocks, Message_GetProperties(m));
 
 
@@ -2419,7 +3078,7 @@ BEGIN_TEST_SUITE(idmap_ut)
 
         unsigned char fake;
         BROKER_HANDLE broker = Broker_Create();
-        auto n = MODULE_CREATE(theAPIS)(broker, testVector2);
+        auto n = MODULE_CREATE(theAPIS)(broker, &testConfig2);
 
         MESSAGE_CONFIG cfg = { 1, &fake, (MAP_HANDLE)&fake };
         auto m = Message_Create(&cfg);
@@ -2430,18 +3089,9 @@ BEGIN_TEST_SUITE(idmap_ut)
         mocks.ResetAllCalls();
 
 
-        STRICT_EXPECTED_CALL(mocks, Message_GetProperties(m));
-        STRICT_EXPECTED_CALL(mocks, ConstMap_Create(IGNORED_PTR_ARG)).IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, ConstMap_Destroy(IGNORED_PTR_ARG)).IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_SOURCE_PROPERTY))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_MAC_ADDRESS_PROPERTY))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreAllArguments();
-        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_DEVICENAME_PROPERTY))
-            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(m, GW_SOURCE_PROPERTY));
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(m, GW_MAC_ADDRESS_PROPERTY));
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(m, GW_DEVICENAME_PROPERTY));
         STRICT_EXPECTED_CALL(mocks, Message_GetProperties(m));
         whenShallConstMap_CloneWriteable_fail = 1;
         STRICT_EXPECTED_CALL(mocks, ConstMap_CloneWriteable(IGNORED_PTR_ARG)).IgnoreArgument(1);
@@ -2471,7 +3121,7 @@ BEGIN_TEST_SUITE(idmap_ut)
 
         unsigned char fake;
         BROKER_HANDLE broker = Broker_Create();
-        auto n = MODULE_CREATE(theAPIS)(broker, testVector2);
+        auto n = MODULE_CREATE(theAPIS)(broker, &testConfig2);
 
         MESSAGE_CONFIG cfg = { 1, &fake, (MAP_HANDLE)&fake };
         auto m = Message_Create(&cfg);
@@ -2482,18 +3132,9 @@ BEGIN_TEST_SUITE(idmap_ut)
         mocks.ResetAllCalls();
 
 
-        STRICT_EXPECTED_CALL(mocks, Message_GetProperties(m));
-        STRICT_EXPECTED_CALL(mocks, ConstMap_Create(IGNORED_PTR_ARG)).IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, ConstMap_Destroy(IGNORED_PTR_ARG)).IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_SOURCE_PROPERTY))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_MAC_ADDRESS_PROPERTY))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreAllArguments();
-        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_DEVICENAME_PROPERTY))
-            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(m, GW_SOURCE_PROPERTY));
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(m, GW_MAC_ADDRESS_PROPERTY));
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(m, GW_DEVICENAME_PROPERTY));
         STRICT_EXPECTED_CALL(mocks, Message_GetProperties(m));
 
         STRICT_EXPECTED_CALL(mocks, ConstMap_CloneWriteable(IGNORED_PTR_ARG)).IgnoreArgument(1);
@@ -2528,7 +3169,7 @@ BEGIN_TEST_SUITE(idmap_ut)
 
         unsigned char fake;
         BROKER_HANDLE broker = Broker_Create();
-        auto n = MODULE_CREATE(theAPIS)(broker, testVector2);
+        auto n = MODULE_CREATE(theAPIS)(broker, &testConfig2);
 
         MESSAGE_CONFIG cfg = { 1, &fake, (MAP_HANDLE)&fake };
         auto m = Message_Create(&cfg);
@@ -2539,18 +3180,9 @@ BEGIN_TEST_SUITE(idmap_ut)
         mocks.ResetAllCalls();
 
 
-        STRICT_EXPECTED_CALL(mocks, Message_GetProperties(m));
-        STRICT_EXPECTED_CALL(mocks, ConstMap_Create(IGNORED_PTR_ARG)).IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, ConstMap_Destroy(IGNORED_PTR_ARG)).IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_SOURCE_PROPERTY))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_MAC_ADDRESS_PROPERTY))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreAllArguments();
-        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_DEVICENAME_PROPERTY))
-            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(m, GW_SOURCE_PROPERTY));
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(m, GW_MAC_ADDRESS_PROPERTY));
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(m, GW_DEVICENAME_PROPERTY));
         STRICT_EXPECTED_CALL(mocks, Message_GetProperties(m));
         STRICT_EXPECTED_CALL(mocks, ConstMap_Create(IGNORED_PTR_ARG)).IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, ConstMap_Destroy(IGNORED_PTR_ARG)).IgnoreArgument(1);
@@ -2585,7 +3217,7 @@ BEGIN_TEST_SUITE(idmap_ut)
 
         unsigned char fake;
         BROKER_HANDLE broker = Broker_Create();
-        auto n = MODULE_CREATE(theAPIS)(broker, testVector2);
+        auto n = MODULE_CREATE(theAPIS)(broker, &testConfig2);
 
         MESSAGE_CONFIG cfg = { 1, &fake, (MAP_HANDLE)&fake };
         auto m = Message_Create(&cfg);
@@ -2596,18 +3228,9 @@ BEGIN_TEST_SUITE(idmap_ut)
         mocks.ResetAllCalls();
 
 
-        STRICT_EXPECTED_CALL(mocks, Message_GetProperties(m));
-        STRICT_EXPECTED_CALL(mocks, ConstMap_Create(IGNORED_PTR_ARG)).IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, ConstMap_Destroy(IGNORED_PTR_ARG)).IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_SOURCE_PROPERTY))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_MAC_ADDRESS_PROPERTY))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreAllArguments();
-        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_DEVICENAME_PROPERTY))
-            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(m, GW_SOURCE_PROPERTY));
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(m, GW_MAC_ADDRESS_PROPERTY));
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(m, GW_DEVICENAME_PROPERTY));
         STRICT_EXPECTED_CALL(mocks, Message_GetProperties(m));
         STRICT_EXPECTED_CALL(mocks, ConstMap_Create(IGNORED_PTR_ARG)).IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, ConstMap_Destroy(IGNORED_PTR_ARG)).IgnoreArgument(1);
@@ -2642,7 +3265,7 @@ BEGIN_TEST_SUITE(idmap_ut)
 
         unsigned char fake;
         BROKER_HANDLE broker = Broker_Create();
-        auto n = MODULE_CREATE(theAPIS)(broker, testVector2);
+        auto n = MODULE_CREATE(theAPIS)(broker, &testConfig2);
 
         MESSAGE_CONFIG cfg = { 1, &fake, (MAP_HANDLE)&fake };
         auto m = Message_Create(&cfg);
@@ -2653,18 +3276,9 @@ BEGIN_TEST_SUITE(idmap_ut)
         mocks.ResetAllCalls();
 
 
-        STRICT_EXPECTED_CALL(mocks, Message_GetProperties(m));
-        STRICT_EXPECTED_CALL(mocks, ConstMap_Create(IGNORED_PTR_ARG)).IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, ConstMap_Destroy(IGNORED_PTR_ARG)).IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_SOURCE_PROPERTY))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_MAC_ADDRESS_PROPERTY))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreAllArguments();
-        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_DEVICENAME_PROPERTY))
-            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(m, GW_SOURCE_PROPERTY));
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(m, GW_MAC_ADDRESS_PROPERTY));
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(m, GW_DEVICENAME_PROPERTY));
         STRICT_EXPECTED_CALL(mocks, Message_GetProperties(m));
         STRICT_EXPECTED_CALL(mocks, ConstMap_Create(IGNORED_PTR_ARG)).IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, ConstMap_Destroy(IGNORED_PTR_ARG)).IgnoreArgument(1);
@@ -2675,7 +3289,7 @@ BEGIN_TEST_SUITE(idmap_ut)
         STRICT_EXPECTED_CALL(mocks, Map_AddOrUpdate(IGNORED_PTR_ARG, GW_SOURCE_PROPERTY, GW_IDMAP_MODULE)).IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, Map_Delete(IGNORED_PTR_ARG, GW_MAC_ADDRESS_PROPERTY))
             .IgnoreArgument(1);
-        whenShallMessage_fail = 3;
+        whenShallMessage_fail = 2;
         STRICT_EXPECTED_CALL(mocks, Message_GetContentHandle(m));
 
 
@@ -2702,7 +3316,7 @@ BEGIN_TEST_SUITE(idmap_ut)
 
         unsigned char fake;
         BROKER_HANDLE broker = Broker_Create();
-        auto n = MODULE_CREATE(theAPIS)(broker, testVector2);
+        auto n = MODULE_CREATE(theAPIS)(broker, &testConfig2);
 
         MESSAGE_CONFIG cfg = { 1, &fake, (MAP_HANDLE)&fake };
         auto m = Message_Create(&cfg);
@@ -2713,18 +3327,9 @@ BEGIN_TEST_SUITE(idmap_ut)
         mocks.ResetAllCalls();
 
 
-        STRICT_EXPECTED_CALL(mocks, Message_GetProperties(m));
-        STRICT_EXPECTED_CALL(mocks, ConstMap_Create(IGNORED_PTR_ARG)).IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, ConstMap_Destroy(IGNORED_PTR_ARG)).IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_SOURCE_PROPERTY))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_MAC_ADDRESS_PROPERTY))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreAllArguments();
-        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_DEVICENAME_PROPERTY))
-            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(m, GW_SOURCE_PROPERTY));
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(m, GW_MAC_ADDRESS_PROPERTY));
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(m, GW_DEVICENAME_PROPERTY));
         STRICT_EXPECTED_CALL(mocks, Message_GetProperties(m));
         STRICT_EXPECTED_CALL(mocks, ConstMap_Create(IGNORED_PTR_ARG)).IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, ConstMap_Destroy(IGNORED_PTR_ARG)).IgnoreArgument(1);
@@ -2739,7 +3344,7 @@ BEGIN_TEST_SUITE(idmap_ut)
         STRICT_EXPECTED_CALL(mocks, Map_Delete(IGNORED_PTR_ARG, GW_MAC_ADDRESS_PROPERTY))
             .IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, Message_GetContentHandle(m));
-        whenShallMessage_fail = 4;
+        whenShallMessage_fail = 3;
         STRICT_EXPECTED_CALL(mocks, Message_CreateFromBuffer(IGNORED_PTR_ARG)).IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, CONSTBUFFER_Create(IGNORED_PTR_ARG, IGNORED_NUM_ARG))
             .IgnoreAllArguments();
@@ -2769,7 +3374,7 @@ BEGIN_TEST_SUITE(idmap_ut)
 
         unsigned char fake;
         BROKER_HANDLE broker = Broker_Create();
-        auto n = MODULE_CREATE(theAPIS)(broker, testVector2);
+        auto n = MODULE_CREATE(theAPIS)(broker, &testConfig2);
 
         MESSAGE_CONFIG cfg = { 1, &fake, (MAP_HANDLE)&fake };
         auto m = Message_Create(&cfg);
@@ -2781,18 +3386,9 @@ BEGIN_TEST_SUITE(idmap_ut)
 
 
 
-        STRICT_EXPECTED_CALL(mocks, Message_GetProperties(m));
-        STRICT_EXPECTED_CALL(mocks, ConstMap_Create(IGNORED_PTR_ARG)).IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, ConstMap_Destroy(IGNORED_PTR_ARG)).IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_SOURCE_PROPERTY))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_MAC_ADDRESS_PROPERTY))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreAllArguments();
-        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_DEVICENAME_PROPERTY))
-            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(m, GW_SOURCE_PROPERTY));
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(m, GW_MAC_ADDRESS_PROPERTY));
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(m, GW_DEVICENAME_PROPERTY));
         STRICT_EXPECTED_CALL(mocks, Message_GetProperties(m));
         STRICT_EXPECTED_CALL(mocks, ConstMap_Create(IGNORED_PTR_ARG)).IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, ConstMap_Destroy(IGNORED_PTR_ARG)).IgnoreArgument(1);
@@ -2860,7 +3456,8 @@ BEGIN_TEST_SUITE(idmap_ut)
         VECTOR_push_back(v, &c7, 1);
         VECTOR_push_back(v, &c8, 1);
         VECTOR_push_back(v, &c9, 1);
-        auto n = MODULE_CREATE(theAPIS)(broker, v);
+        IDENTITY_MAP_MODULE_CONFIG config = { v, NULL, 0 };
+        auto n = MODULE_CREATE(theAPIS)(broker, &config);
 
         MESSAGE_CONFIG cfg = { 1, &fake, (MAP_HANDLE)&fake };
         auto m = Message_Create(&cfg);
@@ -2871,18 +3468,9 @@ BEGIN_TEST_SUITE(idmap_ut)
         mocks.ResetAllCalls();
 
 
-        STRICT_EXPECTED_CALL(mocks, Message_GetProperties(m));
-        STRICT_EXPECTED_CALL(mocks, ConstMap_Create(IGNORED_PTR_ARG)).IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, ConstMap_Destroy(IGNORED_PTR_ARG)).IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_SOURCE_PROPERTY))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_MAC_ADDRESS_PROPERTY))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreAllArguments();
-        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_DEVICENAME_PROPERTY))
-            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(m, GW_SOURCE_PROPERTY));
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(m, GW_MAC_ADDRESS_PROPERTY));
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(m, GW_DEVICENAME_PROPERTY));
         STRICT_EXPECTED_CALL(mocks, Message_GetProperties(m));
         STRICT_EXPECTED_CALL(mocks, ConstMap_Create(IGNORED_PTR_ARG)).IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, ConstMap_Destroy(IGNORED_PTR_ARG)).IgnoreArgument(1);
@@ -2921,6 +3509,7 @@ BEGIN_TEST_SUITE(idmap_ut)
     /*Tests_SRS_IDMAP_17_036: [IdentityMap_Receive shall create a new message by calling Message_Create with new map and cloned content.]*/
     /*Tests_SRS_IDMAP_17_038: [IdentityMap_Receive shall call Broker_Publish with broker and new message.]*/
     /*Tests_SRS_IDMAP_17_039: [IdentityMap_Receive will destroy all resources it created.]*/
+    /*Tests_SRS_IDMAP_30_016: [ IdentityMap_Receive shall read the properties of messageHandle by calling Message_GetProperty with the interned keys. ]*/
     TEST_FUNCTION(IdentityMap_Receive_D2C_Success)
     {
         ///Arrange
@@ -2950,7 +3539,8 @@ BEGIN_TEST_SUITE(idmap_ut)
         VECTOR_push_back(v, &c7, 1);
         VECTOR_push_back(v, &c8, 1);
         VECTOR_push_back(v, &c9, 1);
-        auto n = MODULE_CREATE(theAPIS)(broker, v);
+        IDENTITY_MAP_MODULE_CONFIG config = { v, NULL, 0 };
+        auto n = MODULE_CREATE(theAPIS)(broker, &config);
 
         MESSAGE_CONFIG cfg = { 1, &fake, (MAP_HANDLE)&fake };
         auto m = Message_Create(&cfg);
@@ -2961,18 +3551,9 @@ BEGIN_TEST_SUITE(idmap_ut)
         mocks.ResetAllCalls();
 
 
-        STRICT_EXPECTED_CALL(mocks, Message_GetProperties(m));
-        STRICT_EXPECTED_CALL(mocks, ConstMap_Create(IGNORED_PTR_ARG)).IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, ConstMap_Destroy(IGNORED_PTR_ARG)).IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_SOURCE_PROPERTY))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_MAC_ADDRESS_PROPERTY))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreAllArguments();
-        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_DEVICENAME_PROPERTY))
-            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(m, GW_SOURCE_PROPERTY));
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(m, GW_MAC_ADDRESS_PROPERTY));
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(m, GW_DEVICENAME_PROPERTY));
         STRICT_EXPECTED_CALL(mocks, Message_GetProperties(m));
         STRICT_EXPECTED_CALL(mocks, ConstMap_Create(IGNORED_PTR_ARG)).IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, ConstMap_Destroy(IGNORED_PTR_ARG)).IgnoreArgument(1);
@@ -3009,6 +3590,30 @@ BEGIN_TEST_SUITE(idmap_ut)
 
     }
 
+    /*Tests_SRS_IDMAP_30_011: [ IdentityMap_Receive shall read the message macAddress as a 48 bit number, whatever the case of its digits, without allocating memory. ]*/
+    TEST_FUNCTION(IdentityMap_Receive_D2C_any_case_mac_Success)
+    {
+        ///Arrange
+        CIdentitymapMocks mocks;
+        const MODULE_API* theAPIS= Module_GetApi(MODULE_API_VERSION_1);
+        BROKER_HANDLE broker = Broker_Create();
+        auto n = MODULE_CREATE(theAPIS)(broker, &testConfig2);
+        size_t strdupCalls = currentStrdup_call;
+
+        ///Act
+        receive_d2c(theAPIS, n, "AA:aa:BB:bb:CC:cc");
+        receive_d2c(theAPIS, n, "aa:aa:bb:bb:cc:bb");
+        receive_d2c(theAPIS, n, "aa:aa:bb:bb:cc:dd");
+
+        ///Assert
+        ASSERT_ARE_EQUAL(size_t, (size_t)2, publishCount);
+        ASSERT_ARE_EQUAL(size_t, strdupCalls, currentStrdup_call);
+
+        ///Ablution
+        MODULE_DESTROY(theAPIS)(n);
+        Broker_Destroy(broker);
+    }
+
     //Tests_SRS_IDMAP_17_049: [ On a C2D message received, IdentityMap_Receive shall call ConstMap_CloneWriteable on the message properties. ]
     //Tests_SRS_IDMAP_17_051: [ IdentityMap_Receive shall call Map_AddOrUpdate with key of "macAddress" and value of found macAddress. ]
     //Tests_SRS_IDMAP_17_055: [ IdentityMap_Receive shall call Map_Delete to remove the "deviceName" property. ]
@@ -3046,7 +3651,8 @@ BEGIN_TEST_SUITE(idmap_ut)
         VECTOR_push_back(v, &c7, 1);
         VECTOR_push_back(v, &c8, 1);
         VECTOR_push_back(v, &c9, 1);
-        auto n = MODULE_CREATE(theAPIS)(broker, v);
+        IDENTITY_MAP_MODULE_CONFIG config = { v, NULL, 0 };
+        auto n = MODULE_CREATE(theAPIS)(broker, &config);
 
         MESSAGE_CONFIG cfg = { 1, &fake, (MAP_HANDLE)&fake };
         auto m = Message_Create(&cfg);
@@ -3057,13 +3663,8 @@ BEGIN_TEST_SUITE(idmap_ut)
         mocks.ResetAllCalls();
 
 
-        STRICT_EXPECTED_CALL(mocks, Message_GetProperties(m));
-        STRICT_EXPECTED_CALL(mocks, ConstMap_Create(IGNORED_PTR_ARG)).IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, ConstMap_Destroy(IGNORED_PTR_ARG)).IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_SOURCE_PROPERTY))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_DEVICENAME_PROPERTY))
-            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(m, GW_SOURCE_PROPERTY));
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(m, GW_DEVICENAME_PROPERTY));
             
         STRICT_EXPECTED_CALL(mocks, Message_GetProperties(m));
         STRICT_EXPECTED_CALL(mocks, ConstMap_Create(IGNORED_PTR_ARG)).IgnoreArgument(1);
@@ -3131,7 +3732,8 @@ BEGIN_TEST_SUITE(idmap_ut)
         VECTOR_push_back(v, &c7, 1);
         VECTOR_push_back(v, &c8, 1);
         VECTOR_push_back(v, &c9, 1);
-        auto n = MODULE_CREATE(theAPIS)(broker, v);
+        IDENTITY_MAP_MODULE_CONFIG config = { v, NULL, 0 };
+        auto n = MODULE_CREATE(theAPIS)(broker, &config);
 
         MESSAGE_CONFIG cfg = { 1, &fake, (MAP_HANDLE)&fake };
         auto m = Message_Create(&cfg);
@@ -3142,13 +3744,8 @@ BEGIN_TEST_SUITE(idmap_ut)
         mocks.ResetAllCalls();
 
 
-        STRICT_EXPECTED_CALL(mocks, Message_GetProperties(m));
-        STRICT_EXPECTED_CALL(mocks, ConstMap_Create(IGNORED_PTR_ARG)).IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, ConstMap_Destroy(IGNORED_PTR_ARG)).IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_SOURCE_PROPERTY))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_DEVICENAME_PROPERTY))
-            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(m, GW_SOURCE_PROPERTY));
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(m, GW_DEVICENAME_PROPERTY));
 
         STRICT_EXPECTED_CALL(mocks, Message_GetProperties(m));
         STRICT_EXPECTED_CALL(mocks, ConstMap_Create(IGNORED_PTR_ARG)).IgnoreArgument(1);
@@ -3217,7 +3814,8 @@ BEGIN_TEST_SUITE(idmap_ut)
         VECTOR_push_back(v, &c7, 1);
         VECTOR_push_back(v, &c8, 1);
         VECTOR_push_back(v, &c9, 1);
-        auto n = MODULE_CREATE(theAPIS)(broker, v);
+        IDENTITY_MAP_MODULE_CONFIG config = { v, NULL, 0 };
+        auto n = MODULE_CREATE(theAPIS)(broker, &config);
 
         MESSAGE_CONFIG cfg = { 1, &fake, (MAP_HANDLE)&fake };
         auto m = Message_Create(&cfg);
@@ -3228,13 +3826,8 @@ BEGIN_TEST_SUITE(idmap_ut)
         mocks.ResetAllCalls();
 
 
-        STRICT_EXPECTED_CALL(mocks, Message_GetProperties(m));
-        STRICT_EXPECTED_CALL(mocks, ConstMap_Create(IGNORED_PTR_ARG)).IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, ConstMap_Destroy(IGNORED_PTR_ARG)).IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_SOURCE_PROPERTY))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_DEVICENAME_PROPERTY))
-            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(m, GW_SOURCE_PROPERTY));
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(m, GW_DEVICENAME_PROPERTY));
 
         STRICT_EXPECTED_CALL(mocks, Message_GetProperties(m));
         STRICT_EXPECTED_CALL(mocks, ConstMap_Create(IGNORED_PTR_ARG)).IgnoreArgument(1);
@@ -3294,7 +3887,8 @@ BEGIN_TEST_SUITE(idmap_ut)
         VECTOR_push_back(v, &c7, 1);
         VECTOR_push_back(v, &c8, 1);
         VECTOR_push_back(v, &c9, 1);
-        auto n = MODULE_CREATE(theAPIS)(broker, v);
+        IDENTITY_MAP_MODULE_CONFIG config = { v, NULL, 0 };
+        auto n = MODULE_CREATE(theAPIS)(broker, &config);
 
         MESSAGE_CONFIG cfg = { 1, &fake, (MAP_HANDLE)&fake };
         auto m = Message_Create(&cfg);
@@ -3305,13 +3899,8 @@ BEGIN_TEST_SUITE(idmap_ut)
         mocks.ResetAllCalls();
 
 
-        STRICT_EXPECTED_CALL(mocks, Message_GetProperties(m));
-        STRICT_EXPECTED_CALL(mocks, ConstMap_Create(IGNORED_PTR_ARG)).IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, ConstMap_Destroy(IGNORED_PTR_ARG)).IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_SOURCE_PROPERTY))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_DEVICENAME_PROPERTY))
-            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(m, GW_SOURCE_PROPERTY));
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(m, GW_DEVICENAME_PROPERTY));
 
         STRICT_EXPECTED_CALL(mocks, Message_GetProperties(m));
         STRICT_EXPECTED_CALL(mocks, ConstMap_Create(IGNORED_PTR_ARG)).IgnoreArgument(1);
@@ -3369,7 +3958,8 @@ BEGIN_TEST_SUITE(idmap_ut)
         VECTOR_push_back(v, &c7, 1);
         VECTOR_push_back(v, &c8, 1);
         VECTOR_push_back(v, &c9, 1);
-        auto n = MODULE_CREATE(theAPIS)(broker, v);
+        IDENTITY_MAP_MODULE_CONFIG config = { v, NULL, 0 };
+        auto n = MODULE_CREATE(theAPIS)(broker, &config);
 
         MESSAGE_CONFIG cfg = { 1, &fake, (MAP_HANDLE)&fake };
         auto m = Message_Create(&cfg);
@@ -3380,13 +3970,8 @@ BEGIN_TEST_SUITE(idmap_ut)
         mocks.ResetAllCalls();
 
 
-        STRICT_EXPECTED_CALL(mocks, Message_GetProperties(m));
-        STRICT_EXPECTED_CALL(mocks, ConstMap_Create(IGNORED_PTR_ARG)).IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, ConstMap_Destroy(IGNORED_PTR_ARG)).IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_SOURCE_PROPERTY))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_DEVICENAME_PROPERTY))
-            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(m, GW_SOURCE_PROPERTY));
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(m, GW_DEVICENAME_PROPERTY));
 
         STRICT_EXPECTED_CALL(mocks, Message_GetProperties(m));
         STRICT_EXPECTED_CALL(mocks, ConstMap_Create(IGNORED_PTR_ARG)).IgnoreArgument(1);
@@ -3446,7 +4031,8 @@ BEGIN_TEST_SUITE(idmap_ut)
         VECTOR_push_back(v, &c7, 1);
         VECTOR_push_back(v, &c8, 1);
         VECTOR_push_back(v, &c9, 1);
-        auto n = MODULE_CREATE(theAPIS)(broker, v);
+        IDENTITY_MAP_MODULE_CONFIG config = { v, NULL, 0 };
+        auto n = MODULE_CREATE(theAPIS)(broker, &config);
 
         MESSAGE_CONFIG cfg = { 1, &fake, (MAP_HANDLE)&fake };
         auto m = Message_Create(&cfg);
@@ -3457,13 +4043,8 @@ BEGIN_TEST_SUITE(idmap_ut)
         mocks.ResetAllCalls();
 
 
-        STRICT_EXPECTED_CALL(mocks, Message_GetProperties(m));
-        STRICT_EXPECTED_CALL(mocks, ConstMap_Create(IGNORED_PTR_ARG)).IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, ConstMap_Destroy(IGNORED_PTR_ARG)).IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_SOURCE_PROPERTY))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_DEVICENAME_PROPERTY))
-            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(m, GW_SOURCE_PROPERTY));
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(m, GW_DEVICENAME_PROPERTY));
 
         STRICT_EXPECTED_CALL(mocks, Message_GetProperties(m));
         STRICT_EXPECTED_CALL(mocks, ConstMap_Create(IGNORED_PTR_ARG)).IgnoreArgument(1);
@@ -3520,7 +4101,8 @@ BEGIN_TEST_SUITE(idmap_ut)
         VECTOR_push_back(v, &c7, 1);
         VECTOR_push_back(v, &c8, 1);
         VECTOR_push_back(v, &c9, 1);
-        auto n = MODULE_CREATE(theAPIS)(broker, v);
+        IDENTITY_MAP_MODULE_CONFIG config = { v, NULL, 0 };
+        auto n = MODULE_CREATE(theAPIS)(broker, &config);
 
         MESSAGE_CONFIG cfg = { 1, &fake, (MAP_HANDLE)&fake };
         auto m = Message_Create(&cfg);
@@ -3531,13 +4113,8 @@ BEGIN_TEST_SUITE(idmap_ut)
         mocks.ResetAllCalls();
 
 
-        STRICT_EXPECTED_CALL(mocks, Message_GetProperties(m));
-        STRICT_EXPECTED_CALL(mocks, ConstMap_Create(IGNORED_PTR_ARG)).IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, ConstMap_Destroy(IGNORED_PTR_ARG)).IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_SOURCE_PROPERTY))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_DEVICENAME_PROPERTY))
-            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(m, GW_SOURCE_PROPERTY));
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(m, GW_DEVICENAME_PROPERTY));
 
         STRICT_EXPECTED_CALL(mocks, Message_GetProperties(m));
         STRICT_EXPECTED_CALL(mocks, ConstMap_Create(IGNORED_PTR_ARG)).IgnoreArgument(1);
@@ -3591,7 +4168,8 @@ BEGIN_TEST_SUITE(idmap_ut)
         VECTOR_push_back(v, &c7, 1);
         VECTOR_push_back(v, &c8, 1);
         VECTOR_push_back(v, &c9, 1);
-        auto n = MODULE_CREATE(theAPIS)(broker, v);
+        IDENTITY_MAP_MODULE_CONFIG config = { v, NULL, 0 };
+        auto n = MODULE_CREATE(theAPIS)(broker, &config);
 
         MESSAGE_CONFIG cfg = { 1, &fake, (MAP_HANDLE)&fake };
         auto m = Message_Create(&cfg);
@@ -3602,13 +4180,8 @@ BEGIN_TEST_SUITE(idmap_ut)
         mocks.ResetAllCalls();
 
 
-        STRICT_EXPECTED_CALL(mocks, Message_GetProperties(m));
-        STRICT_EXPECTED_CALL(mocks, ConstMap_Create(IGNORED_PTR_ARG)).IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, ConstMap_Destroy(IGNORED_PTR_ARG)).IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_SOURCE_PROPERTY))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_DEVICENAME_PROPERTY))
-            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(m, GW_SOURCE_PROPERTY));
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(m, GW_DEVICENAME_PROPERTY));
 
         STRICT_EXPECTED_CALL(mocks, Message_GetProperties(m))
             .SetFailReturn((CONSTMAP_HANDLE)NULL);
@@ -3656,7 +4229,8 @@ BEGIN_TEST_SUITE(idmap_ut)
         VECTOR_push_back(v, &c7, 1);
         VECTOR_push_back(v, &c8, 1);
         VECTOR_push_back(v, &c9, 1);
-        auto n = MODULE_CREATE(theAPIS)(broker, v);
+        IDENTITY_MAP_MODULE_CONFIG config = { v, NULL, 0 };
+        auto n = MODULE_CREATE(theAPIS)(broker, &config);
 
         MESSAGE_CONFIG cfg = { 1, &fake, (MAP_HANDLE)&fake };
         auto m = Message_Create(&cfg);
@@ -3667,13 +4241,8 @@ BEGIN_TEST_SUITE(idmap_ut)
         mocks.ResetAllCalls();
 
 
-        STRICT_EXPECTED_CALL(mocks, Message_GetProperties(m));
-        STRICT_EXPECTED_CALL(mocks, ConstMap_Create(IGNORED_PTR_ARG)).IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, ConstMap_Destroy(IGNORED_PTR_ARG)).IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_SOURCE_PROPERTY))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_DEVICENAME_PROPERTY))
-            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(m, GW_SOURCE_PROPERTY));
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(m, GW_DEVICENAME_PROPERTY));
 
         ///Act
         MODULE_RECEIVE(theAPIS)(n, m);
@@ -3719,7 +4288,8 @@ BEGIN_TEST_SUITE(idmap_ut)
         VECTOR_push_back(v, &c7, 1);
         VECTOR_push_back(v, &c8, 1);
         VECTOR_push_back(v, &c9, 1);
-        auto n = MODULE_CREATE(theAPIS)(broker, v);
+        IDENTITY_MAP_MODULE_CONFIG config = { v, NULL, 0 };
+        auto n = MODULE_CREATE(theAPIS)(broker, &config);
 
         MESSAGE_CONFIG cfg = { 1, &fake, (MAP_HANDLE)&fake };
         auto m = Message_Create(&cfg);
@@ -3730,13 +4300,8 @@ BEGIN_TEST_SUITE(idmap_ut)
         mocks.ResetAllCalls();
 
 
-        STRICT_EXPECTED_CALL(mocks, Message_GetProperties(m));
-        STRICT_EXPECTED_CALL(mocks, ConstMap_Create(IGNORED_PTR_ARG)).IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, ConstMap_Destroy(IGNORED_PTR_ARG)).IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_SOURCE_PROPERTY))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_DEVICENAME_PROPERTY))
-            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(m, GW_SOURCE_PROPERTY));
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(m, GW_DEVICENAME_PROPERTY));
 
         ///Act
         MODULE_RECEIVE(theAPIS)(n, m);
@@ -3781,7 +4346,8 @@ BEGIN_TEST_SUITE(idmap_ut)
         VECTOR_push_back(v, &c7, 1);
         VECTOR_push_back(v, &c8, 1);
         VECTOR_push_back(v, &c9, 1);
-        auto n = MODULE_CREATE(theAPIS)(broker, v);
+        IDENTITY_MAP_MODULE_CONFIG config = { v, NULL, 0 };
+        auto n = MODULE_CREATE(theAPIS)(broker, &config);
 
         MESSAGE_CONFIG cfg = { 1, &fake, (MAP_HANDLE)&fake };
         auto m = Message_Create(&cfg);
@@ -3792,11 +4358,7 @@ BEGIN_TEST_SUITE(idmap_ut)
         mocks.ResetAllCalls();
 
 
-        STRICT_EXPECTED_CALL(mocks, Message_GetProperties(m));
-        STRICT_EXPECTED_CALL(mocks, ConstMap_Create(IGNORED_PTR_ARG)).IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, ConstMap_Destroy(IGNORED_PTR_ARG)).IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_SOURCE_PROPERTY))
-            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(m, GW_SOURCE_PROPERTY));
 
 
         ///Act
@@ -3842,7 +4404,8 @@ BEGIN_TEST_SUITE(idmap_ut)
         VECTOR_push_back(v, &c7, 1);
         VECTOR_push_back(v, &c8, 1);
         VECTOR_push_back(v, &c9, 1);
-        auto n = MODULE_CREATE(theAPIS)(broker, v);
+        IDENTITY_MAP_MODULE_CONFIG config = { v, NULL, 0 };
+        auto n = MODULE_CREATE(theAPIS)(broker, &config);
 
         MESSAGE_CONFIG cfg = { 1, &fake, (MAP_HANDLE)&fake };
         auto m = Message_Create(&cfg);
@@ -3855,11 +4418,7 @@ BEGIN_TEST_SUITE(idmap_ut)
         mocks.ResetAllCalls();
 
 
-        STRICT_EXPECTED_CALL(mocks, Message_GetProperties(m));
-        STRICT_EXPECTED_CALL(mocks, ConstMap_Create(IGNORED_PTR_ARG)).IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, ConstMap_Destroy(IGNORED_PTR_ARG)).IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(IGNORED_PTR_ARG, GW_SOURCE_PROPERTY))
-            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(m, GW_SOURCE_PROPERTY));
 
 
         ///Act
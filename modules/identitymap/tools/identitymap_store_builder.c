@@ -0,0 +1,278 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+/*
+* Builds an identity store (see identitymap_store.h) out of a JSON mapping file, the array of
+* { "macAddress", "deviceId", "deviceKey" } objects the identity map module reads. The module maps
+* the store read-only and searches it in place, so it starts in constant time whatever the size of
+* the registry and every gateway process on the machine shares the same pages.
+*
+* A MAC address mapped twice is an error. To replace the mapping file of a running module, build
+* the store next to it and rename it over the mapping file: the module keeps using the store it
+* mapped until it has loaded the new one, writing into a mapped store would change it under its feet.
+*
+* usage: identitymap_store_builder <mapping.json> <store>
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <ctype.h>
+
+#include <parson.h>
+
+#include "identitymap_store.h"
+
+#define MAC_LENGTH 17
+
+typedef struct BUILDER_ENTRY_TAG
+{
+    uint64_t mac;
+    const char * macAddress;
+    const char * deviceId;
+    const char * deviceKey;
+    uint32_t record;
+} BUILDER_ENTRY;
+
+/*the MAC address must be in the form "XX:XX:XX:XX:XX:XX" X=[0-9,a-f,A-F]*/
+static int parse_mac(const char * macAddress, uint64_t * mac)
+{
+    int result = 0;
+    uint64_t value = 0;
+    size_t i;
+    for (i = 0; i < MAC_LENGTH && result == 0; i++)
+    {
+        char c = macAddress[i];
+        if ((i % 3) == 2)
+        {
+            result = (c == ':') ? 0 : __LINE__;
+        }
+        else if (isxdigit((unsigned char)c))
+        {
+            value = (value << 4) | (uint64_t)(isdigit((unsigned char)c) ? (c - '0') : (toupper((unsigned char)c) - 'A' + 10));
+        }
+        else
+        {
+            result = __LINE__;
+        }
+    }
+    if (result == 0 && macAddress[MAC_LENGTH] != '\0')
+    {
+        result = __LINE__;
+    }
+    else if (result == 0)
+    {
+        *mac = value;
+    }
+    return result;
+}
+
+static int compare_mac(const void * a, const void * b)
+{
+    const BUILDER_ENTRY * entryA = (const BUILDER_ENTRY *)a;
+    const BUILDER_ENTRY * entryB = (const BUILDER_ENTRY *)b;
+    return (entryA->mac < entryB->mac) ? -1 : ((entryA->mac > entryB->mac) ? 1 : 0);
+}
+
+static int compare_device(const void * a, const void * b)
+{
+    const BUILDER_ENTRY * entryA = *(const BUILDER_ENTRY * const *)a;
+    const BUILDER_ENTRY * entryB = *(const BUILDER_ENTRY * const *)b;
+    return strcmp(entryA->deviceId, entryB->deviceId);
+}
+
+/*reads every triplet of the JSON array and sorts them by MAC address*/
+static int read_entries(JSON_Array * mapping, BUILDER_ENTRY * entries, size_t count)
+{
+    int result = 0;
+    size_t i;
+    for (i = 0; i < count && result == 0; i++)
+    {
+        JSON_Object * record = json_array_get_object(mapping, i);
+        if (record == NULL ||
+            (entries[i].macAddress = json_object_get_string(record, "macAddress")) == NULL ||
+            (entries[i].deviceId = json_object_get_string(record, "deviceId")) == NULL ||
+            (entries[i].deviceKey = json_object_get_string(record, "deviceKey")) == NULL)
+        {
+            (void)printf("mapping %lu is not an object with a macAddress, a deviceId and a deviceKey\n", (unsigned long)i);
+            result = __LINE__;
+        }
+        else if (parse_mac(entries[i].macAddress, &entries[i].mac) != 0)
+        {
+            (void)printf("mapping %lu: non-canonical MAC address %s\n", (unsigned long)i, entries[i].macAddress);
+            result = __LINE__;
+        }
+    }
+    if (result == 0)
+    {
+        qsort(entries, count, sizeof(BUILDER_ENTRY), compare_mac);
+        for (i = 1; i < count && result == 0; i++)
+        {
+            if (entries[i].mac == entries[i - 1].mac)
+            {
+                (void)printf("MAC address %s is mapped to %s and to %s\n", entries[i].macAddress, entries[i - 1].deviceId, entries[i].deviceId);
+                result = __LINE__;
+            }
+        }
+    }
+    return result;
+}
+
+static int write_string(FILE * store, const char * value, int upperCase)
+{
+    int result = 0;
+    const char * c;
+    for (c = value; result == 0; c++)
+    {
+        result = (fputc(upperCase ? toupper((unsigned char)*c) : *c, store) == EOF) ? __LINE__ : 0;
+        if (*c == '\0')
+        {
+            break;
+        }
+    }
+    return result;
+}
+
+/*writes the header, the records by MAC address, the record numbers by deviceId and the strings*/
+static int write_store(FILE * store, BUILDER_ENTRY * entries, size_t count)
+{
+    int result;
+    BUILDER_ENTRY ** byDevice = (BUILDER_ENTRY **)malloc(count * sizeof(BUILDER_ENTRY *));
+    if (byDevice == NULL)
+    {
+        (void)printf("unable to allocate the device index\n");
+        result = __LINE__;
+    }
+    else
+    {
+        IDENTITY_MAP_STORE_HEADER header;
+        uint64_t stringsSize = 0;
+        size_t i;
+        for (i = 0; i < count; i++)
+        {
+            entries[i].record = (uint32_t)i;
+            byDevice[i] = &entries[i];
+            stringsSize += (MAC_LENGTH + 1) + strlen(entries[i].deviceId) + 1 + strlen(entries[i].deviceKey) + 1;
+        }
+        qsort(byDevice, count, sizeof(BUILDER_ENTRY *), compare_device);
+
+        header.magic = IDENTITY_MAP_STORE_MAGIC;
+        header.version = IDENTITY_MAP_STORE_VERSION;
+        header.count = (uint32_t)count;
+        header.stringsSize = (uint32_t)stringsSize;
+        if (stringsSize > UINT32_MAX)
+        {
+            (void)printf("the strings of the mapping do not fit in a store\n");
+            result = __LINE__;
+        }
+        else if (fwrite(&header, sizeof(header), 1, store) != 1)
+        {
+            result = __LINE__;
+        }
+        else
+        {
+            uint32_t offset = 0;
+            result = 0;
+            for (i = 0; i < count && result == 0; i++)
+            {
+                IDENTITY_MAP_STORE_RECORD record;
+                record.macHigh = (uint32_t)(entries[i].mac >> 32);
+                record.macLow = (uint32_t)entries[i].mac;
+                record.macAddress = offset;
+                offset += MAC_LENGTH + 1;
+                record.deviceId = offset;
+                offset += (uint32_t)strlen(entries[i].deviceId) + 1;
+                record.deviceKey = offset;
+                offset += (uint32_t)strlen(entries[i].deviceKey) + 1;
+                result = (fwrite(&record, sizeof(record), 1, store) != 1) ? __LINE__ : 0;
+            }
+            for (i = 0; i < count && result == 0; i++)
+            {
+                result = (fwrite(&byDevice[i]->record, sizeof(uint32_t), 1, store) != 1) ? __LINE__ : 0;
+            }
+            for (i = 0; i < count && result == 0; i++)
+            {
+                if (write_string(store, entries[i].macAddress, 1) != 0 ||
+                    write_string(store, entries[i].deviceId, 0) != 0 ||
+                    write_string(store, entries[i].deviceKey, 0) != 0)
+                {
+                    result = __LINE__;
+                }
+            }
+        }
+        free(byDevice);
+    }
+    return result;
+}
+
+int main(int argc, char** argv)
+{
+    int result;
+    JSON_Value * json;
+    JSON_Array * mapping;
+    size_t count;
+    if (argc != 3)
+    {
+        (void)printf("usage: %s <mapping.json> <store>\n", argv[0]);
+        result = 1;
+    }
+    else if ((json = json_parse_file(argv[1])) == NULL)
+    {
+        (void)printf("unable to parse %s\n", argv[1]);
+        result = 1;
+    }
+    else
+    {
+        if ((mapping = json_value_get_array(json)) == NULL)
+        {
+            (void)printf("expected a JSON array in %s\n", argv[1]);
+            result = 1;
+        }
+        else if ((count = json_array_get_count(mapping)) == 0 || count > UINT32_MAX)
+        {
+            (void)printf("%s has %lu mappings\n", argv[1], (unsigned long)count);
+            result = 1;
+        }
+        else
+        {
+            BUILDER_ENTRY * entries = (BUILDER_ENTRY *)malloc(count * sizeof(BUILDER_ENTRY));
+            if (entries == NULL)
+            {
+                (void)printf("unable to allocate %lu mappings\n", (unsigned long)count);
+                result = 1;
+            }
+            else
+            {
+                FILE * store;
+                if (read_entries(mapping, entries, count) != 0)
+                {
+                    result = 1;
+                }
+                else if ((store = fopen(argv[2], "wb")) == NULL)
+                {
+                    (void)printf("unable to create %s\n", argv[2]);
+                    result = 1;
+                }
+                else
+                {
+                    int status = write_store(store, entries, count);
+                    if (fclose(store) != 0 || status != 0)
+                    {
+                        (void)printf("unable to write %s\n", argv[2]);
+                        (void)remove(argv[2]);
+                        result = 1;
+                    }
+                    else
+                    {
+                        (void)printf("%lu mappings written to %s\n", (unsigned long)count, argv[2]);
+                        result = 0;
+                    }
+                }
+                free(entries);
+            }
+        }
+        json_value_free(json);
+    }
+    return result;
+}
@@ -7,6 +7,8 @@
 #include "module.h"
 #include <iothub_client_ll.h>
 
+#define IOTHUB_DEFAULT_BATCH_TIMEOUT_MS 1000
+
 #ifdef __cplusplus
 extern "C"
 {
@@ -17,6 +19,12 @@ typedef struct IOTHUB_CONFIG_TAG
     const char* IoTHubName;
     const char* IoTHubSuffix;
     IOTHUB_CLIENT_TRANSPORT_PROVIDER transportProvider;
+    /*when batchSize is greater than 1, or maxInFlight or maxDevices is not 0, the module is pipelined: messages of a device are sent in batches from a thread of the module*/
+    size_t batchSize; /*messages sent together, 0 or 1 sends each one by itself*/
+    unsigned int batchTimeoutMs; /*how long a batch waits to fill up, 0 means IOTHUB_DEFAULT_BATCH_TIMEOUT_MS*/
+    size_t maxInFlight; /*messages of a device sent and not yet confirmed, 0 means no limit*/
+    size_t maxDevices; /*devices connected at once, the one idle for the longest makes room for a new one. 0 means no limit*/
+    size_t transportCount; /*HTTP and AMQP connections the devices are spread over by device name, 0 means 1. MQTT connects each device by itself*/
 }IOTHUB_CONFIG; /*this needs to be passed to the Module_Create function*/
 
 MODULE_EXPORT const MODULE_API* MODULE_STATIC_GETAPI(IOTHUB_MODULE)(MODULE_API_VERSION gateway_api_version);
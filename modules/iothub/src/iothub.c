@@ -17,6 +17,10 @@
 #include "azure_c_shared_utility/vector.h"
 #include "azure_c_shared_utility/xlogging.h"
 #include "azure_c_shared_utility/strings.h"
+#include "azure_c_shared_utility/lock.h"
+#include "azure_c_shared_utility/condition.h"
+#include "azure_c_shared_utility/threadapi.h"
+#include "azure_c_shared_utility/tickcounter.h"
 #include "messageproperties.h"
 #include "broker.h"
 
@@ -29,6 +33,13 @@ typedef struct PERSONALITY_TAG
     IOTHUB_CLIENT_HANDLE iothubHandle;
     BROKER_HANDLE broker;
     MODULE_HANDLE module;
+    IOTHUB_MESSAGE_HANDLE* batch; /*messages waiting to be sent, batchSize of them at most*/
+    size_t batchCount;
+    tickcounter_ms_t batchStart; /*when the oldest message of the batch arrived*/
+    size_t inFlight; /*messages handed to IoTHubClient and not confirmed yet*/
+    size_t hash; /*of deviceName, see device_name_hash*/
+    struct PERSONALITY_TAG* lruPrev; /*the personality that received a message after this one*/
+    struct PERSONALITY_TAG* lruNext; /*the personality that received a message before this one*/
 }PERSONALITY;
 
 typedef PERSONALITY* PERSONALITY_PTR;
@@ -39,8 +50,27 @@ typedef struct IOTHUB_HANDLE_DATA_TAG
     STRING_HANDLE IoTHubName;
     STRING_HANDLE IoTHubSuffix;
     IOTHUB_CLIENT_TRANSPORT_PROVIDER transportProvider;
-    TRANSPORT_HANDLE transportHandle;
+    TRANSPORT_HANDLE* transports; /*the connections shared by the devices, they follow this structure*/
+    size_t transportCount; /*0 when every device has a connection of its own*/
     BROKER_HANDLE broker;
+    PERSONALITY_PTR* index; /*personalities by device name, NULL until the first device arrives*/
+    size_t indexSize; /*a power of two, at least twice indexCount*/
+    size_t indexCount;
+    PERSONALITY_PTR lruHead; /*the personality that received a message last*/
+    PERSONALITY_PTR lruTail; /*the personality idle for the longest*/
+    size_t maxDevices; /*0 means no limit*/
+    /*the rest is only used when the module is pipelined, that is when batchSize is not 0*/
+    size_t batchSize;
+    unsigned int batchTimeoutMs;
+    size_t maxInFlight;
+    LOCK_HANDLE lock; /*guards the batches, the send windows and the personalities vector*/
+    COND_HANDLE sendCondition; /*a batch is due or a send window opened*/
+    COND_HANDLE roomCondition; /*a batch has room again*/
+    TICK_COUNTER_HANDLE tickCounter;
+    THREAD_HANDLE sendThread;
+    bool stopping;
+    size_t nextPersonality; /*where the send thread looks for a due batch first*/
+    IOTHUB_MESSAGE_HANDLE* sending; /*the batch the send thread is sending, batchSize messages at most*/
 }IOTHUB_HANDLE_DATA;
 
 #define SOURCE "source"
@@ -50,6 +80,13 @@ typedef struct IOTHUB_HANDLE_DATA_TAG
 #define SUFFIX "IoTHubSuffix"
 #define HUBNAME "IoTHubName"
 #define TRANSPORT "Transport"
+#define BATCHSIZE "BatchSize"
+#define BATCHTIMEOUT "BatchTimeoutMs"
+#define MAXINFLIGHT "MaxInFlight"
+#define MAXDEVICES "MaxDevices"
+#define TRANSPORTCOUNT "TransportCount"
+
+#define PERSONALITY_INDEX_MIN_SIZE 16
 
 static int strcmp_i(const char* lhs, const char* rhs)
 {
@@ -165,10 +202,33 @@ static void* IotHub_ParseConfigurationFromJson(const char* configuration)
 
                         if (config != NULL)
                         {
-                            strcpy(name, IoTHubName);
-                            strcpy(suffix, IoTHubSuffix);
-                            config->IoTHubName = name;
-                            config->IoTHubSuffix = suffix;
+                            /*Codes_SRS_IOTHUBMODULE_30_001: [ `IotHub_ParseConfigurationFromJson` shall read the optional numbers "BatchSize", "BatchTimeoutMs", "MaxInFlight", "MaxDevices" and "TransportCount", using 0 for the missing ones. ]*/
+                            double batchSize = json_object_get_number(obj, BATCHSIZE);
+                            double batchTimeoutMs = json_object_get_number(obj, BATCHTIMEOUT);
+                            double maxInFlight = json_object_get_number(obj, MAXINFLIGHT);
+                            double maxDevices = json_object_get_number(obj, MAXDEVICES);
+                            double transportCount = json_object_get_number(obj, TRANSPORTCOUNT);
+                            if (batchSize < 0 || batchTimeoutMs < 0 || maxInFlight < 0 || maxDevices < 0 || transportCount < 0)
+                            {
+                                /*Codes_SRS_IOTHUBMODULE_30_002: [ If "BatchSize", "BatchTimeoutMs", "MaxInFlight", "MaxDevices" or "TransportCount" is negative then `IotHub_ParseConfigurationFromJson` shall fail and return NULL. ]*/
+                                LogError("%s, %s, %s, %s and %s cannot be negative", BATCHSIZE, BATCHTIMEOUT, MAXINFLIGHT, MAXDEVICES, TRANSPORTCOUNT);
+                                free(name);
+                                free(suffix);
+                                free(config);
+                                config = NULL;
+                            }
+                            else
+                            {
+                                strcpy(name, IoTHubName);
+                                strcpy(suffix, IoTHubSuffix);
+                                config->IoTHubName = name;
+                                config->IoTHubSuffix = suffix;
+                                config->batchSize = (size_t)batchSize;
+                                config->batchTimeoutMs = (unsigned int)batchTimeoutMs;
+                                config->maxInFlight = (size_t)maxInFlight;
+                                config->maxDevices = (size_t)maxDevices;
+                                config->transportCount = (size_t)transportCount;
+                            }
                         }
 
                         result = config;
@@ -195,6 +255,311 @@ static void IotHub_FreeConfiguration(void* configuration)
     }
 }
 
+/*how many messages a device may have waiting, 0 when every message is sent as it arrives*/
+static size_t pipeline_batch_size(const IOTHUB_CONFIG* config)
+{
+    size_t result;
+    if (config->batchSize > 1)
+    {
+        result = config->batchSize;
+    }
+    else if (config->maxInFlight > 0 || config->maxDevices > 0)
+    {
+        /*evicting a device needs to know which of its messages are in flight, only the send thread counts them*/
+        result = 1;
+    }
+    else
+    {
+        result = 0;
+    }
+    return result;
+}
+
+/*moves the messages of the next device whose batch is due into handleData->sending, as
+  many as its send window allows, and returns that device. Otherwise returns NULL and
+  sets *waitMs to the time until the next batch is due. Call with the lock held.*/
+static PERSONALITY* take_due_batch(IOTHUB_HANDLE_DATA* handleData, size_t* count, unsigned int* waitMs)
+{
+    PERSONALITY* result = NULL;
+    tickcounter_ms_t now;
+    bool timeKnown = true;
+    size_t personalityCount = VECTOR_size(handleData->personalities);
+    size_t i;
+
+    *waitMs = handleData->batchTimeoutMs;
+    if (tickcounter_get_current_ms(handleData->tickCounter, &now) != 0)
+    {
+        /*better early than never*/
+        LogError("unable to tickcounter_get_current_ms, sending every batch");
+        timeKnown = false;
+    }
+
+    for (i = 0; i < personalityCount && result == NULL; i++)
+    {
+        size_t index = (handleData->nextPersonality + i) % personalityCount;
+        PERSONALITY* personality = *(PERSONALITY_PTR*)VECTOR_element(handleData->personalities, index);
+        if (personality->batchCount > 0)
+        {
+            tickcounter_ms_t waited = timeKnown ? now - personality->batchStart : handleData->batchTimeoutMs;
+            size_t window = (handleData->maxInFlight == 0) ? personality->batchCount : handleData->maxInFlight - personality->inFlight;
+            /*Codes_SRS_IOTHUBMODULE_30_008: [ The send thread shall send the batch of a device once it holds `batchSize` messages or its oldest message has waited `batchTimeoutMs` milliseconds. ]*/
+            if (personality->batchCount < handleData->batchSize && waited < handleData->batchTimeoutMs)
+            {
+                unsigned int due = (unsigned int)(handleData->batchTimeoutMs - waited);
+                if (due < *waitMs)
+                {
+                    *waitMs = due;
+                }
+            }
+            /*Codes_SRS_IOTHUBMODULE_30_009: [ The send thread shall not let a device have more than `maxInFlight` messages sent and not confirmed, unless `maxInFlight` is 0; the rest of its batch shall wait for confirmations. ]*/
+            else if (window > 0)
+            {
+                *count = (window < personality->batchCount) ? window : personality->batchCount;
+                (void)memcpy(handleData->sending, personality->batch, *count * sizeof(IOTHUB_MESSAGE_HANDLE));
+                (void)memmove(personality->batch, personality->batch + *count, (personality->batchCount - *count) * sizeof(IOTHUB_MESSAGE_HANDLE));
+                personality->batchCount -= *count;
+                personality->inFlight += *count;
+                if (personality->batchCount > 0)
+                {
+                    /*what the window held back was due already, it stays due*/
+                    personality->batchStart = timeKnown ? now - handleData->batchTimeoutMs : 0;
+                }
+                handleData->nextPersonality = index + 1;
+                result = personality;
+            }
+            else
+            {
+                /*the confirmation that opens the window wakes the send thread up*/
+            }
+        }
+    }
+    return result;
+}
+
+static void IotHub_SendConfirmation(IOTHUB_CLIENT_CONFIRMATION_RESULT result, void* userContextCallback)
+{
+    PERSONALITY* personality = (PERSONALITY*)userContextCallback;
+    IOTHUB_HANDLE_DATA* handleData = (IOTHUB_HANDLE_DATA*)personality->module;
+    if (result != IOTHUB_CLIENT_CONFIRMATION_OK)
+    {
+        LogError("an event was not delivered to IoT Hub, confirmation result %d", (int)result);
+    }
+
+    /*Codes_SRS_IOTHUBMODULE_30_010: [ Every confirmation of a sent message shall remove it from the send window of its device and wake up the send thread. ]*/
+    if (Lock(handleData->lock) != LOCK_OK)
+    {
+        LogError("unable to Lock, the send window of the device stays smaller");
+    }
+    else
+    {
+        personality->inFlight--;
+        (void)Condition_Post(handleData->sendCondition);
+        (void)Unlock(handleData->lock);
+    }
+}
+
+/*hands a batch to IoTHubClient, outside of the lock since confirmations take it*/
+static void send_batch(IOTHUB_HANDLE_DATA* handleData, PERSONALITY* personality, size_t count)
+{
+    size_t failed = 0;
+    size_t i;
+    for (i = 0; i < count; i++)
+    {
+        /*Codes_SRS_IOTHUBMODULE_30_011: [ The send thread shall send each message of a batch, in order, by calling `IoTHubClient_SendEventAsync` with `IotHub_SendConfirmation` and the personality, then destroy it. ]*/
+        if (IoTHubClient_SendEventAsync(personality->iothubHandle, handleData->sending[i], IotHub_SendConfirmation, personality) != IOTHUB_CLIENT_OK)
+        {
+            LogError("unable to IoTHubClient_SendEventAsync");
+            failed++;
+        }
+        IoTHubMessage_Destroy(handleData->sending[i]);
+    }
+
+    if (failed == 0)
+    {
+        /*all of them are on their way*/
+    }
+    else if (Lock(handleData->lock) != LOCK_OK)
+    {
+        LogError("unable to Lock, the send window of the device stays smaller");
+    }
+    else
+    {
+        /*Codes_SRS_IOTHUBMODULE_30_012: [ Messages that `IoTHubClient_SendEventAsync` fails to send shall leave the send window of their device. ]*/
+        personality->inFlight -= failed;
+        (void)Unlock(handleData->lock);
+    }
+}
+
+static int IotHub_SendThread(void* context)
+{
+    IOTHUB_HANDLE_DATA* handleData = (IOTHUB_HANDLE_DATA*)context;
+    bool stopping = false;
+
+    /*Codes_SRS_IOTHUBMODULE_30_007: [ The send thread shall run until `IotHub_Destroy` stops it. ]*/
+    while (!stopping)
+    {
+        if (Lock(handleData->lock) != LOCK_OK)
+        {
+            /*Codes_SRS_IOTHUBMODULE_30_013: [ If acquiring the lock fails, the send thread shall return. ]*/
+            LogError("unable to Lock");
+            stopping = true;
+        }
+        else
+        {
+            PERSONALITY* personality = NULL;
+            size_t count = 0;
+            stopping = handleData->stopping;
+            if (!stopping)
+            {
+                unsigned int waitMs;
+                personality = take_due_batch(handleData, &count, &waitMs);
+                if (personality == NULL)
+                {
+                    /*Codes_SRS_IOTHUBMODULE_30_014: [ When no batch can be sent, the send thread shall wait on its condition until the next batch is due. ]*/
+                    (void)Condition_Wait(handleData->sendCondition, handleData->lock, (int)waitMs);
+                }
+                else
+                {
+                    (void)Condition_Post(handleData->roomCondition);
+                }
+            }
+            (void)Unlock(handleData->lock);
+
+            if (personality != NULL)
+            {
+                send_batch(handleData, personality, count);
+            }
+        }
+    }
+    return 0;
+}
+
+/*returns 0 if the module sends each message as it arrives or if it is ready to send batches*/
+static int start_pipeline(IOTHUB_HANDLE_DATA* handleData, const IOTHUB_CONFIG* config)
+{
+    int result;
+    handleData->batchSize = pipeline_batch_size(config);
+    handleData->batchTimeoutMs = (config->batchTimeoutMs == 0) ? IOTHUB_DEFAULT_BATCH_TIMEOUT_MS : config->batchTimeoutMs;
+    handleData->maxInFlight = config->maxInFlight;
+    handleData->stopping = false;
+    handleData->nextPersonality = 0;
+    handleData->sending = (IOTHUB_MESSAGE_HANDLE*)(handleData->transports + handleData->transportCount);
+
+    if (handleData->batchSize == 0)
+    {
+        /*every message is sent as it arrives*/
+        result = 0;
+    }
+    /*Codes_SRS_IOTHUBMODULE_30_003: [ If `configuration->batchSize` is greater than 1, or `configuration->maxInFlight` or `configuration->maxDevices` is not 0, `IotHub_Create` shall create a lock, two conditions, a tick counter and a thread sending the batches of messages. ]*/
+    else if ((handleData->lock = Lock_Init()) == NULL)
+    {
+        LogError("unable to Lock_Init");
+        result = __LINE__;
+    }
+    else if ((handleData->sendCondition = Condition_Init()) == NULL)
+    {
+        LogError("unable to Condition_Init");
+        (void)Lock_Deinit(handleData->lock);
+        result = __LINE__;
+    }
+    else if ((handleData->roomCondition = Condition_Init()) == NULL)
+    {
+        LogError("unable to Condition_Init");
+        Condition_Deinit(handleData->sendCondition);
+        (void)Lock_Deinit(handleData->lock);
+        result = __LINE__;
+    }
+    else if ((handleData->tickCounter = tickcounter_create()) == NULL)
+    {
+        LogError("unable to tickcounter_create");
+        Condition_Deinit(handleData->roomCondition);
+        Condition_Deinit(handleData->sendCondition);
+        (void)Lock_Deinit(handleData->lock);
+        result = __LINE__;
+    }
+    else if (ThreadAPI_Create(&handleData->sendThread, IotHub_SendThread, handleData) != THREADAPI_OK)
+    {
+        LogError("unable to ThreadAPI_Create");
+        tickcounter_destroy(handleData->tickCounter);
+        Condition_Deinit(handleData->roomCondition);
+        Condition_Deinit(handleData->sendCondition);
+        (void)Lock_Deinit(handleData->lock);
+        result = __LINE__;
+    }
+    else
+    {
+        result = 0;
+    }
+    return result;
+}
+
+static void stop_pipeline(IOTHUB_HANDLE_DATA* handleData)
+{
+    if (handleData->batchSize != 0)
+    {
+        int notUsed;
+        /*Codes_SRS_IOTHUBMODULE_30_015: [ `IotHub_Destroy` shall stop and join the send thread before destroying the personalities. ]*/
+        if (Lock(handleData->lock) != LOCK_OK)
+        {
+            /*the send thread notices when its wait times out*/
+            LogError("unable to Lock");
+            handleData->stopping = true;
+        }
+        else
+        {
+            handleData->stopping = true;
+            (void)Condition_Post(handleData->sendCondition);
+            (void)Unlock(handleData->lock);
+        }
+        (void)ThreadAPI_Join(handleData->sendThread, &notUsed);
+    }
+}
+
+/*how many connections the devices share, 0 when every device has a connection of its own*/
+static size_t shared_transport_count(const IOTHUB_CONFIG* config)
+{
+    size_t result;
+    if (config->transportProvider == HTTP_Protocol ||
+        config->transportProvider == AMQP_Protocol)
+    {
+        result = (config->transportCount > 1) ? config->transportCount : 1;
+    }
+    else
+    {
+        /*MQTT cannot carry more than one device over a connection*/
+        result = 0;
+    }
+    return result;
+}
+
+static void destroy_transports(IOTHUB_HANDLE_DATA* handleData, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        IoTHubTransport_Destroy(handleData->transports[i]);
+    }
+}
+
+/*returns 0 if all the shared transports have been created, otherwise __LINE__*/
+static int create_transports(IOTHUB_HANDLE_DATA* handleData, const IOTHUB_CONFIG* config)
+{
+    int result = 0;
+    for (size_t i = 0; i < handleData->transportCount; i++)
+    {
+        /*Codes_SRS_IOTHUBMODULE_17_001: [ If `configuration->transportProvider` is `HTTP_Protocol` or `AMQP_Protocol`, `IotHub_Create` shall create a shared transport by calling `IoTHubTransport_Create`. ]*/
+        /*Codes_SRS_IOTHUBMODULE_30_022: [ `IotHub_Create` shall create `configuration->transportCount` shared transports, or one if it is 0. ]*/
+        if ((handleData->transports[i] = IoTHubTransport_Create(config->transportProvider, config->IoTHubName, config->IoTHubSuffix)) == NULL)
+        {
+            /*Codes_SRS_IOTHUBMODULE_17_002: [ If creating the shared transport fails, `IotHub_Create` shall fail and return `NULL`. ]*/
+            LogError("unable to create the shared transport %zu of %zu", i, handleData->transportCount);
+            destroy_transports(handleData, i);
+            result = __LINE__;
+            break;
+        }
+    }
+    return result;
+}
+
 static MODULE_HANDLE IotHub_Create(BROKER_HANDLE broker, const void* configuration)
 {
     IOTHUB_HANDLE_DATA *result;
@@ -226,7 +591,8 @@ static MODULE_HANDLE IotHub_Create(BROKER_HANDLE broker, const void* configurati
     }
     else
     {
-        result = malloc(sizeof(IOTHUB_HANDLE_DATA));
+        /*the shared transports follow, then the space the send thread takes the batches into*/
+        result = malloc(sizeof(IOTHUB_HANDLE_DATA) + (shared_transport_count(config) * sizeof(TRANSPORT_HANDLE)) + (pipeline_batch_size(config) * sizeof(IOTHUB_MESSAGE_HANDLE)));
         /*Codes_SRS_IOTHUBMODULE_02_027: [ When `IotHub_Create` encounters an internal failure it shall fail and return `NULL`. ]*/
         if (result == NULL)
         {
@@ -247,23 +613,13 @@ static MODULE_HANDLE IotHub_Create(BROKER_HANDLE broker, const void* configurati
             else
             {
                 result->transportProvider = config->transportProvider;
-                if (result->transportProvider == HTTP_Protocol ||
-                    result->transportProvider == AMQP_Protocol)
+                result->transports = (TRANSPORT_HANDLE*)(result + 1);
+                result->transportCount = shared_transport_count(config);
+                if (create_transports(result, config) != 0)
                 {
-                    /*Codes_SRS_IOTHUBMODULE_17_001: [ If `configuration->transportProvider` is `HTTP_Protocol` or `AMQP_Protocol`, `IotHub_Create` shall create a shared transport by calling `IoTHubTransport_Create`. ]*/
-                    result->transportHandle = IoTHubTransport_Create(config->transportProvider, config->IoTHubName, config->IoTHubSuffix);
-                    if (result->transportHandle == NULL)
-                    {
-                        /*Codes_SRS_IOTHUBMODULE_17_002: [ If creating the shared transport fails, `IotHub_Create` shall fail and return `NULL`. ]*/
-                        VECTOR_destroy(result->personalities);
-                        free(result);
-                        result = NULL;
-                        LogError("VECTOR_create returned NULL");
-                    }
-                }
-                else
-                {
-                    result->transportHandle = NULL;
+                    VECTOR_destroy(result->personalities);
+                    free(result);
+                    result = NULL;
                 }
 
                 if (result != NULL)
@@ -273,7 +629,7 @@ static MODULE_HANDLE IotHub_Create(BROKER_HANDLE broker, const void* configurati
                     if ((result->IoTHubName = STRING_construct(config->IoTHubName)) == NULL)
                     {
                         LogError("STRING_construct returned NULL");
-                        IoTHubTransport_Destroy(result->transportHandle);
+                        destroy_transports(result, result->transportCount);
                         VECTOR_destroy(result->personalities);
                         free(result);
                         result = NULL;
@@ -282,7 +638,7 @@ static MODULE_HANDLE IotHub_Create(BROKER_HANDLE broker, const void* configurati
                     {
                         LogError("STRING_construct returned NULL");
                         STRING_delete(result->IoTHubName);
-                        IoTHubTransport_Destroy(result->transportHandle);
+                        destroy_transports(result, result->transportCount);
                         VECTOR_destroy(result->personalities);
                         free(result);
                         result = NULL;
@@ -291,6 +647,22 @@ static MODULE_HANDLE IotHub_Create(BROKER_HANDLE broker, const void* configurati
                     {
                         /*Codes_SRS_IOTHUBMODULE_17_004: [ `IotHub_Create` shall store the broker. ]*/
                         result->broker = broker;
+                        result->index = NULL;
+                        result->indexSize = 0;
+                        result->indexCount = 0;
+                        result->lruHead = NULL;
+                        result->lruTail = NULL;
+                        result->maxDevices = config->maxDevices;
+                        if (start_pipeline(result, config) != 0)
+                        {
+                            /*Codes_SRS_IOTHUBMODULE_30_004: [ If creating any of them fails, `IotHub_Create` shall fail and return `NULL`. ]*/
+                            STRING_delete(result->IoTHubSuffix);
+                            STRING_delete(result->IoTHubName);
+                            destroy_transports(result, result->transportCount);
+                            VECTOR_destroy(result->personalities);
+                            free(result);
+                            result = NULL;
+                        }
                         /*Codes_SRS_IOTHUBMODULE_02_008: [ Otherwise, `IotHub_Create` shall return a non-`NULL` handle. ]*/
                     }
                 }
@@ -311,16 +683,35 @@ static void IotHub_Destroy(MODULE_HANDLE moduleHandle)
     {
         /*Codes_SRS_IOTHUBMODULE_02_024: [ Otherwise `IotHub_Destroy` shall free all used resources. ]*/
         IOTHUB_HANDLE_DATA * handleData = moduleHandle;
-        size_t vectorSize = VECTOR_size(handleData->personalities);
+        size_t vectorSize;
+        stop_pipeline(handleData);
+        vectorSize = VECTOR_size(handleData->personalities);
         for (size_t i = 0; i < vectorSize; i++)
         {
             PERSONALITY_PTR* personality = VECTOR_element(handleData->personalities, i);
+            /*Codes_SRS_IOTHUBMODULE_30_016: [ `IotHub_Destroy` shall destroy the messages still waiting in the batches. ]*/
+            for (size_t j = 0; j < (*personality)->batchCount; j++)
+            {
+                IoTHubMessage_Destroy((*personality)->batch[j]);
+            }
             STRING_delete((*personality)->deviceKey);
             STRING_delete((*personality)->deviceName);
+            /*confirmations of the messages still in flight come before this returns*/
             IoTHubClient_Destroy((*personality)->iothubHandle);
             free(*personality);
         }
-        IoTHubTransport_Destroy(handleData->transportHandle);
+        if (handleData->batchSize != 0)
+        {
+            tickcounter_destroy(handleData->tickCounter);
+            Condition_Deinit(handleData->roomCondition);
+            Condition_Deinit(handleData->sendCondition);
+            (void)Lock_Deinit(handleData->lock);
+        }
+        if (handleData->index != NULL)
+        {
+            free(handleData->index);
+        }
+        destroy_transports(handleData, handleData->transportCount);
         VECTOR_destroy(handleData->personalities);
         STRING_delete(handleData->IoTHubName);
         STRING_delete(handleData->IoTHubSuffix);
@@ -328,11 +719,6 @@ static void IotHub_Destroy(MODULE_HANDLE moduleHandle)
     }
 }
 
-static bool lookup_DeviceName(const void* element, const void* value)
-{
-    return (strcmp(STRING_c_str((*(PERSONALITY_PTR*)element)->deviceName), value) == 0);
-}
-
 static IOTHUBMESSAGE_DISPOSITION_RESULT IotHub_ReceiveMessageCallback(IOTHUB_MESSAGE_HANDLE msg, void* userContextCallback)
 {
     IOTHUBMESSAGE_DISPOSITION_RESULT result;
@@ -444,9 +830,10 @@ static IOTHUBMESSAGE_DISPOSITION_RESULT IotHub_ReceiveMessageCallback(IOTHUB_MES
 }
 
 /*returns non-null if PERSONALITY has been properly populated*/
-static PERSONALITY_PTR PERSONALITY_create(const char* deviceName, const char* deviceKey, IOTHUB_HANDLE_DATA* moduleHandleData)
+static PERSONALITY_PTR PERSONALITY_create(const char* deviceName, const char* deviceKey, size_t hash, IOTHUB_HANDLE_DATA* moduleHandleData)
 {
-    PERSONALITY_PTR result = (PERSONALITY_PTR)malloc(sizeof(PERSONALITY));
+    /*the batch of the device follows the personality*/
+    PERSONALITY_PTR result = (PERSONALITY_PTR)malloc(sizeof(PERSONALITY) + (moduleHandleData->batchSize * sizeof(IOTHUB_MESSAGE_HANDLE)));
     if (result == NULL)
     {
         LogError("unable to allocate a personality for the device %s", deviceName);
@@ -478,9 +865,10 @@ static PERSONALITY_PTR PERSONALITY_create(const char* deviceName, const char* de
             temp.protocolGatewayHostName = NULL;
 
             /*Codes_SRS_IOTHUBMODULE_05_013: [ If a new personality is created and the module's transport has already been created (in `IotHub_Create`), an `IOTHUB_CLIENT_HANDLE` will be added to the personality by a call to `IoTHubClient_CreateWithTransport`. ]*/
+            /*Codes_SRS_IOTHUBMODULE_30_023: [ The personality shall use the shared transport picked by the hash of its device name modulo the number of shared transports. ]*/
             /*Codes_SRS_IOTHUBMODULE_05_003: [ If a new personality is created and the module's transport has not already been created, an `IOTHUB_CLIENT_HANDLE` will be added to the personality by a call to `IoTHubClient_Create` with the corresponding transport provider. ]*/
-            result->iothubHandle = (moduleHandleData->transportHandle != NULL)
-                ? IoTHubClient_CreateWithTransport(moduleHandleData->transportHandle, &temp)
+            result->iothubHandle = (moduleHandleData->transportCount != 0)
+                ? IoTHubClient_CreateWithTransport(moduleHandleData->transports[hash % moduleHandleData->transportCount], &temp)
                 : IoTHubClient_Create(&temp);
 
             if (result->iothubHandle == NULL)
@@ -508,6 +896,11 @@ static PERSONALITY_PTR PERSONALITY_create(const char* deviceName, const char* de
                     /*it is all fine*/
                     result->broker = moduleHandleData->broker;
                     result->module = moduleHandleData;
+                    result->batch = (IOTHUB_MESSAGE_HANDLE*)(result + 1);
+                    result->batchCount = 0;
+                    result->batchStart = 0;
+                    result->inFlight = 0;
+                    result->hash = hash;
                 }
             }
         }
@@ -522,19 +915,253 @@ static void PERSONALITY_destroy(PERSONALITY* personality)
     IoTHubClient_Destroy(personality->iothubHandle);
 }
 
+/*FNV-1a*/
+static size_t device_name_hash(const char* deviceName)
+{
+    unsigned long hash = 2166136261UL;
+    while (*deviceName != '\0')
+    {
+        hash ^= (unsigned char)*deviceName++;
+        hash = (hash * 16777619UL) & 0xFFFFFFFFUL;
+    }
+    return (size_t)hash;
+}
+
+static void personality_index_insert(PERSONALITY_PTR* index, size_t size, PERSONALITY* personality)
+{
+    size_t mask = size - 1;
+    size_t slot = personality->hash & mask;
+    while (index[slot] != NULL)
+    {
+        slot = (slot + 1) & mask;
+    }
+    index[slot] = personality;
+}
+
+/*makes sure the index stays at most half full once one more personality is
+  inserted. Returns 0 if success, otherwise __LINE__*/
+static int personality_index_reserve(IOTHUB_HANDLE_DATA* moduleHandleData)
+{
+    int result;
+    if ((moduleHandleData->indexCount + 1) * 2 <= moduleHandleData->indexSize)
+    {
+        result = 0;
+    }
+    else
+    {
+        size_t size = (moduleHandleData->indexSize == 0) ? PERSONALITY_INDEX_MIN_SIZE : moduleHandleData->indexSize * 2;
+        PERSONALITY_PTR* index = (PERSONALITY_PTR*)malloc(size * sizeof(PERSONALITY_PTR));
+        if (index == NULL)
+        {
+            LogError("unable to allocate a personality index of %zu slots", size);
+            result = __LINE__;
+        }
+        else
+        {
+            for (size_t i = 0; i < size; i++)
+            {
+                index[i] = NULL;
+            }
+            for (size_t i = 0; i < moduleHandleData->indexSize; i++)
+            {
+                if (moduleHandleData->index[i] != NULL)
+                {
+                    personality_index_insert(index, size, moduleHandleData->index[i]);
+                }
+            }
+            if (moduleHandleData->index != NULL)
+            {
+                free(moduleHandleData->index);
+            }
+            moduleHandleData->index = index;
+            moduleHandleData->indexSize = size;
+            result = 0;
+        }
+    }
+    return result;
+}
+
+/*takes personality, which has to be in the index, out of it*/
+static void personality_index_remove(IOTHUB_HANDLE_DATA* moduleHandleData, const PERSONALITY* personality)
+{
+    PERSONALITY_PTR* index = moduleHandleData->index;
+    size_t mask = moduleHandleData->indexSize - 1;
+    size_t slot = personality->hash & mask;
+    size_t next;
+    while (index[slot] != personality)
+    {
+        slot = (slot + 1) & mask;
+    }
+
+    /*moves back the personalities probed past the freed slot so that they are
+      still found from their first slot*/
+    next = (slot + 1) & mask;
+    while (index[next] != NULL)
+    {
+        size_t first = index[next]->hash & mask;
+        if (((next - first) & mask) >= ((next - slot) & mask))
+        {
+            index[slot] = index[next];
+            slot = next;
+        }
+        next = (next + 1) & mask;
+    }
+    index[slot] = NULL;
+    moduleHandleData->indexCount--;
+}
+
+static PERSONALITY* personality_index_find(const IOTHUB_HANDLE_DATA* moduleHandleData, const char* deviceName, size_t hash)
+{
+    PERSONALITY* result = NULL;
+    if (moduleHandleData->index != NULL)
+    {
+        size_t mask = moduleHandleData->indexSize - 1;
+        size_t slot = hash & mask;
+        while (moduleHandleData->index[slot] != NULL)
+        {
+            PERSONALITY* candidate = moduleHandleData->index[slot];
+            if (candidate->hash == hash &&
+                strcmp(STRING_c_str(candidate->deviceName), deviceName) == 0)
+            {
+                result = candidate;
+                break;
+            }
+            slot = (slot + 1) & mask;
+        }
+    }
+    return result;
+}
+
+static void lru_unlink(IOTHUB_HANDLE_DATA* moduleHandleData, PERSONALITY* personality)
+{
+    if (personality->lruPrev == NULL)
+    {
+        moduleHandleData->lruHead = personality->lruNext;
+    }
+    else
+    {
+        personality->lruPrev->lruNext = personality->lruNext;
+    }
+
+    if (personality->lruNext == NULL)
+    {
+        moduleHandleData->lruTail = personality->lruPrev;
+    }
+    else
+    {
+        personality->lruNext->lruPrev = personality->lruPrev;
+    }
+}
+
+static void lru_push_front(IOTHUB_HANDLE_DATA* moduleHandleData, PERSONALITY* personality)
+{
+    personality->lruPrev = NULL;
+    personality->lruNext = moduleHandleData->lruHead;
+    if (moduleHandleData->lruHead == NULL)
+    {
+        moduleHandleData->lruTail = personality;
+    }
+    else
+    {
+        moduleHandleData->lruHead->lruPrev = personality;
+    }
+    moduleHandleData->lruHead = personality;
+}
+
+/*destroys the least recently used personality that has no message waiting or
+  in flight. Returns 0 if success, otherwise __LINE__*/
+static int evict_idle_personality(IOTHUB_HANDLE_DATA* moduleHandleData)
+{
+    int result;
+    bool pipelined = (moduleHandleData->batchSize != 0);
+    if (pipelined && Lock(moduleHandleData->lock) != LOCK_OK)
+    {
+        LogError("unable to Lock");
+        result = __LINE__;
+    }
+    else
+    {
+        /*Codes_SRS_IOTHUBMODULE_30_020: [ If `maxDevices` personalities exist already, `IotHub_Receive` shall destroy the least recently used personality that has no message waiting or in flight. ]*/
+        PERSONALITY* victim = moduleHandleData->lruTail;
+        while (victim != NULL && (victim->batchCount != 0 || victim->inFlight != 0))
+        {
+            victim = victim->lruPrev;
+        }
+
+        if (victim != NULL)
+        {
+            /*the send thread walks the vector, it changes under the lock*/
+            size_t vectorSize = VECTOR_size(moduleHandleData->personalities);
+            for (size_t i = 0; i < vectorSize; i++)
+            {
+                PERSONALITY_PTR* element = (PERSONALITY_PTR*)VECTOR_element(moduleHandleData->personalities, i);
+                if (*element == victim)
+                {
+                    VECTOR_erase(moduleHandleData->personalities, element, 1);
+                    break;
+                }
+            }
+        }
+
+        if (pipelined)
+        {
+            (void)Unlock(moduleHandleData->lock);
+        }
+
+        if (victim == NULL)
+        {
+            result = __LINE__;
+        }
+        else
+        {
+            personality_index_remove(moduleHandleData, victim);
+            lru_unlink(moduleHandleData, victim);
+            /*outside of the lock, confirmations of other devices take it*/
+            PERSONALITY_destroy(victim);
+            free(victim);
+            result = 0;
+        }
+    }
+    return result;
+}
+
 static PERSONALITY* PERSONALITY_find_or_create(IOTHUB_HANDLE_DATA* moduleHandleData, const char* deviceName, const char* deviceKey)
 {
-    /*Codes_SRS_IOTHUBMODULE_02_017: [ Otherwise `IotHub_Receive` shall not create a new personality. ]*/
     PERSONALITY* result;
-    PERSONALITY_PTR* resultPtr = VECTOR_find_if(moduleHandleData->personalities, lookup_DeviceName, deviceName);
-    if (resultPtr == NULL)
+    size_t hash = device_name_hash(deviceName);
+    /*Codes_SRS_IOTHUBMODULE_30_019: [ `IotHub_Receive` shall look the personality up by device name in a hash index of the personalities. ]*/
+    if ((result = personality_index_find(moduleHandleData, deviceName, hash)) != NULL)
+    {
+        /*Codes_SRS_IOTHUBMODULE_02_017: [ Otherwise `IotHub_Receive` shall not create a new personality. ]*/
+        lru_unlink(moduleHandleData, result);
+        lru_push_front(moduleHandleData, result);
+    }
+    else if (moduleHandleData->maxDevices != 0 &&
+        moduleHandleData->indexCount >= moduleHandleData->maxDevices &&
+        evict_idle_personality(moduleHandleData) != 0)
+    {
+        /*Codes_SRS_IOTHUBMODULE_30_021: [ If no such personality exists, `IotHub_Receive` shall not create a new personality. ]*/
+        LogError("all of the %zu devices have messages waiting or in flight, cannot make room for device %s", moduleHandleData->maxDevices, deviceName);
+    }
+    else
     {
         /*a new device has arrived!*/
         PERSONALITY_PTR personality;
-        if ((personality = PERSONALITY_create(deviceName, deviceKey, moduleHandleData)) == NULL)
+        if ((personality = PERSONALITY_create(deviceName, deviceKey, hash, moduleHandleData)) == NULL)
         {
             LogError("unable to create a personality for the device %s", deviceName);
-            result = NULL;
+        }
+        else if (personality_index_reserve(moduleHandleData) != 0)
+        {
+            PERSONALITY_destroy(personality);
+            free(personality);
+        }
+        /*Codes_SRS_IOTHUBMODULE_30_005: [ If the module is pipelined, `IotHub_Receive` shall hold the lock while adding a new personality. ]*/
+        else if (moduleHandleData->batchSize != 0 && Lock(moduleHandleData->lock) != LOCK_OK)
+        {
+            LogError("unable to Lock");
+            PERSONALITY_destroy(personality);
+            free(personality);
         }
         else
         {
@@ -544,18 +1171,24 @@ static PERSONALITY* PERSONALITY_find_or_create(IOTHUB_HANDLE_DATA* moduleHandleD
                 LogError("VECTOR_push_back failed");
                 PERSONALITY_destroy(personality);
                 free(personality);
-                result = NULL;
             }
             else
             {
-                resultPtr = VECTOR_back(moduleHandleData->personalities);
-                result = *resultPtr;
+                result = *(PERSONALITY_PTR*)VECTOR_back(moduleHandleData->personalities);
             }
+
+            if (moduleHandleData->batchSize != 0)
+            {
+                (void)Unlock(moduleHandleData->lock);
+            }
+
+            if (result != NULL)
+            {
+                personality_index_insert(moduleHandleData->index, moduleHandleData->indexSize, result);
+                moduleHandleData->indexCount++;
+                lru_push_front(moduleHandleData, result);
             }
         }
-    else
-    {
-        result = *resultPtr;
     }
     return result;
 }
@@ -622,6 +1255,53 @@ static IOTHUB_MESSAGE_HANDLE IoTHubMessage_CreateFromGWMessage(MESSAGE_HANDLE me
     return result;
 }
 
+/*adds iotHubMessage to the batch of personality, waiting up to batchTimeoutMs for room*/
+static void queue_message(IOTHUB_HANDLE_DATA* moduleHandleData, PERSONALITY* personality, IOTHUB_MESSAGE_HANDLE iotHubMessage)
+{
+    if (Lock(moduleHandleData->lock) != LOCK_OK)
+    {
+        LogError("unable to Lock");
+    }
+    else
+    {
+        if (personality->batchCount == moduleHandleData->batchSize)
+        {
+            /*Codes_SRS_IOTHUBMODULE_30_017: [ If the batch of the device is full, `IotHub_Receive` shall wait on its condition up to `batchTimeoutMs` milliseconds for the send thread to take it. ]*/
+            (void)Condition_Wait(moduleHandleData->roomCondition, moduleHandleData->lock, (int)moduleHandleData->batchTimeoutMs);
+        }
+
+        if (personality->batchCount == moduleHandleData->batchSize)
+        {
+            /*Codes_SRS_IOTHUBMODULE_30_018: [ If the batch is still full, `IotHub_Receive` shall drop the message. ]*/
+            LogError("IoT Hub does not keep up with device %s, dropping a message", STRING_c_str(personality->deviceName));
+        }
+        else
+        {
+            if (personality->batchCount == 0 &&
+                tickcounter_get_current_ms(moduleHandleData->tickCounter, &personality->batchStart) != 0)
+            {
+                /*the batch is due by its timeout at the latest*/
+                LogError("unable to tickcounter_get_current_ms");
+                personality->batchStart = 0;
+            }
+
+            /*Codes_SRS_IOTHUBMODULE_30_006: [ If the module is pipelined, `IotHub_Receive` shall add the IOTHUB_MESSAGE_HANDLE to the batch of the device instead of sending it, and wake up the send thread when that fills the batch. ]*/
+            personality->batch[personality->batchCount++] = iotHubMessage;
+            iotHubMessage = NULL;
+            if (personality->batchCount == moduleHandleData->batchSize)
+            {
+                (void)Condition_Post(moduleHandleData->sendCondition);
+            }
+        }
+        (void)Unlock(moduleHandleData->lock);
+    }
+
+    if (iotHubMessage != NULL)
+    {
+        IoTHubMessage_Destroy(iotHubMessage);
+    }
+}
+
 static void IotHub_Receive(MODULE_HANDLE moduleHandle, MESSAGE_HANDLE messageHandle)
 {
     /*Codes_SRS_IOTHUBMODULE_02_009: [ If `moduleHandle` or `messageHandle` is `NULL` then `IotHub_Receive` shall do nothing. ]*/
@@ -635,8 +1315,8 @@ static void IotHub_Receive(MODULE_HANDLE moduleHandle, MESSAGE_HANDLE messageHan
     }
     else
     {
-        CONSTMAP_HANDLE properties = Message_GetProperties(messageHandle);
-        const char* source = ConstMap_GetValue(properties, SOURCE); /*properties is !=NULL by contract of Message*/
+        /*looking up single properties avoids cloning the whole map for the messages this module ignores*/
+        const char* source = Message_GetProperty(messageHandle, SOURCE);
 
         /*Codes_SRS_IOTHUBMODULE_02_010: [ If message properties do not contain a property called "source" having the value set to "mapping" then `IotHub_Receive` shall do nothing. ]*/
         if (
@@ -649,7 +1329,7 @@ static void IotHub_Receive(MODULE_HANDLE moduleHandle, MESSAGE_HANDLE messageHan
         else
         {
             /*Codes_SRS_IOTHUBMODULE_02_011: [ If message properties do not contain a property called "deviceName" having a non-`NULL` value then `IotHub_Receive` shall do nothing. ]*/
-            const char* deviceName = ConstMap_GetValue(properties, DEVICENAME);
+            const char* deviceName = Message_GetProperty(messageHandle, DEVICENAME);
             if (deviceName == NULL)
             {
                 /*do nothing, not a message for this module*/
@@ -657,7 +1337,7 @@ static void IotHub_Receive(MODULE_HANDLE moduleHandle, MESSAGE_HANDLE messageHan
             else
             {
                 /*Codes_SRS_IOTHUBMODULE_02_012: [ If message properties do not contain a property called "deviceKey" having a non-`NULL` value then `IotHub_Receive` shall do nothing. ]*/
-                const char* deviceKey = ConstMap_GetValue(properties, DEVICEKEY);
+                const char* deviceKey = Message_GetProperty(messageHandle, DEVICEKEY);
                 if (deviceKey == NULL)
                 {
                     /*do nothing, missing device key*/
@@ -681,6 +1361,10 @@ static void IotHub_Receive(MODULE_HANDLE moduleHandle, MESSAGE_HANDLE messageHan
                         {
                             LogError("unable to IoTHubMessage_CreateFromGWMessage (internal)");
                         }
+                        else if (moduleHandleData->batchSize != 0)
+                        {
+                            queue_message(moduleHandleData, whereIsIt, iotHubMessage);
+                        }
                         else
                         {
                             /*Codes_SRS_IOTHUBMODULE_02_020: [ `IotHub_Receive` shall call IoTHubClient_SendEventAsync passing the IOTHUB_MESSAGE_HANDLE. ]*/
@@ -699,7 +1383,6 @@ static void IotHub_Receive(MODULE_HANDLE moduleHandle, MESSAGE_HANDLE messageHan
                 }
             }
         }
-        ConstMap_Destroy(properties);
     }
     /*Codes_SRS_IOTHUBMODULE_02_022: [ If `IoTHubClient_SendEventAsync` succeeds then `IotHub_Receive` shall return. ]*/
 }
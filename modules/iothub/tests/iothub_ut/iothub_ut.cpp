@@ -10,6 +10,9 @@
 #include "module.h"
 #include "module_access.h"
 #include "azure_c_shared_utility/lock.h"
+#include "azure_c_shared_utility/condition.h"
+#include "azure_c_shared_utility/threadapi.h"
+#include "azure_c_shared_utility/tickcounter.h"
 #include "azure_c_shared_utility/vector.h"
 #include "azure_c_shared_utility/strings.h"
 #include "iothubtransport.h"
@@ -67,6 +70,39 @@ static size_t whenShallIoTHubMessage_CreateFromByteArray_fail;
 
 static size_t currentIoTHubClient_Create_call;
 static size_t whenShallIoTHubClient_Create_fail;
+static TRANSPORT_HANDLE lastClient_transport; /*the transport of the last IoTHubClient_CreateWithTransport*/
+
+static size_t currentIoTHubTransport_Create_call;
+static size_t whenShallIoTHubTransport_Create_fail;
+
+static size_t currentIoTHubClient_SendEventAsync_call;
+static size_t whenShallIoTHubClient_SendEventAsync_fail;
+
+static size_t currentLock_call;
+static size_t whenShallLock_fail;
+
+static size_t currentThreadAPI_Create_call;
+static size_t whenShallThreadAPI_Create_fail;
+static THREAD_START_FUNC sendThread_func;
+static void* sendThread_arg;
+
+static tickcounter_ms_t currentTick_ms;
+
+/*a local stand-in for IoT Hub: the events sent with a confirmation callback wait here until the test confirms them*/
+#define MAX_PENDING_EVENTS 8
+static IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK pendingEvent_callback[MAX_PENDING_EVENTS];
+static void* pendingEvent_context[MAX_PENDING_EVENTS];
+static size_t pendingEvent_count;
+
+static void confirm_pending_events(IOTHUB_CLIENT_CONFIRMATION_RESULT result)
+{
+    size_t count = pendingEvent_count;
+    pendingEvent_count = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        pendingEvent_callback[i](result, pendingEvent_context[i]);
+    }
+}
 
 static IOTHUB_CLIENT_MESSAGE_CALLBACK_ASYNC IotHub_Receive_message_callback_function;
 static void * IotHub_Receive_message_userContext;
@@ -185,6 +221,74 @@ public:
     operator IOTHUB_CONFIG*() { return &config_; }
 };
 
+/*a module sending batches of batchSize messages, with at most maxInFlight of them unconfirmed per device*/
+static MODULE_HANDLE create_pipelined_module(IOTHUB_CONFIG* config, size_t batchSize, size_t maxInFlight)
+{
+    config->batchSize = batchSize;
+    config->batchTimeoutMs = 100;
+    config->maxInFlight = maxInFlight;
+    return Module_Create(BROKER_HANDLE_VALID, config);
+}
+
+/*runs the send thread captured by ThreadAPI_Create for that many passes, the Lock that follows them fails and ends it*/
+static void run_send_thread(size_t passes)
+{
+    whenShallLock_fail = currentLock_call + passes + 1;
+    (void)sendThread_func(sendThread_arg);
+}
+
+
+/*the values behind the CONSTMAP_HANDLE mocks, shared by ConstMap_GetValue and Message_GetProperty*/
+static const char* get_constmap_value(CONSTMAP_HANDLE handle, const char* key)
+{
+    const char* result2;
+    if (handle == CONSTMAP_HANDLE_WITHOUT_SOURCE)
+    {
+        result2 = NULL;
+    }
+    else if (handle == CONSTMAP_HANDLE_WITH_SOURCE_NOT_SET_TO_MAPPING)
+    {
+        if (strcmp(key, "source") == 0)
+        {
+            result2 = "notMapping";
+        }
+        else
+        {
+            result2 = NULL;
+        }
+    }
+    else if (handle == CONSTMAP_HANDLE_VALID_1)
+    {
+        size_t i;
+        result2 = NULL;
+        for (i = 0; i < sizeof(CONSTMAP_KEYS_VALID_1)/sizeof(CONSTMAP_KEYS_VALID_1[0]); i++)
+        {
+            if (strcmp(CONSTMAP_KEYS_VALID_1[i], key) == 0)
+            {
+                result2 = CONSTMAP_VALUES_VALID_1[i];
+                break;
+            }
+        }
+    }
+    else if (handle == CONSTMAP_HANDLE_VALID_2)
+    {
+        size_t i;
+        result2 = NULL;
+        for (i = 0; i < sizeof(CONSTMAP_KEYS_VALID_2)/sizeof(CONSTMAP_KEYS_VALID_2[0]); i++)
+        {
+            if (strcmp(CONSTMAP_KEYS_VALID_2[i], key) == 0)
+            {
+                result2 = CONSTMAP_VALUES_VALID_2[i];
+                break;
+            }
+        }
+    }
+    else
+    {
+        result2 = NULL;
+    }
+    return result2;
+}
 
 TYPED_MOCK_CLASS(IotHubMocks, CGlobalMock)
 {
@@ -258,6 +362,10 @@ public:
     MOCK_STATIC_METHOD_1(, void*, VECTOR_back, VECTOR_HANDLE, handle)
     MOCK_METHOD_END(void*, BASEIMPLEMENTATION::VECTOR_back(handle))
 
+    MOCK_STATIC_METHOD_3(, void, VECTOR_erase, VECTOR_HANDLE, handle, void*, elements, size_t, numElements)
+        BASEIMPLEMENTATION::VECTOR_erase(handle, elements, numElements);
+    MOCK_VOID_METHOD_END()
+
     MOCK_STATIC_METHOD_1(, void, STRING_delete, STRING_HANDLE, s)
         BASEIMPLEMENTATION::STRING_delete(s);
     MOCK_VOID_METHOD_END()
@@ -306,6 +414,7 @@ public:
     MOCK_STATIC_METHOD_2(, IOTHUB_CLIENT_HANDLE, IoTHubClient_CreateWithTransport, TRANSPORT_HANDLE, transport, const IOTHUB_CLIENT_CONFIG*, config)
         IOTHUB_CLIENT_HANDLE result2;
         currentIoTHubClient_Create_call++;
+        lastClient_transport = transport;
         if (whenShallIoTHubClient_Create_fail == currentIoTHubClient_Create_call)
         {
             result2 = NULL;
@@ -349,52 +458,12 @@ public:
     MOCK_METHOD_END(CONSTMAP_HANDLE, result2)
 
     MOCK_STATIC_METHOD_2(, const char*, ConstMap_GetValue, CONSTMAP_HANDLE, handle, const char*, key)
-        const char* result2;
-        if (handle == CONSTMAP_HANDLE_WITHOUT_SOURCE)
-        {
-            result2 = NULL;
-        }
-        else if (handle == CONSTMAP_HANDLE_WITH_SOURCE_NOT_SET_TO_MAPPING)
-        {
-            if (strcmp(key, "source") == 0)
-            {
-                result2 = "notMapping";
-            }
-            else
-            {
-                result2 = NULL;
-            }
-        }
-        else if (handle == CONSTMAP_HANDLE_VALID_1)
-        {
-            size_t i;
-            result2 = NULL;
-            for (i = 0; i < sizeof(CONSTMAP_KEYS_VALID_1)/sizeof(CONSTMAP_KEYS_VALID_1[0]); i++)
-            {
-                if (strcmp(CONSTMAP_KEYS_VALID_1[i], key) == 0)
-                {
-                    result2 = CONSTMAP_VALUES_VALID_1[i];
-                    break;
-                }
-            }
-        }
-        else if (handle == CONSTMAP_HANDLE_VALID_2)
-        {
-            size_t i;
-            result2 = NULL;
-            for (i = 0; i < sizeof(CONSTMAP_KEYS_VALID_2)/sizeof(CONSTMAP_KEYS_VALID_2[0]); i++)
-            {
-                if (strcmp(CONSTMAP_KEYS_VALID_2[i], key) == 0)
-                {
-                    result2 = CONSTMAP_VALUES_VALID_2[i];
-                    break;
-                }
-            }
-        }
-        else
-        {
-            result2 = NULL;
-        }
+        const char* result2 = get_constmap_value(handle, key);
+    MOCK_METHOD_END(const char*, result2)
+
+    /*every MESSAGE_HANDLE has the properties of the CONSTMAP_HANDLE with the same value*/
+    MOCK_STATIC_METHOD_2(, const char*, Message_GetProperty, MESSAGE_HANDLE, message, const char*, key)
+        const char* result2 = get_constmap_value((CONSTMAP_HANDLE)message, key);
     MOCK_METHOD_END(const char*, result2)
 
     MOCK_STATIC_METHOD_3(, MAP_RESULT, Map_AddOrUpdate, MAP_HANDLE, handle, const char*, key, const char*, value)
@@ -404,7 +473,24 @@ public:
     MOCK_METHOD_END(MAP_RESULT, MAP_OK)
 
     MOCK_STATIC_METHOD_4(, IOTHUB_CLIENT_RESULT, IoTHubClient_SendEventAsync, IOTHUB_CLIENT_HANDLE, iotHubClientHandle, IOTHUB_MESSAGE_HANDLE, eventMessageHandle, IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK, eventConfirmationCallback, void*, userContextCallback)
-    MOCK_METHOD_END(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK)
+        IOTHUB_CLIENT_RESULT result2;
+        currentIoTHubClient_SendEventAsync_call++;
+        if (whenShallIoTHubClient_SendEventAsync_fail == currentIoTHubClient_SendEventAsync_call)
+        {
+            result2 = IOTHUB_CLIENT_ERROR;
+        }
+        else
+        {
+            if (eventConfirmationCallback != NULL)
+            {
+                ASSERT_IS_TRUE(pendingEvent_count < MAX_PENDING_EVENTS);
+                pendingEvent_callback[pendingEvent_count] = eventConfirmationCallback;
+                pendingEvent_context[pendingEvent_count] = userContextCallback;
+                pendingEvent_count++;
+            }
+            result2 = IOTHUB_CLIENT_OK;
+        }
+    MOCK_METHOD_END(IOTHUB_CLIENT_RESULT, result2)
 
     MOCK_STATIC_METHOD_3(, IOTHUB_CLIENT_RESULT, IoTHubClient_SetMessageCallback, IOTHUB_CLIENT_HANDLE, iotHubClientHandle, IOTHUB_CLIENT_MESSAGE_CALLBACK_ASYNC, messageCallback, void*, userContextCallback)
         IotHub_Receive_message_callback_function = messageCallback;
@@ -488,7 +574,16 @@ public:
     // transport mocks
 
     MOCK_STATIC_METHOD_3(,TRANSPORT_HANDLE, IoTHubTransport_Create, IOTHUB_CLIENT_TRANSPORT_PROVIDER, protocol, const char*, iotHubName, const char*, iotHubSuffix)
-        TRANSPORT_HANDLE result2 = (TRANSPORT_HANDLE)BASEIMPLEMENTATION::gballoc_malloc(1);
+        TRANSPORT_HANDLE result2;
+        currentIoTHubTransport_Create_call++;
+        if (whenShallIoTHubTransport_Create_fail == currentIoTHubTransport_Create_call)
+        {
+            result2 = NULL;
+        }
+        else
+        {
+            result2 = (TRANSPORT_HANDLE)BASEIMPLEMENTATION::gballoc_malloc(1);
+        }
     MOCK_METHOD_END(TRANSPORT_HANDLE, result2)
 
     MOCK_STATIC_METHOD_1(, void, IoTHubTransport_Destroy, TRANSPORT_HANDLE, transportHlHandle)
@@ -536,9 +631,81 @@ public:
         }
     MOCK_METHOD_END(const char*, result2);
 
+    MOCK_STATIC_METHOD_2(, double, json_object_get_number, const JSON_Object*, object, const char*, name)
+    MOCK_METHOD_END(double, 0);
+
     MOCK_STATIC_METHOD_1(, void, json_value_free, JSON_Value*, value)
         free(value);
     MOCK_VOID_METHOD_END();
+
+    // pipeline
+    MOCK_STATIC_METHOD_0(, LOCK_HANDLE, Lock_Init)
+    MOCK_METHOD_END(LOCK_HANDLE, (LOCK_HANDLE)malloc(1))
+
+    MOCK_STATIC_METHOD_1(, LOCK_RESULT, Lock, LOCK_HANDLE, lock)
+        LOCK_RESULT result2;
+        ++currentLock_call;
+        if ((whenShallLock_fail > 0) &&
+            (currentLock_call == whenShallLock_fail))
+        {
+            result2 = LOCK_ERROR;
+        }
+        else
+        {
+            result2 = LOCK_OK;
+        }
+    MOCK_METHOD_END(LOCK_RESULT, result2)
+
+    MOCK_STATIC_METHOD_1(, LOCK_RESULT, Unlock, LOCK_HANDLE, lock)
+    MOCK_METHOD_END(LOCK_RESULT, LOCK_OK)
+
+    MOCK_STATIC_METHOD_1(, LOCK_RESULT, Lock_Deinit, LOCK_HANDLE, lock)
+        free(lock);
+    MOCK_METHOD_END(LOCK_RESULT, LOCK_OK)
+
+    MOCK_STATIC_METHOD_0(, COND_HANDLE, Condition_Init)
+    MOCK_METHOD_END(COND_HANDLE, (COND_HANDLE)malloc(1))
+
+    MOCK_STATIC_METHOD_1(, COND_RESULT, Condition_Post, COND_HANDLE, handle)
+    MOCK_METHOD_END(COND_RESULT, COND_OK)
+
+    MOCK_STATIC_METHOD_3(, COND_RESULT, Condition_Wait, COND_HANDLE, handle, LOCK_HANDLE, lock, int, timeout_milliseconds)
+    MOCK_METHOD_END(COND_RESULT, COND_TIMEOUT)
+
+    MOCK_STATIC_METHOD_1(, void, Condition_Deinit, COND_HANDLE, handle)
+        free(handle);
+    MOCK_VOID_METHOD_END()
+
+    MOCK_STATIC_METHOD_3(, THREADAPI_RESULT, ThreadAPI_Create, THREAD_HANDLE*, threadHandle, THREAD_START_FUNC, func, void*, arg)
+        THREADAPI_RESULT result2;
+        ++currentThreadAPI_Create_call;
+        if (whenShallThreadAPI_Create_fail == currentThreadAPI_Create_call)
+        {
+            result2 = THREADAPI_ERROR;
+        }
+        else
+        {
+            /*the tests run the thread themselves*/
+            *threadHandle = (THREAD_HANDLE)0x42;
+            sendThread_func = func;
+            sendThread_arg = arg;
+            result2 = THREADAPI_OK;
+        }
+    MOCK_METHOD_END(THREADAPI_RESULT, result2)
+
+    MOCK_STATIC_METHOD_2(, THREADAPI_RESULT, ThreadAPI_Join, THREAD_HANDLE, threadHandle, int*, res)
+    MOCK_METHOD_END(THREADAPI_RESULT, THREADAPI_OK)
+
+    MOCK_STATIC_METHOD_0(, TICK_COUNTER_HANDLE, tickcounter_create)
+    MOCK_METHOD_END(TICK_COUNTER_HANDLE, (TICK_COUNTER_HANDLE)malloc(1))
+
+    MOCK_STATIC_METHOD_1(, void, tickcounter_destroy, TICK_COUNTER_HANDLE, tick_counter)
+        free(tick_counter);
+    MOCK_VOID_METHOD_END()
+
+    MOCK_STATIC_METHOD_2(, int, tickcounter_get_current_ms, TICK_COUNTER_HANDLE, tick_counter, tickcounter_ms_t*, current_ms)
+        *current_ms = currentTick_ms;
+    MOCK_METHOD_END(int, 0)
 };
 
 DECLARE_GLOBAL_MOCK_METHOD_1(IotHubMocks, , void*, gballoc_malloc, size_t, size);
@@ -564,6 +731,7 @@ DECLARE_GLOBAL_MOCK_METHOD_1(IotHubMocks, , CONSTMAP_HANDLE, Message_GetProperti
 DECLARE_GLOBAL_MOCK_METHOD_1(IotHubMocks, , MESSAGE_HANDLE, Message_Create, const MESSAGE_CONFIG*, cfg)
 DECLARE_GLOBAL_MOCK_METHOD_1(IotHubMocks, , void, Message_Destroy, MESSAGE_HANDLE, message)
 DECLARE_GLOBAL_MOCK_METHOD_2(IotHubMocks, , const char*, ConstMap_GetValue, CONSTMAP_HANDLE, handle, const char*, key)
+DECLARE_GLOBAL_MOCK_METHOD_2(IotHubMocks, , const char*, Message_GetProperty, MESSAGE_HANDLE, message, const char*, key)
 DECLARE_GLOBAL_MOCK_METHOD_3(IotHubMocks, , MAP_RESULT, Map_AddOrUpdate, MAP_HANDLE, handle, const char*, key, const char*, value);
 DECLARE_GLOBAL_MOCK_METHOD_3(IotHubMocks, , MAP_RESULT, Map_Add, MAP_HANDLE, handle, const char*, key, const char*, value);
 DECLARE_GLOBAL_MOCK_METHOD_4(IotHubMocks, , CONSTMAP_RESULT, ConstMap_GetInternals, CONSTMAP_HANDLE, handle, const char*const**, keys, const char*const**, values, size_t*, count)
@@ -577,13 +745,28 @@ DECLARE_GLOBAL_MOCK_METHOD_3(IotHubMocks, , IOTHUB_MESSAGE_RESULT, IoTHubMessage
 DECLARE_GLOBAL_MOCK_METHOD_1(IotHubMocks, , const char*, IoTHubMessage_GetString, IOTHUB_MESSAGE_HANDLE, iotHubMessageHandle)
 DECLARE_GLOBAL_MOCK_METHOD_1(IotHubMocks, , IOTHUBMESSAGE_CONTENT_TYPE, IoTHubMessage_GetContentType, IOTHUB_MESSAGE_HANDLE, iotHubMessageHandle)
 DECLARE_GLOBAL_MOCK_METHOD_1(IotHubMocks, , void*, VECTOR_back, VECTOR_HANDLE, handle)
+DECLARE_GLOBAL_MOCK_METHOD_3(IotHubMocks, , void, VECTOR_erase, VECTOR_HANDLE, handle, void*, elements, size_t, numElements)
 DECLARE_GLOBAL_MOCK_METHOD_3(IotHubMocks, , TRANSPORT_HANDLE, IoTHubTransport_Create, IOTHUB_CLIENT_TRANSPORT_PROVIDER, protocol, const char*, iotHubName, const char*, iotHubSuffix)
 DECLARE_GLOBAL_MOCK_METHOD_1(IotHubMocks, , void, IoTHubTransport_Destroy, TRANSPORT_HANDLE, transportHlHandle)
 DECLARE_GLOBAL_MOCK_METHOD_3(IotHubMocks, , BROKER_RESULT, Broker_Publish, BROKER_HANDLE, broker, MODULE_HANDLE, source, MESSAGE_HANDLE, message)
 DECLARE_GLOBAL_MOCK_METHOD_1(IotHubMocks, , JSON_Value*, json_parse_string, const char *, filename);
 DECLARE_GLOBAL_MOCK_METHOD_1(IotHubMocks, , JSON_Object*, json_value_get_object, const JSON_Value*, value);
 DECLARE_GLOBAL_MOCK_METHOD_2(IotHubMocks, , const char*, json_object_get_string, const JSON_Object*, object, const char*, name);
+DECLARE_GLOBAL_MOCK_METHOD_2(IotHubMocks, , double, json_object_get_number, const JSON_Object*, object, const char*, name);
 DECLARE_GLOBAL_MOCK_METHOD_1(IotHubMocks, , void, json_value_free, JSON_Value*, value);
+DECLARE_GLOBAL_MOCK_METHOD_0(IotHubMocks, , LOCK_HANDLE, Lock_Init);
+DECLARE_GLOBAL_MOCK_METHOD_1(IotHubMocks, , LOCK_RESULT, Lock, LOCK_HANDLE, lock);
+DECLARE_GLOBAL_MOCK_METHOD_1(IotHubMocks, , LOCK_RESULT, Unlock, LOCK_HANDLE, lock);
+DECLARE_GLOBAL_MOCK_METHOD_1(IotHubMocks, , LOCK_RESULT, Lock_Deinit, LOCK_HANDLE, lock);
+DECLARE_GLOBAL_MOCK_METHOD_0(IotHubMocks, , COND_HANDLE, Condition_Init);
+DECLARE_GLOBAL_MOCK_METHOD_1(IotHubMocks, , COND_RESULT, Condition_Post, COND_HANDLE, handle);
+DECLARE_GLOBAL_MOCK_METHOD_3(IotHubMocks, , COND_RESULT, Condition_Wait, COND_HANDLE, handle, LOCK_HANDLE, lock, int, timeout_milliseconds);
+DECLARE_GLOBAL_MOCK_METHOD_1(IotHubMocks, , void, Condition_Deinit, COND_HANDLE, handle);
+DECLARE_GLOBAL_MOCK_METHOD_3(IotHubMocks, , THREADAPI_RESULT, ThreadAPI_Create, THREAD_HANDLE*, threadHandle, THREAD_START_FUNC, func, void*, arg);
+DECLARE_GLOBAL_MOCK_METHOD_2(IotHubMocks, , THREADAPI_RESULT, ThreadAPI_Join, THREAD_HANDLE, threadHandle, int*, res);
+DECLARE_GLOBAL_MOCK_METHOD_0(IotHubMocks, , TICK_COUNTER_HANDLE, tickcounter_create);
+DECLARE_GLOBAL_MOCK_METHOD_1(IotHubMocks, , void, tickcounter_destroy, TICK_COUNTER_HANDLE, tick_counter);
+DECLARE_GLOBAL_MOCK_METHOD_2(IotHubMocks, , int, tickcounter_get_current_ms, TICK_COUNTER_HANDLE, tick_counter, tickcounter_ms_t*, current_ms);
 
 BEGIN_TEST_SUITE(iothub_ut)
 
@@ -625,6 +808,24 @@ BEGIN_TEST_SUITE(iothub_ut)
 
         currentIoTHubClient_Create_call = 0;
         whenShallIoTHubClient_Create_fail = 0;
+        lastClient_transport = NULL;
+
+        currentIoTHubTransport_Create_call = 0;
+        whenShallIoTHubTransport_Create_fail = 0;
+
+        currentIoTHubClient_SendEventAsync_call = 0;
+        whenShallIoTHubClient_SendEventAsync_fail = 0;
+
+        currentLock_call = 0;
+        whenShallLock_fail = 0;
+
+        currentThreadAPI_Create_call = 0;
+        whenShallThreadAPI_Create_fail = 0;
+        sendThread_func = NULL;
+        sendThread_arg = NULL;
+
+        currentTick_ms = 0;
+        pendingEvent_count = 0;
 
     }
 
@@ -679,6 +880,16 @@ BEGIN_TEST_SUITE(iothub_ut)
         STRICT_EXPECTED_CALL(mocks, gballoc_malloc(strlen("aHubName") + 1));
         STRICT_EXPECTED_CALL(mocks, gballoc_malloc(strlen("suffix.name") + 1));
         STRICT_EXPECTED_CALL(mocks, gballoc_malloc(sizeof(IOTHUB_CONFIG)));
+        STRICT_EXPECTED_CALL(mocks, json_object_get_number(IGNORED_PTR_ARG, "BatchSize"))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, json_object_get_number(IGNORED_PTR_ARG, "BatchTimeoutMs"))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, json_object_get_number(IGNORED_PTR_ARG, "MaxInFlight"))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, json_object_get_number(IGNORED_PTR_ARG, "MaxDevices"))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, json_object_get_number(IGNORED_PTR_ARG, "TransportCount"))
+            .IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, json_value_free(IGNORED_PTR_ARG))
             .IgnoreArgument(1);
 
@@ -693,6 +904,72 @@ BEGIN_TEST_SUITE(iothub_ut)
         Module_FreeConfiguration(result);
     }
 
+    /*Tests_SRS_IOTHUBMODULE_30_001: [ `IotHub_ParseConfigurationFromJson` shall read the optional numbers "BatchSize", "BatchTimeoutMs", "MaxInFlight", "MaxDevices" and "TransportCount", using 0 for the missing ones. ]*/
+    TEST_FUNCTION(IotHub_ParseConfigurationFromJson_reads_the_batching_numbers)
+    {
+        ///arrange
+        CNiceCallComparer<IotHubMocks> mocks;
+        const char * validJsonString = "calling it valid makes it so";
+
+        STRICT_EXPECTED_CALL(mocks, json_object_get_string(IGNORED_PTR_ARG, "Transport"))
+            .IgnoreArgument(1)
+            .SetReturn("HTTP");
+        STRICT_EXPECTED_CALL(mocks, json_object_get_number(IGNORED_PTR_ARG, "BatchSize"))
+            .IgnoreArgument(1)
+            .SetReturn(8.0);
+        STRICT_EXPECTED_CALL(mocks, json_object_get_number(IGNORED_PTR_ARG, "BatchTimeoutMs"))
+            .IgnoreArgument(1)
+            .SetReturn(250.0);
+        STRICT_EXPECTED_CALL(mocks, json_object_get_number(IGNORED_PTR_ARG, "MaxInFlight"))
+            .IgnoreArgument(1)
+            .SetReturn(4.0);
+        STRICT_EXPECTED_CALL(mocks, json_object_get_number(IGNORED_PTR_ARG, "MaxDevices"))
+            .IgnoreArgument(1)
+            .SetReturn(500.0);
+        STRICT_EXPECTED_CALL(mocks, json_object_get_number(IGNORED_PTR_ARG, "TransportCount"))
+            .IgnoreArgument(1)
+            .SetReturn(3.0);
+
+        ///act
+        auto result = (IOTHUB_CONFIG*)Module_ParseConfigurationFromJson(validJsonString);
+
+        ///assert
+        ASSERT_IS_NOT_NULL(result);
+        ASSERT_ARE_EQUAL(size_t, 8, result->batchSize);
+        ASSERT_ARE_EQUAL(int, 250, (int)result->batchTimeoutMs);
+        ASSERT_ARE_EQUAL(size_t, 4, result->maxInFlight);
+        ASSERT_ARE_EQUAL(size_t, 500, result->maxDevices);
+        ASSERT_ARE_EQUAL(size_t, 3, result->transportCount);
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        Module_FreeConfiguration(result);
+    }
+
+    /*Tests_SRS_IOTHUBMODULE_30_002: [ If "BatchSize", "BatchTimeoutMs", "MaxInFlight", "MaxDevices" or "TransportCount" is negative then `IotHub_ParseConfigurationFromJson` shall fail and return NULL. ]*/
+    TEST_FUNCTION(IotHub_ParseConfigurationFromJson_returns_null_when_a_batching_number_is_negative)
+    {
+        ///arrange
+        CNiceCallComparer<IotHubMocks> mocks;
+        const char * validJsonString = "calling it valid makes it so";
+
+        STRICT_EXPECTED_CALL(mocks, json_object_get_string(IGNORED_PTR_ARG, "Transport"))
+            .IgnoreArgument(1)
+            .SetReturn("HTTP");
+        STRICT_EXPECTED_CALL(mocks, json_object_get_number(IGNORED_PTR_ARG, "MaxInFlight"))
+            .IgnoreArgument(1)
+            .SetReturn(-1.0);
+
+        ///act
+        auto result = Module_ParseConfigurationFromJson(validJsonString);
+
+        ///assert
+        ASSERT_IS_NULL(result);
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+    }
+
     TEST_FUNCTION(IotHub_ParseConfigurationFromJson_returns_NULL_when_malloc_fails_1)
     {
         ///arrange
@@ -1196,39 +1473,133 @@ BEGIN_TEST_SUITE(iothub_ut)
         Module_Destroy(module);
     }
 
-    TEST_FUNCTION(IotHub_Create_creates_a_transport_for_AMQP)
+    /*Tests_SRS_IOTHUBMODULE_30_003: [ If `configuration->batchSize` is greater than 1, or `configuration->maxInFlight` or `configuration->maxDevices` is not 0, `IotHub_Create` shall create a lock, two conditions, a tick counter and a thread sending the batches of messages. ]*/
+    TEST_FUNCTION(IotHub_Create_pipelined_starts_the_send_thread)
     {
         ///arrange
         IotHubMocks mocks;
-        AutoConfig config(AMQP_Protocol);
+        AutoConfig config;
+        ((IOTHUB_CONFIG*)config)->batchSize = 4;
         mocks.ResetAllCalls();
 
-        EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG));
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, VECTOR_create(IGNORED_NUM_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, STRING_construct(name));
+        STRICT_EXPECTED_CALL(mocks, STRING_construct(suffix));
+        STRICT_EXPECTED_CALL(mocks, IoTHubTransport_Create(HTTP_Protocol, name, suffix));
+        STRICT_EXPECTED_CALL(mocks, Lock_Init());
+        STRICT_EXPECTED_CALL(mocks, Condition_Init())
+            .ExpectedTimesExactly(2);
+        STRICT_EXPECTED_CALL(mocks, tickcounter_create());
+        STRICT_EXPECTED_CALL(mocks, ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .IgnoreAllArguments();
 
-        EXPECTED_CALL(mocks, VECTOR_create(IGNORED_NUM_ARG));
+        ///act
+        auto module = Module_Create(BROKER_HANDLE_VALID, config);
 
-        EXPECTED_CALL(mocks, STRING_construct(name));
+        ///assert
+        ASSERT_IS_NOT_NULL(module);
+        ASSERT_IS_NOT_NULL((void*)sendThread_func);
+        ASSERT_ARE_EQUAL(void_ptr, (void*)module, sendThread_arg);
+        mocks.AssertActualAndExpectedCalls();
 
-        EXPECTED_CALL(mocks, STRING_construct(suffix));
+        ///cleanup
+        Module_Destroy(module);
+    }
 
-        STRICT_EXPECTED_CALL(mocks, IoTHubTransport_Create(AMQP_Protocol, name, suffix));
+    /*Tests_SRS_IOTHUBMODULE_30_003: [ If `configuration->batchSize` is greater than 1, or `configuration->maxInFlight` or `configuration->maxDevices` is not 0, `IotHub_Create` shall create a lock, two conditions, a tick counter and a thread sending the batches of messages. ]*/
+    TEST_FUNCTION(IotHub_Create_with_maxDevices_starts_the_send_thread)
+    {
+        ///arrange
+        IotHubMocks mocks;
+        AutoConfig config;
+        ((IOTHUB_CONFIG*)config)->maxDevices = 2;
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, VECTOR_create(IGNORED_NUM_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, STRING_construct(name));
+        STRICT_EXPECTED_CALL(mocks, STRING_construct(suffix));
+        STRICT_EXPECTED_CALL(mocks, IoTHubTransport_Create(HTTP_Protocol, name, suffix));
+        STRICT_EXPECTED_CALL(mocks, Lock_Init());
+        STRICT_EXPECTED_CALL(mocks, Condition_Init())
+            .ExpectedTimesExactly(2);
+        STRICT_EXPECTED_CALL(mocks, tickcounter_create());
+        STRICT_EXPECTED_CALL(mocks, ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .IgnoreAllArguments();
 
         ///act
         auto module = Module_Create(BROKER_HANDLE_VALID, config);
 
         ///assert
         ASSERT_IS_NOT_NULL(module);
+        ASSERT_IS_NOT_NULL((void*)sendThread_func);
         mocks.AssertActualAndExpectedCalls();
 
         ///cleanup
         Module_Destroy(module);
     }
 
-    TEST_FUNCTION(IotHub_Create_does_not_create_a_transport_for_MQTT)
+    /*Tests_SRS_IOTHUBMODULE_30_004: [ If creating any of them fails, `IotHub_Create` shall fail and return `NULL`. ]*/
+    TEST_FUNCTION(IotHub_Create_pipelined_fails_when_ThreadAPI_Create_fails)
     {
         ///arrange
         IotHubMocks mocks;
-        AutoConfig config(MQTT_Protocol);
+        AutoConfig config;
+        ((IOTHUB_CONFIG*)config)->maxInFlight = 2;
+        mocks.ResetAllCalls();
+        whenShallThreadAPI_Create_fail = 1;
+
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, VECTOR_create(IGNORED_NUM_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, STRING_construct(name));
+        STRICT_EXPECTED_CALL(mocks, STRING_construct(suffix));
+        STRICT_EXPECTED_CALL(mocks, IoTHubTransport_Create(HTTP_Protocol, name, suffix));
+        STRICT_EXPECTED_CALL(mocks, Lock_Init());
+        STRICT_EXPECTED_CALL(mocks, Condition_Init())
+            .ExpectedTimesExactly(2);
+        STRICT_EXPECTED_CALL(mocks, tickcounter_create());
+        STRICT_EXPECTED_CALL(mocks, ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .IgnoreAllArguments();
+
+        STRICT_EXPECTED_CALL(mocks, tickcounter_destroy(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, Condition_Deinit(IGNORED_PTR_ARG))
+            .IgnoreArgument(1)
+            .ExpectedTimesExactly(2);
+        STRICT_EXPECTED_CALL(mocks, Lock_Deinit(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
+            .IgnoreArgument(1)
+            .ExpectedTimesExactly(2);
+        STRICT_EXPECTED_CALL(mocks, IoTHubTransport_Destroy(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, VECTOR_destroy(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+
+        ///act
+        auto module = Module_Create(BROKER_HANDLE_VALID, config);
+
+        ///assert
+        ASSERT_IS_NULL(module);
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+    }
+
+    TEST_FUNCTION(IotHub_Create_creates_a_transport_for_AMQP)
+    {
+        ///arrange
+        IotHubMocks mocks;
+        AutoConfig config(AMQP_Protocol);
         mocks.ResetAllCalls();
 
         EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG));
@@ -1239,8 +1610,7 @@ BEGIN_TEST_SUITE(iothub_ut)
 
         EXPECTED_CALL(mocks, STRING_construct(suffix));
 
-        EXPECTED_CALL(mocks, IoTHubTransport_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .NeverInvoked();
+        STRICT_EXPECTED_CALL(mocks, IoTHubTransport_Create(AMQP_Protocol, name, suffix));
 
         ///act
         auto module = Module_Create(BROKER_HANDLE_VALID, config);
@@ -1253,11 +1623,13 @@ BEGIN_TEST_SUITE(iothub_ut)
         Module_Destroy(module);
     }
 
-    TEST_FUNCTION(IotHub_Create_does_not_create_an_unrecognized_transport)
+    /*Tests_SRS_IOTHUBMODULE_30_022: [ `IotHub_Create` shall create `configuration->transportCount` shared transports, or one if it is 0. ]*/
+    TEST_FUNCTION(IotHub_Create_creates_transportCount_transports)
     {
         ///arrange
         IotHubMocks mocks;
-        AutoConfig config((IOTHUB_CLIENT_TRANSPORT_PROVIDER)0x42);
+        AutoConfig config(AMQP_Protocol);
+        ((IOTHUB_CONFIG*)config)->transportCount = 3;
         mocks.ResetAllCalls();
 
         EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG));
@@ -1268,8 +1640,8 @@ BEGIN_TEST_SUITE(iothub_ut)
 
         EXPECTED_CALL(mocks, STRING_construct(suffix));
 
-        EXPECTED_CALL(mocks, IoTHubTransport_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .NeverInvoked();
+        STRICT_EXPECTED_CALL(mocks, IoTHubTransport_Create(AMQP_Protocol, name, suffix))
+            .ExpectedTimesExactly(3);
 
         ///act
         auto module = Module_Create(BROKER_HANDLE_VALID, config);
@@ -1282,8 +1654,102 @@ BEGIN_TEST_SUITE(iothub_ut)
         Module_Destroy(module);
     }
 
-    /*Tests_SRS_IOTHUBMODULE_02_027: [ When `IotHub_Create` encounters an internal failure it shall fail and return `NULL`. ]*/
-    TEST_FUNCTION(IotHub_Create_fails_when_STRING_construct_fails_1)
+    /*Tests_SRS_IOTHUBMODULE_17_002: [ If creating the shared transport fails, `IotHub_Create` shall fail and return `NULL`. ]*/
+    TEST_FUNCTION(IotHub_Create_fails_when_a_later_transport_create_fails)
+    {
+        ///arrange
+        IotHubMocks mocks;
+        AutoConfig config;
+        ((IOTHUB_CONFIG*)config)->transportCount = 3;
+        mocks.ResetAllCalls();
+        whenShallIoTHubTransport_Create_fail = 2;
+
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+
+        STRICT_EXPECTED_CALL(mocks, VECTOR_create(IGNORED_NUM_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, VECTOR_destroy(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+
+        STRICT_EXPECTED_CALL(mocks, IoTHubTransport_Create(HTTP_Protocol, name, suffix))
+            .ExpectedTimesExactly(2);
+        /*only the first one has been created*/
+        STRICT_EXPECTED_CALL(mocks, IoTHubTransport_Destroy(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+
+        ///act
+        auto module = Module_Create(BROKER_HANDLE_VALID, config);
+
+        ///assert
+        ASSERT_IS_NULL(module);
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+    }
+
+    TEST_FUNCTION(IotHub_Create_does_not_create_a_transport_for_MQTT)
+    {
+        ///arrange
+        IotHubMocks mocks;
+        AutoConfig config(MQTT_Protocol);
+        mocks.ResetAllCalls();
+
+        EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG));
+
+        EXPECTED_CALL(mocks, VECTOR_create(IGNORED_NUM_ARG));
+
+        EXPECTED_CALL(mocks, STRING_construct(name));
+
+        EXPECTED_CALL(mocks, STRING_construct(suffix));
+
+        EXPECTED_CALL(mocks, IoTHubTransport_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .NeverInvoked();
+
+        ///act
+        auto module = Module_Create(BROKER_HANDLE_VALID, config);
+
+        ///assert
+        ASSERT_IS_NOT_NULL(module);
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        Module_Destroy(module);
+    }
+
+    TEST_FUNCTION(IotHub_Create_does_not_create_an_unrecognized_transport)
+    {
+        ///arrange
+        IotHubMocks mocks;
+        AutoConfig config((IOTHUB_CLIENT_TRANSPORT_PROVIDER)0x42);
+        mocks.ResetAllCalls();
+
+        EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG));
+
+        EXPECTED_CALL(mocks, VECTOR_create(IGNORED_NUM_ARG));
+
+        EXPECTED_CALL(mocks, STRING_construct(name));
+
+        EXPECTED_CALL(mocks, STRING_construct(suffix));
+
+        EXPECTED_CALL(mocks, IoTHubTransport_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .NeverInvoked();
+
+        ///act
+        auto module = Module_Create(BROKER_HANDLE_VALID, config);
+
+        ///assert
+        ASSERT_IS_NOT_NULL(module);
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        Module_Destroy(module);
+    }
+
+    /*Tests_SRS_IOTHUBMODULE_02_027: [ When `IotHub_Create` encounters an internal failure it shall fail and return `NULL`. ]*/
+    TEST_FUNCTION(IotHub_Create_fails_when_STRING_construct_fails_1)
     {
         ///arrange
         IotHubMocks mocks;
@@ -1571,6 +2037,10 @@ BEGIN_TEST_SUITE(iothub_ut)
         STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
             .IgnoreArgument(1);
 
+        /*this is the personality index*/
+        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+
         /* transport handle */
         STRICT_EXPECTED_CALL(mocks, IoTHubTransport_Destroy(IGNORED_PTR_ARG))
             .IgnoreArgument(1);
@@ -1639,6 +2109,10 @@ BEGIN_TEST_SUITE(iothub_ut)
         STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
             .IgnoreArgument(1);
 
+        /*this is the personality index*/
+        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+
         /* transport handle */
         STRICT_EXPECTED_CALL(mocks, IoTHubTransport_Destroy(IGNORED_PTR_ARG))
             .IgnoreArgument(1);
@@ -1709,19 +2183,13 @@ BEGIN_TEST_SUITE(iothub_ut)
         auto module = Module_Create(BROKER_HANDLE_VALID, config);
         mocks.ResetAllCalls();
 
-        STRICT_EXPECTED_CALL(mocks, Message_GetProperties(MESSAGE_HANDLE_VALID_1));
-        STRICT_EXPECTED_CALL(mocks, ConstMap_Destroy(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(CONSTMAP_HANDLE_VALID_1, "source"));
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(MESSAGE_HANDLE_VALID_1, "source"));
 
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(CONSTMAP_HANDLE_VALID_1, "deviceName"));
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(MESSAGE_HANDLE_VALID_1, "deviceName"));
 
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(CONSTMAP_HANDLE_VALID_1, "deviceKey"));
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(MESSAGE_HANDLE_VALID_1, "deviceKey"));
 
-        /*VECTOR_find_if incurs a STRING_c_str until it find the deviceName. None in this test*/
-        STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreAllArguments();
+        /*the index is empty, the lookup does not compare any deviceName*/
 
         /*because the deviceName is brand new, it will be added as a new personality*/
         {/*separate scope for personality building*/
@@ -1752,6 +2220,10 @@ BEGIN_TEST_SUITE(iothub_ut)
                 .IgnoreArgument(3);
         }
 
+        /*the first personality allocates the index*/
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
+            .IgnoreArgument(1);
+
         /*adding the personality to the VECTOR or personalities*/
         STRICT_EXPECTED_CALL(mocks, VECTOR_push_back(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1))
             .IgnoreArgument(1)
@@ -1839,6 +2311,39 @@ BEGIN_TEST_SUITE(iothub_ut)
         Module_Destroy(module);
     }
 
+    /*Tests_SRS_IOTHUBMODULE_30_023: [ The personality shall use the shared transport picked by the hash of its device name modulo the number of shared transports. ]*/
+    TEST_FUNCTION(IotHub_Receive_spreads_the_devices_over_the_shared_transports)
+    {
+        ///arrange
+        CNiceCallComparer<IotHubMocks> mocks;
+        AutoConfig config;
+        ((IOTHUB_CONFIG*)config)->transportCount = 3;
+        auto module = Module_Create(BROKER_HANDLE_VALID, config);
+
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_CreateWithTransport(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .IgnoreAllArguments()
+            .ExpectedTimesExactly(2);
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_Create(IGNORED_PTR_ARG))
+            .IgnoreArgument(1)
+            .NeverInvoked();
+
+        ///act
+        Module_Receive(module, MESSAGE_HANDLE_VALID_1);
+        TRANSPORT_HANDLE firstTransport = lastClient_transport;
+        Module_Receive(module, MESSAGE_HANDLE_VALID_2);
+        TRANSPORT_HANDLE secondTransport = lastClient_transport;
+
+        ///assert
+        /*the hashes of "firstDevice" and "secondDevice" are 2 and 0 modulo 3*/
+        ASSERT_IS_NOT_NULL(firstTransport);
+        ASSERT_IS_NOT_NULL(secondTransport);
+        ASSERT_ARE_NOT_EQUAL(void_ptr, (void*)firstTransport, (void*)secondTransport);
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        Module_Destroy(module);
+    }
+
     /*Tests_SRS_IOTHUBMODULE_05_003: [ If a new personality is created and the module's transport has not already been created, an `IOTHUB_CLIENT_HANDLE` will be added to the personality by a call to `IoTHubClient_Create` with the corresponding transport provider. ]*/
     TEST_FUNCTION(IotHub_Receive_creates_a_client_with_MQTT_transport)
     {
@@ -1897,23 +2402,16 @@ BEGIN_TEST_SUITE(iothub_ut)
         Module_Receive(module, MESSAGE_HANDLE_VALID_1);
         mocks.ResetAllCalls();
 
-        STRICT_EXPECTED_CALL(mocks, Message_GetProperties(MESSAGE_HANDLE_VALID_1));
-        STRICT_EXPECTED_CALL(mocks, ConstMap_Destroy(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(CONSTMAP_HANDLE_VALID_1, "source"));
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(MESSAGE_HANDLE_VALID_1, "source"));
 
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(CONSTMAP_HANDLE_VALID_1, "deviceName"));
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(MESSAGE_HANDLE_VALID_1, "deviceName"));
 
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(CONSTMAP_HANDLE_VALID_1, "deviceKey"));
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(MESSAGE_HANDLE_VALID_1, "deviceKey"));
 
-        /*VECTOR_find_if incurs a STRING_c_str until it find the deviceName. One in this test*/
+        /*the index lookup compares the deviceName of the personality having the same hash*/
         STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
             .IgnoreArgument(1);
 
-        STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreAllArguments();
-
         { /*scope for creating the IOTHUBMESSAGE from GWMESSAGE*/
 
           /*gettng the GW message content*/
@@ -1981,22 +2479,13 @@ BEGIN_TEST_SUITE(iothub_ut)
         Module_Receive(module, MESSAGE_HANDLE_VALID_1);
         mocks.ResetAllCalls();
 
-        STRICT_EXPECTED_CALL(mocks, Message_GetProperties(MESSAGE_HANDLE_VALID_2));
-        STRICT_EXPECTED_CALL(mocks, ConstMap_Destroy(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(MESSAGE_HANDLE_VALID_2, "source"));
 
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(CONSTMAP_HANDLE_VALID_2, "source"));
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(MESSAGE_HANDLE_VALID_2, "deviceName"));
 
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(CONSTMAP_HANDLE_VALID_2, "deviceName"));
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(MESSAGE_HANDLE_VALID_2, "deviceKey"));
 
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(CONSTMAP_HANDLE_VALID_2, "deviceKey"));
-
-        /*VECTOR_find_if incurs a STRING_c_str until it find the deviceName. One in this test*/
-        STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-
-        STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreAllArguments();
+        /*no personality in the index has the hash of secondDevice, the lookup does not compare any deviceName*/
 
         /*because the deviceName is brand new, it will be added as a new personality*/
         {/*separate scope for personality building*/
@@ -2095,19 +2584,13 @@ BEGIN_TEST_SUITE(iothub_ut)
         auto module = Module_Create(BROKER_HANDLE_VALID, config);
         mocks.ResetAllCalls();
 
-        STRICT_EXPECTED_CALL(mocks, Message_GetProperties(MESSAGE_HANDLE_VALID_1));
-        STRICT_EXPECTED_CALL(mocks, ConstMap_Destroy(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(MESSAGE_HANDLE_VALID_1, "source"));
 
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(CONSTMAP_HANDLE_VALID_1, "source"));
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(MESSAGE_HANDLE_VALID_1, "deviceName"));
 
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(CONSTMAP_HANDLE_VALID_1, "deviceName"));
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(MESSAGE_HANDLE_VALID_1, "deviceKey"));
 
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(CONSTMAP_HANDLE_VALID_1, "deviceKey"));
-
-        /*VECTOR_find_if incurs a STRING_c_str until it find the deviceName. None in this test*/
-        STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreAllArguments();
+        /*the index is empty, the lookup does not compare any deviceName*/
 
         /*because the deviceName is brand new, it will be added as a new personality*/
         {/*separate scope for personality building*/
@@ -2138,6 +2621,10 @@ BEGIN_TEST_SUITE(iothub_ut)
                 .IgnoreArgument(3);
         }
 
+        /*the first personality allocates the index*/
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
+            .IgnoreArgument(1);
+
         /*adding the personality to the VECTOR or personalities*/
         STRICT_EXPECTED_CALL(mocks, VECTOR_push_back(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1))
             .IgnoreArgument(1)
@@ -2211,19 +2698,13 @@ BEGIN_TEST_SUITE(iothub_ut)
         auto module = Module_Create(BROKER_HANDLE_VALID, config);
         mocks.ResetAllCalls();
 
-        STRICT_EXPECTED_CALL(mocks, Message_GetProperties(MESSAGE_HANDLE_VALID_1));
-        STRICT_EXPECTED_CALL(mocks, ConstMap_Destroy(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(CONSTMAP_HANDLE_VALID_1, "source"));
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(MESSAGE_HANDLE_VALID_1, "source"));
 
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(CONSTMAP_HANDLE_VALID_1, "deviceName"));
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(MESSAGE_HANDLE_VALID_1, "deviceName"));
 
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(CONSTMAP_HANDLE_VALID_1, "deviceKey"));
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(MESSAGE_HANDLE_VALID_1, "deviceKey"));
 
-        /*VECTOR_find_if incurs a STRING_c_str until it find the deviceName. None in this test*/
-        STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreAllArguments();
+        /*the index is empty, the lookup does not compare any deviceName*/
 
         /*because the deviceName is brand new, it will be added as a new personality*/
         {/*separate scope for personality building*/
@@ -2255,6 +2736,10 @@ BEGIN_TEST_SUITE(iothub_ut)
                 .IgnoreArgument(3);
         }
 
+        /*the first personality allocates the index*/
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
+            .IgnoreArgument(1);
+
         /*adding the personality to the VECTOR or personalities*/
         STRICT_EXPECTED_CALL(mocks, VECTOR_push_back(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1))
             .IgnoreArgument(1)
@@ -2323,19 +2808,13 @@ BEGIN_TEST_SUITE(iothub_ut)
         auto module = Module_Create(BROKER_HANDLE_VALID, config);
         mocks.ResetAllCalls();
 
-        STRICT_EXPECTED_CALL(mocks, Message_GetProperties(MESSAGE_HANDLE_VALID_1));
-        STRICT_EXPECTED_CALL(mocks, ConstMap_Destroy(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(CONSTMAP_HANDLE_VALID_1, "source"));
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(MESSAGE_HANDLE_VALID_1, "source"));
 
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(CONSTMAP_HANDLE_VALID_1, "deviceName"));
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(MESSAGE_HANDLE_VALID_1, "deviceName"));
 
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(CONSTMAP_HANDLE_VALID_1, "deviceKey"));
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(MESSAGE_HANDLE_VALID_1, "deviceKey"));
 
-        /*VECTOR_find_if incurs a STRING_c_str until it find the deviceName. None in this test*/
-        STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreAllArguments();
+        /*the index is empty, the lookup does not compare any deviceName*/
 
         /*because the deviceName is brand new, it will be added as a new personality*/
         {/*separate scope for personality building*/
@@ -2367,6 +2846,10 @@ BEGIN_TEST_SUITE(iothub_ut)
                 .IgnoreArgument(3);
         }
 
+        /*the first personality allocates the index*/
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
+            .IgnoreArgument(1);
+
         /*adding the personality to the VECTOR or personalities*/
         STRICT_EXPECTED_CALL(mocks, VECTOR_push_back(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1))
             .IgnoreArgument(1)
@@ -2431,19 +2914,13 @@ BEGIN_TEST_SUITE(iothub_ut)
         auto module = Module_Create(BROKER_HANDLE_VALID, config);
         mocks.ResetAllCalls();
 
-        STRICT_EXPECTED_CALL(mocks, Message_GetProperties(MESSAGE_HANDLE_VALID_1));
-        STRICT_EXPECTED_CALL(mocks, ConstMap_Destroy(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(CONSTMAP_HANDLE_VALID_1, "source"));
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(MESSAGE_HANDLE_VALID_1, "source"));
 
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(CONSTMAP_HANDLE_VALID_1, "deviceName"));
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(MESSAGE_HANDLE_VALID_1, "deviceName"));
 
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(CONSTMAP_HANDLE_VALID_1, "deviceKey"));
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(MESSAGE_HANDLE_VALID_1, "deviceKey"));
 
-        /*VECTOR_find_if incurs a STRING_c_str until it find the deviceName. None in this test*/
-        STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreAllArguments();
+        /*the index is empty, the lookup does not compare any deviceName*/
 
         /*because the deviceName is brand new, it will be added as a new personality*/
         {/*separate scope for personality building*/
@@ -2473,6 +2950,10 @@ BEGIN_TEST_SUITE(iothub_ut)
                 .IgnoreArgument(3);
         }
 
+        /*the first personality allocates the index*/
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
+            .IgnoreArgument(1);
+
         /*adding the personality to the VECTOR or personalities*/
         STRICT_EXPECTED_CALL(mocks, VECTOR_push_back(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1))
             .IgnoreArgument(1)
@@ -2533,19 +3014,13 @@ BEGIN_TEST_SUITE(iothub_ut)
         auto module = Module_Create(BROKER_HANDLE_VALID, config);
         mocks.ResetAllCalls();
 
-        STRICT_EXPECTED_CALL(mocks, Message_GetProperties(MESSAGE_HANDLE_VALID_1));
-        STRICT_EXPECTED_CALL(mocks, ConstMap_Destroy(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(CONSTMAP_HANDLE_VALID_1, "source"));
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(MESSAGE_HANDLE_VALID_1, "source"));
 
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(CONSTMAP_HANDLE_VALID_1, "deviceName"));
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(MESSAGE_HANDLE_VALID_1, "deviceName"));
 
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(CONSTMAP_HANDLE_VALID_1, "deviceKey"));
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(MESSAGE_HANDLE_VALID_1, "deviceKey"));
 
-        /*VECTOR_find_if incurs a STRING_c_str until it find the deviceName. None in this test*/
-        STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreAllArguments();
+        /*the index is empty, the lookup does not compare any deviceName*/
 
         /*because the deviceName is brand new, it will be added as a new personality*/
         {/*separate scope for personality building*/
@@ -2575,6 +3050,10 @@ BEGIN_TEST_SUITE(iothub_ut)
                 .IgnoreArgument(3);
         }
 
+        /*the first personality allocates the index*/
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
+            .IgnoreArgument(1);
+
         /*adding the personality to the VECTOR or personalities*/
         STRICT_EXPECTED_CALL(mocks, VECTOR_push_back(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1))
             .IgnoreArgument(1)
@@ -2615,19 +3094,13 @@ BEGIN_TEST_SUITE(iothub_ut)
         auto module = Module_Create(BROKER_HANDLE_VALID, config);
         mocks.ResetAllCalls();
 
-        STRICT_EXPECTED_CALL(mocks, Message_GetProperties(MESSAGE_HANDLE_VALID_1));
-        STRICT_EXPECTED_CALL(mocks, ConstMap_Destroy(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(MESSAGE_HANDLE_VALID_1, "source"));
 
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(CONSTMAP_HANDLE_VALID_1, "source"));
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(MESSAGE_HANDLE_VALID_1, "deviceName"));
 
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(CONSTMAP_HANDLE_VALID_1, "deviceName"));
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(MESSAGE_HANDLE_VALID_1, "deviceKey"));
 
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(CONSTMAP_HANDLE_VALID_1, "deviceKey"));
-
-        /*VECTOR_find_if incurs a STRING_c_str until it find the deviceName. None in this test*/
-        STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreAllArguments();
+        /*the index is empty, the lookup does not compare any deviceName*/
 
         /*because the deviceName is brand new, it will be added as a new personality*/
         {/*separate scope for personality building*/
@@ -2667,6 +3140,10 @@ BEGIN_TEST_SUITE(iothub_ut)
                 .IgnoreArgument(3);
         }
 
+        /*the first personality allocates the index*/
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
+            .IgnoreArgument(1);
+
         /*adding the personality to the VECTOR or personalities*/
         whenShallVECTOR_push_back_fail = currentVECTOR_push_back_call + 1;
         STRICT_EXPECTED_CALL(mocks, VECTOR_push_back(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1))
@@ -2692,19 +3169,13 @@ BEGIN_TEST_SUITE(iothub_ut)
         auto module = Module_Create(BROKER_HANDLE_VALID, config);
         mocks.ResetAllCalls();
 
-        STRICT_EXPECTED_CALL(mocks, Message_GetProperties(MESSAGE_HANDLE_VALID_1));
-        STRICT_EXPECTED_CALL(mocks, ConstMap_Destroy(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(CONSTMAP_HANDLE_VALID_1, "source"));
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(MESSAGE_HANDLE_VALID_1, "source"));
 
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(CONSTMAP_HANDLE_VALID_1, "deviceName"));
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(MESSAGE_HANDLE_VALID_1, "deviceName"));
 
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(CONSTMAP_HANDLE_VALID_1, "deviceKey"));
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(MESSAGE_HANDLE_VALID_1, "deviceKey"));
 
-        /*VECTOR_find_if incurs a STRING_c_str until it find the deviceName. None in this test*/
-        STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreAllArguments();
+        /*the index is empty, the lookup does not compare any deviceName*/
 
         /*because the deviceName is brand new, it will be added as a new personality*/
         {/*separate scope for personality building*/
@@ -2739,19 +3210,13 @@ BEGIN_TEST_SUITE(iothub_ut)
         auto module = Module_Create(BROKER_HANDLE_VALID, config);
         mocks.ResetAllCalls();
 
-        STRICT_EXPECTED_CALL(mocks, Message_GetProperties(MESSAGE_HANDLE_VALID_1));
-        STRICT_EXPECTED_CALL(mocks, ConstMap_Destroy(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(CONSTMAP_HANDLE_VALID_1, "source"));
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(MESSAGE_HANDLE_VALID_1, "source"));
 
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(CONSTMAP_HANDLE_VALID_1, "deviceName"));
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(MESSAGE_HANDLE_VALID_1, "deviceName"));
 
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(CONSTMAP_HANDLE_VALID_1, "deviceKey"));
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(MESSAGE_HANDLE_VALID_1, "deviceKey"));
 
-        /*VECTOR_find_if incurs a STRING_c_str until it find the deviceName. None in this test*/
-        STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreAllArguments();
+        /*the index is empty, the lookup does not compare any deviceName*/
 
         /*because the deviceName is brand new, it will be added as a new personality*/
         {/*separate scope for personality building*/
@@ -2805,19 +3270,13 @@ BEGIN_TEST_SUITE(iothub_ut)
         auto module = Module_Create(BROKER_HANDLE_VALID, config);
         mocks.ResetAllCalls();
 
-        STRICT_EXPECTED_CALL(mocks, Message_GetProperties(MESSAGE_HANDLE_VALID_1));
-        STRICT_EXPECTED_CALL(mocks, ConstMap_Destroy(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(CONSTMAP_HANDLE_VALID_1, "source"));
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(MESSAGE_HANDLE_VALID_1, "source"));
 
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(CONSTMAP_HANDLE_VALID_1, "deviceName"));
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(MESSAGE_HANDLE_VALID_1, "deviceName"));
 
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(CONSTMAP_HANDLE_VALID_1, "deviceKey"));
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(MESSAGE_HANDLE_VALID_1, "deviceKey"));
 
-        /*VECTOR_find_if incurs a STRING_c_str until it find the deviceName. None in this test*/
-        STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreAllArguments();
+        /*the index is empty, the lookup does not compare any deviceName*/
 
         /*because the deviceName is brand new, it will be added as a new personality*/
         {/*separate scope for personality building*/
@@ -2877,19 +3336,13 @@ BEGIN_TEST_SUITE(iothub_ut)
         auto module = Module_Create(BROKER_HANDLE_VALID, config);
         mocks.ResetAllCalls();
 
-        STRICT_EXPECTED_CALL(mocks, Message_GetProperties(MESSAGE_HANDLE_VALID_1));
-        STRICT_EXPECTED_CALL(mocks, ConstMap_Destroy(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(MESSAGE_HANDLE_VALID_1, "source"));
 
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(CONSTMAP_HANDLE_VALID_1, "source"));
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(MESSAGE_HANDLE_VALID_1, "deviceName"));
 
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(CONSTMAP_HANDLE_VALID_1, "deviceName"));
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(MESSAGE_HANDLE_VALID_1, "deviceKey"));
 
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(CONSTMAP_HANDLE_VALID_1, "deviceKey"));
-
-        /*VECTOR_find_if incurs a STRING_c_str until it find the deviceName. None in this test*/
-        STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreAllArguments();
+        /*the index is empty, the lookup does not compare any deviceName*/
 
         /*because the deviceName is brand new, it will be added as a new personality*/
         {/*separate scope for personality building*/
@@ -2928,19 +3381,13 @@ BEGIN_TEST_SUITE(iothub_ut)
         auto module = Module_Create(BROKER_HANDLE_VALID, config);
         mocks.ResetAllCalls();
 
-        STRICT_EXPECTED_CALL(mocks, Message_GetProperties(MESSAGE_HANDLE_VALID_1));
-        STRICT_EXPECTED_CALL(mocks, ConstMap_Destroy(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(CONSTMAP_HANDLE_VALID_1, "source"));
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(MESSAGE_HANDLE_VALID_1, "source"));
 
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(CONSTMAP_HANDLE_VALID_1, "deviceName"));
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(MESSAGE_HANDLE_VALID_1, "deviceName"));
 
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(CONSTMAP_HANDLE_VALID_1, "deviceKey"));
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(MESSAGE_HANDLE_VALID_1, "deviceKey"));
 
-        /*VECTOR_find_if incurs a STRING_c_str until it find the deviceName. None in this test*/
-        STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreAllArguments();
+        /*the index is empty, the lookup does not compare any deviceName*/
 
         /*because the deviceName is brand new, it will be added as a new personality*/
         {/*separate scope for personality building*/
@@ -2969,15 +3416,11 @@ BEGIN_TEST_SUITE(iothub_ut)
         auto module = Module_Create(BROKER_HANDLE_VALID, config);
         mocks.ResetAllCalls();
 
-        STRICT_EXPECTED_CALL(mocks, Message_GetProperties(MESSAGE_HANDLE_VALID_1));
-        STRICT_EXPECTED_CALL(mocks, ConstMap_Destroy(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(CONSTMAP_HANDLE_VALID_1, "source"));
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(MESSAGE_HANDLE_VALID_1, "source"));
 
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(CONSTMAP_HANDLE_VALID_1, "deviceName"));
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(MESSAGE_HANDLE_VALID_1, "deviceName"));
 
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(CONSTMAP_HANDLE_VALID_1, "deviceKey"))
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(MESSAGE_HANDLE_VALID_1, "deviceKey"))
             .SetReturn((const char*)NULL);
 
         ///act
@@ -2999,13 +3442,9 @@ BEGIN_TEST_SUITE(iothub_ut)
         auto module = Module_Create(BROKER_HANDLE_VALID, config);
         mocks.ResetAllCalls();
 
-        STRICT_EXPECTED_CALL(mocks, Message_GetProperties(MESSAGE_HANDLE_VALID_1));
-        STRICT_EXPECTED_CALL(mocks, ConstMap_Destroy(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(CONSTMAP_HANDLE_VALID_1, "source"));
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(MESSAGE_HANDLE_VALID_1, "source"));
 
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(CONSTMAP_HANDLE_VALID_1, "deviceName"))
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(MESSAGE_HANDLE_VALID_1, "deviceName"))
             .SetReturn((const char*)NULL);
 
         ///act
@@ -3027,15 +3466,171 @@ BEGIN_TEST_SUITE(iothub_ut)
         auto module = Module_Create(BROKER_HANDLE_VALID, config);
         mocks.ResetAllCalls();
 
-        STRICT_EXPECTED_CALL(mocks, Message_GetProperties(MESSAGE_HANDLE_VALID_1));
-        STRICT_EXPECTED_CALL(mocks, ConstMap_Destroy(IGNORED_PTR_ARG))
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperty(MESSAGE_HANDLE_VALID_1, "source"))
+            .SetReturn((const char*)NULL);
+
+        ///act
+        Module_Receive(module, MESSAGE_HANDLE_VALID_1);
+
+        ///assert
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        Module_Destroy(module);
+    }
+
+    /*Tests_SRS_IOTHUBMODULE_30_019: [ `IotHub_Receive` shall look the personality up by device name in a hash index of the personalities. ]*/
+    /*Tests_SRS_IOTHUBMODULE_02_017: [ Otherwise `IotHub_Receive` shall not create a new personality. ]*/
+    TEST_FUNCTION(IotHub_Receive_finds_a_device_among_several)
+    {
+        ///arrange
+        CNiceCallComparer<IotHubMocks> mocks;
+        AutoConfig config;
+        auto module = Module_Create(BROKER_HANDLE_VALID, config);
+        Module_Receive(module, MESSAGE_HANDLE_VALID_1);
+        Module_Receive(module, MESSAGE_HANDLE_VALID_2);
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_CreateWithTransport(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .IgnoreAllArguments()
+            .NeverInvoked();
+        STRICT_EXPECTED_CALL(mocks, VECTOR_push_back(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1))
+            .IgnoreArgument(1)
+            .IgnoreArgument(2)
+            .NeverInvoked();
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_SendEventAsync(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .IgnoreAllArguments()
+            .ExpectedTimesExactly(2);
+
+        ///act
+        Module_Receive(module, MESSAGE_HANDLE_VALID_1);
+        Module_Receive(module, MESSAGE_HANDLE_VALID_2);
+
+        ///assert
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        Module_Destroy(module);
+    }
+
+    /*Tests_SRS_IOTHUBMODULE_30_020: [ If `maxDevices` personalities exist already, `IotHub_Receive` shall destroy the least recently used personality that has no message waiting or in flight. ]*/
+    TEST_FUNCTION(IotHub_Receive_evicts_the_least_recently_used_device_when_maxDevices_is_reached)
+    {
+        ///arrange
+        CNiceCallComparer<IotHubMocks> mocks;
+        AutoConfig config;
+        ((IOTHUB_CONFIG*)config)->maxDevices = 1;
+        auto module = Module_Create(BROKER_HANDLE_VALID, config);
+        Module_Receive(module, MESSAGE_HANDLE_VALID_1);
+        run_send_thread(1);
+        confirm_pending_events(IOTHUB_CLIENT_CONFIRMATION_OK);
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, VECTOR_erase(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1))
+            .IgnoreArgument(1)
+            .IgnoreArgument(2);
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_Destroy(IGNORED_PTR_ARG))
             .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, STRING_construct("secondDevice"));
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_CreateWithTransport(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .IgnoreAllArguments();
 
-        STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue(CONSTMAP_HANDLE_VALID_1, "source"))
-            .SetReturn((const char*)NULL);
+        ///act
+        Module_Receive(module, MESSAGE_HANDLE_VALID_2);
+
+        ///assert
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        Module_Destroy(module);
+    }
+
+    /*Tests_SRS_IOTHUBMODULE_30_021: [ If no such personality exists, `IotHub_Receive` shall not create a new personality. ]*/
+    TEST_FUNCTION(IotHub_Receive_with_maxDevices_does_not_evict_a_device_with_a_message_in_flight)
+    {
+        ///arrange
+        CNiceCallComparer<IotHubMocks> mocks;
+        AutoConfig config;
+        ((IOTHUB_CONFIG*)config)->maxDevices = 1;
+        auto module = Module_Create(BROKER_HANDLE_VALID, config);
+        Module_Receive(module, MESSAGE_HANDLE_VALID_1);
+        /*the message is handed to IoTHubClient and not confirmed*/
+        run_send_thread(1);
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_Destroy(IGNORED_PTR_ARG))
+            .IgnoreArgument(1)
+            .NeverInvoked();
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_CreateWithTransport(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .IgnoreAllArguments()
+            .NeverInvoked();
 
         ///act
+        Module_Receive(module, MESSAGE_HANDLE_VALID_2);
+
+        ///assert
+        ASSERT_ARE_EQUAL(size_t, 1, pendingEvent_count);
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        Module_Destroy(module);
+    }
+
+    /*Tests_SRS_IOTHUBMODULE_30_021: [ If no such personality exists, `IotHub_Receive` shall not create a new personality. ]*/
+    TEST_FUNCTION(IotHub_Receive_pipelined_does_not_evict_a_device_with_messages_waiting)
+    {
+        ///arrange
+        CNiceCallComparer<IotHubMocks> mocks;
+        AutoConfig config;
+        ((IOTHUB_CONFIG*)config)->maxDevices = 1;
+        auto module = create_pipelined_module(config, 3, 0);
         Module_Receive(module, MESSAGE_HANDLE_VALID_1);
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_Destroy(IGNORED_PTR_ARG))
+            .IgnoreArgument(1)
+            .NeverInvoked();
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_CreateWithTransport(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .IgnoreAllArguments()
+            .NeverInvoked();
+        STRICT_EXPECTED_CALL(mocks, IoTHubMessage_CreateFromByteArray(IGNORED_PTR_ARG, IGNORED_NUM_ARG))
+            .IgnoreAllArguments()
+            .NeverInvoked();
+
+        ///act
+        Module_Receive(module, MESSAGE_HANDLE_VALID_2);
+
+        ///assert
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        Module_Destroy(module);
+    }
+
+    /*Tests_SRS_IOTHUBMODULE_30_020: [ If `maxDevices` personalities exist already, `IotHub_Receive` shall destroy the least recently used personality that has no message waiting or in flight. ]*/
+    /*Tests_SRS_IOTHUBMODULE_30_021: [ If no such personality exists, `IotHub_Receive` shall not create a new personality. ]*/
+    TEST_FUNCTION(IotHub_Receive_pipelined_evicts_a_device_once_its_messages_are_confirmed)
+    {
+        ///arrange
+        CNiceCallComparer<IotHubMocks> mocks;
+        AutoConfig config;
+        ((IOTHUB_CONFIG*)config)->maxDevices = 1;
+        auto module = create_pipelined_module(config, 2, 0);
+        Module_Receive(module, MESSAGE_HANDLE_VALID_1);
+        Module_Receive(module, MESSAGE_HANDLE_VALID_1);
+        run_send_thread(1);
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_Destroy(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_CreateWithTransport(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .IgnoreAllArguments();
+
+        ///act
+        /*both messages are in flight, there is no room for secondDevice*/
+        Module_Receive(module, MESSAGE_HANDLE_VALID_2);
+        confirm_pending_events(IOTHUB_CLIENT_CONFIRMATION_OK);
+        Module_Receive(module, MESSAGE_HANDLE_VALID_2);
 
         ///assert
         mocks.AssertActualAndExpectedCalls();
@@ -3454,4 +4049,267 @@ BEGIN_TEST_SUITE(iothub_ut)
         Module_Destroy(module);
     }
 
+    /*Tests_SRS_IOTHUBMODULE_30_006: [ If the module is pipelined, `IotHub_Receive` shall add the IOTHUB_MESSAGE_HANDLE to the batch of the device instead of sending it, and wake up the send thread when that fills the batch. ]*/
+    TEST_FUNCTION(IotHub_Receive_pipelined_queues_the_message_instead_of_sending_it)
+    {
+        ///arrange
+        CNiceCallComparer<IotHubMocks> mocks;
+        AutoConfig config;
+        auto module = create_pipelined_module(config, 3, 0);
+        Module_Receive(module, MESSAGE_HANDLE_VALID_1);
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, IoTHubMessage_CreateFromByteArray(IGNORED_PTR_ARG, 1))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_SendEventAsync(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .IgnoreAllArguments()
+            .NeverInvoked();
+        STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(IGNORED_PTR_ARG))
+            .IgnoreArgument(1)
+            .NeverInvoked();
+        STRICT_EXPECTED_CALL(mocks, Condition_Post(IGNORED_PTR_ARG))
+            .IgnoreArgument(1)
+            .NeverInvoked();
+
+        ///act
+        Module_Receive(module, MESSAGE_HANDLE_VALID_1);
+
+        ///assert
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        Module_Destroy(module);
+    }
+
+    /*Tests_SRS_IOTHUBMODULE_30_006: [ If the module is pipelined, `IotHub_Receive` shall add the IOTHUB_MESSAGE_HANDLE to the batch of the device instead of sending it, and wake up the send thread when that fills the batch. ]*/
+    TEST_FUNCTION(IotHub_Receive_pipelined_wakes_the_send_thread_when_the_batch_is_full)
+    {
+        ///arrange
+        CNiceCallComparer<IotHubMocks> mocks;
+        AutoConfig config;
+        auto module = create_pipelined_module(config, 2, 0);
+        Module_Receive(module, MESSAGE_HANDLE_VALID_1);
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, Condition_Post(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_SendEventAsync(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .IgnoreAllArguments()
+            .NeverInvoked();
+
+        ///act
+        Module_Receive(module, MESSAGE_HANDLE_VALID_1);
+
+        ///assert
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        Module_Destroy(module);
+    }
+
+    /*Tests_SRS_IOTHUBMODULE_30_017: [ If the batch of the device is full, `IotHub_Receive` shall wait on its condition up to `batchTimeoutMs` milliseconds for the send thread to take it. ]*/
+    /*Tests_SRS_IOTHUBMODULE_30_018: [ If the batch is still full, `IotHub_Receive` shall drop the message. ]*/
+    TEST_FUNCTION(IotHub_Receive_pipelined_drops_the_message_when_the_batch_stays_full)
+    {
+        ///arrange
+        CNiceCallComparer<IotHubMocks> mocks;
+        AutoConfig config;
+        auto module = create_pipelined_module(config, 2, 0);
+        Module_Receive(module, MESSAGE_HANDLE_VALID_1);
+        Module_Receive(module, MESSAGE_HANDLE_VALID_1);
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, Condition_Wait(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 100))
+            .IgnoreArgument(1)
+            .IgnoreArgument(2);
+        STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_SendEventAsync(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .IgnoreAllArguments()
+            .NeverInvoked();
+
+        ///act
+        Module_Receive(module, MESSAGE_HANDLE_VALID_1);
+
+        ///assert
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        Module_Destroy(module);
+    }
+
+    /*Tests_SRS_IOTHUBMODULE_30_007: [ The send thread shall run until `IotHub_Destroy` stops it. ]*/
+    /*Tests_SRS_IOTHUBMODULE_30_013: [ If acquiring the lock fails, the send thread shall return. ]*/
+    /*Tests_SRS_IOTHUBMODULE_30_008: [ The send thread shall send the batch of a device once it holds `batchSize` messages or its oldest message has waited `batchTimeoutMs` milliseconds. ]*/
+    /*Tests_SRS_IOTHUBMODULE_30_011: [ The send thread shall send each message of a batch, in order, by calling `IoTHubClient_SendEventAsync` with `IotHub_SendConfirmation` and the personality, then destroy it. ]*/
+    TEST_FUNCTION(IotHub_SendThread_sends_a_full_batch)
+    {
+        ///arrange
+        CNiceCallComparer<IotHubMocks> mocks;
+        AutoConfig config;
+        auto module = create_pipelined_module(config, 2, 0);
+        Module_Receive(module, MESSAGE_HANDLE_VALID_1);
+        Module_Receive(module, MESSAGE_HANDLE_VALID_1);
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_SendEventAsync(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .IgnoreAllArguments()
+            .ExpectedTimesExactly(2);
+        STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(IGNORED_PTR_ARG))
+            .IgnoreArgument(1)
+            .ExpectedTimesExactly(2);
+
+        ///act
+        run_send_thread(1);
+
+        ///assert
+        ASSERT_ARE_EQUAL(size_t, 2, pendingEvent_count);
+        ASSERT_IS_NOT_NULL(pendingEvent_context[0]);
+        ASSERT_ARE_EQUAL(void_ptr, pendingEvent_context[0], pendingEvent_context[1]);
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        confirm_pending_events(IOTHUB_CLIENT_CONFIRMATION_OK);
+        Module_Destroy(module);
+    }
+
+    /*Tests_SRS_IOTHUBMODULE_30_008: [ The send thread shall send the batch of a device once it holds `batchSize` messages or its oldest message has waited `batchTimeoutMs` milliseconds. ]*/
+    /*Tests_SRS_IOTHUBMODULE_30_014: [ When no batch can be sent, the send thread shall wait on its condition until the next batch is due. ]*/
+    TEST_FUNCTION(IotHub_SendThread_sends_a_partial_batch_once_it_times_out)
+    {
+        ///arrange
+        CNiceCallComparer<IotHubMocks> mocks;
+        AutoConfig config;
+        auto module = create_pipelined_module(config, 3, 0);
+        Module_Receive(module, MESSAGE_HANDLE_VALID_1);
+        currentTick_ms = 60;
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, Condition_Wait(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 40))
+            .IgnoreArgument(1)
+            .IgnoreArgument(2);
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_SendEventAsync(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .IgnoreAllArguments()
+            .NeverInvoked();
+
+        ///act
+        run_send_thread(1);
+
+        ///assert
+        ASSERT_ARE_EQUAL(size_t, 0, pendingEvent_count);
+        mocks.AssertActualAndExpectedCalls();
+
+        ///act
+        currentTick_ms = 100;
+        run_send_thread(1);
+
+        ///assert
+        ASSERT_ARE_EQUAL(size_t, 1, pendingEvent_count);
+
+        ///cleanup
+        confirm_pending_events(IOTHUB_CLIENT_CONFIRMATION_OK);
+        Module_Destroy(module);
+    }
+
+    /*Tests_SRS_IOTHUBMODULE_30_009: [ The send thread shall not let a device have more than `maxInFlight` messages sent and not confirmed, unless `maxInFlight` is 0; the rest of its batch shall wait for confirmations. ]*/
+    /*Tests_SRS_IOTHUBMODULE_30_010: [ Every confirmation of a sent message shall remove it from the send window of its device and wake up the send thread. ]*/
+    TEST_FUNCTION(IotHub_SendThread_keeps_a_device_within_its_send_window)
+    {
+        ///arrange
+        CNiceCallComparer<IotHubMocks> mocks;
+        AutoConfig config;
+        auto module = create_pipelined_module(config, 3, 1);
+        Module_Receive(module, MESSAGE_HANDLE_VALID_1);
+        Module_Receive(module, MESSAGE_HANDLE_VALID_1);
+        Module_Receive(module, MESSAGE_HANDLE_VALID_1);
+        mocks.ResetAllCalls();
+
+        ///act
+        run_send_thread(2);
+
+        ///assert
+        /*one message went out, the second pass found the window closed*/
+        ASSERT_ARE_EQUAL(size_t, 1, pendingEvent_count);
+
+        ///act
+        STRICT_EXPECTED_CALL(mocks, Condition_Post(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        confirm_pending_events(IOTHUB_CLIENT_CONFIRMATION_ERROR);
+        run_send_thread(1);
+
+        ///assert
+        ASSERT_ARE_EQUAL(size_t, 1, pendingEvent_count);
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        confirm_pending_events(IOTHUB_CLIENT_CONFIRMATION_OK);
+        Module_Destroy(module);
+    }
+
+    /*Tests_SRS_IOTHUBMODULE_30_012: [ Messages that `IoTHubClient_SendEventAsync` fails to send shall leave the send window of their device. ]*/
+    TEST_FUNCTION(IotHub_SendThread_reopens_the_window_when_SendEventAsync_fails)
+    {
+        ///arrange
+        CNiceCallComparer<IotHubMocks> mocks;
+        AutoConfig config;
+        auto module = create_pipelined_module(config, 2, 1);
+        Module_Receive(module, MESSAGE_HANDLE_VALID_1);
+        Module_Receive(module, MESSAGE_HANDLE_VALID_1);
+        mocks.ResetAllCalls();
+        whenShallIoTHubClient_SendEventAsync_fail = 1;
+
+        ///act
+        /*the failed send takes a Lock of its own*/
+        whenShallLock_fail = currentLock_call + 4;
+        (void)sendThread_func(sendThread_arg);
+
+        ///assert
+        /*the second message went out right after the first one failed*/
+        ASSERT_ARE_EQUAL(size_t, 1, pendingEvent_count);
+
+        ///cleanup
+        confirm_pending_events(IOTHUB_CLIENT_CONFIRMATION_OK);
+        Module_Destroy(module);
+    }
+
+    /*Tests_SRS_IOTHUBMODULE_30_015: [ `IotHub_Destroy` shall stop and join the send thread before destroying the personalities. ]*/
+    /*Tests_SRS_IOTHUBMODULE_30_016: [ `IotHub_Destroy` shall destroy the messages still waiting in the batches. ]*/
+    TEST_FUNCTION(IotHub_Destroy_pipelined_stops_the_send_thread)
+    {
+        ///arrange
+        CNiceCallComparer<IotHubMocks> mocks;
+        AutoConfig config;
+        auto module = create_pipelined_module(config, 3, 0);
+        Module_Receive(module, MESSAGE_HANDLE_VALID_1);
+        Module_Receive(module, MESSAGE_HANDLE_VALID_1);
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, Condition_Post(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, ThreadAPI_Join(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .IgnoreAllArguments();
+        STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(IGNORED_PTR_ARG))
+            .IgnoreArgument(1)
+            .ExpectedTimesExactly(2);
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_Destroy(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, tickcounter_destroy(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, Condition_Deinit(IGNORED_PTR_ARG))
+            .IgnoreArgument(1)
+            .ExpectedTimesExactly(2);
+        STRICT_EXPECTED_CALL(mocks, Lock_Deinit(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+
+        ///act
+        Module_Destroy(module);
+
+        ///assert
+        mocks.AssertActualAndExpectedCalls();
+    }
+
 END_TEST_SUITE(iothub_ut)
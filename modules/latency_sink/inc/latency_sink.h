@@ -0,0 +1,32 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifndef LATENCY_SINK_H
+#define LATENCY_SINK_H
+
+#include <stdbool.h>
+#include "module.h"
+
+#define LATENCY_SINK_DEFAULT_REPORT_PERIOD_MS 10000
+#define LATENCY_SINK_MAX_SOURCES 256
+
+typedef struct LATENCY_SINK_CONFIG_TAG
+{
+    const char * keyProperty; /*the property whose value names the source of a message, NULL means GW_SOURCE_PROPERTY*/
+    unsigned int reportPeriodMs; /*0 means LATENCY_SINK_DEFAULT_REPORT_PERIOD_MS*/
+    const char * fileName; /*the reports are appended to this file, one JSON object per line, NULL writes no file*/
+    bool publishReports; /*the reports are also published as messages*/
+} LATENCY_SINK_CONFIG; /*this needs to be passed to the Module_Create function*/
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+MODULE_EXPORT const MODULE_API* MODULE_STATIC_GETAPI(LATENCY_SINK_MODULE)(MODULE_API_VERSION gateway_api_version);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*LATENCY_SINK_H*/
@@ -0,0 +1,753 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+
+#include "azure_c_shared_utility/gballoc.h"
+#include "azure_c_shared_utility/gb_stdio.h"
+#include "azure_c_shared_utility/crt_abstractions.h"
+#include "azure_c_shared_utility/xlogging.h"
+#include "azure_c_shared_utility/map.h"
+#include "azure_c_shared_utility/lock.h"
+#include "azure_c_shared_utility/condition.h"
+#include "azure_c_shared_utility/threadapi.h"
+#include "messageproperties.h"
+#include "monotonic_clock.h"
+#include "message.h"
+#include "broker.h"
+#include "latency_sink.h"
+
+#include <parson.h>
+
+/*the report period is waited for with Condition_Wait, which takes an int of milliseconds*/
+#define LATENCY_SINK_MAX_REPORT_PERIOD_MS (24 * 60 * 60 * 1000)
+
+/*
+ * The latencies are counted in an HDR style histogram: latencies under LATENCY_SINK_SUB_BUCKETS
+ * microseconds have a bucket each, every power of 2 above is split in LATENCY_SINK_SUB_BUCKETS / 2
+ * buckets, so a percentile is within 1/64 of the latency it stands for. Latencies of more than
+ * 2^36 microseconds (19 hours) are counted in the last bucket.
+ */
+#define LATENCY_SINK_SUB_BUCKETS 128
+#define LATENCY_SINK_MAX_SHIFT 29
+#define LATENCY_SINK_MAX_LATENCY ((((uint64_t)LATENCY_SINK_SUB_BUCKETS) << LATENCY_SINK_MAX_SHIFT) - 1)
+#define LATENCY_SINK_BUCKETS (LATENCY_SINK_SUB_BUCKETS + LATENCY_SINK_MAX_SHIFT * (LATENCY_SINK_SUB_BUCKETS / 2))
+
+#define LATENCY_SINK_PERCENTILES 4
+/*the percentiles of a report, in hundredths of a percent*/
+static const uint64_t latencySinkPercentiles[LATENCY_SINK_PERCENTILES] = { 5000, 9000, 9900, 9990 };
+
+#define LATENCY_SINK_REPORT_HEADER "{\"periodMs\":%u,\"untracked\":%llu,\"sources\":["
+#define LATENCY_SINK_REPORT_SOURCE "%s{\"source\":\"%s\",\"count\":%llu,\"unstamped\":%llu,\"min\":%llu,\"mean\":%llu,\"p50\":%llu,\"p90\":%llu,\"p99\":%llu,\"p999\":%llu,\"max\":%llu}"
+#define LATENCY_SINK_REPORT_FOOTER "]}\n"
+/*room for the numbers of a source, its name is accounted for on its own*/
+#define LATENCY_SINK_REPORT_SOURCE_MAX 384
+
+/*the latencies of the messages of one source since the last report*/
+typedef struct LATENCY_SINK_SOURCE_TAG
+{
+    char * name;
+    uint64_t count;
+    uint64_t unstamped; /*messages without a valid send time*/
+    uint64_t sum;
+    uint64_t min;
+    uint64_t max;
+    uint64_t buckets[LATENCY_SINK_BUCKETS];
+} LATENCY_SINK_SOURCE;
+
+/*what a report says of one source, taken under the lock and formatted without it*/
+typedef struct LATENCY_SINK_SUMMARY_TAG
+{
+    const char * name;
+    uint64_t count;
+    uint64_t unstamped;
+    uint64_t min;
+    uint64_t mean;
+    uint64_t max;
+    uint64_t percentiles[LATENCY_SINK_PERCENTILES];
+} LATENCY_SINK_SUMMARY;
+
+typedef struct LATENCY_SINK_DATA_TAG
+{
+    BROKER_HANDLE broker;
+    char * keyProperty;
+    unsigned int reportPeriodMs;
+    FILE * file; /*NULL when the reports are not written to a file*/
+    MAP_HANDLE reportProperties; /*NULL when the reports are not published*/
+    LOCK_HANDLE lock;
+    COND_HANDLE stopCondition; /*the reporter waits on it for the next report*/
+    THREAD_HANDLE thread;
+    bool stopping;
+    LATENCY_SINK_SOURCE * sources[LATENCY_SINK_MAX_SOURCES]; /*guarded by lock, never removed before Destroy*/
+    size_t sourceCount;
+    uint64_t untracked; /*messages of the sources past LATENCY_SINK_MAX_SOURCES*/
+    LATENCY_SINK_SUMMARY * summaries; /*LATENCY_SINK_MAX_SOURCES summaries, used by the reporter only*/
+} LATENCY_SINK_DATA;
+
+static size_t LatencySink_BucketIndex(uint64_t latency)
+{
+    size_t result;
+    if (latency < LATENCY_SINK_SUB_BUCKETS)
+    {
+        result = (size_t)latency;
+    }
+    else
+    {
+        unsigned int shift = 1;
+        if (latency > LATENCY_SINK_MAX_LATENCY)
+        {
+            latency = LATENCY_SINK_MAX_LATENCY;
+        }
+        while ((latency >> shift) >= LATENCY_SINK_SUB_BUCKETS)
+        {
+            shift++;
+        }
+        result = LATENCY_SINK_SUB_BUCKETS + (shift - 1) * (LATENCY_SINK_SUB_BUCKETS / 2) + (size_t)((latency >> shift) - (LATENCY_SINK_SUB_BUCKETS / 2));
+    }
+    return result;
+}
+
+/*the highest latency counted in a bucket*/
+static uint64_t LatencySink_BucketValue(size_t index)
+{
+    uint64_t result;
+    if (index < LATENCY_SINK_SUB_BUCKETS)
+    {
+        result = index;
+    }
+    else
+    {
+        unsigned int shift = (unsigned int)((index - LATENCY_SINK_SUB_BUCKETS) / (LATENCY_SINK_SUB_BUCKETS / 2)) + 1;
+        uint64_t base = (uint64_t)((index - LATENCY_SINK_SUB_BUCKETS) % (LATENCY_SINK_SUB_BUCKETS / 2) + (LATENCY_SINK_SUB_BUCKETS / 2)) << shift;
+        result = base + (((uint64_t)1) << shift) - 1;
+    }
+    return result;
+}
+
+static void LatencySink_ResetSource(LATENCY_SINK_SOURCE * source)
+{
+    source->count = 0;
+    source->unstamped = 0;
+    source->sum = 0;
+    source->min = UINT64_MAX;
+    source->max = 0;
+    (void)memset(source->buckets, 0, sizeof(source->buckets));
+}
+
+/*the send time must be decimal digits only and not in the future*/
+static bool LatencySink_ParseSendTime(const char * sendTime, uint64_t now, uint64_t * latency)
+{
+    bool result;
+    if (sendTime == NULL || !isdigit((unsigned char)sendTime[0]))
+    {
+        result = false;
+    }
+    else
+    {
+        char * end;
+        unsigned long long value;
+        errno = 0;
+        value = strtoull(sendTime, &end, 10);
+        if (errno != 0 || *end != '\0' || value > now)
+        {
+            result = false;
+        }
+        else
+        {
+            *latency = now - (uint64_t)value;
+            result = true;
+        }
+    }
+    return result;
+}
+
+/*finds the source of a name, or adds it; NULL when there are LATENCY_SINK_MAX_SOURCES already. Called under the lock*/
+static LATENCY_SINK_SOURCE * LatencySink_FindSource(LATENCY_SINK_DATA * moduleData, const char * name)
+{
+    LATENCY_SINK_SOURCE * result = NULL;
+    size_t i;
+    for (i = 0; i < moduleData->sourceCount; i++)
+    {
+        if (strcmp(moduleData->sources[i]->name, name) == 0)
+        {
+            result = moduleData->sources[i];
+            break;
+        }
+    }
+    if (result == NULL && moduleData->sourceCount < LATENCY_SINK_MAX_SOURCES)
+    {
+        result = (LATENCY_SINK_SOURCE *)malloc(sizeof(LATENCY_SINK_SOURCE));
+        if (result == NULL)
+        {
+            LogError("unable to allocate the source %s", name);
+        }
+        else if (mallocAndStrcpy_s(&result->name, name) != 0)
+        {
+            LogError("unable to copy the name of the source %s", name);
+            free(result);
+            result = NULL;
+        }
+        else
+        {
+            LatencySink_ResetSource(result);
+            moduleData->sources[moduleData->sourceCount++] = result;
+        }
+    }
+    return result;
+}
+
+/*takes the percentiles of a source out of its histogram*/
+static void LatencySink_Summarize(const LATENCY_SINK_SOURCE * source, LATENCY_SINK_SUMMARY * summary)
+{
+    size_t i;
+    summary->name = source->name;
+    summary->count = source->count;
+    summary->unstamped = source->unstamped;
+    if (source->count == 0)
+    {
+        summary->min = 0;
+        summary->mean = 0;
+        summary->max = 0;
+        for (i = 0; i < LATENCY_SINK_PERCENTILES; i++)
+        {
+            summary->percentiles[i] = 0;
+        }
+    }
+    else
+    {
+        uint64_t seen = 0;
+        size_t bucket = 0;
+        summary->min = source->min;
+        summary->mean = source->sum / source->count;
+        summary->max = source->max;
+        for (i = 0; i < LATENCY_SINK_PERCENTILES; i++)
+        {
+            uint64_t rank = (source->count * latencySinkPercentiles[i] + 9999) / 10000;
+            uint64_t value;
+            while (seen + source->buckets[bucket] < rank)
+            {
+                seen += source->buckets[bucket];
+                bucket++;
+            }
+            value = LatencySink_BucketValue(bucket);
+            summary->percentiles[i] = (value < source->min) ? source->min : (value > source->max) ? source->max : value;
+        }
+    }
+}
+
+/*copies a string escaped for JSON, destination has room for 6 characters per character of source*/
+static void LatencySink_EscapeJson(char * destination, const char * source)
+{
+    static const char hexDigits[] = "0123456789abcdef";
+    for (; *source != '\0'; source++)
+    {
+        unsigned char c = (unsigned char)*source;
+        if (c == '"' || c == '\\')
+        {
+            *destination++ = '\\';
+            *destination++ = (char)c;
+        }
+        else if (c < 0x20)
+        {
+            *destination++ = '\\';
+            *destination++ = 'u';
+            *destination++ = '0';
+            *destination++ = '0';
+            *destination++ = hexDigits[c >> 4];
+            *destination++ = hexDigits[c & 0xF];
+        }
+        else
+        {
+            *destination++ = (char)c;
+        }
+    }
+    *destination = '\0';
+}
+
+/*formats a report as one line of JSON, NULL on failure*/
+static char * LatencySink_FormatReport(const LATENCY_SINK_DATA * moduleData, size_t summaryCount, uint64_t untracked)
+{
+    char * result;
+    size_t capacity = sizeof(LATENCY_SINK_REPORT_HEADER) + 32 + sizeof(LATENCY_SINK_REPORT_FOOTER);
+    size_t longestName = 0;
+    size_t i;
+    for (i = 0; i < summaryCount; i++)
+    {
+        size_t nameLength = strlen(moduleData->summaries[i].name);
+        capacity += LATENCY_SINK_REPORT_SOURCE_MAX + 6 * nameLength;
+        longestName = (nameLength > longestName) ? nameLength : longestName;
+    }
+
+    result = (char *)malloc(capacity + 6 * longestName + 1);
+    if (result == NULL)
+    {
+        LogError("unable to allocate the report");
+    }
+    else
+    {
+        char * escapedName = result + capacity; /*the names are escaped past the end of the report*/
+        int written = sprintf_s(result, capacity, LATENCY_SINK_REPORT_HEADER, moduleData->reportPeriodMs, (unsigned long long)untracked);
+        size_t size = (written < 0) ? capacity : (size_t)written;
+        for (i = 0; i < summaryCount && size < capacity; i++)
+        {
+            const LATENCY_SINK_SUMMARY * summary = &moduleData->summaries[i];
+            LatencySink_EscapeJson(escapedName, summary->name);
+            written = sprintf_s(result + size, capacity - size, LATENCY_SINK_REPORT_SOURCE, (i == 0) ? "" : ",", escapedName,
+                (unsigned long long)summary->count, (unsigned long long)summary->unstamped, (unsigned long long)summary->min, (unsigned long long)summary->mean,
+                (unsigned long long)summary->percentiles[0], (unsigned long long)summary->percentiles[1], (unsigned long long)summary->percentiles[2], (unsigned long long)summary->percentiles[3],
+                (unsigned long long)summary->max);
+            size = (written < 0) ? capacity : size + (size_t)written;
+        }
+        if (size >= capacity || sprintf_s(result + size, capacity - size, LATENCY_SINK_REPORT_FOOTER) < 0)
+        {
+            LogError("unable to format the report");
+            free(result);
+            result = NULL;
+        }
+    }
+    return result;
+}
+
+static void LatencySink_PublishReport(LATENCY_SINK_DATA * moduleData, const char * report, size_t size)
+{
+    MESSAGE_CONFIG messageConfig;
+    MESSAGE_HANDLE message;
+    messageConfig.size = size;
+    messageConfig.source = (const unsigned char *)report;
+    messageConfig.sourceProperties = moduleData->reportProperties;
+    message = Message_Create(&messageConfig);
+    if (message == NULL)
+    {
+        LogError("unable to create the report message");
+    }
+    else
+    {
+        if (Broker_Publish(moduleData->broker, (MODULE_HANDLE)moduleData, message) != BROKER_OK)
+        {
+            LogError("unable to publish the report");
+        }
+        Message_Destroy(message);
+    }
+}
+
+/*reports the sources that received messages since the last report and starts them over*/
+static void LatencySink_Report(LATENCY_SINK_DATA * moduleData, bool publish)
+{
+    if (Lock(moduleData->lock) != LOCK_OK)
+    {
+        LogError("unable to Lock, the report is skipped");
+    }
+    else
+    {
+        size_t summaryCount = 0;
+        uint64_t untracked = moduleData->untracked;
+        size_t i;
+        for (i = 0; i < moduleData->sourceCount; i++)
+        {
+            LATENCY_SINK_SOURCE * source = moduleData->sources[i];
+            if (source->count != 0 || source->unstamped != 0)
+            {
+                LatencySink_Summarize(source, &moduleData->summaries[summaryCount]);
+                summaryCount++;
+                LatencySink_ResetSource(source);
+            }
+        }
+        moduleData->untracked = 0;
+        (void)Unlock(moduleData->lock);
+
+        /*Codes_SRS_LATENCY_SINK_30_016: [ A period without messages shall not be reported. ]*/
+        if (summaryCount != 0 || untracked != 0)
+        {
+            char * report = LatencySink_FormatReport(moduleData, summaryCount, untracked);
+            if (report != NULL)
+            {
+                size_t size = strlen(report);
+                if (moduleData->file != NULL)
+                {
+                    /*Codes_SRS_LATENCY_SINK_30_017: [ When the module has a file, the report shall be appended to it as one line. ]*/
+                    if (fwrite(report, 1, size, moduleData->file) != size || fflush(moduleData->file) != 0)
+                    {
+                        LogError("unable to write the report to the file");
+                    }
+                }
+                if (publish && moduleData->reportProperties != NULL)
+                {
+                    /*Codes_SRS_LATENCY_SINK_30_018: [ When the reports are published, the report shall be published as the content of a message whose GW_SOURCE_PROPERTY is GW_SOURCE_LATENCY_REPORT. ]*/
+                    LatencySink_PublishReport(moduleData, report, size - 1);
+                }
+                if (moduleData->file == NULL && moduleData->reportProperties == NULL)
+                {
+                    /*Codes_SRS_LATENCY_SINK_30_019: [ When the module neither has a file nor publishes the reports, the report shall be logged. ]*/
+                    LogInfo("%.*s", (int)(size - 1), report);
+                }
+                free(report);
+            }
+        }
+    }
+}
+
+static int LatencySink_Reporter(void * param)
+{
+    LATENCY_SINK_DATA * moduleData = (LATENCY_SINK_DATA *)param;
+    uint64_t period = (uint64_t)moduleData->reportPeriodMs * 1000;
+    uint64_t due = MonotonicClock_GetUs() + period;
+    bool stopping = false;
+    while (!stopping)
+    {
+        if (Lock(moduleData->lock) != LOCK_OK)
+        {
+            LogError("unable to Lock, the reports stop");
+            stopping = true;
+        }
+        else
+        {
+            uint64_t now = MonotonicClock_GetUs();
+            if (!moduleData->stopping && now < due)
+            {
+                (void)Condition_Wait(moduleData->stopCondition, moduleData->lock, (int)((due - now + 999) / 1000));
+            }
+            stopping = moduleData->stopping;
+            (void)Unlock(moduleData->lock);
+
+            if (!stopping && (now = MonotonicClock_GetUs()) >= due)
+            {
+                /*Codes_SRS_LATENCY_SINK_30_015: [ Every reportPeriodMs, the module shall report the count, the number of unstamped messages, the minimum, mean, 50th, 90th, 99th, 99.9th percentile and maximum latency of each source, then start them over. ]*/
+                LatencySink_Report(moduleData, true);
+                due += period;
+                if (due <= now)
+                {
+                    /*a late report does not pile up the next ones*/
+                    due = now + period;
+                }
+            }
+        }
+    }
+
+    /*Codes_SRS_LATENCY_SINK_30_022: [ LatencySink_Destroy shall report what was received since the last report, without publishing it. ]*/
+    LatencySink_Report(moduleData, false);
+    return 0;
+}
+
+/*releases the module, whatever part of it was created*/
+static void LatencySink_FreeModule(LATENCY_SINK_DATA * moduleData)
+{
+    size_t i;
+    for (i = 0; i < moduleData->sourceCount; i++)
+    {
+        free(moduleData->sources[i]->name);
+        free(moduleData->sources[i]);
+    }
+    if (moduleData->reportProperties != NULL)
+    {
+        Map_Destroy(moduleData->reportProperties);
+    }
+    if (moduleData->file != NULL)
+    {
+        (void)fclose(moduleData->file);
+    }
+    free(moduleData->summaries);
+    if (moduleData->stopCondition != NULL)
+    {
+        Condition_Deinit(moduleData->stopCondition);
+    }
+    if (moduleData->lock != NULL)
+    {
+        Lock_Deinit(moduleData->lock);
+    }
+    free(moduleData->keyProperty);
+    free(moduleData);
+}
+
+static MODULE_HANDLE LatencySink_Create(BROKER_HANDLE broker, const void* configuration)
+{
+    LATENCY_SINK_DATA * result;
+    const LATENCY_SINK_CONFIG * config = (const LATENCY_SINK_CONFIG *)configuration;
+    if (broker == NULL || config == NULL)
+    {
+        /*Codes_SRS_LATENCY_SINK_30_001: [ If broker or configuration is NULL, LatencySink_Create shall fail and return NULL. ]*/
+        LogError("invalid arg broker=%p configuration=%p", broker, configuration);
+        result = NULL;
+    }
+    else if (config->reportPeriodMs > LATENCY_SINK_MAX_REPORT_PERIOD_MS)
+    {
+        /*Codes_SRS_LATENCY_SINK_30_002: [ If reportPeriodMs is more than a day, LatencySink_Create shall fail and return NULL. ]*/
+        LogError("the report period of %u ms is more than a day", config->reportPeriodMs);
+        result = NULL;
+    }
+    else if ((result = (LATENCY_SINK_DATA *)malloc(sizeof(LATENCY_SINK_DATA))) == NULL)
+    {
+        /*Codes_SRS_LATENCY_SINK_30_003: [ If any resource of the module cannot be created, LatencySink_Create shall fail, release what it created and return NULL. ]*/
+        LogError("unable to allocate the module");
+    }
+    else
+    {
+        bool created = false;
+        result->broker = broker;
+        result->reportPeriodMs = (config->reportPeriodMs == 0) ? LATENCY_SINK_DEFAULT_REPORT_PERIOD_MS : config->reportPeriodMs;
+        result->thread = NULL;
+        result->stopping = false;
+        result->sourceCount = 0;
+        result->untracked = 0;
+        result->file = NULL;
+        result->reportProperties = NULL;
+        result->keyProperty = NULL;
+        result->lock = NULL;
+        result->stopCondition = NULL;
+        result->summaries = NULL;
+
+        /*Codes_SRS_LATENCY_SINK_30_004: [ LatencySink_Create shall copy the keyProperty, GW_SOURCE_PROPERTY when it is NULL. ]*/
+        if (mallocAndStrcpy_s(&result->keyProperty, (config->keyProperty == NULL) ? GW_SOURCE_PROPERTY : config->keyProperty) != 0)
+        {
+            LogError("unable to copy the key property");
+            result->keyProperty = NULL;
+        }
+        else if ((result->lock = Lock_Init()) == NULL)
+        {
+            LogError("unable to Lock_Init");
+        }
+        else if ((result->stopCondition = Condition_Init()) == NULL)
+        {
+            LogError("unable to Condition_Init");
+        }
+        else if ((result->summaries = (LATENCY_SINK_SUMMARY *)malloc(LATENCY_SINK_MAX_SOURCES * sizeof(LATENCY_SINK_SUMMARY))) == NULL)
+        {
+            LogError("unable to allocate the summaries");
+        }
+        /*Codes_SRS_LATENCY_SINK_30_005: [ When fileName is not NULL, LatencySink_Create shall open the file to append the reports to it. ]*/
+        else if (config->fileName != NULL && (result->file = fopen(config->fileName, "ab")) == NULL)
+        {
+            LogError("unable to open %s", config->fileName);
+        }
+        /*Codes_SRS_LATENCY_SINK_30_006: [ When publishReports is true, LatencySink_Create shall create the properties of the report messages. ]*/
+        else if (config->publishReports &&
+            ((result->reportProperties = Map_Create(NULL)) == NULL ||
+            Map_Add(result->reportProperties, GW_SOURCE_PROPERTY, GW_SOURCE_LATENCY_REPORT) != MAP_OK))
+        {
+            LogError("unable to create the properties of the reports");
+        }
+        else
+        {
+            /*Codes_SRS_LATENCY_SINK_30_007: [ Otherwise LatencySink_Create shall return a non-NULL handle. ]*/
+            created = true;
+        }
+
+        if (!created)
+        {
+            LatencySink_FreeModule(result);
+            result = NULL;
+        }
+    }
+    return result;
+}
+
+static void * LatencySink_ParseConfigurationFromJson(const char* configuration)
+{
+    LATENCY_SINK_CONFIG * result;
+    /*Codes_SRS_LATENCY_SINK_30_008: [ If configuration is NULL or the JSON null, LatencySink_ParseConfigurationFromJson shall return the default configuration. ]*/
+    JSON_Value * json = (configuration == NULL) ? NULL : json_parse_string(configuration);
+    JSON_Object * jsonObject = (json == NULL) ? NULL : json_value_get_object(json);
+    if (configuration != NULL && (json == NULL || (jsonObject == NULL && json_value_get_type(json) != JSONNull)))
+    {
+        /*Codes_SRS_LATENCY_SINK_30_009: [ If configuration is neither a JSON object nor the JSON null, LatencySink_ParseConfigurationFromJson shall fail and return NULL. ]*/
+        LogError("the configuration is not a JSON object");
+        result = NULL;
+    }
+    else
+    {
+        const char * keyProperty = NULL;
+        double reportPeriodMs = 0;
+        const char * fileName = NULL;
+        int publishReports = 0;
+        if (jsonObject != NULL)
+        {
+            /*Codes_SRS_LATENCY_SINK_30_010: [ LatencySink_ParseConfigurationFromJson shall read the optional "keyProperty", "reportPeriodMs", "fileName" and "publishReports". ]*/
+            keyProperty = json_object_get_string(jsonObject, "keyProperty");
+            reportPeriodMs = json_object_get_number(jsonObject, "reportPeriodMs");
+            fileName = json_object_get_string(jsonObject, "fileName");
+            publishReports = json_object_get_boolean(jsonObject, "publishReports");
+        }
+
+        if (reportPeriodMs < 0 || reportPeriodMs > LATENCY_SINK_MAX_REPORT_PERIOD_MS)
+        {
+            /*Codes_SRS_LATENCY_SINK_30_011: [ If "reportPeriodMs" is negative or more than a day, LatencySink_ParseConfigurationFromJson shall fail and return NULL. ]*/
+            LogError("reportPeriodMs is not a number of milliseconds up to a day");
+            result = NULL;
+        }
+        else if ((result = (LATENCY_SINK_CONFIG *)malloc(sizeof(LATENCY_SINK_CONFIG))) == NULL)
+        {
+            /*Codes_SRS_LATENCY_SINK_30_012: [ If any allocation fails, LatencySink_ParseConfigurationFromJson shall fail and return NULL. ]*/
+            LogError("unable to allocate the configuration");
+        }
+        else
+        {
+            char * keyPropertyCopy = NULL;
+            char * fileNameCopy = NULL;
+            if ((keyProperty != NULL && mallocAndStrcpy_s(&keyPropertyCopy, keyProperty) != 0) ||
+                (fileName != NULL && mallocAndStrcpy_s(&fileNameCopy, fileName) != 0))
+            {
+                LogError("unable to copy the configuration");
+                free(keyPropertyCopy);
+                free(result);
+                result = NULL;
+            }
+            else
+            {
+                result->keyProperty = keyPropertyCopy;
+                result->reportPeriodMs = (unsigned int)reportPeriodMs;
+                result->fileName = fileNameCopy;
+                result->publishReports = (publishReports == 1);
+            }
+        }
+    }
+
+    if (json != NULL)
+    {
+        json_value_free(json);
+    }
+    return result;
+}
+
+static void LatencySink_FreeConfiguration(void * configuration)
+{
+    /*Codes_SRS_LATENCY_SINK_30_013: [ LatencySink_FreeConfiguration shall release the configuration, if it is not NULL. ]*/
+    if (configuration != NULL)
+    {
+        LATENCY_SINK_CONFIG * config = (LATENCY_SINK_CONFIG *)configuration;
+        free((void *)config->keyProperty);
+        free((void *)config->fileName);
+        free(config);
+    }
+}
+
+static void LatencySink_Start(MODULE_HANDLE moduleHandle)
+{
+    if (moduleHandle == NULL)
+    {
+        LogError("invalid arg moduleHandle=NULL");
+    }
+    else
+    {
+        /*Codes_SRS_LATENCY_SINK_30_014: [ LatencySink_Start shall start the thread making the reports. ]*/
+        LATENCY_SINK_DATA * moduleData = (LATENCY_SINK_DATA *)moduleHandle;
+        if (ThreadAPI_Create(&moduleData->thread, LatencySink_Reporter, moduleData) != THREADAPI_OK)
+        {
+            LogError("unable to ThreadAPI_Create, the latencies will not be reported");
+            moduleData->thread = NULL;
+        }
+    }
+}
+
+static void LatencySink_Destroy(MODULE_HANDLE moduleHandle)
+{
+    /*Codes_SRS_LATENCY_SINK_30_020: [ If moduleHandle is NULL, LatencySink_Destroy shall return. ]*/
+    if (moduleHandle != NULL)
+    {
+        LATENCY_SINK_DATA * moduleData = (LATENCY_SINK_DATA *)moduleHandle;
+        if (moduleData->thread != NULL)
+        {
+            int notUsed;
+            /*Codes_SRS_LATENCY_SINK_30_021: [ LatencySink_Destroy shall stop the reporting thread and wait for it. ]*/
+            if (Lock(moduleData->lock) != LOCK_OK)
+            {
+                LogError("unable to Lock, stopping the reporter anyway");
+                moduleData->stopping = true;
+                (void)Condition_Post(moduleData->stopCondition);
+            }
+            else
+            {
+                moduleData->stopping = true;
+                (void)Condition_Post(moduleData->stopCondition);
+                (void)Unlock(moduleData->lock);
+            }
+            if (ThreadAPI_Join(moduleData->thread, &notUsed) != THREADAPI_OK)
+            {
+                LogError("unable to ThreadAPI_Join, the reporter may outlive the module");
+            }
+        }
+        /*Codes_SRS_LATENCY_SINK_30_023: [ LatencySink_Destroy shall release all the resources of the module. ]*/
+        LatencySink_FreeModule(moduleData);
+    }
+}
+
+static void LatencySink_Receive(MODULE_HANDLE moduleHandle, MESSAGE_HANDLE messageHandle)
+{
+    if (moduleHandle == NULL || messageHandle == NULL)
+    {
+        /*Codes_SRS_LATENCY_SINK_30_024: [ If moduleHandle or messageHandle is NULL, LatencySink_Receive shall return. ]*/
+        LogError("invalid arg moduleHandle=%p messageHandle=%p", moduleHandle, messageHandle);
+    }
+    else
+    {
+        LATENCY_SINK_DATA * moduleData = (LATENCY_SINK_DATA *)moduleHandle;
+        /*the clock is read first, looking up the properties is part of the latency of the gateway*/
+        uint64_t now = MonotonicClock_GetUs();
+        /*Codes_SRS_LATENCY_SINK_30_025: [ LatencySink_Receive shall account the message to the source named by its keyProperty, the empty name when it has none. ]*/
+        const char * name = Message_GetProperty(messageHandle, moduleData->keyProperty);
+        /*Codes_SRS_LATENCY_SINK_30_026: [ The latency of the message shall be the microseconds between its GW_SEND_TIME_PROPERTY and the monotonic clock of the machine when LatencySink_Receive is called. ]*/
+        uint64_t latency = 0;
+        bool stamped = LatencySink_ParseSendTime(Message_GetProperty(messageHandle, GW_SEND_TIME_PROPERTY), now, &latency);
+        if (Lock(moduleData->lock) != LOCK_OK)
+        {
+            LogError("unable to Lock, the message is not accounted");
+        }
+        else
+        {
+            LATENCY_SINK_SOURCE * source = LatencySink_FindSource(moduleData, (name == NULL) ? "" : name);
+            if (source == NULL)
+            {
+                /*Codes_SRS_LATENCY_SINK_30_027: [ Past LATENCY_SINK_MAX_SOURCES sources, the messages of new sources shall only be counted as untracked. ]*/
+                moduleData->untracked++;
+            }
+            else if (!stamped)
+            {
+                /*Codes_SRS_LATENCY_SINK_30_028: [ A message without a GW_SEND_TIME_PROPERTY of decimal digits that is not in the future shall be counted as unstamped. ]*/
+                source->unstamped++;
+            }
+            else
+            {
+                source->buckets[LatencySink_BucketIndex(latency)]++;
+                source->count++;
+                source->sum += latency;
+                source->min = (latency < source->min) ? latency : source->min;
+                source->max = (latency > source->max) ? latency : source->max;
+            }
+            (void)Unlock(moduleData->lock);
+        }
+    }
+}
+
+static const MODULE_API_1 LatencySink_APIS_all =
+{
+    {MODULE_API_VERSION_1},
+    LatencySink_ParseConfigurationFromJson,
+    LatencySink_FreeConfiguration,
+    LatencySink_Create,
+    LatencySink_Destroy,
+    LatencySink_Receive,
+    LatencySink_Start
+};
+
+#ifdef BUILD_MODULE_TYPE_STATIC
+MODULE_EXPORT const MODULE_API* MODULE_STATIC_GETAPI(LATENCY_SINK_MODULE)(MODULE_API_VERSION gateway_api_version)
+#else
+MODULE_EXPORT const MODULE_API* Module_GetApi(MODULE_API_VERSION gateway_api_version)
+#endif
+{
+    const MODULE_API* result;
+    if (gateway_api_version >= LatencySink_APIS_all.base.version)
+    {
+        /*Codes_SRS_LATENCY_SINK_30_029: [ Module_GetApi shall return the MODULE_API structure. ]*/
+        result = (const MODULE_API*)&LatencySink_APIS_all;
+    }
+    else
+    {
+        result = NULL;
+    }
+    return result;
+}
@@ -0,0 +1,869 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifdef __cplusplus
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#else
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdint.h>
+#endif
+
+#include "testrunnerswitcher.h"
+#include "umock_c.h"
+
+static void* my_gballoc_malloc(size_t size)
+{
+    return malloc(size);
+}
+
+static void my_gballoc_free(void* s)
+{
+    free(s);
+}
+
+#define ENABLE_MOCKS
+#include "module.h"
+#include "module_access.h"
+#include "azure_c_shared_utility/gballoc.h"
+#include "azure_c_shared_utility/crt_abstractions.h"
+#include "azure_c_shared_utility/lock.h"
+#include "azure_c_shared_utility/condition.h"
+#include "azure_c_shared_utility/threadapi.h"
+#include "azure_c_shared_utility/map.h"
+#include "message.h"
+#include "broker.h"
+#include "parson.h"
+
+MOCKABLE_FUNCTION(, JSON_Value*, json_parse_string, const char *, string);
+MOCKABLE_FUNCTION(, JSON_Object*, json_value_get_object, const JSON_Value *, value);
+MOCKABLE_FUNCTION(, JSON_Value_Type, json_value_get_type, const JSON_Value *, value);
+MOCKABLE_FUNCTION(, const char*, json_object_get_string, const JSON_Object *, object, const char *, name);
+MOCKABLE_FUNCTION(, double, json_object_get_number, const JSON_Object *, object, const char *, name);
+MOCKABLE_FUNCTION(, int, json_object_get_boolean, const JSON_Object *, object, const char *, name);
+MOCKABLE_FUNCTION(, void, json_value_free, JSON_Value *, value);
+
+MOCKABLE_FUNCTION(, const char*, Message_GetProperty, MESSAGE_HANDLE, message, const char*, key);
+MOCKABLE_FUNCTION(, MESSAGE_HANDLE, Message_Create, const MESSAGE_CONFIG*, cfg);
+MOCKABLE_FUNCTION(, void, Message_Destroy, MESSAGE_HANDLE, message);
+MOCKABLE_FUNCTION(, BROKER_RESULT, Broker_Publish, BROKER_HANDLE, broker, MODULE_HANDLE, source, MESSAGE_HANDLE, message);
+
+/*the module is built with GB_STDIO_INTERCEPT*/
+MOCKABLE_FUNCTION(, FILE*, gb_fopen, const char*, filename, const char*, mode);
+MOCKABLE_FUNCTION(, int, gb_fclose, FILE*, stream);
+
+#undef ENABLE_MOCKS
+
+#include "latency_sink.h"
+#include "monotonic_clock.h"
+
+static TEST_MUTEX_HANDLE g_testByTest;
+static TEST_MUTEX_HANDLE g_dllByDll;
+
+#define TEST_REPORT_FILE "latency_sink_ut.ndjson"
+
+static int my_mallocAndStrcpy_s(char** destination, const char* source)
+{
+    size_t size = strlen(source) + 1;
+    *destination = (char*)malloc(size);
+    (void)memcpy(*destination, source, size);
+    return 0;
+}
+
+/*the reports are written to a real file*/
+static FILE* my_gb_fopen(const char* filename, const char* mode)
+{
+    return fopen(filename, mode);
+}
+
+static int my_gb_fclose(FILE* stream)
+{
+    return fclose(stream);
+}
+
+/*the reporter is run by ThreadAPI_Join, once Destroy has asked it to stop*/
+static THREAD_START_FUNC g_threadFunc;
+static void* g_threadArg;
+
+static THREADAPI_RESULT my_ThreadAPI_Create(THREAD_HANDLE* threadHandle, THREAD_START_FUNC func, void* arg)
+{
+    g_threadFunc = func;
+    g_threadArg = arg;
+    *threadHandle = (THREAD_HANDLE)0x46;
+    return THREADAPI_OK;
+}
+
+static THREADAPI_RESULT my_ThreadAPI_Join(THREAD_HANDLE threadHandle, int* res)
+{
+    (void)threadHandle;
+    *res = g_threadFunc(g_threadArg);
+    return THREADAPI_OK;
+}
+
+/*a message is its properties*/
+typedef struct TEST_MESSAGE_TAG
+{
+    const char* source; /*NULL when the message has no GW_SOURCE_PROPERTY*/
+    const char* sendTime; /*NULL when the message has no GW_SEND_TIME_PROPERTY*/
+    char sendTimeValue[32];
+} TEST_MESSAGE;
+
+static const char* my_Message_GetProperty(MESSAGE_HANDLE handle, const char* key)
+{
+    const TEST_MESSAGE* message = (const TEST_MESSAGE*)handle;
+    return (strcmp(key, "source") == 0) ? message->source : (strcmp(key, "sendTime") == 0) ? message->sendTime : NULL;
+}
+
+/*sends a message sent ageUs microseconds ago*/
+static void receive_stamped(const MODULE_API* apis, MODULE_HANDLE module, const char* source, uint64_t ageUs)
+{
+    TEST_MESSAGE message;
+    message.source = source;
+    (void)sprintf(message.sendTimeValue, "%llu", (unsigned long long)(MonotonicClock_GetUs() - ageUs));
+    message.sendTime = message.sendTimeValue;
+    MODULE_RECEIVE(apis)(module, (MESSAGE_HANDLE)&message);
+}
+
+static void receive_unstamped(const MODULE_API* apis, MODULE_HANDLE module, const char* source, const char* sendTime)
+{
+    TEST_MESSAGE message;
+    message.source = source;
+    message.sendTime = sendTime;
+    MODULE_RECEIVE(apis)(module, (MESSAGE_HANDLE)&message);
+}
+
+/*the content of the report file, empty when there is no such file*/
+static char g_report[4096];
+
+static const char* read_report(void)
+{
+    FILE* file = fopen(TEST_REPORT_FILE, "rb");
+    g_report[0] = '\0';
+    if (file != NULL)
+    {
+        size_t read = fread(g_report, 1, sizeof(g_report) - 1, file);
+        g_report[read] = '\0';
+        (void)fclose(file);
+    }
+    return g_report;
+}
+
+DEFINE_ENUM_STRINGS(UMOCK_C_ERROR_CODE, UMOCK_C_ERROR_CODE_VALUES)
+
+static void on_umock_c_error(UMOCK_C_ERROR_CODE error_code)
+{
+    char temp_str[256];
+    (void)snprintf(temp_str, sizeof(temp_str), "umock_c reported error :%s", ENUM_TO_STRING(UMOCK_C_ERROR_CODE, error_code));
+    ASSERT_FAIL(temp_str);
+}
+
+
+BEGIN_TEST_SUITE(latency_sink_ut)
+
+TEST_SUITE_INITIALIZE(suite_init)
+{
+    TEST_INITIALIZE_MEMORY_DEBUG(g_dllByDll);
+    g_testByTest = TEST_MUTEX_CREATE();
+    ASSERT_IS_NOT_NULL(g_testByTest);
+
+    umock_c_init(on_umock_c_error);
+
+    REGISTER_GLOBAL_MOCK_HOOK(gballoc_malloc, my_gballoc_malloc);
+    REGISTER_GLOBAL_MOCK_HOOK(gballoc_free, my_gballoc_free);
+    REGISTER_GLOBAL_MOCK_HOOK(mallocAndStrcpy_s, my_mallocAndStrcpy_s);
+    REGISTER_GLOBAL_MOCK_HOOK(gb_fopen, my_gb_fopen);
+    REGISTER_GLOBAL_MOCK_HOOK(gb_fclose, my_gb_fclose);
+
+    REGISTER_GLOBAL_MOCK_RETURN(Lock_Init, (LOCK_HANDLE)0x44);
+    REGISTER_GLOBAL_MOCK_RETURN(Lock, LOCK_OK);
+    REGISTER_GLOBAL_MOCK_RETURN(Unlock, LOCK_OK);
+    REGISTER_GLOBAL_MOCK_RETURN(Condition_Init, (COND_HANDLE)0x45);
+    REGISTER_GLOBAL_MOCK_RETURN(Map_Create, (MAP_HANDLE)0x47);
+    REGISTER_GLOBAL_MOCK_RETURN(Map_Add, MAP_OK);
+    REGISTER_GLOBAL_MOCK_HOOK(ThreadAPI_Create, my_ThreadAPI_Create);
+    REGISTER_GLOBAL_MOCK_HOOK(ThreadAPI_Join, my_ThreadAPI_Join);
+    REGISTER_GLOBAL_MOCK_HOOK(Message_GetProperty, my_Message_GetProperty);
+
+    REGISTER_UMOCK_ALIAS_TYPE(MODULE_HANDLE, void*);
+
+    REGISTER_UMOCK_ALIAS_TYPE(BROKER_HANDLE, void*);
+
+    REGISTER_UMOCK_ALIAS_TYPE(BROKER_RESULT, int);
+
+    REGISTER_UMOCK_ALIAS_TYPE(MESSAGE_HANDLE, void*);
+
+    REGISTER_UMOCK_ALIAS_TYPE(MAP_HANDLE, void*);
+
+    REGISTER_UMOCK_ALIAS_TYPE(MAP_FILTER_CALLBACK, void*);
+
+    REGISTER_UMOCK_ALIAS_TYPE(MAP_RESULT, int);
+
+
+    REGISTER_UMOCK_ALIAS_TYPE(JSON_Value_Type, int);
+
+    REGISTER_UMOCK_ALIAS_TYPE(LOCK_HANDLE, void*);
+
+    REGISTER_UMOCK_ALIAS_TYPE(LOCK_RESULT, int);
+
+    REGISTER_UMOCK_ALIAS_TYPE(COND_HANDLE, void*);
+
+    REGISTER_UMOCK_ALIAS_TYPE(COND_RESULT, int);
+
+    REGISTER_UMOCK_ALIAS_TYPE(THREAD_HANDLE, void*);
+
+    REGISTER_UMOCK_ALIAS_TYPE(THREAD_START_FUNC, void*);
+
+    REGISTER_UMOCK_ALIAS_TYPE(THREADAPI_RESULT, int);
+}
+
+TEST_SUITE_CLEANUP(suite_cleanup)
+{
+    umock_c_deinit();
+    TEST_MUTEX_DESTROY(g_testByTest);
+    TEST_DEINITIALIZE_MEMORY_DEBUG(g_dllByDll);
+}
+
+TEST_FUNCTION_INITIALIZE(method_init)
+{
+    if (TEST_MUTEX_ACQUIRE(g_testByTest))
+    {
+        ASSERT_FAIL("our mutex is ABANDONED. Failure in test framework");
+    }
+
+    umock_c_reset_all_calls();
+    g_threadFunc = NULL;
+    g_threadArg = NULL;
+    (void)remove(TEST_REPORT_FILE);
+}
+
+TEST_FUNCTION_CLEANUP(method_cleanup)
+{
+    (void)remove(TEST_REPORT_FILE);
+    TEST_MUTEX_RELEASE(g_testByTest);
+}
+
+/*the calls of LatencySink_Create for a module without file and without published reports*/
+static void expected_calls_create(void)
+{
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
+        .IgnoreArgument(1);
+
+    STRICT_EXPECTED_CALL(mallocAndStrcpy_s(IGNORED_PTR_ARG, "source"))
+        .IgnoreArgument(1);
+
+    STRICT_EXPECTED_CALL(Lock_Init());
+
+    STRICT_EXPECTED_CALL(Condition_Init());
+
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
+        .IgnoreArgument(1);
+}
+
+/*the calls releasing a module without file, without published reports and without sources*/
+static void expected_calls_free_module(void)
+{
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+
+    STRICT_EXPECTED_CALL(Condition_Deinit((COND_HANDLE)0x45));
+
+    STRICT_EXPECTED_CALL(Lock_Deinit((LOCK_HANDLE)0x44));
+
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+}
+
+/*Tests_SRS_LATENCY_SINK_30_029: [ Module_GetApi shall return the MODULE_API structure. ]*/
+TEST_FUNCTION(LatencySink_Module_GetApi_returns_non_NULL)
+{
+    // arrange
+
+    // act
+    const MODULE_API* apis = Module_GetApi(MODULE_API_VERSION_1);
+
+    // assert
+    ASSERT_IS_TRUE(MODULE_PARSE_CONFIGURATION_FROM_JSON(apis) != NULL);
+    ASSERT_IS_TRUE(MODULE_FREE_CONFIGURATION(apis) != NULL);
+    ASSERT_IS_TRUE(MODULE_CREATE(apis) != NULL);
+    ASSERT_IS_TRUE(MODULE_DESTROY(apis) != NULL);
+    ASSERT_IS_TRUE(MODULE_RECEIVE(apis) != NULL);
+    ASSERT_IS_TRUE(MODULE_START(apis) != NULL);
+}
+
+/*Tests_SRS_LATENCY_SINK_30_001: [ If broker or configuration is NULL, LatencySink_Create shall fail and return NULL. ]*/
+TEST_FUNCTION(LatencySink_Create_returns_NULL_when_broker_is_NULL)
+{
+    // arrange
+    const MODULE_API* apis = Module_GetApi(MODULE_API_VERSION_1);
+    LATENCY_SINK_CONFIG config = { NULL, 0, NULL, false };
+
+    // act
+    MODULE_HANDLE result = MODULE_CREATE(apis)(NULL, &config);
+
+    // assert
+    ASSERT_IS_NULL(result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/*Tests_SRS_LATENCY_SINK_30_001: [ If broker or configuration is NULL, LatencySink_Create shall fail and return NULL. ]*/
+TEST_FUNCTION(LatencySink_Create_returns_NULL_when_configuration_is_NULL)
+{
+    // arrange
+    const MODULE_API* apis = Module_GetApi(MODULE_API_VERSION_1);
+
+    // act
+    MODULE_HANDLE result = MODULE_CREATE(apis)((BROKER_HANDLE)0x42, NULL);
+
+    // assert
+    ASSERT_IS_NULL(result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/*Tests_SRS_LATENCY_SINK_30_002: [ If reportPeriodMs is more than a day, LatencySink_Create shall fail and return NULL. ]*/
+TEST_FUNCTION(LatencySink_Create_returns_NULL_when_the_report_period_is_more_than_a_day)
+{
+    // arrange
+    const MODULE_API* apis = Module_GetApi(MODULE_API_VERSION_1);
+    LATENCY_SINK_CONFIG config = { NULL, 24 * 60 * 60 * 1000 + 1, NULL, false };
+
+    // act
+    MODULE_HANDLE result = MODULE_CREATE(apis)((BROKER_HANDLE)0x42, &config);
+
+    // assert
+    ASSERT_IS_NULL(result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/*Tests_SRS_LATENCY_SINK_30_004: [ LatencySink_Create shall copy the keyProperty, GW_SOURCE_PROPERTY when it is NULL. ]*/
+/*Tests_SRS_LATENCY_SINK_30_007: [ Otherwise LatencySink_Create shall return a non-NULL handle. ]*/
+/*Tests_SRS_LATENCY_SINK_30_023: [ LatencySink_Destroy shall release all the resources of the module. ]*/
+TEST_FUNCTION(LatencySink_Create_succeeds_with_the_default_configuration)
+{
+    // arrange
+    const MODULE_API* apis = Module_GetApi(MODULE_API_VERSION_1);
+    LATENCY_SINK_CONFIG config = { NULL, 0, NULL, false };
+    MODULE_HANDLE result;
+
+    expected_calls_create();
+
+    // act
+    result = MODULE_CREATE(apis)((BROKER_HANDLE)0x42, &config);
+
+    // assert
+    ASSERT_IS_NOT_NULL(result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    umock_c_reset_all_calls();
+    expected_calls_free_module();
+    MODULE_DESTROY(apis)(result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/*Tests_SRS_LATENCY_SINK_30_005: [ When fileName is not NULL, LatencySink_Create shall open the file to append the reports to it. ]*/
+/*Tests_SRS_LATENCY_SINK_30_006: [ When publishReports is true, LatencySink_Create shall create the properties of the report messages. ]*/
+TEST_FUNCTION(LatencySink_Create_opens_the_file_and_creates_the_report_properties)
+{
+    // arrange
+    const MODULE_API* apis = Module_GetApi(MODULE_API_VERSION_1);
+    LATENCY_SINK_CONFIG config = { "macAddress", 1000, TEST_REPORT_FILE, true };
+    MODULE_HANDLE result;
+
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
+        .IgnoreArgument(1);
+
+    STRICT_EXPECTED_CALL(mallocAndStrcpy_s(IGNORED_PTR_ARG, "macAddress"))
+        .IgnoreArgument(1);
+
+    STRICT_EXPECTED_CALL(Lock_Init());
+
+    STRICT_EXPECTED_CALL(Condition_Init());
+
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
+        .IgnoreArgument(1);
+
+    STRICT_EXPECTED_CALL(gb_fopen(TEST_REPORT_FILE, "ab"));
+
+    STRICT_EXPECTED_CALL(Map_Create(NULL));
+
+    STRICT_EXPECTED_CALL(Map_Add((MAP_HANDLE)0x47, "source", "latencyReport"));
+
+    // act
+    result = MODULE_CREATE(apis)((BROKER_HANDLE)0x42, &config);
+
+    // assert
+    ASSERT_IS_NOT_NULL(result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    MODULE_DESTROY(apis)(result);
+}
+
+/*Tests_SRS_LATENCY_SINK_30_003: [ If any resource of the module cannot be created, LatencySink_Create shall fail, release what it created and return NULL. ]*/
+TEST_FUNCTION(LatencySink_Create_returns_NULL_when_Condition_Init_fails)
+{
+    // arrange
+    const MODULE_API* apis = Module_GetApi(MODULE_API_VERSION_1);
+    LATENCY_SINK_CONFIG config = { NULL, 0, NULL, false };
+    MODULE_HANDLE result;
+
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
+        .IgnoreArgument(1);
+
+    STRICT_EXPECTED_CALL(mallocAndStrcpy_s(IGNORED_PTR_ARG, "source"))
+        .IgnoreArgument(1);
+
+    STRICT_EXPECTED_CALL(Lock_Init());
+
+    STRICT_EXPECTED_CALL(Condition_Init())
+        .SetReturn((COND_HANDLE)NULL);
+
+    STRICT_EXPECTED_CALL(gballoc_free(NULL));
+
+    STRICT_EXPECTED_CALL(Lock_Deinit((LOCK_HANDLE)0x44));
+
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+
+    // act
+    result = MODULE_CREATE(apis)((BROKER_HANDLE)0x42, &config);
+
+    // assert
+    ASSERT_IS_NULL(result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/*Tests_SRS_LATENCY_SINK_30_003: [ If any resource of the module cannot be created, LatencySink_Create shall fail, release what it created and return NULL. ]*/
+TEST_FUNCTION(LatencySink_Create_returns_NULL_when_the_file_cannot_be_opened)
+{
+    // arrange
+    const MODULE_API* apis = Module_GetApi(MODULE_API_VERSION_1);
+    LATENCY_SINK_CONFIG config = { NULL, 0, TEST_REPORT_FILE, false };
+    MODULE_HANDLE result;
+
+    expected_calls_create();
+
+    STRICT_EXPECTED_CALL(gb_fopen(TEST_REPORT_FILE, "ab"))
+        .SetReturn((FILE*)NULL);
+
+    expected_calls_free_module();
+
+    // act
+    result = MODULE_CREATE(apis)((BROKER_HANDLE)0x42, &config);
+
+    // assert
+    ASSERT_IS_NULL(result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/*Tests_SRS_LATENCY_SINK_30_008: [ If configuration is NULL or the JSON null, LatencySink_ParseConfigurationFromJson shall return the default configuration. ]*/
+TEST_FUNCTION(LatencySink_ParseConfigurationFromJson_returns_the_default_configuration_when_configuration_is_NULL)
+{
+    // arrange
+    const MODULE_API* apis = Module_GetApi(MODULE_API_VERSION_1);
+    LATENCY_SINK_CONFIG* result;
+
+    STRICT_EXPECTED_CALL(gballoc_malloc(sizeof(LATENCY_SINK_CONFIG)));
+
+    // act
+    result = (LATENCY_SINK_CONFIG*)MODULE_PARSE_CONFIGURATION_FROM_JSON(apis)(NULL);
+
+    // assert
+    ASSERT_IS_NOT_NULL(result);
+    ASSERT_IS_NULL(result->keyProperty);
+    ASSERT_ARE_EQUAL(int, 0, result->reportPeriodMs);
+    ASSERT_IS_NULL(result->fileName);
+    ASSERT_IS_FALSE(result->publishReports);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    MODULE_FREE_CONFIGURATION(apis)(result);
+}
+
+/*Tests_SRS_LATENCY_SINK_30_008: [ If configuration is NULL or the JSON null, LatencySink_ParseConfigurationFromJson shall return the default configuration. ]*/
+TEST_FUNCTION(LatencySink_ParseConfigurationFromJson_returns_the_default_configuration_when_configuration_is_null)
+{
+    // arrange
+    const MODULE_API* apis = Module_GetApi(MODULE_API_VERSION_1);
+    LATENCY_SINK_CONFIG* result;
+
+    STRICT_EXPECTED_CALL(json_parse_string("null"))
+        .SetReturn((JSON_Value*)0x42);
+
+    STRICT_EXPECTED_CALL(json_value_get_object((JSON_Value*)0x42))
+        .SetReturn((JSON_Object*)NULL);
+
+    STRICT_EXPECTED_CALL(json_value_get_type((JSON_Value*)0x42))
+        .SetReturn(JSONNull);
+
+    STRICT_EXPECTED_CALL(gballoc_malloc(sizeof(LATENCY_SINK_CONFIG)));
+
+    STRICT_EXPECTED_CALL(json_value_free((JSON_Value*)0x42));
+
+    // act
+    result = (LATENCY_SINK_CONFIG*)MODULE_PARSE_CONFIGURATION_FROM_JSON(apis)("null");
+
+    // assert
+    ASSERT_IS_NOT_NULL(result);
+    ASSERT_IS_NULL(result->keyProperty);
+    ASSERT_IS_NULL(result->fileName);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    MODULE_FREE_CONFIGURATION(apis)(result);
+}
+
+/*Tests_SRS_LATENCY_SINK_30_009: [ If configuration is neither a JSON object nor the JSON null, LatencySink_ParseConfigurationFromJson shall fail and return NULL. ]*/
+TEST_FUNCTION(LatencySink_ParseConfigurationFromJson_returns_NULL_when_configuration_is_not_JSON)
+{
+    // arrange
+    const MODULE_API* apis = Module_GetApi(MODULE_API_VERSION_1);
+
+    STRICT_EXPECTED_CALL(json_parse_string("{"))
+        .SetReturn((JSON_Value*)NULL);
+
+    // act
+    void* result = MODULE_PARSE_CONFIGURATION_FROM_JSON(apis)("{");
+
+    // assert
+    ASSERT_IS_NULL(result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/*Tests_SRS_LATENCY_SINK_30_009: [ If configuration is neither a JSON object nor the JSON null, LatencySink_ParseConfigurationFromJson shall fail and return NULL. ]*/
+TEST_FUNCTION(LatencySink_ParseConfigurationFromJson_returns_NULL_when_configuration_is_not_an_object)
+{
+    // arrange
+    const MODULE_API* apis = Module_GetApi(MODULE_API_VERSION_1);
+
+    STRICT_EXPECTED_CALL(json_parse_string("[]"))
+        .SetReturn((JSON_Value*)0x42);
+
+    STRICT_EXPECTED_CALL(json_value_get_object((JSON_Value*)0x42))
+        .SetReturn((JSON_Object*)NULL);
+
+    STRICT_EXPECTED_CALL(json_value_get_type((JSON_Value*)0x42))
+        .SetReturn(JSONArray);
+
+    STRICT_EXPECTED_CALL(json_value_free((JSON_Value*)0x42));
+
+    // act
+    void* result = MODULE_PARSE_CONFIGURATION_FROM_JSON(apis)("[]");
+
+    // assert
+    ASSERT_IS_NULL(result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/*Tests_SRS_LATENCY_SINK_30_010: [ LatencySink_ParseConfigurationFromJson shall read the optional "keyProperty", "reportPeriodMs", "fileName" and "publishReports". ]*/
+/*Tests_SRS_LATENCY_SINK_30_013: [ LatencySink_FreeConfiguration shall release the configuration, if it is not NULL. ]*/
+TEST_FUNCTION(LatencySink_ParseConfigurationFromJson_reads_the_configuration)
+{
+    // arrange
+    const MODULE_API* apis = Module_GetApi(MODULE_API_VERSION_1);
+    LATENCY_SINK_CONFIG* result;
+
+    STRICT_EXPECTED_CALL(json_parse_string("{}"))
+        .SetReturn((JSON_Value*)0x42);
+
+    STRICT_EXPECTED_CALL(json_value_get_object((JSON_Value*)0x42))
+        .SetReturn((JSON_Object*)0x43);
+
+    STRICT_EXPECTED_CALL(json_object_get_string((JSON_Object*)0x43, "keyProperty"))
+        .SetReturn("macAddress");
+
+    STRICT_EXPECTED_CALL(json_object_get_number((JSON_Object*)0x43, "reportPeriodMs"))
+        .SetReturn(500);
+
+    STRICT_EXPECTED_CALL(json_object_get_string((JSON_Object*)0x43, "fileName"))
+        .SetReturn("latency.ndjson");
+
+    STRICT_EXPECTED_CALL(json_object_get_boolean((JSON_Object*)0x43, "publishReports"))
+        .SetReturn(1);
+
+    STRICT_EXPECTED_CALL(gballoc_malloc(sizeof(LATENCY_SINK_CONFIG)));
+
+    STRICT_EXPECTED_CALL(mallocAndStrcpy_s(IGNORED_PTR_ARG, "macAddress"))
+        .IgnoreArgument(1);
+
+    STRICT_EXPECTED_CALL(mallocAndStrcpy_s(IGNORED_PTR_ARG, "latency.ndjson"))
+        .IgnoreArgument(1);
+
+    STRICT_EXPECTED_CALL(json_value_free((JSON_Value*)0x42));
+
+    // act
+    result = (LATENCY_SINK_CONFIG*)MODULE_PARSE_CONFIGURATION_FROM_JSON(apis)("{}");
+
+    // assert
+    ASSERT_IS_NOT_NULL(result);
+    ASSERT_ARE_EQUAL(char_ptr, "macAddress", result->keyProperty);
+    ASSERT_ARE_EQUAL(int, 500, result->reportPeriodMs);
+    ASSERT_ARE_EQUAL(char_ptr, "latency.ndjson", result->fileName);
+    ASSERT_IS_TRUE(result->publishReports);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    umock_c_reset_all_calls();
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(gballoc_free(result));
+    MODULE_FREE_CONFIGURATION(apis)(result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/*Tests_SRS_LATENCY_SINK_30_011: [ If "reportPeriodMs" is negative or more than a day, LatencySink_ParseConfigurationFromJson shall fail and return NULL. ]*/
+TEST_FUNCTION(LatencySink_ParseConfigurationFromJson_returns_NULL_when_the_report_period_is_negative)
+{
+    // arrange
+    const MODULE_API* apis = Module_GetApi(MODULE_API_VERSION_1);
+
+    STRICT_EXPECTED_CALL(json_parse_string("{}"))
+        .SetReturn((JSON_Value*)0x42);
+
+    STRICT_EXPECTED_CALL(json_value_get_object((JSON_Value*)0x42))
+        .SetReturn((JSON_Object*)0x43);
+
+    STRICT_EXPECTED_CALL(json_object_get_string((JSON_Object*)0x43, "keyProperty"))
+        .SetReturn((const char*)NULL);
+
+    STRICT_EXPECTED_CALL(json_object_get_number((JSON_Object*)0x43, "reportPeriodMs"))
+        .SetReturn(-1);
+
+    STRICT_EXPECTED_CALL(json_object_get_string((JSON_Object*)0x43, "fileName"))
+        .SetReturn((const char*)NULL);
+
+    STRICT_EXPECTED_CALL(json_object_get_boolean((JSON_Object*)0x43, "publishReports"))
+        .SetReturn(-1);
+
+    STRICT_EXPECTED_CALL(json_value_free((JSON_Value*)0x42));
+
+    // act
+    void* result = MODULE_PARSE_CONFIGURATION_FROM_JSON(apis)("{}");
+
+    // assert
+    ASSERT_IS_NULL(result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/*Tests_SRS_LATENCY_SINK_30_013: [ LatencySink_FreeConfiguration shall release the configuration, if it is not NULL. ]*/
+TEST_FUNCTION(LatencySink_FreeConfiguration_does_nothing_when_configuration_is_NULL)
+{
+    // arrange
+    const MODULE_API* apis = Module_GetApi(MODULE_API_VERSION_1);
+
+    // act
+    MODULE_FREE_CONFIGURATION(apis)(NULL);
+
+    // assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/*Tests_SRS_LATENCY_SINK_30_020: [ If moduleHandle is NULL, LatencySink_Destroy shall return. ]*/
+TEST_FUNCTION(LatencySink_Destroy_does_nothing_when_moduleHandle_is_NULL)
+{
+    // arrange
+    const MODULE_API* apis = Module_GetApi(MODULE_API_VERSION_1);
+
+    // act
+    MODULE_DESTROY(apis)(NULL);
+
+    // assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/*Tests_SRS_LATENCY_SINK_30_024: [ If moduleHandle or messageHandle is NULL, LatencySink_Receive shall return. ]*/
+TEST_FUNCTION(LatencySink_Receive_does_nothing_when_an_argument_is_NULL)
+{
+    // arrange
+    const MODULE_API* apis = Module_GetApi(MODULE_API_VERSION_1);
+    TEST_MESSAGE message = { "a", NULL, "" };
+
+    // act
+    MODULE_RECEIVE(apis)(NULL, (MESSAGE_HANDLE)&message);
+    MODULE_RECEIVE(apis)((MODULE_HANDLE)0x42, NULL);
+
+    // assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/*Tests_SRS_LATENCY_SINK_30_014: [ LatencySink_Start shall start the thread making the reports. ]*/
+/*Tests_SRS_LATENCY_SINK_30_021: [ LatencySink_Destroy shall stop the reporting thread and wait for it. ]*/
+/*Tests_SRS_LATENCY_SINK_30_016: [ A period without messages shall not be reported. ]*/
+TEST_FUNCTION(LatencySink_Destroy_stops_the_reporter)
+{
+    // arrange
+    const MODULE_API* apis = Module_GetApi(MODULE_API_VERSION_1);
+    LATENCY_SINK_CONFIG config = { NULL, 0, NULL, false };
+    MODULE_HANDLE module = MODULE_CREATE(apis)((BROKER_HANDLE)0x42, &config);
+    ASSERT_IS_NOT_NULL(module);
+
+    umock_c_reset_all_calls();
+    STRICT_EXPECTED_CALL(ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, module))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
+    MODULE_START(apis)(module);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(Lock((LOCK_HANDLE)0x44));
+
+    STRICT_EXPECTED_CALL(Condition_Post((COND_HANDLE)0x45));
+
+    STRICT_EXPECTED_CALL(Unlock((LOCK_HANDLE)0x44));
+
+    STRICT_EXPECTED_CALL(ThreadAPI_Join((THREAD_HANDLE)0x46, IGNORED_PTR_ARG))
+        .IgnoreArgument(2);
+
+    /*the reporter sees the module stopping*/
+    STRICT_EXPECTED_CALL(Lock((LOCK_HANDLE)0x44));
+
+    STRICT_EXPECTED_CALL(Unlock((LOCK_HANDLE)0x44));
+
+    /*and has nothing to report*/
+    STRICT_EXPECTED_CALL(Lock((LOCK_HANDLE)0x44));
+
+    STRICT_EXPECTED_CALL(Unlock((LOCK_HANDLE)0x44));
+
+    expected_calls_free_module();
+
+    // act
+    MODULE_DESTROY(apis)(module);
+
+    // assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/*Tests_SRS_LATENCY_SINK_30_025: [ LatencySink_Receive shall account the message to the source named by its keyProperty, the empty name when it has none. ]*/
+TEST_FUNCTION(LatencySink_Receive_reads_the_properties_of_the_message)
+{
+    // arrange
+    const MODULE_API* apis = Module_GetApi(MODULE_API_VERSION_1);
+    LATENCY_SINK_CONFIG config = { NULL, 0, NULL, false };
+    MODULE_HANDLE module = MODULE_CREATE(apis)((BROKER_HANDLE)0x42, &config);
+    TEST_MESSAGE message = { "a", NULL, "" };
+    ASSERT_IS_NOT_NULL(module);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(Message_GetProperty((MESSAGE_HANDLE)&message, "source"));
+
+    STRICT_EXPECTED_CALL(Message_GetProperty((MESSAGE_HANDLE)&message, "sendTime"));
+
+    STRICT_EXPECTED_CALL(Lock((LOCK_HANDLE)0x44));
+
+    /*the first message of a source adds it*/
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
+        .IgnoreArgument(1);
+
+    STRICT_EXPECTED_CALL(mallocAndStrcpy_s(IGNORED_PTR_ARG, "a"))
+        .IgnoreArgument(1);
+
+    STRICT_EXPECTED_CALL(Unlock((LOCK_HANDLE)0x44));
+
+    // act
+    MODULE_RECEIVE(apis)(module, (MESSAGE_HANDLE)&message);
+
+    // assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    MODULE_DESTROY(apis)(module);
+}
+
+/*Tests_SRS_LATENCY_SINK_30_015: [ Every reportPeriodMs, the module shall report the count, the number of unstamped messages, the minimum, mean, 50th, 90th, 99th, 99.9th percentile and maximum latency of each source, then start them over. ]*/
+/*Tests_SRS_LATENCY_SINK_30_017: [ When the module has a file, the report shall be appended to it as one line. ]*/
+/*Tests_SRS_LATENCY_SINK_30_022: [ LatencySink_Destroy shall report what was received since the last report, without publishing it. ]*/
+/*Tests_SRS_LATENCY_SINK_30_026: [ The latency of the message shall be the microseconds between its GW_SEND_TIME_PROPERTY and the monotonic clock of the machine when LatencySink_Receive is called. ]*/
+/*Tests_SRS_LATENCY_SINK_30_028: [ A message without a GW_SEND_TIME_PROPERTY of decimal digits that is not in the future shall be counted as unstamped. ]*/
+TEST_FUNCTION(LatencySink_reports_the_percentiles_of_each_source_to_the_file)
+{
+    // arrange
+    const MODULE_API* apis = Module_GetApi(MODULE_API_VERSION_1);
+    LATENCY_SINK_CONFIG config = { NULL, 0, TEST_REPORT_FILE, true };
+    MODULE_HANDLE module = MODULE_CREATE(apis)((BROKER_HANDLE)0x42, &config);
+    unsigned long long min, mean, p50, p90, p99, p999, max;
+    const char* report;
+    uint64_t i;
+    ASSERT_IS_NOT_NULL(module);
+    MODULE_START(apis)(module);
+
+    /*messages of "a" sent 1, 2... 100 ms ago*/
+    for (i = 1; i <= 100; i++)
+    {
+        receive_stamped(apis, module, "a", i * 1000);
+    }
+    receive_unstamped(apis, module, "b", NULL);
+    receive_unstamped(apis, module, "b", "12x");
+    receive_unstamped(apis, module, "b", "-1");
+    receive_unstamped(apis, module, "b", "99999999999999999999");
+    umock_c_reset_all_calls();
+
+    // act
+    MODULE_DESTROY(apis)(module);
+
+    // assert
+    report = read_report();
+    ASSERT_ARE_EQUAL(int, 7, sscanf(report,
+        "{\"periodMs\":10000,\"untracked\":0,\"sources\":[{\"source\":\"a\",\"count\":100,\"unstamped\":0,\"min\":%llu,\"mean\":%llu,\"p50\":%llu,\"p90\":%llu,\"p99\":%llu,\"p999\":%llu,\"max\":%llu}",
+        &min, &mean, &p50, &p90, &p99, &p999, &max));
+    ASSERT_IS_TRUE(min >= 1000);
+    ASSERT_IS_TRUE(mean >= 50500);
+    /*a percentile is within 1/64 of the latency it stands for*/
+    ASSERT_IS_TRUE(p50 >= 50000 && p50 < 60000);
+    ASSERT_IS_TRUE(p90 >= 90000 && p90 <= p99);
+    ASSERT_IS_TRUE(p99 >= 99000 && p99 <= p999);
+    ASSERT_IS_TRUE(p999 <= max);
+    ASSERT_IS_TRUE(max >= 100000);
+    ASSERT_IS_NOT_NULL(strstr(report, ",{\"source\":\"b\",\"count\":0,\"unstamped\":4,\"min\":0,\"mean\":0,\"p50\":0,\"p90\":0,\"p99\":0,\"p999\":0,\"max\":0}]}\n"));
+    /*the last report is not published*/
+    ASSERT_IS_NULL(strstr(umock_c_get_actual_calls(), "[Message_Create("));
+}
+
+/*Tests_SRS_LATENCY_SINK_30_025: [ LatencySink_Receive shall account the message to the source named by its keyProperty, the empty name when it has none. ]*/
+/*Tests_SRS_LATENCY_SINK_30_027: [ Past LATENCY_SINK_MAX_SOURCES sources, the messages of new sources shall only be counted as untracked. ]*/
+TEST_FUNCTION(LatencySink_counts_the_messages_of_sources_past_the_limit_as_untracked)
+{
+    // arrange
+    const MODULE_API* apis = Module_GetApi(MODULE_API_VERSION_1);
+    LATENCY_SINK_CONFIG config = { NULL, 0, TEST_REPORT_FILE, false };
+    MODULE_HANDLE module = MODULE_CREATE(apis)((BROKER_HANDLE)0x42, &config);
+    const char* expected = "{\"periodMs\":10000,\"untracked\":2,\"sources\":[{\"source\":\"\",\"count\":1,";
+    char source[16];
+    const char* report;
+    int i;
+    ASSERT_IS_NOT_NULL(module);
+    MODULE_START(apis)(module);
+
+    receive_stamped(apis, module, NULL, 1000);
+    receive_stamped(apis, module, "a\"b", 1000);
+    for (i = 2; i < LATENCY_SINK_MAX_SOURCES; i++)
+    {
+        (void)sprintf(source, "%d", i);
+        receive_stamped(apis, module, source, 1000);
+    }
+    receive_stamped(apis, module, "untracked", 1000);
+    receive_stamped(apis, module, "untracked", 1000);
+
+    // act
+    MODULE_DESTROY(apis)(module);
+
+    // assert
+    report = read_report();
+    ASSERT_ARE_EQUAL(int, 0, strncmp(report, expected, strlen(expected)));
+    ASSERT_IS_NOT_NULL(strstr(report, ",{\"source\":\"a\\\"b\",\"count\":1,"));
+    ASSERT_IS_NULL(strstr(report, "\"source\":\"untracked\""));
+}
+
+END_TEST_SUITE(latency_sink_ut)
@@ -4,11 +4,16 @@
 #ifndef LOGGER_H
 #define LOGGER_H
 
+#include <stdbool.h>
 #include "module.h"
 
+#define LOGGER_DEFAULT_BUFFER_SIZE (64 * 1024)
+#define LOGGER_DEFAULT_FLUSH_INTERVAL_MS 1000
+
 typedef enum LOGGER_TYPE_TAG
 {
-    LOGGING_TO_FILE
+    LOGGING_TO_FILE,
+    LOGGING_TO_NDJSON_FILE
 } LOGGER_TYPE;
 
 typedef struct LOGGER_CONFIG_TAG
@@ -20,6 +25,18 @@ typedef struct LOGGER_CONFIG_TAG
         {
             const char * name;
         } loggerConfigFile;
+        /*one JSON record per line, written from a buffer by a thread of the module*/
+        struct LOGGER_CONFIG_NDJSON_FILE_TAG
+        {
+            const char * name;
+            size_t bufferSize; /*bytes gathered before they are written, 0 means LOGGER_DEFAULT_BUFFER_SIZE*/
+            unsigned int flushIntervalMs; /*longest time a record waits in the buffer, 0 means LOGGER_DEFAULT_FLUSH_INTERVAL_MS*/
+            const char * jsonArrayName; /*when not NULL, Logger_Destroy also writes all the records of the file as a JSON array to this file*/
+            size_t segmentSize; /*the file is closed as name.1 and a new one is started before it grows over this many bytes, 0 means no limit*/
+            unsigned int segmentSeconds; /*the file is closed as name.1 and a new one is started once it is this old, 0 means no limit*/
+            size_t maxRetainedBytes; /*the oldest closed segments are deleted to keep them under this many bytes, 0 means no limit*/
+            bool compressSegments; /*closed segments are gzipped by a thread of the module into name.i.gz, needs use_zlib*/
+        } loggerConfigNdjsonFile;
     } selectee;
 } LOGGER_CONFIG; /*this needs to be passed to the Module_Create function*/
 
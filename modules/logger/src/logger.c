@@ -4,9 +4,11 @@
 #include <stdlib.h>
 #include <stddef.h>
 #include <stdbool.h>
+#include <string.h>
 #include <errno.h>
 
 #include "logger.h"
+#include "base64_write.h"
 
 #include <azure_c_shared_utility/gballoc.h>
 #include <azure_c_shared_utility/gb_stdio.h>
@@ -18,14 +20,72 @@
 #include <azure_c_shared_utility/map.h>
 #include <azure_c_shared_utility/constmap.h>
 #include <azure_c_shared_utility/strings.h>
+#include <azure_c_shared_utility/lock.h>
+#include <azure_c_shared_utility/condition.h>
+#include <azure_c_shared_utility/threadapi.h>
 
 #include <parson.h>
 
+#ifdef LOGGER_USE_ZLIB
+#include <zlib.h>
+#endif
+
+/*a segment closed by the NDJSON mode*/
+typedef struct LOGGER_SEGMENT_TAG
+{
+    size_t size;
+    bool compressed; /*the file is name.i.gz instead of name.i*/
+}LOGGER_SEGMENT;
+
+#define LOGGER_INITIAL_SEGMENT_CAPACITY 8
+#define LOGGER_SEGMENT_SUFFIX_SIZE (sizeof(".18446744073709551615.gz"))
+
 typedef struct LOGGER_HANDLE_DATA_TAG
 {
     FILE* fout;
+    LOGGER_TYPE selector;
+    /*the rest is only used by LOGGING_TO_NDJSON_FILE*/
+    LOCK_HANDLE lock; /*guards the buffers and the flags below*/
+    COND_HANDLE flushCondition; /*posted when the writer has to write the buffer or to stop*/
+    COND_HANDLE roomCondition; /*posted when the writer took the buffer or finished writing*/
+    THREAD_HANDLE writer;
+    char* buffer; /*the records waiting to be written*/
+    char* writing; /*the records being written by the writer*/
+    size_t bufferSize;
+    size_t bufferUsed;
+    unsigned int flushIntervalMs;
+    bool flushRequested;
+    bool writerBusy;
+    bool stopping;
+    char* name;
+    char* jsonArrayName; /*NULL when no JSON array is written at the end*/
+    /*segments, only used when segmentSize or segmentSeconds is not 0. Only one thread at a time writes the file*/
+    size_t segmentSize;
+    unsigned int segmentSeconds;
+    size_t maxRetainedBytes;
+    size_t segmentBytes; /*bytes in the file being written*/
+    time_t segmentStart;
+    LOGGER_SEGMENT* segments; /*the closed segments, segments[0] is name.1, the newest*/
+    size_t segmentCount;
+    size_t segmentCapacity;
+    char* stagingName; /*name.0, the segment just closed*/
+    char* segmentName; /*scratch names for renaming the closed segments*/
+    char* otherSegmentName;
+    size_t stagingBytes;
+    /*only used when compressSegments is true, then the closer thread owns the closed segments*/
+    bool compressSegments;
+    LOCK_HANDLE segmentLock; /*guards segmentPending and segmentStopping*/
+    COND_HANDLE segmentCondition; /*posted when a segment is staged, when it is closed and when the closer has to stop*/
+    THREAD_HANDLE segmentCloser;
+    bool segmentPending;
+    bool segmentStopping;
 }LOGGER_HANDLE_DATA;
 
+#define NDJSON_TIME "{\"time\":\""
+#define NDJSON_PROPERTIES "\",\"properties\":{"
+#define NDJSON_CONTENT "},\"content\":\""
+#define NDJSON_END "\"}\n"
+
 /*this function adds a JSON object to the output*/
 /*function assumes the file already has a json array in it. and that the last character is ] (when the first json is appended) or , when subsequent jsons are appended*/
 static int addJSONString(FILE* fout, const char* jsonString)
@@ -53,7 +113,8 @@ static int addJSONString(FILE* fout, const char* jsonString)
 
 
 
-static int LogStartStop_Print(char* destination, size_t destinationSize, bool appendStart, bool isAbsoluteStart)
+/*prints the local time with the strftime format. Returns 0 if success, otherwise __LINE__*/
+static int print_time(char* destination, size_t destinationSize, const char* format)
 {
     int result;
     time_t temp = time(NULL);
@@ -72,9 +133,6 @@ static int LogStartStop_Print(char* destination, size_t destinationSize, bool ap
         }
         else
         {
-            const char* format = appendStart ?
-                (isAbsoluteStart?"{\"time\":\"%c\",\"content\":\"Log started\"}]" : ",{\"time\":\"%c\",\"content\":\"Log started\"}]"):
-                ",{\"time\":\"%c\",\"content\":\"Log stopped\"}]";
             if (strftime(destination, destinationSize, format, t) == 0)
             {
                 LogError("unable to strftime");
@@ -89,6 +147,14 @@ static int LogStartStop_Print(char* destination, size_t destinationSize, bool ap
     return result;
 }
 
+static int LogStartStop_Print(char* destination, size_t destinationSize, bool appendStart, bool isAbsoluteStart)
+{
+    const char* format = appendStart ?
+        (isAbsoluteStart?"{\"time\":\"%c\",\"content\":\"Log started\"}]" : ",{\"time\":\"%c\",\"content\":\"Log started\"}]"):
+        ",{\"time\":\"%c\",\"content\":\"Log stopped\"}]";
+    return print_time(destination, destinationSize, format);
+}
+
 static int append_logStartStop(FILE* fout, bool appendStart, bool isAbsoluteStart)
 {
     int result;
@@ -114,6 +180,914 @@ static int append_logStartStop(FILE* fout, bool appendStart, bool isAbsoluteStar
     return result;
 }
 
+/*length of value once escaped as the inside of a JSON string*/
+static size_t json_string_length(const char* value)
+{
+    size_t result = 0;
+    for (; *value != '\0'; value++)
+    {
+        unsigned char c = (unsigned char)*value;
+        result += ((c == '"') || (c == '\\')) ? 2 : (c < 0x20) ? 6 : 1;
+    }
+    return result;
+}
+
+static char* json_string_write(char* destination, const char* value)
+{
+    static const char hexDigits[] = "0123456789abcdef";
+    for (; *value != '\0'; value++)
+    {
+        unsigned char c = (unsigned char)*value;
+        if ((c == '"') || (c == '\\'))
+        {
+            *destination++ = '\\';
+            *destination++ = (char)c;
+        }
+        else if (c < 0x20)
+        {
+            *destination++ = '\\';
+            *destination++ = 'u';
+            *destination++ = '0';
+            *destination++ = '0';
+            *destination++ = hexDigits[c >> 4];
+            *destination++ = hexDigits[c & 0x0F];
+        }
+        else
+        {
+            *destination++ = (char)c;
+        }
+    }
+    return destination;
+}
+
+/*the parts of one NDJSON record, gathered before the record is written*/
+typedef struct NDJSON_RECORD_TAG
+{
+    const char* time;
+    const char* const* keys;
+    const char* const* values;
+    size_t count;
+    const CONSTBUFFER* content;
+}NDJSON_RECORD;
+
+static size_t ndjson_record_length(const NDJSON_RECORD* record)
+{
+    size_t result = (sizeof(NDJSON_TIME) - 1) + json_string_length(record->time) + (sizeof(NDJSON_PROPERTIES) - 1);
+    size_t i;
+    for (i = 0; i < record->count; i++)
+    {
+        /*"key":"value" and the comma before all but the first*/
+        result += json_string_length(record->keys[i]) + json_string_length(record->values[i]) + ((i == 0) ? 5 : 6);
+    }
+    return result + (sizeof(NDJSON_CONTENT) - 1) + BASE64_WRITE_LENGTH(record->content->size) + (sizeof(NDJSON_END) - 1);
+}
+
+static void ndjson_record_write(char* destination, const NDJSON_RECORD* record)
+{
+    size_t i;
+    (void)memcpy(destination, NDJSON_TIME, sizeof(NDJSON_TIME) - 1);
+    destination = json_string_write(destination + sizeof(NDJSON_TIME) - 1, record->time);
+    (void)memcpy(destination, NDJSON_PROPERTIES, sizeof(NDJSON_PROPERTIES) - 1);
+    destination += sizeof(NDJSON_PROPERTIES) - 1;
+    for (i = 0; i < record->count; i++)
+    {
+        if (i != 0)
+        {
+            *destination++ = ',';
+        }
+        *destination++ = '"';
+        destination = json_string_write(destination, record->keys[i]);
+        *destination++ = '"';
+        *destination++ = ':';
+        *destination++ = '"';
+        destination = json_string_write(destination, record->values[i]);
+        *destination++ = '"';
+    }
+    (void)memcpy(destination, NDJSON_CONTENT, sizeof(NDJSON_CONTENT) - 1);
+    destination = base64_write(destination + sizeof(NDJSON_CONTENT) - 1, record->content->buffer, record->content->size);
+    (void)memcpy(destination, NDJSON_END, sizeof(NDJSON_END) - 1);
+}
+
+static int write_all(FILE* fout, const char* source, size_t size)
+{
+    int result;
+    if ((fwrite(source, 1, size, fout) != size) ||
+        (fflush(fout) != 0))
+    {
+        LogError("unable to write %lu bytes to the log file", (unsigned long)size);
+        result = __LINE__;
+    }
+    else
+    {
+        result = 0;
+    }
+    return result;
+}
+
+static void segment_file_name(char* destination, const char* name, size_t index, bool compressed)
+{
+    (void)sprintf_s(destination, strlen(name) + LOGGER_SEGMENT_SUFFIX_SIZE, "%s.%lu%s", name, (unsigned long)index, compressed ? ".gz" : "");
+}
+
+/*returns true when fileName can be opened, and its size*/
+static bool probe_file(const char* fileName, size_t* size)
+{
+    bool result;
+    FILE* file = fopen(fileName, "rb");
+    if (file == NULL)
+    {
+        result = false;
+    }
+    else
+    {
+        long int fileSize;
+        *size = ((fseek(file, 0, SEEK_END) == 0) && ((fileSize = ftell(file)) > 0)) ? (size_t)fileSize : 0;
+        (void)fclose(file);
+        result = true;
+    }
+    return result;
+}
+
+static int grow_segments(LOGGER_HANDLE_DATA* handleData)
+{
+    int result;
+    LOGGER_SEGMENT* segments = (LOGGER_SEGMENT*)malloc(2 * handleData->segmentCapacity * sizeof(LOGGER_SEGMENT));
+    if (segments == NULL)
+    {
+        LogError("unable to allocate %lu segments", (unsigned long)(2 * handleData->segmentCapacity));
+        result = __LINE__;
+    }
+    else
+    {
+        (void)memcpy(segments, handleData->segments, handleData->segmentCount * sizeof(LOGGER_SEGMENT));
+        free(handleData->segments);
+        handleData->segments = segments;
+        handleData->segmentCapacity *= 2;
+        result = 0;
+    }
+    return result;
+}
+
+/*finds the closed segments name.1, name.2... left by a previous run*/
+static void discover_segments(LOGGER_HANDLE_DATA* handleData)
+{
+    bool found = true;
+    while (found)
+    {
+        size_t size;
+        bool compressed = false;
+        segment_file_name(handleData->segmentName, handleData->name, handleData->segmentCount + 1, false);
+        if (!probe_file(handleData->segmentName, &size))
+        {
+            compressed = true;
+            segment_file_name(handleData->segmentName, handleData->name, handleData->segmentCount + 1, true);
+        }
+
+        if ((compressed && !probe_file(handleData->segmentName, &size)) ||
+            ((handleData->segmentCount == handleData->segmentCapacity) && (grow_segments(handleData) != 0)))
+        {
+            found = false;
+        }
+        else
+        {
+            handleData->segments[handleData->segmentCount].size = size;
+            handleData->segments[handleData->segmentCount].compressed = compressed;
+            handleData->segmentCount++;
+        }
+    }
+}
+
+static void remove_oldest_segment(LOGGER_HANDLE_DATA* handleData)
+{
+    handleData->segmentCount--;
+    segment_file_name(handleData->segmentName, handleData->name, handleData->segmentCount + 1, handleData->segments[handleData->segmentCount].compressed);
+    if (remove(handleData->segmentName) != 0)
+    {
+        LogError("unable to remove %s", handleData->segmentName);
+    }
+}
+
+#ifdef LOGGER_USE_ZLIB
+/*gzips source into destination. Returns 0 if success, otherwise __LINE__*/
+static int compress_file(const char* source, const char* destination)
+{
+    int result;
+    FILE* fin = fopen(source, "rb");
+    if (fin == NULL)
+    {
+        LogError("unable to open %s", source);
+        result = __LINE__;
+    }
+    else
+    {
+        gzFile fout = gzopen(destination, "wb");
+        if (fout == NULL)
+        {
+            LogError("unable to gzopen %s", destination);
+            result = __LINE__;
+        }
+        else
+        {
+            char chunk[4096];
+            size_t read;
+            bool failed = false;
+            while (!failed && ((read = fread(chunk, 1, sizeof(chunk), fin)) != 0))
+            {
+                failed = (gzwrite(fout, chunk, (unsigned int)read) != (int)read);
+            }
+
+            if ((gzclose(fout) != Z_OK) || failed || ferror(fin))
+            {
+                LogError("unable to compress %s", source);
+                (void)remove(destination);
+                result = __LINE__;
+            }
+            else
+            {
+                result = 0;
+            }
+        }
+        (void)fclose(fin);
+    }
+    return result;
+}
+#endif
+
+/*turns name.0 into name.1, after renaming name.i to name.i+1, then deletes the oldest segments over maxRetainedBytes*/
+static void close_segment(LOGGER_HANDLE_DATA* handleData)
+{
+    size_t i;
+    if ((handleData->segmentCount == handleData->segmentCapacity) &&
+        (grow_segments(handleData) != 0))
+    {
+        /*no room to remember one more segment, the oldest goes*/
+        remove_oldest_segment(handleData);
+    }
+
+    /*Codes_SRS_LOGGER_30_016: [ When a segment is closed, the closed segments name.i (or name.i.gz) shall be renamed name.i+1, from the oldest, and the segment shall become name.1. ]*/
+    for (i = handleData->segmentCount; i > 0; i--)
+    {
+        segment_file_name(handleData->segmentName, handleData->name, i, handleData->segments[i - 1].compressed);
+        segment_file_name(handleData->otherSegmentName, handleData->name, i + 1, handleData->segments[i - 1].compressed);
+        if (rename(handleData->segmentName, handleData->otherSegmentName) != 0)
+        {
+            LogError("unable to rename %s to %s", handleData->segmentName, handleData->otherSegmentName);
+        }
+        handleData->segments[i] = handleData->segments[i - 1];
+    }
+    handleData->segmentCount++;
+    handleData->segments[0].size = handleData->stagingBytes;
+    handleData->segments[0].compressed = false;
+
+#ifdef LOGGER_USE_ZLIB
+    /*Codes_SRS_LOGGER_30_017: [ When compressSegments is true, the closer thread shall compress the segment into name.1.gz and remove the uncompressed file. ]*/
+    segment_file_name(handleData->segmentName, handleData->name, 1, true);
+    if (handleData->compressSegments &&
+        (compress_file(handleData->stagingName, handleData->segmentName) == 0))
+    {
+        handleData->segments[0].compressed = true;
+        (void)probe_file(handleData->segmentName, &handleData->segments[0].size);
+        if (remove(handleData->stagingName) != 0)
+        {
+            LogError("unable to remove %s", handleData->stagingName);
+        }
+    }
+    else
+#endif
+    {
+        segment_file_name(handleData->segmentName, handleData->name, 1, false);
+        if (rename(handleData->stagingName, handleData->segmentName) != 0)
+        {
+            LogError("unable to rename %s to %s", handleData->stagingName, handleData->segmentName);
+        }
+    }
+
+    /*Codes_SRS_LOGGER_30_018: [ When maxRetainedBytes is not 0, the oldest closed segments shall be deleted until their sizes add up to at most maxRetainedBytes. ]*/
+    if (handleData->maxRetainedBytes != 0)
+    {
+        size_t retained = 0;
+        for (i = 0; i < handleData->segmentCount; i++)
+        {
+            retained += handleData->segments[i].size;
+        }
+        while ((handleData->segmentCount > 0) && (retained > handleData->maxRetainedBytes))
+        {
+            retained -= handleData->segments[handleData->segmentCount - 1].size;
+            remove_oldest_segment(handleData);
+        }
+    }
+}
+
+/*the closer thread: closes the segments staged by the writer, compressing them takes as long as it takes*/
+static int Logger_SegmentCloser(void* context)
+{
+    LOGGER_HANDLE_DATA* handleData = (LOGGER_HANDLE_DATA*)context;
+    if (Lock(handleData->segmentLock) != LOCK_OK)
+    {
+        LogError("unable to Lock, the closer stops");
+    }
+    else
+    {
+        bool locked = true;
+        while (locked && (!handleData->segmentStopping || handleData->segmentPending))
+        {
+            if (!handleData->segmentPending)
+            {
+                (void)Condition_Wait(handleData->segmentCondition, handleData->segmentLock, 0);
+            }
+            if (handleData->segmentPending)
+            {
+                (void)Unlock(handleData->segmentLock);
+                close_segment(handleData);
+                if (Lock(handleData->segmentLock) != LOCK_OK)
+                {
+                    LogError("unable to Lock, the closer stops");
+                    locked = false;
+                }
+                else
+                {
+                    handleData->segmentPending = false;
+                    (void)Condition_Post(handleData->segmentCondition);
+                }
+            }
+        }
+        if (locked)
+        {
+            (void)Unlock(handleData->segmentLock);
+        }
+    }
+    return 0;
+}
+
+/*closes the file being written as name.0 and starts a new one*/
+static void rotate_segment(LOGGER_HANDLE_DATA* handleData)
+{
+    if (fclose(handleData->fout) != 0)
+    {
+        LogError("unable to fclose");
+    }
+    handleData->fout = NULL;
+
+    if (!handleData->compressSegments)
+    {
+        if (rename(handleData->name, handleData->stagingName) != 0)
+        {
+            LogError("unable to rename %s to %s, the segment goes on", handleData->name, handleData->stagingName);
+        }
+        else
+        {
+            handleData->stagingBytes = handleData->segmentBytes;
+            handleData->segmentBytes = 0;
+            close_segment(handleData);
+        }
+    }
+    else if (Lock(handleData->segmentLock) != LOCK_OK)
+    {
+        LogError("unable to Lock, the segment goes on");
+    }
+    else
+    {
+        while (handleData->segmentPending)
+        {
+            /*the closer is still compressing the previous segment*/
+            (void)Condition_Wait(handleData->segmentCondition, handleData->segmentLock, 0);
+        }
+        if (rename(handleData->name, handleData->stagingName) != 0)
+        {
+            LogError("unable to rename %s to %s, the segment goes on", handleData->name, handleData->stagingName);
+        }
+        else
+        {
+            handleData->stagingBytes = handleData->segmentBytes;
+            handleData->segmentBytes = 0;
+            handleData->segmentPending = true;
+            (void)Condition_Post(handleData->segmentCondition);
+        }
+        (void)Unlock(handleData->segmentLock);
+    }
+
+    if (handleData->segmentSeconds != 0)
+    {
+        handleData->segmentStart = time(NULL);
+    }
+}
+
+/*writes to the file, first starting a new segment when the current one is full or too old*/
+static int write_segment(LOGGER_HANDLE_DATA* handleData, const char* source, size_t size)
+{
+    int result;
+    /*Codes_SRS_LOGGER_30_015: [ Before writing, the module shall close the file as a segment and open a new one when the file is not empty and the write would take it over segmentSize bytes, or when it was started segmentSeconds or more ago. ]*/
+    if ((handleData->segmentBytes != 0) &&
+        (((handleData->segmentSize != 0) && (handleData->segmentBytes + size > handleData->segmentSize)) ||
+        ((handleData->segmentSeconds != 0) && (difftime(time(NULL), handleData->segmentStart) >= (double)handleData->segmentSeconds))))
+    {
+        rotate_segment(handleData);
+    }
+
+    if ((handleData->fout == NULL) &&
+        ((handleData->fout = fopen(handleData->name, "ab")) == NULL))
+    {
+        LogError("unable to open file %s, %lu bytes are lost", handleData->name, (unsigned long)size);
+        result = __LINE__;
+    }
+    else if ((result = write_all(handleData->fout, source, size)) == 0)
+    {
+        handleData->segmentBytes += size;
+    }
+    return result;
+}
+
+/*the writer thread: writes the buffer when asked to, when flushIntervalMs passed or when the module stops*/
+static int Logger_NdjsonWriter(void* context)
+{
+    LOGGER_HANDLE_DATA* handleData = (LOGGER_HANDLE_DATA*)context;
+    if (Lock(handleData->lock) != LOCK_OK)
+    {
+        LogError("unable to Lock, the writer stops");
+    }
+    else
+    {
+        bool locked = true;
+        while (locked && (!handleData->stopping || (handleData->bufferUsed != 0)))
+        {
+            /*Codes_SRS_LOGGER_30_008: [ The writer thread shall write the buffer to the file when the buffer is at least half full, when flushIntervalMs have passed or when the module is destroyed. ]*/
+            if (!handleData->flushRequested && !handleData->stopping)
+            {
+                (void)Condition_Wait(handleData->flushCondition, handleData->lock, (int)handleData->flushIntervalMs);
+            }
+            handleData->flushRequested = false;
+            if (handleData->bufferUsed != 0)
+            {
+                /*the records received meanwhile go to the other buffer*/
+                char* full = handleData->buffer;
+                size_t size = handleData->bufferUsed;
+                handleData->buffer = handleData->writing;
+                handleData->writing = full;
+                handleData->bufferUsed = 0;
+                handleData->writerBusy = true;
+                (void)Condition_Post(handleData->roomCondition);
+                (void)Unlock(handleData->lock);
+
+                (void)write_segment(handleData, full, size);
+
+                if (Lock(handleData->lock) != LOCK_OK)
+                {
+                    LogError("unable to Lock, the writer stops");
+                    locked = false;
+                }
+                else
+                {
+                    handleData->writerBusy = false;
+                    (void)Condition_Post(handleData->roomCondition);
+                }
+            }
+        }
+        if (locked)
+        {
+            (void)Unlock(handleData->lock);
+        }
+    }
+    return 0;
+}
+
+/*called with the lock held, waits until the buffer has room for length bytes (length is at most bufferSize) and returns where they go*/
+static char* ndjson_reserve(LOGGER_HANDLE_DATA* handleData, size_t length)
+{
+    while (handleData->bufferUsed + length > handleData->bufferSize)
+    {
+        handleData->flushRequested = true;
+        (void)Condition_Post(handleData->flushCondition);
+        (void)Condition_Wait(handleData->roomCondition, handleData->lock, 0);
+    }
+    return handleData->buffer + handleData->bufferUsed;
+}
+
+/*called with the lock held after the reserved bytes are written*/
+static void ndjson_commit(LOGGER_HANDLE_DATA* handleData, size_t length)
+{
+    handleData->bufferUsed += length;
+    if ((handleData->bufferUsed >= handleData->bufferSize / 2) && !handleData->flushRequested)
+    {
+        handleData->flushRequested = true;
+        (void)Condition_Post(handleData->flushCondition);
+    }
+}
+
+/*called with the lock held, writes text that does not fit in the buffer after everything before it*/
+static int ndjson_write_direct(LOGGER_HANDLE_DATA* handleData, const char* text, size_t length)
+{
+    while ((handleData->bufferUsed != 0) || handleData->writerBusy)
+    {
+        handleData->flushRequested = true;
+        (void)Condition_Post(handleData->flushCondition);
+        (void)Condition_Wait(handleData->roomCondition, handleData->lock, 0);
+    }
+    return write_segment(handleData, text, length);
+}
+
+static int ndjson_append_logStartStop(LOGGER_HANDLE_DATA* handleData, bool appendStart)
+{
+    int result;
+    char temp[80] = { 0 };
+    if (print_time(temp, sizeof(temp) / sizeof(temp[0]), appendStart ? "{\"time\":\"%c\",\"content\":\"Log started\"}\n" : "{\"time\":\"%c\",\"content\":\"Log stopped\"}\n") != 0)
+    {
+        LogError("unable to create start/stop time json string");
+        result = __LINE__;
+    }
+    else if (Lock(handleData->lock) != LOCK_OK)
+    {
+        LogError("unable to Lock");
+        result = __LINE__;
+    }
+    else
+    {
+        size_t length = strlen(temp);
+        if (length > handleData->bufferSize)
+        {
+            result = ndjson_write_direct(handleData, temp, length);
+        }
+        else
+        {
+            (void)memcpy(ndjson_reserve(handleData, length), temp, length);
+            ndjson_commit(handleData, length);
+            result = 0;
+        }
+        (void)Unlock(handleData->lock);
+    }
+    return result;
+}
+
+/*writes the records of the NDJSON file as one JSON array to another file. Returns 0 if success, otherwise __LINE__*/
+static int write_json_array(const char* ndjsonName, const char* jsonArrayName)
+{
+    int result;
+    FILE* fin = fopen(ndjsonName, "rb");
+    if (fin == NULL)
+    {
+        LogError("unable to open %s", ndjsonName);
+        result = __LINE__;
+    }
+    else
+    {
+        FILE* fout = fopen(jsonArrayName, "wb");
+        if (fout == NULL)
+        {
+            LogError("unable to open %s", jsonArrayName);
+            result = __LINE__;
+        }
+        else
+        {
+            char chunk[4096];
+            size_t read;
+            bool wroteRecord = false;
+            bool afterNewline = false;
+            bool failed = (fputc('[', fout) == EOF);
+            while (!failed && ((read = fread(chunk, 1, sizeof(chunk), fin)) != 0))
+            {
+                size_t i = 0;
+                while (!failed && (i < read))
+                {
+                    if (chunk[i] == '\n')
+                    {
+                        afterNewline = true;
+                        i++;
+                    }
+                    else
+                    {
+                        /*the records are separated by commas instead of newlines*/
+                        size_t end = i;
+                        while ((end < read) && (chunk[end] != '\n'))
+                        {
+                            end++;
+                        }
+                        if (afterNewline && wroteRecord)
+                        {
+                            failed = (fputc(',', fout) == EOF);
+                        }
+                        afterNewline = false;
+                        wroteRecord = true;
+                        failed = failed || (fwrite(chunk + i, 1, end - i, fout) != end - i);
+                        i = end;
+                    }
+                }
+            }
+
+            if (failed || ferror(fin) || (fputc(']', fout) == EOF))
+            {
+                LogError("unable to write %s", jsonArrayName);
+                result = __LINE__;
+            }
+            else
+            {
+                result = 0;
+            }
+
+            if (fclose(fout) != 0)
+            {
+                LogError("unable to close file %s", jsonArrayName);
+                result = __LINE__;
+            }
+        }
+        (void)fclose(fin);
+    }
+    return result;
+}
+
+/*releases what Logger_CreateNdjson made, but the threads*/
+static void ndjson_free(LOGGER_HANDLE_DATA* handleData)
+{
+    if ((handleData->fout != NULL) &&
+        (fclose(handleData->fout) != 0))
+    {
+        LogError("unable to fclose");
+    }
+    if (handleData->segmentCondition != NULL)
+    {
+        Condition_Deinit(handleData->segmentCondition);
+    }
+    if (handleData->segmentLock != NULL)
+    {
+        (void)Lock_Deinit(handleData->segmentLock);
+    }
+    if (handleData->roomCondition != NULL)
+    {
+        Condition_Deinit(handleData->roomCondition);
+    }
+    if (handleData->flushCondition != NULL)
+    {
+        Condition_Deinit(handleData->flushCondition);
+    }
+    if (handleData->lock != NULL)
+    {
+        (void)Lock_Deinit(handleData->lock);
+    }
+    free(handleData->segments);
+    free(handleData->stagingName);
+    free(handleData->buffer);
+    free(handleData->writing);
+    free(handleData->name);
+    free(handleData->jsonArrayName);
+    free(handleData);
+}
+
+/*stops the closer thread, after it closed the segment staged last*/
+static void stop_segment_closer(LOGGER_HANDLE_DATA* handleData)
+{
+    int notUsed;
+    if (Lock(handleData->segmentLock) != LOCK_OK)
+    {
+        LogError("unable to Lock, stopping the closer anyway");
+        handleData->segmentStopping = true;
+    }
+    else
+    {
+        handleData->segmentStopping = true;
+        (void)Condition_Post(handleData->segmentCondition);
+        (void)Unlock(handleData->segmentLock);
+    }
+
+    if (ThreadAPI_Join(handleData->segmentCloser, &notUsed) != THREADAPI_OK)
+    {
+        LogError("unable to ThreadAPI_Join");
+    }
+}
+
+/*allocates the names of the segments and the list of closed segments, then finds the segments of a previous run. Returns 0 if success, otherwise __LINE__*/
+static int ndjson_init_segments(LOGGER_HANDLE_DATA* handleData)
+{
+    int result;
+    size_t nameSize = strlen(handleData->name) + LOGGER_SEGMENT_SUFFIX_SIZE;
+    if ((handleData->stagingName = (char*)malloc(3 * nameSize)) == NULL)
+    {
+        LogError("unable to allocate the segment names");
+        result = __LINE__;
+    }
+    else if ((handleData->segments = (LOGGER_SEGMENT*)malloc(LOGGER_INITIAL_SEGMENT_CAPACITY * sizeof(LOGGER_SEGMENT))) == NULL)
+    {
+        LogError("unable to allocate the segments");
+        result = __LINE__;
+    }
+    else
+    {
+        long int fileSize;
+        handleData->segmentName = handleData->stagingName + nameSize;
+        handleData->otherSegmentName = handleData->segmentName + nameSize;
+        handleData->segmentCapacity = LOGGER_INITIAL_SEGMENT_CAPACITY;
+        segment_file_name(handleData->stagingName, handleData->name, 0, false);
+        /*Codes_SRS_LOGGER_30_014: [ Logger_Create shall count the closed segments name.1, name.2... (or name.i.gz) of a previous run, up to the first one missing, and the bytes of the file name. ]*/
+        discover_segments(handleData);
+        handleData->segmentBytes = ((fseek(handleData->fout, 0, SEEK_END) == 0) && ((fileSize = ftell(handleData->fout)) > 0)) ? (size_t)fileSize : 0;
+        if (handleData->segmentSeconds != 0)
+        {
+            handleData->segmentStart = time(NULL);
+        }
+        result = 0;
+    }
+    return result;
+}
+
+static MODULE_HANDLE Logger_CreateNdjson(const struct LOGGER_CONFIG_NDJSON_FILE_TAG* config)
+{
+    LOGGER_HANDLE_DATA* result;
+    bool segmented = (config->segmentSize != 0) || (config->segmentSeconds != 0);
+#ifndef LOGGER_USE_ZLIB
+    if (config->compressSegments)
+    {
+        /*Codes_SRS_LOGGER_30_013: [ If compressSegments is true and the module was built without use_zlib, Logger_Create shall fail and return NULL. ]*/
+        LogError("compressSegments needs the logger to be built with use_zlib");
+        result = NULL;
+    }
+    else
+#endif
+    if (segmented && (config->jsonArrayName != NULL))
+    {
+        /*Codes_SRS_LOGGER_30_020: [ If jsonArrayName is not NULL and segmentSize or segmentSeconds is not 0, Logger_Create shall fail and return NULL. ]*/
+        LogError("jsonArrayName cannot be used with segmentSize or segmentSeconds");
+        result = NULL;
+    }
+    else
+    /*Codes_SRS_LOGGER_30_005: [ Logger_Create shall allocate the module and two buffers of bufferSize bytes, LOGGER_DEFAULT_BUFFER_SIZE when bufferSize is 0. ]*/
+    if ((result = (LOGGER_HANDLE_DATA*)malloc(sizeof(LOGGER_HANDLE_DATA))) == NULL)
+    {
+        /*Codes_SRS_LOGGER_30_007: [ If any of the above fails, Logger_Create shall fail, release what it created and return NULL. ]*/
+        LogError("malloc failed");
+    }
+    else
+    {
+        (void)memset(result, 0, sizeof(LOGGER_HANDLE_DATA));
+        result->selector = LOGGING_TO_NDJSON_FILE;
+        result->bufferSize = (config->bufferSize == 0) ? LOGGER_DEFAULT_BUFFER_SIZE : config->bufferSize;
+        result->flushIntervalMs = (config->flushIntervalMs == 0) ? LOGGER_DEFAULT_FLUSH_INTERVAL_MS : config->flushIntervalMs;
+        result->segmentSize = config->segmentSize;
+        result->segmentSeconds = config->segmentSeconds;
+        result->maxRetainedBytes = config->maxRetainedBytes;
+        result->compressSegments = segmented && config->compressSegments;
+        if (((result->buffer = (char*)malloc(result->bufferSize)) == NULL) ||
+            ((result->writing = (char*)malloc(result->bufferSize)) == NULL))
+        {
+            LogError("unable to allocate the buffers");
+            ndjson_free(result);
+            result = NULL;
+        }
+        else if (((config->jsonArrayName != NULL) || segmented) &&
+            ((mallocAndStrcpy_s(&result->name, config->name) != 0) ||
+            ((config->jsonArrayName != NULL) && (mallocAndStrcpy_s(&result->jsonArrayName, config->jsonArrayName) != 0))))
+        {
+            LogError("unable to copy the file names");
+            ndjson_free(result);
+            result = NULL;
+        }
+        /*Codes_SRS_LOGGER_30_006: [ Logger_Create shall open the file name for appending, create the lock, the conditions and the writer thread, then add the start record followed by a newline. ]*/
+        else if ((result->fout = fopen(config->name, "ab")) == NULL)
+        {
+            LogError("unable to open file %s", config->name);
+            ndjson_free(result);
+            result = NULL;
+        }
+        else if (segmented && (ndjson_init_segments(result) != 0))
+        {
+            LogError("unable to prepare the segments");
+            ndjson_free(result);
+            result = NULL;
+        }
+        else if (((result->lock = Lock_Init()) == NULL) ||
+            ((result->flushCondition = Condition_Init()) == NULL) ||
+            ((result->roomCondition = Condition_Init()) == NULL) ||
+            (result->compressSegments && (((result->segmentLock = Lock_Init()) == NULL) || ((result->segmentCondition = Condition_Init()) == NULL))))
+        {
+            LogError("unable to create the locks and conditions");
+            ndjson_free(result);
+            result = NULL;
+        }
+        else if (result->compressSegments &&
+            (ThreadAPI_Create(&result->segmentCloser, Logger_SegmentCloser, result) != THREADAPI_OK))
+        {
+            LogError("unable to ThreadAPI_Create");
+            ndjson_free(result);
+            result = NULL;
+        }
+        else if (ThreadAPI_Create(&result->writer, Logger_NdjsonWriter, result) != THREADAPI_OK)
+        {
+            LogError("unable to ThreadAPI_Create");
+            if (result->compressSegments)
+            {
+                stop_segment_closer(result);
+            }
+            ndjson_free(result);
+            result = NULL;
+        }
+        else if (ndjson_append_logStartStop(result, true) != 0)
+        {
+            /*as for LOGGING_TO_FILE, a missing start record does not stop the logging*/
+            LogError("ndjson_append_logStartStop failed");
+        }
+        else
+        {
+            /*all is fine*/
+        }
+    }
+    return result;
+}
+
+static void Logger_DestroyNdjson(LOGGER_HANDLE_DATA* handleData)
+{
+    int notUsed;
+    /*Codes_SRS_LOGGER_30_011: [ Logger_Destroy shall add the stop record, make the writer thread write the buffer and end, then close the file. ]*/
+    if (ndjson_append_logStartStop(handleData, false) != 0)
+    {
+        LogError("unable to append log ending time");
+    }
+
+    if (Lock(handleData->lock) != LOCK_OK)
+    {
+        LogError("unable to Lock, stopping the writer anyway");
+        handleData->stopping = true;
+    }
+    else
+    {
+        handleData->stopping = true;
+        (void)Condition_Post(handleData->flushCondition);
+        (void)Unlock(handleData->lock);
+    }
+
+    if (ThreadAPI_Join(handleData->writer, &notUsed) != THREADAPI_OK)
+    {
+        LogError("unable to ThreadAPI_Join");
+    }
+
+    if ((handleData->fout != NULL) &&
+        (fclose(handleData->fout) != 0))
+    {
+        LogError("unable to fclose");
+    }
+    handleData->fout = NULL;
+
+    if (handleData->compressSegments)
+    {
+        stop_segment_closer(handleData);
+    }
+
+    /*Codes_SRS_LOGGER_30_012: [ If jsonArrayName is not NULL, Logger_Destroy shall then write all the records of the file as one JSON array to the file jsonArrayName. ]*/
+    if ((handleData->jsonArrayName != NULL) &&
+        (write_json_array(handleData->name, handleData->jsonArrayName) != 0))
+    {
+        LogError("unable to write the JSON array to %s", handleData->jsonArrayName);
+    }
+
+    ndjson_free(handleData);
+}
+
+static void Logger_ReceiveNdjson(LOGGER_HANDLE_DATA* handleData, MESSAGE_HANDLE messageHandle)
+{
+    char timetemp[80] = { 0 };
+    if (print_time(timetemp, sizeof(timetemp) / sizeof(timetemp[0]), "%c") != 0)
+    {
+        LogError("unable to print the time");
+    }
+    else
+    {
+        NDJSON_RECORD record;
+        CONSTMAP_HANDLE properties = Message_GetProperties(messageHandle); /*by contract this is never NULL*/
+        record.time = timetemp;
+        record.content = Message_GetContent(messageHandle); /*by contract, this is never NULL*/
+        if (ConstMap_GetInternals(properties, &record.keys, &record.values, &record.count) != CONSTMAP_OK)
+        {
+            LogError("unable to ConstMap_GetInternals");
+        }
+        else if (Lock(handleData->lock) != LOCK_OK)
+        {
+            LogError("unable to Lock");
+        }
+        else
+        {
+            /*Codes_SRS_LOGGER_30_009: [ Logger_Receive shall add to the buffer the same JSON value as LOGGING_TO_FILE followed by a newline, waiting for the writer to make room when the buffer is full. ]*/
+            size_t length = ndjson_record_length(&record);
+            if (length <= handleData->bufferSize)
+            {
+                ndjson_record_write(ndjson_reserve(handleData, length), &record);
+                ndjson_commit(handleData, length);
+            }
+            else
+            {
+                /*Codes_SRS_LOGGER_30_010: [ A record longer than the buffer shall be written to the file directly, after the records before it. ]*/
+                char* text = (char*)malloc(length);
+                if (text == NULL)
+                {
+                    LogError("unable to allocate %lu bytes for a record", (unsigned long)length);
+                }
+                else
+                {
+                    ndjson_record_write(text, &record);
+                    (void)ndjson_write_direct(handleData, text, length);
+                    free(text);
+                }
+            }
+            (void)Unlock(handleData->lock);
+        }
+        ConstMap_Destroy(properties);
+    }
+}
+
 static MODULE_HANDLE Logger_Create(BROKER_HANDLE broker, const void* configuration)
 {
     LOGGER_HANDLE_DATA* result;
@@ -130,12 +1104,25 @@ static MODULE_HANDLE Logger_Create(BROKER_HANDLE broker, const void* configurati
     else
     {
         const LOGGER_CONFIG* config = configuration;
-        /*Codes_SRS_LOGGER_02_003: [If configuration->selector has a value different than LOGGING_TO_FILE then Logger_Create shall fail and return NULL.]*/
-        if (config->selector != LOGGING_TO_FILE)
+        /*Codes_SRS_LOGGER_02_003: [If configuration->selector has a value different than LOGGING_TO_FILE or LOGGING_TO_NDJSON_FILE then Logger_Create shall fail and return NULL.]*/
+        if ((config->selector != LOGGING_TO_FILE) && (config->selector != LOGGING_TO_NDJSON_FILE))
         {
             LogError("invalid arg config->selector=%d", config->selector);
             result = NULL;
         }
+        else if (config->selector == LOGGING_TO_NDJSON_FILE)
+        {
+            /*Codes_SRS_LOGGER_02_004: [If configuration->selectee.loggerConfigFile.name is NULL then Logger_Create shall fail and return NULL.]*/
+            if (config->selectee.loggerConfigNdjsonFile.name == NULL)
+            {
+                LogError("invalid arg config->selectee.loggerConfigNdjsonFile.name=NULL");
+                result = NULL;
+            }
+            else
+            {
+                result = Logger_CreateNdjson(&config->selectee.loggerConfigNdjsonFile);
+            }
+        }
         else
         {
             /*Codes_SRS_LOGGER_02_004: [If configuration->selectee.loggerConfigFile.name is NULL then Logger_Create shall fail and return NULL.]*/
@@ -156,6 +1143,7 @@ static MODULE_HANDLE Logger_Create(BROKER_HANDLE broker, const void* configurati
                 }
                 else
                 {
+                    result->selector = LOGGING_TO_FILE;
                     /*Codes_SRS_LOGGER_02_006: [Logger_Create shall open the file configuration the filename selectee.loggerConfigFile.name in update (reading and writing) mode and assign the result of fopen to fout field. ]*/
                     result->fout = fopen(config->selectee.loggerConfigFile.name, "r+b"); /*open binary file for update (reading and writing)*/
                     if (result->fout == NULL)
@@ -257,6 +1245,53 @@ static MODULE_HANDLE Logger_Create(BROKER_HANDLE broker, const void* configurati
     return result;
 }
 
+/*turns config, holding the file name only, into a LOGGING_TO_NDJSON_FILE configuration. Returns 0 if success, otherwise __LINE__*/
+static int parse_ndjson_settings(const JSON_Object* obj, LOGGER_CONFIG* config)
+{
+    int result;
+    /*Codes_SRS_LOGGER_30_003: [ For LOGGING_TO_NDJSON_FILE, Logger_ParseConfigurationFromJson shall read the optional numbers "bufferSize" and "flushIntervalMs" (0 when missing) and the optional string "jsonArrayFilename". ]*/
+    double bufferSize = json_object_get_number(obj, "bufferSize");
+    double flushIntervalMs = json_object_get_number(obj, "flushIntervalMs");
+    const char* jsonArrayName = json_object_get_string(obj, "jsonArrayFilename");
+    /*Codes_SRS_LOGGER_30_019: [ For LOGGING_TO_NDJSON_FILE, Logger_ParseConfigurationFromJson shall also read the optional numbers "segmentSize", "segmentSeconds" and "maxRetainedBytes" (0 when missing) and the optional boolean "compressSegments" (false when missing). ]*/
+    double segmentSize = json_object_get_number(obj, "segmentSize");
+    double segmentSeconds = json_object_get_number(obj, "segmentSeconds");
+    double maxRetainedBytes = json_object_get_number(obj, "maxRetainedBytes");
+    int compressSegments = json_object_get_boolean(obj, "compressSegments");
+    if ((bufferSize < 0) || (flushIntervalMs < 0) || (segmentSize < 0) || (segmentSeconds < 0) || (maxRetainedBytes < 0))
+    {
+        /*Codes_SRS_LOGGER_30_004: [ If any of these numbers is negative, Logger_ParseConfigurationFromJson shall fail and return NULL. ]*/
+        LogError("bufferSize, flushIntervalMs, segmentSize, segmentSeconds and maxRetainedBytes cannot be negative");
+        result = __LINE__;
+    }
+    else
+    {
+        char* jsonArrayNameCopy = NULL;
+        if ((jsonArrayName != NULL) &&
+            (mallocAndStrcpy_s(&jsonArrayNameCopy, jsonArrayName) != 0))
+        {
+            /*Codes_SRS_LOGGER_17_003: [ If any system call fails, Logger_ParseConfigurationFromJson shall fail and return NULL. ]*/
+            LogError("Copying the JSON array filename failed");
+            result = __LINE__;
+        }
+        else
+        {
+            const char* name = config->selectee.loggerConfigFile.name;
+            config->selector = LOGGING_TO_NDJSON_FILE;
+            config->selectee.loggerConfigNdjsonFile.name = name;
+            config->selectee.loggerConfigNdjsonFile.bufferSize = (size_t)bufferSize;
+            config->selectee.loggerConfigNdjsonFile.flushIntervalMs = (unsigned int)flushIntervalMs;
+            config->selectee.loggerConfigNdjsonFile.jsonArrayName = jsonArrayNameCopy;
+            config->selectee.loggerConfigNdjsonFile.segmentSize = (size_t)segmentSize;
+            config->selectee.loggerConfigNdjsonFile.segmentSeconds = (unsigned int)segmentSeconds;
+            config->selectee.loggerConfigNdjsonFile.maxRetainedBytes = (size_t)maxRetainedBytes;
+            config->selectee.loggerConfigNdjsonFile.compressSegments = (compressSegments == 1);
+            result = 0;
+        }
+    }
+    return result;
+}
+
 static void* Logger_ParseConfigurationFromJson(const char* configuration)
 {
     LOGGER_CONFIG* result;
@@ -297,34 +1332,52 @@ static void* Logger_ParseConfigurationFromJson(const char* configuration)
                 {
                     /*fileNameValue is believed at this moment to be a string that might point to a filename on the system*/
 
-                    /*Codes_SRS_LOGGER_17_001: [ Logger_ParseConfigurationFromJson shall allocate a new LOGGER_CONFIG structure. ]*/
-                    result = (LOGGER_CONFIG*)malloc(sizeof(LOGGER_CONFIG));
-                    if (result == NULL)
+                    /*Codes_SRS_LOGGER_30_001: [ Logger_ParseConfigurationFromJson shall read the optional string "format": "ndjson" selects LOGGING_TO_NDJSON_FILE, a missing "format" or "json" selects LOGGING_TO_FILE. ]*/
+                    const char* format = json_object_get_string(obj, "format");
+                    bool isNdjson = (format != NULL) && (strcmp(format, "ndjson") == 0);
+                    if ((format != NULL) && !isNdjson && (strcmp(format, "json") != 0))
                     {
-                        /*Codes_SRS_LOGGER_17_003: [ If any system call fails, Logger_ParseConfigurationFromJson shall fail and return NULL. ]*/
-                        LogError("malloc failed");
+                        /*Codes_SRS_LOGGER_30_002: [ If "format" has any other value, Logger_ParseConfigurationFromJson shall fail and return NULL. ]*/
+                        LogError("unknown format %s", format);
+                        result = NULL;
                     }
                     else
                     {
-                        /*Codes_SRS_LOGGER_17_002: [ Logger_ParseConfigurationFromJson shall duplicate the filename string into the LOGGER_CONFIG structure. ]*/
-                        /*Codes_SRS_LOGGER_17_007: [ Logger_ParseConfigurationFromJson shall set the selector in LOGGER_CONFIG to LOGGING_TO_FILE. ]*/
-                        result->selector = LOGGING_TO_FILE;
-                        char * logfileName;
-                        int copy_result = mallocAndStrcpy_s(&logfileName, fileNameValue);
-                        if (copy_result != 0)
+                        /*Codes_SRS_LOGGER_17_001: [ Logger_ParseConfigurationFromJson shall allocate a new LOGGER_CONFIG structure. ]*/
+                        result = (LOGGER_CONFIG*)malloc(sizeof(LOGGER_CONFIG));
+                        if (result == NULL)
                         {
                             /*Codes_SRS_LOGGER_17_003: [ If any system call fails, Logger_ParseConfigurationFromJson shall fail and return NULL. ]*/
-                            LogError("Copying the filename failed, error= %d", copy_result);
-                            free(result);
-                            result = NULL;
+                            LogError("malloc failed");
                         }
                         else
                         {
-                            /*Codes_SRS_LOGGER_17_006: [ Logger_ParseConfigurationFromJson shall return a pointer to the created LOGGER_CONFIG structure. ]*/
-                            /**
-                             * Everything's good.
-                             */
-                             result->selectee.loggerConfigFile.name = (const char *)logfileName;
+                            /*Codes_SRS_LOGGER_17_002: [ Logger_ParseConfigurationFromJson shall duplicate the filename string into the LOGGER_CONFIG structure. ]*/
+                            /*Codes_SRS_LOGGER_17_007: [ Logger_ParseConfigurationFromJson shall set the selector in LOGGER_CONFIG to LOGGING_TO_FILE. ]*/
+                            result->selector = LOGGING_TO_FILE;
+                            char * logfileName;
+                            int copy_result = mallocAndStrcpy_s(&logfileName, fileNameValue);
+                            if (copy_result != 0)
+                            {
+                                /*Codes_SRS_LOGGER_17_003: [ If any system call fails, Logger_ParseConfigurationFromJson shall fail and return NULL. ]*/
+                                LogError("Copying the filename failed, error= %d", copy_result);
+                                free(result);
+                                result = NULL;
+                            }
+                            else
+                            {
+                                /*Codes_SRS_LOGGER_17_006: [ Logger_ParseConfigurationFromJson shall return a pointer to the created LOGGER_CONFIG structure. ]*/
+                                /**
+                                 * Everything's good.
+                                 */
+                                 result->selectee.loggerConfigFile.name = (const char *)logfileName;
+                                 if (isNdjson && (parse_ndjson_settings(obj, result) != 0))
+                                 {
+                                     free(logfileName);
+                                     free(result);
+                                     result = NULL;
+                                 }
+                            }
                         }
                     }
                 }
@@ -347,7 +1400,18 @@ static void Logger_FreeConfiguration(void* configuration)
     {
         /*Codes_SRS_LOGGER_17_005: [ Logger_FreeConfiguration shall free all resources created by Logger_ParseConfigurationFromJson. ]*/
         LOGGER_CONFIG* config = (LOGGER_CONFIG*)configuration;
-        free((char*)config->selectee.loggerConfigFile.name);
+        if (config->selector == LOGGING_TO_NDJSON_FILE)
+        {
+            free((char*)config->selectee.loggerConfigNdjsonFile.name);
+            if (config->selectee.loggerConfigNdjsonFile.jsonArrayName != NULL)
+            {
+                free((char*)config->selectee.loggerConfigNdjsonFile.jsonArrayName);
+            }
+        }
+        else
+        {
+            free((char*)config->selectee.loggerConfigFile.name);
+        }
         free(config);
     }
 }
@@ -355,7 +1419,15 @@ static void Logger_FreeConfiguration(void* configuration)
 static void Logger_Destroy(MODULE_HANDLE module)
 {
     /*Codes_SRS_LOGGER_02_014: [If moduleHandle is NULL then Logger_Destroy shall return.]*/
-    if (module != NULL)
+    if (module == NULL)
+    {
+        /*return as is*/
+    }
+    else if (((LOGGER_HANDLE_DATA *)module)->selector == LOGGING_TO_NDJSON_FILE)
+    {
+        Logger_DestroyNdjson((LOGGER_HANDLE_DATA *)module);
+    }
+    else
     {
         /*Codes_SRS_LOGGER_02_019: [Logger_Destroy shall add to the log file the following end of log JSON object:]*/
         LOGGER_HANDLE_DATA* moduleHandleData = (LOGGER_HANDLE_DATA *)module;
@@ -386,6 +1458,10 @@ static void Logger_Receive(MODULE_HANDLE moduleHandle, MESSAGE_HANDLE messageHan
     {
         LogError("invalid arg moduleHandle = %p", moduleHandle);
     }
+    else if (((LOGGER_HANDLE_DATA *)moduleHandle)->selector == LOGGING_TO_NDJSON_FILE)
+    {
+        Logger_ReceiveNdjson((LOGGER_HANDLE_DATA *)moduleHandle, messageHandle);
+    }
     else
     {
         /*Codes_SRS_LOGGER_02_011: [Logger_Receive shall write in the fout FILE the following information in JSON format:]*/
@@ -8,6 +8,8 @@
 #include "micromockcharstararenullterminatedstrings.h"
 
 #include <cstdarg>
+#include <set>
+#include <string>
 /*general macros useful for MOCKS*/
 #define CURRENT_API_CALL(API) C2(C2(current, API), _call)
 #define WHEN_SHALL_API_FAIL(API) C2(C2(whenShall, API), _fail)
@@ -22,6 +24,8 @@ gb_fprintf                        \
 FOR_EACH_1(DEFINE_FAIL_VARIABLES, LIST_OF_COUNTED_APIS)
 
 #include "azure_c_shared_utility/lock.h"
+#include "azure_c_shared_utility/condition.h"
+#include "azure_c_shared_utility/threadapi.h"
 #include "module.h"
 #include "module_access.h"
 #include "azure_c_shared_utility/strings.h"
@@ -171,6 +175,85 @@ static MESSAGE_HANDLE validMessageHandle = (MESSAGE_HANDLE)0x032;
 static unsigned char buffer[3] = { 1,2,3 };
 static CONSTBUFFER validBuffer = { buffer, sizeof(buffer)/sizeof(buffer[0]) };
 
+static const char* const propertyKeys[] = { "deviceName", "quote" };
+static const char* const propertyValues[] = { "firstDevice", "say \"hi\"" };
+#define EXPECTED_NDJSON_RECORD "{\"time\":\"time\",\"properties\":{\"deviceName\":\"firstDevice\",\"quote\":\"say \\\"hi\\\"\"},\"content\":\"AQID\"}\n"
+
+static LOGGER_CONFIG validNdjsonConfig;
+
+/*the NDJSON mode writes, renames and removes real files: fopen with "ab", "rb" or "wb" opens them for real and fclose closes them*/
+#define NDJSON_FILE "logger_ut.ndjson"
+#define JSON_ARRAY_FILE "logger_ut.json"
+static std::set<FILE*> realFiles;
+
+static FILE* real_fopen(const char* filename, const char* mode)
+{
+    FILE* result = fopen(filename, mode);
+    if (result != NULL)
+    {
+        (void)realFiles.insert(result);
+    }
+    return result;
+}
+
+static bool real_fclose(FILE* file)
+{
+    bool result = (realFiles.erase(file) != 0);
+    if (result)
+    {
+        (void)fclose(file);
+    }
+    return result;
+}
+
+static void write_file(const char* filename, const char* content)
+{
+    FILE* file = fopen(filename, "wb");
+    ASSERT_IS_NOT_NULL(file);
+    (void)fputs(content, file);
+    (void)fclose(file);
+}
+
+/*the content of the file, "missing" when there is no such file*/
+static std::string read_file(const char* filename)
+{
+    std::string result;
+    FILE* file = fopen(filename, "rb");
+    if (file == NULL)
+    {
+        result = "missing";
+    }
+    else
+    {
+        char chunk[256];
+        size_t read;
+        while ((read = fread(chunk, 1, sizeof(chunk), file)) != 0)
+        {
+            result.append(chunk, read);
+        }
+        (void)fclose(file);
+    }
+    return result;
+}
+
+static void remove_ndjson_files(void)
+{
+    char segmentName[64];
+    (void)remove(NDJSON_FILE);
+    (void)remove(JSON_ARRAY_FILE);
+    for (int i = 0; i < 10; i++)
+    {
+        (void)sprintf(segmentName, NDJSON_FILE ".%d", i);
+        (void)remove(segmentName);
+    }
+}
+
+static time_t currentTime;
+
+/*the writer thread captured by ThreadAPI_Create, ThreadAPI_Join runs it*/
+static THREAD_START_FUNC writerThread_func;
+static void* writerThread_arg;
+
 
 TYPED_MOCK_CLASS(CLoggerMocks, CGlobalMock)
 {
@@ -195,6 +278,12 @@ public:
     MOCK_STATIC_METHOD_2(, const char*, json_object_get_string, const JSON_Object*, object, const char*, name)
     MOCK_METHOD_END(const char*, (strcmp(name, "filename") == 0) ? "log.txt" : NULL);
 
+    MOCK_STATIC_METHOD_2(, double, json_object_get_number, const JSON_Object*, object, const char*, name)
+    MOCK_METHOD_END(double, 0);
+
+    MOCK_STATIC_METHOD_2(, int, json_object_get_boolean, const JSON_Object*, object, const char*, name)
+    MOCK_METHOD_END(int, -1);
+
     MOCK_STATIC_METHOD_1(, void, json_value_free, JSON_Value*, value)
         free(value);
     MOCK_VOID_METHOD_END();
@@ -262,6 +351,12 @@ public:
         free(handle);
     MOCK_VOID_METHOD_END()
 
+    MOCK_STATIC_METHOD_4(, CONSTMAP_RESULT, ConstMap_GetInternals, CONSTMAP_HANDLE, handle, const char*const**, keys, const char*const**, values, size_t*, count)
+        *keys = propertyKeys;
+        *values = propertyValues;
+        *count = sizeof(propertyKeys) / sizeof(propertyKeys[0]);
+    MOCK_METHOD_END(CONSTMAP_RESULT, CONSTMAP_OK)
+
     MOCK_STATIC_METHOD_1(, const CONSTBUFFER *, Message_GetContent, MESSAGE_HANDLE, message)
         const CONSTBUFFER * result2 = &validBuffer;
     MOCK_METHOD_END(const CONSTBUFFER *, result2)
@@ -271,11 +366,16 @@ public:
     MOCK_METHOD_END(STRING_HANDLE, result2);
 
     MOCK_STATIC_METHOD_2(, FILE*, gb_fopen, const char*, filename, const char*, mode)
-        FILE* result2 = (FILE*)malloc(8);
+        FILE* result2 = ((strcmp(mode, "ab") == 0) || (strcmp(mode, "rb") == 0) || (strcmp(mode, "wb") == 0)) ?
+            real_fopen(filename, mode) :
+            (FILE*)malloc(8);
     MOCK_METHOD_END(FILE*, result2);
     
     MOCK_STATIC_METHOD_1(, int, gb_fclose, FILE*, file)
-        free(file);
+        if (!real_fclose(file))
+        {
+            free(file);
+        }
         int result2 = 0;
     MOCK_METHOD_END(int, result2);
 
@@ -288,7 +388,7 @@ public:
     MOCK_METHOD_END(long int, result2);
 
     MOCK_STATIC_METHOD_1(, time_t, gb_time, time_t *, timer)
-        time_t result2 = (time_t)1; /*assume "1" is valid time_t*/
+        time_t result2 = currentTime; /*assume "1" is valid time_t*/
     MOCK_METHOD_END(time_t, result2);
     
     MOCK_STATIC_METHOD_1(, struct tm*, gb_localtime, const time_t *, timer)
@@ -303,13 +403,57 @@ public:
         else
         {
             strcpy(s, TIME_IN_STRFTIME);
+            if (format[strlen(format) - 1] == '\n')
+            {
+                strcat(s, "\n"); /*the NDJSON start and stop records keep their newline*/
+            }
         }
     MOCK_METHOD_END(size_t, maxsize);
+
+    // NDJSON writer
+    MOCK_STATIC_METHOD_0(, LOCK_HANDLE, Lock_Init)
+    MOCK_METHOD_END(LOCK_HANDLE, (LOCK_HANDLE)malloc(1))
+
+    MOCK_STATIC_METHOD_1(, LOCK_RESULT, Lock, LOCK_HANDLE, lock)
+    MOCK_METHOD_END(LOCK_RESULT, LOCK_OK)
+
+    MOCK_STATIC_METHOD_1(, LOCK_RESULT, Unlock, LOCK_HANDLE, lock)
+    MOCK_METHOD_END(LOCK_RESULT, LOCK_OK)
+
+    MOCK_STATIC_METHOD_1(, LOCK_RESULT, Lock_Deinit, LOCK_HANDLE, lock)
+        free(lock);
+    MOCK_METHOD_END(LOCK_RESULT, LOCK_OK)
+
+    MOCK_STATIC_METHOD_0(, COND_HANDLE, Condition_Init)
+    MOCK_METHOD_END(COND_HANDLE, (COND_HANDLE)malloc(1))
+
+    MOCK_STATIC_METHOD_1(, COND_RESULT, Condition_Post, COND_HANDLE, handle)
+    MOCK_METHOD_END(COND_RESULT, COND_OK)
+
+    MOCK_STATIC_METHOD_3(, COND_RESULT, Condition_Wait, COND_HANDLE, handle, LOCK_HANDLE, lock, int, timeout_milliseconds)
+    MOCK_METHOD_END(COND_RESULT, COND_TIMEOUT)
+
+    MOCK_STATIC_METHOD_1(, void, Condition_Deinit, COND_HANDLE, handle)
+        free(handle);
+    MOCK_VOID_METHOD_END()
+
+    MOCK_STATIC_METHOD_3(, THREADAPI_RESULT, ThreadAPI_Create, THREAD_HANDLE*, threadHandle, THREAD_START_FUNC, func, void*, arg)
+        /*the tests run the writer in ThreadAPI_Join*/
+        *threadHandle = (THREAD_HANDLE)0x42;
+        writerThread_func = func;
+        writerThread_arg = arg;
+    MOCK_METHOD_END(THREADAPI_RESULT, THREADAPI_OK)
+
+    MOCK_STATIC_METHOD_2(, THREADAPI_RESULT, ThreadAPI_Join, THREAD_HANDLE, threadHandle, int*, res)
+        *res = writerThread_func(writerThread_arg);
+    MOCK_METHOD_END(THREADAPI_RESULT, THREADAPI_OK)
 };
 
 DECLARE_GLOBAL_MOCK_METHOD_1(CLoggerMocks, , JSON_Value*, json_parse_string, const char *, filename);
 DECLARE_GLOBAL_MOCK_METHOD_1(CLoggerMocks, , JSON_Object*, json_value_get_object, const JSON_Value*, value);
 DECLARE_GLOBAL_MOCK_METHOD_2(CLoggerMocks, , const char*, json_object_get_string, const JSON_Object*, object, const char*, name);
+DECLARE_GLOBAL_MOCK_METHOD_2(CLoggerMocks, , double, json_object_get_number, const JSON_Object*, object, const char*, name);
+DECLARE_GLOBAL_MOCK_METHOD_2(CLoggerMocks, , int, json_object_get_boolean, const JSON_Object*, object, const char*, name);
 DECLARE_GLOBAL_MOCK_METHOD_1(CLoggerMocks, , void, json_value_free, JSON_Value*, value);
 
 DECLARE_GLOBAL_MOCK_METHOD_1(CLoggerMocks, , void*, gballoc_malloc, size_t, size);
@@ -329,6 +473,7 @@ DECLARE_GLOBAL_MOCK_METHOD_1(CLoggerMocks, , void, Map_Destroy, MAP_HANDLE, ptr)
 
 DECLARE_GLOBAL_MOCK_METHOD_1(CLoggerMocks, , CONSTMAP_HANDLE, Message_GetProperties, MESSAGE_HANDLE, message);
 DECLARE_GLOBAL_MOCK_METHOD_1(CLoggerMocks, , void,  ConstMap_Destroy, CONSTMAP_HANDLE, handle);
+DECLARE_GLOBAL_MOCK_METHOD_4(CLoggerMocks, , CONSTMAP_RESULT, ConstMap_GetInternals, CONSTMAP_HANDLE, handle, const char*const**, keys, const char*const**, values, size_t*, count);
 DECLARE_GLOBAL_MOCK_METHOD_1(CLoggerMocks, , const CONSTBUFFER *, Message_GetContent, MESSAGE_HANDLE, message);
 
 DECLARE_GLOBAL_MOCK_METHOD_2(CLoggerMocks, , STRING_HANDLE, Base64_Encode_Bytes, const unsigned char*, source, size_t, size);
@@ -342,6 +487,17 @@ DECLARE_GLOBAL_MOCK_METHOD_1(CLoggerMocks, , time_t, gb_time, time_t*, timer);
 DECLARE_GLOBAL_MOCK_METHOD_1(CLoggerMocks, , struct tm*, gb_localtime, const time_t*, timer);
 DECLARE_GLOBAL_MOCK_METHOD_4(CLoggerMocks, , size_t, gb_strftime, char*, s, size_t, maxsize, const char *, format, const struct tm *, timeptr);
 
+DECLARE_GLOBAL_MOCK_METHOD_0(CLoggerMocks, , LOCK_HANDLE, Lock_Init);
+DECLARE_GLOBAL_MOCK_METHOD_1(CLoggerMocks, , LOCK_RESULT, Lock, LOCK_HANDLE, lock);
+DECLARE_GLOBAL_MOCK_METHOD_1(CLoggerMocks, , LOCK_RESULT, Unlock, LOCK_HANDLE, lock);
+DECLARE_GLOBAL_MOCK_METHOD_1(CLoggerMocks, , LOCK_RESULT, Lock_Deinit, LOCK_HANDLE, lock);
+DECLARE_GLOBAL_MOCK_METHOD_0(CLoggerMocks, , COND_HANDLE, Condition_Init);
+DECLARE_GLOBAL_MOCK_METHOD_1(CLoggerMocks, , COND_RESULT, Condition_Post, COND_HANDLE, handle);
+DECLARE_GLOBAL_MOCK_METHOD_3(CLoggerMocks, , COND_RESULT, Condition_Wait, COND_HANDLE, handle, LOCK_HANDLE, lock, int, timeout_milliseconds);
+DECLARE_GLOBAL_MOCK_METHOD_1(CLoggerMocks, , void, Condition_Deinit, COND_HANDLE, handle);
+DECLARE_GLOBAL_MOCK_METHOD_3(CLoggerMocks, , THREADAPI_RESULT, ThreadAPI_Create, THREAD_HANDLE*, threadHandle, THREAD_START_FUNC, func, void*, arg);
+DECLARE_GLOBAL_MOCK_METHOD_2(CLoggerMocks, , THREADAPI_RESULT, ThreadAPI_Join, THREAD_HANDLE, threadHandle, int*, res);
+
 
 static void mocks_ResetAllCounters(void)
 {
@@ -379,10 +535,24 @@ BEGIN_TEST_SUITE(logger_ut)
 
         mocks_ResetAllCounters();
 
+        currentTime = (time_t)1;
+        remove_ndjson_files();
+        (void)memset(&validNdjsonConfig, 0, sizeof(validNdjsonConfig));
+        validNdjsonConfig.selector = LOGGING_TO_NDJSON_FILE;
+        validNdjsonConfig.selectee.loggerConfigNdjsonFile.name = NDJSON_FILE;
+        validNdjsonConfig.selectee.loggerConfigNdjsonFile.bufferSize = 4096;
+        validNdjsonConfig.selectee.loggerConfigNdjsonFile.flushIntervalMs = 250;
     }
 
     TEST_FUNCTION_CLEANUP(TestMethodCleanup)
     {
+        /*files opened by a gb_fopen that was made to fail*/
+        for (std::set<FILE*>::iterator file = realFiles.begin(); file != realFiles.end(); ++file)
+        {
+            (void)fclose(*file);
+        }
+        realFiles.clear();
+
         if (!MicroMockReleaseMutex(g_testByTest))
         {
             ASSERT_FAIL("failure in test framework at ReleaseMutex");
@@ -422,6 +592,8 @@ BEGIN_TEST_SUITE(logger_ut)
             .IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, json_object_get_string(IGNORED_PTR_ARG, "filename")) /*this is getting a json string that is what follows "filename": in the json*/
             .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, json_object_get_string(IGNORED_PTR_ARG, "format")) /*no "format" means LOGGING_TO_FILE*/
+            .IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, gballoc_malloc(sizeof(LOGGER_CONFIG)));
 		STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
 			.IgnoreArgument(1)
@@ -452,6 +624,8 @@ BEGIN_TEST_SUITE(logger_ut)
 			.IgnoreArgument(1);
 		STRICT_EXPECTED_CALL(mocks, json_object_get_string(IGNORED_PTR_ARG, "filename")) /*this is getting a json string that is what follows "filename": in the json*/
 			.IgnoreArgument(1);
+		STRICT_EXPECTED_CALL(mocks, json_object_get_string(IGNORED_PTR_ARG, "format")) /*no "format" means LOGGING_TO_FILE*/
+			.IgnoreArgument(1);
 		STRICT_EXPECTED_CALL(mocks, gballoc_malloc(sizeof(LOGGER_CONFIG)));
 		STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
 			.IgnoreArgument(1);
@@ -483,6 +657,8 @@ BEGIN_TEST_SUITE(logger_ut)
 			.IgnoreArgument(1);
 		STRICT_EXPECTED_CALL(mocks, json_object_get_string(IGNORED_PTR_ARG, "filename")) /*this is getting a json string that is what follows "filename": in the json*/
 			.IgnoreArgument(1);
+		STRICT_EXPECTED_CALL(mocks, json_object_get_string(IGNORED_PTR_ARG, "format")) /*no "format" means LOGGING_TO_FILE*/
+			.IgnoreArgument(1);
 		STRICT_EXPECTED_CALL(mocks, gballoc_malloc(sizeof(LOGGER_CONFIG)))
 			.SetFailReturn(nullptr);
 
@@ -496,6 +672,147 @@ BEGIN_TEST_SUITE(logger_ut)
 		///cleanup
 	}
     
+    /*Tests_SRS_LOGGER_30_001: [ Logger_ParseConfigurationFromJson shall read the optional string "format": "ndjson" selects LOGGING_TO_NDJSON_FILE, a missing "format" or "json" selects LOGGING_TO_FILE. ]*/
+    /*Tests_SRS_LOGGER_30_003: [ For LOGGING_TO_NDJSON_FILE, Logger_ParseConfigurationFromJson shall read the optional numbers "bufferSize" and "flushIntervalMs" (0 when missing) and the optional string "jsonArrayFilename". ]*/
+    /*Tests_SRS_LOGGER_30_019: [ For LOGGING_TO_NDJSON_FILE, Logger_ParseConfigurationFromJson shall also read the optional numbers "segmentSize", "segmentSeconds" and "maxRetainedBytes" (0 when missing) and the optional boolean "compressSegments" (false when missing). ]*/
+    TEST_FUNCTION(Logger_ParseConfigurationFromJson_reads_the_ndjson_settings)
+    {
+        ///arrange
+        CLoggerMocks mocks;
+
+        STRICT_EXPECTED_CALL(mocks, json_parse_string(VALID_CONFIG_STRING));
+        STRICT_EXPECTED_CALL(mocks, json_value_free(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, json_value_get_object(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, json_object_get_string(IGNORED_PTR_ARG, "filename"))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, json_object_get_string(IGNORED_PTR_ARG, "format"))
+            .IgnoreArgument(1)
+            .SetReturn("ndjson");
+        STRICT_EXPECTED_CALL(mocks, json_object_get_number(IGNORED_PTR_ARG, "bufferSize"))
+            .IgnoreArgument(1)
+            .SetReturn(8192.0);
+        STRICT_EXPECTED_CALL(mocks, json_object_get_number(IGNORED_PTR_ARG, "flushIntervalMs"))
+            .IgnoreArgument(1)
+            .SetReturn(250.0);
+        STRICT_EXPECTED_CALL(mocks, json_object_get_string(IGNORED_PTR_ARG, "jsonArrayFilename"))
+            .IgnoreArgument(1)
+            .SetReturn("log.json");
+        STRICT_EXPECTED_CALL(mocks, json_object_get_number(IGNORED_PTR_ARG, "segmentSize"))
+            .IgnoreArgument(1)
+            .SetReturn(1048576.0);
+        STRICT_EXPECTED_CALL(mocks, json_object_get_number(IGNORED_PTR_ARG, "segmentSeconds"))
+            .IgnoreArgument(1)
+            .SetReturn(3600.0);
+        STRICT_EXPECTED_CALL(mocks, json_object_get_number(IGNORED_PTR_ARG, "maxRetainedBytes"))
+            .IgnoreArgument(1)
+            .SetReturn(8388608.0);
+        STRICT_EXPECTED_CALL(mocks, json_object_get_boolean(IGNORED_PTR_ARG, "compressSegments"))
+            .IgnoreArgument(1)
+            .SetReturn(1);
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(sizeof(LOGGER_CONFIG)));
+        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, "log.txt"))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, "log.json"))
+            .IgnoreArgument(1);
+
+        ///act
+        auto result = (LOGGER_CONFIG*)Logger_ParseConfigurationFromJson(VALID_CONFIG_STRING);
+
+        ///assert
+        ASSERT_IS_NOT_NULL(result);
+        mocks.AssertActualAndExpectedCalls();
+        ASSERT_ARE_EQUAL(int, (int)LOGGING_TO_NDJSON_FILE, (int)result->selector);
+        ASSERT_ARE_EQUAL(char_ptr, "log.txt", result->selectee.loggerConfigNdjsonFile.name);
+        ASSERT_ARE_EQUAL(size_t, 8192, result->selectee.loggerConfigNdjsonFile.bufferSize);
+        ASSERT_ARE_EQUAL(int, 250, (int)result->selectee.loggerConfigNdjsonFile.flushIntervalMs);
+        ASSERT_ARE_EQUAL(char_ptr, "log.json", result->selectee.loggerConfigNdjsonFile.jsonArrayName);
+        ASSERT_ARE_EQUAL(size_t, 1048576, result->selectee.loggerConfigNdjsonFile.segmentSize);
+        ASSERT_ARE_EQUAL(int, 3600, (int)result->selectee.loggerConfigNdjsonFile.segmentSeconds);
+        ASSERT_ARE_EQUAL(size_t, 8388608, result->selectee.loggerConfigNdjsonFile.maxRetainedBytes);
+        ASSERT_IS_TRUE(result->selectee.loggerConfigNdjsonFile.compressSegments);
+
+        ///cleanup
+        Logger_FreeConfiguration(result);
+    }
+
+    /*Tests_SRS_LOGGER_30_002: [ If "format" has any other value, Logger_ParseConfigurationFromJson shall fail and return NULL. ]*/
+    TEST_FUNCTION(Logger_ParseConfigurationFromJson_fails_on_an_unknown_format)
+    {
+        ///arrange
+        CLoggerMocks mocks;
+
+        STRICT_EXPECTED_CALL(mocks, json_parse_string(VALID_CONFIG_STRING));
+        STRICT_EXPECTED_CALL(mocks, json_value_free(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, json_value_get_object(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, json_object_get_string(IGNORED_PTR_ARG, "filename"))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, json_object_get_string(IGNORED_PTR_ARG, "format"))
+            .IgnoreArgument(1)
+            .SetReturn("xml");
+
+        ///act
+        auto result = Logger_ParseConfigurationFromJson(VALID_CONFIG_STRING);
+
+        ///assert
+        ASSERT_IS_NULL(result);
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+    }
+
+    /*Tests_SRS_LOGGER_30_004: [ If any of these numbers is negative, Logger_ParseConfigurationFromJson shall fail and return NULL. ]*/
+    TEST_FUNCTION(Logger_ParseConfigurationFromJson_fails_on_a_negative_bufferSize)
+    {
+        ///arrange
+        CLoggerMocks mocks;
+
+        STRICT_EXPECTED_CALL(mocks, json_parse_string(VALID_CONFIG_STRING));
+        STRICT_EXPECTED_CALL(mocks, json_value_free(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, json_value_get_object(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, json_object_get_string(IGNORED_PTR_ARG, "filename"))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, json_object_get_string(IGNORED_PTR_ARG, "format"))
+            .IgnoreArgument(1)
+            .SetReturn("ndjson");
+        STRICT_EXPECTED_CALL(mocks, json_object_get_number(IGNORED_PTR_ARG, "bufferSize"))
+            .IgnoreArgument(1)
+            .SetReturn(-1.0);
+        STRICT_EXPECTED_CALL(mocks, json_object_get_number(IGNORED_PTR_ARG, "flushIntervalMs"))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, json_object_get_string(IGNORED_PTR_ARG, "jsonArrayFilename"))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, json_object_get_number(IGNORED_PTR_ARG, "segmentSize"))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, json_object_get_number(IGNORED_PTR_ARG, "segmentSeconds"))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, json_object_get_number(IGNORED_PTR_ARG, "maxRetainedBytes"))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, json_object_get_boolean(IGNORED_PTR_ARG, "compressSegments"))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(sizeof(LOGGER_CONFIG)));
+        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, "log.txt"))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)) /*the file name*/
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)) /*the configuration*/
+            .IgnoreArgument(1);
+
+        ///act
+        auto result = Logger_ParseConfigurationFromJson(VALID_CONFIG_STRING);
+
+        ///assert
+        ASSERT_IS_NULL(result);
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+    }
+
     /*Tests_SRS_LOGGER_05_012: [ If the JSON object does not contain a value named "filename" then Logger_ParseConfigurationFromJson shall fail and return NULL. ]*/
     TEST_FUNCTION(Logger_ParseConfigurationFromJson_fails_when_json_object_get_string_fails)
     {
@@ -579,6 +896,8 @@ BEGIN_TEST_SUITE(logger_ut)
 			.IgnoreArgument(1);
 		STRICT_EXPECTED_CALL(mocks, json_object_get_string(IGNORED_PTR_ARG, "filename")) /*this is getting a json string that is what follows "filename": in the json*/
 			.IgnoreArgument(1);
+		STRICT_EXPECTED_CALL(mocks, json_object_get_string(IGNORED_PTR_ARG, "format")) /*no "format" means LOGGING_TO_FILE*/
+			.IgnoreArgument(1);
 		STRICT_EXPECTED_CALL(mocks, gballoc_malloc(sizeof(LOGGER_CONFIG)));
 		STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
 			.IgnoreArgument(1)
@@ -646,7 +965,7 @@ BEGIN_TEST_SUITE(logger_ut)
         ///cleanup
     }
 
-    /*Tests_SRS_LOGGER_02_003: [If configuration->selector has a value different than LOGGING_TO_FILE then Logger_Create shall fail and return NULL.]*/
+    /*Tests_SRS_LOGGER_02_003: [If configuration->selector has a value different than LOGGING_TO_FILE or LOGGING_TO_NDJSON_FILE then Logger_Create shall fail and return NULL.]*/
     TEST_FUNCTION(Logger_Create_with_invalid_selector_fails)
     {
         ///arrange
@@ -2245,6 +2564,291 @@ BEGIN_TEST_SUITE(logger_ut)
         ///cleanup
     }
 
+    /*Tests_SRS_LOGGER_30_005: [ Logger_Create shall allocate the module and two buffers of bufferSize bytes, LOGGER_DEFAULT_BUFFER_SIZE when bufferSize is 0. ]*/
+    /*Tests_SRS_LOGGER_30_006: [ Logger_Create shall open the file name for appending, create the lock, the conditions and the writer thread, then add the start record followed by a newline. ]*/
+    TEST_FUNCTION(Logger_Create_ndjson_happy_path_succeeds)
+    {
+        ///arrange
+        CLoggerMocks mocks;
+        validNdjsonConfig.selectee.loggerConfigNdjsonFile.bufferSize = 0;
+
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is the handle*/
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(LOGGER_DEFAULT_BUFFER_SIZE)) /*this is the buffer*/
+            .ExpectedTimesExactly(2);
+        STRICT_EXPECTED_CALL(mocks, gb_fopen(NDJSON_FILE, "ab"));
+        STRICT_EXPECTED_CALL(mocks, Lock_Init());
+        STRICT_EXPECTED_CALL(mocks, Condition_Init())
+            .ExpectedTimesExactly(2);
+        STRICT_EXPECTED_CALL(mocks, ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .IgnoreAllArguments();
+        STRICT_EXPECTED_CALL(mocks, gb_time(NULL));
+        STRICT_EXPECTED_CALL(mocks, gb_localtime(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, gb_strftime(IGNORED_PTR_ARG, IGNORED_NUM_ARG, "{\"time\":\"%c\",\"content\":\"Log started\"}\n", IGNORED_PTR_ARG))
+            .IgnoreArgument(1)
+            .IgnoreArgument(2)
+            .IgnoreArgument(4);
+        STRICT_EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+
+        ///act
+        auto handle = Logger_Create(validBrokerHandle, &validNdjsonConfig);
+
+        ///assert
+        ASSERT_IS_NOT_NULL(handle);
+        mocks.AssertActualAndExpectedCalls();
+        ASSERT_ARE_EQUAL(size_t, 0, CURRENT_API_CALL(gb_fprintf));
+
+        ///cleanup
+        Logger_Destroy(handle);
+    }
+
+    /*Tests_SRS_LOGGER_30_007: [ If any of the above fails, Logger_Create shall fail, release what it created and return NULL. ]*/
+    TEST_FUNCTION(Logger_Create_ndjson_fails_when_fopen_fails)
+    {
+        ///arrange
+        CLoggerMocks mocks;
+
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is the handle*/
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(4096)) /*this is the buffer*/
+            .ExpectedTimesExactly(2);
+        STRICT_EXPECTED_CALL(mocks, gb_fopen(NDJSON_FILE, "ab"))
+            .SetFailReturn((FILE*)NULL);
+        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+            .IgnoreArgument(1)
+            .ExpectedTimesExactly(7); /*the buffers, the file names and the segments that were not allocated, the handle*/
+
+        ///act
+        auto handle = Logger_Create(validBrokerHandle, &validNdjsonConfig);
+
+        ///assert
+        ASSERT_IS_NULL(handle);
+        mocks.AssertActualAndExpectedCalls();
+    }
+
+    /*Tests_SRS_LOGGER_30_008: [ The writer thread shall write the buffer to the file when the buffer is at least half full, when flushIntervalMs have passed or when the module is destroyed. ]*/
+    /*Tests_SRS_LOGGER_30_009: [ Logger_Receive shall add to the buffer the same JSON value as LOGGING_TO_FILE followed by a newline, waiting for the writer to make room when the buffer is full. ]*/
+    /*Tests_SRS_LOGGER_30_011: [ Logger_Destroy shall add the stop record, make the writer thread write the buffer and end, then close the file. ]*/
+    TEST_FUNCTION(Logger_Receive_ndjson_appends_one_line_per_message)
+    {
+        ///arrange
+        CLoggerMocks mocks;
+        write_file(NDJSON_FILE, "{\"old\":1}\n");
+        auto moduleHandle = Logger_Create(validBrokerHandle, &validNdjsonConfig);
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, gb_time(NULL));
+        STRICT_EXPECTED_CALL(mocks, gb_localtime(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, gb_strftime(IGNORED_PTR_ARG, IGNORED_NUM_ARG, "%c", IGNORED_PTR_ARG))
+            .IgnoreArgument(1)
+            .IgnoreArgument(2)
+            .IgnoreArgument(4);
+        STRICT_EXPECTED_CALL(mocks, Message_GetProperties(validMessageHandle));
+        STRICT_EXPECTED_CALL(mocks, ConstMap_Destroy(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, Message_GetContent(validMessageHandle));
+        STRICT_EXPECTED_CALL(mocks, ConstMap_GetInternals(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .IgnoreAllArguments();
+        STRICT_EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+
+        ///act
+        Logger_Receive(moduleHandle, validMessageHandle);
+
+        ///assert
+        mocks.AssertActualAndExpectedCalls();
+        ASSERT_ARE_EQUAL(size_t, 0, CURRENT_API_CALL(gb_fprintf));
+
+        ///cleanup
+        Logger_Destroy(moduleHandle);
+        ASSERT_ARE_EQUAL(char_ptr, "{\"old\":1}\n" TIME_IN_STRFTIME "\n" EXPECTED_NDJSON_RECORD TIME_IN_STRFTIME "\n", read_file(NDJSON_FILE).c_str());
+    }
+
+    /*Tests_SRS_LOGGER_30_010: [ A record longer than the buffer shall be written to the file directly, after the records before it. ]*/
+    TEST_FUNCTION(Logger_Receive_ndjson_writes_a_record_longer_than_the_buffer_directly)
+    {
+        ///arrange
+        CLoggerMocks mocks;
+        validNdjsonConfig.selectee.loggerConfigNdjsonFile.bufferSize = 4; /*not even the start record "time\n" fits*/
+        auto moduleHandle = Logger_Create(validBrokerHandle, &validNdjsonConfig);
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(sizeof(EXPECTED_NDJSON_RECORD) - 1));
+        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+
+        ///act
+        Logger_Receive(moduleHandle, validMessageHandle);
+
+        ///assert
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        Logger_Destroy(moduleHandle);
+        ASSERT_ARE_EQUAL(char_ptr, TIME_IN_STRFTIME "\n" EXPECTED_NDJSON_RECORD TIME_IN_STRFTIME "\n", read_file(NDJSON_FILE).c_str());
+    }
+
+    /*Tests_SRS_LOGGER_30_012: [ If jsonArrayName is not NULL, Logger_Destroy shall then write all the records of the file as one JSON array to the file jsonArrayName. ]*/
+    TEST_FUNCTION(Logger_Destroy_ndjson_writes_the_json_array)
+    {
+        ///arrange
+        CLoggerMocks mocks;
+        write_file(NDJSON_FILE, "{\"old\":1}\n");
+        validNdjsonConfig.selectee.loggerConfigNdjsonFile.jsonArrayName = JSON_ARRAY_FILE;
+        auto moduleHandle = Logger_Create(validBrokerHandle, &validNdjsonConfig);
+        Logger_Receive(moduleHandle, validMessageHandle);
+
+        ///act
+        Logger_Destroy(moduleHandle);
+
+        ///assert
+        ASSERT_ARE_EQUAL(char_ptr, "{\"old\":1}\n" TIME_IN_STRFTIME "\n" EXPECTED_NDJSON_RECORD TIME_IN_STRFTIME "\n", read_file(NDJSON_FILE).c_str());
+        ASSERT_ARE_EQUAL(char_ptr, "[{\"old\":1}," TIME_IN_STRFTIME "," "{\"time\":\"time\",\"properties\":{\"deviceName\":\"firstDevice\",\"quote\":\"say \\\"hi\\\"\"},\"content\":\"AQID\"}" "," TIME_IN_STRFTIME "]", read_file(JSON_ARRAY_FILE).c_str());
+    }
+
+    /*Tests_SRS_LOGGER_30_015: [ Before writing, the module shall close the file as a segment and open a new one when the file is not empty and the write would take it over segmentSize bytes, or when it was started segmentSeconds or more ago. ]*/
+    /*Tests_SRS_LOGGER_30_016: [ When a segment is closed, the closed segments name.i (or name.i.gz) shall be renamed name.i+1, from the oldest, and the segment shall become name.1. ]*/
+    TEST_FUNCTION(Logger_Receive_ndjson_starts_a_new_segment_when_the_file_is_full)
+    {
+        ///arrange
+        CLoggerMocks mocks;
+        validNdjsonConfig.selectee.loggerConfigNdjsonFile.bufferSize = 4; /*every record is written directly*/
+        validNdjsonConfig.selectee.loggerConfigNdjsonFile.segmentSize = 1; /*one record per segment*/
+        auto moduleHandle = Logger_Create(validBrokerHandle, &validNdjsonConfig);
+
+        ///act
+        Logger_Receive(moduleHandle, validMessageHandle);
+        Logger_Receive(moduleHandle, validMessageHandle);
+        Logger_Destroy(moduleHandle);
+
+        ///assert
+        ASSERT_ARE_EQUAL(char_ptr, TIME_IN_STRFTIME "\n", read_file(NDJSON_FILE).c_str());
+        ASSERT_ARE_EQUAL(char_ptr, EXPECTED_NDJSON_RECORD, read_file(NDJSON_FILE ".1").c_str());
+        ASSERT_ARE_EQUAL(char_ptr, EXPECTED_NDJSON_RECORD, read_file(NDJSON_FILE ".2").c_str());
+        ASSERT_ARE_EQUAL(char_ptr, TIME_IN_STRFTIME "\n", read_file(NDJSON_FILE ".3").c_str());
+        ASSERT_ARE_EQUAL(char_ptr, "missing", read_file(NDJSON_FILE ".0").c_str());
+
+        ///cleanup
+        remove_ndjson_files();
+    }
+
+    /*Tests_SRS_LOGGER_30_015: [ Before writing, the module shall close the file as a segment and open a new one when the file is not empty and the write would take it over segmentSize bytes, or when it was started segmentSeconds or more ago. ]*/
+    TEST_FUNCTION(Logger_Receive_ndjson_starts_a_new_segment_when_the_file_is_old)
+    {
+        ///arrange
+        CLoggerMocks mocks;
+        validNdjsonConfig.selectee.loggerConfigNdjsonFile.bufferSize = 4;
+        validNdjsonConfig.selectee.loggerConfigNdjsonFile.segmentSeconds = 60;
+        auto moduleHandle = Logger_Create(validBrokerHandle, &validNdjsonConfig);
+
+        ///act
+        Logger_Receive(moduleHandle, validMessageHandle);
+        currentTime += 60;
+        Logger_Receive(moduleHandle, validMessageHandle);
+        Logger_Destroy(moduleHandle);
+
+        ///assert
+        ASSERT_ARE_EQUAL(char_ptr, TIME_IN_STRFTIME "\n" EXPECTED_NDJSON_RECORD, read_file(NDJSON_FILE ".1").c_str());
+        ASSERT_ARE_EQUAL(char_ptr, EXPECTED_NDJSON_RECORD TIME_IN_STRFTIME "\n", read_file(NDJSON_FILE).c_str());
+        ASSERT_ARE_EQUAL(char_ptr, "missing", read_file(NDJSON_FILE ".2").c_str());
+
+        ///cleanup
+        remove_ndjson_files();
+    }
+
+    /*Tests_SRS_LOGGER_30_018: [ When maxRetainedBytes is not 0, the oldest closed segments shall be deleted until their sizes add up to at most maxRetainedBytes. ]*/
+    TEST_FUNCTION(Logger_Receive_ndjson_deletes_the_oldest_segments_over_maxRetainedBytes)
+    {
+        ///arrange
+        CLoggerMocks mocks;
+        validNdjsonConfig.selectee.loggerConfigNdjsonFile.bufferSize = 4;
+        validNdjsonConfig.selectee.loggerConfigNdjsonFile.segmentSize = 1;
+        validNdjsonConfig.selectee.loggerConfigNdjsonFile.maxRetainedBytes = sizeof(EXPECTED_NDJSON_RECORD) - 1; /*room for one record*/
+        auto moduleHandle = Logger_Create(validBrokerHandle, &validNdjsonConfig);
+
+        ///act
+        Logger_Receive(moduleHandle, validMessageHandle);
+        Logger_Receive(moduleHandle, validMessageHandle);
+        Logger_Destroy(moduleHandle);
+
+        ///assert
+        ASSERT_ARE_EQUAL(char_ptr, TIME_IN_STRFTIME "\n", read_file(NDJSON_FILE).c_str());
+        ASSERT_ARE_EQUAL(char_ptr, EXPECTED_NDJSON_RECORD, read_file(NDJSON_FILE ".1").c_str());
+        ASSERT_ARE_EQUAL(char_ptr, "missing", read_file(NDJSON_FILE ".2").c_str());
+        ASSERT_ARE_EQUAL(char_ptr, "missing", read_file(NDJSON_FILE ".3").c_str());
+
+        ///cleanup
+        remove_ndjson_files();
+    }
+
+    /*Tests_SRS_LOGGER_30_014: [ Logger_Create shall count the closed segments name.1, name.2... (or name.i.gz) of a previous run, up to the first one missing, and the bytes of the file name. ]*/
+    TEST_FUNCTION(Logger_Create_ndjson_continues_the_segments_of_a_previous_run)
+    {
+        ///arrange
+        CLoggerMocks mocks;
+        write_file(NDJSON_FILE ".1", "{\"old\":1}\n");
+        write_file(NDJSON_FILE ".2", "{\"old\":2}\n");
+        write_file(NDJSON_FILE ".4", "{\"old\":4}\n"); /*not a segment, .3 is missing*/
+        validNdjsonConfig.selectee.loggerConfigNdjsonFile.bufferSize = 4;
+        validNdjsonConfig.selectee.loggerConfigNdjsonFile.segmentSize = 1;
+
+        ///act
+        auto moduleHandle = Logger_Create(validBrokerHandle, &validNdjsonConfig);
+        Logger_Destroy(moduleHandle);
+
+        ///assert
+        ASSERT_IS_NOT_NULL(moduleHandle);
+        ASSERT_ARE_EQUAL(char_ptr, TIME_IN_STRFTIME "\n", read_file(NDJSON_FILE).c_str());
+        ASSERT_ARE_EQUAL(char_ptr, TIME_IN_STRFTIME "\n", read_file(NDJSON_FILE ".1").c_str());
+        ASSERT_ARE_EQUAL(char_ptr, "{\"old\":1}\n", read_file(NDJSON_FILE ".2").c_str());
+        ASSERT_ARE_EQUAL(char_ptr, "{\"old\":2}\n", read_file(NDJSON_FILE ".3").c_str());
+        ASSERT_ARE_EQUAL(char_ptr, "{\"old\":4}\n", read_file(NDJSON_FILE ".4").c_str());
+
+        ///cleanup
+        remove_ndjson_files();
+    }
+
+#ifndef LOGGER_USE_ZLIB
+    /*Tests_SRS_LOGGER_30_013: [ If compressSegments is true and the module was built without use_zlib, Logger_Create shall fail and return NULL. ]*/
+    TEST_FUNCTION(Logger_Create_ndjson_fails_to_compress_without_zlib)
+    {
+        ///arrange
+        CLoggerMocks mocks;
+        validNdjsonConfig.selectee.loggerConfigNdjsonFile.segmentSize = 1024;
+        validNdjsonConfig.selectee.loggerConfigNdjsonFile.compressSegments = true;
+
+        ///act
+        auto moduleHandle = Logger_Create(validBrokerHandle, &validNdjsonConfig);
+
+        ///assert
+        ASSERT_IS_NULL(moduleHandle);
+        mocks.AssertActualAndExpectedCalls();
+    }
+#endif
+
+    /*Tests_SRS_LOGGER_30_020: [ If jsonArrayName is not NULL and segmentSize or segmentSeconds is not 0, Logger_Create shall fail and return NULL. ]*/
+    TEST_FUNCTION(Logger_Create_ndjson_fails_with_a_json_array_and_segments)
+    {
+        ///arrange
+        CLoggerMocks mocks;
+        validNdjsonConfig.selectee.loggerConfigNdjsonFile.jsonArrayName = JSON_ARRAY_FILE;
+        validNdjsonConfig.selectee.loggerConfigNdjsonFile.segmentSeconds = 60;
+
+        ///act
+        auto moduleHandle = Logger_Create(validBrokerHandle, &validNdjsonConfig);
+
+        ///assert
+        ASSERT_IS_NULL(moduleHandle);
+        mocks.AssertActualAndExpectedCalls();
+    }
+
     /*Tests_SRS_LOGGER_26_001: [ `Module_GetApi` shall return a pointer to a  `MODULE_API` structure with the required function pointers. ]*/
     TEST_FUNCTION(Module_GetApi_returns_non_NULL_and_non_NULL_fields)
     {
@@ -11,6 +11,12 @@ extern "C"
 {
 #endif
 
+/*bounds of the "load" settings*/
+#define SIMULATED_DEVICE_MAX_BURST_SIZE 100000
+#define SIMULATED_DEVICE_MAX_PAYLOAD (256 * 1024)
+#define SIMULATED_DEVICE_MAX_PROPERTIES 64
+#define SIMULATED_DEVICE_MAX_DEVICES 100000
+
 MODULE_EXPORT const MODULE_API* MODULE_STATIC_GETAPI(SIMULATED_DEVICE_MODULE)(MODULE_API_VERSION gateway_api_version);
 
 #ifdef __cplusplus
@@ -2,18 +2,54 @@
 // Licensed under the MIT license. See LICENSE file in the project root for full license information.
 
 #include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
 
 #include "simulated_device.h"
 #include "azure_c_shared_utility/threadapi.h"
 #include "azure_c_shared_utility/xlogging.h"
 #include "azure_c_shared_utility/crt_abstractions.h"
+#include "azure_c_shared_utility/map.h"
 #include "messageproperties.h"
+#include "monotonic_clock.h"
 #include "message.h"
 #include "module.h"
 #include "broker.h"
 
 #include <parson.h>
 
+#define MAC_LENGTH 17
+/*the JSON object the padding of a load message goes in, and the same object without padding*/
+#define LOAD_CONTENT_HEADER "{\"sequence\":%llu,\"sendTime\":%llu,\"padding\":\""
+#define LOAD_CONTENT_SHORT "{\"sequence\":%llu,\"sendTime\":%llu}"
+/*room for the header with the largest numbers*/
+#define LOAD_CONTENT_HEADER_MAX 96
+#define LOAD_PADDING 'x'
+
+typedef enum SIMULATEDDEVICE_PAYLOAD_DISTRIBUTION_TAG
+{
+    SIMULATEDDEVICE_PAYLOAD_UNIFORM,
+    SIMULATEDDEVICE_PAYLOAD_EXPONENTIAL
+} SIMULATEDDEVICE_PAYLOAD_DISTRIBUTION;
+
+/*the traffic of the load generator, see the devdoc for the meaning of each field*/
+typedef struct SIMULATEDDEVICE_LOAD_TAG
+{
+    double              rate;
+    size_t              burstSize;
+    unsigned int        onPeriod;
+    unsigned int        offPeriod;
+    size_t              payloadMin;
+    size_t              payloadMax;
+    SIMULATEDDEVICE_PAYLOAD_DISTRIBUTION payloadDistribution;
+    size_t              propertyCount;
+    size_t              deviceCount;
+    uint64_t            messageCount;
+    uint64_t            seed;
+} SIMULATEDDEVICE_LOAD;
+
 typedef struct SIMULATEDDEVICE_DATA_TAG
 {
     BROKER_HANDLE       broker;
@@ -21,12 +57,17 @@ typedef struct SIMULATEDDEVICE_DATA_TAG
     const char *        fakeMacAddress;
     unsigned int        messagePeriod;
     unsigned int        simulatedDeviceRunning : 1;
+    unsigned int        loadEnabled : 1;
+    SIMULATEDDEVICE_LOAD load;
+    char *              macAddresses; /*deviceCount MAC addresses of MAC_LENGTH + 1 characters*/
 } SIMULATEDDEVICE_DATA;
 
 typedef struct SIMULATEDDEVICE_CONFIG_TAG
 {
     char *              macAddress;
     unsigned int        messagePeriod;
+    unsigned int        loadEnabled; /*0 for one temperature reading per messagePeriod*/
+    SIMULATEDDEVICE_LOAD load;
 } SIMULATEDDEVICE_CONFIG;
 
 static void SimulatedDevice_Receive(MODULE_HANDLE moduleHandle, MESSAGE_HANDLE messageHandle)
@@ -88,8 +129,12 @@ static void SimulatedDevice_Destroy(MODULE_HANDLE moduleHandle)
         /* Tell thread to stop */
         module_data->simulatedDeviceRunning = 0;
         /* join the thread */
-        ThreadAPI_Join(module_data->simulatedDeviceThread, &result);
+        if (module_data->simulatedDeviceThread != NULL)
+        {
+            ThreadAPI_Join(module_data->simulatedDeviceThread, &result);
+        }
         /* free module data */
+        free(module_data->macAddresses);
         free((void*)module_data->fakeMacAddress);
         free(module_data);
     }
@@ -173,6 +218,228 @@ static int simulated_device_worker(void * user_data)
     return 0;
 }
 
+/*waits until due or until the module stops*/
+static void simulated_device_wait(SIMULATEDDEVICE_DATA* module_data, uint64_t due)
+{
+    uint64_t now;
+    while (module_data->simulatedDeviceRunning && (now = MonotonicClock_GetUs()) < due)
+    {
+        uint64_t remaining_ms = (due - now) / 1000;
+        /* sleep the milliseconds, spin on the rest so high rates keep their pace */
+        ThreadAPI_Sleep((remaining_ms > 100) ? 100 : (remaining_ms > 1) ? (unsigned int)(remaining_ms - 1) : 0);
+    }
+}
+
+/*xorshift64*, the same seed gives the same traffic*/
+static uint64_t simulated_device_random(uint64_t* state)
+{
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return *state * 2685821657736338717ULL;
+}
+
+static size_t simulated_device_payload_size(const SIMULATEDDEVICE_LOAD* load, uint64_t* state)
+{
+    size_t result;
+    size_t range = load->payloadMax - load->payloadMin;
+    if (range == 0)
+    {
+        result = load->payloadMin;
+    }
+    else if (load->payloadDistribution == SIMULATEDDEVICE_PAYLOAD_UNIFORM)
+    {
+        result = load->payloadMin + (size_t)(simulated_device_random(state) % (range + 1));
+    }
+    else
+    {
+        /* mostly small payloads and a long tail: the mean is a quarter of the range, sizes past payloadMax are drawn again */
+        double size;
+        do
+        {
+            double uniform = ((double)(simulated_device_random(state) >> 11) + 1.0) / 9007199254740993.0;
+            size = -log(uniform) * (double)range / 4.0;
+        } while (size > (double)range);
+        result = load->payloadMin + (size_t)size;
+    }
+    return result;
+}
+
+/*writes the JSON object of a load message in payload, size bytes when it is large enough*/
+static size_t simulated_device_write_content(unsigned char* payload, size_t size, size_t* header_length, unsigned long long sequence, unsigned long long send_time)
+{
+    size_t result;
+    char header[LOAD_CONTENT_HEADER_MAX];
+    int length = sprintf_s(header, sizeof(header), LOAD_CONTENT_HEADER, sequence, send_time);
+    if (length < 0 || size < (size_t)length + 2)
+    {
+        length = sprintf_s((char*)payload, LOAD_CONTENT_HEADER_MAX, LOAD_CONTENT_SHORT, sequence, send_time);
+        result = (length < 0) ? 0 : (size_t)length;
+        /* the whole header was overwritten */
+        *header_length = LOAD_CONTENT_HEADER_MAX;
+    }
+    else
+    {
+        (void)memcpy(payload, header, length);
+        /* the rest of the previous header becomes padding again */
+        if (*header_length > (size_t)length)
+        {
+            (void)memset(payload + length, LOAD_PADDING, *header_length - length);
+        }
+        *header_length = (size_t)length;
+        payload[size - 2] = '"';
+        payload[size - 1] = '}';
+        result = size;
+    }
+    return result;
+}
+
+static int simulated_device_load_worker(void * user_data)
+{
+    SIMULATEDDEVICE_DATA* module_data = (SIMULATEDDEVICE_DATA*)user_data;
+    const SIMULATEDDEVICE_LOAD* load = &(module_data->load);
+    size_t capacity = (load->payloadMax > LOAD_CONTENT_HEADER_MAX) ? load->payloadMax : LOAD_CONTENT_HEADER_MAX;
+    unsigned char* payload = (unsigned char*)malloc(capacity);
+    MAP_HANDLE properties = Map_Create(NULL);
+    uint64_t random_state = (load->seed == 0) ? 1 : load->seed;
+    uint64_t published = 0;
+    uint64_t failures = 0;
+
+    if (payload == NULL || properties == NULL)
+    {
+        LogError("unable to allocate the payload and properties of the load");
+    }
+    else
+    {
+        size_t i;
+        int status = 0;
+        if (Map_Add(properties, GW_SOURCE_PROPERTY, GW_SOURCE_BLE_TELEMETRY) != MAP_OK)
+        {
+            status = __LINE__;
+        }
+        for (i = 0; (i < load->propertyCount) && (status == 0); i++)
+        {
+            char key[32];
+            char value[32];
+            if (sprintf_s(key, sizeof(key), "property%lu", (unsigned long)i) < 0 ||
+                sprintf_s(value, sizeof(value), "value%lu", (unsigned long)i) < 0 ||
+                Map_Add(properties, key, value) != MAP_OK)
+            {
+                status = __LINE__;
+            }
+        }
+
+        if (status != 0)
+        {
+            LogError("Failed to set the properties of the load");
+        }
+        else
+        {
+            /* the bursts of an on period, 0 when there is no off period and the traffic never stops */
+            uint64_t bursts_per_window = 0;
+            uint64_t window_us = ((uint64_t)load->onPeriod + load->offPeriod) * 1000;
+            uint64_t begin = MonotonicClock_GetUs();
+            uint64_t window_start = begin;
+            uint64_t burst;
+            size_t header_length = capacity;
+            size_t device = 0;
+            int finished = 0;
+            (void)memset(payload, LOAD_PADDING, capacity);
+            if (load->rate != 0 && load->onPeriod != 0 && load->offPeriod != 0)
+            {
+                bursts_per_window = (uint64_t)(load->rate * load->onPeriod / 1000.0 / (double)load->burstSize);
+                if (bursts_per_window == 0)
+                {
+                    bursts_per_window = 1;
+                }
+            }
+
+            for (burst = 0; module_data->simulatedDeviceRunning && !finished; burst++)
+            {
+                /* when the burst is due */
+                if (load->rate != 0)
+                {
+                    uint64_t due;
+                    if (bursts_per_window == 0)
+                    {
+                        due = begin + (uint64_t)((double)burst * (double)load->burstSize * 1000000.0 / load->rate);
+                    }
+                    else
+                    {
+                        due = begin + (burst / bursts_per_window) * window_us +
+                            (uint64_t)((double)(burst % bursts_per_window) * (double)load->burstSize * 1000000.0 / load->rate);
+                    }
+                    simulated_device_wait(module_data, due);
+                }
+                else if (load->onPeriod != 0 && load->offPeriod != 0 &&
+                    MonotonicClock_GetUs() >= window_start + (uint64_t)load->onPeriod * 1000)
+                {
+                    window_start += window_us;
+                    simulated_device_wait(module_data, window_start);
+                }
+
+                for (i = 0; (i < load->burstSize) && module_data->simulatedDeviceRunning && !finished; i++)
+                {
+                    MESSAGE_CONFIG newMessageCfg;
+                    char sequence[24];
+                    char send_time[24];
+                    unsigned long long now = (unsigned long long)MonotonicClock_GetUs();
+                    size_t size = simulated_device_payload_size(load, &random_state);
+                    const char* mac_address = module_data->macAddresses + device * (MAC_LENGTH + 1);
+                    device = (device + 1 == load->deviceCount) ? 0 : device + 1;
+
+                    newMessageCfg.size = simulated_device_write_content(payload, size, &header_length, (unsigned long long)published, now);
+                    newMessageCfg.source = payload;
+                    newMessageCfg.sourceProperties = properties;
+                    if (sprintf_s(sequence, sizeof(sequence), "%llu", (unsigned long long)published) < 0 ||
+                        sprintf_s(send_time, sizeof(send_time), "%llu", now) < 0 ||
+                        Map_AddOrUpdate(properties, GW_MAC_ADDRESS_PROPERTY, mac_address) != MAP_OK ||
+                        Map_AddOrUpdate(properties, GW_SEQUENCE_PROPERTY, sequence) != MAP_OK ||
+                        Map_AddOrUpdate(properties, GW_SEND_TIME_PROPERTY, send_time) != MAP_OK)
+                    {
+                        LogError("Failed to set the properties of the message");
+                        failures++;
+                    }
+                    else
+                    {
+                        MESSAGE_HANDLE newMessage = Message_Create(&newMessageCfg);
+                        if (newMessage == NULL)
+                        {
+                            failures++;
+                        }
+                        else
+                        {
+                            if (Broker_Publish(module_data->broker, (MODULE_HANDLE)module_data, newMessage) != BROKER_OK)
+                            {
+                                failures++;
+                            }
+                            Message_Destroy(newMessage);
+                        }
+                    }
+                    /* the end of the object is padding for the next size */
+                    if (newMessageCfg.size == size && size >= 2)
+                    {
+                        payload[size - 2] = LOAD_PADDING;
+                        payload[size - 1] = LOAD_PADDING;
+                    }
+
+                    published++;
+                    finished = (published == load->messageCount);
+                }
+            }
+        }
+        LogInfo("Device: %s, published %llu messages, %llu failed",
+            module_data->fakeMacAddress, (unsigned long long)published, (unsigned long long)failures);
+    }
+
+    if (properties != NULL)
+    {
+        Map_Destroy(properties);
+    }
+    free(payload);
+    return 0;
+}
+
 static void SimulatedDevice_Start(MODULE_HANDLE moduleHandle)
 {
     if (moduleHandle == NULL)
@@ -186,7 +453,7 @@ static void SimulatedDevice_Start(MODULE_HANDLE moduleHandle)
         /* Create a fake data thread.  */
         if (ThreadAPI_Create(
             &(module_data->simulatedDeviceThread),
-            simulated_device_worker,
+            module_data->loadEnabled ? simulated_device_load_worker : simulated_device_worker,
             (void*)module_data) != THREADAPI_OK)
         {
             LogError("ThreadAPI_Create failed");
@@ -199,6 +466,67 @@ static void SimulatedDevice_Start(MODULE_HANDLE moduleHandle)
     }
 }
 
+/*the MAC address must be in the form "XX:XX:XX:XX:XX:XX" X=[0-9,a-f,A-F]*/
+static int simulated_device_parse_mac(const char * macAddress, uint64_t * mac)
+{
+    int result = 0;
+    uint64_t value = 0;
+    size_t i;
+    for (i = 0; i < MAC_LENGTH && result == 0; i++)
+    {
+        char c = macAddress[i];
+        if ((i % 3) == 2)
+        {
+            result = (c == ':') ? 0 : __LINE__;
+        }
+        else if (isxdigit((unsigned char)c))
+        {
+            value = (value << 4) | (uint64_t)(isdigit((unsigned char)c) ? (c - '0') : (toupper((unsigned char)c) - 'A' + 10));
+        }
+        else
+        {
+            result = __LINE__;
+        }
+    }
+    if (result == 0 && macAddress[MAC_LENGTH] != '\0')
+    {
+        result = __LINE__;
+    }
+    else if (result == 0)
+    {
+        *mac = value;
+    }
+    return result;
+}
+
+/*the MAC addresses of the simulated devices: macAddress, then the addresses that follow it*/
+static char * simulated_device_mac_addresses(const char * macAddress, size_t deviceCount)
+{
+    char * result;
+    uint64_t mac;
+    if (simulated_device_parse_mac(macAddress, &mac) != 0)
+    {
+        LogError("macAddress %s is not in canonical form", macAddress);
+        result = NULL;
+    }
+    else if ((result = (char *)malloc(deviceCount * (MAC_LENGTH + 1))) == NULL)
+    {
+        LogError("unable to allocate the MAC addresses");
+    }
+    else
+    {
+        size_t i;
+        for (i = 0; i < deviceCount; i++)
+        {
+            uint64_t device = (mac + i) & 0xFFFFFFFFFFFFULL;
+            (void)sprintf_s(result + i * (MAC_LENGTH + 1), MAC_LENGTH + 1, "%02X:%02X:%02X:%02X:%02X:%02X",
+                (unsigned int)(device >> 40) & 0xFF, (unsigned int)(device >> 32) & 0xFF, (unsigned int)(device >> 24) & 0xFF,
+                (unsigned int)(device >> 16) & 0xFF, (unsigned int)(device >> 8) & 0xFF, (unsigned int)device & 0xFF);
+        }
+    }
+    return result;
+}
+
 static MODULE_HANDLE SimulatedDevice_Create(BROKER_HANDLE broker, const void* configuration)
 {
     SIMULATEDDEVICE_DATA * result;
@@ -229,13 +557,26 @@ static MODULE_HANDLE SimulatedDevice_Create(BROKER_HANDLE broker, const void* co
             if (status != 0)
             {
                 LogError("MacAddress did not copy");
+                free(result);
+                result = NULL;
             }
             else
             {
                 result->fakeMacAddress = newFakeAddress;
                 result -> messagePeriod = config -> messagePeriod;
                 result->simulatedDeviceThread = NULL;
+                result->loadEnabled = config->loadEnabled ? 1 : 0;
+                result->load = config->load;
+                result->macAddresses = NULL;
 
+                if (config->loadEnabled &&
+                    (result->macAddresses = simulated_device_mac_addresses(config->macAddress, config->load.deviceCount)) == NULL)
+                {
+                    LogError("unable to make the MAC addresses of %lu devices", (unsigned long)config->load.deviceCount);
+                    free(newFakeAddress);
+                    free(result);
+                    result = NULL;
+                }
             }
 
         }
@@ -243,6 +584,56 @@ static MODULE_HANDLE SimulatedDevice_Create(BROKER_HANDLE broker, const void* co
     return result;
 }
 
+static int simulated_device_parse_load(JSON_Object* load, SIMULATEDDEVICE_LOAD* config)
+{
+    int result;
+    const char* distribution = json_object_get_string(load, "payloadDistribution");
+    double rate = json_object_get_number(load, "rate");
+    double burstSize = json_object_get_number(load, "burstSize");
+    double onPeriod = json_object_get_number(load, "onPeriod");
+    double offPeriod = json_object_get_number(load, "offPeriod");
+    double payloadMin = json_object_get_number(load, "payloadMin");
+    double payloadMax = json_object_get_number(load, "payloadMax");
+    double propertyCount = json_object_get_number(load, "propertyCount");
+    double deviceCount = json_object_get_number(load, "deviceCount");
+    double messageCount = json_object_get_number(load, "messageCount");
+    double seed = json_object_get_number(load, "seed");
+
+    if (rate < 0 || burstSize < 0 || burstSize > SIMULATED_DEVICE_MAX_BURST_SIZE ||
+        onPeriod < 0 || onPeriod > UINT32_MAX || offPeriod < 0 || offPeriod > UINT32_MAX ||
+        payloadMin < 0 || payloadMax < 0 || payloadMax > SIMULATED_DEVICE_MAX_PAYLOAD || payloadMin > SIMULATED_DEVICE_MAX_PAYLOAD ||
+        (payloadMax != 0 && payloadMax < payloadMin) ||
+        propertyCount < 0 || propertyCount > SIMULATED_DEVICE_MAX_PROPERTIES ||
+        deviceCount < 0 || deviceCount > SIMULATED_DEVICE_MAX_DEVICES ||
+        messageCount < 0 || seed < 0)
+    {
+        LogError("load settings out of range");
+        result = __LINE__;
+    }
+    else if (distribution != NULL && strcmp(distribution, "uniform") != 0 && strcmp(distribution, "exponential") != 0)
+    {
+        LogError("unknown payloadDistribution %s", distribution);
+        result = __LINE__;
+    }
+    else
+    {
+        config->rate = rate;
+        config->burstSize = (burstSize < 1) ? 1 : (size_t)burstSize;
+        config->onPeriod = (unsigned int)onPeriod;
+        config->offPeriod = (unsigned int)offPeriod;
+        config->payloadMin = (size_t)payloadMin;
+        config->payloadMax = (payloadMax == 0) ? config->payloadMin : (size_t)payloadMax;
+        config->payloadDistribution = (distribution != NULL && strcmp(distribution, "exponential") == 0) ?
+            SIMULATEDDEVICE_PAYLOAD_EXPONENTIAL : SIMULATEDDEVICE_PAYLOAD_UNIFORM;
+        config->propertyCount = (size_t)propertyCount;
+        config->deviceCount = (deviceCount < 1) ? 1 : (size_t)deviceCount;
+        config->messageCount = (uint64_t)messageCount;
+        config->seed = (uint64_t)seed;
+        result = 0;
+    }
+    return result;
+}
+
 static void * SimulatedDevice_ParseConfigurationFromJson(const char* configuration)
 {
 	SIMULATEDDEVICE_CONFIG * result;
@@ -271,14 +662,23 @@ static void * SimulatedDevice_ParseConfigurationFromJson(const char* configurati
             {
                 SIMULATEDDEVICE_CONFIG config;
                 const char* macAddress = json_object_get_string(root, "macAddress");
+                JSON_Object* load = json_object_get_object(root, "load");
+                /* a configuration without load copies zeroes rather than garbage */
+                (void)memset(&config, 0, sizeof(config));
                 if (macAddress == NULL)
                 {
                     LogError("unable to json_object_get_string");
                     result = NULL;
                 }
+                else if (load != NULL && simulated_device_parse_load(load, &(config.load)) != 0)
+                {
+                    result = NULL;
+                }
                 else
                 {
-                    int period = (int)json_object_get_number(root, "messagePeriod");
+                    /* the load generator does not use the period */
+                    int period = (load != NULL) ? 1 : (int)json_object_get_number(root, "messagePeriod");
+                    config.loadEnabled = (load != NULL);
                     if (period <= 0)
                     {
                         LogError("Invalid period time specified");
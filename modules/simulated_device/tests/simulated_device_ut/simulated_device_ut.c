@@ -0,0 +1,682 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifdef __cplusplus
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#else
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdint.h>
+#endif
+
+#include "testrunnerswitcher.h"
+#include "umock_c.h"
+
+#define ENABLE_MOCKS
+#include "module.h"
+#include "module_access.h"
+#include "azure_c_shared_utility/threadapi.h"
+#include "azure_c_shared_utility/map.h"
+#include "azure_c_shared_utility/constmap.h"
+#include "message.h"
+#include "broker.h"
+#include "parson.h"
+
+MOCKABLE_FUNCTION(, JSON_Value*, json_parse_string, const char *, string);
+MOCKABLE_FUNCTION(, JSON_Object*, json_value_get_object, const JSON_Value *, value);
+MOCKABLE_FUNCTION(, JSON_Object*, json_object_get_object, const JSON_Object *, object, const char *, name);
+MOCKABLE_FUNCTION(, const char*, json_object_get_string, const JSON_Object *, object, const char *, name);
+MOCKABLE_FUNCTION(, double, json_object_get_number, const JSON_Object *, object, const char *, name);
+MOCKABLE_FUNCTION(, void, json_value_free, JSON_Value *, value);
+
+MOCKABLE_FUNCTION(, CONSTMAP_HANDLE, Message_GetProperties, MESSAGE_HANDLE, message);
+MOCKABLE_FUNCTION(, const CONSTBUFFER*, Message_GetContent, MESSAGE_HANDLE, message);
+MOCKABLE_FUNCTION(, MESSAGE_HANDLE, Message_Create, const MESSAGE_CONFIG*, cfg);
+MOCKABLE_FUNCTION(, void, Message_Destroy, MESSAGE_HANDLE, message);
+MOCKABLE_FUNCTION(, BROKER_RESULT, Broker_Publish, BROKER_HANDLE, broker, MODULE_HANDLE, source, MESSAGE_HANDLE, message);
+
+#undef ENABLE_MOCKS
+
+#include "simulated_device.h"
+
+static TEST_MUTEX_HANDLE g_testByTest;
+static TEST_MUTEX_HANDLE g_dllByDll;
+
+#define TEST_JSON_VALUE ((JSON_Value*)0x42)
+#define TEST_ROOT ((JSON_Object*)0x43)
+#define TEST_LOAD ((JSON_Object*)0x44)
+
+/*the JSON configuration: the root object and its "load" object*/
+typedef struct TEST_LOAD_SETTING_TAG
+{
+    const char* name;
+    double value;
+} TEST_LOAD_SETTING;
+
+static TEST_LOAD_SETTING g_loadSettings[] =
+{
+    { "rate", 0 },
+    { "burstSize", 0 },
+    { "onPeriod", 0 },
+    { "offPeriod", 0 },
+    { "payloadMin", 0 },
+    { "payloadMax", 0 },
+    { "propertyCount", 0 },
+    { "deviceCount", 0 },
+    { "messageCount", 0 },
+    { "seed", 0 }
+};
+
+#define TEST_LOAD_SETTING_COUNT (sizeof(g_loadSettings) / sizeof(g_loadSettings[0]))
+
+static const char* g_macAddress;
+static double g_messagePeriod;
+static bool g_hasLoad;
+static const char* g_payloadDistribution;
+
+static void set_load(const char* name, double value)
+{
+    size_t i;
+    for (i = 0; i < TEST_LOAD_SETTING_COUNT; i++)
+    {
+        if (strcmp(g_loadSettings[i].name, name) == 0)
+        {
+            g_loadSettings[i].value = value;
+        }
+    }
+}
+
+static void reset_configuration(void)
+{
+    size_t i;
+    for (i = 0; i < TEST_LOAD_SETTING_COUNT; i++)
+    {
+        g_loadSettings[i].value = 0;
+    }
+    g_macAddress = "01:02:03:04:05:06";
+    g_messagePeriod = 0;
+    g_hasLoad = true;
+    g_payloadDistribution = NULL;
+}
+
+static JSON_Value* my_json_parse_string(const char* string)
+{
+    (void)string;
+    return TEST_JSON_VALUE;
+}
+
+static JSON_Object* my_json_value_get_object(const JSON_Value* value)
+{
+    (void)value;
+    return TEST_ROOT;
+}
+
+static JSON_Object* my_json_object_get_object(const JSON_Object* object, const char* name)
+{
+    return (object == TEST_ROOT && strcmp(name, "load") == 0 && g_hasLoad) ? TEST_LOAD : NULL;
+}
+
+static const char* my_json_object_get_string(const JSON_Object* object, const char* name)
+{
+    const char* result = NULL;
+    if (object == TEST_ROOT && strcmp(name, "macAddress") == 0)
+    {
+        result = g_macAddress;
+    }
+    else if (object == TEST_LOAD && strcmp(name, "payloadDistribution") == 0)
+    {
+        result = g_payloadDistribution;
+    }
+    return result;
+}
+
+/*parson returns 0 for a number that is not there*/
+static double my_json_object_get_number(const JSON_Object* object, const char* name)
+{
+    double result = 0;
+    if (object == TEST_ROOT && strcmp(name, "messagePeriod") == 0)
+    {
+        result = g_messagePeriod;
+    }
+    else if (object == TEST_LOAD)
+    {
+        size_t i;
+        for (i = 0; i < TEST_LOAD_SETTING_COUNT; i++)
+        {
+            if (strcmp(g_loadSettings[i].name, name) == 0)
+            {
+                result = g_loadSettings[i].value;
+            }
+        }
+    }
+    return result;
+}
+
+/*the worker is run by the test, once Start has created it*/
+static THREAD_START_FUNC g_threadFunc;
+static void* g_threadArg;
+
+static THREADAPI_RESULT my_ThreadAPI_Create(THREAD_HANDLE* threadHandle, THREAD_START_FUNC func, void* arg)
+{
+    g_threadFunc = func;
+    g_threadArg = arg;
+    *threadHandle = (THREAD_HANDLE)0x46;
+    return THREADAPI_OK;
+}
+
+static THREADAPI_RESULT my_ThreadAPI_Join(THREAD_HANDLE threadHandle, int* res)
+{
+    (void)threadHandle;
+    *res = 0;
+    return THREADAPI_OK;
+}
+
+/*what the load published: the content and the MAC address of each message*/
+#define TEST_MAX_MESSAGES 256
+#define TEST_MAX_CONTENT 512
+
+static char g_contents[TEST_MAX_MESSAGES][TEST_MAX_CONTENT + 1];
+static size_t g_sizes[TEST_MAX_MESSAGES];
+static size_t g_contentCount;
+static char g_macAddresses[TEST_MAX_MESSAGES][18];
+static size_t g_macAddressCount;
+
+static MAP_RESULT my_Map_AddOrUpdate(MAP_HANDLE handle, const char* key, const char* value)
+{
+    (void)handle;
+    if (strcmp(key, "macAddress") == 0 && g_macAddressCount < TEST_MAX_MESSAGES)
+    {
+        (void)strncpy(g_macAddresses[g_macAddressCount], value, sizeof(g_macAddresses[0]) - 1);
+        g_macAddresses[g_macAddressCount][sizeof(g_macAddresses[0]) - 1] = '\0';
+        g_macAddressCount++;
+    }
+    return MAP_OK;
+}
+
+static MESSAGE_HANDLE my_Message_Create(const MESSAGE_CONFIG* cfg)
+{
+    if (g_contentCount < TEST_MAX_MESSAGES)
+    {
+        size_t size = (cfg->size > TEST_MAX_CONTENT) ? TEST_MAX_CONTENT : cfg->size;
+        (void)memcpy(g_contents[g_contentCount], cfg->source, size);
+        g_contents[g_contentCount][size] = '\0';
+        g_sizes[g_contentCount] = cfg->size;
+        g_contentCount++;
+    }
+    return (MESSAGE_HANDLE)0x50;
+}
+
+/*parses the configuration, creates the module and runs its load until messageCount messages are published*/
+static void run_load(void)
+{
+    const MODULE_API* apis = Module_GetApi(MODULE_API_VERSION_1);
+    void* configuration = MODULE_PARSE_CONFIGURATION_FROM_JSON(apis)("{}");
+    MODULE_HANDLE module;
+    ASSERT_IS_NOT_NULL(configuration);
+    module = MODULE_CREATE(apis)((BROKER_HANDLE)0x42, configuration);
+    MODULE_FREE_CONFIGURATION(apis)(configuration);
+    ASSERT_IS_NOT_NULL(module);
+
+    MODULE_START(apis)(module);
+    ASSERT_IS_NOT_NULL(g_threadFunc);
+    (void)g_threadFunc(g_threadArg);
+
+    MODULE_DESTROY(apis)(module);
+}
+
+/*checks that the content of the index-th message is either {"sequence":index,"sendTime":T,"padding":"x...x"} filling the
+  whole payload, or {"sequence":index,"sendTime":T} when the payload is too small for the padding*/
+static void assert_load_content(size_t index)
+{
+    const char* content = g_contents[index];
+    size_t size = g_sizes[index];
+    char prefix[64];
+    const char* sendTime;
+    size_t digits;
+    (void)sprintf(prefix, "{\"sequence\":%lu,\"sendTime\":", (unsigned long)index);
+    ASSERT_ARE_EQUAL(int, 0, strncmp(content, prefix, strlen(prefix)));
+
+    sendTime = content + strlen(prefix);
+    digits = strspn(sendTime, "0123456789");
+    ASSERT_IS_TRUE(digits > 0);
+    if (sendTime[digits] == '}')
+    {
+        ASSERT_ARE_EQUAL(size_t, (size_t)(sendTime - content) + digits + 1, size);
+    }
+    else
+    {
+        const char* padding = sendTime + digits;
+        ASSERT_ARE_EQUAL(int, 0, strncmp(padding, ",\"padding\":\"", strlen(",\"padding\":\"")));
+        padding += strlen(",\"padding\":\"");
+        ASSERT_ARE_EQUAL(size_t, size - 2, (size_t)(padding - content) + strspn(padding, "x"));
+        ASSERT_ARE_EQUAL(char, '"', content[size - 2]);
+        ASSERT_ARE_EQUAL(char, '}', content[size - 1]);
+    }
+}
+
+DEFINE_ENUM_STRINGS(UMOCK_C_ERROR_CODE, UMOCK_C_ERROR_CODE_VALUES)
+
+static void on_umock_c_error(UMOCK_C_ERROR_CODE error_code)
+{
+    char temp_str[256];
+    (void)snprintf(temp_str, sizeof(temp_str), "umock_c reported error :%s", ENUM_TO_STRING(UMOCK_C_ERROR_CODE, error_code));
+    ASSERT_FAIL(temp_str);
+}
+
+
+BEGIN_TEST_SUITE(simulated_device_ut)
+
+TEST_SUITE_INITIALIZE(suite_init)
+{
+    TEST_INITIALIZE_MEMORY_DEBUG(g_dllByDll);
+    g_testByTest = TEST_MUTEX_CREATE();
+    ASSERT_IS_NOT_NULL(g_testByTest);
+
+    umock_c_init(on_umock_c_error);
+
+    REGISTER_GLOBAL_MOCK_HOOK(json_parse_string, my_json_parse_string);
+    REGISTER_GLOBAL_MOCK_HOOK(json_value_get_object, my_json_value_get_object);
+    REGISTER_GLOBAL_MOCK_HOOK(json_object_get_object, my_json_object_get_object);
+    REGISTER_GLOBAL_MOCK_HOOK(json_object_get_string, my_json_object_get_string);
+    REGISTER_GLOBAL_MOCK_HOOK(json_object_get_number, my_json_object_get_number);
+    REGISTER_GLOBAL_MOCK_HOOK(ThreadAPI_Create, my_ThreadAPI_Create);
+    REGISTER_GLOBAL_MOCK_HOOK(ThreadAPI_Join, my_ThreadAPI_Join);
+    REGISTER_GLOBAL_MOCK_RETURN(Map_Create, (MAP_HANDLE)0x47);
+    REGISTER_GLOBAL_MOCK_RETURN(Map_Add, MAP_OK);
+    REGISTER_GLOBAL_MOCK_HOOK(Map_AddOrUpdate, my_Map_AddOrUpdate);
+    REGISTER_GLOBAL_MOCK_HOOK(Message_Create, my_Message_Create);
+    REGISTER_GLOBAL_MOCK_RETURN(Broker_Publish, BROKER_OK);
+
+    REGISTER_UMOCK_ALIAS_TYPE(MODULE_HANDLE, void*);
+
+    REGISTER_UMOCK_ALIAS_TYPE(BROKER_HANDLE, void*);
+
+    REGISTER_UMOCK_ALIAS_TYPE(BROKER_RESULT, int);
+
+    REGISTER_UMOCK_ALIAS_TYPE(MESSAGE_HANDLE, void*);
+
+    REGISTER_UMOCK_ALIAS_TYPE(MAP_HANDLE, void*);
+
+    REGISTER_UMOCK_ALIAS_TYPE(MAP_FILTER_CALLBACK, void*);
+
+    REGISTER_UMOCK_ALIAS_TYPE(MAP_RESULT, int);
+
+    REGISTER_UMOCK_ALIAS_TYPE(CONSTMAP_HANDLE, void*);
+
+    REGISTER_UMOCK_ALIAS_TYPE(CONSTMAP_RESULT, int);
+
+    REGISTER_UMOCK_ALIAS_TYPE(THREAD_HANDLE, void*);
+
+    REGISTER_UMOCK_ALIAS_TYPE(THREAD_START_FUNC, void*);
+
+    REGISTER_UMOCK_ALIAS_TYPE(THREADAPI_RESULT, int);
+}
+
+TEST_SUITE_CLEANUP(suite_cleanup)
+{
+    umock_c_deinit();
+    TEST_MUTEX_DESTROY(g_testByTest);
+    TEST_DEINITIALIZE_MEMORY_DEBUG(g_dllByDll);
+}
+
+TEST_FUNCTION_INITIALIZE(method_init)
+{
+    if (TEST_MUTEX_ACQUIRE(g_testByTest))
+    {
+        ASSERT_FAIL("our mutex is ABANDONED. Failure in test framework");
+    }
+
+    umock_c_reset_all_calls();
+    reset_configuration();
+    g_threadFunc = NULL;
+    g_threadArg = NULL;
+    g_contentCount = 0;
+    g_macAddressCount = 0;
+}
+
+TEST_FUNCTION_CLEANUP(method_cleanup)
+{
+    TEST_MUTEX_RELEASE(g_testByTest);
+}
+
+TEST_FUNCTION(SimulatedDevice_Module_GetApi_returns_non_NULL)
+{
+    // arrange
+
+    // act
+    const MODULE_API* apis = Module_GetApi(MODULE_API_VERSION_1);
+
+    // assert
+    ASSERT_IS_TRUE(MODULE_PARSE_CONFIGURATION_FROM_JSON(apis) != NULL);
+    ASSERT_IS_TRUE(MODULE_FREE_CONFIGURATION(apis) != NULL);
+    ASSERT_IS_TRUE(MODULE_CREATE(apis) != NULL);
+    ASSERT_IS_TRUE(MODULE_DESTROY(apis) != NULL);
+    ASSERT_IS_TRUE(MODULE_RECEIVE(apis) != NULL);
+    ASSERT_IS_TRUE(MODULE_START(apis) != NULL);
+}
+
+TEST_FUNCTION(SimulatedDevice_ParseConfigurationFromJson_returns_NULL_when_configuration_is_NULL)
+{
+    // arrange
+    const MODULE_API* apis = Module_GetApi(MODULE_API_VERSION_1);
+
+    // act
+    void* result = MODULE_PARSE_CONFIGURATION_FROM_JSON(apis)(NULL);
+
+    // assert
+    ASSERT_IS_NULL(result);
+}
+
+TEST_FUNCTION(SimulatedDevice_ParseConfigurationFromJson_returns_NULL_without_macAddress)
+{
+    // arrange
+    const MODULE_API* apis = Module_GetApi(MODULE_API_VERSION_1);
+    g_macAddress = NULL;
+
+    // act
+    void* result = MODULE_PARSE_CONFIGURATION_FROM_JSON(apis)("{}");
+
+    // assert
+    ASSERT_IS_NULL(result);
+}
+
+TEST_FUNCTION(SimulatedDevice_ParseConfigurationFromJson_without_load_needs_a_positive_messagePeriod)
+{
+    // arrange
+    const MODULE_API* apis = Module_GetApi(MODULE_API_VERSION_1);
+    void* without_period;
+    void* with_period;
+    MODULE_HANDLE module;
+    g_hasLoad = false;
+
+    // act
+    without_period = MODULE_PARSE_CONFIGURATION_FROM_JSON(apis)("{}");
+    g_messagePeriod = 500;
+    with_period = MODULE_PARSE_CONFIGURATION_FROM_JSON(apis)("{}");
+    module = MODULE_CREATE(apis)((BROKER_HANDLE)0x42, with_period);
+    MODULE_START(apis)(module);
+
+    // assert
+    ASSERT_IS_NULL(without_period);
+    ASSERT_IS_NOT_NULL(with_period);
+    ASSERT_IS_NOT_NULL(module);
+    ASSERT_IS_NOT_NULL(g_threadFunc);
+    ASSERT_ARE_EQUAL(size_t, 0, g_contentCount);
+
+    // cleanup
+    MODULE_DESTROY(apis)(module);
+    MODULE_FREE_CONFIGURATION(apis)(with_period);
+}
+
+TEST_FUNCTION(SimulatedDevice_ParseConfigurationFromJson_returns_NULL_for_load_settings_out_of_range)
+{
+    // arrange
+    const MODULE_API* apis = Module_GetApi(MODULE_API_VERSION_1);
+    const TEST_LOAD_SETTING out_of_range[] =
+    {
+        { "rate", -1 },
+        { "burstSize", -1 },
+        { "burstSize", SIMULATED_DEVICE_MAX_BURST_SIZE + 1 },
+        { "onPeriod", -1 },
+        { "onPeriod", 4294967296.0 },
+        { "offPeriod", -1 },
+        { "offPeriod", 4294967296.0 },
+        { "payloadMin", -1 },
+        { "payloadMin", SIMULATED_DEVICE_MAX_PAYLOAD + 1 },
+        { "payloadMax", -1 },
+        { "payloadMax", SIMULATED_DEVICE_MAX_PAYLOAD + 1 },
+        { "propertyCount", -1 },
+        { "propertyCount", SIMULATED_DEVICE_MAX_PROPERTIES + 1 },
+        { "deviceCount", -1 },
+        { "deviceCount", SIMULATED_DEVICE_MAX_DEVICES + 1 },
+        { "messageCount", -1 },
+        { "seed", -1 }
+    };
+    size_t i;
+
+    for (i = 0; i < sizeof(out_of_range) / sizeof(out_of_range[0]); i++)
+    {
+        void* result;
+        reset_configuration();
+        set_load(out_of_range[i].name, out_of_range[i].value);
+
+        // act
+        result = MODULE_PARSE_CONFIGURATION_FROM_JSON(apis)("{}");
+
+        // assert
+        ASSERT_IS_NULL(result);
+    }
+}
+
+TEST_FUNCTION(SimulatedDevice_ParseConfigurationFromJson_returns_NULL_when_payloadMax_is_less_than_payloadMin)
+{
+    // arrange
+    const MODULE_API* apis = Module_GetApi(MODULE_API_VERSION_1);
+    set_load("payloadMin", 100);
+    set_load("payloadMax", 99);
+
+    // act
+    void* result = MODULE_PARSE_CONFIGURATION_FROM_JSON(apis)("{}");
+
+    // assert
+    ASSERT_IS_NULL(result);
+}
+
+TEST_FUNCTION(SimulatedDevice_ParseConfigurationFromJson_returns_NULL_for_an_unknown_payloadDistribution)
+{
+    // arrange
+    const MODULE_API* apis = Module_GetApi(MODULE_API_VERSION_1);
+    g_payloadDistribution = "normal";
+
+    // act
+    void* result = MODULE_PARSE_CONFIGURATION_FROM_JSON(apis)("{}");
+
+    // assert
+    ASSERT_IS_NULL(result);
+}
+
+TEST_FUNCTION(SimulatedDevice_ParseConfigurationFromJson_accepts_load_settings_at_their_bounds)
+{
+    // arrange
+    const MODULE_API* apis = Module_GetApi(MODULE_API_VERSION_1);
+    set_load("burstSize", SIMULATED_DEVICE_MAX_BURST_SIZE);
+    set_load("onPeriod", 4294967295.0);
+    set_load("offPeriod", 4294967295.0);
+    set_load("payloadMin", SIMULATED_DEVICE_MAX_PAYLOAD);
+    set_load("payloadMax", SIMULATED_DEVICE_MAX_PAYLOAD);
+    set_load("propertyCount", SIMULATED_DEVICE_MAX_PROPERTIES);
+    set_load("deviceCount", SIMULATED_DEVICE_MAX_DEVICES);
+    g_payloadDistribution = "exponential";
+
+    // act
+    void* result = MODULE_PARSE_CONFIGURATION_FROM_JSON(apis)("{}");
+
+    // assert
+    ASSERT_IS_NOT_NULL(result);
+
+    // cleanup
+    MODULE_FREE_CONFIGURATION(apis)(result);
+}
+
+TEST_FUNCTION(SimulatedDevice_Create_returns_NULL_when_the_macAddress_of_a_load_is_not_canonical)
+{
+    // arrange
+    const MODULE_API* apis = Module_GetApi(MODULE_API_VERSION_1);
+    void* configuration;
+    MODULE_HANDLE result;
+    g_macAddress = "01:02:03:04:05";
+    configuration = MODULE_PARSE_CONFIGURATION_FROM_JSON(apis)("{}");
+
+    // act
+    result = MODULE_CREATE(apis)((BROKER_HANDLE)0x42, configuration);
+
+    // assert
+    ASSERT_IS_NOT_NULL(configuration);
+    ASSERT_IS_NULL(result);
+
+    // cleanup
+    MODULE_FREE_CONFIGURATION(apis)(configuration);
+}
+
+TEST_FUNCTION(SimulatedDevice_load_gives_each_device_the_MAC_address_following_the_previous_one)
+{
+    // arrange
+    g_macAddress = "01:02:03:04:05:FE";
+    set_load("deviceCount", 3);
+    set_load("messageCount", 7);
+
+    // act
+    run_load();
+
+    // assert
+    ASSERT_ARE_EQUAL(size_t, 7, g_macAddressCount);
+    ASSERT_ARE_EQUAL(char_ptr, "01:02:03:04:05:FE", g_macAddresses[0]);
+    ASSERT_ARE_EQUAL(char_ptr, "01:02:03:04:05:FF", g_macAddresses[1]);
+    ASSERT_ARE_EQUAL(char_ptr, "01:02:03:04:06:00", g_macAddresses[2]);
+    ASSERT_ARE_EQUAL(char_ptr, "01:02:03:04:05:FE", g_macAddresses[3]);
+    ASSERT_ARE_EQUAL(char_ptr, "01:02:03:04:05:FF", g_macAddresses[4]);
+    ASSERT_ARE_EQUAL(char_ptr, "01:02:03:04:06:00", g_macAddresses[5]);
+    ASSERT_ARE_EQUAL(char_ptr, "01:02:03:04:05:FE", g_macAddresses[6]);
+}
+
+TEST_FUNCTION(SimulatedDevice_load_wraps_the_MAC_addresses_around_48_bits)
+{
+    // arrange
+    g_macAddress = "ff:ff:ff:ff:ff:ff";
+    set_load("deviceCount", 2);
+    set_load("messageCount", 2);
+
+    // act
+    run_load();
+
+    // assert
+    ASSERT_ARE_EQUAL(size_t, 2, g_macAddressCount);
+    ASSERT_ARE_EQUAL(char_ptr, "FF:FF:FF:FF:FF:FF", g_macAddresses[0]);
+    ASSERT_ARE_EQUAL(char_ptr, "00:00:00:00:00:00", g_macAddresses[1]);
+}
+
+TEST_FUNCTION(SimulatedDevice_load_draws_uniform_payload_sizes_within_bounds)
+{
+    // arrange
+    size_t smallest = SIZE_MAX;
+    size_t largest = 0;
+    size_t i;
+    set_load("payloadMin", 200);
+    set_load("payloadMax", 300);
+    set_load("messageCount", 200);
+    set_load("seed", 7);
+
+    // act
+    run_load();
+
+    // assert
+    ASSERT_ARE_EQUAL(size_t, 200, g_contentCount);
+    for (i = 0; i < g_contentCount; i++)
+    {
+        smallest = (g_sizes[i] < smallest) ? g_sizes[i] : smallest;
+        largest = (g_sizes[i] > largest) ? g_sizes[i] : largest;
+        assert_load_content(i);
+    }
+    ASSERT_IS_TRUE(smallest >= 200);
+    ASSERT_IS_TRUE(largest <= 300);
+    ASSERT_IS_TRUE(smallest < largest);
+}
+
+TEST_FUNCTION(SimulatedDevice_load_draws_exponential_payload_sizes_within_bounds)
+{
+    // arrange
+    size_t total = 0;
+    size_t i;
+    set_load("payloadMin", 200);
+    set_load("payloadMax", 300);
+    set_load("messageCount", 200);
+    set_load("seed", 7);
+    g_payloadDistribution = "exponential";
+
+    // act
+    run_load();
+
+    // assert
+    ASSERT_ARE_EQUAL(size_t, 200, g_contentCount);
+    for (i = 0; i < g_contentCount; i++)
+    {
+        ASSERT_IS_TRUE(g_sizes[i] >= 200);
+        ASSERT_IS_TRUE(g_sizes[i] <= 300);
+        total += g_sizes[i];
+    }
+    /*the mean is a quarter of the range above payloadMin*/
+    ASSERT_IS_TRUE(total / g_contentCount < 250);
+}
+
+TEST_FUNCTION(SimulatedDevice_load_pads_the_content_to_the_payload_size)
+{
+    // arrange
+    size_t i;
+    set_load("payloadMin", 150);
+    set_load("payloadMax", 150);
+    set_load("messageCount", 3);
+
+    // act
+    run_load();
+
+    // assert
+    ASSERT_ARE_EQUAL(size_t, 3, g_contentCount);
+    for (i = 0; i < g_contentCount; i++)
+    {
+        ASSERT_ARE_EQUAL(size_t, 150, g_sizes[i]);
+        ASSERT_IS_NOT_NULL(strstr(g_contents[i], "\"padding\":\""));
+        assert_load_content(i);
+    }
+}
+
+TEST_FUNCTION(SimulatedDevice_load_writes_the_content_without_padding_when_the_payload_is_too_small)
+{
+    // arrange
+    size_t i;
+    set_load("payloadMin", 10);
+    set_load("payloadMax", 10);
+    set_load("messageCount", 3);
+
+    // act
+    run_load();
+
+    // assert
+    ASSERT_ARE_EQUAL(size_t, 3, g_contentCount);
+    for (i = 0; i < g_contentCount; i++)
+    {
+        ASSERT_IS_NULL(strstr(g_contents[i], "padding"));
+        assert_load_content(i);
+    }
+}
+
+TEST_FUNCTION(SimulatedDevice_load_rewrites_the_content_in_place_for_any_sequence_of_sizes)
+{
+    // arrange
+    size_t padded = 0;
+    size_t i;
+    set_load("payloadMin", 0);
+    set_load("payloadMax", 120);
+    set_load("messageCount", 200);
+    set_load("seed", 11);
+
+    // act
+    run_load();
+
+    // assert
+    ASSERT_ARE_EQUAL(size_t, 200, g_contentCount);
+    for (i = 0; i < g_contentCount; i++)
+    {
+        padded += (strstr(g_contents[i], "padding") != NULL) ? 1 : 0;
+        assert_load_content(i);
+    }
+    /*both kinds of content follow each other*/
+    ASSERT_IS_TRUE(padded > 0);
+    ASSERT_IS_TRUE(padded < g_contentCount);
+}
+
+END_TEST_SUITE(simulated_device_ut)
@@ -10,6 +10,7 @@ local_install=$build_root/install-deps
 log_dir=$build_root
 run_unittests=OFF
 run_e2e_tests=OFF
+build_perf=OFF
 run_valgrind=0
 enable_java_binding=OFF
 enable_nodejs_binding=OFF
@@ -30,6 +31,7 @@ usage ()
     echo " --toolchain-file <file>       Pass CMake a toolchain file for cross-compiling"
     echo " --run-unittests               Build/run unit tests"
     echo " --run-e2e-tests               Build/run end-to-end tests"
+    echo " --build-perf                  Build the performance benchmarks"
     echo " --enable-java-binding         Build the Java binding"
     echo "                               (JAVA_HOME must be defined in your environment)"
     echo " --enable-nodejs-binding       Build Node.js binding"
@@ -65,6 +67,7 @@ process_args ()
               "-c" | "--clean" ) build_clean=1;;
               "--run-unittests" ) run_unittests=ON;;
               "--run-e2e-tests" ) run_e2e_tests=ON;;
+              "--build-perf" ) build_perf=ON;;
               "-cl" | "--compileoption" ) save_next_arg=1;;
               "-rv" | "--run-valgrind" ) run_valgrind=1;;
               "--enable-java-binding" ) enable_java_binding=ON;;
@@ -126,6 +129,7 @@ cmake $toolchainfile \
       -DCMAKE_BUILD_TYPE=Debug \
       -Drun_unittests:BOOL=$run_unittests \
       -Drun_e2e_tests:BOOL=$run_e2e_tests \
+      -Dbuild_perf:BOOL=$build_perf \
       -Denable_java_binding:BOOL=$enable_java_binding \
       -Denable_nodejs_binding:BOOL=$enable_nodejs_binding \
       -Denable_ble_module:BOOL=$enable_ble_module \